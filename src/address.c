@@ -29,75 +29,322 @@
 
 #include "config.h"
 #include "address.h"
+#include <stdlib.h>
 #include <string.h>
 #include <pcap.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+//! Initial number of slots of local addresses set
+#define ADDRESS_LOCAL_SLOTS 64
+//! Buffer size to read address change notifications
+#define ADDRESS_NETLINK_BUFSIZE 8192
+
+//! Local addresses loading states
+enum address_local_state {
+    ADDRESS_LOCAL_NONE = 0,
+    ADDRESS_LOCAL_LOADING,
+    ADDRESS_LOCAL_LOADED,
+};
+
+//! Local devices addresses set (open addressing, power of two slots)
+static address_t *local_addrs = NULL;
+//! Number of slots of local addresses set
+static size_t local_size = 0;
+//! Local addresses loading state (see address_local_state)
+static int local_state = 0;
+#ifdef __linux__
+//! Netlink socket with address change notifications (-1 if none)
+static int local_nl = -1;
+//! Last time address change notifications were read
+static time_t local_checked = 0;
+#endif
+
+/**
+ * @brief Number of bytes of binary IP for given family
+ */
+static size_t
+address_ip_len(int family)
+{
+    return (family == AF_INET6) ? 16 : (family == AF_INET) ? 4 : 0;
+}
 
 bool
 addressport_equals(address_t addr1, address_t addr2)
 {
-    return addr1.port == addr2.port && !strcmp(addr1.ip, addr2.ip);
+    return addr1.port == addr2.port && address_equals(addr1, addr2);
 }
 
 bool
 address_equals(address_t addr1, address_t addr2)
 {
-    return !strcmp(addr1.ip, addr2.ip);
+    if (addr1.family != addr2.family)
+        return false;
+
+    if (addr1.family == AF_INET)
+        return addr1.ip.words[0] == addr2.ip.words[0];
+
+    return !memcmp(addr1.ip.bytes, addr2.ip.bytes, address_ip_len(addr1.family));
 }
 
-bool
-address_is_local(address_t addr)
+/**
+ * @brief Hash of the binary IP of given address
+ */
+static uint32_t
+address_ip_hash(address_t addr)
+{
+    uint32_t hash = addr.family;
+    size_t i;
+
+    for (i = 0; i < address_ip_len(addr.family) / 4; i++)
+        hash = (hash ^ addr.ip.words[i]) * 0x9E3779B1u;
+
+    return hash ^ (hash >> 16);
+}
+
+/**
+ * @brief Get the address of a device socket address
+ *
+ * @return 0 if the socket address is IPv4 or IPv6, 1 otherwise
+ */
+static int
+address_from_sockaddr(address_t *addr, const struct sockaddr *sa)
 {
-    //! Local devices pointer
-    static pcap_if_t *devices = 0;
-    pcap_if_t *dev;
+    if (!sa)
+        return 1;
+
+    switch (sa->sa_family) {
+        case AF_INET:
+            address_set_ip(addr, AF_INET, &((struct sockaddr_in *) sa)->sin_addr);
+            return 0;
+#ifdef USE_IPV6
+        case AF_INET6:
+            address_set_ip(addr, AF_INET6, &((struct sockaddr_in6 *) sa)->sin6_addr);
+            return 0;
+#endif
+        default:
+            return 1;
+    }
+}
+
+/**
+ * @brief Get the local addresses set slot of given address
+ *
+ * @return slot with the address or the empty slot where it would be added
+ */
+static address_t *
+address_local_slot(address_t addr)
+{
+    size_t pos = address_ip_hash(addr) & (local_size - 1);
+
+    while (local_addrs[pos].family && !address_equals(local_addrs[pos], addr))
+        pos = (pos + 1) & (local_size - 1);
+
+    return &local_addrs[pos];
+}
+
+/**
+ * @brief Fill the local addresses set with all device addresses
+ */
+static void
+address_local_load()
+{
+    pcap_if_t *devices = NULL, *dev;
     pcap_addr_t *da;
     char errbuf[PCAP_ERRBUF_SIZE];
-    struct sockaddr_in *ipaddr;
-#ifdef USE_IPV6
-    struct sockaddr_in6 *ip6addr;
+    address_t local;
+    size_t count = 0, size;
+
+    // Get Local devices addresses
+    if (pcap_findalldevs(&devices, errbuf) != 0)
+        devices = NULL;
+
+    for (dev = devices; dev; dev = dev->next) {
+        for (da = dev->addresses; da; da = da->next)
+            count++;
+    }
+
+    // Keep the set at most half full
+    for (size = ADDRESS_LOCAL_SLOTS; size < count * 2; size <<= 1);
+
+    free(local_addrs);
+    local_size = (local_addrs = calloc(size, sizeof(address_t))) ? size : 0;
+
+    for (dev = devices; dev && local_size; dev = dev->next) {
+        for (da = dev->addresses; da; da = da->next) {
+            if (address_from_sockaddr(&local, da->addr) == 0)
+                *address_local_slot(local) = local;
+        }
+    }
+
+    if (devices)
+        pcap_freealldevs(devices);
+}
+
+#ifdef __linux__
+/**
+ * @brief Subscribe to kernel notifications of address changes
+ */
+static void
+address_local_watch()
+{
+    struct sockaddr_nl nl = { 0 };
+
+    nl.nl_family = AF_NETLINK;
+    nl.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+
+    if ((local_nl = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE)) < 0)
+        return;
+
+    if (bind(local_nl, (struct sockaddr *) &nl, sizeof(nl)) != 0) {
+        close(local_nl);
+        local_nl = -1;
+    }
+}
+
+/**
+ * @brief Check if local addresses have changed
+ *
+ * Notifications are only read once per second.
+ */
+static bool
+address_local_changed()
+{
+    char buffer[ADDRESS_NETLINK_BUFSIZE];
+    time_t now = time(NULL);
+    bool changed = false;
+
+    if (local_nl < 0 || now == local_checked)
+        return false;
+    local_checked = now;
+
+    // Any notification means an address has been added or removed
+    while (recv(local_nl, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+        changed = true;
+
+    // Some notifications have been lost
+    return changed || errno == ENOBUFS;
+}
+#endif
+
+/**
+ * @brief Build the local addresses set once
+ */
+static void
+address_local_init()
+{
+#ifdef __linux__
+    address_local_watch();
 #endif
-    char ip[ADDRESSLEN];
+    address_local_load();
+    __atomic_store_n(&local_state, ADDRESS_LOCAL_LOADED, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Thread building the local addresses set
+ */
+static void *
+address_local_thread(void *arg)
+{
+    address_local_init();
+    return NULL;
+}
 
-    // Get all network devices
-    if (!devices) {
-        // Get Local devices addresses
-        pcap_findalldevs(&devices, errbuf);
+void
+address_local_preload()
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    if (local_state != ADDRESS_LOCAL_NONE)
+        return;
+
+    // Listing devices can take a while with many interfaces
+    local_state = ADDRESS_LOCAL_LOADING;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, address_local_thread, NULL) != 0)
+        local_state = ADDRESS_LOCAL_NONE;
+    pthread_attr_destroy(&attr);
+}
+
+bool
+address_is_local(address_t addr)
+{
+    switch (__atomic_load_n(&local_state, __ATOMIC_ACQUIRE)) {
+        case ADDRESS_LOCAL_NONE:
+            address_local_init();
+            break;
+        case ADDRESS_LOCAL_LOADING:
+            // No address is local until the set is built
+            return false;
+        default:
+#ifdef __linux__
+            if (address_local_changed())
+                address_local_load();
+#endif
+            break;
     }
 
-    for (dev = devices; dev; dev = dev->next) {
-        for (da = dev->addresses; da ; da = da->next) {
-            // Ingore empty addresses
-            if (!da->addr)
-                continue;
-
-            // Initialize variables
-            memset(ip, 0, sizeof(ip));
-
-            // Get address representation
-            switch (da->addr->sa_family) {
-            case AF_INET:
-                ipaddr = (struct sockaddr_in *) da->addr;
-                inet_ntop(AF_INET, &ipaddr->sin_addr, ip, sizeof(ip));
-                break;
+    if (!local_size || !address_ip_len(addr.family))
+        return false;
+
+    return address_local_slot(addr)->family != 0;
+}
+
+void
+address_set_ip(address_t *addr, int family, const void *ip)
+{
+    memset(&addr->ip, 0, sizeof(addr->ip));
+    addr->family = family;
+    memcpy(addr->ip.bytes, ip, address_ip_len(family));
+}
+
+int
+address_set_ip_str(address_t *addr, const char *ip)
+{
+    uint8_t bin[ADDRESS_BINLEN];
+
+    if (inet_pton(AF_INET, ip, bin) == 1) {
+        address_set_ip(addr, AF_INET, bin);
+        return 0;
+    }
 #ifdef USE_IPV6
-            case AF_INET6:
-                ip6addr = (struct sockaddr_in6 *) da->addr;
-                inet_ntop(AF_INET, &ip6addr->sin6_addr, ip, sizeof(ip));
-                break;
+    if (inet_pton(AF_INET6, ip, bin) == 1) {
+        address_set_ip(addr, AF_INET6, bin);
+        return 0;
+    }
 #endif
-            }
 
-            // Check if this address matches
-            if (!strcmp(addr.ip, ip)) {
-                return true;
-            }
+    return 1;
+}
 
-        }
-    }
-    return false;
+char *
+address_get_ip(address_t addr, char *ip)
+{
+    ip[0] = '\0';
+    if (addr.family)
+        inet_ntop(addr.family, addr.ip.bytes, ip, ADDRESSLEN);
+    return ip;
+}
+
+address_key_t *
+address_get_key(address_t addr, address_key_t *key)
+{
+    memset(key, 0, sizeof(address_key_t));
+    memcpy(key->ip, addr.ip.bytes, address_ip_len(addr.family));
+    key->port = addr.port;
+    key->family = addr.family;
+    return key;
 }
 
 address_t
@@ -111,11 +358,12 @@ address_from_str(const char *ipport)
     if (!ipport || strlen(ipport) > ADDRESSLEN + 6)
         return ret;
 
-    strncpy(scanipport, ipport, strlen(ipport));
+    strncpy(scanipport, ipport, sizeof(scanipport) - 1);
+    scanipport[sizeof(scanipport) - 1] = '\0';
 
     if (sscanf(scanipport, "%[^:]:%d", address, &port) == 2) {
-        strncpy(ret.ip, address, strlen(address));
-        ret.port = port;
+        if (address_set_ip_str(&ret, address) == 0)
+            ret.port = port;
     }
 
     return ret;
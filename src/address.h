@@ -48,17 +48,46 @@
 #define ADDRESSLEN INET_ADDRSTRLEN
 #endif
 
-//! Shorter declaration of address structure
+//! Shorter declaration of address structures
 typedef struct address address_t;
+typedef struct address_key address_key_t;
+
+//! Binary IP address length (enough for IPv6)
+#define ADDRESS_BINLEN 16
 
 /**
  * @brief Network address
+ *
+ * IP address is stored in network byte order. Use @address_get_ip to get
+ * its text representation.
  */
 struct address {
-    //! IP address
-    char ip[ADDRESSLEN];
+    //! Address family (AF_INET, AF_INET6 or 0 if not set)
+    uint8_t family;
     //! Port
     uint16_t port;
+    //! IP address in binary format
+    union {
+        uint8_t bytes[ADDRESS_BINLEN];
+        uint32_t words[ADDRESS_BINLEN / 4];
+    } ip;
+};
+
+/**
+ * @brief Binary hash table key of a network address
+ *
+ * Fields are laid out without implicit padding, so keys can be compared
+ * and hashed byte by byte.
+ */
+struct address_key {
+    //! IP address in binary format (unused bytes are zero)
+    uint8_t ip[ADDRESS_BINLEN];
+    //! Port
+    uint16_t port;
+    //! Address family
+    uint8_t family;
+    //! Unused (always zero)
+    uint8_t pad;
 };
 
 /**
@@ -81,6 +110,14 @@ addressport_equals(address_t addr1, address_t addr2);
 bool
 address_equals(address_t addr1, address_t addr2);
 
+/**
+ * @brief Build the local addresses set in a separate thread
+ *
+ * Until the set is built no address is considered local.
+ */
+void
+address_local_preload();
+
 /**
  * @brief Check if a given IP address belongs to a local device
  *
@@ -90,6 +127,46 @@ address_equals(address_t addr1, address_t addr2);
 bool
 address_is_local(address_t addr);
 
+/**
+ * @brief Set address IP from its binary representation
+ *
+ * @param addr Address structure
+ * @param family AF_INET or AF_INET6
+ * @param ip pointer to in_addr or in6_addr data
+ */
+void
+address_set_ip(address_t *addr, int family, const void *ip);
+
+/**
+ * @brief Set address IP from its text representation
+ *
+ * @param addr Address structure
+ * @param ip IPv4 or IPv6 address string
+ * @return 0 if the string is a valid IP address, 1 otherwise
+ */
+int
+address_set_ip_str(address_t *addr, const char *ip);
+
+/**
+ * @brief Get IP address text representation
+ *
+ * @param addr Address structure
+ * @param ip Character array of at least ADDRESSLEN bytes
+ * @return pointer to ip
+ */
+char *
+address_get_ip(address_t addr, char *ip);
+
+/**
+ * @brief Get the binary hash table key of an address
+ *
+ * @param addr Address structure
+ * @param key Key to fill
+ * @return pointer to key
+ */
+address_key_t *
+address_get_key(address_t addr, address_key_t *key);
+
 /**
  * @brief Convert string IP:PORT to address structure
  *
@@ -0,0 +1,140 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file arena.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source code of functions defined in arena.h
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "util.h"
+
+arena_t *
+arena_create()
+{
+    arena_t *arena;
+
+    if (!(arena = sng_malloc(sizeof(arena_t))))
+        return NULL;
+
+    arena->next_size = ARENA_CHUNK_MIN;
+    return arena;
+}
+
+void
+arena_destroy(arena_t *arena)
+{
+    arena_chunk_t *chunk, *next;
+
+    if (!arena)
+        return;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        sng_free(chunk);
+    }
+    sng_free(arena);
+}
+
+/**
+ * @brief Allocate a new chunk for the arena
+ *
+ * @param arena Arena that will own the chunk
+ * @param size Usable bytes of the chunk
+ * @return allocated chunk or NULL on error
+ */
+static arena_chunk_t *
+arena_chunk_create(arena_t *arena, size_t size)
+{
+    arena_chunk_t *chunk;
+
+    if (!(chunk = malloc(sizeof(arena_chunk_t) + size)))
+        return NULL;
+
+    chunk->size = size;
+    chunk->used = 0;
+    arena->size += sizeof(arena_chunk_t) + size;
+    return chunk;
+}
+
+void *
+arena_alloc(arena_t *arena, size_t size)
+{
+    arena_chunk_t *chunk;
+    void *data;
+
+    if (!arena || !size)
+        return NULL;
+
+    // Keep all allocations aligned
+    size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+    if (size > ARENA_CHUNK_MAX / 4) {
+        // Big allocations get their own chunk, behind the current one
+        if (!(chunk = arena_chunk_create(arena, size)))
+            return NULL;
+        if (arena->chunks) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            chunk->next = NULL;
+            arena->chunks = chunk;
+        }
+    } else if (!(chunk = arena->chunks) || chunk->size - chunk->used < size) {
+        // Current chunk is full, request a bigger one
+        if (!(chunk = arena_chunk_create(arena, arena->next_size)))
+            return NULL;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        if (arena->next_size < ARENA_CHUNK_MAX)
+            arena->next_size *= 2;
+    }
+
+    data = chunk->data + chunk->used;
+    chunk->used += size;
+    memset(data, 0, size);
+    return data;
+}
+
+char *
+arena_strdup(arena_t *arena, const char *str)
+{
+    char *copy;
+    size_t len;
+
+    if (!str)
+        return NULL;
+
+    len = strlen(str) + 1;
+    if ((copy = arena_alloc(arena, len)))
+        memcpy(copy, str, len);
+    return copy;
+}
+
+size_t
+arena_size(arena_t *arena)
+{
+    return (arena) ? arena->size : 0;
+}
@@ -0,0 +1,123 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file arena.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to manage memory arenas
+ *
+ * An arena hands out memory from a list of chunks and releases all of it at
+ * once. Small chunks are used first and each new chunk doubles the size of
+ * the previous one, so short dialogs waste little memory and long ones don't
+ * require many chunks. Allocations bigger than a quarter of the largest
+ * chunk size get a chunk of their own.
+ *
+ * Memory allocated from an arena can not be released individually.
+ */
+
+#ifndef __SNGREP_ARENA_H_
+#define __SNGREP_ARENA_H_
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+
+//! Size of the first arena chunk
+#define ARENA_CHUNK_MIN 512
+//! Max size of shared arena chunks
+#define ARENA_CHUNK_MAX 16384
+//! Alignment of arena allocations
+#define ARENA_ALIGN     8
+
+//! Shorter declaration of arena structures
+typedef struct arena arena_t;
+typedef struct arena_chunk arena_chunk_t;
+
+/**
+ * @brief Block of memory of an arena
+ */
+struct arena_chunk {
+    //! Next chunk in the arena list
+    arena_chunk_t *next;
+    //! Usable bytes of this chunk
+    size_t size;
+    //! Allocated bytes of this chunk
+    size_t used;
+    //! Chunk memory
+    uint8_t data[];
+};
+
+/**
+ * @brief Memory arena
+ */
+struct arena {
+    //! Chunk list, current chunk first
+    arena_chunk_t *chunks;
+    //! Size of the next shared chunk
+    size_t next_size;
+    //! Total bytes allocated for chunks
+    size_t size;
+};
+
+/**
+ * @brief Create a new empty arena
+ *
+ * @return allocated arena or NULL on error
+ */
+arena_t *
+arena_create();
+
+/**
+ * @brief Release all memory allocated from the arena
+ *
+ * @param arena Arena to destroy
+ */
+void
+arena_destroy(arena_t *arena);
+
+/**
+ * @brief Allocate zero filled memory from the arena
+ *
+ * @param arena Arena to allocate from
+ * @param size Requested bytes
+ * @return pointer to allocated memory or NULL on error
+ */
+void *
+arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * @brief Copy a string into arena memory
+ *
+ * @param arena Arena to allocate from
+ * @param str String to copy
+ * @return pointer to the copy or NULL on error
+ */
+char *
+arena_strdup(arena_t *arena, const char *str);
+
+/**
+ * @brief Get the memory used by the arena chunks
+ */
+size_t
+arena_size(arena_t *arena);
+
+#endif /* __SNGREP_ARENA_H_ */
@@ -32,8 +32,11 @@
 
 #include "config.h"
 #include <netdb.h>
+#include <errno.h>
+#include <sched.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 #include "capture.h"
 #ifdef USE_EEP
 #include "capture_eep.h"
@@ -44,24 +47,43 @@
 #ifdef WITH_OPENSSL
 #include "capture_openssl.h"
 #endif
+#ifdef USE_TPACKET
+#include "capture_tpacket.h"
+#endif
+#include "capture_overload.h"
+#include "capture_reader.h"
+#include "capture_zstream.h"
+#include "capture_merge.h"
+#include "capture_writer.h"
+#include "snapshot.h"
 #include "sip.h"
 #include "rtp.h"
 #include "setting.h"
+#include "storage.h"
+#include "profile.h"
 #include "util.h"
 
 // Capture information
 capture_config_t capture_cfg =
 { 0 };
 
+// Filters can not be compiled from multiple threads in old libpcap versions
+static pthread_mutex_t capture_compile_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void
 capture_init(size_t limit, bool rtp_capture, bool rotate)
 {
+    int i;
+
     capture_cfg.limit = limit;
     capture_cfg.rtp_capture = rtp_capture;
     capture_cfg.rotate = rotate;
     capture_cfg.paused = 0;
     capture_cfg.sources = vector_create(1, 1);
 
+    // Configure degradation levels for overload conditions
+    capture_overload_init();
+
     // Fixme
     if (setting_has_value(SETTING_CAPTURE_STORAGE, "none")) {
         capture_cfg.storage = CAPTURE_STORAGE_NONE;
@@ -69,6 +91,21 @@ capture_init(size_t limit, bool rtp_capture, bool rotate)
         capture_cfg.storage = CAPTURE_STORAGE_MEMORY;
     } else if (setting_has_value(SETTING_CAPTURE_STORAGE, "disk")) {
         capture_cfg.storage = CAPTURE_STORAGE_DISK;
+        // Create the spool file for captured frames
+        if (storage_init(setting_get_value(SETTING_CAPTURE_STORAGE_DIR)) != 0) {
+            fprintf(stderr, "Unable to create storage file in %s. Using memory storage.\n",
+                    setting_get_value(SETTING_CAPTURE_STORAGE_DIR));
+            capture_cfg.storage = CAPTURE_STORAGE_MEMORY;
+        }
+    }
+
+    // Calls writing their RTP packets to spool files
+    if (setting_has_value(SETTING_CAPTURE_RTP_SPOOL, "locked")) {
+        storage_set_rtp_mode(STORAGE_RTP_LOCKED);
+    } else if (setting_has_value(SETTING_CAPTURE_RTP_SPOOL, "filtered")) {
+        storage_set_rtp_mode(STORAGE_RTP_FILTERED);
+    } else {
+        storage_set_rtp_mode(STORAGE_RTP_OFF);
     }
 
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
@@ -86,11 +123,54 @@ capture_init(size_t limit, bool rtp_capture, bool rotate)
 #endif
     pthread_mutex_init(&capture_cfg.lock, &attr);
 
+    // Kernel filter follows active RTP streams
+    capture_cfg.rtp_filter = setting_enabled(SETTING_CAPTURE_RTP_FILTER);
+
+    // Recent packets table for duplicates detection
+    if ((capture_cfg.dedup_window = setting_get_intvalue(SETTING_CAPTURE_DEDUP)) > 0)
+        capture_cfg.dedup = calloc(CAPTURE_DEDUP_SLOTS, sizeof(uint64_t));
+
+    // Number of packets parsed with a single capture lock
+    capture_cfg.batch_size = setting_get_intvalue(SETTING_CAPTURE_BATCH_SIZE);
+    if (capture_cfg.batch_size < 1)
+        capture_cfg.batch_size = 1;
+    if (capture_cfg.batch_size > CAPTURE_BATCH_MAX)
+        capture_cfg.batch_size = CAPTURE_BATCH_MAX;
+
+    // Create the parser threads queues if requested
+    if (setting_get_intvalue(SETTING_CAPTURE_QUEUE) > 0) {
+        capture_cfg.nworkers = setting_get_intvalue(SETTING_CAPTURE_WORKERS);
+        if (capture_cfg.nworkers < 1)
+            capture_cfg.nworkers = 1;
+        capture_cfg.workers = sng_malloc(sizeof(capture_worker_t) * capture_cfg.nworkers);
+        for (i = 0; i < capture_cfg.nworkers; i++) {
+            capture_cfg.workers[i].queue = ring_create(setting_get_intvalue(SETTING_CAPTURE_QUEUE));
+            pthread_mutex_init(&capture_cfg.workers[i].lock, NULL);
+            pthread_cond_init(&capture_cfg.workers[i].cond, NULL);
+        }
+    }
+
+#if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
+    // Create the TLS threads queues if requested
+    if (setting_get_intvalue(SETTING_CAPTURE_TLS_WORKERS) > 0) {
+        capture_cfg.ntls_workers = setting_get_intvalue(SETTING_CAPTURE_TLS_WORKERS);
+        capture_cfg.tls_workers = sng_malloc(sizeof(capture_worker_t) * capture_cfg.ntls_workers);
+        for (i = 0; i < capture_cfg.ntls_workers; i++) {
+            capture_cfg.tls_workers[i].queue = ring_create(setting_get_intvalue(SETTING_CAPTURE_QUEUE) > 0 ?
+                                                           setting_get_intvalue(SETTING_CAPTURE_QUEUE) :
+                                                           CAPTURE_TLS_QUEUE);
+            pthread_mutex_init(&capture_cfg.tls_workers[i].lock, NULL);
+            pthread_cond_init(&capture_cfg.tls_workers[i].cond, NULL);
+        }
+    }
+#endif
 }
 
 void
 capture_deinit()
 {
+    int i;
+
     // Close pcap handler
     capture_close();
 
@@ -98,65 +178,247 @@ capture_deinit()
     vector_set_destroyer(capture_cfg.sources, vector_generic_destroyer);
     vector_destroy(capture_cfg.sources);
 
+    // Remove parser threads queues
+    for (i = 0; i < capture_cfg.nworkers; i++) {
+        ring_destroy(capture_cfg.workers[i].queue);
+        pthread_cond_destroy(&capture_cfg.workers[i].cond);
+        pthread_mutex_destroy(&capture_cfg.workers[i].lock);
+    }
+    sng_free(capture_cfg.workers);
+    capture_cfg.workers = NULL;
+    capture_cfg.nworkers = 0;
+
+    for (i = 0; i < capture_cfg.ntls_workers; i++) {
+        ring_destroy(capture_cfg.tls_workers[i].queue);
+        pthread_cond_destroy(&capture_cfg.tls_workers[i].cond);
+        pthread_mutex_destroy(&capture_cfg.tls_workers[i].lock);
+    }
+    sng_free(capture_cfg.tls_workers);
+    capture_cfg.tls_workers = NULL;
+    capture_cfg.ntls_workers = 0;
+
+    sng_free(capture_cfg.dedup);
+    capture_cfg.dedup = NULL;
+
+    // Close disk storage spool file
+    storage_deinit();
+
     // Remove capture mutex
     pthread_mutex_destroy(&capture_cfg.lock);
 }
 
+/**
+ * @brief Check if a source name is in a comma separated list
+ *
+ * Empty lists contain all sources.
+ */
+static bool
+capture_source_listed(const char *list, const char *name)
+{
+    size_t len;
+
+    if (!list || !*list)
+        return true;
+    if (!name)
+        return false;
+
+    len = strlen(name);
+    while (*list) {
+        if (!strncmp(list, name, len) && (list[len] == ',' || list[len] == '\0'))
+            return true;
+        if (!(list = strchr(list, ',')))
+            break;
+        list++;
+    }
+    return false;
+}
+
+/**
+ * @brief Open the dump file for captured packets
+ *
+ * Dump file uses the link type of the first opened source.
+ *
+ * @return 0 if file is open, 2 otherwise (error stored in source)
+ */
+static int
+capture_output_open(capture_info_t *capinfo, const char *outfile)
+{
+    if (!outfile || capture_cfg.pd || capture_cfg.writer)
+        return 0;
+
+    // Write dump file in a separate thread (unless it is standard output)
+    if (setting_enabled(SETTING_CAPTURE_WRITER) && strcmp(outfile, "-")) {
+        if ((capture_cfg.writer = capture_writer_open(capinfo->handle, outfile)) == NULL) {
+            snprintf(capinfo->error, sizeof(capinfo->error), "Couldn't open output dump file %s", outfile);
+            return 2;
+        }
+    } else if ((capture_cfg.pd = pcap_dump_open(capinfo->handle, outfile)) == NULL) {
+        snprintf(capinfo->error, sizeof(capinfo->error), "Couldn't open output dump file %s: %s", outfile,
+                 pcap_geterr(capinfo->handle));
+        return 2;
+    }
+
+    return 0;
+}
+
 int
-capture_online(const char *dev, const char *outfile)
+capture_add_source(capture_info_t *capinfo, const char *outfile)
 {
-    capture_info_t *capinfo;
+    // Add this capture information as packet source
+    vector_append(capture_cfg.sources, capinfo);
 
-    //! Error string
-    char errbuf[PCAP_ERRBUF_SIZE];
+    // Check if packets of this source can be duplicated by others
+    capinfo->dedup = capture_cfg.dedup && capture_source_listed(
+            setting_get_value(SETTING_CAPTURE_DEDUP_SOURCES), capinfo->device ? capinfo->device : capinfo->infile);
 
-    // Create a new structure to handle this capture source
-    if (!(capinfo = sng_malloc(sizeof(capture_info_t)))) {
-        fprintf(stderr, "Can't allocate memory for capture data!\n");
-        return 1;
+    // Dump file will be opened once the source is ready
+    if (outfile)
+        capture_cfg.outfile = outfile;
+    if (capinfo->opening)
+        return 0;
+
+    // If requested store packets in a dump file
+    if (capture_output_open(capinfo, outfile) != 0) {
+        fprintf(stderr, "%s\n", capinfo->error);
+        return 2;
     }
 
+    return 0;
+}
+
+/**
+ * @brief Open the capture device of an online source
+ *
+ * @return 0 if device is ready, non zero otherwise (error stored in source)
+ */
+static int
+capture_online_open(capture_info_t *capinfo)
+{
+    const char *dev = capinfo->device;
+    int snaplen, bufsize, ret;
+
+    //! Error string
+    char errbuf[PCAP_ERRBUF_SIZE];
+
     // Try to find capture device information
     if (pcap_lookupnet(dev, &capinfo->net, &capinfo->mask, errbuf) == -1) {
         capinfo->net = 0;
         capinfo->mask = 0;
     }
 
-    // Open capture device
-    capinfo->handle = pcap_open_live(dev, MAXIMUM_SNAPLEN, 1, 1000, errbuf);
+    // Create capture device handler
+    capinfo->handle = pcap_create(dev, errbuf);
     if (capinfo->handle == NULL) {
-        fprintf(stderr, "Couldn't open device %s: %s\n", dev, errbuf);
+        snprintf(capinfo->error, sizeof(capinfo->error), "Couldn't open device %s: %s", dev, errbuf);
         return 2;
     }
 
-    // Store capture device
-    capinfo->device = dev;
+    // SIP only captures can use a smaller snaplen
+    snaplen = setting_get_intvalue(SETTING_CAPTURE_SNAPLEN);
+    if (snaplen <= 0 || snaplen > MAXIMUM_SNAPLEN)
+        snaplen = MAXIMUM_SNAPLEN;
+
+    pcap_set_snaplen(capinfo->handle, snaplen);
+    pcap_set_promisc(capinfo->handle, 1);
+    pcap_set_timeout(capinfo->handle, setting_get_intvalue(SETTING_CAPTURE_BATCH_LATENCY));
+
+    // Kernel buffer size (libpcap default if not set)
+    if ((bufsize = setting_get_intvalue(SETTING_CAPTURE_BUFFER)) > 0)
+        pcap_set_buffer_size(capinfo->handle, bufsize);
 
-    // Get datalink to parse packets correctly
-    capinfo->link = pcap_datalink(capinfo->handle);
+    // Deliver packets as soon as they arrive instead of waiting for timeout
+    if (setting_enabled(SETTING_CAPTURE_IMMEDIATE))
+        pcap_set_immediate_mode(capinfo->handle, 1);
+
+    // Open capture device
+    if ((ret = pcap_activate(capinfo->handle)) < 0) {
+        snprintf(capinfo->error, sizeof(capinfo->error), "Couldn't open device %s: %s", dev, pcap_geterr(capinfo->handle));
+        pcap_close(capinfo->handle);
+        capinfo->handle = NULL;
+        return 2;
+    } else if (ret > 0 && !capinfo->opening) {
+        fprintf(stderr, "Warning opening device %s: %s\n", dev, pcap_geterr(capinfo->handle));
+    }
 
     // Check linktypes sngrep knowns before start parsing packets
-    if ((capinfo->link_hl = datalink_size(capinfo->link)) == -1) {
-        fprintf(stderr, "Unable to handle linktype %d\n", capinfo->link);
+    if (capture_set_link(capinfo, pcap_datalink(capinfo->handle)) != 0) {
+        snprintf(capinfo->error, sizeof(capinfo->error), "Unable to handle linktype %d", capinfo->link);
         return 3;
     }
 
-    // Create Vectors for IP and TCP reassembly
-    capinfo->tcp_reasm = vector_create(0, 10);
-    capinfo->ip_reasm = vector_create(0, 10);
+    // Create IP and TCP reassembly storage
+    capinfo->tcp_flows = htable_create_fixed(TCP_FLOWS_SIZE, sizeof(capture_tcp_flow_key_t));
+    capinfo->ip_frags = htable_create_fixed(IP_FRAGS_SIZE, sizeof(capture_ip_frag_key_t));
+
+    return 0;
+}
+
+int
+capture_online(const char *dev, const char *outfile)
+{
+    capture_info_t *capinfo;
+    int ret;
+
+#ifdef USE_TPACKET
+    // Use TPACKET_V3 rings instead of libpcap
+    if (setting_enabled(SETTING_CAPTURE_TPACKET))
+        return capture_tpacket(dev, outfile);
+#endif
+
+    // Create a new structure to handle this capture source
+    if (!(capinfo = sng_malloc(sizeof(capture_info_t)))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+
+    // Store capture device
+    capinfo->device = dev;
+
+    // Let the capture thread open the device
+    if (setting_enabled(SETTING_CAPTURE_ASYNC)) {
+        capinfo->opening = true;
+        return capture_add_source(capinfo, outfile);
+    }
+
+    if ((ret = capture_online_open(capinfo)) != 0) {
+        fprintf(stderr, "%s\n", capinfo->error);
+        return ret;
+    }
 
     // Add this capture information as packet source
-    vector_append(capture_cfg.sources, capinfo);
+    return capture_add_source(capinfo, outfile);
+}
 
-    // If requested store packets in a dump file
-    if (outfile && !capture_cfg.pd) {
-        if ((capture_cfg.pd = dump_open(outfile)) == NULL) {
-            fprintf(stderr, "Couldn't open output dump file %s: %s\n", outfile,
-                    pcap_geterr(capinfo->handle));
-            return 2;
-        }
+/**
+ * @brief Open the input file of an offline source
+ *
+ * @return 0 if file is ready, non zero otherwise (error stored in source)
+ */
+static int
+capture_offline_open(capture_info_t *capinfo)
+{
+    // Error text (in case of file open error)
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    // Open PCAP file
+    if ((capinfo->handle = capture_zstream_pcap_open(capinfo->infile, errbuf)) == NULL) {
+        snprintf(capinfo->error, sizeof(capinfo->error), "Couldn't open pcap file %s: %s", capinfo->infile, errbuf);
+        return 1;
+    }
+
+    // Check linktypes sngrep knowns before start parsing packets
+    if (capture_set_link(capinfo, pcap_datalink(capinfo->handle)) != 0) {
+        snprintf(capinfo->error, sizeof(capinfo->error), "Unable to handle linktype %d", capinfo->link);
+        return 3;
     }
 
+    // Create IP and TCP reassembly storage
+    capinfo->tcp_flows = htable_create_fixed(TCP_FLOWS_SIZE, sizeof(capture_tcp_flow_key_t));
+    capinfo->ip_frags = htable_create_fixed(IP_FRAGS_SIZE, sizeof(capture_ip_frag_key_t));
+
+    // Read classic pcap files in a separate thread if possible
+    capture_reader_open(capinfo);
+
     return 0;
 }
 
@@ -165,9 +427,11 @@ capture_offline(const char *infile, const char *outfile)
 {
     capture_info_t *capinfo;
     FILE *fstdin;
+    int ret;
 
-    // Error text (in case of file open error)
-    char errbuf[PCAP_ERRBUF_SIZE];
+    // Restore calls from snapshot files instead of parsing packets
+    if (snapshot_is_file(infile))
+        return snapshot_open(infile, outfile);
 
     // Create a new structure to handle this capture source
     if (!(capinfo = sng_malloc(sizeof(capture_info_t)))) {
@@ -183,10 +447,15 @@ capture_offline(const char *infile, const char *outfile)
     // Set capture input file
     capinfo->infile = infile;
 
-    // Open PCAP file
-    if ((capinfo->handle = pcap_open_offline(infile, errbuf)) == NULL) {
-        fprintf(stderr, "Couldn't open pcap file %s: %s\n", infile, errbuf);
-        return 1;
+    // Let the capture thread open the file (stdin must be read before ncurses)
+    if (setting_enabled(SETTING_CAPTURE_ASYNC) && strncmp(infile, "/dev/stdin", 10)) {
+        capinfo->opening = true;
+        return capture_add_source(capinfo, outfile);
+    }
+
+    if ((ret = capture_offline_open(capinfo)) != 0) {
+        fprintf(stderr, "%s\n", capinfo->error);
+        return ret;
     }
 
     // Reopen tty for ncurses after pcap have used stdin
@@ -197,32 +466,89 @@ capture_offline(const char *infile, const char *outfile)
         }
     }
 
-    // Get datalink to parse packets correctly
-    capinfo->link = pcap_datalink(capinfo->handle);
+    // Add this capture information as packet source
+    return capture_add_source(capinfo, outfile);
+}
 
-    // Check linktypes sngrep knowns before start parsing packets
-    if ((capinfo->link_hl = datalink_size(capinfo->link)) == -1) {
-        fprintf(stderr, "Unable to handle linktype %d\n", capinfo->link);
-        return 3;
+/**
+ * @brief Count a packet as pending to be parsed
+ */
+static void
+capture_packet_unparsed(packet_t *pkt)
+{
+    if (!pkt->unparsed) {
+        pkt->unparsed = true;
+        __atomic_fetch_add(&capture_cfg.unparsed, 1, __ATOMIC_SEQ_CST);
     }
+}
 
-    // Create Vectors for IP and TCP reassembly
-    capinfo->tcp_reasm = vector_create(0, 10);
-    capinfo->ip_reasm = vector_create(0, 10);
+/**
+ * @brief Count a packet as parsed or discarded
+ */
+static void
+capture_packet_parsed(packet_t *pkt)
+{
+    if (pkt->unparsed) {
+        pkt->unparsed = false;
+        __atomic_fetch_sub(&capture_cfg.unparsed, 1, __ATOMIC_SEQ_CST);
+    }
+}
 
-    // Add this capture information as packet source
-    vector_append(capture_cfg.sources, capinfo);
+/**
+ * @brief Add data to a FNV-1a hash
+ */
+static uint64_t
+capture_dedup_hash(uint64_t hash, const void *data, size_t len)
+{
+    const u_char *bytes = data;
 
-    // If requested store packets in a dump file
-    if (outfile && !capture_cfg.pd) {
-        if ((capture_cfg.pd = dump_open(outfile)) == NULL) {
-            fprintf(stderr, "Couldn't open output dump file %s: %s\n", outfile,
-                    pcap_geterr(capinfo->handle));
-            return 2;
+    while (len--) {
+        hash ^= *bytes++;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Check if the same packet has been captured recently
+ *
+ * Packet hash is stored with its capture time in a slot of the recent
+ * packets table, replacing the previous one. Slots are updated without
+ * locks, so concurrent sources may miss some duplicates, but never drop
+ * different packets (unless their hashes collide).
+ *
+ * @return true if packet is a duplicate and must be dropped
+ */
+static bool
+capture_dedup_check(packet_t *pkt)
+{
+    const uint64_t tmask = (1ull << CAPTURE_DEDUP_TIME_BITS) - 1;
+    struct timeval ts = packet_time(pkt);
+    uint64_t hash = 14695981039346656037ull, now, slot, diff;
+
+    // Hash packet fields (address structures can contain padding)
+    hash = capture_dedup_hash(hash, &pkt->ip_id, sizeof(pkt->ip_id));
+    hash = capture_dedup_hash(hash, &pkt->proto, sizeof(pkt->proto));
+    hash = capture_dedup_hash(hash, &pkt->src.port, sizeof(pkt->src.port));
+    hash = capture_dedup_hash(hash, pkt->src.ip.bytes, ADDRESS_BINLEN);
+    hash = capture_dedup_hash(hash, &pkt->dst.port, sizeof(pkt->dst.port));
+    hash = capture_dedup_hash(hash, pkt->dst.ip.bytes, ADDRESS_BINLEN);
+    hash = capture_dedup_hash(hash, packet_payload(pkt), packet_payloadlen(pkt));
+
+    now = ((uint64_t) ts.tv_sec * 1000 + ts.tv_usec / 1000) & tmask;
+    slot = __atomic_load_n(&capture_cfg.dedup[hash % CAPTURE_DEDUP_SLOTS], __ATOMIC_RELAXED);
+
+    // Copies from other sources may be parsed before the original packet
+    if ((slot & ~tmask) == (hash & ~tmask)) {
+        diff = (now - slot) & tmask;
+        if (diff <= capture_cfg.dedup_window || tmask + 1 - diff <= capture_cfg.dedup_window) {
+            __atomic_fetch_add(&capture_cfg.dedup_drops, 1, __ATOMIC_RELAXED);
+            return true;
         }
     }
 
-    return 0;
+    __atomic_store_n(&capture_cfg.dedup[hash % CAPTURE_DEDUP_SLOTS], (hash & ~tmask) | now, __ATOMIC_RELAXED);
+    return false;
 }
 
 void
@@ -238,8 +564,10 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
     struct tcphdr *tcp;
     // TCP header size
     uint16_t tcp_off;
+    // Reassembled IP packet data
+    u_char reasm[MAX_CAPTURE_LEN];
     // Packet data
-    u_char data[MAX_CAPTURE_LEN];
+    u_char *data;
     // Packet payload data
     u_char *payload = NULL;
     // Whole packet size
@@ -247,12 +575,29 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
     // Packet payload size
     uint32_t size_payload =  size_capture - capinfo->link_hl;
     // Captured packet info
-    packet_t *pkt;
+    packet_t *pkt, *next;
+    // Next WebSocket frames of the same segment
+    packet_t *ws = NULL;
+    // Packet position in offline time window
+    int window;
+    // Stage start time
+    PROFILE_DECLARE(start);
+
+    // Count received packets
+    __atomic_fetch_add(&capinfo->packets, 1, __ATOMIC_RELAXED);
 
     // Ignore packets while capture is paused
     if (capture_paused())
         return;
 
+    // Ignore offline packets outside requested time window
+    if (capinfo->infile && (window = capture_time_window_check(header->ts)) != 0) {
+        // Stop reading files with libpcap after the window
+        if (window > 0 && capinfo->handle)
+            pcap_breakloop(capinfo->handle);
+        return;
+    }
+
     // Check if we have reached capture limit
     if (capture_cfg.limit && sip_calls_count() >= capture_cfg.limit) {
         // If capture rotation is disabled, just skip this packet
@@ -261,17 +606,28 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
         }
     }
 
+    // Check if we have reached capture memory limit
+    if (!capture_cfg.rotate && sip_calls_memory_exceeded())
+        return;
+
     // Check maximum capture length
     if (header->caplen > MAX_CAPTURE_LEN)
         return;
 
-    // Copy packet payload
-    memcpy(data, packet, header->caplen);
-
     // Check if we have a complete IP packet
-    if (!(pkt = capture_packet_reasm_ip(capinfo, header, data, &size_payload, &size_capture)))
+    PROFILE_START(start);
+    pkt = capture_packet_reasm_ip(capinfo, header, packet, reasm, &size_payload, &size_capture);
+    PROFILE_STOP(PROFILE_REASM_IP, start);
+    if (!pkt)
         return;
 
+    // Parse stored frame data unless IP fragments have been assembled
+    if (vector_count(pkt->frames) == 1) {
+        data = ((frame_t *) vector_first(pkt->frames))->data;
+    } else {
+        data = reasm;
+    }
+
     // Only interested in UDP packets
     if (pkt->proto == IPPROTO_UDP) {
         // Get UDP header
@@ -293,7 +649,7 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
 
         // Complete packet with Transport information
         packet_set_type(pkt, PACKET_SIP_UDP);
-        packet_set_payload(pkt, payload, size_payload);
+        packet_set_frame_payload(pkt, payload, size_payload);
 
     } else if (pkt->proto == IPPROTO_TCP) {
         // Get TCP header
@@ -315,55 +671,247 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
 
         // Complete packet with Transport information
         packet_set_type(pkt, PACKET_SIP_TCP);
-        packet_set_payload(pkt, payload, size_payload);
+        packet_set_frame_payload(pkt, payload, size_payload);
 
         // Create a structure for this captured packet
-        if (!(pkt = capture_packet_reasm_tcp(capinfo, pkt, tcp, payload, size_payload)))
+        PROFILE_START(start);
+        pkt = capture_packet_reasm_tcp(capinfo, pkt, tcp, payload, size_payload);
+        PROFILE_STOP(PROFILE_REASM_TCP, start);
+        if (!pkt)
             return;
 
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
         // Check if packet is TLS
         if (capture_cfg.keyfile) {
+            if (capture_cfg.tls_workers) {
+                // Let the TLS threads decrypt this packet and parse the result
+                pkt->tcp_flags = tcp->th_flags;
+                capture_tls_queue_packet(capinfo, pkt);
+                // Messages completed by the same segment keep connection order
+                while ((pkt = capture_packet_reasm_tcp_next(capinfo)))
+                    capture_tls_queue_packet(capinfo, pkt);
+                return;
+            }
+            PROFILE_START(start);
             tls_process_segment(pkt, tcp);
+            PROFILE_STOP(PROFILE_TLS, start);
         }
 #endif
 
         // Check if packet is WS or WSS
-        capture_ws_check_packet(pkt);
+        PROFILE_START(start);
+        capture_ws_check_packet(pkt, &ws);
+        PROFILE_STOP(PROFILE_WS, start);
     } else {
         // Not handled protocol
         packet_destroy(pkt);
         return;
     }
 
+    // Send this packet and other messages completed by the same TCP segment
+    while (pkt) {
+        if ((next = ws)) {
+            // Next WebSocket frame of the same segment
+            capture_ws_check_packet(next, &ws);
+        } else {
+            next = (pkt->proto == IPPROTO_TCP) ? capture_packet_reasm_tcp_next(capinfo) : NULL;
+        }
+
+        // Drop copies of already captured packets
+        if (capinfo->dedup && capture_dedup_check(pkt)) {
+            packet_destroy(pkt);
+            pkt = next;
+            continue;
+        }
+
+        capture_packet_unparsed(pkt);
+        if (capture_cfg.workers) {
+            // Let the parser threads handle this packet
+            capture_queue_packet(capinfo, pkt);
+        } else {
+            // Parse this packet in capture thread once the batch is full
+            capinfo->batch[capinfo->batch_count++] = pkt;
+            if (capinfo->batch_count >= capture_cfg.batch_size)
+                capture_batch_flush(capinfo);
+        }
+
+        pkt = next;
+    }
+}
+
+void
+capture_packet_process(packet_t *pkt)
+{
+    capture_packet_process_batch(&pkt, 1);
+}
+
+void
+capture_packet_process_batch(packet_t **pkts, int count)
+{
+    sip_pending_t pending[CAPTURE_BATCH_MAX];
+    bool prepared[CAPTURE_BATCH_MAX];
+    sip_call_t *call;
+    bool stored;
+    int i;
+    // Stage start time
+    PROFILE_DECLARE(start);
+
+    // Degrade capture if packets are not parsed in time
+    capture_overload_check();
+
+    // Parse SIP data that does not require the capture lock
+    for (i = 0; i < count; i++) {
+        PROFILE_START(start);
+        prepared[i] = (packet_payloadlen(pkts[i]) && sip_prepare_packet(pkts[i], &pending[i]) == 0);
+        PROFILE_STOP(PROFILE_SIP_PARSE, start);
+    }
+
     // Avoid parsing from multiples sources.
     // Avoid parsing while screen in being redrawn
     capture_lock();
-    // Check if we can handle this packet
-    if (capture_packet_parse(pkt) == 0) {
+    for (i = 0; i < count; i++) {
+        // Check if we can handle this packet
+        call = capture_packet_store(pkts[i], prepared[i] ? &pending[i] : NULL, &stored);
+        capture_packet_parsed(pkts[i]);
+        if (call) {
+            // Packets received through EEP have no frame headers to send or save
+            if (!pkts[i]->eep) {
 #ifdef USE_EEP
-        // Send this packet through eep
-        capture_eep_send(pkt);
+                // Send this packet through eep
+                capture_eep_send(pkts[i]);
 #endif
-        // Store this packets in output file
-        dump_packet(capture_cfg.pd, pkt);
-        // If storage is disabled, delete frames payload
-        if (capture_cfg.storage == 0) {
-            packet_free_frames(pkt);
+                // Store this packets in output file
+                PROFILE_START(start);
+                if (call->dump_offset < 0 && capture_cfg.pd)
+                    call->dump_offset = pcap_dump_ftell(capture_cfg.pd);
+                dump_packet(capture_cfg.pd, pkts[i]);
+                capture_writer_packet(capture_cfg.writer, pkts[i]);
+                // Remember where the dialog packets start in the dump file
+                if (call->dump_offset < 0 && capture_cfg.writer)
+                    capture_writer_position(capture_cfg.writer, &call->dump_file, &call->dump_offset);
+                // Send this packet to attached processes
+                snapshot_publish_packet(pkts[i]);
+                PROFILE_STOP(PROFILE_DUMP, start);
+            }
+            // Only packet RTP header has been stored
+            if (!stored) {
+                packet_destroy(pkts[i]);
+                continue;
+            }
+            // If storage is disabled, delete frames payload
+            call_add_packet_memory(call, pkts[i], -1);
+            if (capture_cfg.storage == CAPTURE_STORAGE_NONE) {
+                packet_free_frames(pkts[i]);
+            } else if (capture_cfg.storage == CAPTURE_STORAGE_DISK) {
+                // Move frames payload to disk spool file
+                storage_spool_frames(pkts[i]);
+            }
+            // Update call memory without frames payload
+            call_add_packet_memory(call, pkts[i], 1);
+        } else {
+            // Not an interesting packet ...
+            packet_destroy(pkts[i]);
         }
-        // Allow Interface refresh and user input actions
-        capture_unlock();
-        return;
     }
-
-    // Not an interesting packet ...
-    packet_destroy(pkt);
+    // Release memory if limit has been reached
+    sip_calls_check_memory(capture_cfg.rotate);
     // Allow Interface refresh and user input actions
     capture_unlock();
 }
 
+void
+capture_batch_flush(capture_info_t *capinfo)
+{
+    if (capinfo->batch_count) {
+        capture_packet_process_batch(capinfo->batch, capinfo->batch_count);
+        capinfo->batch_count = 0;
+    }
+}
+
+/**
+ * @brief Discard an IP datagram pending reassembly
+ *
+ * @param destroy Also destroy the datagram packet and its fragments
+ */
+static void
+capture_ip_frag_destroy(capture_info_t *capinfo, capture_ip_frag_t *frag, bool destroy)
+{
+    htable_remove(capinfo->ip_frags, &frag->key);
+
+    // Remove from pending list
+    if (frag->prev)
+        frag->prev->next = frag->next;
+    else
+        capinfo->ip_first = frag->next;
+    if (frag->next)
+        frag->next->prev = frag->prev;
+    else
+        capinfo->ip_last = frag->prev;
+
+    capinfo->ip_frags_memory -= frag->memory;
+
+    if (destroy)
+        packet_destroy(frag->packet);
+    sng_free(frag);
+}
+
+/**
+ * @brief Discard datagrams whose fragments have not arrived in time
+ */
+static void
+capture_ip_frags_expire(capture_info_t *capinfo, time_t now)
+{
+    while (capinfo->ip_first && capinfo->ip_first->deadline < now) {
+        capture_ip_frag_destroy(capinfo, capinfo->ip_first, true);
+        __atomic_fetch_add(&capture_cfg.ip_frags_expired, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void
+capture_ip_frags_clear(capture_info_t *capinfo)
+{
+    while (capinfo->ip_first)
+        capture_ip_frag_destroy(capinfo, capinfo->ip_first, true);
+}
+
+/**
+ * @brief Check if an UDP datagram could be stored
+ *
+ * Cheap check on raw frame data, so datagrams that are neither SIP nor
+ * RTP of a known stream are discarded before allocating any packet.
+ * RTP is also accepted while there are packets pending to be parsed,
+ * as they may contain the SDP that creates its stream.
+ *
+ * @param udp UDP header in frame data
+ * @param len Captured length from UDP header
+ * @return true if datagram must be parsed
+ */
+static bool
+capture_packet_check_udp(const u_char *udp, uint32_t len)
+{
+    const struct udphdr *hdr = (const struct udphdr *) udp;
+    u_char *payload;
+
+    if (len <= sizeof(struct udphdr))
+        return false;
+
+    // RTP and RTCP packets are matched by their destination
+    if (rtp_flow_port(ntohs(hdr->uh_dport)))
+        return true;
+
+    payload = (u_char *) udp + sizeof(struct udphdr);
+    len -= sizeof(struct udphdr);
+    if (sip_parser_start((const char *) payload, len))
+        return true;
+
+    // Streams of SDP messages still pending to be parsed are not known yet
+    return __atomic_load_n(&capture_cfg.unparsed, __ATOMIC_SEQ_CST)
+           && (data_is_rtp(payload, len) == 0 || data_is_rtcp(payload, len) == 0);
+}
+
 packet_t *
-capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *header, u_char *packet, uint32_t *size, uint32_t *caplen)
+capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *header, const u_char *packet,
+                        u_char *assembled, uint32_t *size, uint32_t *caplen)
 {
     // IP header data
     struct ip *ip4;
@@ -395,47 +943,19 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
     vector_iter_t it;
     //! Packet containers
     packet_t *pkt;
+    //! Datagram pending reassembly
+    capture_ip_frag_t *frag;
+    capture_ip_frag_key_t key;
     //! Storage for IP frame
     frame_t *frame;
     uint32_t len_data = 0;
     //! Link + Extra header size
-    uint16_t link_hl = capinfo->link_hl;
-
-    // Skip VLAN header if present
-    if (capinfo->link == DLT_EN10MB) {
-        struct ether_header *eth = (struct ether_header *) packet;
-        if (ntohs(eth->ether_type) == ETHERTYPE_8021Q) {
-            link_hl += 4;
-        }
-    }
-
-#ifdef SLL_HDR_LEN
-    if (capinfo->link == DLT_LINUX_SLL) {
-        struct sll_header *sll = (struct sll_header *) packet;
-        if (ntohs(sll->sll_protocol) == ETHERTYPE_8021Q) {
-            link_hl += 4;
-        }
-    }
-#endif
-
-    // Skip NFLOG header if present
-    if (capinfo->link == DLT_NFLOG) {
-        // Parse NFLOG TLV headers
-        while (link_hl + 8 <= *caplen) {
-            nflog_tlv_t *tlv = (nflog_tlv_t *) (packet + link_hl);
+    int link_hl;
 
-            if (!tlv) break;
-
-            if (tlv->tlv_type == NFULA_PAYLOAD) {
-                link_hl += 4;
-                break;
-            }
-
-            if (tlv->tlv_length >= 4) {
-                link_hl += ((tlv->tlv_length + 3) & ~3); /* next TLV aligned to 4B */
-            }
-        }
-    }
+    // Get link headers size of this packet
+    if ((link_hl = capinfo->link_decode(capinfo, packet, *caplen)) < 0
+        || link_hl + (int) sizeof(struct ip) > (int) *caplen)
+        return NULL;
 
     // Get IP header
     ip4 = (struct ip *) (packet + link_hl);
@@ -459,8 +979,8 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
             ip_frag_off = (ip_frag) ? (ip_off & IP_OFFMASK) * 8 : 0;
             ip_id = ntohs(ip4->ip_id);
 
-            inet_ntop(AF_INET, &ip4->ip_src, src.ip, sizeof(src.ip));
-            inet_ntop(AF_INET, &ip4->ip_dst, dst.ip, sizeof(dst.ip));
+            address_set_ip(&src, AF_INET, &ip4->ip_src);
+            address_set_ip(&dst, AF_INET, &ip4->ip_dst);
             break;
 #ifdef USE_IPV6
         case 6:
@@ -474,8 +994,8 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
                 ip_id = ntohl(ip6f->ip6f_ident);
             }
 
-            inet_ntop(AF_INET6, &ip6->ip6_src, src.ip, sizeof(src.ip));
-            inet_ntop(AF_INET6, &ip6->ip6_dst, dst.ip, sizeof(dst.ip));
+            address_set_ip(&src, AF_INET6, &ip6->ip6_src);
+            address_set_ip(&dst, AF_INET6, &ip6->ip6_dst);
             break;
 #endif
         default:
@@ -490,31 +1010,50 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
 
     // If no fragmentation
     if (ip_frag == 0) {
+        // Discard not interesting datagrams before storing them
+        if (ip_proto == IPPROTO_UDP) {
+            len_data = (*caplen < header->caplen) ? *size : header->caplen - link_hl - ip_hl;
+            if (link_hl + ip_hl > header->caplen || !capture_packet_check_udp(packet + link_hl + ip_hl, len_data))
+                return NULL;
+        }
+
         // Just create a new packet with given network data
         pkt = packet_create(ip_ver, ip_proto, src, dst, ip_id);
         packet_add_frame(pkt, header, packet);
         return pkt;
     }
 
-    // Look for another packet with same id in IP reassembly vector
-    it = vector_iterator(capinfo->ip_reasm);
-    while ((pkt = vector_iterator_next(&it))) {
-        if (addressport_equals(pkt->src, src)
-                && addressport_equals(pkt->dst, dst)
-                && pkt->ip_id == ip_id) {
-            break;
-        }
-    }
+    // Discard datagrams that will never be completed
+    capture_ip_frags_expire(capinfo, header->ts.tv_sec);
+
+    // Look for another packet with same id in IP reassembly table
+    memset(&key, 0, sizeof(key));
+    address_get_key(src, &key.src);
+    address_get_key(dst, &key.dst);
+    key.id = ip_id;
+    key.proto = ip_proto;
 
     // If we already have this packet stored, append this frames to existing one
-    if (pkt) {
-        packet_add_frame(pkt, header, packet);
-    } else {
-        // Add To the possible reassembly list
-        pkt = packet_create(ip_ver, ip_proto, src, dst, ip_id);
-        packet_add_frame(pkt, header, packet);
-        vector_append(capinfo->ip_reasm, pkt);
+    if (!(frag = htable_find(capinfo->ip_frags, &key))) {
+        if (!(frag = sng_malloc(sizeof(capture_ip_frag_t))))
+            return NULL;
+        frag->key = key;
+        frag->packet = packet_create(ip_ver, ip_proto, src, dst, ip_id);
+        frag->deadline = header->ts.tv_sec + IP_FRAG_TIMEOUT;
+
+        // Newest datagram in pending list
+        frag->prev = capinfo->ip_last;
+        if (capinfo->ip_last)
+            capinfo->ip_last->next = frag;
+        else
+            capinfo->ip_first = frag;
+        capinfo->ip_last = frag;
+        htable_insert(capinfo->ip_frags, &frag->key, frag);
     }
+    pkt = frag->packet;
+    packet_add_frame(pkt, header, packet);
+    frag->memory += sizeof(frame_t) + header->caplen;
+    capinfo->ip_frags_memory += sizeof(frame_t) + header->caplen;
 
     // Add this IP content length to the total captured of the packet
     pkt->ip_cap_len += ip_len - ip_hl;
@@ -538,147 +1077,459 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
         }
 
         // Check packet content length
-        if (len_data > MAX_CAPTURE_LEN)
+        if (len_data > MAX_CAPTURE_LEN - link_hl - ip_hl) {
+            capture_ip_frag_destroy(capinfo, frag, true);
+            __atomic_fetch_add(&capture_cfg.ip_frags_incomplete, 1, __ATOMIC_RELAXED);
             return NULL;
+        }
 
         // Initialize memory for the assembly packet
-        memset(packet, 0, link_hl + ip_hl + len_data);
+        memset(assembled, 0, link_hl + ip_hl + len_data);
 
         it = vector_iterator(pkt->frames);
         while ((frame = vector_iterator_next(&it))) {
             // Get IP header
             struct ip *frame_ip = (struct ip *) (frame->data + link_hl);
-            memcpy(packet + link_hl + ip_hl + (ntohs(frame_ip->ip_off) & IP_OFFMASK) * 8,
-                   frame->data + link_hl + frame_ip->ip_hl * 4,
-                   ntohs(frame_ip->ip_len) - frame_ip->ip_hl * 4);
+            uint32_t frag_off = (ntohs(frame_ip->ip_off) & IP_OFFMASK) * 8;
+            uint32_t frag_len = ntohs(frame_ip->ip_len) - frame_ip->ip_hl * 4;
+
+            // Overlapping fragments can not be written past the datagram
+            if (frag_off + frag_len > len_data
+                || link_hl + frame_ip->ip_hl * 4 + frag_len > frame->header.caplen) {
+                capture_ip_frag_destroy(capinfo, frag, true);
+                __atomic_fetch_add(&capture_cfg.ip_frags_incomplete, 1, __ATOMIC_RELAXED);
+                return NULL;
+            }
+
+            memcpy(assembled + link_hl + ip_hl + frag_off,
+                   frame->data + link_hl + frame_ip->ip_hl * 4, frag_len);
         }
 
         *caplen = link_hl + ip_hl + len_data;
         *size = len_data;
 
         // Return the assembled IP packet
-        vector_remove(capinfo->ip_reasm, pkt);
+        capture_ip_frag_destroy(capinfo, frag, false);
         return pkt;
     }
 
+    // Make room for newer datagrams discarding the oldest ones
+    while (capinfo->ip_frags_memory > IP_FRAGS_MAX_MEMORY && capinfo->ip_first) {
+        capture_ip_frag_destroy(capinfo, capinfo->ip_first, true);
+        __atomic_fetch_add(&capture_cfg.ip_frags_incomplete, 1, __ATOMIC_RELAXED);
+    }
+
     return NULL;
 }
 
-packet_t *
-capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphdr *tcp, u_char *payload, int size_payload) {
+/**
+ * @brief Compare TCP sequence numbers handling wraparound
+ *
+ * @return negative if a is before b, 0 if equal, positive otherwise
+ */
+static inline int32_t
+capture_tcp_seq_cmp(uint32_t a, uint32_t b)
+{
+    return (int32_t) (a - b);
+}
 
-    vector_iter_t it = vector_iterator(capinfo->tcp_reasm);
-    packet_t *pkt;
-    u_char *new_payload;
-    u_char full_payload[MAX_CAPTURE_LEN + 1];
+/**
+ * @brief Get the hash table key of a TCP flow
+ */
+static capture_tcp_flow_key_t *
+capture_tcp_flow_key(address_t src, address_t dst, capture_tcp_flow_key_t *key)
+{
+    address_get_key(src, &key->src);
+    address_get_key(dst, &key->dst);
+    return key;
+}
 
-    //! Assembled
-    if ((int32_t) size_payload <= 0)
-        return packet;
+/**
+ * @brief Start reassembling a new TCP flow
+ *
+ * Given packet frames will belong to the flow packet.
+ */
+static capture_tcp_flow_t *
+capture_tcp_flow_create(capture_info_t *capinfo, const capture_tcp_flow_key_t *key, packet_t *packet, uint32_t seq)
+{
+    capture_tcp_flow_t *flow;
+
+    if (!(flow = sng_malloc(sizeof(capture_tcp_flow_t))))
+        return NULL;
+
+    flow->key = *key;
+    flow->packet = packet;
+    flow->seq = flow->next_seq = seq;
+    flow->segments = vector_create(0, 4);
+    vector_set_destroyer(flow->segments, vector_generic_destroyer);
+
+    // Newest flow in activity list
+    flow->prev = capinfo->tcp_last;
+    if (capinfo->tcp_last)
+        capinfo->tcp_last->next = flow;
+    else
+        capinfo->tcp_first = flow;
+    capinfo->tcp_last = flow;
+
+    htable_insert(capinfo->tcp_flows, &flow->key, flow);
+    return flow;
+}
 
-    while ((pkt = vector_iterator_next(&it))) {
-        if (addressport_equals(pkt->src, packet->src) &&
-                addressport_equals(pkt->dst, packet->dst)) {
-            break;
-        }
+/**
+ * @brief Discard a TCP flow and all its pending data
+ */
+static void
+capture_tcp_flow_destroy(capture_info_t *capinfo, capture_tcp_flow_t *flow)
+{
+    htable_remove(capinfo->tcp_flows, &flow->key);
+
+    // Remove from activity list
+    if (flow->prev)
+        flow->prev->next = flow->next;
+    else
+        capinfo->tcp_first = flow->next;
+    if (flow->next)
+        flow->next->prev = flow->prev;
+    else
+        capinfo->tcp_last = flow->prev;
+
+    if (capinfo->tcp_ready == flow)
+        capinfo->tcp_ready = NULL;
+
+    packet_destroy(flow->packet);
+    vector_destroy(flow->segments);
+    sng_free(flow->data);
+    sng_free(flow);
+}
+
+/**
+ * @brief Mark flow as the most recently active
+ */
+static void
+capture_tcp_flow_touch(capture_info_t *capinfo, capture_tcp_flow_t *flow, time_t now)
+{
+    flow->last_seen = now;
+
+    if (capinfo->tcp_last == flow)
+        return;
+
+    // Unlink from current position
+    if (flow->prev)
+        flow->prev->next = flow->next;
+    else
+        capinfo->tcp_first = flow->next;
+    flow->next->prev = flow->prev;
+
+    // Append at the end
+    flow->prev = capinfo->tcp_last;
+    flow->next = NULL;
+    capinfo->tcp_last->next = flow;
+    capinfo->tcp_last = flow;
+}
+
+/**
+ * @brief Discard flows that have not received data for a while
+ */
+static void
+capture_tcp_flows_expire(capture_info_t *capinfo, time_t now)
+{
+    while (capinfo->tcp_first && capinfo->tcp_first->last_seen + TCP_FLOW_TIMEOUT < now)
+        capture_tcp_flow_destroy(capinfo, capinfo->tcp_first);
+}
+
+void
+capture_tcp_flows_clear(capture_info_t *capinfo)
+{
+    while (capinfo->tcp_first)
+        capture_tcp_flow_destroy(capinfo, capinfo->tcp_first);
+}
+
+/**
+ * @brief Copy payload data into the flow buffer
+ *
+ * @param prepend Add data before the already stored payload
+ * @return 0 on success, 1 if assembled payload is too big
+ */
+static int
+capture_tcp_flow_write(capture_tcp_flow_t *flow, const u_char *data, uint32_t len, bool prepend)
+{
+    uint32_t size;
+    u_char *buffer;
+
+    // Dont handle too big payload packets
+    if (flow->len + len > MAX_CAPTURE_LEN)
+        return 1;
+
+    // Grow the buffer as required
+    if (flow->len + len + 1 > flow->size) {
+        size = (flow->size) ? flow->size : 2048;
+        while (size < flow->len + len + 1)
+            size *= 2;
+        if (!(buffer = realloc(flow->data, size)))
+            return 1;
+        flow->data = buffer;
+        flow->size = size;
     }
 
-    // If we already have this packet stored
-    if (pkt) {
-        frame_t *frame;
-        // Append this frames to the original packet
-        vector_iter_t frames = vector_iterator(packet->frames);
-        while ((frame = vector_iterator_next(&frames)))
-            packet_add_frame(pkt, frame->header, frame->data);
-        // Destroy current packet as its frames belong to the stored packet
-        packet_destroy(packet);
+    if (prepend) {
+        memmove(flow->data + len, flow->data, flow->len);
+        memcpy(flow->data, data, len);
+        // Headers must be scanned again
+        flow->scanned = flow->msglen = 0;
     } else {
-        // First time this packet has been seen
-        pkt = packet;
-        // Add To the possible reassembly list
-        vector_append(capinfo->tcp_reasm, packet);
+        memcpy(flow->data + flow->len, data, len);
     }
+    flow->len += len;
+    flow->data[flow->len] = '\0';
+    return 0;
+}
 
-    // Store firt tcp sequence
-    if (pkt->tcp_seq == 0) {
-        pkt->tcp_seq = ntohl(tcp->th_seq);
+/**
+ * @brief Add a TCP segment payload to the flow in sequence order
+ *
+ * @return 0 on success, 1 if assembled payload is too big
+ */
+static int
+capture_tcp_flow_add_segment(capture_tcp_flow_t *flow, uint32_t seq, const u_char *data, uint32_t len)
+{
+    capture_tcp_segment_t *segment, *queued;
+    uint32_t skip;
+    int i;
+
+    // Segment just before all stored data (received out of order)
+    if (capture_tcp_seq_cmp(seq + len, flow->seq) == 0 && flow->len) {
+        flow->seq = seq;
+        return capture_tcp_flow_write(flow, data, len, true);
     }
 
-    // If the first frame of this packet
-    if (vector_count(pkt->frames) == 1) {
-        // Set initial payload
-        packet_set_payload(pkt, payload, size_payload);
-    } else {
-        // Check payload length. Dont handle too big payload packets
-        if (pkt->payload_len + size_payload > MAX_CAPTURE_LEN) {
-            packet_destroy(pkt);
-            vector_remove(capinfo->tcp_reasm, pkt);
-            return NULL;
+    // Already received data (retransmission)
+    if (capture_tcp_seq_cmp(seq + len, flow->next_seq) <= 0)
+        return 0;
+
+    // Segment after a gap, keep it until missing data arrives
+    if (capture_tcp_seq_cmp(seq, flow->next_seq) > 0) {
+        if (!(segment = sng_malloc(sizeof(capture_tcp_segment_t) + len)))
+            return 1;
+        segment->seq = seq;
+        segment->len = len;
+        memcpy(segment->data, data, len);
+
+        // Keep segments sorted by sequence
+        for (i = vector_count(flow->segments); i > 0; i--) {
+            queued = vector_item(flow->segments, i - 1);
+            if (capture_tcp_seq_cmp(queued->seq, seq) <= 0)
+                break;
         }
-        new_payload = sng_malloc(pkt->payload_len + size_payload);
-        if (pkt->tcp_seq < ntohl(tcp->th_seq)) {
-            // Append payload to the existing
-            pkt->tcp_seq =  ntohl(tcp->th_seq);
-            memcpy(new_payload, pkt->payload, pkt->payload_len);
-            memcpy(new_payload + pkt->payload_len, payload, size_payload);
-        } else {
-            // Prepend payload to the existing
-            memcpy(new_payload, payload, size_payload);
-            memcpy(new_payload + size_payload, pkt->payload, pkt->payload_len);
+        vector_append(flow->segments, segment);
+        vector_insert(flow->segments, segment, i);
+        return 0;
+    }
+
+    // Only store data not received yet
+    skip = flow->next_seq - seq;
+    if (capture_tcp_flow_write(flow, data + skip, len - skip, false) != 0)
+        return 1;
+    flow->next_seq += len - skip;
+
+    // Add stored segments that are now in order
+    while ((segment = vector_first(flow->segments))) {
+        if (capture_tcp_seq_cmp(segment->seq, flow->next_seq) > 0)
+            break;
+        if (capture_tcp_seq_cmp(segment->seq + segment->len, flow->next_seq) > 0) {
+            skip = flow->next_seq - segment->seq;
+            if (capture_tcp_flow_write(flow, segment->data + skip, segment->len - skip, false) != 0)
+                return 1;
+            flow->next_seq += segment->len - skip;
         }
-        packet_set_payload(pkt, new_payload, pkt->payload_len + size_payload);
-        sng_free(new_payload);
+        vector_remove(flow->segments, segment);
     }
 
-    // Store full payload content
-    memset(full_payload, 0, MAX_CAPTURE_LEN);
-    memcpy(full_payload, pkt->payload, pkt->payload_len);
+    return 0;
+}
 
-    // This packet is ready to be parsed
-    int original_size = pkt->payload_len;
-    int valid = sip_validate_packet(pkt);
-    if (valid == VALIDATE_COMPLETE_SIP) {
-        // Full SIP packet!
-        vector_remove(capinfo->tcp_reasm, pkt);
-        return pkt;
-    } else if (valid == VALIDATE_MULTIPLE_SIP) {
-        vector_remove(capinfo->tcp_reasm, pkt);
-
-        // We have a full SIP Packet, but do not remove everything from the reasm queue
-        packet_t *cont = packet_clone(pkt);
-        int pldiff = original_size - pkt->payload_len;
-        if (pldiff > 0 && pldiff < MAX_CAPTURE_LEN) {
-            packet_set_payload(cont, full_payload + pkt->payload_len, pldiff);
-            vector_append(capinfo->tcp_reasm, cont);
+/**
+ * @brief Extract the first complete message from a flow
+ *
+ * @param push TCP PSH flag is set in the last segment
+ * @return packet with the message payload or NULL if it is still incomplete
+ */
+static packet_t *
+capture_tcp_flow_message(capture_info_t *capinfo, capture_tcp_flow_t *flow, bool push)
+{
+    packet_t *pkt;
+    uint32_t start, msglen;
+    int valid = VALIDATE_PARTIAL_SIP;
+
+    if (!flow->len)
+        return NULL;
+
+    if (!flow->msglen) {
+        // Check only new data for the end of headers
+        start = (flow->scanned > 2) ? flow->scanned - 2 : 0;
+        if (sip_parser_body((const char *) flow->data, flow->len, start) >= 0 || (push && !flow->sip)) {
+            valid = sip_validate_payload(flow->data, flow->len, &msglen);
+            flow->sip = (valid != VALIDATE_NOT_SIP);
+            flow->msglen = msglen;
         }
+        flow->scanned = flow->len;
+
+        // Not a SIP payload (WebSocket, TLS, ...), wait until PSH flag
+        if (valid == VALIDATE_NOT_SIP && push) {
+            pkt = flow->packet;
+            flow->packet = NULL;
+            // Packet takes the ownership of the assembled payload
+            packet_set_payload(pkt, NULL, 0);
+            pkt->payload = flow->data;
+            pkt->payload_len = flow->len;
+            flow->data = NULL;
+            flow->len = flow->size = 0;
+            capture_tcp_flow_destroy(capinfo, flow);
+            return pkt;
+        }
+    }
 
-        // Return the full initial packet
+    // Wait until the whole message has been received
+    if (!flow->msglen || flow->len < flow->msglen)
+        return NULL;
+
+    // Full SIP packet!
+    pkt = flow->packet;
+    if (flow->len == flow->msglen && !vector_count(flow->segments)) {
+        // Packet takes the ownership of the assembled payload
+        flow->packet = NULL;
+        packet_set_payload(pkt, NULL, 0);
+        pkt->payload = flow->data;
+        pkt->payload_len = flow->len;
+        flow->data = NULL;
+        flow->len = flow->size = 0;
+        capture_tcp_flow_destroy(capinfo, flow);
         return pkt;
-    } else if (valid == VALIDATE_NOT_SIP) {
-        // Not a SIP packet, store until PSH flag
-        if (tcp->th_flags & TH_PUSH) {
-            vector_remove(capinfo->tcp_reasm, pkt);
-            return pkt;
+    }
+
+    // Remaining data belongs to the following message, keep the same frames
+    packet_set_payload(pkt, flow->data, flow->msglen);
+    flow->packet = packet_clone(pkt);
+    flow->len -= flow->msglen;
+    flow->seq += flow->msglen;
+    memmove(flow->data, flow->data + flow->msglen, flow->len + 1);
+    flow->msglen = flow->scanned = 0;
+    flow->sip = false;
+
+    // Check if there are more messages ready in this flow
+    capinfo->tcp_ready = flow;
+    return pkt;
+}
+
+packet_t *
+capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphdr *tcp,
+                         u_char *payload, int size_payload)
+{
+    capture_tcp_flow_t *flow;
+    frame_t *frame;
+    vector_iter_t frames;
+    capture_tcp_flow_key_t key;
+    uint32_t seq, msglen;
+    time_t now;
+    bool push;
+    int valid;
+
+    //! Assembled
+    if ((int32_t) size_payload <= 0)
+        return packet;
+
+    seq = ntohl(tcp->th_seq);
+    push = (tcp->th_flags & TH_PUSH) != 0;
+    now = packet_time(packet).tv_sec;
+    capinfo->tcp_ready = NULL;
+
+    // Discard idle flows
+    capture_tcp_flows_expire(capinfo, now);
+
+    if (!(flow = htable_find(capinfo->tcp_flows, capture_tcp_flow_key(packet->src, packet->dst, &key)))) {
+        // Most SIP messages fit in a single segment
+        valid = sip_validate_payload(payload, size_payload, &msglen);
+        if (valid == VALIDATE_COMPLETE_SIP || (valid == VALIDATE_NOT_SIP && push))
+            return packet;
+
+        // Start reassembling this connection
+        if (!(flow = capture_tcp_flow_create(capinfo, &key, packet, seq))) {
+            packet_destroy(packet);
+            return NULL;
         }
+        flow->sip = (valid != VALIDATE_NOT_SIP);
+        flow->msglen = msglen;
+    } else {
+        // Move this frames to the flow packet (payload points to them)
+        frames = vector_iterator(packet->frames);
+        while ((frame = vector_iterator_next(&frames)))
+            vector_append(flow->packet->frames, frame);
+        vector_clear(packet->frames);
+        packet_destroy(packet);
     }
 
-    // An incomplete SIP Packet
-    return NULL;
+    capture_tcp_flow_touch(capinfo, flow, now);
+
+    // Store segment payload
+    if (capture_tcp_flow_add_segment(flow, seq, payload, size_payload) != 0) {
+        capture_tcp_flow_destroy(capinfo, flow);
+        return NULL;
+    }
+
+    return capture_tcp_flow_message(capinfo, flow, push);
+}
+
+packet_t *
+capture_packet_reasm_tcp_next(capture_info_t *capinfo)
+{
+    capture_tcp_flow_t *flow = capinfo->tcp_ready;
+
+    if (!flow)
+        return NULL;
+
+    capinfo->tcp_ready = NULL;
+    return capture_tcp_flow_message(capinfo, flow, false);
+}
+
+/**
+ * @brief Unmask WebSocket frame payload
+ *
+ * Payload is unmasked eight bytes at a time. Destination can overlap the
+ * source as long as it starts before it (frame data is moved over its
+ * headers).
+ */
+static void
+capture_ws_unmask(u_char *dst, const u_char *src, uint64_t len, const u_char *key)
+{
+    uint64_t mask, word, i = 0;
+
+    // Every eight bytes start with the first mask byte
+    memcpy(&mask, key, 4);
+    memcpy((u_char *) &mask + 4, key, 4);
+
+    for (; i + sizeof(word) <= len; i += sizeof(word)) {
+        memcpy(&word, src + i, sizeof(word));
+        word ^= mask;
+        memcpy(dst + i, &word, sizeof(word));
+    }
+    for (; i < len; i++)
+        dst[i] = src[i] ^ key[i % 4];
 }
 
 int
-capture_ws_check_packet(packet_t *packet)
+capture_ws_check_packet(packet_t *packet, packet_t **next)
 {
-    int ws_off = 0;
-    u_char ws_fin;
+    uint32_t ws_off = 0;
     u_char ws_opcode;
     u_char ws_mask;
     uint8_t ws_len;
     u_char ws_mask_key[4];
-    u_char *payload, *newpayload;
+    u_char *payload;
     uint32_t size_payload;
+    uint64_t len;
     int i;
 
+    *next = NULL;
+
     /**
      * WSocket header definition according to RFC 6455
      *     0                   1                   2                   3
@@ -706,11 +1557,10 @@ capture_ws_check_packet(packet_t *packet)
     payload = packet_payload(packet);
 
     // Check we have payload
-    if (size_payload == 0)
+    if (size_payload < 2)
         return 0;
 
     // Flags && Opcode
-    ws_fin = (*payload & WH_FIN) >> 4;
     ws_opcode = *payload & WH_OPCODE;
     ws_off++;
 
@@ -723,9 +1573,8 @@ capture_ws_check_packet(packet_t *packet)
     ws_len = (*(payload + ws_off) & WH_LEN);
     ws_off++;
 
-    // Skip Payload len
+    // Get extended payload len
     switch (ws_len) {
-            // Extended
         case 126:
             ws_off += 2;
             break;
@@ -735,29 +1584,44 @@ capture_ws_check_packet(packet_t *packet)
         default:
             return 0;
     }
+    if (size_payload <= ws_off)
+        return 0;
+    for (i = 2, len = 0; i < ws_off; i++)
+        len = (len << 8) | payload[i];
 
     // Get Masking key if mask is enabled
     if (ws_mask) {
+        if (size_payload <= ws_off + 4)
+            return 0;
         memcpy(ws_mask_key, (payload + ws_off), 4);
         ws_off += 4;
     }
 
     // Skip Websocket headers
     size_payload -= ws_off;
-    if ((int32_t) size_payload <= 0)
-        return 0;
+    if (len > size_payload)
+        len = size_payload;
+
+    // Next frames of the segment are checked as a different packet
+    if (len < size_payload) {
+        *next = packet_clone(packet);
+        packet_set_type(*next, packet->type);
+        packet_set_payload(*next, payload + ws_off + len, size_payload - len);
+    }
 
-    newpayload = sng_malloc(size_payload);
-    memcpy(newpayload, payload + ws_off, size_payload);
-    // If mask is enabled, unmask the payload
     if (ws_mask) {
-        for (i = 0; i < size_payload; i++)
-            newpayload[i] = newpayload[i] ^ ws_mask_key[i % 4];
+        // Unmask the payload over the headers, never modifying frame data
+        packet_detach_payload(packet);
+        payload = packet_payload(packet);
+        capture_ws_unmask(payload, payload + ws_off, len, ws_mask_key);
+        packet_trim_payload(packet, len);
+    } else if (packet->payload_ref) {
+        // Unmasked payload can still point to frame data
+        packet_set_frame_payload(packet, payload + ws_off, len);
+    } else {
+        memmove(payload, payload + ws_off, len);
+        packet_trim_payload(packet, len);
     }
-    // Set new packet payload into the packet
-    packet_set_payload(packet, newpayload, size_payload);
-    // Free the new payload
-    sng_free(newpayload);
 
     if (packet->type == PACKET_SIP_TLS) {
         packet_set_type(packet, PACKET_SIP_WSS);
@@ -768,94 +1632,836 @@ capture_ws_check_packet(packet_t *packet)
 }
 
 
+capture_worker_t *
+capture_packet_worker(packet_t *pkt)
+{
+    const u_char *data;
+    uint32_t len, hash = 2166136261u;
+    sip_hdr_t callid;
+
+    // Only one parser thread
+    if (capture_cfg.nworkers == 1)
+        return capture_cfg.workers;
+
+    if (packet_payloadlen(pkt) && sip_parser_callid((const char *) packet_payload(pkt),
+                                                    packet_payloadlen(pkt), &callid) == 0) {
+        // SIP packets are assigned by Call-ID
+        data = packet_payload(pkt) + callid.off;
+        len = callid.len;
+    } else {
+        // Other packets are assigned by destination (same key as RTP flows)
+        data = (const u_char *) &pkt->dst;
+        len = sizeof(address_t);
+    }
+
+    // FNV-1a hash
+    while (len--) {
+        hash ^= *data++;
+        hash *= 16777619u;
+    }
+
+    return &capture_cfg.workers[hash % capture_cfg.nworkers];
+}
+
+/**
+ * @brief Add a packet to a worker queue
+ *
+ * @param wait Wait until there is space in the queue instead of dropping the packet
+ * @return 0 if packet has been queued, 1 if it has been dropped
+ */
+static int
+capture_worker_push(capture_worker_t *worker, packet_t *pkt, bool wait)
+{
+    while (ring_push(worker->queue, pkt) != 0) {
+        if (!wait) {
+            __atomic_fetch_add(&capture_cfg.queue_drops, 1, __ATOMIC_RELAXED);
+            capture_packet_parsed(pkt);
+            packet_destroy(pkt);
+            return 1;
+        }
+        // Give the worker some time to empty the queue
+        usleep(1000);
+    }
+
+    // Wake up worker thread if it is waiting for packets
+    if (__atomic_load_n(&worker->waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+    }
+    return 0;
+}
+
+/**
+ * @brief Wait until a worker queue is not empty
+ *
+ * @param running Worker threads running flag
+ */
+static void
+capture_worker_wait(capture_worker_t *worker, bool *running)
+{
+    struct timespec wait;
+
+    pthread_mutex_lock(&worker->lock);
+    __atomic_store_n(&worker->waiting, true, __ATOMIC_SEQ_CST);
+    if (ring_count(worker->queue) == 0 && *running) {
+        clock_gettime(CLOCK_REALTIME, &wait);
+        wait.tv_nsec += 10 * 1000 * 1000;
+        if (wait.tv_nsec >= 1000000000) {
+            wait.tv_sec++;
+            wait.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&worker->cond, &worker->lock, &wait);
+    }
+    __atomic_store_n(&worker->waiting, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+void
+capture_queue_packet(capture_info_t *capinfo, packet_t *pkt)
+{
+    // Online sources can not wait for the parser
+    capture_worker_push(capture_packet_worker(pkt), pkt, capinfo && capinfo->infile);
+}
+
+void
+capture_parser_thread(void *info)
+{
+    capture_worker_t *worker = (capture_worker_t *) info;
+    packet_t *pkts[CAPTURE_BATCH_MAX];
+    int count;
+
+    while (capture_cfg.parser_running) {
+        // Parse queued packets
+        for (count = 0; count < capture_cfg.batch_size; count++) {
+            if (!(pkts[count] = ring_pop(worker->queue)))
+                break;
+        }
+        if (count) {
+            // Store fewer dialogs while this queue is backing up
+            sip_calls_sample_adapt(ring_count(worker->queue) * 100 / ring_size(worker->queue));
+            capture_packet_process_batch(pkts, count);
+            continue;
+        }
+
+        // Wait until capture threads queue more packets
+        capture_worker_wait(worker, &capture_cfg.parser_running);
+    }
+}
+
+#if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
+/**
+ * @brief Get the TLS thread for the given packet
+ *
+ * Both directions of a connection are assigned to the same thread, so
+ * connection state is only accessed from one thread.
+ */
+static capture_worker_t *
+capture_tls_worker(packet_t *pkt)
+{
+    const u_char *first = (const u_char *) &pkt->src, *second = (const u_char *) &pkt->dst;
+    const u_char *swap;
+    uint32_t i, hash = 2166136261u;
+
+    if (capture_cfg.ntls_workers == 1)
+        return capture_cfg.tls_workers;
+
+    // Hash addresses in the same order for both directions
+    if (memcmp(first, second, sizeof(address_t)) > 0) {
+        swap = first;
+        first = second;
+        second = swap;
+    }
+
+    // FNV-1a hash
+    for (i = 0; i < sizeof(address_t); i++) {
+        hash ^= first[i];
+        hash *= 16777619u;
+    }
+    for (i = 0; i < sizeof(address_t); i++) {
+        hash ^= second[i];
+        hash *= 16777619u;
+    }
+
+    return &capture_cfg.tls_workers[hash % capture_cfg.ntls_workers];
+}
+
+void
+capture_tls_queue_packet(capture_info_t *capinfo, packet_t *pkt)
+{
+    capture_packet_unparsed(pkt);
+    __atomic_fetch_add(&capture_cfg.tls_pending, 1, __ATOMIC_SEQ_CST);
+    if (capture_worker_push(capture_tls_worker(pkt), pkt, capinfo->infile != NULL) != 0)
+        __atomic_fetch_sub(&capture_cfg.tls_pending, 1, __ATOMIC_SEQ_CST);
+}
+
+void
+capture_tls_thread(void *info)
+{
+    capture_worker_t *worker = (capture_worker_t *) info;
+    packet_t *pkts[CAPTURE_BATCH_MAX], *pkt, *ws = NULL;
+    struct tcphdr tcp;
+    bool wait = !capture_is_online();
+    int count = 0;
+    // Stage start time
+    PROFILE_DECLARE(start);
+
+    memset(&tcp, 0, sizeof(tcp));
+
+    while (capture_cfg.tls_running) {
+        if (!(pkt = ring_pop(worker->queue))) {
+            // Parse decrypted packets before waiting for more
+            if (count) {
+                capture_packet_process_batch(pkts, count);
+                __atomic_fetch_sub(&capture_cfg.tls_pending, count, __ATOMIC_SEQ_CST);
+                count = 0;
+                continue;
+            }
+            capture_worker_wait(worker, &capture_cfg.tls_running);
+            continue;
+        }
+
+        // Decrypt the segment, messages completed by the same segment are not TLS
+        if (pkt->tcp_flags) {
+            tcp.th_flags = pkt->tcp_flags;
+            PROFILE_START(start);
+            tls_process_segment(pkt, &tcp);
+            PROFILE_STOP(PROFILE_TLS, start);
+
+            // Check if packet is WS or WSS
+            PROFILE_START(start);
+            capture_ws_check_packet(pkt, &ws);
+            PROFILE_STOP(PROFILE_WS, start);
+        }
+
+        while (pkt) {
+            if (capture_cfg.workers) {
+                // Let the parser threads handle this packet
+                capture_worker_push(capture_packet_worker(pkt), pkt, wait);
+                __atomic_fetch_sub(&capture_cfg.tls_pending, 1, __ATOMIC_SEQ_CST);
+            } else {
+                // Parse this packet in TLS thread once the batch is full
+                pkts[count++] = pkt;
+                if (count >= capture_cfg.batch_size) {
+                    capture_packet_process_batch(pkts, count);
+                    __atomic_fetch_sub(&capture_cfg.tls_pending, count, __ATOMIC_SEQ_CST);
+                    count = 0;
+                }
+            }
+
+            // Next WebSocket frame of the same segment
+            if ((pkt = ws)) {
+                capture_packet_unparsed(pkt);
+                __atomic_fetch_add(&capture_cfg.tls_pending, 1, __ATOMIC_SEQ_CST);
+                capture_ws_check_packet(pkt, &ws);
+            }
+        }
+    }
+
+    // Discard packets not parsed yet
+    while (count)
+        packet_destroy(pkts[--count]);
+}
+#endif
+
+bool
+capture_parser_queued()
+{
+    return capture_cfg.workers != NULL;
+}
+
+uint32_t
+capture_queue_drops()
+{
+    return __atomic_load_n(&capture_cfg.queue_drops, __ATOMIC_RELAXED);
+}
+
+uint32_t
+capture_ip_frags_expired()
+{
+    return __atomic_load_n(&capture_cfg.ip_frags_expired, __ATOMIC_RELAXED);
+}
+
+uint32_t
+capture_ip_frags_incomplete()
+{
+    return __atomic_load_n(&capture_cfg.ip_frags_incomplete, __ATOMIC_RELAXED);
+}
+
+int
+capture_queue_usage()
+{
+    size_t count;
+    int i, usage, max = 0;
+
+    for (i = 0; i < capture_cfg.nworkers; i++) {
+        count = ring_count(capture_cfg.workers[i].queue);
+        if ((usage = count * 100 / ring_size(capture_cfg.workers[i].queue)) > max)
+            max = usage;
+    }
+    return max;
+}
+
+void
+capture_stats(capture_stats_t *stats)
+{
+    capture_info_t *capinfo;
+    struct pcap_stat ps;
+    vector_iter_t it;
+
+    memset(stats, 0, sizeof(capture_stats_t));
+    stats->queue_drops = capture_queue_drops();
+    stats->duplicates = __atomic_load_n(&capture_cfg.dedup_drops, __ATOMIC_RELAXED);
+    stats->dump_queue = capture_writer_queue(capture_cfg.writer);
+    stats->dump_drops = capture_writer_drops(capture_cfg.writer);
+#ifdef USE_EEP
+    stats->eep_queue = capture_eep_send_queue();
+    stats->eep_drops = capture_eep_send_drops();
+    stats->eep_relayed = capture_eep_relayed();
+#endif
+
+    it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        stats->packets += __atomic_load_n(&capinfo->packets, __ATOMIC_RELAXED);
+
+        // Drops are only known for capture devices
+        if (!capinfo->device || !capinfo->handle)
+            continue;
+
+#ifdef USE_TPACKET
+        if (capinfo->tpacket) {
+            stats->drops += capture_tpacket_drops(capinfo);
+            continue;
+        }
+#endif
+
+        if (pcap_stats(capinfo->handle, &ps) == 0) {
+            stats->drops += ps.ps_drop;
+            stats->ifdrops += ps.ps_ifdrop;
+        }
+    }
+}
+
+void
+capture_health(health_info_t *info)
+{
+    capture_info_t *capinfo;
+    health_source_t *source;
+    vector_iter_t it;
+    int i;
+
+#if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
+    info->tls_connections = tls_connection_count();
+#endif
+    info->tls_pending = __atomic_load_n(&capture_cfg.tls_pending, __ATOMIC_RELAXED);
+
+    // Packets pending in each parser thread queue
+    for (i = 0; i < capture_cfg.nworkers && i < HEALTH_WORKERS_MAX; i++) {
+        info->queue[i] = ring_count(capture_cfg.workers[i].queue);
+        info->queue_size = ring_size(capture_cfg.workers[i].queue);
+    }
+    info->nworkers = i;
+
+    // Reassembly containers of each capture source
+    it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it)) && info->nsources < HEALTH_SOURCES_MAX) {
+        source = &info->sources[info->nsources++];
+        snprintf(source->name, sizeof(source->name), "%s",
+                 (capinfo->device) ? capinfo->device : (capinfo->infile) ? capinfo->infile : "");
+        source->ip_frags = (capinfo->ip_frags) ? htable_count(capinfo->ip_frags) : 0;
+        source->ip_frags_memory = __atomic_load_n(&capinfo->ip_frags_memory, __ATOMIC_RELAXED);
+        source->tcp_flows = (capinfo->tcp_flows) ? htable_count(capinfo->tcp_flows) : 0;
+    }
+}
+
 int
 capture_packet_parse(packet_t *packet)
+{
+    sip_pending_t pending;
+    sip_call_t *call;
+    bool prepared, stored;
+    // Stage start time
+    PROFILE_DECLARE(start);
+
+    // Check if this packet contains a SIP message
+    PROFILE_START(start);
+    prepared = (packet_payloadlen(packet) && sip_prepare_packet(packet, &pending) == 0);
+    PROFILE_STOP(PROFILE_SIP_PARSE, start);
+    call = capture_packet_store(packet, prepared ? &pending : NULL, &stored);
+    if (call && !stored)
+        packet_destroy(packet);
+
+    // Release memory if limit has been reached
+    sip_calls_check_memory(capture_cfg.rotate);
+
+    return (call) ? 0 : 1;
+}
+
+sip_call_t *
+capture_packet_store(packet_t *packet, sip_pending_t *pending, bool *stored)
 {
     // Media structure for RTP packets
     rtp_stream_t *stream;
+    sip_msg_t *msg;
+    // Stage start time
+    PROFILE_DECLARE(start);
+
+    *stored = true;
+
+    // Store SIP message into its call
+    if (pending) {
+        PROFILE_START(start);
+        msg = sip_store_packet(pending);
+        PROFILE_STOP(PROFILE_SIP_STORE, start);
+        if (msg)
+            return msg->call;
+    }
 
     // We're only interested in packets with payload
     if (packet_payloadlen(packet)) {
-        // Parse this header and payload
-        if (sip_check_packet(packet)) {
-            return 0;
-        }
-
         // Check if this packet belongs to a RTP stream
-        if ((stream = rtp_check_packet(packet))) {
+        PROFILE_START(start);
+        stream = rtp_check_packet(packet);
+        PROFILE_STOP(PROFILE_RTP, start);
+        if (stream) {
             // We have an RTP packet!
             packet_set_type(packet, PACKET_RTP);
             // Store this pacekt if capture rtp is enabled
             if (capture_cfg.rtp_capture) {
-                call_add_rtp_packet(stream_get_call(stream), packet);
-                return 0;
+                *stored = call_add_rtp_packet(stream_get_call(stream), stream, packet);
+                return stream_get_call(stream);
             }
         }
     }
-    return 1;
+    return NULL;
 }
 
 void
 capture_close()
 {
     capture_info_t *capinfo;
+    packet_t *pkt;
+    bool opening;
+    int i;
 
     // Nothing to close
     if (vector_count(capture_cfg.sources) == 0)
         return;
 
+    // Stop all captures
+    vector_iter_t it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        // Threads still opening their source will stop after current open step
+        if (capinfo->running) {
+            capture_lock();
+            opening = __atomic_load_n(&capinfo->opening, __ATOMIC_ACQUIRE);
+            if (opening)
+                __atomic_store_n(&capinfo->running, false, __ATOMIC_RELEASE);
+            capture_unlock();
+            if (opening)
+                pthread_join(capinfo->capture_t, NULL);
+        }
+#ifdef USE_TPACKET
+        // TPACKET threads check running flag between ring blocks
+        if (capinfo->tpacket) {
+            if (capinfo->running) {
+                capinfo->running = false;
+                pthread_join(capinfo->capture_t, NULL);
+            }
+            capture_tpacket_close(capinfo);
+            continue;
+        }
+#endif
+        // Reader sources check running flag between file blocks
+        if (capinfo->reader) {
+            if (capinfo->running) {
+                capinfo->running = false;
+                pthread_join(capinfo->capture_t, NULL);
+            }
+            capture_reader_close(capinfo);
+            continue;
+        }
+        // Merged sources check running flag between packets
+        if (capinfo->merge) {
+            if (capinfo->running) {
+                capinfo->running = false;
+                pthread_join(capinfo->capture_t, NULL);
+            }
+            capture_merge_close(capinfo);
+            continue;
+        }
+        // Snapshot sources check running flag between records
+        if (capinfo->snapshot) {
+            if (capinfo->running) {
+                capinfo->running = false;
+                pthread_join(capinfo->capture_t, NULL);
+            }
+            snapshot_close(capinfo);
+            continue;
+        }
+        //Close PCAP file
+        if (capinfo->handle) {
+            if (capinfo->running) {
+                /* We must cancel the thread here instead of joining because, according to pcap_breakloop man page,
+                 * you can only break pcap_loop from within the same thread.
+                 * @see: https://www.tcpdump.org/manpages/pcap_breakloop.3pcap.html
+                 */
+                pcap_breakloop(capinfo->handle);
+                pthread_cancel(capinfo->capture_t);
+                pthread_join(capinfo->capture_t, NULL);
+            }
+        }
+    }
+
+    // Stop TLS threads
+    if (capture_cfg.tls_running) {
+        capture_cfg.tls_running = false;
+        for (i = 0; i < capture_cfg.ntls_workers; i++) {
+            pthread_mutex_lock(&capture_cfg.tls_workers[i].lock);
+            pthread_cond_signal(&capture_cfg.tls_workers[i].cond);
+            pthread_mutex_unlock(&capture_cfg.tls_workers[i].lock);
+            pthread_join(capture_cfg.tls_workers[i].thread, NULL);
+        }
+    }
+
+    // Discard packets not decrypted yet
+    for (i = 0; i < capture_cfg.ntls_workers; i++) {
+        while ((pkt = ring_pop(capture_cfg.tls_workers[i].queue)))
+            packet_destroy(pkt);
+    }
+    capture_cfg.tls_pending = 0;
+
+    // Stop parser threads
+    if (capture_cfg.parser_running) {
+        capture_cfg.parser_running = false;
+        for (i = 0; i < capture_cfg.nworkers; i++) {
+            pthread_mutex_lock(&capture_cfg.workers[i].lock);
+            pthread_cond_signal(&capture_cfg.workers[i].cond);
+            pthread_mutex_unlock(&capture_cfg.workers[i].lock);
+            pthread_join(capture_cfg.workers[i].thread, NULL);
+        }
+    }
+
+    // Discard packets not parsed yet
+    for (i = 0; i < capture_cfg.nworkers; i++) {
+        while ((pkt = ring_pop(capture_cfg.workers[i].queue)))
+            packet_destroy(pkt);
+    }
+
+    capture_cfg.unparsed = 0;
+
+    // Discard incomplete TCP messages and IP datagrams
+    it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        if (capinfo->tcp_flows)
+            capture_tcp_flows_clear(capinfo);
+        if (capinfo->ip_frags)
+            capture_ip_frags_clear(capinfo);
+    }
+
     // Close dump file
     if (capture_cfg.pd) {
         dump_close(capture_cfg.pd);
+        capture_cfg.pd = NULL;
+    }
+
+    // Write pending dump file blocks
+    if (capture_cfg.writer) {
+        capture_writer_close(capture_cfg.writer);
+        capture_cfg.writer = NULL;
+    }
+}
+
+/**
+ * @brief Get the N-th CPU of a CPU list (e.g. 0-3,6)
+ *
+ * CPUs are reused from the start of the list when index is greater
+ * than the number of CPUs in the list.
+ *
+ * @return CPU number or -1 if list is not valid
+ */
+static int
+capture_thread_cpu(const char *cpus, int index)
+{
+    int list[CPU_SETSIZE];
+    int count = 0, first, last;
+    char *end;
+
+    while (*cpus && count < CPU_SETSIZE) {
+        first = last = strtol(cpus, &end, 10);
+        if (end == cpus || first < 0)
+            return -1;
+        if (*end == '-') {
+            cpus = end + 1;
+            last = strtol(cpus, &end, 10);
+            if (end == cpus || last < first)
+                return -1;
+        }
+        for (; first <= last && first < CPU_SETSIZE && count < CPU_SETSIZE; first++)
+            list[count++] = first;
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return -1;
+        cpus = end;
     }
 
-    // Stop all captures
-    vector_iter_t it = vector_iterator(capture_cfg.sources);
-    while ((capinfo = vector_iterator_next(&it))) {
-        //Close PCAP file
-        if (capinfo->handle) {
-            if (capinfo->running) {
-                /* We must cancel the thread here instead of joining because, according to pcap_breakloop man page,
-                 * you can only break pcap_loop from within the same thread.
-                 * @see: https://www.tcpdump.org/manpages/pcap_breakloop.3pcap.html
-                 */
-                pcap_breakloop(capinfo->handle);
-                pthread_cancel(capinfo->capture_t);
-                pthread_join(capinfo->capture_t, NULL);
+    return (count) ? list[index % count] : -1;
+}
+
+int
+capture_thread_setup(pthread_t thread, const char *cpus, int index, int priority)
+{
+    struct sched_param param;
+    cpu_set_t set;
+    int cpu, ret = 0, err;
+
+    // Pin thread to one of the configured CPUs
+    if (cpus && *cpus) {
+        if ((cpu = capture_thread_cpu(cpus, index)) < 0) {
+            fprintf(stderr, "Invalid CPU list %s\n", cpus);
+            ret = 1;
+        } else {
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if ((err = pthread_setaffinity_np(thread, sizeof(set), &set)) != 0) {
+                fprintf(stderr, "Unable to set thread affinity to CPU %d: %s\n", cpu, strerror(err));
+                ret = 1;
             }
         }
     }
 
+    // Use real time scheduling
+    if (priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        if ((err = pthread_setschedparam(thread, SCHED_FIFO, &param)) != 0) {
+            fprintf(stderr, "Unable to set thread SCHED_FIFO priority %d: %s\n", priority, strerror(err));
+            ret = 1;
+        }
+    }
+
+    return ret;
 }
 
 int
 capture_launch_thread(capture_info_t *capinfo)
 {
+    int i;
     //! capture thread attributes
     pthread_attr_t attr;
     pthread_attr_init(&attr);
 
+    // Start parser threads for queued packets
+    if (capture_cfg.workers) {
+        capture_cfg.parser_running = true;
+        for (i = 0; i < capture_cfg.nworkers; i++) {
+            if (pthread_create(&capture_cfg.workers[i].thread, &attr,
+                               (void *) capture_parser_thread, &capture_cfg.workers[i])) {
+                return 1;
+            }
+            capture_thread_setup(capture_cfg.workers[i].thread,
+                                 setting_get_value(SETTING_CAPTURE_WORKERS_AFFINITY), i, 0);
+        }
+    }
+
+#if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
+    // Start TLS threads for queued packets
+    if (capture_cfg.tls_workers) {
+        capture_cfg.tls_running = true;
+        for (i = 0; i < capture_cfg.ntls_workers; i++) {
+            if (pthread_create(&capture_cfg.tls_workers[i].thread, &attr,
+                               (void *) capture_tls_thread, &capture_cfg.tls_workers[i])) {
+                return 1;
+            }
+        }
+    }
+#endif
+
     // Start all captures threads
     vector_iter_t it = vector_iterator(capture_cfg.sources);
-    while ((capinfo = vector_iterator_next(&it))) {
+    for (i = 0; (capinfo = vector_iterator_next(&it)); i++) {
         // Mark capture as running
         capinfo->running = true;
         if (pthread_create(&capinfo->capture_t, &attr, (void *) capture_thread, capinfo)) {
             return 1;
         }
+        capture_thread_setup(capinfo->capture_t, setting_get_value(SETTING_CAPTURE_AFFINITY), i,
+                             setting_get_intvalue(SETTING_CAPTURE_PRIORITY));
     }
 
     pthread_attr_destroy(&attr);
     return 0;
 }
 
+/**
+ * @brief Compile and set the capture filter of a source
+ *
+ * @param fp Storage for the compiled filter (used by reader and snapshot sources)
+ * @return 0 if filter is valid, 1 otherwise
+ */
+static int
+capture_source_set_filter(capture_info_t *capinfo, const char *filter, struct bpf_program *fp)
+{
+    //! Check if filter compiles
+    if (pcap_compile(capinfo->handle, fp, filter, 0, capinfo->mask) == -1)
+        return 1;
+
+#ifdef USE_TPACKET
+    // Set the filter on TPACKET socket
+    if (capinfo->tpacket)
+        return capture_tpacket_set_filter(capinfo, fp);
+#endif
+
+    // Reader sources filter packets while decoding them
+    if (capinfo->reader)
+        return capture_reader_set_filter(capinfo, fp);
+
+    // Merged sources compile the filter for each file
+    if (capinfo->merge)
+        return capture_merge_set_filter(capinfo, filter);
+
+    // Snapshot sources filter stored frames while restoring them
+    if (capinfo->snapshot)
+        return snapshot_set_filter(capinfo, fp);
+
+    // Set capture filter
+    if (pcap_setfilter(capinfo->handle, fp) == -1)
+        return 1;
+
+    return 0;
+}
+
+/**
+ * @brief Check a filter for a source not opened yet
+ *
+ * Link type of the source is not known, so the filter is checked for
+ * ethernet frames. It is compiled again once the source is opened.
+ *
+ * @return 0 if filter is valid, 1 otherwise
+ */
+static int
+capture_source_check_filter(capture_info_t *capinfo, const char *filter)
+{
+    struct bpf_program fp;
+    pcap_t *handle;
+    int ret = 1;
+
+    if (!(handle = pcap_open_dead(DLT_EN10MB, MAXIMUM_SNAPLEN)))
+        return 1;
+
+    if (pcap_compile(handle, &fp, filter, 0, PCAP_NETMASK_UNKNOWN) == 0) {
+        pcap_freecode(&fp);
+        ret = 0;
+    } else {
+        snprintf(capinfo->error, sizeof(capinfo->error), "%s", pcap_geterr(handle));
+    }
+
+    pcap_close(handle);
+    return ret;
+}
+
+/**
+ * @brief Open a source from its capture thread
+ *
+ * Sources are opened concurrently, each one starting to capture or read
+ * packets as soon as it is ready, while the interface is already shown.
+ *
+ * @return 0 if source is ready, non zero otherwise (error stored in source)
+ */
+static int
+capture_source_open(capture_info_t *capinfo)
+{
+    int ret;
+
+    capinfo->error[0] = '\0';
+    if (capinfo->device) {
+        ret = capture_online_open(capinfo);
+    } else {
+        ret = capture_offline_open(capinfo);
+    }
+
+    // Capture has been closed while opening the source
+    if (!__atomic_load_n(&capinfo->running, __ATOMIC_ACQUIRE))
+        return 1;
+
+    // Set the capture filter for this source link type
+    if (ret == 0 && capture_cfg.filter) {
+        pthread_mutex_lock(&capture_compile_lock);
+        if ((ret = capture_source_set_filter(capinfo, capture_cfg.filter, &capinfo->fp)) != 0) {
+            snprintf(capinfo->error, sizeof(capinfo->error), "Couldn't install filter %s: %s",
+                     capture_cfg.filter, pcap_geterr(capinfo->handle));
+        }
+        pthread_mutex_unlock(&capture_compile_lock);
+    }
+
+    // Source is ready unless capture has been closed meanwhile
+    capture_lock();
+    if (!__atomic_load_n(&capinfo->running, __ATOMIC_ACQUIRE)) {
+        ret = 1;
+    } else if (ret == 0 && capture_cfg.outfile) {
+        // First opened source creates the dump file
+        ret = capture_output_open(capinfo, capture_cfg.outfile);
+    }
+    __atomic_store_n(&capinfo->opening, false, __ATOMIC_RELEASE);
+    capture_unlock();
+
+    return ret;
+}
+
 void
 capture_thread(void *info)
 {
     capture_info_t *capinfo = (capture_info_t *) info;
+    int ret;
+
+    // Open source before reading its packets
+    if (capinfo->opening && capture_source_open(capinfo) != 0) {
+        capinfo->running = false;
+        return;
+    }
+
+#ifdef USE_TPACKET
+    // Parse packets from TPACKET_V3 ring
+    if (capinfo->tpacket) {
+        capture_tpacket_loop(capinfo);
+        return;
+    }
+#endif
+
+    // Parse packets from file blocks read by reader thread
+    if (capinfo->reader) {
+        capture_reader_loop(capinfo);
+        capinfo->running = false;
+        return;
+    }
+
+    // Parse packets of all merged files sorted by time
+    if (capinfo->merge) {
+        capture_merge_loop(capinfo);
+        capinfo->running = false;
+        return;
+    }
+
+    // Restore calls stored in a snapshot file
+    if (capinfo->snapshot) {
+        snapshot_loop(capinfo);
+        capinfo->running = false;
+        return;
+    }
 
-    // Parse available packets
-    pcap_loop(capinfo->handle, -1, parse_packet, (u_char *) capinfo);
+    // Parse available packets in batches
+    capture_rtp_filter_update(capinfo);
+    while ((ret = pcap_dispatch(capinfo->handle, capture_cfg.batch_size, parse_packet, (u_char *) capinfo)) >= 0) {
+        // Parse decoded packets of this batch
+        capture_batch_flush(capinfo);
+        // Follow new RTP streams
+        capture_rtp_filter_update(capinfo);
+        // No more packets in input file
+        if (ret == 0 && capinfo->infile)
+            break;
+    }
+    capture_batch_flush(capinfo);
     capinfo->running = false;
 }
 
@@ -875,11 +2481,23 @@ int
 capture_is_running()
 {
     capture_info_t *capinfo;
+    int i;
     vector_iter_t it = vector_iterator(capture_cfg.sources);
     while ((capinfo = vector_iterator_next(&it))) {
         if (capinfo->running)
             return 1;
     }
+
+    // Captured packets are still being decrypted
+    if (capture_cfg.tls_running && __atomic_load_n(&capture_cfg.tls_pending, __ATOMIC_SEQ_CST))
+        return 1;
+
+    // Captured packets are still being parsed
+    for (i = 0; capture_cfg.parser_running && i < capture_cfg.nworkers; i++) {
+        if (ring_count(capture_cfg.workers[i].queue))
+            return 1;
+    }
+
     return 0;
 }
 
@@ -891,14 +2509,15 @@ capture_set_bpf_filter(const char *filter)
 
     // Apply the given filter to all sources
     while ((capinfo = vector_iterator_next(&it))) {
-        //! Check if filter compiles
-        if (pcap_compile(capinfo->handle, &capture_cfg.fp, filter, 0, capinfo->mask) == -1)
-            return 1;
+        // Sources opened by capture threads will set the filter later
+        if (capinfo->opening) {
+            if (capture_source_check_filter(capinfo, filter) != 0)
+                return 1;
+            continue;
+        }
 
-        // Set capture filter
-        if (pcap_setfilter(capinfo->handle, &capture_cfg.fp) == -1)
+        if (capture_source_set_filter(capinfo, filter, &capture_cfg.fp) != 0)
             return 1;
-
     }
 
     // Store valid capture filter
@@ -913,6 +2532,88 @@ capture_get_bpf_filter()
     return capture_cfg.filter;
 }
 
+void
+capture_rtp_filter_update(capture_info_t *capinfo)
+{
+    char filter[CAPTURE_RTP_FILTER_MAX * 96 + 1024], ip[ADDRESSLEN];
+    address_t dsts[CAPTURE_RTP_FILTER_MAX];
+    struct bpf_program fp;
+    const char *sip;
+    uint32_t changes;
+    time_t now;
+    int count, len, i;
+
+    // Only live sources can change their kernel filter
+    if (!capture_cfg.rtp_filter || capinfo->infile)
+        return;
+
+    // Wait for stream changes, updating the filter at most once per interval
+    changes = rtp_flow_changes();
+    now = time(NULL);
+    if (capinfo->rtp_filter_time) {
+        if (changes == capinfo->rtp_filter_changes || now - capinfo->rtp_filter_time < CAPTURE_RTP_FILTER_INTERVAL)
+            return;
+    }
+    capinfo->rtp_filter_changes = changes;
+    capinfo->rtp_filter_time = now;
+
+    // Get active streams destinations
+    capture_lock();
+    count = rtp_flow_dsts(dsts, CAPTURE_RTP_FILTER_MAX);
+    capture_unlock();
+
+    // SIP packets are selected by the user filter
+    if (!(sip = capture_cfg.filter) && !(sip = setting_get_value(SETTING_CAPTURE_RTP_FILTER_SIP)))
+        sip = "not udp";
+    len = snprintf(filter, sizeof(filter), "(%s)", sip);
+
+    // Add each stream destination
+    for (i = 0; i < count && i < CAPTURE_RTP_FILTER_MAX && len < (int) sizeof(filter); i++) {
+        len += snprintf(filter + len, sizeof(filter) - len, " or (%s dst host %s and udp dst port %u)",
+                        (dsts[i].family == AF_INET6) ? "ip6" : "ip", address_get_ip(dsts[i], ip), dsts[i].port);
+    }
+
+    // Too many streams for a kernel filter, accept all UDP
+    if (count > CAPTURE_RTP_FILTER_MAX || len >= (int) sizeof(filter))
+        snprintf(filter, sizeof(filter), "(%s) or udp", sip);
+
+    pthread_mutex_lock(&capture_compile_lock);
+    if (pcap_compile(capinfo->handle, &fp, filter, 1, capinfo->mask) == 0) {
+#ifdef USE_TPACKET
+        if (capinfo->tpacket) {
+            capture_tpacket_set_filter(capinfo, &fp);
+        } else
+#endif
+        pcap_setfilter(capinfo->handle, &fp);
+        pcap_freecode(&fp);
+    }
+    pthread_mutex_unlock(&capture_compile_lock);
+}
+
+void
+capture_set_time_window(struct timeval from, struct timeval to)
+{
+    capture_cfg.from = from;
+    capture_cfg.to = to;
+}
+
+void
+capture_get_time_window(struct timeval *from, struct timeval *to)
+{
+    *from = capture_cfg.from;
+    *to = capture_cfg.to;
+}
+
+int
+capture_time_window_check(struct timeval ts)
+{
+    if (capture_cfg.from.tv_sec && timercmp(&ts, &capture_cfg.from, <))
+        return -1;
+    if (capture_cfg.to.tv_sec && timercmp(&ts, &capture_cfg.to, >))
+        return 1;
+    return 0;
+}
+
 
 void
 capture_set_paused(int pause)
@@ -926,8 +2627,11 @@ capture_paused()
     return capture_cfg.paused;
 }
 
-const char *
-capture_status_desc()
+/**
+ * @brief Get a description of the capture mode
+ */
+static const char *
+capture_status_mode()
 {
     int online = 0, offline = 0, loading = 0;
 
@@ -979,6 +2683,80 @@ capture_status_desc()
     }
 }
 
+const char *
+capture_status_desc()
+{
+    static char desc[128];
+    capture_info_t *capinfo, *failed = NULL;
+    const char *overload;
+    int opening = 0, nfailed = 0, len;
+
+    // Sources still being opened or that could not be opened
+    vector_iter_t it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        if (__atomic_load_n(&capinfo->opening, __ATOMIC_ACQUIRE)) {
+            opening++;
+        } else if (capinfo->error[0]) {
+            failed = capinfo;
+            nfailed++;
+        }
+    }
+
+    // Show degradation level next to capture mode
+    overload = capture_overload_desc();
+    if (!overload && !opening && !nfailed)
+        return capture_status_mode();
+
+    len = snprintf(desc, sizeof(desc), "%s (", capture_status_mode());
+    if (overload)
+        len += snprintf(desc + len, sizeof(desc) - len, "%s, ", overload);
+    if (opening)
+        len += snprintf(desc + len, sizeof(desc) - len, "Opening %d/%d, ", opening, vector_count(capture_cfg.sources));
+    if (nfailed == 1)
+        len += snprintf(desc + len, sizeof(desc) - len, "%s failed, ",
+                        failed->device ? failed->device : sng_basename(failed->infile));
+    else if (nfailed > 1)
+        len += snprintf(desc + len, sizeof(desc) - len, "%d failed, ", nfailed);
+
+    // Replace last separator
+    if (len >= 2 && len < (int) sizeof(desc))
+        strcpy(desc + len - 2, ")");
+    return desc;
+}
+
+int
+capture_load_progress(uint64_t *loaded, uint64_t *total, uint64_t *msecs)
+{
+    capture_info_t *capinfo;
+    uint64_t decoded, size, elapsed;
+    int loading = 0;
+
+    *loaded = *total = *msecs = 0;
+
+    // Sum the progress of all files still being read
+    vector_iter_t it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        if (!capinfo->running)
+            continue;
+        if (capinfo->reader) {
+            capture_reader_progress(capinfo, &decoded, &size, &elapsed);
+        } else if (capinfo->merge) {
+            capture_merge_progress(capinfo, &decoded, &size, &elapsed);
+        } else if (capinfo->snapshot && !capinfo->snapshot->shared) {
+            snapshot_progress(capinfo, &decoded, &size, &elapsed);
+        } else {
+            continue;
+        }
+        *loaded += decoded;
+        *total += size;
+        if (elapsed > *msecs)
+            *msecs = elapsed;
+        loading++;
+    }
+
+    return loading;
+}
+
 const char*
 capture_input_file()
 {
@@ -986,7 +2764,9 @@ capture_input_file()
 
     if (vector_count(capture_cfg.sources) == 1) {
         capinfo = vector_first(capture_cfg.sources);
-        if (capinfo->infile) {
+        if (capinfo->merge) {
+            return "Multiple files";
+        } else if (capinfo->infile) {
             return sng_basename(capinfo->infile);
         } else {
             return NULL;
@@ -1010,6 +2790,12 @@ capture_device()
     return NULL;
 }
 
+const char *
+capture_output_file()
+{
+    return capture_cfg.outfile;
+}
+
 const char*
 capture_keyfile()
 {
@@ -1034,12 +2820,42 @@ capture_sources_count()
     return vector_count(capture_cfg.sources);
 }
 
+int
+capture_sources_errors()
+{
+    capture_info_t *capinfo;
+    int failed = 0;
+
+    vector_iter_t it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        if (!__atomic_load_n(&capinfo->opening, __ATOMIC_ACQUIRE) && capinfo->error[0]) {
+            fprintf(stderr, "%s\n", capinfo->error);
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+int
+capture_datalink()
+{
+    capture_info_t *capinfo;
+
+    if (!(capinfo = vector_first(capture_cfg.sources)))
+        return -1;
+    return capinfo->link;
+}
+
 char *
 capture_last_error()
 {
     capture_info_t *capinfo;
     if (vector_count(capture_cfg.sources) == 1) {
         capinfo = vector_first(capture_cfg.sources);
+        // Sources not opened yet only store their own errors
+        if (__atomic_load_n(&capinfo->opening, __ATOMIC_ACQUIRE) || !capinfo->handle)
+            return capinfo->error;
         return pcap_geterr(capinfo->handle);
     }
     return NULL;
@@ -1049,8 +2865,13 @@ capture_last_error()
 void
 capture_lock()
 {
+    // Time spent waiting for other threads
+    PROFILE_DECLARE(start);
+
     // Avoid parsing more packet
+    PROFILE_START(start);
     pthread_mutex_lock(&capture_cfg.lock);
+    PROFILE_STOP(PROFILE_LOCK_WAIT, start);
 }
 
 void
@@ -1119,6 +2940,8 @@ datalink_size(int datalink)
         case DLT_LINUX_SLL:
             return 16;
 #endif
+        case DLT_LINUX_SLL2:
+            return 20;
 #ifdef DLT_IPNET
         case DLT_IPNET:
             return 24;
@@ -1130,6 +2953,132 @@ datalink_size(int datalink)
 
 }
 
+/**
+ * @brief Get an Ethernet type from packet data (host byte order)
+ */
+static inline uint16_t
+capture_link_type(const u_char *data)
+{
+    return data[0] << 8 | data[1];
+}
+
+/**
+ * @brief Skip VLAN tags (802.1Q, 802.1ad) after link headers
+ *
+ * @param packet Packet data
+ * @param link_hl Size of link headers before the tags
+ * @param type Ethernet type of the link headers
+ * @param caplen Captured packet length
+ * @return size of link headers including all tags
+ */
+static inline int
+capture_link_vlan(const u_char *packet, int link_hl, uint16_t type, uint32_t caplen)
+{
+    while ((type == ETHERTYPE_8021Q || type == ETHERTYPE_8021AD || type == ETHERTYPE_QINQ)
+           && link_hl + 4 <= (int) caplen) {
+        type = capture_link_type(packet + link_hl + 2);
+        link_hl += 4;
+    }
+    return link_hl;
+}
+
+/**
+ * @brief Decode link headers of fixed size (Raw IP, loopback, PPP, ...)
+ */
+static int
+capture_link_fixed(const capture_info_t *capinfo, const u_char *packet, uint32_t caplen)
+{
+    return capinfo->link_hl;
+}
+
+/**
+ * @brief Decode Ethernet headers and their VLAN tags
+ */
+static int
+capture_link_ether(const capture_info_t *capinfo, const u_char *packet, uint32_t caplen)
+{
+    if (caplen < 14)
+        return -1;
+    return capture_link_vlan(packet, 14, capture_link_type(packet + 12), caplen);
+}
+
+/**
+ * @brief Decode Linux cooked capture headers and their VLAN tags
+ */
+static int
+capture_link_sll(const capture_info_t *capinfo, const u_char *packet, uint32_t caplen)
+{
+    if (caplen < 16)
+        return -1;
+    return capture_link_vlan(packet, 16, capture_link_type(packet + 14), caplen);
+}
+
+/**
+ * @brief Decode Linux cooked capture v2 headers and their VLAN tags
+ */
+static int
+capture_link_sll2(const capture_info_t *capinfo, const u_char *packet, uint32_t caplen)
+{
+    if (caplen < 20)
+        return -1;
+    return capture_link_vlan(packet, 20, capture_link_type(packet), caplen);
+}
+
+/**
+ * @brief Decode NFLOG headers until the payload TLV
+ */
+static int
+capture_link_nflog(const capture_info_t *capinfo, const u_char *packet, uint32_t caplen)
+{
+    const nflog_tlv_t *tlv;
+    int link_hl = capinfo->link_hl;
+
+    // Parse NFLOG TLV headers
+    while (link_hl + 8 <= (int) caplen) {
+        tlv = (const nflog_tlv_t *) (packet + link_hl);
+
+        if (tlv->tlv_type == NFULA_PAYLOAD)
+            return link_hl + 4;
+
+        // Invalid TLV length
+        if (tlv->tlv_length < 4)
+            return -1;
+
+        // Next TLV aligned to 4B
+        link_hl += ((tlv->tlv_length + 3) & ~3);
+    }
+
+    return -1;
+}
+
+capture_link_f
+capture_link_decoder(int datalink)
+{
+    switch (datalink) {
+        case DLT_EN10MB:
+            return capture_link_ether;
+#ifdef DLT_LINUX_SLL
+        case DLT_LINUX_SLL:
+            return capture_link_sll;
+#endif
+        case DLT_LINUX_SLL2:
+            return capture_link_sll2;
+        case DLT_NFLOG:
+            return capture_link_nflog;
+        default:
+            return (datalink_size(datalink) == -1) ? NULL : capture_link_fixed;
+    }
+}
+
+int
+capture_set_link(capture_info_t *capinfo, int datalink)
+{
+    capinfo->link = datalink;
+    capinfo->link_hl = datalink_size(datalink);
+    capinfo->link_decode = capture_link_decoder(datalink);
+    return capinfo->link_decode == NULL;
+}
+
 pcap_dumper_t *
 dump_open(const char *dumpfile)
 {
@@ -1137,6 +3086,8 @@ dump_open(const char *dumpfile)
 
     if (vector_count(capture_cfg.sources) == 1) {
         capinfo = vector_first(capture_cfg.sources);
+        if (__atomic_load_n(&capinfo->opening, __ATOMIC_ACQUIRE) || !capinfo->handle)
+            return NULL;
         return pcap_dump_open(capinfo->handle, dumpfile);
     }
     return NULL;
@@ -1150,8 +3101,15 @@ dump_packet(pcap_dumper_t *pd, const packet_t *packet)
 
     vector_iter_t it = vector_iterator(packet->frames);
     frame_t *frame;
+    u_char *data;
     while ((frame = vector_iterator_next(&it))) {
-        pcap_dump((u_char*) pd, frame->header, frame->data);
+        if (frame->data) {
+            pcap_dump((u_char*) pd, &frame->header, frame->data);
+        } else if ((data = storage_read_frame(frame))) {
+            // Read frame content back from disk storage
+            pcap_dump((u_char*) pd, &frame->header, data);
+            sng_free(data);
+        }
     }
     pcap_dump_flush(pd);
 }
@@ -33,6 +33,7 @@
 #define __SNGREP_CAPTURE_H
 
 #include "config.h"
+#include <limits.h>
 #include <pthread.h>
 #include <pcap.h>
 #include <string.h>
@@ -81,6 +82,9 @@
 #include <stdbool.h>
 #include "packet.h"
 #include "vector.h"
+#include "hash.h"
+#include "health.h"
+#include "ring.h"
 
 //! Max allowed packet assembled size
 #define MAX_CAPTURE_LEN 20480
@@ -91,6 +95,14 @@
 #ifndef ETHERTYPE_8021Q
 #define ETHERTYPE_8021Q 0x8100
 #endif
+//! Define VLAN 802.1ad (QinQ) Ethernet types
+#define ETHERTYPE_8021AD 0x88A8
+#define ETHERTYPE_QINQ   0x9100
+
+//! Linux cooked capture v2 (for libpcap <1.10.0)
+#ifndef DLT_LINUX_SLL2
+#define DLT_LINUX_SLL2  276
+#endif
 
 //! NFLOG Support (for libpcap <1.6.0)
 #define DLT_NFLOG       239
@@ -109,6 +121,30 @@ typedef struct nflog_tlv {
 #define WH_LEN      0x7F
 #define WS_OPCODE_TEXT 0x1
 
+//! Max number of packets parsed with a single capture lock
+#define CAPTURE_BATCH_MAX 64
+//! Size of TLS threads queues when capture.queue is 0
+#define CAPTURE_TLS_QUEUE 8192
+//! Max RTP destinations in capture filter (all UDP is accepted above this)
+#define CAPTURE_RTP_FILTER_MAX 128
+//! Min seconds between capture filter updates
+#define CAPTURE_RTP_FILTER_INTERVAL 1
+//! Number of recently captured packets checked for duplicates (power of 2)
+#define CAPTURE_DEDUP_SLOTS 65536
+//! Bits of the capture time (ms) stored with each recent packet hash
+#define CAPTURE_DEDUP_TIME_BITS 24
+
+//! Initial size of IP fragments hash table
+#define IP_FRAGS_SIZE 64
+//! Seconds to receive all fragments of a datagram
+#define IP_FRAG_TIMEOUT 30
+//! Max memory for pending fragments of each capture source
+#define IP_FRAGS_MAX_MEMORY (4 * 1024 * 1024)
+//! Initial size of TCP flows hash table
+#define TCP_FLOWS_SIZE 128
+//! Seconds without data before a TCP flow is discarded
+#define TCP_FLOW_TIMEOUT 60
+
 enum capture_storage {
     CAPTURE_STORAGE_NONE = 0,
     CAPTURE_STORAGE_MEMORY,
@@ -119,6 +155,169 @@ enum capture_storage {
 typedef struct capture_config capture_config_t;
 //; Shorter declaration of capture_info structure
 typedef struct capture_info capture_info_t;
+//! Shorter declaration of capture_stats structure
+typedef struct capture_stats capture_stats_t;
+//! Get the link headers size of a packet (-1 if not valid)
+typedef int (*capture_link_f)(const capture_info_t *capinfo, const u_char *packet, uint32_t caplen);
+//! Shorter declaration of capture_tpacket structure
+typedef struct capture_tpacket capture_tpacket_t;
+//! Shorter declaration of capture_reader structure
+typedef struct capture_reader capture_reader_t;
+//! Shorter declaration of capture_merge structure
+typedef struct capture_merge capture_merge_t;
+//! Shorter declaration of capture_writer structure
+typedef struct capture_writer capture_writer_t;
+//! Shorter declaration of snapshot structure
+typedef struct snapshot snapshot_t;
+//! Shorter declaration of capture_worker structure
+typedef struct capture_worker capture_worker_t;
+//! Shorter declaration of IP reassembly structure
+typedef struct capture_ip_frag capture_ip_frag_t;
+typedef struct capture_ip_frag_key capture_ip_frag_key_t;
+//! Shorter declaration of TCP reassembly structures
+typedef struct capture_tcp_flow capture_tcp_flow_t;
+typedef struct capture_tcp_flow_key capture_tcp_flow_key_t;
+typedef struct capture_tcp_segment capture_tcp_segment_t;
+//! Forward declaration of SIP structures (see sip.h)
+struct sip_pending;
+struct sip_call;
+
+/**
+ * @brief Parser thread information
+ *
+ * Each parser thread has its own packet queue. Packets are sent to
+ * a worker depending on their Call-ID or RTP destination, so all the
+ * packets of a dialog or stream are parsed in order.
+ *
+ * TLS threads use the same structure, receiving all the packets of a
+ * connection in the same queue.
+ */
+struct capture_worker {
+    //! Packets pending to be parsed by this worker
+    ring_t *queue;
+    //! Worker thread is waiting for new packets
+    bool waiting;
+    //! Worker thread wakeup condition
+    pthread_cond_t cond;
+    //! Worker thread wakeup condition lock
+    pthread_mutex_t lock;
+    //! Worker thread
+    pthread_t thread;
+};
+
+/**
+ * @brief Hash table key of IP datagrams pending reassembly
+ */
+struct capture_ip_frag_key {
+    //! Source and destination addresses (without ports)
+    address_key_t src, dst;
+    //! IP identifier
+    uint32_t id;
+    //! IP protocol
+    uint8_t proto;
+    //! Unused (always zero)
+    uint8_t pad[3];
+};
+
+/**
+ * @brief IP datagram with pending fragments
+ */
+struct capture_ip_frag {
+    //! Hash table key (addresses, IP identifier and protocol)
+    capture_ip_frag_key_t key;
+    //! Packet with all the received fragments
+    packet_t *packet;
+    //! Memory used by received fragments
+    size_t memory;
+    //! Datagram is discarded if not completed before this time (seconds)
+    time_t deadline;
+    //! Previous and next pending datagrams (oldest first)
+    capture_ip_frag_t *prev, *next;
+};
+
+/**
+ * @brief TCP segment received before the previous ones
+ */
+struct capture_tcp_segment {
+    //! TCP sequence of the first byte
+    uint32_t seq;
+    //! Segment payload length
+    uint32_t len;
+    //! Segment payload
+    u_char data[];
+};
+
+/**
+ * @brief Hash table key of TCP connections pending reassembly
+ */
+struct capture_tcp_flow_key {
+    //! Source and destination addresses
+    address_key_t src, dst;
+};
+
+/**
+ * @brief TCP connection with a partially received message
+ *
+ * Segments are appended in sequence order to the flow buffer. Once the
+ * message headers are complete, its Content-Length determines how much
+ * data is required, so the payload is not validated again for every
+ * new segment.
+ */
+struct capture_tcp_flow {
+    //! Hash table key (source and destination ip:port)
+    capture_tcp_flow_key_t key;
+    //! Packet with all the frames of the pending data
+    packet_t *packet;
+    //! Assembled payload (always NULL terminated)
+    u_char *data;
+    //! Assembled payload length
+    uint32_t len;
+    //! Allocated payload size
+    uint32_t size;
+    //! TCP sequence of the first payload byte
+    uint32_t seq;
+    //! TCP sequence expected for the next segment
+    uint32_t next_seq;
+    //! Payload bytes already checked for the end of headers
+    uint32_t scanned;
+    //! Length of the first message (0 until its headers are complete)
+    uint32_t msglen;
+    //! Payload starts with a SIP request or response line
+    bool sip;
+    //! Out of order segments sorted by sequence (capture_tcp_segment_t)
+    vector_t *segments;
+    //! Time of the last received segment (seconds)
+    time_t last_seen;
+    //! Previous and next flows by activity (oldest first)
+    capture_tcp_flow_t *prev, *next;
+};
+
+/**
+ * @brief Packet counters of all capture sources
+ */
+struct capture_stats
+{
+    //! Packets received from capture sources
+    uint64_t packets;
+    //! Packets dropped by capture buffers (libpcap or kernel ring)
+    uint64_t drops;
+    //! Packets dropped by network interfaces
+    uint64_t ifdrops;
+    //! Packets dropped because parser queue was full
+    uint64_t queue_drops;
+    //! Dump file blocks waiting to be written
+    uint64_t dump_queue;
+    //! Frames not written to dump file
+    uint64_t dump_drops;
+    //! Packets waiting to be sent through EEP
+    uint64_t eep_queue;
+    //! Packets not sent through EEP
+    uint64_t eep_drops;
+    //! Packets relayed from EEP listener without parsing them
+    uint64_t eep_relayed;
+    //! Duplicated packets dropped before parsing
+    uint64_t duplicates;
+};
 
 /**
  * @brief Capture common configuration
@@ -144,12 +343,52 @@ struct capture_config {
     const char *filter;
     //! The compiled filter expression
     struct bpf_program fp;
+    //! Dump file for captured packets (NULL if not requested)
+    const char *outfile;
     //! libpcap dump file handler
     pcap_dumper_t *pd;
+    //! Dump file writer thread (NULL if dump file is written by libpcap)
+    capture_writer_t *writer;
     //! Capture sources
     vector_t *sources;
     //! Capture Lock. Avoid parsing and handling data at the same time
     pthread_mutex_t lock;
+    //! Parser threads (NULL if parsing in capture threads)
+    capture_worker_t *workers;
+    //! Number of parser threads
+    int nworkers;
+    //! Parser threads are running
+    bool parser_running;
+    //! Packets dropped because parser or TLS queue was full
+    uint32_t queue_drops;
+    //! TLS decryption threads (NULL if decrypting in capture threads)
+    capture_worker_t *tls_workers;
+    //! Number of TLS decryption threads
+    int ntls_workers;
+    //! TLS decryption threads are running
+    bool tls_running;
+    //! Packets queued to TLS threads and not yet sent to parser
+    uint32_t tls_pending;
+    //! Decoded packets not yet parsed (RTP streams of their SDP not created yet)
+    uint32_t unparsed;
+    //! Capture filter of online sources follows RTP streams destinations
+    bool rtp_filter;
+    //! Max number of packets parsed with a single capture lock
+    int batch_size;
+    //! IP datagrams discarded because not all fragments arrived in time
+    uint32_t ip_frags_expired;
+    //! IP datagrams discarded before completion (memory limit, invalid)
+    uint32_t ip_frags_incomplete;
+    //! Offline packets before this time are ignored (0 for no limit)
+    struct timeval from;
+    //! Offline packets after this time are ignored (0 for no limit)
+    struct timeval to;
+    //! Hash and capture time of recent packets checked for duplicates
+    uint64_t *dedup;
+    //! Max time between a packet and its duplicates (ms)
+    uint32_t dedup_window;
+    //! Duplicated packets dropped before parsing
+    uint64_t dedup_drops;
 };
 
 /**
@@ -165,6 +404,8 @@ struct capture_info
     int link;
     //! libpcap link header size
     int8_t link_hl;
+    //! Link headers decoder for this link type
+    capture_link_f link_decode;
     //! libpcap capture handler
     pcap_t *handle;
     //! Netmask of our sniffing device
@@ -175,12 +416,48 @@ struct capture_info
     const char *infile;
     //! Capture device in Online mode
     const char *device;
-    //! Packets pending IP reassembly
-    vector_t *ip_reasm;
-    //! Packets pending TCP reassembly
-    vector_t *tcp_reasm;
+    //! Source is being opened by its capture thread
+    bool opening;
+    //! Why this source could not be opened (empty if it was)
+    char error[PCAP_ERRBUF_SIZE + PATH_MAX];
+    //! Capture filter compiled for this source link type
+    struct bpf_program fp;
+    //! Datagrams pending IP reassembly indexed by addresses and id
+    htable_t *ip_frags;
+    //! Datagrams pending IP reassembly (oldest first)
+    capture_ip_frag_t *ip_first, *ip_last;
+    //! Memory used by pending IP fragments
+    size_t ip_frags_memory;
+    //! TCP flows pending reassembly indexed by addresses
+    htable_t *tcp_flows;
+    //! TCP flows sorted by last activity (oldest first)
+    capture_tcp_flow_t *tcp_first, *tcp_last;
+    //! TCP flow with more complete messages after the returned one
+    capture_tcp_flow_t *tcp_ready;
     //! Capture thread for online capturing
     pthread_t capture_t;
+    //! Decoded packets pending to be parsed
+    packet_t *batch[CAPTURE_BATCH_MAX];
+    //! Number of packets in batch
+    int batch_count;
+    //! Packets received from this source
+    uint64_t packets;
+    //! Drop packets already captured by any source
+    bool dedup;
+#ifdef USE_TPACKET
+    //! Linux TPACKET_V3 ring (NULL for libpcap sources)
+    capture_tpacket_t *tpacket;
+#endif
+    //! Offline file reader (NULL for files read by libpcap)
+    capture_reader_t *reader;
+    //! Input files of a merged offline source (NULL for single sources)
+    capture_merge_t *merge;
+    //! Snapshot file being restored (NULL for capture sources)
+    snapshot_t *snapshot;
+    //! RTP flow changes when capture filter was last updated
+    uint32_t rtp_filter_changes;
+    //! Time of last capture filter update (0 if never updated)
+    time_t rtp_filter_time;
 };
 
 /**
@@ -205,11 +482,27 @@ capture_deinit();
  * @param device Device to start capture from
  * @param outfile Dumpfile for captured packets
  *
+ * With capture.async enabled the device is opened later by its capture
+ * thread and errors are reported by @ref capture_sources_errors.
+ *
  * @return 0 on spawn success, 1 otherwise
  */
 int
 capture_online(const char *dev, const char *outfile);
 
+/**
+ * @brief Add a new capture source
+ *
+ * Append the given source to the capture sources list and open the dump
+ * file using the source link type if it is not opened yet.
+ *
+ * @param capinfo Capture source information
+ * @param outfile Dumpfile for captured packets
+ * @return 0 on success, 2 if dump file can not be opened
+ */
+int
+capture_add_source(capture_info_t *capinfo, const char *outfile);
+
 /**
  * @brief Read from pcap file and fill sngrep sctuctures
  *
@@ -218,6 +511,9 @@ capture_online(const char *dev, const char *outfile);
  *
  * @param infile File to read packets from
  *
+ * With capture.async enabled the file is opened later by its capture
+ * thread (except standard input and snapshot files).
+ *
  * @return 0 if load has been successfull, 1 otherwise
  */
 int
@@ -245,15 +541,13 @@ parse_packet(u_char *capinfo, const struct pcap_pkthdr *header, const u_char *pa
  * done to avoid reassembling too big packets, that aren't likely to be interesting
  * for sngrep.
  *
- * TODO
- * Assembly only works when all of the IP fragments are received in the good order.
- * Properly check memory boundaries during packet reconstruction.
- * Implement a way to timeout pending IP fragments after some time.
- * TODO
+ * Pending datagrams are discarded after IP_FRAG_TIMEOUT seconds or when their
+ * source fragments use more than IP_FRAGS_MAX_MEMORY bytes.
  *
  * @param capinfo Packet capture session information
  * @para header Header received from libpcap callback
  * @para packet Packet contents received from libpcap callback
+ * @param assembled Buffer for the whole assembled packet contents
  * @param size Packet size (not including Layer and Network headers)
  * @param caplen Full packet size (current fragment -> whole assembled packet)
  * @return a Packet structure when packet is not fragmented or fully reassembled
@@ -261,12 +555,22 @@ parse_packet(u_char *capinfo, const struct pcap_pkthdr *header, const u_char *pa
  */
 packet_t *
 capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *header,
-                        u_char *packet, uint32_t *size, uint32_t *caplen);
+                        const u_char *packet, u_char *assembled, uint32_t *size, uint32_t *caplen);
+
+/**
+ * @brief Remove all IP datagrams pending reassembly
+ *
+ * @param capinfo Packet capture session information
+ */
+void
+capture_ip_frags_clear(capture_info_t *capinfo);
 
 /**
  * @brief Reassembly capture TCP segments
  *
  * This function will try to assemble TCP segments of an existing packet.
+ * Segments are stored in a per connection flow, sorted by their sequence
+ * number. Retransmitted data is ignored.
  *
  * @note We assume packets higher than MAX_CAPTURE_LEN won't be SIP. This has been
  * done to avoid reassembling too big packets, that aren't likely to be interesting
@@ -283,17 +587,190 @@ packet_t *
 capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphdr *tcp,
                          u_char *payload, int size_payload);
 
+/**
+ * @brief Get next complete message of the last reassembled TCP flow
+ *
+ * A single TCP segment can complete more than one SIP message. This
+ * function returns the following ones after capture_packet_reasm_tcp.
+ *
+ * @param capinfo Packet capture session information
+ * @return a Packet structure with a complete SIP message or NULL
+ */
+packet_t *
+capture_packet_reasm_tcp_next(capture_info_t *capinfo);
+
+/**
+ * @brief Remove all TCP flows pending reassembly
+ *
+ * @param capinfo Packet capture session information
+ */
+void
+capture_tcp_flows_clear(capture_info_t *capinfo);
+
 /**
  * @brief Check if given payload belongs to a Websocket connection
  *
  * Parse the given payload and determine if given payload could belong
  * to a Websocket packet. This function will change the payload pointer
- * apnd size content to point to the SIP payload data.
+ * apnd size content to point to the SIP payload data, unmasking it in
+ * place.
+ *
+ * When the payload contains more frames after the first one, they are
+ * stored in a new packet that must be checked again.
+ *
+ * @param packet Decoded TCP packet
+ * @param next Packet with the following frames or NULL if there are none
+ * @return 1 if packet is websocket, 0 otherwise
+ */
+int
+capture_ws_check_packet(packet_t *packet, packet_t **next);
+
+/**
+ * @brief Parse and store a decoded packet
+ *
+ * Check if the packet contains SIP or RTP data, storing it and sending it
+ * to EEP and dump file outputs. Packets without interesting data will be
+ * destroyed.
+ *
+ * @param pkt Decoded packet structure
+ */
+void
+capture_packet_process(packet_t *pkt);
+
+/**
+ * @brief Parse and store a list of decoded packets
+ *
+ * Packets are parsed without the capture lock and then stored taking the
+ * lock only once for the whole list.
+ *
+ * @param pkts Decoded packets structures
+ * @param count Number of packets (up to CAPTURE_BATCH_MAX)
+ */
+void
+capture_packet_process_batch(packet_t **pkts, int count);
+
+/**
+ * @brief Parse all packets pending in the source batch
+ *
+ * @param capinfo Capture source information
+ */
+void
+capture_batch_flush(capture_info_t *capinfo);
+
+/**
+ * @brief Get the parser thread for a decoded packet
+ *
+ * SIP packets are assigned using their Call-ID hash, while any other
+ * packet is assigned using its destination address hash.
+ *
+ * @param pkt Decoded packet structure
+ * @return parser thread that must handle this packet
+ */
+capture_worker_t *
+capture_packet_worker(packet_t *pkt);
+
+/**
+ * @brief Send a decoded packet to a parser thread
+ *
+ * Online capture packets will be dropped if the parser queue is full, while
+ * offline capture will wait until there is space in the queue.
+ *
+ * @param capinfo Capture source of the packet (NULL for network sources)
+ * @param pkt Decoded packet structure
+ */
+void
+capture_queue_packet(capture_info_t *capinfo, packet_t *pkt);
+
+/**
+ * @brief Send a decoded TCP packet to a TLS thread
+ *
+ * All packets of a connection are sent to the same thread. Online capture
+ * packets will be dropped if the TLS queue is full, while offline capture
+ * will wait until there is space in the queue.
+ *
+ * @param capinfo Capture source of the packet
+ * @param pkt Decoded packet structure
+ */
+void
+capture_tls_queue_packet(capture_info_t *capinfo, packet_t *pkt);
+
+/**
+ * @brief Check if decoded packets are parsed by parser threads
+ *
+ * @return true if packets must be sent with @capture_queue_packet
+ */
+bool
+capture_parser_queued();
+
+/**
+ * @brief Parser thread for queued packets
+ *
+ * This thread parses the packets decoded by capture threads so they never
+ * wait for the capture lock.
+ *
+ * @param info Parser thread information
+ */
+void
+capture_parser_thread(void *info);
+
+/**
+ * @brief TLS decryption thread for queued packets
+ *
+ * This thread decrypts TLS segments decoded by capture threads and sends
+ * the resulting packets to the parser, so RSA and record decryption of
+ * different connections run in parallel.
+ *
+ * @param info TLS thread information
+ */
+void
+capture_tls_thread(void *info);
+
+/**
+ * @brief Get the number of packets dropped because parser queue was full
+ */
+uint32_t
+capture_queue_drops();
+
+/**
+ * @brief Get the number of IP datagrams whose fragments did not arrive in time
+ */
+uint32_t
+capture_ip_frags_expired();
+
+/**
+ * @brief Get the number of IP datagrams discarded before being reassembled
+ */
+uint32_t
+capture_ip_frags_incomplete();
+
+/**
+ * @brief Get packet counters of all capture sources
+ *
+ * Drop counters are only available for online capture sources.
+ *
+ * @param stats Pointer to store the counters
+ */
+void
+capture_stats(capture_stats_t *stats);
+
+/**
+ * @brief Read capture containers usage
+ *
+ * Reassembly containers are read while capture threads may be changing
+ * them, so only their sizes are reported.
+ *
+ * @param info Health report to fill
+ */
+void
+capture_health(health_info_t *info);
+
+/**
+ * @brief Get usage of parser threads queues
  *
- * @return 0 if packet is websocket, 1 otherwise
+ * @return usage percentage of the fullest queue (0 without parser threads)
  */
 int
-capture_ws_check_packet(packet_t *packet);
+capture_queue_usage();
 
 /**
  * @brief Check if the given packet structure is SIP/RTP/..
@@ -306,6 +783,36 @@ capture_ws_check_packet(packet_t *packet);
 int
 capture_packet_parse(packet_t *pkt);
 
+/**
+ * @brief Store a packet that has already been parsed
+ *
+ * Store the SIP message prepared outside the capture lock or check
+ * if the packet belongs to a RTP stream.
+ *
+ * @param pkt Packet structure
+ * @param pending Prepared SIP message or NULL if packet is not SIP
+ * @param stored Set to false if only packet data has been stored in the
+ *        returned call, so the packet can be destroyed
+ * @return call where the packet has been stored or NULL
+ */
+struct sip_call *
+capture_packet_store(packet_t *pkt, struct sip_pending *pending, bool *stored);
+
+/**
+ * @brief Pin a thread to a CPU and set its scheduling priority
+ *
+ * Threads of the same kind are spread over the CPUs of the list using
+ * their index.
+ *
+ * @param thread Thread to configure
+ * @param cpus CPU list (e.g. 0-3,6) or NULL to keep thread affinity
+ * @param index Thread number to select a CPU of the list
+ * @param priority SCHED_FIFO priority (1-99) or 0 to keep thread policy
+ * @return 0 on success, 1 otherwise
+ */
+int
+capture_thread_setup(pthread_t thread, const char *cpus, int index, int priority);
+
 /**
  * @brief Create a capture thread for online mode
  *
@@ -356,6 +863,49 @@ capture_set_bpf_filter(const char *filter);
 const char *
 capture_get_bpf_filter();
 
+/**
+ * @brief Update the capture filter with active RTP destinations
+ *
+ * When enabled, online sources only accept SIP packets matching the user
+ * filter (or capture.rtp.filter.sip setting) and UDP packets sent to the
+ * destination of an active RTP stream. This is invoked from the capture
+ * thread of the source and only rebuilds the filter once per interval
+ * when streams have changed.
+ *
+ * @param capinfo Capture source
+ */
+void
+capture_rtp_filter_update(capture_info_t *capinfo);
+
+/**
+ * @brief Set the time window of offline packets to parse
+ *
+ * Packets read from input files outside the window are ignored and
+ * files are no longer read after the window end.
+ *
+ * @param from Window start time (0 for no limit)
+ * @param to Window end time (0 for no limit)
+ */
+void
+capture_set_time_window(struct timeval from, struct timeval to);
+
+/**
+ * @brief Get the time window of offline packets to parse
+ *
+ * @param from Window start time (0 for no limit)
+ * @param to Window end time (0 for no limit)
+ */
+void
+capture_get_time_window(struct timeval *from, struct timeval *to);
+
+/**
+ * @brief Check if a packet timestamp is inside the offline time window
+ *
+ * @return -1 if is before the window, 1 if after, 0 if inside
+ */
+int
+capture_time_window_check(struct timeval ts);
+
 /**
  * @brief Pause/Resume capture
  *
@@ -384,6 +934,17 @@ capture_status();
 const char *
 capture_status_desc();
 
+/**
+ * @brief Get loading progress of offline files read by reader threads
+ *
+ * @param loaded Bytes of input files already decoded
+ * @param total Size of input files
+ * @param msecs Time elapsed since files started to be decoded
+ * @return number of files still being loaded
+ */
+int
+capture_load_progress(uint64_t *loaded, uint64_t *total, uint64_t *msecs);
+
 /**
  * @brief Get Input file from Offline mode
  *
@@ -402,6 +963,14 @@ capture_input_file();
 const char *
 capture_device();
 
+/**
+ * @brief Get the dump file for captured packets
+ *
+ * @return dump file name or NULL if packets are not dumped
+ */
+const char *
+capture_output_file();
+
 /**
  * @brief Get Key file from decrypting TLS packets
  *
@@ -432,6 +1001,21 @@ capture_tls_server();
 int
 capture_sources_count();
 
+/**
+ * @brief Print the errors of sources that could not be opened
+ *
+ * @return number of failed sources
+ */
+int
+capture_sources_errors();
+
+/**
+ * @brief Return the link type of the first capture source
+ * @return libpcap link type or -1 if there are no sources
+ */
+int
+capture_datalink();
+
 /**
  * @brief Return the last capture error
  */
@@ -469,6 +1053,28 @@ capture_close();
 int8_t
 datalink_size(int datalink);
 
+/**
+ * @brief Get the link headers decoder for a datalink
+ *
+ * Each decoder handles the headers of only one link type, so packets
+ * are decoded without checking their source link type.
+ *
+ * @param datalink libpcap link type
+ * @return decoder or NULL if link type is not handled
+ */
+capture_link_f
+capture_link_decoder(int datalink);
+
+/**
+ * @brief Set link type of a capture source
+ *
+ * @param capinfo Capture source
+ * @param datalink libpcap link type
+ * @return 0 if link type is handled, 1 otherwise
+ */
+int
+capture_set_link(capture_info_t *capinfo, int datalink);
+
 /**
  * @brief Open a new dumper file for capture handler
  */
@@ -44,21 +44,80 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <pcap.h>
 #include "capture_eep.h"
 #include "util.h"
 #include "setting.h"
+#include "sip_parser.h"
 
 capture_eep_config_t eep_cfg = { 0 };
 
 void *
 accept_eep_client(void *data);
 
+static void *
+capture_eep_send_thread(void *data);
+
+static void
+capture_eep_sendmmsg(struct mmsghdr *mmsgs, int count);
+
+/**
+ * @brief Create a client socket for a new EEP destination
+ *
+ * @return 0 if destination socket has been created, 1 otherwise
+ */
+static int
+capture_eep_connect(const char *host, const char *port)
+{
+    struct addrinfo *ai, hints[1] = { { 0 } };
+    int sock;
+
+    if (eep_cfg.client_count == EEP_SEND_MAX) {
+        fprintf(stderr, "EEP client: too many destinations (max %d)\n", EEP_SEND_MAX);
+        return 1;
+    }
+
+    hints->ai_flags = AI_NUMERICSERV;
+    hints->ai_family = AF_UNSPEC;
+    hints->ai_socktype = SOCK_DGRAM;
+    hints->ai_protocol = IPPROTO_UDP;
+
+    if (getaddrinfo(host, port, hints, &ai)) {
+        fprintf(stderr, "EEP client: failed getaddrinfo() for %s:%s\n", host, port);
+        return 1;
+    }
+
+    sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (sock < 0) {
+        fprintf(stderr, "Sender socket creation failed: %s\n", strerror(errno));
+        freeaddrinfo(ai);
+        return 1;
+    }
+    eep_cfg.client_socks[eep_cfg.client_count++] = sock;
+
+    if (connect(sock, ai->ai_addr, (socklen_t) (ai->ai_addrlen)) == -1) {
+        if (errno != EINPROGRESS) {
+            fprintf(stderr, "Sender socket creation failed: %s\n", strerror(errno));
+            freeaddrinfo(ai);
+            return 1;
+        }
+    }
+
+    freeaddrinfo(ai);
+    return 0;
+}
+
 int
 capture_eep_init()
 {
     struct addrinfo *ai, hints[1] = { { 0 } };
+    struct timeval timeout = { 0, EEP_RECV_TIMEOUT_MSECS * 1000 };
+    char fanout[MAX_SETTING_LEN], *dest, *port, *saveptr;
+    int size, count, sock, i, reuse = 1;
 
     // Setting for EEP client
     if (setting_enabled(SETTING_EEP_SEND)) {
@@ -69,32 +128,57 @@ capture_eep_init()
         eep_cfg.capt_password = setting_get_value(SETTING_EEP_SEND_PASS);
         eep_cfg.capt_id = setting_get_intvalue(SETTING_EEP_SEND_ID);;
 
-        hints->ai_flags = AI_NUMERICSERV;
-        hints->ai_family = AF_UNSPEC;
-        hints->ai_socktype = SOCK_DGRAM;
-        hints->ai_protocol = IPPROTO_UDP;
-
-        if (getaddrinfo(eep_cfg.capt_host, eep_cfg.capt_port, hints, &ai)) {
-            fprintf(stderr, "EEP client: failed getaddrinfo() for %s:%s\n",
-                    eep_cfg.capt_host, eep_cfg.capt_port);
+        // Connect to main destination
+        if (capture_eep_connect(eep_cfg.capt_host, eep_cfg.capt_port) != 0)
             return 1;
+
+        // Connect to extra destinations (address:port separated by commas)
+        memset(fanout, 0, sizeof(fanout));
+        if (setting_get_value(SETTING_EEP_SEND_FANOUT))
+            strncpy(fanout, setting_get_value(SETTING_EEP_SEND_FANOUT), sizeof(fanout) - 1);
+        for (dest = strtok_r(fanout, ",", &saveptr); dest; dest = strtok_r(NULL, ",", &saveptr)) {
+            if (!(port = strrchr(dest, ':'))) {
+                fprintf(stderr, "EEP client: invalid destination %s\n", dest);
+                return 1;
+            }
+            *port++ = '\0';
+            if (capture_eep_connect(dest, port) != 0)
+                return 1;
         }
 
-        eep_cfg.client_sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-        if (eep_cfg.client_sock < 0) {
-            fprintf(stderr, "Sender socket creation failed: %s\n", strerror(errno));
+        // Create the send queue with all its packets unused
+        if ((size = setting_get_intvalue(SETTING_EEP_SEND_QUEUE)) <= 0
+            || !(eep_cfg.send_msgs = calloc(size, sizeof(capture_eep_msg_t)))
+            || !(eep_cfg.send_free = ring_create(size))
+            || !(eep_cfg.send_queue = ring_create(size))) {
+            fprintf(stderr, "Can't allocate memory for EEP send queue!\n");
+            return 1;
+        }
+        for (i = 0; i < size; i++)
+            ring_push(eep_cfg.send_free, &eep_cfg.send_msgs[i]);
+        eep_cfg.send_size = size;
+
+        // Create a new thread for sending queued packets
+        eep_cfg.client_running = true;
+        if (pthread_create(&eep_cfg.client_thread, NULL, capture_eep_send_thread, NULL) != 0) {
+            fprintf(stderr, "Error creating sender thread: %s\n", strerror(errno));
+            eep_cfg.client_running = false;
             return 1;
         }
+    }
 
-        if (connect(eep_cfg.client_sock, ai->ai_addr, (socklen_t) (ai->ai_addrlen)) == -1) {
-            if (errno != EINPROGRESS) {
-                fprintf(stderr, "Sender socket creation failed: %s\n", strerror(errno));
+    if (setting_enabled(SETTING_EEP_LISTEN)) {
+        // Received packets are only forwarded to EEP destinations
+        if (setting_enabled(SETTING_EEP_RELAY)) {
+            if (!eep_cfg.client_count) {
+                fprintf(stderr, "EEP relay requires at least one destination (-H)\n");
                 return 1;
             }
+            eep_cfg.relay = true;
+            eep_cfg.relay_id = setting_get_intvalue(SETTING_EEP_RELAY_ID);
+            eep_cfg.relay_sample = setting_get_intvalue(SETTING_EEP_RELAY_SAMPLE);
         }
-    }
 
-    if (setting_enabled(SETTING_EEP_LISTEN)) {
         // Fill configuration structure
         eep_cfg.capt_srv_version = setting_get_intvalue(SETTING_EEP_LISTEN_VER);
         eep_cfg.capt_srv_host = setting_get_value(SETTING_EEP_LISTEN_ADDR);
@@ -112,25 +196,49 @@ capture_eep_init()
             return 1;
         }
 
-        // Create a socket for a new TCP IPv4 connection
-        eep_cfg.server_sock = socket(AF_INET, SOCK_DGRAM, 0);
-        if (eep_cfg.client_sock < 0) {
-            fprintf(stderr, "Error creating server socket: %s\n", strerror(errno));
-            return 1;
-        }
+        // Multiple listener threads share the port using SO_REUSEPORT
+        count = setting_get_intvalue(SETTING_EEP_LISTEN_THREADS);
+        if (count < 1)
+            count = 1;
+        if (count > EEP_LISTEN_MAX)
+            count = EEP_LISTEN_MAX;
+
+        while (eep_cfg.server_count < count) {
+            // Create a socket for receiving HEP datagrams
+            if ((sock = socket(ai->ai_family, SOCK_DGRAM, 0)) < 0) {
+                fprintf(stderr, "Error creating server socket: %s\n", strerror(errno));
+                return 1;
+            }
+            eep_cfg.server_socks[eep_cfg.server_count++] = sock;
 
-        // Bind that socket to the requested address and port
-        if (bind(eep_cfg.server_sock, ai->ai_addr, ai->ai_addrlen) == -1) {
-            fprintf(stderr, "Error binding address: %s\n", strerror(errno));
-            return 1;
-        }
+            if (count > 1 && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1) {
+                fprintf(stderr, "Error sharing server socket: %s\n", strerror(errno));
+                return 1;
+            }
 
-        // Create a new thread for accepting client connections
-        if (pthread_create(&eep_cfg.server_thread, NULL, accept_eep_client, NULL) != 0) {
-            fprintf(stderr, "Error creating accept thread: %s\n", strerror(errno));
-            return 1;
+            // Wake up periodically to check if thread must stop
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            // Bind that socket to the requested address and port
+            if (bind(sock, ai->ai_addr, ai->ai_addrlen) == -1) {
+                fprintf(stderr, "Error binding address: %s\n", strerror(errno));
+                return 1;
+            }
         }
 
+        // Create a new thread for each listener socket
+        eep_cfg.server_running = true;
+        for (i = 0; i < count; i++) {
+            if (pthread_create(&eep_cfg.server_threads[i], NULL, accept_eep_client,
+                               &eep_cfg.server_socks[i]) != 0) {
+                fprintf(stderr, "Error creating accept thread: %s\n", strerror(errno));
+                // Stop already running threads
+                __atomic_store_n(&eep_cfg.server_running, false, __ATOMIC_RELEASE);
+                while (i--)
+                    pthread_join(eep_cfg.server_threads[i], NULL);
+                return 1;
+            }
+        }
     }
 
     // Settings for EEP server
@@ -141,36 +249,105 @@ capture_eep_init()
 void *
 accept_eep_client(void *data)
 {
-    packet_t *pkt;
+    int sock = *(int *) data;
+    unsigned char *buffers;
+    struct mmsghdr mmsgs[EEP_RECV_BATCH], relay_mmsgs[EEP_RECV_BATCH];
+    struct iovec iovs[EEP_RECV_BATCH], relay_iovs[EEP_RECV_BATCH];
+    packet_t *pkts[EEP_RECV_BATCH];
+    int count, received, i;
+
+    if (!(buffers = malloc(EEP_RECV_BATCH * MAX_CAPTURE_LEN)))
+        return NULL;
+
+    memset(mmsgs, 0, sizeof(mmsgs));
+    memset(relay_mmsgs, 0, sizeof(relay_mmsgs));
+    for (i = 0; i < EEP_RECV_BATCH; i++) {
+        iovs[i].iov_base = buffers + i * MAX_CAPTURE_LEN;
+        iovs[i].iov_len = MAX_CAPTURE_LEN;
+        mmsgs[i].msg_hdr.msg_iov = &iovs[i];
+        mmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
     // Begin accepting connections
-    while (eep_cfg.server_sock > 0) {
-        if ((pkt = capture_eep_receive())) {
-            // Avoid parsing from multiples sources.
-            // Avoid parsing while screen in being redrawn
-            capture_lock();
-            if (capture_packet_parse(pkt) != 0) {
-                packet_destroy(pkt);
+    while (__atomic_load_n(&eep_cfg.server_running, __ATOMIC_ACQUIRE)) {
+        // Wait for the first datagram, get any other already received
+        if ((received = recvmmsg(sock, mmsgs, EEP_RECV_BATCH, MSG_WAITFORONE, NULL)) <= 0)
+            continue;
+
+        if (eep_cfg.relay) {
+            // Forward received datagrams without parsing them
+            for (i = 0, count = 0; i < received; i++) {
+                if (capture_eep_relay_check(iovs[i].iov_base, mmsgs[i].msg_len)) {
+                    relay_iovs[count].iov_base = iovs[i].iov_base;
+                    relay_iovs[count].iov_len = mmsgs[i].msg_len;
+                    relay_mmsgs[count].msg_hdr.msg_iov = &relay_iovs[count];
+                    relay_mmsgs[count].msg_hdr.msg_iovlen = 1;
+                    count++;
+                }
             }
-            capture_unlock();
+            if (count) {
+                capture_eep_sendmmsg(relay_mmsgs, count);
+                __atomic_add_fetch(&eep_cfg.relay_packets, count, __ATOMIC_RELAXED);
+            }
+            continue;
+        }
+
+        for (i = 0, count = 0; i < received; i++) {
+            if ((pkts[count] = capture_eep_decode(iovs[i].iov_base, mmsgs[i].msg_len)))
+                count++;
+        }
+
+        if (capture_parser_queued()) {
+            // Let the parser threads handle received packets
+            for (i = 0; i < count; i++)
+                capture_queue_packet(NULL, pkts[i]);
+        } else if (count) {
+            // Parse all received packets taking capture lock once
+            capture_packet_process_batch(pkts, count);
         }
     }
 
-    // Leave the thread gracefully
-    pthread_exit(NULL);
-    return 0;
+    free(buffers);
+    return NULL;
 }
 
 void
 capture_eep_deinit()
 {
-    if (eep_cfg.client_sock)
-        close(eep_cfg.client_sock);
+    int i;
+
+    // Stop listener threads before they feed more packets to capture
+    if (eep_cfg.server_running) {
+        __atomic_store_n(&eep_cfg.server_running, false, __ATOMIC_RELEASE);
+        for (i = 0; i < eep_cfg.server_count; i++)
+            pthread_join(eep_cfg.server_threads[i], NULL);
+    }
 
-    if (eep_cfg.server_sock) {
-        close(eep_cfg.server_sock);
-        eep_cfg.server_sock = -1;
-        //pthread_join(&eep_cfg.server_thread, &ret);
+    for (i = 0; i < eep_cfg.server_count; i++)
+        close(eep_cfg.server_socks[i]);
+    eep_cfg.server_count = 0;
+
+    // Wait until all queued packets have been sent
+    if (eep_cfg.client_running) {
+        // Packets are queued with capture lock held, no more will be queued after this
+        capture_lock();
+        __atomic_store_n(&eep_cfg.client_running, false, __ATOMIC_RELEASE);
+        capture_unlock();
+        pthread_join(eep_cfg.client_thread, NULL);
+    }
+
+    for (i = 0; i < eep_cfg.client_count; i++)
+        close(eep_cfg.client_socks[i]);
+    eep_cfg.client_count = 0;
+
+    if (eep_cfg.send_msgs) {
+        for (i = 0; i < eep_cfg.send_size; i++)
+            free(eep_cfg.send_msgs[i].data);
+        free(eep_cfg.send_msgs);
+        ring_destroy(eep_cfg.send_free);
+        ring_destroy(eep_cfg.send_queue);
+        eep_cfg.send_msgs = NULL;
+        eep_cfg.send_free = eep_cfg.send_queue = NULL;
     }
 }
 
@@ -189,27 +366,54 @@ capture_eep_listen_port()
 int
 capture_eep_send(packet_t *pkt)
 {
+    capture_eep_msg_t *msg;
+    frame_t *frame;
+    unsigned char *data;
+    uint32_t len;
+
     // Dont send RTP packets
     if (pkt->type == PACKET_RTP)
         return 1;
 
-    // Check we have a connection established
-    if (!eep_cfg.client_sock)
+    // Check we have a connection established and sender is still running
+    if (!eep_cfg.client_count || !__atomic_load_n(&eep_cfg.client_running, __ATOMIC_ACQUIRE))
         return 1;
 
-    switch (eep_cfg.capt_version) {
-        case 2:
-            return capture_eep_send_v2(pkt);
-        case 3:
-            return capture_eep_send_v3(pkt);
+    // Get an unused queue entry
+    if (!(msg = ring_pop(eep_cfg.send_free))) {
+        __atomic_add_fetch(&eep_cfg.send_drops, 1, __ATOMIC_RELAXED);
+        return 1;
     }
-    return 1;
+
+    // Grow payload buffer if required
+    len = packet_payloadlen(pkt);
+    if (len > msg->size) {
+        if (!(data = realloc(msg->data, len))) {
+            ring_push(eep_cfg.send_free, msg);
+            __atomic_add_fetch(&eep_cfg.send_drops, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+        msg->data = data;
+        msg->size = len;
+    }
+
+    // Copy packet data, packet can be freed before being sent
+    frame = vector_first(pkt->frames);
+    msg->ip_version = pkt->ip_version;
+    msg->proto = pkt->proto;
+    msg->src = pkt->src;
+    msg->dst = pkt->dst;
+    msg->ts = frame->header.ts;
+    msg->len = len;
+    memcpy(msg->data, packet_payload(pkt), len);
+
+    ring_push(eep_cfg.send_queue, msg);
+    return 0;
 }
 
-int
-capture_eep_send_v2(packet_t *pkt)
+uint32_t
+capture_eep_encode_v2(capture_eep_msg_t *msg, unsigned char *buffer)
 {
-    void* buffer;
     uint32_t buflen = 0, tlen = 0;
     struct hep_hdr hdr;
     struct hep_timehdr hep_time;
@@ -217,131 +421,107 @@ capture_eep_send_v2(packet_t *pkt)
 #ifdef USE_IPV6
     struct hep_ip6hdr hep_ip6header;
 #endif
-    unsigned char *data = packet_payload(pkt);
-    uint32_t len = packet_payloadlen(pkt);
-    frame_t *frame = vector_first(pkt->frames);
 
     /* Version && proto */
+    memset(&hdr, 0, sizeof(hdr));
     hdr.hp_v = 2;
-    hdr.hp_f = pkt->ip_version == 4 ? AF_INET : AF_INET6;
-    hdr.hp_p = pkt->proto;
-    hdr.hp_sport = htons(pkt->src.port);
-    hdr.hp_dport = htons(pkt->dst.port);
+    hdr.hp_f = msg->ip_version == 4 ? AF_INET : AF_INET6;
+    hdr.hp_p = msg->proto;
+    hdr.hp_sport = htons(msg->src.port);
+    hdr.hp_dport = htons(msg->dst.port);
 
     /* Timestamp */
-    hep_time.tv_sec = frame->header->ts.tv_sec;
-    hep_time.tv_usec = frame->header->ts.tv_usec;
+    hep_time.tv_sec = msg->ts.tv_sec;
+    hep_time.tv_usec = msg->ts.tv_usec;
     hep_time.captid = eep_cfg.capt_id;
 
     /* Calculate initial HEP packet size */
     tlen = sizeof(struct hep_hdr) + sizeof(struct hep_timehdr);
 
     /* IPv4 */
-    if (pkt->ip_version == 4) {
-        inet_pton(AF_INET, pkt->src.ip, &hep_ipheader.hp_src);
-        inet_pton(AF_INET, pkt->dst.ip, &hep_ipheader.hp_dst);
+    if (msg->ip_version == 4) {
+        memcpy(&hep_ipheader.hp_src, msg->src.ip.bytes, sizeof(hep_ipheader.hp_src));
+        memcpy(&hep_ipheader.hp_dst, msg->dst.ip.bytes, sizeof(hep_ipheader.hp_dst));
         tlen += sizeof(struct hep_iphdr);
-        hdr.hp_l += sizeof(struct hep_iphdr);
     }
 
 #ifdef USE_IPV6
     /* IPv6 */
-    else if(pkt->ip_version == 6) {
-        inet_pton(AF_INET6, pkt->src.ip, &hep_ip6header.hp6_src);
-        inet_pton(AF_INET6, pkt->dst.ip, &hep_ip6header.hp6_dst);
+    else if(msg->ip_version == 6) {
+        memcpy(&hep_ip6header.hp6_src, msg->src.ip.bytes, sizeof(hep_ip6header.hp6_src));
+        memcpy(&hep_ip6header.hp6_dst, msg->dst.ip.bytes, sizeof(hep_ip6header.hp6_dst));
         tlen += sizeof(struct hep_ip6hdr);
-        hdr.hp_l += sizeof(struct hep_ip6hdr);
     }
 #endif
 
     // Add payload size to the final size of HEP packet
-    tlen += len;
+    tlen += msg->len;
     hdr.hp_l = htons(tlen);
 
-    // Allocate memory for HEPv2 packet
-    if (!(buffer = sng_malloc(tlen)))
-        return 1;
-
     // Copy basic headers
-    buflen = 0;
-    memcpy((void*) buffer + buflen, &hdr, sizeof(struct hep_hdr));
+    memcpy(buffer + buflen, &hdr, sizeof(struct hep_hdr));
     buflen += sizeof(struct hep_hdr);
 
     // Copy IP header
-    if (pkt->ip_version == 4) {
-        memcpy((void*) buffer + buflen, &hep_ipheader, sizeof(struct hep_iphdr));
+    if (msg->ip_version == 4) {
+        memcpy(buffer + buflen, &hep_ipheader, sizeof(struct hep_iphdr));
         buflen += sizeof(struct hep_iphdr);
     }
 #ifdef USE_IPV6
-    else if(pkt->ip_version == 6) {
-        memcpy((void*) buffer + buflen, &hep_ip6header, sizeof(struct hep_ip6hdr));
+    else if(msg->ip_version == 6) {
+        memcpy(buffer + buflen, &hep_ip6header, sizeof(struct hep_ip6hdr));
         buflen += sizeof(struct hep_ip6hdr);
     }
 #endif
 
     // Copy TImestamp header
-    memcpy((void*) buffer + buflen, &hep_time, sizeof(struct hep_timehdr));
+    memcpy(buffer + buflen, &hep_time, sizeof(struct hep_timehdr));
     buflen += sizeof(struct hep_timehdr);
 
-    // Now copy payload itself
-    memcpy((void*) buffer + buflen, data, len);
-    buflen += len;
-
-    if (send(eep_cfg.client_sock, buffer, buflen, 0) == -1) {
-        return 1;
-    }
-
-    /* FREE */
-    sng_free(buffer);
-
-    return 1;
+    return buflen;
 }
 
-int
-capture_eep_send_v3(packet_t *pkt)
+uint32_t
+capture_eep_encode_v3(capture_eep_msg_t *msg, unsigned char *buffer)
 {
-    struct hep_generic *hg = NULL;
-    void* buffer;
-    uint32_t buflen = 0, iplen = 0, tlen = 0;
+    struct hep_generic hg;
+    uint32_t buflen = 0, iplen = 0, tlen = 0, passlen = 0;
     hep_chunk_ip4_t src_ip4, dst_ip4;
 #ifdef USE_IPV6
     hep_chunk_ip6_t src_ip6, dst_ip6;
 #endif
     hep_chunk_t payload_chunk;
     hep_chunk_t authkey_chunk;
-    frame_t *frame = vector_first(pkt->frames);
-    unsigned char *data = packet_payload(pkt);
-    uint32_t len = packet_payloadlen(pkt);
 
-    hg = sng_malloc(sizeof(struct hep_generic));
+    memset(&hg, 0, sizeof(hg));
 
     /* header set "HEP3" */
-    memcpy(hg->header.id, "\x48\x45\x50\x33", 4);
+    memcpy(hg.header.id, "\x48\x45\x50\x33", 4);
 
     /* IP proto */
-    hg->ip_family.chunk.vendor_id = htons(0x0000);
-    hg->ip_family.chunk.type_id = htons(0x0001);
-    hg->ip_family.data = pkt->ip_version == 4 ? AF_INET : AF_INET6;
-    hg->ip_family.chunk.length = htons(sizeof(hg->ip_family));
+    hg.ip_family.chunk.vendor_id = htons(0x0000);
+    hg.ip_family.chunk.type_id = htons(0x0001);
+    hg.ip_family.data = msg->ip_version == 4 ? AF_INET : AF_INET6;
+    hg.ip_family.chunk.length = htons(sizeof(hg.ip_family));
 
     /* Proto ID */
-    hg->ip_proto.chunk.vendor_id = htons(0x0000);
-    hg->ip_proto.chunk.type_id = htons(0x0002);
-    hg->ip_proto.data = pkt->proto;
-    hg->ip_proto.chunk.length = htons(sizeof(hg->ip_proto));
+    hg.ip_proto.chunk.vendor_id = htons(0x0000);
+    hg.ip_proto.chunk.type_id = htons(0x0002);
+    hg.ip_proto.data = msg->proto;
+    hg.ip_proto.chunk.length = htons(sizeof(hg.ip_proto));
 
     /* IPv4 */
-    if (pkt->ip_version == 4) {
+    if (msg->ip_version == 4) {
         /* SRC IP */
         src_ip4.chunk.vendor_id = htons(0x0000);
         src_ip4.chunk.type_id = htons(0x0003);
-        inet_pton(AF_INET, pkt->src.ip, &src_ip4.data);
+        memcpy(&src_ip4.data, msg->src.ip.bytes, sizeof(src_ip4.data));
         src_ip4.chunk.length = htons(sizeof(src_ip4));
 
         /* DST IP */
         dst_ip4.chunk.vendor_id = htons(0x0000);
         dst_ip4.chunk.type_id = htons(0x0004);
-        inet_pton(AF_INET, pkt->dst.ip, &dst_ip4.data);
+        memcpy(&dst_ip4.data, msg->dst.ip.bytes, sizeof(dst_ip4.data));
         dst_ip4.chunk.length = htons(sizeof(dst_ip4));
 
         iplen = sizeof(dst_ip4) + sizeof(src_ip4);
@@ -349,17 +529,17 @@ capture_eep_send_v3(packet_t *pkt)
 
 #ifdef USE_IPV6
     /* IPv6 */
-    else if(pkt->ip_version == 6) {
+    else if(msg->ip_version == 6) {
         /* SRC IPv6 */
         src_ip6.chunk.vendor_id = htons(0x0000);
         src_ip6.chunk.type_id = htons(0x0005);
-        inet_pton(AF_INET6, pkt->src.ip, &src_ip6.data);
+        memcpy(&src_ip6.data, msg->src.ip.bytes, sizeof(src_ip6.data));
         src_ip6.chunk.length = htons(sizeof(src_ip6));
 
         /* DST IPv6 */
         dst_ip6.chunk.vendor_id = htons(0x0000);
         dst_ip6.chunk.type_id = htons(0x0006);
-        inet_pton(AF_INET6, pkt->dst.ip, &dst_ip6.data);
+        memcpy(&dst_ip6.data, msg->dst.ip.bytes, sizeof(dst_ip6.data));
         dst_ip6.chunk.length = htons(sizeof(dst_ip6));
 
         iplen = sizeof(dst_ip6) + sizeof(src_ip6);
@@ -367,87 +547,84 @@ capture_eep_send_v3(packet_t *pkt)
 #endif
 
     /* SRC PORT */
-    hg->src_port.chunk.vendor_id = htons(0x0000);
-    hg->src_port.chunk.type_id = htons(0x0007);
-    hg->src_port.data = htons(pkt->src.port);
-    hg->src_port.chunk.length = htons(sizeof(hg->src_port));
+    hg.src_port.chunk.vendor_id = htons(0x0000);
+    hg.src_port.chunk.type_id = htons(0x0007);
+    hg.src_port.data = htons(msg->src.port);
+    hg.src_port.chunk.length = htons(sizeof(hg.src_port));
 
     /* DST PORT */
-    hg->dst_port.chunk.vendor_id = htons(0x0000);
-    hg->dst_port.chunk.type_id = htons(0x0008);
-    hg->dst_port.data = htons(pkt->dst.port);
-    hg->dst_port.chunk.length = htons(sizeof(hg->dst_port));
+    hg.dst_port.chunk.vendor_id = htons(0x0000);
+    hg.dst_port.chunk.type_id = htons(0x0008);
+    hg.dst_port.data = htons(msg->dst.port);
+    hg.dst_port.chunk.length = htons(sizeof(hg.dst_port));
 
     /* TIMESTAMP SEC */
-    hg->time_sec.chunk.vendor_id = htons(0x0000);
-    hg->time_sec.chunk.type_id = htons(0x0009);
-    hg->time_sec.data = htonl(frame->header->ts.tv_sec);
-    hg->time_sec.chunk.length = htons(sizeof(hg->time_sec));
+    hg.time_sec.chunk.vendor_id = htons(0x0000);
+    hg.time_sec.chunk.type_id = htons(0x0009);
+    hg.time_sec.data = htonl(msg->ts.tv_sec);
+    hg.time_sec.chunk.length = htons(sizeof(hg.time_sec));
 
     /* TIMESTAMP USEC */
-    hg->time_usec.chunk.vendor_id = htons(0x0000);
-    hg->time_usec.chunk.type_id = htons(0x000a);
-    hg->time_usec.data = htonl(frame->header->ts.tv_usec);
-    hg->time_usec.chunk.length = htons(sizeof(hg->time_usec));
+    hg.time_usec.chunk.vendor_id = htons(0x0000);
+    hg.time_usec.chunk.type_id = htons(0x000a);
+    hg.time_usec.data = htonl(msg->ts.tv_usec);
+    hg.time_usec.chunk.length = htons(sizeof(hg.time_usec));
 
     /* Protocol TYPE */
-    hg->proto_t.chunk.vendor_id = htons(0x0000);
-    hg->proto_t.chunk.type_id = htons(0x000b);
-    hg->proto_t.data = 1;
-    hg->proto_t.chunk.length = htons(sizeof(hg->proto_t));
+    hg.proto_t.chunk.vendor_id = htons(0x0000);
+    hg.proto_t.chunk.type_id = htons(0x000b);
+    hg.proto_t.data = 1;
+    hg.proto_t.chunk.length = htons(sizeof(hg.proto_t));
 
     /* Capture ID */
-    hg->capt_id.chunk.vendor_id = htons(0x0000);
-    hg->capt_id.chunk.type_id = htons(0x000c);
-    hg->capt_id.data = htons(eep_cfg.capt_id);
-    hg->capt_id.chunk.length = htons(sizeof(hg->capt_id));
+    hg.capt_id.chunk.vendor_id = htons(0x0000);
+    hg.capt_id.chunk.type_id = htons(0x000c);
+    hg.capt_id.data = htonl(eep_cfg.capt_id);
+    hg.capt_id.chunk.length = htons(sizeof(hg.capt_id));
 
     /* Payload */
     payload_chunk.vendor_id = htons(0x0000);
     payload_chunk.type_id = htons(0x000f);
-    payload_chunk.length = htons(sizeof(payload_chunk) + len);
+    payload_chunk.length = htons(sizeof(payload_chunk) + msg->len);
 
-    tlen = sizeof(struct hep_generic) + len + iplen + sizeof(hep_chunk_t);
+    tlen = sizeof(struct hep_generic) + msg->len + iplen + sizeof(hep_chunk_t);
 
     /* auth key */
     if (eep_cfg.capt_password != NULL) {
+        passlen = strlen(eep_cfg.capt_password);
 
         tlen += sizeof(hep_chunk_t);
         /* Auth key */
         authkey_chunk.vendor_id = htons(0x0000);
         authkey_chunk.type_id = htons(0x000e);
-        authkey_chunk.length = htons(sizeof(authkey_chunk) + strlen(eep_cfg.capt_password));
-        tlen += strlen(eep_cfg.capt_password);
+        authkey_chunk.length = htons(sizeof(authkey_chunk) + passlen);
+        tlen += passlen;
     }
 
     /* total */
-    hg->header.length = htons(tlen);
+    hg.header.length = htons(tlen);
 
-    if (!(buffer = sng_malloc(tlen))) {
-        sng_free(hg);
-        return 1;
-    }
-    memcpy((void*) buffer, hg, sizeof(struct hep_generic));
+    memcpy(buffer, &hg, sizeof(struct hep_generic));
     buflen = sizeof(struct hep_generic);
 
     /* IPv4 */
-    if (pkt->ip_version == 4) {
+    if (msg->ip_version == 4) {
         /* SRC IP */
-        memcpy((void*) buffer + buflen, &src_ip4, sizeof(struct hep_chunk_ip4));
+        memcpy(buffer + buflen, &src_ip4, sizeof(struct hep_chunk_ip4));
         buflen += sizeof(struct hep_chunk_ip4);
 
-        memcpy((void*) buffer + buflen, &dst_ip4, sizeof(struct hep_chunk_ip4));
+        memcpy(buffer + buflen, &dst_ip4, sizeof(struct hep_chunk_ip4));
         buflen += sizeof(struct hep_chunk_ip4);
     }
 
 #ifdef USE_IPV6
     /* IPv6 */
-    else if(pkt->ip_version == 6) {
+    else if(msg->ip_version == 6) {
         /* SRC IPv6 */
-        memcpy((void*) buffer+buflen, &src_ip4, sizeof(struct hep_chunk_ip6));
+        memcpy(buffer + buflen, &src_ip6, sizeof(struct hep_chunk_ip6));
         buflen += sizeof(struct hep_chunk_ip6);
 
-        memcpy((void*) buffer+buflen, &dst_ip6, sizeof(struct hep_chunk_ip6));
+        memcpy(buffer + buflen, &dst_ip6, sizeof(struct hep_chunk_ip6));
         buflen += sizeof(struct hep_chunk_ip6);
     }
 #endif
@@ -455,62 +632,269 @@ capture_eep_send_v3(packet_t *pkt)
     /* AUTH KEY CHUNK */
     if (eep_cfg.capt_password != NULL) {
 
-        memcpy((void*) buffer + buflen, &authkey_chunk, sizeof(struct hep_chunk));
+        memcpy(buffer + buflen, &authkey_chunk, sizeof(struct hep_chunk));
         buflen += sizeof(struct hep_chunk);
 
         /* Now copying payload self */
-        memcpy((void*) buffer + buflen, eep_cfg.capt_password, strlen(eep_cfg.capt_password));
-        buflen += strlen(eep_cfg.capt_password);
+        memcpy(buffer + buflen, eep_cfg.capt_password, passlen);
+        buflen += passlen;
     }
 
     /* PAYLOAD CHUNK */
-    memcpy((void*) buffer + buflen, &payload_chunk, sizeof(struct hep_chunk));
+    memcpy(buffer + buflen, &payload_chunk, sizeof(struct hep_chunk));
     buflen += sizeof(struct hep_chunk);
 
-    /* Now copying payload itself */
-    memcpy((void*) buffer + buflen, data, len);
-    buflen += len;
+    return buflen;
+}
 
-    if (send(eep_cfg.client_sock, buffer, buflen, 0) == -1) {
-        return 1;
+/**
+ * @brief Send a batch of packets to all EEP destinations
+ */
+static void
+capture_eep_sendmmsg(struct mmsghdr *mmsgs, int count)
+{
+    int dest, sent, ret;
+
+    for (dest = 0; dest < eep_cfg.client_count; dest++) {
+        // Skip packets that fail, keep sending the rest
+        for (sent = 0; sent < count; sent += (ret > 0) ? ret : 1) {
+            if ((ret = sendmmsg(eep_cfg.client_socks[dest], mmsgs + sent, count - sent, 0)) <= 0)
+                __atomic_add_fetch(&eep_cfg.send_errors, 1, __ATOMIC_RELAXED);
+        }
     }
+}
 
-    /* FREE */
-    sng_free(buffer);
-    sng_free(hg);
-    return 0;
+/**
+ * @brief Send queued packets in batches
+ *
+ * HEP headers of each packet are encoded into a preallocated buffer and
+ * sent along with packet payload without copying it again.
+ */
+static void *
+capture_eep_send_thread(void *data)
+{
+    unsigned char *headers;
+    capture_eep_msg_t *msgs[EEP_SEND_BATCH];
+    struct mmsghdr mmsgs[EEP_SEND_BATCH];
+    struct iovec iovs[EEP_SEND_BATCH][2];
+    int count, i;
+
+    if (!(headers = malloc(EEP_SEND_BATCH * EEP_HEADER_MAX)))
+        return NULL;
+
+    memset(mmsgs, 0, sizeof(mmsgs));
+
+    // Send all queued packets before leaving
+    while (__atomic_load_n(&eep_cfg.client_running, __ATOMIC_ACQUIRE) || ring_count(eep_cfg.send_queue)) {
+
+        // Get a batch of queued packets
+        for (count = 0; count < EEP_SEND_BATCH; count++) {
+            if (!(msgs[count] = ring_pop(eep_cfg.send_queue)))
+                break;
+            iovs[count][0].iov_base = headers + count * EEP_HEADER_MAX;
+            iovs[count][0].iov_len = (eep_cfg.capt_version == 2)
+                ? capture_eep_encode_v2(msgs[count], iovs[count][0].iov_base)
+                : capture_eep_encode_v3(msgs[count], iovs[count][0].iov_base);
+            iovs[count][1].iov_base = msgs[count]->data;
+            iovs[count][1].iov_len = msgs[count]->len;
+            mmsgs[count].msg_hdr.msg_iov = iovs[count];
+            mmsgs[count].msg_hdr.msg_iovlen = 2;
+        }
+
+        if (!count) {
+            usleep(1000);
+            continue;
+        }
+
+        capture_eep_sendmmsg(mmsgs, count);
+
+        for (i = 0; i < count; i++)
+            ring_push(eep_cfg.send_free, msgs[i]);
+    }
+
+    free(headers);
+    return NULL;
+}
+
+uint64_t
+capture_eep_send_queue()
+{
+    return (eep_cfg.send_queue) ? ring_count(eep_cfg.send_queue) : 0;
+}
+
+uint64_t
+capture_eep_send_drops()
+{
+    return __atomic_load_n(&eep_cfg.send_drops, __ATOMIC_RELAXED)
+           + __atomic_load_n(&eep_cfg.send_errors, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Check if a call must be relayed based on its Call-ID hash
+ */
+static bool
+capture_eep_relay_sample(const unsigned char *payload, uint32_t len)
+{
+    sip_hdr_t callid;
+    const unsigned char *data;
+    uint32_t hash = 2166136261u;
+
+    if (eep_cfg.relay_sample >= 100)
+        return true;
+
+    // Packets without Call-ID are always relayed
+    if (sip_parser_callid((const char *) payload, len, &callid) != 0)
+        return true;
+
+    // FNV-1a hash (all packets of a call get the same result)
+    for (data = payload + callid.off, len = callid.len; len; len--) {
+        hash ^= *data++;
+        hash *= 16777619u;
+    }
+
+    return (int) (hash % 100) < eep_cfg.relay_sample;
+}
+
+bool
+capture_eep_relay_check(unsigned char *buffer, uint32_t len)
+{
+    hep_ctrl_t ctrl;
+    hep_chunk_t chunk;
+    uint32_t pos, total, clen, offset = 0, captid;
+    uint16_t captid16;
+    const unsigned char *payload = NULL;
+    uint32_t payload_len = 0;
+    bool authorized;
+
+    // HEPv2: capture id is in the timestamp header
+    if (len > 0 && buffer[0] == 2 && eep_cfg.capt_srv_version == 2) {
+        pos = sizeof(struct hep_hdr);
+        if (buffer[2] == AF_INET)
+            pos += sizeof(struct hep_iphdr);
+#ifdef USE_IPV6
+        else if (buffer[2] == AF_INET6)
+            pos += sizeof(struct hep_ip6hdr);
+#endif
+        else
+            return false;
+        if (pos + sizeof(struct hep_timehdr) > len)
+            return false;
+        if (eep_cfg.relay_id) {
+            captid16 = eep_cfg.relay_id;
+            memcpy(buffer + pos + offsetof(struct hep_timehdr, captid), &captid16, sizeof(captid16));
+        }
+        pos += sizeof(struct hep_timehdr);
+        return capture_eep_relay_sample(buffer + pos, len - pos);
+    }
+
+    // HEPv3: walk chunks looking for payload, auth key and capture id
+    if (len < sizeof(hep_ctrl_t) || memcmp(buffer, "\x48\x45\x50\x33", 4) != 0
+        || eep_cfg.capt_srv_version != 3)
+        return false;
+
+    memcpy(&ctrl, buffer, sizeof(hep_ctrl_t));
+    total = ntohs(ctrl.length);
+    if (total > len)
+        return false;
+
+    authorized = !eep_cfg.capt_srv_password;
+
+    for (pos = sizeof(hep_ctrl_t); pos + sizeof(hep_chunk_t) <= total; pos += clen) {
+        memcpy(&chunk, buffer + pos, sizeof(hep_chunk_t));
+        clen = ntohs(chunk.length);
+        if (clen < sizeof(hep_chunk_t) || pos + clen > total)
+            return false;
+        if (chunk.vendor_id != 0)
+            continue;
+
+        switch (ntohs(chunk.type_id)) {
+            case 0x000c:
+                /* Capture ID */
+                offset = pos;
+                break;
+            case 0x000e:
+                /* auth key */
+                if (eep_cfg.capt_srv_password
+                    && clen - sizeof(hep_chunk_t) == strlen(eep_cfg.capt_srv_password)
+                    && !memcmp(buffer + pos + sizeof(hep_chunk_t), eep_cfg.capt_srv_password,
+                               clen - sizeof(hep_chunk_t)))
+                    authorized = true;
+                break;
+            case 0x000f:
+                /* Payload */
+                payload = buffer + pos + sizeof(hep_chunk_t);
+                payload_len = clen - sizeof(hep_chunk_t);
+                break;
+        }
+    }
+
+    if (!authorized || !payload)
+        return false;
+
+    // Rewrite capture id keeping its chunk size
+    if (offset && eep_cfg.relay_id) {
+        memcpy(&chunk, buffer + offset, sizeof(hep_chunk_t));
+        if (ntohs(chunk.length) == sizeof(hep_chunk_uint32_t)) {
+            captid = htonl(eep_cfg.relay_id);
+            memcpy(buffer + offset + sizeof(hep_chunk_t), &captid, sizeof(captid));
+        } else if (ntohs(chunk.length) == sizeof(hep_chunk_uint16_t)) {
+            captid16 = htons(eep_cfg.relay_id);
+            memcpy(buffer + offset + sizeof(hep_chunk_t), &captid16, sizeof(captid16));
+        }
+    }
+
+    return capture_eep_relay_sample(payload, payload_len);
+}
+
+uint64_t
+capture_eep_relayed()
+{
+    return __atomic_load_n(&eep_cfg.relay_packets, __ATOMIC_RELAXED);
 }
 
 packet_t *
-capture_eep_receive()
+capture_eep_decode(const unsigned char *buffer, uint32_t len)
 {
     switch (eep_cfg.capt_srv_version) {
         case 2:
-            return capture_eep_receive_v2();
+            return capture_eep_decode_v2(buffer, len);
         case 3:
-            return capture_eep_receive_v3();
+            return capture_eep_decode_v3(buffer, len);
     }
     return NULL;
 }
 
+/**
+ * @brief Create a packet from decoded EEP data
+ */
+static packet_t *
+capture_eep_packet(uint8_t family, uint8_t proto, address_t src, address_t dst,
+                   struct pcap_pkthdr *header, const unsigned char *payload)
+{
+    packet_t *pkt;
+    u_char *data;
+
+    // Create a new packet
+    pkt = packet_create((family == AF_INET) ? 4 : 6, proto, src, dst, 0);
+    data = packet_add_frame(pkt, header, payload)->data;
+    packet_set_type(pkt, PACKET_SIP_UDP);
+    // Payload is the whole frame content
+    packet_set_frame_payload(pkt, data, header->caplen);
+    // Frames do not contain link and network headers
+    pkt->eep = true;
+
+    return pkt;
+}
+
 packet_t *
-capture_eep_receive_v2()
+capture_eep_decode_v2(const unsigned char *buffer, uint32_t len)
 {
     uint8_t family, proto;
-    unsigned char *payload = 0;
     uint32_t pos;
-    char buffer[MAX_CAPTURE_LEN] ;
-    //! Source Address
-    address_t src;
-    //! Destination address
-    address_t dst;
+    //! Source and Destination Address
+    address_t src, dst;
     //! Packet header
     struct pcap_pkthdr header;
-    //! New created packet pointer
-    packet_t *pkt;
-    //! EEP client data
-    struct sockaddr eep_client;
-    socklen_t eep_client_len;
     struct hep_hdr hdr;
     struct hep_timehdr hep_time;
     struct hep_iphdr hep_ipheader;
@@ -518,11 +902,7 @@ capture_eep_receive_v2()
     struct hep_ip6hdr hep_ip6header;
 #endif
 
-    // Initialize buffer
-    memset(buffer, 0, MAX_CAPTURE_LEN);
-
-    /* Receive EEP generic header */
-    if (recvfrom(eep_cfg.server_sock, buffer, MAX_CAPTURE_LEN, 0, &eep_client, &eep_client_len) == -1)
+    if (len < sizeof(struct hep_hdr))
         return NULL;
 
     /* Copy initial bytes to HEPv2 header */
@@ -537,184 +917,170 @@ capture_eep_receive_v2()
     /* Proto ID */
     proto = hdr.hp_p;
 
+    memset(&src, 0, sizeof(src));
+    memset(&dst, 0, sizeof(dst));
     pos = sizeof(struct hep_hdr);
 
     /* IPv4 */
     if (family == AF_INET) {
-        memcpy(&hep_ipheader, (void*) buffer + pos, sizeof(struct hep_iphdr));
-        inet_ntop(AF_INET, &hep_ipheader.hp_src, src.ip, sizeof(src.ip));
-        inet_ntop(AF_INET, &hep_ipheader.hp_dst, dst.ip, sizeof(dst.ip));
+        if (pos + sizeof(struct hep_iphdr) > len)
+            return NULL;
+        memcpy(&hep_ipheader, buffer + pos, sizeof(struct hep_iphdr));
+        address_set_ip(&src, AF_INET, &hep_ipheader.hp_src);
+        address_set_ip(&dst, AF_INET, &hep_ipheader.hp_dst);
         pos += sizeof(struct hep_iphdr);
     }
 #ifdef USE_IPV6
     /* IPv6 */
     else if(family == AF_INET6) {
-        memcpy(&hep_ip6header, (void*) buffer + pos, sizeof(struct hep_ip6hdr));
-        inet_ntop(AF_INET6, &hep_ip6header.hp6_src, src.ip, sizeof(src.ip));
-        inet_ntop(AF_INET6, &hep_ip6header.hp6_dst, dst.ip, sizeof(dst.ip));
+        if (pos + sizeof(struct hep_ip6hdr) > len)
+            return NULL;
+        memcpy(&hep_ip6header, buffer + pos, sizeof(struct hep_ip6hdr));
+        address_set_ip(&src, AF_INET6, &hep_ip6header.hp6_src);
+        address_set_ip(&dst, AF_INET6, &hep_ip6header.hp6_dst);
         pos += sizeof(struct hep_ip6hdr);
     }
 #endif
+    else {
+        return NULL;
+    }
 
     /* PORTS */
     src.port = ntohs(hdr.hp_sport);
     dst.port = ntohs(hdr.hp_dport);
 
     /* TIMESTAMP*/
-    memcpy(&hep_time, (void*) buffer + pos, sizeof(struct hep_timehdr));
+    if (pos + sizeof(struct hep_timehdr) > len)
+        return NULL;
+    memcpy(&hep_time, buffer + pos, sizeof(struct hep_timehdr));
     pos += sizeof(struct hep_timehdr);
     header.ts.tv_sec = hep_time.tv_sec;
     header.ts.tv_usec = hep_time.tv_usec;
 
-    /* Protocol TYPE */
-    /* Capture ID */
-
-    // Calculate payload size (Total size - headers size)
-    header.caplen = header.len = ntohs(hdr.hp_l) - pos;
-
-    // Copy packet payload
-    payload = sng_malloc(header.caplen + 1);
-    memcpy(payload, (void*) buffer + pos, header.caplen);
-
-    // Create a new packet
-    pkt = packet_create((family == AF_INET) ? 4 : 6, proto, src, dst, 0);
-    packet_add_frame(pkt, &header, payload);
-    packet_set_transport_data(pkt, src.port, dst.port);
-    packet_set_type(pkt, PACKET_SIP_UDP);
-    packet_set_payload(pkt, payload, header.caplen);
-
-    /* FREE */
-    sng_free(payload);
-    return pkt;
+    // Payload is the rest of the datagram (hp_l is too small for its size)
+    header.caplen = header.len = len - pos;
 
+    return capture_eep_packet(family, proto, src, dst, &header, buffer + pos);
 }
 
 packet_t *
-capture_eep_receive_v3()
+capture_eep_decode_v3(const unsigned char *buffer, uint32_t len)
 {
-
-    struct hep_generic hg;
-    hep_chunk_ip4_t src_ip4, dst_ip4;
-#ifdef USE_IPV6
-    hep_chunk_ip6_t src_ip6, dst_ip6;
-#endif
-    hep_chunk_t payload_chunk;
-    hep_chunk_t authkey_chunk;
-    hep_chunk_t uuid_chunk;
-    uint8_t family, proto;
-    char password[100];
-    int password_len, uuid_len;
-    unsigned char *payload = 0;
-    uint32_t len, pos;
-    char buffer[MAX_CAPTURE_LEN] ;
+    hep_ctrl_t ctrl;
+    hep_chunk_t chunk;
+    uint16_t type, value16;
+    uint32_t pos, total, clen, value32;
+    uint8_t family = 0, proto = 0;
+    const unsigned char *data, *payload = NULL;
+    bool authorized;
     //! Source and Destination Address
     address_t src, dst;
-    //! EEP client data
-    struct sockaddr eep_client;
-    socklen_t eep_client_len;
     //! Packet header
     struct pcap_pkthdr header;
-    //! New created packet pointer
-    packet_t *pkt;
 
-    /* Receive EEP generic header */
-    if (recvfrom(eep_cfg.server_sock, buffer, MAX_CAPTURE_LEN, 0, &eep_client, &eep_client_len) == -1)
+    if (len < sizeof(hep_ctrl_t))
         return NULL;
 
-    /* Copy initial bytes to EEP Generic header */
-    memcpy(&hg, buffer, sizeof(struct hep_generic));
-
     /* header check */
-    if (memcmp(hg.header.id, "\x48\x45\x50\x33", 4) != 0)
+    memcpy(&ctrl, buffer, sizeof(hep_ctrl_t));
+    if (memcmp(ctrl.id, "\x48\x45\x50\x33", 4) != 0)
         return NULL;
 
-    /* IP proto */
-    family = hg.ip_family.data;
-    /* Proto ID */
-    proto = hg.ip_proto.data;
-
-    len = ntohs(hg.header.length) - sizeof(struct hep_generic);
-    pos = sizeof(struct hep_generic);
-
-    /* IPv4 */
-    if (family == AF_INET) {
-        /* SRC IP */
-        memcpy(&src_ip4, (void*) buffer + pos, sizeof(struct hep_chunk_ip4));
-        inet_ntop(AF_INET, &src_ip4.data, src.ip, sizeof(src.ip));
-        pos += sizeof(struct hep_chunk_ip4);
-
-        /* DST IP */
-        memcpy(&dst_ip4, (void*) buffer + pos, sizeof(struct hep_chunk_ip4));
-        inet_ntop(AF_INET, &dst_ip4.data, dst.ip, sizeof(src.ip));
-        pos += sizeof(struct hep_chunk_ip4);
-    }
-#ifdef USE_IPV6
-    /* IPv6 */
-    else if(family == AF_INET6) {
-        /* SRC IPv6 */
-        memcpy(&src_ip6, (void*) buffer + pos, sizeof(struct hep_chunk_ip6));
-        inet_ntop(AF_INET6, &src_ip6.data, src.ip, sizeof(src.ip));
-        pos += sizeof(struct hep_chunk_ip6);
-
-        /* DST IP */
-        memcpy(&src_ip6, (void*) buffer + pos, sizeof(struct hep_chunk_ip6));
-        inet_ntop(AF_INET6, &dst_ip6.data, dst.ip, sizeof(dst.ip));
-        pos += sizeof(struct hep_chunk_ip6);
-    }
-#endif
-
-    /* SRC PORT */
-    src.port = ntohs(hg.src_port.data);
-    /* DST PORT */
-    dst.port = ntohs(hg.dst_port.data);
-    /* TIMESTAMP*/
-    header.ts.tv_sec = ntohl(hg.time_sec.data);
-    header.ts.tv_usec = ntohl(hg.time_usec.data);
-    /* Protocol TYPE */
-    /* Capture ID */
+    // Ignore any data after HEP packet
+    total = ntohs(ctrl.length);
+    if (total > len)
+        return NULL;
 
-    /* auth key */
-    if (eep_cfg.capt_srv_password != NULL) {
-        memcpy(&authkey_chunk, (void*) buffer + pos, sizeof(authkey_chunk));
-        pos += sizeof(authkey_chunk);
+    memset(&src, 0, sizeof(src));
+    memset(&dst, 0, sizeof(dst));
+    memset(&header, 0, sizeof(header));
 
-        password_len = ntohs(authkey_chunk.length) - sizeof(authkey_chunk);
-        memcpy(password, (void*) buffer + pos, password_len);
-        pos += password_len;
+    // Packets must be authenticated if a password is configured
+    authorized = !eep_cfg.capt_srv_password;
 
-        // Validate the password
-        if (strncmp(password, eep_cfg.capt_srv_password, password_len) != 0)
+    // Walk all chunks directly from received data
+    for (pos = sizeof(hep_ctrl_t); pos + sizeof(hep_chunk_t) <= total; pos += clen) {
+        memcpy(&chunk, buffer + pos, sizeof(hep_chunk_t));
+        clen = ntohs(chunk.length);
+        if (clen < sizeof(hep_chunk_t) || pos + clen > total)
             return NULL;
-    }
 
-    if (setting_enabled(SETTING_EEP_LISTEN_UUID)) {
-        memcpy(&uuid_chunk, (void*) buffer + pos, sizeof(uuid_chunk));
-        pos += sizeof(uuid_chunk);
-
-        uuid_len = ntohs(uuid_chunk.length) - sizeof(uuid_chunk);
-        pos += uuid_len;
+        // Only generic chunks are known
+        if (chunk.vendor_id != 0)
+            continue;
+
+        data = buffer + pos + sizeof(hep_chunk_t);
+        type = ntohs(chunk.type_id);
+        switch (type) {
+            case 0x0001:
+                /* IP proto */
+                family = *data;
+                break;
+            case 0x0002:
+                /* Proto ID */
+                proto = *data;
+                break;
+            case 0x0003:
+            case 0x0004:
+                /* IPv4 SRC and DST */
+                if (clen < sizeof(hep_chunk_ip4_t))
+                    return NULL;
+                address_set_ip((type == 0x0003) ? &src : &dst, AF_INET, data);
+                break;
+#ifdef USE_IPV6
+            case 0x0005:
+            case 0x0006:
+                /* IPv6 SRC and DST */
+                if (clen < sizeof(hep_chunk_ip6_t))
+                    return NULL;
+                address_set_ip((type == 0x0005) ? &src : &dst, AF_INET6, data);
+                break;
+#endif
+            case 0x0007:
+            case 0x0008:
+                /* SRC and DST PORT */
+                if (clen < sizeof(hep_chunk_uint16_t))
+                    return NULL;
+                memcpy(&value16, data, sizeof(value16));
+                if (type == 0x0007)
+                    src.port = ntohs(value16);
+                else
+                    dst.port = ntohs(value16);
+                break;
+            case 0x0009:
+            case 0x000a:
+                /* TIMESTAMP */
+                if (clen < sizeof(hep_chunk_uint32_t))
+                    return NULL;
+                memcpy(&value32, data, sizeof(value32));
+                if (type == 0x0009)
+                    header.ts.tv_sec = ntohl(value32);
+                else
+                    header.ts.tv_usec = ntohl(value32);
+                break;
+            case 0x000e:
+                /* auth key */
+                if (eep_cfg.capt_srv_password
+                    && clen - sizeof(hep_chunk_t) == strlen(eep_cfg.capt_srv_password)
+                    && !memcmp(data, eep_cfg.capt_srv_password, clen - sizeof(hep_chunk_t)))
+                    authorized = true;
+                break;
+            case 0x000f:
+                /* Payload */
+                payload = data;
+                header.caplen = header.len = clen - sizeof(hep_chunk_t);
+                break;
+            default:
+                /* Protocol TYPE, Capture ID, UUID, ... */
+                break;
+        }
     }
 
-    /* Payload */
-    memcpy(&payload_chunk, (void*) buffer + pos, sizeof(payload_chunk));
-    pos += sizeof(payload_chunk);
-
-    // Calculate payload size
-    header.caplen = header.len = ntohs(payload_chunk.length) - sizeof(payload_chunk);
-
-    // Receive packet payload
-    payload = sng_malloc(header.caplen);
-    memcpy(payload, (void*) buffer + pos, header.caplen);
-
-    // Create a new packet
-    pkt = packet_create((family == AF_INET)?4:6, proto, src, dst, 0);
-    packet_add_frame(pkt, &header, payload);
-    packet_set_type(pkt, PACKET_SIP_UDP);
-    packet_set_payload(pkt, payload, header.caplen);
+    // Validate the password and required chunks
+    if (!authorized || !payload || (family != AF_INET && family != AF_INET6))
+        return NULL;
 
-    /* FREE */
-    sng_free(payload);
-    return pkt;
+    return capture_eep_packet(family, proto, src, dst, &header, payload);
 }
 
 int
@@ -740,15 +1106,27 @@ capture_eep_set_server_url(const char *url)
 int
 capture_eep_set_client_url(const char *url)
 {
+    static int urls = 0;
     char urlstr[256];
     char address[256], port[256];
+    char dests[MAX_SETTING_LEN];
+    const char *fanout;
 
     memset(urlstr, 0, sizeof(urlstr));
     memset(address, 0, sizeof(address));
     memset(port, 0, sizeof(port));
 
-    strncpy(urlstr, url, strlen(url));
+    strncpy(urlstr, url, sizeof(urlstr) - 1);
     if (sscanf(urlstr, "%*[^:]:%[^:]:%s", address, port) == 2) {
+        // Next urls are added as extra destinations
+        if (urls++) {
+            if ((fanout = setting_get_value(SETTING_EEP_SEND_FANOUT)))
+                snprintf(dests, sizeof(dests), "%s,%s:%s", fanout, address, port);
+            else
+                snprintf(dests, sizeof(dests), "%s:%s", address, port);
+            setting_set_value(SETTING_EEP_SEND_FANOUT, dests);
+            return 0;
+        }
         setting_set_value(SETTING_EEP_SEND, SETTING_ON);
         setting_set_value(SETTING_EEP_SEND_ADDR, address);
         setting_set_value(SETTING_EEP_SEND_PORT, port);
@@ -42,20 +42,69 @@
 #ifndef __SNGREP_CAPTURE_EEP_H
 #define __SNGREP_CAPTURE_EEP_H
 #include <pthread.h>
+#include <stdbool.h>
 #include "capture.h"
+#include "ring.h"
+
+//! Packets sent with a single sendmmsg call
+#define EEP_SEND_BATCH 64
+//! Max size of HEP headers before packet payload (including auth key)
+#define EEP_HEADER_MAX 1400
+//! Packets received with a single recvmmsg call
+#define EEP_RECV_BATCH 64
+//! Max number of listener threads
+#define EEP_LISTEN_MAX 32
+//! Max number of destinations for sent packets
+#define EEP_SEND_MAX 8
+//! Time listener threads wait for packets before checking if they must stop
+#define EEP_RECV_TIMEOUT_MSECS 100
 
 //! Shorter declaration of capture_eep_config structure
 typedef struct capture_eep_config  capture_eep_config_t;
+//! Shorter declaration of capture_eep_msg structure
+typedef struct capture_eep_msg capture_eep_msg_t;
+
+/**
+ * @brief Packet waiting to be sent through EEP
+ *
+ * Queued packets are preallocated and reused. Payload buffer only grows
+ * when a bigger packet is queued.
+ */
+struct capture_eep_msg
+{
+    //! IP version of the packet
+    uint8_t ip_version;
+    //! Transport protocol
+    uint8_t proto;
+    //! Packet source
+    address_t src;
+    //! Packet destination
+    address_t dst;
+    //! Capture time of first frame
+    struct timeval ts;
+    //! Payload data
+    unsigned char *data;
+    //! Payload length
+    uint32_t len;
+    //! Allocated payload buffer size
+    uint32_t size;
+};
 
 /**
  * @brief EEP  Client/Server configuration
  */
 struct capture_eep_config
 {
-    //! Client socket for sending EEP data
-    int client_sock;
-    //! Server socket for receiving EEP data
-    int server_sock;
+    //! Client sockets for sending EEP data (one per destination)
+    int client_socks[EEP_SEND_MAX];
+    //! Number of destinations
+    int client_count;
+    //! Server sockets for receiving EEP data (one per listener thread)
+    int server_socks[EEP_LISTEN_MAX];
+    //! Number of listener threads
+    int server_count;
+    //! Listener threads must keep receiving packets
+    bool server_running;
     //! Capture agent id
     int capt_id;
     //! Hep Version for sending data (2 or 3)
@@ -74,8 +123,32 @@ struct capture_eep_config
     const char *capt_srv_port;
     //! Server password to authenticate incoming connections
     const char *capt_srv_password;
-    //! Server thread to parse incoming data
-    pthread_t server_thread;
+    //! Server threads to parse incoming data
+    pthread_t server_threads[EEP_LISTEN_MAX];
+    //! Client thread to send queued packets
+    pthread_t client_thread;
+    //! Client thread must keep sending packets
+    bool client_running;
+    //! Preallocated packets of the send queue
+    capture_eep_msg_t *send_msgs;
+    //! Number of preallocated packets
+    int send_size;
+    //! Unused packets of the send queue
+    ring_t *send_free;
+    //! Packets waiting to be sent
+    ring_t *send_queue;
+    //! Packets not sent because send queue was full
+    uint64_t send_drops;
+    //! Packets not sent because of socket errors
+    uint64_t send_errors;
+    //! Forward received packets without parsing them
+    bool relay;
+    //! Capture id for relayed packets (0 to keep received one)
+    int relay_id;
+    //! Percentage of calls relayed
+    int relay_sample;
+    //! Packets relayed from the listener threads
+    uint64_t relay_packets;
 };
 
 /* HEPv3 types */
@@ -209,7 +282,7 @@ struct hep_ip6hdr
  * This funtion will setup all required sockets both for
  * send and receiving information depending on sngrep configuration.
  *
- * It will also launch a thread to received EEP data if configured
+ * It will also launch threads to receive EEP data if configured
  * to do so.
  *
  * @return 1 on any error occurs, 0 otherwise
@@ -243,7 +316,10 @@ const char *
 capture_eep_listen_port();
 
 /**
- * @brief Wrapper for sending packet in configured EEP version
+ * @brief Queue a packet to be sent in configured EEP version
+ *
+ * Packet data is copied into the send queue and sent later by the
+ * client thread. Packet is dropped if the queue is full.
  *
  * @param pkt Packet Structure data
  * @return 1 on any error occurs, 0 otherwise
@@ -252,63 +328,96 @@ int
 capture_eep_send(packet_t *pkt);
 
 /**
- * @brief Send a captured packet (EEP version 2)
+ * @brief Encode HEP headers of a queued packet (EEP version 2)
  *
- * Send a packet encapsulated into EEP through the client socket.
- * This function will only handle SIP packets if EEP client mode
- * has been enabled.
+ * Packet payload is not copied. It must be sent right after the headers.
  *
- * @param pkt Packet Structure data
- * @return 1 on any error occurs, 0 otherwise
+ * @param msg Queued packet data
+ * @param buffer Output buffer of at least EEP_HEADER_MAX bytes
+ * @return Length of the headers
  */
-int
-capture_eep_send_v2(packet_t *pkt);
+uint32_t
+capture_eep_encode_v2(capture_eep_msg_t *msg, unsigned char *buffer);
 
 /**
- * @brief Send a captured packet (EEP version 3)
+ * @brief Encode HEP headers of a queued packet (EEP version 3)
  *
- * Send a packet encapsulated into EEP through the client socket.
- * This function will only handle SIP packets if EEP client mode
- * has been enabled.
+ * Packet payload is not copied. It must be sent right after the headers.
  *
- * @param pkt Packet Structure data
- * @return 1 on any error occurs, 0 otherwise
+ * @param msg Queued packet data
+ * @param buffer Output buffer of at least EEP_HEADER_MAX bytes
+ * @return Length of the headers
  */
-int
-capture_eep_send_v3(packet_t *pkt);
+uint32_t
+capture_eep_encode_v3(capture_eep_msg_t *msg, unsigned char *buffer);
+
+/**
+ * @brief Return the number of packets waiting to be sent
+ */
+uint64_t
+capture_eep_send_queue();
+
+/**
+ * @brief Return the number of packets that couldn't be sent
+ *
+ * Includes packets dropped because the queue was full and socket errors
+ */
+uint64_t
+capture_eep_send_drops();
 
 /**
- * @brief Wrapper for receiving packet in configured EEP version
+ * @brief Check if a received packet must be relayed
+ *
+ * Packets are checked in place: only Call-ID is extracted from the
+ * payload for sampling. Capture id is rewritten if configured.
  *
+ * @param buffer Received datagram
+ * @param len Received datagram length
+ * @return true if packet must be sent to the EEP destinations
+ */
+bool
+capture_eep_relay_check(unsigned char *buffer, uint32_t len);
+
+/**
+ * @brief Return the number of packets relayed without parsing them
+ */
+uint64_t
+capture_eep_relayed();
+
+/**
+ * @brief Decode a received packet in configured EEP version
+ *
+ * @param buffer Received datagram
+ * @param len Received datagram length
  * @return NULL on any error, packet structure otherwise
  */
 packet_t *
-capture_eep_receive();
-
+capture_eep_decode(const unsigned char *buffer, uint32_t len);
 
 /**
- * @brief Received a captured packet (EEP version 2)
+ * @brief Decode a received packet (EEP version 2)
  *
- * Wait for a packet to be received through the EEP server. This
- * function will parse received EEP data and create a new packet
- * structure.
+ * Create a new packet structure from received EEP data.
  *
+ * @param buffer Received datagram
+ * @param len Received datagram length
  * @return NULL on any error, packet structure otherwise
  */
 packet_t *
-capture_eep_receive_v2();
+capture_eep_decode_v2(const unsigned char *buffer, uint32_t len);
 
 /**
- * @brief Received a captured packet (EEP version 3)
+ * @brief Decode a received packet (EEP version 3)
  *
- * Wait for a packet to be received through the EEP server. This
- * function will parse received EEP data and create a new packet
- * structure.
+ * Walk all chunks of received EEP data without copying them and create a
+ * new packet structure. Unknown chunks are ignored.
  *
+ * @param buffer Received datagram
+ * @param len Received datagram length
  * @return NULL on any error, packet structure otherwise
  */
 packet_t *
-capture_eep_receive_v3();
+capture_eep_decode_v3(const unsigned char *buffer, uint32_t len);
 
 /**
  * @brief Set EEP server url
@@ -334,6 +443,8 @@ capture_eep_set_server_url(const char *url);
  *  - udp:10.10.0.100:9060
  *  - udp:0.0.0.0:9960
  *
+ * Each url after the first one is added to the extra destinations.
+ *
  * @param url URL to be parsed
  * @return 0 if url has been parsed, 1 otherwise
  */
@@ -0,0 +1,295 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_merge.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in capture_merge.h
+ */
+#include "config.h"
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "capture_merge.h"
+#include "capture_zstream.h"
+#include "util.h"
+
+/**
+ * @brief Get current monotonic time in milliseconds
+ */
+static uint64_t
+capture_merge_msecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Check if next packet of first input must be decoded before second's
+ */
+static bool
+capture_merge_before(capture_merge_input_t *first, capture_merge_input_t *second)
+{
+    if (first->header->ts.tv_sec != second->header->ts.tv_sec)
+        return first->header->ts.tv_sec < second->header->ts.tv_sec;
+    if (first->header->ts.tv_usec != second->header->ts.tv_usec)
+        return first->header->ts.tv_usec < second->header->ts.tv_usec;
+    return first->index < second->index;
+}
+
+/**
+ * @brief Move down the heap item at given position until heap is sorted
+ */
+static void
+capture_merge_sift_down(capture_merge_t *merge, int pos)
+{
+    capture_merge_input_t *input = merge->heap[pos];
+    int child;
+
+    while ((child = pos * 2 + 1) < merge->heap_count) {
+        // Choose the oldest child
+        if (child + 1 < merge->heap_count && capture_merge_before(merge->heap[child + 1], merge->heap[child]))
+            child++;
+        if (!capture_merge_before(merge->heap[child], input))
+            break;
+        merge->heap[pos] = merge->heap[child];
+        pos = child;
+    }
+    merge->heap[pos] = input;
+}
+
+/**
+ * @brief Move up the heap item at given position until heap is sorted
+ */
+static void
+capture_merge_sift_up(capture_merge_t *merge, int pos)
+{
+    capture_merge_input_t *input = merge->heap[pos];
+    int parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!capture_merge_before(input, merge->heap[parent]))
+            break;
+        merge->heap[pos] = merge->heap[parent];
+        pos = parent;
+    }
+    merge->heap[pos] = input;
+}
+
+/**
+ * @brief Read next packet of an input file
+ *
+ * @return true if a packet has been read, false on file end or error
+ */
+static bool
+capture_merge_next(capture_merge_input_t *input)
+{
+    int ret;
+
+    // Files are no longer read after requested time window
+    if ((ret = pcap_next_ex(input->handle, &input->header, &input->data)) == 1)
+        return capture_time_window_check(input->header->ts) <= 0;
+
+    if (ret == -1)
+        fprintf(stderr, "Error reading pcap file %s: %s\n", input->infile, pcap_geterr(input->handle));
+
+    return false;
+}
+
+int
+capture_merge(vector_t *infiles, const char *outfile)
+{
+    capture_info_t *capinfo;
+    capture_merge_t *merge;
+    capture_merge_input_t *input;
+    struct stat st;
+    FILE *fstdin;
+    bool usestdin = false;
+    int i;
+
+    // Error text (in case of file open error)
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    // Create a new structure to handle this capture source
+    if (!(capinfo = sng_malloc(sizeof(capture_info_t)))
+        || !(merge = sng_malloc(sizeof(capture_merge_t)))
+        || !(merge->inputs = sng_malloc(sizeof(capture_merge_input_t) * vector_count(infiles)))
+        || !(merge->heap = sng_malloc(sizeof(capture_merge_input_t *) * vector_count(infiles)))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+    capinfo->merge = merge;
+
+    for (i = 0; i < vector_count(infiles); i++) {
+        input = &merge->inputs[merge->count++];
+        input->index = i;
+        input->infile = vector_item(infiles, i);
+
+        // Check if file is standard input
+        if (strlen(input->infile) == 1 && *input->infile == '-') {
+            input->infile = "/dev/stdin";
+            usestdin = true;
+        }
+
+        // Open PCAP file
+        if ((input->handle = capture_zstream_pcap_open(input->infile, errbuf)) == NULL) {
+            fprintf(stderr, "Couldn't open pcap file %s: %s\n", input->infile, errbuf);
+            return 1;
+        }
+
+        // Get datalink to parse packets correctly
+        input->link = pcap_datalink(input->handle);
+
+        // Check linktypes sngrep knowns before start parsing packets
+        input->link_hl = datalink_size(input->link);
+        if (!(input->link_decode = capture_link_decoder(input->link))) {
+            fprintf(stderr, "Unable to handle linktype %d\n", input->link);
+            return 3;
+        }
+
+        // Input size for loading progress
+        if (stat(input->infile, &st) == 0 && S_ISREG(st.st_mode)) {
+            merge->size += st.st_size;
+            merge->decoded += CAPTURE_MERGE_HEADER;
+        }
+    }
+
+    // Reopen tty for ncurses after pcap have used stdin
+    if (usestdin) {
+        if (!(fstdin = freopen("/dev/tty", "r", stdin))) {
+            fprintf(stderr, "Failed to reopen tty while using stdin for capture.");
+            return 1;
+        }
+    }
+
+    // Merged source uses first file handler for dump files
+    capinfo->infile = merge->inputs[0].infile;
+    capinfo->handle = merge->inputs[0].handle;
+    capinfo->link = merge->inputs[0].link;
+    capinfo->link_hl = merge->inputs[0].link_hl;
+    capinfo->link_decode = merge->inputs[0].link_decode;
+
+    // Create IP and TCP reassembly storage
+    capinfo->tcp_flows = htable_create_fixed(TCP_FLOWS_SIZE, sizeof(capture_tcp_flow_key_t));
+    capinfo->ip_frags = htable_create_fixed(IP_FRAGS_SIZE, sizeof(capture_ip_frag_key_t));
+
+    // Add this capture information as packet source
+    return capture_add_source(capinfo, outfile);
+}
+
+void
+capture_merge_loop(capture_info_t *capinfo)
+{
+    capture_merge_t *merge = capinfo->merge;
+    capture_merge_input_t *input;
+    int i;
+
+    merge->start = capture_merge_msecs();
+
+    // Sort input files by their first packet
+    for (i = 0; i < merge->count; i++) {
+        if (capture_merge_next(&merge->inputs[i])) {
+            merge->heap[merge->heap_count] = &merge->inputs[i];
+            capture_merge_sift_up(merge, merge->heap_count++);
+        }
+    }
+
+    while (capinfo->running && merge->heap_count) {
+        input = merge->heap[0];
+
+        // Decode oldest pending packet using its file link type
+        capinfo->link = input->link;
+        capinfo->link_hl = input->link_hl;
+        capinfo->link_decode = input->link_decode;
+        parse_packet((u_char *) capinfo, input->header, input->data);
+        __atomic_fetch_add(&merge->decoded, CAPTURE_MERGE_RECORD + input->header->caplen, __ATOMIC_RELAXED);
+
+        // Replace it with the next packet of the same file
+        if (!capture_merge_next(input))
+            merge->heap[0] = merge->heap[--merge->heap_count];
+        if (merge->heap_count)
+            capture_merge_sift_down(merge, 0);
+    }
+
+    // Parse remaining decoded packets
+    capture_batch_flush(capinfo);
+}
+
+int
+capture_merge_set_filter(capture_info_t *capinfo, const char *filter)
+{
+    capture_merge_t *merge = capinfo->merge;
+    capture_merge_input_t *input;
+    int i;
+
+    // Each file may have a different link type
+    for (i = 0; i < merge->count; i++) {
+        input = &merge->inputs[i];
+        if (input->filtered) {
+            pcap_freecode(&input->fp);
+            input->filtered = false;
+        }
+        if (pcap_compile(input->handle, &input->fp, filter, 0, 0) == -1)
+            return 1;
+        input->filtered = true;
+        if (pcap_setfilter(input->handle, &input->fp) == -1)
+            return 1;
+    }
+
+    return 0;
+}
+
+void
+capture_merge_progress(capture_info_t *capinfo, uint64_t *decoded, uint64_t *size, uint64_t *msecs)
+{
+    capture_merge_t *merge = capinfo->merge;
+
+    *decoded = __atomic_load_n(&merge->decoded, __ATOMIC_RELAXED);
+    *size = merge->size;
+    *msecs = (merge->start) ? capture_merge_msecs() - merge->start : 0;
+}
+
+void
+capture_merge_close(capture_info_t *capinfo)
+{
+    capture_merge_t *merge = capinfo->merge;
+    int i;
+
+    if (!merge)
+        return;
+
+    for (i = 0; i < merge->count; i++) {
+        if (merge->inputs[i].filtered)
+            pcap_freecode(&merge->inputs[i].fp);
+        if (merge->inputs[i].handle)
+            pcap_close(merge->inputs[i].handle);
+    }
+
+    sng_free(merge->inputs);
+    sng_free(merge->heap);
+
+    capinfo->handle = NULL;
+    capinfo->merge = NULL;
+    sng_free(merge);
+}
@@ -0,0 +1,147 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_merge.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to read several offline files as a single source
+ *
+ * Input files of a merged source are read by the same capture thread.
+ * Next packet of each file is stored in a heap sorted by timestamp, so
+ * packets are decoded in global time order no matter which file they
+ * come from, without different threads competing for the capture lock.
+ */
+#ifndef __SNGREP_CAPTURE_MERGE_H
+#define __SNGREP_CAPTURE_MERGE_H
+
+#include "config.h"
+#include <stdint.h>
+#include "capture.h"
+#include "vector.h"
+
+//! Size of pcap file global header
+#define CAPTURE_MERGE_HEADER 24
+//! Size of pcap record header
+#define CAPTURE_MERGE_RECORD 16
+
+//! Shorter declaration of merge input structure
+typedef struct capture_merge_input capture_merge_input_t;
+
+/**
+ * @brief Input file of a merged source
+ */
+struct capture_merge_input
+{
+    //! Input file
+    const char *infile;
+    //! libpcap capture handler
+    pcap_t *handle;
+    //! libpcap link type
+    int link;
+    //! libpcap link header size
+    int8_t link_hl;
+    //! Link headers decoder for this file link type
+    capture_link_f link_decode;
+    //! Compiled capture filter for this file link type
+    struct bpf_program fp;
+    //! Capture filter has been compiled
+    bool filtered;
+    //! Header of next packet of this file
+    struct pcap_pkthdr *header;
+    //! Data of next packet of this file
+    const u_char *data;
+    //! Input order (oldest packet first on timestamp ties)
+    int index;
+};
+
+/**
+ * @brief Merged offline source information
+ */
+struct capture_merge
+{
+    //! Input files
+    capture_merge_input_t *inputs;
+    //! Number of input files
+    int count;
+    //! Input files with pending packets sorted by next packet timestamp
+    capture_merge_input_t **heap;
+    //! Number of input files in the heap
+    int heap_count;
+    //! Total size of input files
+    uint64_t size;
+    //! Bytes already decoded
+    uint64_t decoded;
+    //! Decoding start time (ms)
+    uint64_t start;
+};
+
+/**
+ * @brief Offline capture function for several files merged by time
+ *
+ * Create one capture source that reads packets of all given files
+ * sorted by their timestamp.
+ *
+ * @param infiles Vector of PCAP input files
+ * @param outfile Dumpfile for captured packets
+ * @return 0 on success, error code otherwise (same as capture_offline)
+ */
+int
+capture_merge(vector_t *infiles, const char *outfile);
+
+/**
+ * @brief Decode input files packets until all files end or capture is stopped
+ *
+ * @param capinfo Capture source information
+ */
+void
+capture_merge_loop(capture_info_t *capinfo);
+
+/**
+ * @brief Set the BPF filter of all files of a merged source
+ *
+ * @param capinfo Capture source information
+ * @param filter Filter expression
+ * @return 0 if filter has been set, 1 otherwise
+ */
+int
+capture_merge_set_filter(capture_info_t *capinfo, const char *filter);
+
+/**
+ * @brief Get the loading progress of a merged source
+ *
+ * @param capinfo Capture source information
+ * @param decoded Bytes of the input files already decoded
+ * @param size Total size of input files
+ * @param msecs Time elapsed since the files started to be decoded
+ */
+void
+capture_merge_progress(capture_info_t *capinfo, uint64_t *decoded, uint64_t *size, uint64_t *msecs);
+
+/**
+ * @brief Close all input files of a merged source
+ *
+ * @param capinfo Capture source information
+ */
+void
+capture_merge_close(capture_info_t *capinfo);
+
+#endif /* __SNGREP_CAPTURE_MERGE_H */
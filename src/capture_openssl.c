@@ -36,8 +36,20 @@
 #include "option.h"
 #include "util.h"
 #include "sip.h"
+#include "setting.h"
 
-struct SSLConnection *connections;
+/**
+ * Connections are tracked by each thread processing segments. Capture
+ * threads and TLS threads always receive all packets of a connection.
+ */
+//! Connections indexed by client and server address
+static __thread htable_t *connections;
+//! Connections activity list, least recently active first
+static __thread struct SSLConnection *connections_first, *connections_last;
+//! Last time idle connections were discarded
+static __thread time_t connections_expired;
+//! Connections tracked by all threads
+static uint32_t connections_count = 0;
 
 struct CipherSuite TLS_RSA_WITH_AES_128_CBC_SHA =
 { 0x00, 0x2F };
@@ -181,9 +193,22 @@ PRF12(unsigned char *dest, int dlen, unsigned char *pre_master_secret,
     return dlen;
 }
 
+/**
+ * @brief Get the hash table key of a connection
+ */
+static char *
+tls_connection_key(struct in_addr caddr, uint16_t cport, struct in_addr saddr, uint16_t sport,
+                   char *key)
+{
+    sprintf(key, "%08x:%04x-%08x:%04x", caddr.s_addr, cport, saddr.s_addr, sport);
+    return key;
+}
+
 struct SSLConnection *
 tls_connection_create(struct in_addr caddr, uint16_t cport, struct in_addr saddr, uint16_t sport) {
     struct SSLConnection *conn = NULL;
+    int maxconn;
+
     conn = sng_malloc(sizeof(struct SSLConnection));
 
     memcpy(&conn->client_addr, &caddr, sizeof(struct in_addr));
@@ -207,9 +232,25 @@ tls_connection_create(struct in_addr caddr, uint16_t cport, struct in_addr saddr
     conn->client_cipher_ctx = EVP_CIPHER_CTX_new();
     conn->server_cipher_ctx = EVP_CIPHER_CTX_new();
 
-    // Add this connection to the list
-    conn->next = connections;
-    connections = conn;
+    // Make room for this connection discarding least recently active ones
+    if (!connections)
+        connections = htable_create(TLS_CONNECTIONS_SIZE);
+    maxconn = setting_get_intvalue(SETTING_CAPTURE_TLS_MAXCONN);
+    while (connections_first && maxconn > 0 && htable_count(connections) >= (size_t) maxconn)
+        tls_connection_destroy(connections_first);
+
+    // Newest connection in activity list
+    conn->prev = connections_last;
+    if (connections_last)
+        connections_last->next = conn;
+    else
+        connections_first = conn;
+    connections_last = conn;
+
+    // Add this connection to the table
+    tls_connection_key(caddr, cport, saddr, sport, conn->key);
+    htable_insert(connections, conn->key, conn);
+    __atomic_add_fetch(&connections_count, 1, __ATOMIC_RELAXED);
 
     return conn;
 }
@@ -217,19 +258,18 @@ tls_connection_create(struct in_addr caddr, uint16_t cport, struct in_addr saddr
 void
 tls_connection_destroy(struct SSLConnection *conn)
 {
-    struct SSLConnection *c;
-
-    // Remove connection from connections list
-    if (conn == connections) {
-        connections = conn->next;
-    } else {
-        for (c = connections; c; c = c->next) {
-            if (c->next == conn) {
-                c->next = conn->next;
-                break;
-            }
-        }
-    }
+    htable_remove(connections, conn->key);
+    __atomic_sub_fetch(&connections_count, 1, __ATOMIC_RELAXED);
+
+    // Remove from activity list
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        connections_first = conn->next;
+    if (conn->next)
+        conn->next->prev = conn->prev;
+    else
+        connections_last = conn->prev;
 
     // Deallocate connection memory
     EVP_CIPHER_CTX_free(conn->client_cipher_ctx);
@@ -239,6 +279,12 @@ tls_connection_destroy(struct SSLConnection *conn)
     sng_free(conn);
 }
 
+uint32_t
+tls_connection_count()
+{
+    return __atomic_load_n(&connections_count, __ATOMIC_RELAXED);
+}
+
 /**
  * FIXME Replace this with a tls_load_key function and use it
  * in tls_connection_create.
@@ -291,18 +337,68 @@ tls_connection_dir(struct SSLConnection *conn, struct in_addr addr, uint16_t por
 struct SSLConnection*
 tls_connection_find(struct in_addr src, uint16_t sport, struct in_addr dst, uint16_t dport) {
     struct SSLConnection *conn;
+    char key[TLS_CONNECTION_KEYLEN];
 
-    for (conn = connections; conn; conn = conn->next) {
-        if (tls_connection_dir(conn, src, sport) == 0 &&
-                tls_connection_dir(conn, dst, dport) == 1) {
-            return conn;
-        }
-        if (tls_connection_dir(conn, src, sport) == 1 &&
-                tls_connection_dir(conn, dst, dport) == 0) {
-            return conn;
-        }
+    if (!connections)
+        return NULL;
+
+    // Packet from client to server
+    if ((conn = htable_find(connections, tls_connection_key(src, sport, dst, dport, key))))
+        return conn;
+
+    // Packet from server to client
+    return htable_find(connections, tls_connection_key(dst, dport, src, sport, key));
+}
+
+/**
+ * @brief Mark connection as the most recently active
+ */
+static void
+tls_connection_touch(struct SSLConnection *conn, time_t now)
+{
+    conn->last_seen = now;
+
+    if (connections_last == conn)
+        return;
+
+    // Unlink from current position
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        connections_first = conn->next;
+    conn->next->prev = conn->prev;
+
+    // Append at the end
+    conn->prev = connections_last;
+    conn->next = NULL;
+    connections_last->next = conn;
+    connections_last = conn;
+}
+
+/**
+ * @brief Discard idle connections
+ *
+ * Connections that have not completed the handshake or are being closed
+ * are discarded after TLS_HANDSHAKE_TIMEOUT seconds, the rest after
+ * TLS_CONNECTION_TIMEOUT seconds without packets. As activity list is
+ * sorted by last packet time, only its head needs to be checked.
+ */
+static void
+tls_connections_expire(time_t now)
+{
+    struct SSLConnection *conn, *next;
+
+    // Check once per second of capture time
+    if (now == connections_expired)
+        return;
+    connections_expired = now;
+
+    for (conn = connections_first; conn && conn->last_seen + TLS_HANDSHAKE_TIMEOUT < now; conn = next) {
+        next = conn->next;
+        if (!conn->encrypted || conn->state >= TCP_STATE_FIN
+            || conn->last_seen + TLS_CONNECTION_TIMEOUT < now)
+            tls_connection_destroy(conn);
     }
-    return NULL;
 }
 
 int
@@ -318,13 +414,19 @@ tls_process_segment(packet_t *packet, struct tcphdr *tcp)
     uint16_t sport = packet->src.port;
     uint16_t dport = packet->dst.port;
     address_t tlsserver = capture_tls_server();
+    time_t now = packet_time(packet).tv_sec;
 
     // Convert addresses
-    inet_pton(AF_INET, packet->src.ip, &ip_src);
-    inet_pton(AF_INET, packet->dst.ip, &ip_dst);
+    memcpy(&ip_src, packet->src.ip.bytes, sizeof(ip_src));
+    memcpy(&ip_dst, packet->dst.ip.bytes, sizeof(ip_dst));
+
+    // Discard idle connections
+    tls_connections_expire(now);
 
     // Try to find a session for this ip
     if ((conn = tls_connection_find(ip_src, sport, ip_dst, dport))) {
+        tls_connection_touch(conn, now);
+
         // Update last connection direction
         conn->direction = tls_connection_dir(conn, ip_src, sport);
 
@@ -342,6 +444,10 @@ tls_process_segment(packet_t *packet, struct tcphdr *tcp)
                 break;
             case TCP_STATE_ACK:
             case TCP_STATE_ESTABLISHED:
+                // Connection is being closed, discard it with next packet
+                if (tcp->th_flags & (TH_FIN | TH_RST))
+                    conn->state = TCP_STATE_FIN;
+
                 // Check if we have a SSLv2 Handshake
                 if(tls_record_handshake_is_ssl2(conn, payload, size_payload)) {
                     if (tls_process_record_ssl2(conn, payload, size_payload, &out, &outl) != 0)
@@ -372,11 +478,13 @@ tls_process_segment(packet_t *packet, struct tcphdr *tcp)
             if (tlsserver.port) {
                 if (addressport_equals(tlsserver, packet->dst)) {
                     // New connection, store it status and leave
-                    tls_connection_create(ip_src, sport, ip_dst, dport);
+                    if ((conn = tls_connection_create(ip_src, sport, ip_dst, dport)))
+                        conn->last_seen = now;
                 }
             } else {
                 // New connection, store it status and leave
-                tls_connection_create(ip_src, sport, ip_dst, dport);
+                if ((conn = tls_connection_create(ip_src, sport, ip_dst, dport)))
+                    conn->last_seen = now;
             }
         }
     }
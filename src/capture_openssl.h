@@ -55,6 +55,15 @@
 #include "capture.h"
 
 //! Cast two bytes into decimal (Big Endian)
+//! Initial size of TLS connections hash table
+#define TLS_CONNECTIONS_SIZE 64
+//! Seconds without packets before a connection is discarded
+#define TLS_CONNECTION_TIMEOUT 300
+//! Seconds to complete the TCP and TLS handshakes of a connection
+#define TLS_HANDSHAKE_TIMEOUT 30
+//! Length of connection hash table keys
+#define TLS_CONNECTION_KEYLEN 32
+
 #define UINT16_INT(i) ((i.x[0] << 8) | i.x[1])
 //! Cast three bytes into decimal (Big Endian)
 #define UINT24_INT(i) ((i.x[0] << 16) | (i.x[1] << 8) | i.x[2])
@@ -250,7 +259,12 @@ struct SSLConnection {
     EVP_CIPHER_CTX *client_cipher_ctx;
     EVP_CIPHER_CTX *server_cipher_ctx;
 
-    struct SSLConnection *next;
+    //! Hash table key of the connection
+    char key[TLS_CONNECTION_KEYLEN];
+    //! Timestamp of the last packet of this connection
+    time_t last_seen;
+    //! Connections activity list, least recently active first
+    struct SSLConnection *prev, *next;
 };
 
 /**
@@ -314,7 +328,8 @@ PRF(unsigned char *dest, int dlen, unsigned char *pre_master_secret, int plen, u
  *
  * This will allocate enough memory to store all connection data
  * from a detected SSL connection. This will also add this structure to
- * the connections linked list.
+ * the connections table, discarding the least recently active connection
+ * when capture.tls.maxconn connections are already tracked.
  *
  * @param caddr Client address
  * @param cport Client port
@@ -329,13 +344,19 @@ tls_connection_create(struct in_addr caddr, uint16_t cport, struct in_addr saddr
  * @brief Destroys an existing SSLConnection
  *
  * This will free all allocated memory of SSLConnection also removing
- * the connection from connections list.
+ * the connection from connections table.
  *
  * @param conn Existing connection pointer
  */
 void
 tls_connection_destroy(struct SSLConnection *conn);
 
+/**
+ * @brief Get the number of connections tracked by all threads
+ */
+uint32_t
+tls_connection_count();
+
 /**
  * @brief Check if given keyfile is valid
  *
@@ -366,8 +387,10 @@ tls_connection_dir(struct SSLConnection *conn, struct in_addr addr, uint16_t por
  * Try to find connection data for a given address and port.
  * This address:port convination can be the client or server one.
  *
- * @param addr Client or server address
- * @param port Client or server port
+ * @param src Packet source address
+ * @param sport Packet source port
+ * @param dst Packet destination address
+ * @param dport Packet destination port
  * @return an existing Connection pointer or NULL if not found
  */
 struct SSLConnection*
@@ -0,0 +1,192 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_overload.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in capture_overload.h
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include "capture.h"
+#include "capture_overload.h"
+#include "setting.h"
+
+//! Overload governor status
+capture_overload_t overload_cfg = { 0 };
+
+//! Degradation action names (used in settings) and descriptions
+static const struct {
+    const char *name;
+    const char *desc;
+} overload_actions[OVERLOAD_ACTION_COUNT] = {
+    { "none",    NULL },
+    { "rtp",     "Overload: no RTP" },
+    { "sdp",     "Overload: no SDP" },
+    { "dialogs", "Overload: INVITE only" },
+    { "sample",  "Overload: sampling 1/%d" },
+};
+
+void
+capture_overload_init()
+{
+    char levels[256], *name, *saveptr;
+    int i;
+
+    memset(&overload_cfg, 0, sizeof(capture_overload_t));
+    overload_cfg.enabled = setting_enabled(SETTING_CAPTURE_OVERLOAD);
+    overload_cfg.hold = setting_get_intvalue(SETTING_CAPTURE_OVERLOAD_HOLD);
+    if ((overload_cfg.sample = setting_get_intvalue(SETTING_CAPTURE_OVERLOAD_SAMPLE)) < 1)
+        overload_cfg.sample = 1;
+
+    // Degradation actions in level order (names separated by commas)
+    memset(levels, 0, sizeof(levels));
+    strncpy(levels, setting_get_value(SETTING_CAPTURE_OVERLOAD_LEVELS), sizeof(levels) - 1);
+    for (name = strtok_r(levels, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        for (i = OVERLOAD_NONE + 1; i < OVERLOAD_ACTION_COUNT; i++) {
+            if (!strcmp(name, overload_actions[i].name))
+                break;
+        }
+        if (i == OVERLOAD_ACTION_COUNT) {
+            fprintf(stderr, "Ignoring unknown overload level %s\n", name);
+        } else if (overload_cfg.nlevels < OVERLOAD_ACTION_COUNT - 1) {
+            overload_cfg.levels[++overload_cfg.nlevels] = i;
+        }
+    }
+
+    if (!overload_cfg.nlevels)
+        overload_cfg.enabled = false;
+}
+
+/**
+ * @brief Change current degradation level
+ */
+static void
+capture_overload_set_level(int level)
+{
+    uint32_t active = 0;
+    int i;
+
+    for (i = 1; i <= level; i++)
+        active |= 1 << overload_cfg.levels[i];
+
+    __atomic_store_n(&overload_cfg.level, level, __ATOMIC_RELAXED);
+    __atomic_store_n(&overload_cfg.active, active, __ATOMIC_RELAXED);
+    overload_cfg.calm = 0;
+}
+
+void
+capture_overload_check()
+{
+    capture_stats_t stats;
+    time_t last, now;
+    uint64_t drops;
+    bool overloaded, normal;
+    int usage;
+
+    if (!overload_cfg.enabled)
+        return;
+
+    // Only one thread checks the load each second
+    last = __atomic_load_n(&overload_cfg.check_time, __ATOMIC_RELAXED);
+    if ((now = time(NULL)) == last)
+        return;
+    if (!__atomic_compare_exchange_n(&overload_cfg.check_time, &last, now, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+
+    // Offline files are never degraded, they can be read slower
+    if (!capture_is_online())
+        return;
+
+    // Packets waiting to be parsed and packets the kernel could not queue
+    usage = capture_queue_usage();
+    capture_stats(&stats);
+    drops = stats.drops + stats.ifdrops + stats.queue_drops;
+    overloaded = (usage >= OVERLOAD_HIGH || drops > overload_cfg.drops);
+    normal = (usage <= OVERLOAD_LOW && drops == overload_cfg.drops);
+    overload_cfg.drops = drops;
+
+    if (overloaded) {
+        // Enable next level
+        if (overload_cfg.level < overload_cfg.nlevels)
+            capture_overload_set_level(overload_cfg.level + 1);
+        else
+            overload_cfg.calm = 0;
+    } else if (normal && overload_cfg.level) {
+        // Disable last level after some seconds of normal load
+        if (++overload_cfg.calm >= overload_cfg.hold)
+            capture_overload_set_level(overload_cfg.level - 1);
+    } else {
+        overload_cfg.calm = 0;
+    }
+}
+
+bool
+capture_overload_active(enum overload_action action)
+{
+    return __atomic_load_n(&overload_cfg.active, __ATOMIC_RELAXED) & (1 << action);
+}
+
+void
+capture_overload_shed(enum overload_action action)
+{
+    __atomic_fetch_add(&overload_cfg.shed[action], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t
+capture_overload_shed_count(enum overload_action action)
+{
+    return __atomic_load_n(&overload_cfg.shed[action], __ATOMIC_RELAXED);
+}
+
+int
+capture_overload_level()
+{
+    return __atomic_load_n(&overload_cfg.level, __ATOMIC_RELAXED);
+}
+
+int
+capture_overload_sample()
+{
+    return capture_overload_active(OVERLOAD_SAMPLE) ? overload_cfg.sample : 1;
+}
+
+const char *
+capture_overload_desc()
+{
+    static char desc[64];
+    int level;
+
+    if (!(level = capture_overload_level()))
+        return NULL;
+
+    snprintf(desc, sizeof(desc), overload_actions[overload_cfg.levels[level]].desc, overload_cfg.sample);
+    return desc;
+}
+
+const char *
+capture_overload_action_name(enum overload_action action)
+{
+    return overload_actions[action].name;
+}
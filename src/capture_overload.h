@@ -0,0 +1,161 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_overload.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to degrade capture fidelity when parsers fall behind
+ *
+ * Parser queues usage and kernel drops are checked every second. While
+ * any of them shows that packets can not be parsed in time, configured
+ * degradation levels are enabled one by one, dropping data in a controlled
+ * way (RTP, SDP, new dialogs...) before the kernel starts dropping random
+ * SIP messages. Levels are disabled in reverse order once the load is back
+ * to normal for a few seconds.
+ */
+#ifndef __SNGREP_CAPTURE_OVERLOAD_H
+#define __SNGREP_CAPTURE_OVERLOAD_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+//! Parser queue usage (%) that enables next degradation level
+#define OVERLOAD_HIGH 75
+//! Parser queue usage (%) considered normal load
+#define OVERLOAD_LOW 10
+
+//! Shorter declaration of capture_overload structure
+typedef struct capture_overload capture_overload_t;
+
+/**
+ * @brief Degradation actions
+ */
+enum overload_action
+{
+    OVERLOAD_NONE = 0,
+    //! Don't store RTP packets
+    OVERLOAD_RTP,
+    //! Don't parse SDP of SIP messages (no new RTP streams)
+    OVERLOAD_SDP,
+    //! Don't create new dialogs not starting with INVITE
+    OVERLOAD_DIALOGS,
+    //! Only store 1 of each N new dialogs
+    OVERLOAD_SAMPLE,
+    //! Number of actions (including none)
+    OVERLOAD_ACTION_COUNT
+};
+
+/**
+ * @brief Overload governor status
+ */
+struct capture_overload
+{
+    //! Governor is enabled
+    bool enabled;
+    //! Action of each level (first level is 1)
+    enum overload_action levels[OVERLOAD_ACTION_COUNT];
+    //! Number of configured levels
+    int nlevels;
+    //! Current level (0 for normal operation)
+    int level;
+    //! Actions enabled by current level (bitmask)
+    uint32_t active;
+    //! Store 1 of each N dialogs in sample level
+    int sample;
+    //! Seconds of normal load before disabling a level
+    int hold;
+    //! Seconds of normal load since last level change
+    int calm;
+    //! Kernel drops on last check
+    uint64_t drops;
+    //! Last check time
+    time_t check_time;
+    //! Packets or messages discarded by each action
+    uint64_t shed[OVERLOAD_ACTION_COUNT];
+};
+
+/**
+ * @brief Configure degradation levels from settings
+ */
+void
+capture_overload_init();
+
+/**
+ * @brief Check capture load and change degradation level
+ *
+ * Load is checked at most once per second. This can be called from any
+ * thread parsing packets.
+ */
+void
+capture_overload_check();
+
+/**
+ * @brief Check if a degradation action is enabled
+ */
+bool
+capture_overload_active(enum overload_action action);
+
+/**
+ * @brief Account data discarded by a degradation action
+ */
+void
+capture_overload_shed(enum overload_action action);
+
+/**
+ * @brief Get number of packets or messages discarded by an action
+ */
+uint64_t
+capture_overload_shed_count(enum overload_action action);
+
+/**
+ * @brief Get current degradation level
+ *
+ * @return level number or 0 for normal operation
+ */
+int
+capture_overload_level();
+
+/**
+ * @brief Get sampling rate of sample level
+ *
+ * @return N if 1 of each N dialogs must be stored, 1 if sampling is disabled
+ */
+int
+capture_overload_sample();
+
+/**
+ * @brief Get a short description of current degradation level
+ *
+ * @return level description or NULL for normal operation
+ */
+const char *
+capture_overload_desc();
+
+/**
+ * @brief Get the name of a degradation action
+ */
+const char *
+capture_overload_action_name(enum overload_action action);
+
+#endif /* __SNGREP_CAPTURE_OVERLOAD_H */
@@ -0,0 +1,532 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_reader.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in capture_reader.h
+ */
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "capture_reader.h"
+#include "setting.h"
+#include "util.h"
+
+/**
+ * @brief Get current monotonic time in milliseconds
+ */
+static uint64_t
+capture_reader_msecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Read a record header field in host byte order
+ */
+static inline uint32_t
+capture_reader_field(capture_reader_t *reader, const uint8_t *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return reader->swapped ? __builtin_bswap32(value) : value;
+}
+
+/**
+ * @brief Check capture file header is from a classic pcap file
+ *
+ * @return 0 if file can be read by reader threads, 1 otherwise
+ */
+static int
+capture_reader_check_header(capture_reader_t *reader, const uint8_t *header)
+{
+    uint32_t magic;
+
+    memcpy(&magic, header, sizeof(magic));
+    switch (magic) {
+        case 0xa1b2c3d4: reader->swapped = false; reader->nsecs = false; break;
+        case 0xd4c3b2a1: reader->swapped = true;  reader->nsecs = false; break;
+        case 0xa1b23c4d: reader->swapped = false; reader->nsecs = true;  break;
+        case 0x4d3cb2a1: reader->swapped = true;  reader->nsecs = true;  break;
+        default:
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Add an entry to the index being built
+ */
+static void
+capture_reader_index_add(capture_reader_t *reader, struct timeval ts, uint64_t offset)
+{
+    capture_reader_index_entry_t *index;
+
+    // Make room for more entries
+    if (reader->index_count == reader->index_size) {
+        reader->index_size = (reader->index_size) ? reader->index_size * 2 : 1024;
+        if (!(index = realloc(reader->index, sizeof(capture_reader_index_entry_t) * reader->index_size))) {
+            // Stop building the index
+            reader->index_interval = 0;
+            return;
+        }
+        reader->index = index;
+    }
+
+    reader->index[reader->index_count].sec = ts.tv_sec;
+    reader->index[reader->index_count].usec = ts.tv_usec;
+    reader->index[reader->index_count].offset = offset;
+    reader->index_count++;
+}
+
+/**
+ * @brief Load the sidecar index of a capture file
+ *
+ * @param infile Capture file
+ * @param st Capture file status
+ * @param count Number of loaded entries
+ * @return loaded entries or NULL if file has no valid index
+ */
+static capture_reader_index_entry_t *
+capture_reader_index_load(const char *infile, struct stat *st, uint32_t *count)
+{
+    capture_reader_index_entry_t *index = NULL;
+    capture_reader_index_t header;
+    char path[PATH_MAX];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s%s", infile, READER_INDEX_SUFFIX);
+    if (!(fp = fopen(path, "r")))
+        return NULL;
+
+    // Check index belongs to current capture file contents
+    if (fread(&header, sizeof(header), 1, fp) == 1
+        && !memcmp(header.magic, READER_INDEX_MAGIC, sizeof(header.magic))
+        && header.size == (uint64_t) st->st_size && header.mtime == (int64_t) st->st_mtime
+        && header.count && (index = malloc(sizeof(capture_reader_index_entry_t) * header.count))) {
+        if (fread(index, sizeof(capture_reader_index_entry_t), header.count, fp) != header.count) {
+            free(index);
+            index = NULL;
+        }
+    }
+    fclose(fp);
+
+    *count = (index) ? header.count : 0;
+    return index;
+}
+
+/**
+ * @brief Write the sidecar index of a capture file
+ *
+ * @return 0 if index has been written, 1 otherwise
+ */
+static int
+capture_reader_index_write(const char *infile, capture_reader_t *reader)
+{
+    capture_reader_index_t header;
+    char path[PATH_MAX];
+    FILE *fp;
+    int ret;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, READER_INDEX_MAGIC, sizeof(header.magic));
+    header.size = reader->size;
+    header.mtime = reader->mtime;
+    header.interval = reader->index_interval;
+    header.count = reader->index_count;
+
+    snprintf(path, sizeof(path), "%s%s", infile, READER_INDEX_SUFFIX);
+    if (!(fp = fopen(path, "w")))
+        return 1;
+
+    ret = fwrite(&header, sizeof(header), 1, fp) != 1
+          || fwrite(reader->index, sizeof(capture_reader_index_entry_t), reader->index_count, fp) != reader->index_count;
+
+    // Remove partially written indexes
+    if (fclose(fp) != 0 || ret) {
+        unlink(path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Read capture file data, decompressing it if required
+ */
+static ssize_t
+capture_reader_input(capture_reader_t *reader, uint8_t *data, size_t len)
+{
+    if (reader->zstream)
+        return capture_zstream_read(reader->zstream, data, len);
+    return read(reader->fd, data, len);
+}
+
+/**
+ * @brief Fill free blocks with complete records from capture file
+ *
+ * Records not fully read at the end of a block are moved to the
+ * beginning of the next one.
+ */
+static void
+capture_reader_thread(void *info)
+{
+    capture_reader_t *reader = (capture_reader_t *) info;
+    capture_reader_block_t *block;
+    uint32_t caplen;
+    size_t len, end;
+    ssize_t bytes;
+
+    while (reader->running) {
+        // Wait until capture thread gives back a decoded block
+        if (!(block = ring_pop(reader->free))) {
+            usleep(1000);
+            continue;
+        }
+
+        // Start with the partial record of previous block
+        memcpy(block->data, reader->carry, reader->carry_len);
+        len = reader->carry_len;
+        block->offset = reader->position - reader->carry_len;
+
+        // Fill the block with file data
+        while (len < reader->block_size) {
+            if ((bytes = capture_reader_input(reader, block->data + len, reader->block_size - len)) < 0 && errno == EINTR)
+                continue;
+            if (bytes <= 0)
+                break;
+            len += bytes;
+            reader->position += bytes;
+        }
+        block->last = (len < reader->block_size);
+
+        // Find the end of last complete record
+        for (end = 0; end + READER_RECORD_HEADER <= len; end += READER_RECORD_HEADER + caplen) {
+            caplen = capture_reader_field(reader, block->data + end + 8);
+            // Invalid record, stop reading the file
+            if (caplen > reader->block_size - READER_RECORD_HEADER) {
+                block->last = true;
+                break;
+            }
+            if (end + READER_RECORD_HEADER + caplen > len)
+                break;
+        }
+
+        // Keep partial record for the next block
+        reader->carry_len = (block->last) ? 0 : len - end;
+        memcpy(reader->carry, block->data + end, reader->carry_len);
+        block->len = end;
+
+        // Full ring has room for all blocks
+        ring_push(reader->full, block);
+        if (block->last)
+            break;
+    }
+}
+
+int
+capture_reader_open(capture_info_t *capinfo)
+{
+    capture_reader_t *reader;
+    capture_reader_index_entry_t *index;
+    uint8_t header[READER_FILE_HEADER];
+    struct timeval from, to, ts;
+    struct stat st;
+    uint32_t count;
+    int fd, zfd, i;
+
+    if (!setting_enabled(SETTING_CAPTURE_READER))
+        return 1;
+
+    // Only regular files can be opened again after libpcap
+    if ((fd = open(capinfo->infile, O_RDONLY)) < 0)
+        return 1;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 1;
+    }
+
+    if (!(reader = sng_malloc(sizeof(capture_reader_t)))) {
+        close(fd);
+        return 1;
+    }
+    reader->fd = fd;
+    reader->size = st.st_size;
+    reader->mtime = st.st_mtime;
+    reader->position = READER_FILE_HEADER;
+    capinfo->reader = reader;
+
+    // Compressed files are decompressed by the reader thread
+    if (capture_zstream_format(fd) != ZSTREAM_NONE) {
+        if ((zfd = dup(fd)) < 0 || !(reader->zstream = capture_zstream_open(zfd))) {
+            if (zfd >= 0)
+                close(zfd);
+            capture_reader_close(capinfo);
+            return 1;
+        }
+    }
+
+    // Check file is a classic pcap file
+    if (capture_reader_input(reader, header, sizeof(header)) != sizeof(header)
+        || capture_reader_check_header(reader, header) != 0) {
+        capture_reader_close(capinfo);
+        return 1;
+    }
+
+    // Start reading from the last indexed record before the time window
+    // Compressed files can't be read from an offset, so they are not indexed
+    capture_get_time_window(&from, &to);
+    if (!reader->zstream && (index = capture_reader_index_load(capinfo->infile, &st, &count))) {
+        for (i = 0; from.tv_sec && i < (int) count; i++) {
+            ts.tv_sec = index[i].sec;
+            ts.tv_usec = index[i].usec;
+            if (timercmp(&ts, &from, >))
+                break;
+            reader->position = index[i].offset;
+        }
+        free(index);
+    } else if (!reader->zstream && setting_enabled(SETTING_CAPTURE_INDEX)) {
+        // Build the missing index while decoding the file
+        reader->index_interval = setting_get_intvalue(SETTING_CAPTURE_INDEX_INTERVAL);
+    }
+    if (!reader->zstream) {
+        reader->decoded = reader->position;
+        lseek(fd, reader->position, SEEK_SET);
+
+        // Read ahead the whole file
+        posix_fadvise(fd, reader->position, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    // Blocks must be able to store the biggest record
+    reader->block_size = setting_get_intvalue(SETTING_CAPTURE_READER_BLOCKSIZE);
+    if (reader->block_size < MAXIMUM_SNAPLEN + READER_RECORD_HEADER)
+        reader->block_size = MAXIMUM_SNAPLEN + READER_RECORD_HEADER;
+    reader->block_count = setting_get_intvalue(SETTING_CAPTURE_READER_BLOCKS);
+    if (reader->block_count < 2)
+        reader->block_count = 2;
+
+    // Allocate blocks, all of them are initially free
+    reader->free = ring_create(reader->block_count);
+    reader->full = ring_create(reader->block_count);
+    reader->carry = malloc(reader->block_size);
+    reader->blocks = sng_malloc(sizeof(capture_reader_block_t) * reader->block_count);
+    if (!reader->free || !reader->full || !reader->carry || !reader->blocks) {
+        capture_reader_close(capinfo);
+        return 1;
+    }
+    for (i = 0; i < reader->block_count; i++) {
+        if (!(reader->blocks[i].data = malloc(reader->block_size))) {
+            capture_reader_close(capinfo);
+            return 1;
+        }
+        ring_push(reader->free, &reader->blocks[i]);
+    }
+
+    return 0;
+}
+
+void
+capture_reader_loop(capture_info_t *capinfo)
+{
+    capture_reader_t *reader = capinfo->reader;
+    capture_reader_block_t *block;
+    struct pcap_pkthdr header;
+    const uint8_t *record;
+    size_t offset;
+    bool last = false, stopped = false;
+    int window;
+
+    // Start reading file blocks
+    reader->start = capture_reader_msecs();
+    reader->running = true;
+    if (pthread_create(&reader->thread, NULL, (void *) capture_reader_thread, reader)) {
+        reader->running = false;
+        return;
+    }
+
+    while (capinfo->running && !last) {
+        // Wait until reader thread fills a block
+        if (!(block = ring_pop(reader->full))) {
+            usleep(1000);
+            continue;
+        }
+
+        // Parse all records in the block
+        for (offset = 0; offset < block->len; offset += READER_RECORD_HEADER + header.caplen) {
+            record = block->data + offset;
+            header.ts.tv_sec = capture_reader_field(reader, record);
+            header.ts.tv_usec = capture_reader_field(reader, record + 4);
+            if (reader->nsecs)
+                header.ts.tv_usec /= 1000;
+            header.caplen = capture_reader_field(reader, record + 8);
+            header.len = capture_reader_field(reader, record + 12);
+
+            // Store file offset of every N-th record
+            if (reader->index_interval && reader->records++ % reader->index_interval == 0)
+                capture_reader_index_add(reader, header.ts, block->offset + offset);
+
+            // Ignore packets outside requested time window
+            if ((window = capture_time_window_check(header.ts)) > 0) {
+                stopped = true;
+                break;
+            } else if (window < 0) {
+                continue;
+            }
+
+            // Ignore packets not matching capture filter
+            if (reader->filter
+                && !pcap_offline_filter(reader->filter, &header, record + READER_RECORD_HEADER))
+                continue;
+
+            parse_packet((u_char *) capinfo, &header, record + READER_RECORD_HEADER);
+        }
+
+        // Parse decoded packets of this block
+        capture_batch_flush(capinfo);
+        __atomic_fetch_add(&reader->decoded, block->len, __ATOMIC_RELAXED);
+
+        // Give the block back to the reader
+        last = block->last || stopped;
+        ring_push(reader->free, block);
+    }
+
+    // Stop reader thread
+    reader->running = false;
+    pthread_join(reader->thread, NULL);
+
+    // Store the index once the whole file has been decoded
+    if (last && !stopped && reader->index_interval)
+        capture_reader_index_write(capinfo->infile, reader);
+}
+
+int
+capture_reader_set_filter(capture_info_t *capinfo, struct bpf_program *fp)
+{
+    capinfo->reader->filter = fp;
+    return 0;
+}
+
+void
+capture_reader_progress(capture_info_t *capinfo, uint64_t *decoded, uint64_t *size, uint64_t *msecs)
+{
+    capture_reader_t *reader = capinfo->reader;
+
+    // Compressed files progress is measured in file bytes
+    if (reader->zstream) {
+        *decoded = capture_zstream_consumed(reader->zstream);
+    } else {
+        *decoded = __atomic_load_n(&reader->decoded, __ATOMIC_RELAXED);
+    }
+    *size = reader->size;
+    *msecs = (reader->start) ? capture_reader_msecs() - reader->start : 0;
+}
+
+int
+capture_reader_index_file(const char *infile)
+{
+    capture_reader_t reader;
+    uint8_t header[READER_FILE_HEADER];
+    struct timeval ts;
+    struct stat st;
+    uint32_t caplen;
+    FILE *fp;
+    int ret = 1;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.index_interval = setting_get_intvalue(SETTING_CAPTURE_INDEX_INTERVAL);
+    if (reader.index_interval < 1)
+        reader.index_interval = 1;
+
+    if (!(fp = fopen(infile, "r"))) {
+        fprintf(stderr, "Couldn't open pcap file %s: %s\n", infile, strerror(errno));
+        return 1;
+    }
+
+    if (fstat(fileno(fp), &st) != 0 || fread(header, sizeof(header), 1, fp) != 1
+        || capture_reader_check_header(&reader, header) != 0) {
+        fprintf(stderr, "Couldn't index %s: Not a pcap file\n", infile);
+        fclose(fp);
+        return 1;
+    }
+    reader.size = st.st_size;
+    reader.mtime = st.st_mtime;
+    reader.position = READER_FILE_HEADER;
+
+    // Only read record headers, skipping packet data
+    while (fread(header, READER_RECORD_HEADER, 1, fp) == 1) {
+        if (reader.records++ % reader.index_interval == 0) {
+            ts.tv_sec = capture_reader_field(&reader, header);
+            ts.tv_usec = capture_reader_field(&reader, header + 4);
+            if (reader.nsecs)
+                ts.tv_usec /= 1000;
+            capture_reader_index_add(&reader, ts, reader.position);
+        }
+        caplen = capture_reader_field(&reader, header + 8);
+        reader.position += READER_RECORD_HEADER + caplen;
+        if (fseeko(fp, caplen, SEEK_CUR) != 0)
+            break;
+    }
+    fclose(fp);
+
+    if (reader.index_interval && (ret = capture_reader_index_write(infile, &reader)) != 0)
+        fprintf(stderr, "Couldn't write index of %s\n", infile);
+
+    free(reader.index);
+    return ret;
+}
+
+void
+capture_reader_close(capture_info_t *capinfo)
+{
+    capture_reader_t *reader = capinfo->reader;
+    int i;
+
+    if (!reader)
+        return;
+
+    if (reader->blocks) {
+        for (i = 0; i < reader->block_count; i++)
+            free(reader->blocks[i].data);
+    }
+    if (reader->free)
+        ring_destroy(reader->free);
+    if (reader->full)
+        ring_destroy(reader->full);
+    sng_free(reader->blocks);
+    free(reader->carry);
+    free(reader->index);
+    capture_zstream_close(reader->zstream);
+    close(reader->fd);
+
+    capinfo->reader = NULL;
+    sng_free(reader);
+}
@@ -0,0 +1,235 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_reader.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to read offline capture files in a separate thread
+ *
+ * Offline files are read by a reader thread in big sequential blocks
+ * containing several complete pcap records. The capture thread decodes
+ * and reassembles the records of each block while the next ones are
+ * being read, and parser threads (if configured) parse decoded packets.
+ *
+ * Only classic pcap files are supported, optionally compressed with gzip
+ * or zstd (decompressed by the reader thread). Other formats (pcapng)
+ * and non-seekable inputs (stdin) are read using libpcap.
+ *
+ * A sidecar index file (capture file name + .idx) can store the file
+ * offset of every N-th record, so reading a time window of the file can
+ * start near its first packet instead of the beginning of the file.
+ */
+#ifndef __SNGREP_CAPTURE_READER_H
+#define __SNGREP_CAPTURE_READER_H
+
+#include "config.h"
+#include <stdint.h>
+#include <pthread.h>
+#include "capture.h"
+#include "capture_zstream.h"
+#include "ring.h"
+
+//! Size of pcap file global header
+#define READER_FILE_HEADER 24
+//! Size of pcap record header
+#define READER_RECORD_HEADER 16
+//! Sidecar index file name suffix
+#define READER_INDEX_SUFFIX ".idx"
+//! Sidecar index file format identifier
+#define READER_INDEX_MAGIC "SNGIDX1"
+
+//! Shorter declaration of reader block structure
+typedef struct capture_reader_block capture_reader_block_t;
+//! Shorter declaration of reader index structures
+typedef struct capture_reader_index capture_reader_index_t;
+typedef struct capture_reader_index_entry capture_reader_index_entry_t;
+
+/**
+ * @brief Sidecar index file header
+ *
+ * Index is only valid for the capture file with the same size and
+ * modification time. Header is followed by count entries.
+ */
+struct capture_reader_index
+{
+    //! Index format identifier
+    char magic[8];
+    //! Indexed capture file size
+    uint64_t size;
+    //! Indexed capture file modification time
+    int64_t mtime;
+    //! Records between index entries
+    uint32_t interval;
+    //! Number of index entries
+    uint32_t count;
+};
+
+/**
+ * @brief Sidecar index file entry
+ */
+struct capture_reader_index_entry
+{
+    //! Record timestamp seconds
+    int64_t sec;
+    //! Record timestamp microseconds
+    int64_t usec;
+    //! Record offset in capture file
+    uint64_t offset;
+};
+
+/**
+ * @brief Block of complete pcap records read from file
+ */
+struct capture_reader_block
+{
+    //! Block data
+    uint8_t *data;
+    //! Bytes of complete records in this block
+    size_t len;
+    //! File offset of block data
+    uint64_t offset;
+    //! No more blocks after this one
+    bool last;
+};
+
+/**
+ * @brief Offline file reader information
+ *
+ * Store file descriptor and read blocks of an offline capture source
+ */
+struct capture_reader
+{
+    //! Capture file descriptor
+    int fd;
+    //! Decompression stream of compressed files (NULL for plain files)
+    capture_zstream_t *zstream;
+    //! Record headers have different byte order
+    bool swapped;
+    //! Record timestamps have nanosecond precision
+    bool nsecs;
+    //! Size of allocated blocks
+    size_t block_size;
+    //! Number of allocated blocks
+    int block_count;
+    //! Allocated blocks
+    capture_reader_block_t *blocks;
+    //! Blocks ready to be filled by the reader thread
+    ring_t *free;
+    //! Blocks ready to be decoded by the capture thread
+    ring_t *full;
+    //! Partial record at the end of last read block
+    uint8_t *carry;
+    //! Bytes in partial record buffer
+    size_t carry_len;
+    //! Compiled filter program (NULL if none)
+    struct bpf_program *filter;
+    //! File offset of next read
+    uint64_t position;
+    //! Capture file modification time
+    int64_t mtime;
+    //! Index entries built while decoding the whole file
+    capture_reader_index_entry_t *index;
+    //! Number of built index entries
+    uint32_t index_count;
+    //! Allocated index entries
+    uint32_t index_size;
+    //! Records between built index entries (0 if index is not being built)
+    uint32_t index_interval;
+    //! Number of decoded records
+    uint64_t records;
+    //! Reader thread
+    pthread_t thread;
+    //! Reader thread must keep reading
+    bool running;
+    //! Capture file size
+    uint64_t size;
+    //! Bytes already decoded
+    uint64_t decoded;
+    //! Decoding start time (ms)
+    uint64_t start;
+};
+
+/**
+ * @brief Prepare an offline source to be read by a reader thread
+ *
+ * Check the given file can be read without libpcap and allocate the
+ * blocks used to send file data to the capture thread.
+ *
+ * @param capinfo Offline capture source information
+ * @return 0 if reader will be used, 1 if source must be read with libpcap
+ */
+int
+capture_reader_open(capture_info_t *capinfo);
+
+/**
+ * @brief Decode file records until file end or capture is stopped
+ *
+ * Start the reader thread and send all records of each read block
+ * to parse_packet before giving the block back.
+ *
+ * @param capinfo Capture source information
+ */
+void
+capture_reader_loop(capture_info_t *capinfo);
+
+/**
+ * @brief Set the BPF filter of a reader capture source
+ *
+ * @param capinfo Capture source information
+ * @param fp Compiled filter program
+ * @return 0 if filter has been set, 1 otherwise
+ */
+int
+capture_reader_set_filter(capture_info_t *capinfo, struct bpf_program *fp);
+
+/**
+ * @brief Get the loading progress of a reader capture source
+ *
+ * @param capinfo Capture source information
+ * @param decoded Bytes of the file already decoded
+ * @param size Capture file size
+ * @param msecs Time elapsed since the file started to be decoded
+ */
+void
+capture_reader_progress(capture_info_t *capinfo, uint64_t *decoded, uint64_t *size, uint64_t *msecs);
+
+/**
+ * @brief Create the sidecar index of a capture file
+ *
+ * Only record headers are read, so indexing is much faster than
+ * decoding the file.
+ *
+ * @param infile Classic pcap capture file
+ * @return 0 if index has been written, 1 otherwise
+ */
+int
+capture_reader_index_file(const char *infile);
+
+/**
+ * @brief Free reader blocks and close the capture file
+ *
+ * @param capinfo Capture source information
+ */
+void
+capture_reader_close(capture_info_t *capinfo);
+
+#endif /* __SNGREP_CAPTURE_READER_H */
@@ -0,0 +1,281 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_tpacket.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in capture_tpacket.h
+ */
+#include "config.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include "capture_tpacket.h"
+#include "setting.h"
+#include "util.h"
+
+/**
+ * @brief Create a TPACKET_V3 capture source
+ *
+ * @param dev Device to capture packets from
+ * @param outfile Dumpfile for captured packets
+ * @param fanout Join the process fanout group for this device
+ * @return 0 on success, error code otherwise (same as capture_online)
+ */
+static int
+capture_tpacket_open(const char *dev, const char *outfile, bool fanout)
+{
+    capture_info_t *capinfo;
+    capture_tpacket_t *tp;
+    struct tpacket_req3 req;
+    struct sockaddr_ll ll;
+    struct packet_mreq mreq;
+    struct ifreq ifr;
+    int version = TPACKET_V3;
+    int group;
+
+    // Only ethernet devices are supported
+    if (!strcmp(dev, "any") || strlen(dev) >= IFNAMSIZ) {
+        fprintf(stderr, "Couldn't open device %s: TPACKET capture requires an ethernet device\n", dev);
+        return 2;
+    }
+
+    // Create a new structure to handle this capture source
+    if (!(capinfo = sng_malloc(sizeof(capture_info_t)))
+        || !(tp = sng_malloc(sizeof(capture_tpacket_t)))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+    capinfo->tpacket = tp;
+
+    // Get configured ring geometry
+    tp->block_size = setting_get_intvalue(SETTING_CAPTURE_TPACKET_BLOCKSIZE);
+    tp->block_count = setting_get_intvalue(SETTING_CAPTURE_TPACKET_BLOCKS);
+    if (tp->block_size < TPACKET_FRAME_SIZE || tp->block_size % getpagesize() || !tp->block_count) {
+        fprintf(stderr, "Invalid TPACKET ring size: blocks must be a multiple of %d bytes\n",
+                getpagesize());
+        return 2;
+    }
+
+    // Open capture device
+    if ((tp->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0) {
+        fprintf(stderr, "Couldn't open device %s: %s\n", dev, strerror(errno));
+        return 2;
+    }
+
+    // Get device index and hardware type
+    memset(&ifr, 0, sizeof(ifr));
+    strcpy(ifr.ifr_name, dev);
+    if (ioctl(tp->fd, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "Couldn't open device %s: %s\n", dev, strerror(errno));
+        return 2;
+    }
+    memset(&ll, 0, sizeof(ll));
+    ll.sll_family = AF_PACKET;
+    ll.sll_protocol = htons(ETH_P_ALL);
+    ll.sll_ifindex = ifr.ifr_ifindex;
+
+    // Check linktypes sngrep knowns before start parsing packets
+    if (ioctl(tp->fd, SIOCGIFHWADDR, &ifr) < 0
+        || (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER && ifr.ifr_hwaddr.sa_family != ARPHRD_LOOPBACK)) {
+        fprintf(stderr, "Unable to handle linktype of device %s\n", dev);
+        return 3;
+    }
+    capture_set_link(capinfo, DLT_EN10MB);
+
+    // Request a TPACKET_V3 ring
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = tp->block_size;
+    req.tp_block_nr = tp->block_count;
+    req.tp_frame_size = TPACKET_FRAME_SIZE;
+    req.tp_frame_nr = (tp->block_size / TPACKET_FRAME_SIZE) * tp->block_count;
+    req.tp_retire_blk_tov = TPACKET_BLOCK_TIMEOUT;
+    if (setsockopt(tp->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0
+        || setsockopt(tp->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        fprintf(stderr, "Couldn't create TPACKET ring for device %s: %s\n", dev, strerror(errno));
+        return 2;
+    }
+
+    // Map the ring into our memory
+    tp->map = mmap(NULL, (size_t) tp->block_size * tp->block_count, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, tp->fd, 0);
+    if (tp->map == MAP_FAILED) {
+        tp->map = NULL;
+        fprintf(stderr, "Couldn't map TPACKET ring for device %s: %s\n", dev, strerror(errno));
+        return 2;
+    }
+
+    // Only capture packets from requested device
+    if (bind(tp->fd, (struct sockaddr *) &ll, sizeof(ll)) < 0) {
+        fprintf(stderr, "Couldn't open device %s: %s\n", dev, strerror(errno));
+        return 2;
+    }
+
+    // Capture packets not addressed to this host
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = ll.sll_ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    setsockopt(tp->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+
+    // Share device traffic between sources. Flow hash keeps reassembly on one source
+    if (fanout) {
+        group = (getpid() & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (setsockopt(tp->fd, SOL_PACKET, PACKET_FANOUT, &group, sizeof(group)) < 0) {
+            fprintf(stderr, "Couldn't join fanout group for device %s: %s\n", dev, strerror(errno));
+            return 2;
+        }
+    }
+
+    // Dummy pcap handler for filter compiling and dump files
+    if (!(capinfo->handle = pcap_open_dead(capinfo->link, MAXIMUM_SNAPLEN))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+
+    // Store capture device
+    capinfo->device = dev;
+
+    // Create IP and TCP reassembly storage
+    capinfo->tcp_flows = htable_create_fixed(TCP_FLOWS_SIZE, sizeof(capture_tcp_flow_key_t));
+    capinfo->ip_frags = htable_create_fixed(IP_FRAGS_SIZE, sizeof(capture_ip_frag_key_t));
+
+    // Add this capture information as packet source
+    return capture_add_source(capinfo, outfile);
+}
+
+int
+capture_tpacket(const char *dev, const char *outfile)
+{
+    int fanout = setting_get_intvalue(SETTING_CAPTURE_TPACKET_FANOUT);
+    int i, ret;
+
+    // Create a capture source for each fanout thread
+    for (i = 0; i < fanout || i == 0; i++) {
+        if ((ret = capture_tpacket_open(dev, outfile, fanout > 1)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+void
+capture_tpacket_loop(capture_info_t *capinfo)
+{
+    capture_tpacket_t *tp = capinfo->tpacket;
+    struct tpacket_block_desc *block;
+    struct tpacket3_hdr *frame;
+    struct pcap_pkthdr header;
+    struct pollfd pfd;
+    uint32_t i;
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = tp->fd;
+    pfd.events = POLLIN | POLLERR;
+
+    while (capinfo->running) {
+        // Follow new RTP streams
+        capture_rtp_filter_update(capinfo);
+
+        block = (struct tpacket_block_desc *) (tp->map + (size_t) tp->current * tp->block_size);
+
+        // Wait until kernel hands us this block
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            poll(&pfd, 1, 100);
+            continue;
+        }
+
+        // Parse all frames in the block directly from the ring
+        frame = (struct tpacket3_hdr *) ((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt);
+        for (i = 0; i < block->hdr.bh1.num_pkts; i++) {
+            header.ts.tv_sec = frame->tp_sec;
+            header.ts.tv_usec = frame->tp_nsec / 1000;
+            header.caplen = frame->tp_snaplen;
+            header.len = frame->tp_len;
+            parse_packet((u_char *) capinfo, &header, (u_char *) frame + frame->tp_mac);
+            frame = (struct tpacket3_hdr *) ((uint8_t *) frame + frame->tp_next_offset);
+        }
+
+        // Parse decoded packets of this block
+        capture_batch_flush(capinfo);
+
+        // Give the block back to the kernel
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        tp->current = (tp->current + 1) % tp->block_count;
+    }
+}
+
+int
+capture_tpacket_set_filter(capture_info_t *capinfo, struct bpf_program *fp)
+{
+    struct sock_fprog prog;
+
+    // libpcap and kernel use the same BPF instruction layout
+    prog.len = fp->bf_len;
+    prog.filter = (struct sock_filter *) fp->bf_insns;
+
+    if (setsockopt(capinfo->tpacket->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+        return 1;
+
+    return 0;
+}
+
+uint64_t
+capture_tpacket_drops(capture_info_t *capinfo)
+{
+    capture_tpacket_t *tp = capinfo->tpacket;
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    // Kernel resets its counters each time they are read (by UI and reports)
+    if (getsockopt(tp->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+        return __atomic_add_fetch(&tp->drops, st.tp_drops, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&tp->drops, __ATOMIC_RELAXED);
+}
+
+void
+capture_tpacket_close(capture_info_t *capinfo)
+{
+    capture_tpacket_t *tp = capinfo->tpacket;
+
+    if (!tp)
+        return;
+
+    if (tp->map)
+        munmap(tp->map, (size_t) tp->block_size * tp->block_count);
+    if (tp->fd >= 0)
+        close(tp->fd);
+    if (capinfo->handle)
+        pcap_close(capinfo->handle);
+
+    capinfo->handle = NULL;
+    capinfo->tpacket = NULL;
+    sng_free(tp);
+}
@@ -0,0 +1,120 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_tpacket.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to capture packets using Linux TPACKET_V3 rings
+ *
+ * This file contains declaration of structure and functions to read
+ * packets directly from AF_PACKET memory mapped rings. Each ring block
+ * contains several frames that are parsed without any copy or syscall.
+ *
+ * Additional information about TPACKET_V3 can be found in kernel
+ * documentation at Documentation/networking/packet_mmap.txt
+ */
+#ifndef __SNGREP_CAPTURE_TPACKET_H
+#define __SNGREP_CAPTURE_TPACKET_H
+
+#include "config.h"
+#include <stdint.h>
+#include "capture.h"
+
+//! Timeout for retiring a not filled block (ms)
+#define TPACKET_BLOCK_TIMEOUT 10
+//! Frame size for ring slots calculation
+#define TPACKET_FRAME_SIZE 2048
+
+/**
+ * @brief TPACKET_V3 ring information
+ *
+ * Store AF_PACKET socket and mapped memory ring of a capture source
+ */
+struct capture_tpacket
+{
+    //! AF_PACKET socket
+    int fd;
+    //! Memory mapped ring
+    uint8_t *map;
+    //! Size of each ring block
+    uint32_t block_size;
+    //! Number of ring blocks
+    uint32_t block_count;
+    //! Next block to be read
+    uint32_t current;
+    //! Packets dropped by the kernel (socket statistics are reset on read)
+    uint64_t drops;
+};
+
+/**
+ * @brief Online capture function using TPACKET_V3 rings
+ *
+ * Create one capture source for the given device. If fanout has been
+ * configured, multiple sources will share the device traffic.
+ *
+ * @param dev Device to capture packets from
+ * @param outfile Dumpfile for captured packets
+ *
+ * @return 0 on spawn success, 1 otherwise
+ */
+int
+capture_tpacket(const char *dev, const char *outfile);
+
+/**
+ * @brief Read packets from the ring until capture is stopped
+ *
+ * Wait for the kernel to fill ring blocks and send all their frames
+ * to parse_packet before giving the block back.
+ *
+ * @param capinfo Capture source information
+ */
+void
+capture_tpacket_loop(capture_info_t *capinfo);
+
+/**
+ * @brief Set the BPF filter of a TPACKET capture source
+ *
+ * @param capinfo Capture source information
+ * @param fp Compiled filter program
+ * @return 0 if filter has been set, 1 otherwise
+ */
+int
+capture_tpacket_set_filter(capture_info_t *capinfo, struct bpf_program *fp);
+
+/**
+ * @brief Get the number of packets dropped by the kernel ring
+ *
+ * @param capinfo Capture source information
+ * @return dropped packets since the capture was started
+ */
+uint64_t
+capture_tpacket_drops(capture_info_t *capinfo);
+
+/**
+ * @brief Unmap the ring and close the capture socket
+ *
+ * @param capinfo Capture source information
+ */
+void
+capture_tpacket_close(capture_info_t *capinfo);
+
+#endif /* __SNGREP_CAPTURE_TPACKET_H */
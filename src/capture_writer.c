@@ -0,0 +1,530 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_writer.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in capture_writer.h
+ */
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "capture_writer.h"
+#include "setting.h"
+#include "storage.h"
+#include "util.h"
+
+/**
+ * @brief Get current monotonic time in milliseconds
+ */
+static uint64_t
+capture_writer_msecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Get the path of dump file started at given time
+ */
+static void
+capture_writer_filename(capture_writer_t *writer, time_t when, char *path, size_t len)
+{
+    struct tm tm;
+    bool same;
+
+    // Dump file name can be an strftime template
+    localtime_r(&when, &tm);
+    if (!strchr(writer->outfile, '%') || !strftime(path, len, writer->outfile, &tm))
+        snprintf(path, len, "%s", writer->outfile);
+    same = !strcmp(path, writer->name);
+    snprintf(writer->name, sizeof(writer->name), "%s", path);
+
+    // Rotated files must not overwrite previous ones
+    if (writer->seq && same)
+        snprintf(path + strlen(path), len - strlen(path), ".%u", writer->seq);
+}
+
+/**
+ * @brief Open current dump file path for writing
+ *
+ * @return 0 on success, 1 otherwise
+ */
+static int
+capture_writer_open_file(capture_writer_t *writer)
+{
+    // Direct writes are not supported by all filesystems
+    writer->direct = setting_enabled(SETTING_CAPTURE_WRITER_DIRECT);
+    if (writer->direct && (writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644)) >= 0)
+        return 0;
+    writer->direct = false;
+
+    return (writer->fd = open(writer->path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0;
+}
+
+/**
+ * @brief Close current dump file
+ */
+static void
+capture_writer_close_file(capture_writer_t *writer)
+{
+    if (writer->fd < 0)
+        return;
+
+    if (writer->fsync == WRITER_FSYNC_CLOSE)
+        fsync(writer->fd);
+    close(writer->fd);
+    writer->fd = -1;
+}
+
+/**
+ * @brief Close current dump file and start the next one
+ *
+ * Oldest dump files are removed when max files number is reached.
+ */
+static void
+capture_writer_next_file(capture_writer_t *writer, time_t when)
+{
+    int last;
+
+    capture_writer_close_file(writer);
+
+    // Remember the new file and forget the oldest one
+    writer->seq++;
+    capture_writer_filename(writer, when, writer->path, sizeof(writer->path));
+    if (writer->max_files) {
+        if (writer->files_count == writer->max_files) {
+            unlink(writer->files[writer->files_first]);
+            free(writer->files[writer->files_first]);
+            writer->files_first = (writer->files_first + 1) % writer->max_files;
+            writer->files_count--;
+        }
+        last = (writer->files_first + writer->files_count++) % writer->max_files;
+        writer->files[last] = strdup(writer->path);
+    }
+
+    // Records of this file are lost if it can not be opened
+    capture_writer_open_file(writer);
+}
+
+/**
+ * @brief Write a block to the dump file
+ */
+static void
+capture_writer_write(capture_writer_t *writer, capture_writer_block_t *block)
+{
+    size_t done = 0;
+    ssize_t bytes;
+    int flags;
+
+    if (writer->fd < 0) {
+        __atomic_fetch_add(&writer->errors, block->frames, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Only last block of each file may have an unaligned size
+    if (writer->direct && block->len % WRITER_ALIGN) {
+        if ((flags = fcntl(writer->fd, F_GETFL)) != -1)
+            fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT);
+        writer->direct = false;
+    }
+
+    while (done < block->len) {
+        if ((bytes = write(writer->fd, block->data + done, block->len - done)) < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0) {
+            __atomic_fetch_add(&writer->errors, block->frames, __ATOMIC_RELAXED);
+            return;
+        }
+        done += bytes;
+    }
+
+    if (writer->fsync == WRITER_FSYNC_BLOCK)
+        fdatasync(writer->fd);
+}
+
+/**
+ * @brief Write full blocks until writer is closed
+ */
+static void *
+capture_writer_thread(void *info)
+{
+    capture_writer_t *writer = (capture_writer_t *) info;
+    capture_writer_block_t *block;
+
+    while (true) {
+        // Write all full blocks before stopping
+        if ((block = ring_pop(writer->full))) {
+            capture_writer_write(writer, block);
+            if (block->rotate)
+                capture_writer_next_file(writer, block->rotate_time);
+            block->len = block->frames = 0;
+            block->rotate = false;
+            ring_push(writer->free, block);
+            continue;
+        }
+
+        if (!__atomic_load_n(&writer->running, __ATOMIC_ACQUIRE))
+            break;
+
+        // Do not keep records in memory for too long (direct writes only use full blocks)
+        if (!writer->direct) {
+            pthread_mutex_lock(&writer->lock);
+            if (writer->current && writer->current->len
+                && capture_writer_msecs() - writer->current_start >= WRITER_FLUSH_MSECS) {
+                ring_push(writer->full, writer->current);
+                writer->current = NULL;
+            }
+            pthread_mutex_unlock(&writer->lock);
+        }
+
+        usleep(1000);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check there is room for a record of given length
+ *
+ * @return true if record can be copied, false if it must be dropped
+ */
+static bool
+capture_writer_reserve(capture_writer_t *writer, size_t len)
+{
+    if (!writer->current) {
+        if (!(writer->current = ring_pop(writer->free)))
+            return false;
+        writer->current_start = capture_writer_msecs();
+    }
+
+    // Records never fill more than two blocks
+    return writer->current->len + len <= writer->block_size || ring_count(writer->free);
+}
+
+/**
+ * @brief Copy record data into current block, sending full blocks to the writer thread
+ */
+static void
+capture_writer_copy(capture_writer_t *writer, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    size_t bytes;
+
+    while (len) {
+        if (!writer->current) {
+            writer->current = ring_pop(writer->free);
+            writer->current_start = capture_writer_msecs();
+        }
+
+        bytes = writer->block_size - writer->current->len;
+        if (bytes > len)
+            bytes = len;
+        memcpy(writer->current->data + writer->current->len, src, bytes);
+        writer->current->len += bytes;
+        writer->file_bytes += bytes;
+        src += bytes;
+        len -= bytes;
+
+        if (writer->current->len == writer->block_size) {
+            ring_push(writer->full, writer->current);
+            writer->current = NULL;
+        }
+    }
+}
+
+/**
+ * @brief Check if current dump file must be rotated before a record
+ */
+static bool
+capture_writer_must_rotate(capture_writer_t *writer, size_t len)
+{
+    // Files always contain at least one record
+    if (writer->file_bytes <= writer->header_len)
+        return false;
+
+    if (writer->rotate_size && writer->file_bytes + len > writer->rotate_size)
+        return true;
+
+    return writer->rotate_secs && time(NULL) - writer->file_start >= writer->rotate_secs;
+}
+
+/**
+ * @brief Mark current block as last of its dump file
+ *
+ * Rotation is delayed if there are no free blocks for the next file header.
+ */
+static void
+capture_writer_rotate(capture_writer_t *writer)
+{
+    if (!writer->current && !(writer->current = ring_pop(writer->free)))
+        return;
+    if (!ring_count(writer->free))
+        return;
+
+    writer->file_start = time(NULL);
+    writer->current->rotate = true;
+    writer->current->rotate_time = writer->file_start;
+    ring_push(writer->full, writer->current);
+    writer->current = NULL;
+
+    // Next file starts with the file header
+    writer->file_seq++;
+    writer->file_bytes = 0;
+    capture_writer_copy(writer, writer->header, writer->header_len);
+}
+
+capture_writer_t *
+capture_writer_open(pcap_t *handle, const char *outfile)
+{
+    capture_writer_t *writer;
+    pcap_dumper_t *pd;
+    pthread_attr_t attr;
+    ssize_t header_len;
+    int fd, i;
+
+    if (!(writer = sng_malloc(sizeof(capture_writer_t)))
+        || !(writer->header = malloc(WRITER_ALIGN))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return NULL;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    writer->fd = -1;
+    writer->last_offset = -1;
+    writer->outfile = outfile;
+    if (setting_has_value(SETTING_CAPTURE_WRITER_FSYNC, "block")) {
+        writer->fsync = WRITER_FSYNC_BLOCK;
+    } else if (setting_has_value(SETTING_CAPTURE_WRITER_FSYNC, "close")) {
+        writer->fsync = WRITER_FSYNC_CLOSE;
+    }
+
+    // Dump file rotation
+    writer->rotate_size = (uint64_t) setting_get_intvalue(SETTING_CAPTURE_WRITER_ROTATE_SIZE) * 1024 * 1024;
+    writer->rotate_secs = (time_t) setting_get_intvalue(SETTING_CAPTURE_WRITER_ROTATE_TIME) * 60;
+    if ((writer->max_files = setting_get_intvalue(SETTING_CAPTURE_WRITER_MAX_FILES)) < 0)
+        writer->max_files = 0;
+    if (writer->max_files && !(writer->files = sng_malloc(sizeof(char *) * writer->max_files))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        capture_writer_close(writer);
+        return NULL;
+    }
+    writer->file_start = time(NULL);
+    capture_writer_filename(writer, writer->file_start, writer->path, sizeof(writer->path));
+    if (writer->max_files) {
+        writer->files[0] = strdup(writer->path);
+        writer->files_count = 1;
+    }
+
+    // Let libpcap write the file header
+    if (!(pd = pcap_dump_open(handle, writer->path))) {
+        fprintf(stderr, "Couldn't open output dump file %s: %s\n", writer->path, pcap_geterr(handle));
+        capture_writer_close(writer);
+        return NULL;
+    }
+    pcap_dump_close(pd);
+
+    // Same header is written at the start of each rotated file
+    if ((fd = open(writer->path, O_RDONLY)) < 0 || (header_len = read(fd, writer->header, WRITER_ALIGN)) <= 0) {
+        fprintf(stderr, "Couldn't open output dump file %s: %s\n", writer->path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        capture_writer_close(writer);
+        return NULL;
+    }
+    writer->header_len = header_len;
+    close(fd);
+
+    if (capture_writer_open_file(writer) != 0) {
+        fprintf(stderr, "Couldn't open output dump file %s: %s\n", writer->path, strerror(errno));
+        capture_writer_close(writer);
+        return NULL;
+    }
+
+    // Blocks must be able to store the biggest record
+    writer->block_size = setting_get_intvalue(SETTING_CAPTURE_WRITER_BLOCKSIZE);
+    if (writer->block_size < MAXIMUM_SNAPLEN + WRITER_RECORD_HEADER)
+        writer->block_size = MAXIMUM_SNAPLEN + WRITER_RECORD_HEADER;
+    writer->block_size = (writer->block_size + WRITER_ALIGN - 1) / WRITER_ALIGN * WRITER_ALIGN;
+    writer->block_count = setting_get_intvalue(SETTING_CAPTURE_WRITER_BLOCKS);
+    if (writer->block_count < 2)
+        writer->block_count = 2;
+
+    // Allocate aligned blocks, all of them are initially free
+    writer->free = ring_create(writer->block_count);
+    writer->full = ring_create(writer->block_count);
+    writer->blocks = sng_malloc(sizeof(capture_writer_block_t) * writer->block_count);
+    if (!writer->free || !writer->full || !writer->blocks) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        capture_writer_close(writer);
+        return NULL;
+    }
+    for (i = 0; i < writer->block_count; i++) {
+        if (posix_memalign((void **) &writer->blocks[i].data, WRITER_ALIGN, writer->block_size) != 0) {
+            writer->blocks[i].data = NULL;
+            fprintf(stderr, "Can't allocate memory for capture data!\n");
+            capture_writer_close(writer);
+            return NULL;
+        }
+        ring_push(writer->free, &writer->blocks[i]);
+    }
+
+    // File header is written with first block
+    capture_writer_copy(writer, writer->header, writer->header_len);
+
+    // Start writer thread
+    writer->running = true;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    if (pthread_create(&writer->thread, &attr, capture_writer_thread, writer) != 0) {
+        writer->running = false;
+        pthread_attr_destroy(&attr);
+        fprintf(stderr, "Failed to launch dump file writer thread.\n");
+        capture_writer_close(writer);
+        return NULL;
+    }
+    pthread_attr_destroy(&attr);
+
+    return writer;
+}
+
+void
+capture_writer_packet(capture_writer_t *writer, const packet_t *packet)
+{
+    vector_iter_t it;
+    frame_t *frame;
+    u_char *data;
+    uint32_t record[4];
+
+    if (!writer || !packet)
+        return;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->last_offset = -1;
+    it = vector_iterator(packet->frames);
+    while ((frame = vector_iterator_next(&it))) {
+        // Read frame content back from disk storage
+        if (!(data = (frame->data) ? frame->data : storage_read_frame(frame)))
+            continue;
+
+        // Same record header written by pcap_dump
+        record[0] = frame->header.ts.tv_sec;
+        record[1] = frame->header.ts.tv_usec;
+        record[2] = frame->header.caplen;
+        record[3] = frame->header.len;
+
+        // Start next dump file if current one is big or old enough
+        if (capture_writer_must_rotate(writer, sizeof(record) + frame->header.caplen))
+            capture_writer_rotate(writer);
+
+        if (capture_writer_reserve(writer, sizeof(record) + frame->header.caplen)) {
+            // Remember where the packet starts
+            if (writer->last_offset < 0) {
+                writer->last_file = writer->file_seq;
+                writer->last_offset = writer->file_bytes;
+            }
+            writer->current->frames++;
+            capture_writer_copy(writer, record, sizeof(record));
+            capture_writer_copy(writer, data, frame->header.caplen);
+        } else {
+            __atomic_fetch_add(&writer->drops, 1, __ATOMIC_RELAXED);
+        }
+
+        if (data != frame->data)
+            sng_free(data);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+int
+capture_writer_queue(capture_writer_t *writer)
+{
+    return (writer) ? (int) ring_count(writer->full) : 0;
+}
+
+int
+capture_writer_position(capture_writer_t *writer, uint32_t *file, int64_t *offset)
+{
+    int ret = 1;
+
+    if (!writer)
+        return 1;
+
+    pthread_mutex_lock(&writer->lock);
+    if (writer->last_offset >= 0) {
+        *file = writer->last_file;
+        *offset = writer->last_offset;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return ret;
+}
+
+uint64_t
+capture_writer_drops(capture_writer_t *writer)
+{
+    if (!writer)
+        return 0;
+
+    return __atomic_load_n(&writer->drops, __ATOMIC_RELAXED)
+           + __atomic_load_n(&writer->errors, __ATOMIC_RELAXED);
+}
+
+void
+capture_writer_close(capture_writer_t *writer)
+{
+    int i;
+
+    if (!writer)
+        return;
+
+    // Send last partial block and wait until all blocks are written
+    if (writer->running) {
+        pthread_mutex_lock(&writer->lock);
+        if (writer->current && writer->current->len)
+            ring_push(writer->full, writer->current);
+        writer->current = NULL;
+        pthread_mutex_unlock(&writer->lock);
+        __atomic_store_n(&writer->running, false, __ATOMIC_RELEASE);
+        pthread_join(writer->thread, NULL);
+    }
+
+    capture_writer_close_file(writer);
+    for (i = 0; i < writer->files_count; i++)
+        free(writer->files[(writer->files_first + i) % writer->max_files]);
+    sng_free(writer->files);
+    free(writer->header);
+
+    for (i = 0; writer->blocks && i < writer->block_count; i++)
+        free(writer->blocks[i].data);
+    sng_free(writer->blocks);
+    if (writer->free)
+        ring_destroy(writer->free);
+    if (writer->full)
+        ring_destroy(writer->full);
+    pthread_mutex_destroy(&writer->lock);
+    sng_free(writer);
+}
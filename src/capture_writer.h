@@ -0,0 +1,214 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_writer.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to write the capture dump file in a separate thread
+ *
+ * Captured packets are copied as pcap records into big memory blocks
+ * and a writer thread writes full blocks to the dump file, so slow disks
+ * never make the capture threads wait. When all blocks are waiting to
+ * be written, new packets are not stored in the dump file.
+ *
+ * The file header is written by libpcap, so dump files are the same
+ * than the ones written by pcap_dump.
+ *
+ * Dump files can be rotated after a size or time. Capture threads only
+ * mark the last block of each file, and the writer thread closes it and
+ * opens the next one after writing that block.
+ */
+#ifndef __SNGREP_CAPTURE_WRITER_H
+#define __SNGREP_CAPTURE_WRITER_H
+
+#include "config.h"
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include "capture.h"
+#include "ring.h"
+
+//! Size of pcap record header
+#define WRITER_RECORD_HEADER 16
+//! Alignment of blocks memory and size for direct writes
+#define WRITER_ALIGN 4096
+//! Max time a partial block waits before being written (ms)
+#define WRITER_FLUSH_MSECS 1000
+
+//! Shorter declaration of writer block structure
+typedef struct capture_writer_block capture_writer_block_t;
+
+//! Dump file synchronization policies
+enum capture_writer_fsync {
+    WRITER_FSYNC_OFF = 0,
+    WRITER_FSYNC_BLOCK,
+    WRITER_FSYNC_CLOSE,
+};
+
+/**
+ * @brief Block of pcap records pending to be written
+ *
+ * Records can be split between consecutive blocks.
+ */
+struct capture_writer_block
+{
+    //! Block data
+    uint8_t *data;
+    //! Bytes used in this block
+    size_t len;
+    //! Frames starting in this block
+    uint32_t frames;
+    //! Dump file must be rotated after writing this block
+    bool rotate;
+    //! Time used to name next dump file
+    time_t rotate_time;
+};
+
+/**
+ * @brief Dump file writer information
+ */
+struct capture_writer
+{
+    //! Dump file descriptor
+    int fd;
+    //! Dump file name (strftime template if it contains '%')
+    const char *outfile;
+    //! Current dump file path
+    char path[PATH_MAX];
+    //! Current dump file name before adding rotation suffix
+    char name[PATH_MAX];
+    //! File header written by libpcap
+    uint8_t *header;
+    //! File header length
+    size_t header_len;
+    //! Rotate dump file after this number of bytes (0 to disable)
+    uint64_t rotate_size;
+    //! Rotate dump file after this number of seconds (0 to disable)
+    time_t rotate_secs;
+    //! Bytes queued for current dump file
+    uint64_t file_bytes;
+    //! Time current dump file was started
+    time_t file_start;
+    //! Number of rotated files
+    uint32_t seq;
+    //! Number of dump files started by capture threads
+    uint32_t file_seq;
+    //! Dump file number and offset of the last packet first record
+    uint32_t last_file;
+    int64_t last_offset;
+    //! Max number of dump files kept (0 for no limit)
+    int max_files;
+    //! Paths of kept dump files (oldest first from files_first)
+    char **files;
+    //! Number of kept dump files
+    int files_count;
+    //! Oldest kept dump file position
+    int files_first;
+    //! Dump file is opened with O_DIRECT
+    bool direct;
+    //! Dump file synchronization policy
+    enum capture_writer_fsync fsync;
+    //! Size of allocated blocks
+    size_t block_size;
+    //! Number of allocated blocks
+    int block_count;
+    //! Allocated blocks
+    capture_writer_block_t *blocks;
+    //! Blocks ready to be filled with records
+    ring_t *free;
+    //! Blocks ready to be written by the writer thread
+    ring_t *full;
+    //! Block being filled with records (NULL if none available)
+    capture_writer_block_t *current;
+    //! Time current block got its first record (ms)
+    uint64_t current_start;
+    //! Lock for current block (shared by capture and writer threads)
+    pthread_mutex_t lock;
+    //! Writer thread
+    pthread_t thread;
+    //! Writer thread must keep writing
+    bool running;
+    //! Frames not written because all blocks were full
+    uint64_t drops;
+    //! Frames lost in failed writes
+    uint64_t errors;
+};
+
+/**
+ * @brief Open a dump file written by a writer thread
+ *
+ * @param handle libpcap handler of the first capture source
+ * @param outfile Dumpfile for captured packets
+ * @return writer information or NULL on error
+ */
+capture_writer_t *
+capture_writer_open(pcap_t *handle, const char *outfile);
+
+/**
+ * @brief Queue all frames of a packet to be written
+ *
+ * @param writer Dump file writer
+ * @param packet Packet to store in the dump file
+ */
+void
+capture_writer_packet(capture_writer_t *writer, const packet_t *packet);
+
+/**
+ * @brief Get number of blocks waiting to be written
+ *
+ * @param writer Dump file writer
+ * @return number of full blocks in writer queue
+ */
+int
+capture_writer_queue(capture_writer_t *writer);
+
+/**
+ * @brief Get where the last packet was written
+ *
+ * This must be called with the capture lock after writing the packet.
+ *
+ * @param file Dump file number (0 for the first file)
+ * @param offset Offset of the packet first record in that file
+ * @return 0 if last packet was written, 1 otherwise
+ */
+int
+capture_writer_position(capture_writer_t *writer, uint32_t *file, int64_t *offset);
+
+/**
+ * @brief Get number of frames not written in the dump file
+ *
+ * @param writer Dump file writer
+ * @return frames dropped because writer queue was full or write failed
+ */
+uint64_t
+capture_writer_drops(capture_writer_t *writer);
+
+/**
+ * @brief Write all pending records and close the dump file
+ *
+ * @param writer Dump file writer
+ */
+void
+capture_writer_close(capture_writer_t *writer);
+
+#endif /* __SNGREP_CAPTURE_WRITER_H */
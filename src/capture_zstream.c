@@ -0,0 +1,284 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_zstream.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in capture_zstream.h
+ */
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture_zstream.h"
+#include "util.h"
+
+//! Name of each compression format
+static const char *zstream_names[] = { "plain", "gzip", "zstd" };
+
+enum capture_zstream_format
+capture_zstream_format(int fd)
+{
+    uint8_t magic[4];
+
+    if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic))
+        return ZSTREAM_NONE;
+
+    if (magic[0] == 0x1f && magic[1] == 0x8b)
+        return ZSTREAM_GZIP;
+    if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return ZSTREAM_ZSTD;
+
+    return ZSTREAM_NONE;
+}
+
+/**
+ * @brief Check if a compression format is supported by this build
+ */
+static bool
+capture_zstream_supported(enum capture_zstream_format format)
+{
+    switch (format) {
+#ifdef WITH_ZLIB
+        case ZSTREAM_GZIP:
+            return true;
+#endif
+#ifdef WITH_ZSTD
+        case ZSTREAM_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+capture_zstream_t *
+capture_zstream_open(int fd)
+{
+    capture_zstream_t *zstream;
+    enum capture_zstream_format format;
+
+    if (!capture_zstream_supported(format = capture_zstream_format(fd)))
+        return NULL;
+
+    if (!(zstream = sng_malloc(sizeof(capture_zstream_t))))
+        return NULL;
+    zstream->fd = fd;
+    zstream->format = format;
+
+    // Read ahead the whole file
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+#ifdef WITH_ZLIB
+    if (format == ZSTREAM_GZIP) {
+        if (!(zstream->gz = gzdopen(fd, "rb"))) {
+            sng_free(zstream);
+            return NULL;
+        }
+        gzbuffer(zstream->gz, ZSTREAM_BUFFER_SIZE);
+    }
+#endif
+#ifdef WITH_ZSTD
+    if (format == ZSTREAM_ZSTD) {
+        if (!(zstream->zstd = ZSTD_createDStream()) || ZSTD_isError(ZSTD_initDStream(zstream->zstd))
+            || !(zstream->buffer = malloc(ZSTREAM_BUFFER_SIZE))) {
+            ZSTD_freeDStream(zstream->zstd);
+            sng_free(zstream);
+            return NULL;
+        }
+        zstream->in.src = zstream->buffer;
+    }
+#endif
+
+    return zstream;
+}
+
+#ifdef WITH_ZLIB
+/**
+ * @brief Read decompressed data from a gzip file
+ */
+static ssize_t
+capture_zstream_read_gzip(capture_zstream_t *zstream, uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+    int bytes;
+
+    while (pos < len && !zstream->eof) {
+        if ((bytes = gzread(zstream->gz, data + pos, (len - pos > INT32_MAX) ? INT32_MAX : len - pos)) < 0)
+            return (pos) ? (ssize_t) pos : -1;
+        if (bytes == 0)
+            zstream->eof = true;
+        pos += bytes;
+    }
+
+    __atomic_store_n(&zstream->consumed, gzoffset(zstream->gz), __ATOMIC_RELAXED);
+    return pos;
+}
+#endif
+
+#ifdef WITH_ZSTD
+/**
+ * @brief Read decompressed data from a zstd file
+ *
+ * Concatenated frames are decompressed as a single stream.
+ */
+static ssize_t
+capture_zstream_read_zstd(capture_zstream_t *zstream, uint8_t *data, size_t len)
+{
+    ZSTD_outBuffer out = { data, len, 0 };
+    ssize_t bytes;
+    size_t ret;
+
+    while (out.pos < out.size) {
+        // Read more compressed data
+        if (zstream->in.pos == zstream->in.size) {
+            if (zstream->eof)
+                break;
+            if ((bytes = read(zstream->fd, zstream->buffer, ZSTREAM_BUFFER_SIZE)) < 0 && errno == EINTR)
+                continue;
+            if (bytes <= 0) {
+                zstream->eof = true;
+                break;
+            }
+            zstream->in.size = bytes;
+            zstream->in.pos = 0;
+            __atomic_fetch_add(&zstream->consumed, bytes, __ATOMIC_RELAXED);
+        }
+
+        if (ZSTD_isError(ret = ZSTD_decompressStream(zstream->zstd, &out, &zstream->in)))
+            return (out.pos) ? (ssize_t) out.pos : -1;
+    }
+
+    return out.pos;
+}
+#endif
+
+ssize_t
+capture_zstream_read(capture_zstream_t *zstream, void *data, size_t len)
+{
+    switch (zstream->format) {
+#ifdef WITH_ZLIB
+        case ZSTREAM_GZIP:
+            return capture_zstream_read_gzip(zstream, data, len);
+#endif
+#ifdef WITH_ZSTD
+        case ZSTREAM_ZSTD:
+            return capture_zstream_read_zstd(zstream, data, len);
+#endif
+        default:
+            return -1;
+    }
+}
+
+uint64_t
+capture_zstream_consumed(capture_zstream_t *zstream)
+{
+    return __atomic_load_n(&zstream->consumed, __ATOMIC_RELAXED);
+}
+
+void
+capture_zstream_close(capture_zstream_t *zstream)
+{
+    if (!zstream)
+        return;
+
+#ifdef WITH_ZLIB
+    if (zstream->format == ZSTREAM_GZIP) {
+        // File descriptor is closed with the gzip stream
+        gzclose(zstream->gz);
+        zstream->fd = -1;
+    }
+#endif
+#ifdef WITH_ZSTD
+    ZSTD_freeDStream(zstream->zstd);
+    free(zstream->buffer);
+#endif
+    if (zstream->fd >= 0)
+        close(zstream->fd);
+    sng_free(zstream);
+}
+
+#ifdef HAVE_FOPENCOOKIE
+/**
+ * @brief Read function of libpcap custom streams
+ */
+static ssize_t
+capture_zstream_cookie_read(void *cookie, char *buf, size_t size)
+{
+    return capture_zstream_read((capture_zstream_t *) cookie, buf, size);
+}
+
+/**
+ * @brief Close function of libpcap custom streams
+ */
+static int
+capture_zstream_cookie_close(void *cookie)
+{
+    capture_zstream_close((capture_zstream_t *) cookie);
+    return 0;
+}
+#endif
+
+pcap_t *
+capture_zstream_pcap_open(const char *infile, char *errbuf)
+{
+    enum capture_zstream_format format;
+    int fd;
+#ifdef HAVE_FOPENCOOKIE
+    cookie_io_functions_t io = { 0 };
+    capture_zstream_t *zstream;
+    pcap_t *handle;
+    FILE *fp;
+#endif
+
+    // Let libpcap report any error opening the file
+    if ((fd = open(infile, O_RDONLY)) < 0)
+        return pcap_open_offline(infile, errbuf);
+
+    if ((format = capture_zstream_format(fd)) == ZSTREAM_NONE) {
+        close(fd);
+        return pcap_open_offline(infile, errbuf);
+    }
+
+#ifdef HAVE_FOPENCOOKIE
+    if ((zstream = capture_zstream_open(fd))) {
+        io.read = capture_zstream_cookie_read;
+        io.close = capture_zstream_cookie_close;
+        if (!(fp = fopencookie(zstream, "r", io))) {
+            capture_zstream_close(zstream);
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", strerror(errno));
+            return NULL;
+        }
+        // Stream is closed with libpcap handler
+        if (!(handle = pcap_fopen_offline(fp, errbuf)))
+            fclose(fp);
+        return handle;
+    }
+#endif
+
+    close(fd);
+    snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s compressed files are not supported", zstream_names[format]);
+    return NULL;
+}
@@ -0,0 +1,152 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_zstream.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to read compressed capture files
+ *
+ * Capture files compressed with gzip or zstd are detected by their
+ * magic bytes and decompressed while being read, so they can be used
+ * as input files without decompressing them first.
+ *
+ * Offline reader thread decompresses classic pcap files while the
+ * capture thread decodes the previous blocks. Any other compressed
+ * file (pcapng, merged inputs, reader disabled) is read by libpcap
+ * through a custom stream.
+ */
+#ifndef __SNGREP_CAPTURE_ZSTREAM_H
+#define __SNGREP_CAPTURE_ZSTREAM_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <pcap.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+//! Size of the buffer of compressed data read from file
+#define ZSTREAM_BUFFER_SIZE 1048576
+
+//! Shorter declaration of capture_zstream structure
+typedef struct capture_zstream capture_zstream_t;
+
+/**
+ * @brief Compression formats of capture files
+ */
+enum capture_zstream_format
+{
+    ZSTREAM_NONE = 0,
+    ZSTREAM_GZIP,
+    ZSTREAM_ZSTD,
+};
+
+/**
+ * @brief Decompression stream of a capture file
+ */
+struct capture_zstream
+{
+    //! Compressed file descriptor
+    int fd;
+    //! Compression format of the file
+    enum capture_zstream_format format;
+#ifdef WITH_ZLIB
+    //! gzip decompression stream
+    gzFile gz;
+#endif
+#ifdef WITH_ZSTD
+    //! zstd decompression stream
+    ZSTD_DStream *zstd;
+    //! Compressed data pending to be decompressed
+    ZSTD_inBuffer in;
+    //! Compressed data buffer
+    uint8_t *buffer;
+#endif
+    //! All file data has been read
+    bool eof;
+    //! Compressed bytes read from file
+    uint64_t consumed;
+};
+
+/**
+ * @brief Get the compression format of a file from its first bytes
+ *
+ * @param fd File descriptor (its read offset is not changed)
+ * @return compression format or ZSTREAM_NONE if file is not compressed
+ */
+enum capture_zstream_format
+capture_zstream_format(int fd);
+
+/**
+ * @brief Create a decompression stream for a compressed file
+ *
+ * Stream takes ownership of the file descriptor on success.
+ *
+ * @param fd File descriptor of a compressed file
+ * @return stream or NULL if file is not compressed or its format is not supported
+ */
+capture_zstream_t *
+capture_zstream_open(int fd);
+
+/**
+ * @brief Read decompressed data
+ *
+ * @param zstream Decompression stream
+ * @param data Buffer to fill
+ * @param len Buffer size
+ * @return decompressed bytes (less than len at file end) or -1 on error
+ */
+ssize_t
+capture_zstream_read(capture_zstream_t *zstream, void *data, size_t len);
+
+/**
+ * @brief Get the compressed bytes read from file
+ *
+ * Can be called from any thread while the stream is being read.
+ */
+uint64_t
+capture_zstream_consumed(capture_zstream_t *zstream);
+
+/**
+ * @brief Close a decompression stream and its file
+ */
+void
+capture_zstream_close(capture_zstream_t *zstream);
+
+/**
+ * @brief Open a capture file with libpcap
+ *
+ * Compressed files are decompressed while libpcap reads them.
+ *
+ * @param infile Capture file
+ * @param errbuf libpcap error buffer
+ * @return libpcap handler or NULL on error
+ */
+pcap_t *
+capture_zstream_pcap_open(const char *infile, char *errbuf);
+
+#endif /* __SNGREP_CAPTURE_ZSTREAM_H */
@@ -0,0 +1,465 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file cdr.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to export dialogs summary records
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include "cdr.h"
+#include "capture.h"
+#include "sip.h"
+#include "setting.h"
+
+/**
+ * @brief Exported record field
+ *
+ * Fields taken from dialogs attributes use the attribute name.
+ */
+typedef struct cdr_field {
+    //! Dialog attribute of this field (-1 if none)
+    int attr;
+    //! Field name for fields without attribute
+    const char *name;
+    //! Field value is quoted in JSON records
+    bool text;
+} cdr_field_t;
+
+//! Fields of exported records in output order
+static cdr_field_t cdr_fields[] = {
+    { SIP_ATTR_CALLINDEX,  NULL,         false },
+    { SIP_ATTR_CALLID,     NULL,         true  },
+    { SIP_ATTR_XCALLID,    NULL,         true  },
+    { SIP_ATTR_SIPFROM,    NULL,         true  },
+    { SIP_ATTR_SIPTO,      NULL,         true  },
+    { SIP_ATTR_SRC,        NULL,         true  },
+    { SIP_ATTR_DST,        NULL,         true  },
+    { SIP_ATTR_DATE,       NULL,         true  },
+    { SIP_ATTR_TIME,       NULL,         true  },
+    { -1,                  "start",      false },
+    { -1,                  "end",        false },
+    { SIP_ATTR_METHOD,     NULL,         true  },
+    { SIP_ATTR_TRANSPORT,  NULL,         true  },
+    { SIP_ATTR_MSGCNT,     NULL,         false },
+    { SIP_ATTR_CALLSTATE,  NULL,         true  },
+    { SIP_ATTR_CONVDUR,    NULL,         false },
+    { SIP_ATTR_TOTALDUR,   NULL,         false },
+    { SIP_ATTR_REASON_TXT, NULL,         true  },
+    { SIP_ATTR_WARNING,    NULL,         false },
+    { -1,                  "codecs",     true  },
+    { -1,                  "streams",    false },
+    { -1,                  "rtppackets", false },
+    { SIP_ATTR_RTPLOSS,    NULL,         false },
+    { SIP_ATTR_RTPJITTER,  NULL,         false },
+    { SIP_ATTR_RTPMOS,     NULL,         false },
+};
+
+//! Number of exported record fields
+#define CDR_FIELD_COUNT (int) (sizeof(cdr_fields) / sizeof(cdr_fields[0]))
+
+//! Exporter configuration and status
+static cdr_config_t cdr_cfg = { 0 };
+
+/**
+ * @brief Get the name of a record field
+ */
+static const char *
+cdr_field_name(int field)
+{
+    if (cdr_fields[field].attr >= 0)
+        return sip_attr_get_name(cdr_fields[field].attr);
+    return cdr_fields[field].name;
+}
+
+/**
+ * @brief Format a duration between two times in seconds
+ *
+ * @return formatted duration or NULL if any time is not set
+ */
+static const char *
+cdr_duration(struct timeval start, struct timeval end, char *value)
+{
+    if (!timerisset(&start) || !timerisset(&end))
+        return NULL;
+
+    sprintf(value, "%.3f", (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+    return value;
+}
+
+/**
+ * @brief Format the value of a record field
+ *
+ * @return formatted value or NULL if record has no value for this field
+ */
+static const char *
+cdr_field_value(const cdr_record_t *rec, int field, char *value)
+{
+    char ip[ADDRESSLEN];
+    const char *str = NULL;
+    struct tm tm;
+    time_t t;
+
+    switch (cdr_fields[field].attr) {
+        case SIP_ATTR_CALLINDEX:
+            sprintf(value, "%d", rec->index);
+            return value;
+        case SIP_ATTR_CALLID:
+            str = rec->strings + rec->offsets[CDR_STRING_CALLID];
+            break;
+        case SIP_ATTR_XCALLID:
+            str = rec->strings + rec->offsets[CDR_STRING_XCALLID];
+            break;
+        case SIP_ATTR_SIPFROM:
+            str = rec->strings + rec->offsets[CDR_STRING_SIPFROM];
+            break;
+        case SIP_ATTR_SIPTO:
+            str = rec->strings + rec->offsets[CDR_STRING_SIPTO];
+            break;
+        case SIP_ATTR_SRC:
+            sprintf(value, "%s:%u", address_get_ip(rec->src, ip), rec->src.port);
+            return value;
+        case SIP_ATTR_DST:
+            sprintf(value, "%s:%u", address_get_ip(rec->dst, ip), rec->dst.port);
+            return value;
+        case SIP_ATTR_DATE:
+        case SIP_ATTR_TIME:
+            t = (time_t) rec->start.tv_sec;
+            localtime_r(&t, &tm);
+            if (cdr_fields[field].attr == SIP_ATTR_DATE) {
+                strftime(value, SIP_ATTR_MAXLEN, "%Y/%m/%d", &tm);
+            } else {
+                strftime(value, SIP_ATTR_MAXLEN, "%H:%M:%S", &tm);
+                sprintf(value + strlen(value), ".%06d", (int) rec->start.tv_usec);
+            }
+            return value;
+        case SIP_ATTR_METHOD:
+            str = sip_method_str(rec->reqresp);
+            break;
+        case SIP_ATTR_TRANSPORT:
+            str = sip_transport_str(rec->transport);
+            break;
+        case SIP_ATTR_MSGCNT:
+            sprintf(value, "%d", rec->msgs);
+            return value;
+        case SIP_ATTR_CALLSTATE:
+            str = call_state_to_str(rec->state);
+            break;
+        case SIP_ATTR_CONVDUR:
+            return cdr_duration(rec->conv_start, rec->conv_end, value);
+        case SIP_ATTR_TOTALDUR:
+            return cdr_duration(rec->start, rec->end, value);
+        case SIP_ATTR_REASON_TXT:
+            str = rec->strings + rec->offsets[CDR_STRING_REASON];
+            break;
+        case SIP_ATTR_WARNING:
+            if (!rec->warning)
+                return NULL;
+            sprintf(value, "%d", rec->warning);
+            return value;
+        case SIP_ATTR_RTPLOSS:
+        case SIP_ATTR_RTPJITTER:
+        case SIP_ATTR_RTPMOS:
+            if (!rec->quality)
+                return NULL;
+            sprintf(value, "%.1f", (cdr_fields[field].attr == SIP_ATTR_RTPLOSS) ? rec->loss
+                                   : (cdr_fields[field].attr == SIP_ATTR_RTPJITTER) ? rec->jitter : rec->mos);
+            return value;
+        default:
+            if (!strcmp(cdr_fields[field].name, "start")) {
+                sprintf(value, "%ld.%06ld", (long) rec->start.tv_sec, (long) rec->start.tv_usec);
+            } else if (!strcmp(cdr_fields[field].name, "end")) {
+                sprintf(value, "%ld.%06ld", (long) rec->end.tv_sec, (long) rec->end.tv_usec);
+            } else if (!strcmp(cdr_fields[field].name, "streams")) {
+                sprintf(value, "%d", rec->streams);
+            } else if (!strcmp(cdr_fields[field].name, "rtppackets")) {
+                sprintf(value, "%" PRIu64, rec->rtp_packets);
+            } else {
+                str = rec->strings + rec->offsets[CDR_STRING_CODECS];
+                break;
+            }
+            return value;
+    }
+
+    return (str && *str) ? str : NULL;
+}
+
+/**
+ * @brief Write a text value quoted as a JSON string
+ */
+static void
+cdr_write_json_string(FILE *out, const char *value)
+{
+    const unsigned char *c;
+
+    fputc('"', out);
+    for (c = (const unsigned char *) value; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', out);
+            fputc(*c, out);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief Write a value as a CSV field
+ *
+ * Values are only quoted if they contain separators or quotes.
+ */
+static void
+cdr_write_csv_string(FILE *out, const char *value)
+{
+    const char *c;
+
+    if (!strpbrk(value, ",\"\r\n")) {
+        fputs(value, out);
+        return;
+    }
+
+    fputc('"', out);
+    for (c = value; *c; c++) {
+        if (*c == '"')
+            fputc('"', out);
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief Format and write a record
+ */
+static void
+cdr_write_record(const cdr_record_t *rec)
+{
+    char buffer[SIP_ATTR_MAXLEN + 1];
+    const char *value;
+    int i;
+
+    if (cdr_cfg.format == CDR_FORMAT_JSON)
+        fputc('{', cdr_cfg.out);
+
+    for (i = 0; i < CDR_FIELD_COUNT; i++) {
+        value = cdr_field_value(rec, i, buffer);
+        if (cdr_cfg.format == CDR_FORMAT_JSON) {
+            fprintf(cdr_cfg.out, "%s\"%s\":", (i) ? "," : "", cdr_field_name(i));
+            if (!value) {
+                fputs("null", cdr_cfg.out);
+            } else if (cdr_fields[i].text) {
+                cdr_write_json_string(cdr_cfg.out, value);
+            } else {
+                fputs(value, cdr_cfg.out);
+            }
+        } else {
+            if (i)
+                fputc(',', cdr_cfg.out);
+            if (value)
+                cdr_write_csv_string(cdr_cfg.out, value);
+        }
+    }
+
+    fputs((cdr_cfg.format == CDR_FORMAT_JSON) ? "}\n" : "\n", cdr_cfg.out);
+}
+
+/**
+ * @brief Write queued records until exporter is stopped
+ */
+static void *
+cdr_writer_thread(void *data)
+{
+    cdr_record_t *rec;
+
+    // Write all queued records before leaving
+    while (__atomic_load_n(&cdr_cfg.running, __ATOMIC_ACQUIRE) || ring_count(cdr_cfg.queue)) {
+        if (!(rec = ring_pop(cdr_cfg.queue))) {
+            fflush(cdr_cfg.out);
+            usleep(CDR_WRITER_WAIT);
+            continue;
+        }
+        cdr_write_record(rec);
+        free(rec);
+    }
+
+    fflush(cdr_cfg.out);
+    return NULL;
+}
+
+int
+cdr_init()
+{
+    const char *file = setting_get_value(SETTING_CDR_FILE);
+    int i, size;
+
+    if (!file || !strlen(file))
+        return 0;
+
+    cdr_cfg.format = setting_has_value(SETTING_CDR_FORMAT, "csv") ? CDR_FORMAT_CSV : CDR_FORMAT_JSON;
+
+    if ((size = setting_get_intvalue(SETTING_CDR_QUEUE)) <= 0 || !(cdr_cfg.queue = ring_create(size))) {
+        fprintf(stderr, "Can't allocate memory for dialog records queue!\n");
+        return 1;
+    }
+
+    if (!(cdr_cfg.out = fopen(file, "a"))) {
+        fprintf(stderr, "Unable to open %s: %s\n", file, strerror(errno));
+        ring_destroy(cdr_cfg.queue);
+        cdr_cfg.queue = NULL;
+        return 1;
+    }
+
+    // New CSV files start with the fields names
+    if (cdr_cfg.format == CDR_FORMAT_CSV && ftell(cdr_cfg.out) == 0) {
+        for (i = 0; i < CDR_FIELD_COUNT; i++)
+            fprintf(cdr_cfg.out, "%s%s", (i) ? "," : "", cdr_field_name(i));
+        fputc('\n', cdr_cfg.out);
+    }
+
+    // Create a new thread for writing queued records
+    cdr_cfg.running = true;
+    if (pthread_create(&cdr_cfg.writer, NULL, cdr_writer_thread, NULL) != 0) {
+        fprintf(stderr, "Error creating dialog records writer thread: %s\n", strerror(errno));
+        cdr_cfg.running = false;
+        fclose(cdr_cfg.out);
+        cdr_cfg.out = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+cdr_deinit()
+{
+    vector_iter_t it;
+    sip_call_t *call;
+
+    if (!cdr_cfg.out)
+        return;
+
+    // Export dialogs that have not reached a final state
+    capture_lock();
+    it = sip_calls_iterator();
+    while ((call = vector_iterator_next(&it)))
+        cdr_export_call(call);
+    capture_unlock();
+
+    // Wait until all queued records have been written
+    __atomic_store_n(&cdr_cfg.running, false, __ATOMIC_RELEASE);
+    pthread_join(cdr_cfg.writer, NULL);
+
+    if (cdr_cfg.dropped)
+        fprintf(stderr, "%" PRIu64 " dialog records dropped, increase %s\n",
+                cdr_cfg.dropped, setting_name(SETTING_CDR_QUEUE));
+
+    fclose(cdr_cfg.out);
+    cdr_cfg.out = NULL;
+    ring_destroy(cdr_cfg.queue);
+    cdr_cfg.queue = NULL;
+}
+
+void
+cdr_export_call(sip_call_t *call)
+{
+    const char *strings[CDR_STRING_COUNT];
+    char from[SIP_ATTR_MAXLEN + 1] = "", to[SIP_ATTR_MAXLEN + 1] = "";
+    char codecs[CDR_CODECS_LEN] = "";
+    size_t len = 0, slen;
+    const char *format;
+    rtp_stream_t *stream;
+    sip_msg_t *first;
+    cdr_record_t *rec;
+    vector_iter_t it;
+    int i;
+
+    if (!cdr_cfg.out || call->cdr_exported || !(first = vector_first(call->msgs)))
+        return;
+    call->cdr_exported = true;
+
+    // Messages not parsed when stored only have the headers index
+    strings[CDR_STRING_CALLID] = call->callid;
+    strings[CDR_STRING_XCALLID] = call->xcallid;
+    strings[CDR_STRING_SIPFROM] = (first->sip_from) ? first->sip_from : msg_get_attribute(first, SIP_ATTR_SIPFROM, from);
+    strings[CDR_STRING_SIPTO] = (first->sip_to) ? first->sip_to : msg_get_attribute(first, SIP_ATTR_SIPTO, to);
+    strings[CDR_STRING_REASON] = call->reasontxt;
+    strings[CDR_STRING_CODECS] = codecs;
+
+    // Distinct formats of the call RTP streams
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it))) {
+        if (stream->type != PACKET_RTP || !(format = stream_get_format(stream)) || strstr(codecs, format))
+            continue;
+        slen = strlen(codecs);
+        if (slen + strlen(format) + 2 > sizeof(codecs))
+            break;
+        sprintf(codecs + slen, "%s%s", (slen) ? "," : "", format);
+    }
+
+    for (i = 0; i < CDR_STRING_COUNT; i++)
+        len += (strings[i] ? strlen(strings[i]) : 0) + 1;
+    if (len > UINT16_MAX || !(rec = malloc(sizeof(cdr_record_t) + len)))
+        return;
+
+    for (i = 0, len = 0; i < CDR_STRING_COUNT; i++) {
+        slen = strings[i] ? strlen(strings[i]) : 0;
+        rec->offsets[i] = len;
+        memcpy(rec->strings + len, strings[i] ? strings[i] : "", slen + 1);
+        len += slen + 1;
+    }
+
+    rec->index = call->index;
+    rec->state = call->state;
+    rec->warning = call->warning;
+    rec->msgs = call_msg_count(call);
+    rec->reqresp = first->reqresp;
+    rec->transport = first->packet->type;
+    rec->src = first->packet->src;
+    rec->dst = first->packet->dst;
+    rec->start = msg_get_time(first);
+    rec->end = msg_get_time(vector_last(call->msgs));
+    rec->conv_start = msg_get_time(call->cstart_msg);
+    rec->conv_end = msg_get_time(call->cend_msg);
+    rec->quality = call_rtp_quality(call, &rec->loss, &rec->jitter, &rec->mos);
+    rec->streams = 0;
+    rec->rtp_packets = 0;
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it))) {
+        if (stream->type != PACKET_RTP)
+            continue;
+        rec->streams++;
+        rec->rtp_packets += stream->pktcnt;
+    }
+
+    if (ring_push(cdr_cfg.queue, rec) != 0) {
+        cdr_cfg.dropped++;
+        free(rec);
+    }
+}
@@ -0,0 +1,158 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file cdr.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to export dialogs summary records
+ *
+ * In no interface mode, a summary of each dialog can be written to a file
+ * as JSON lines or CSV rows when the dialog reaches a final state or it
+ * is removed from storage. Parser threads only copy the dialog data into
+ * a record, records are formatted and written by a separate thread.
+ */
+#ifndef __SNGREP_CDR_H
+#define __SNGREP_CDR_H
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "address.h"
+#include "ring.h"
+#include "sip_call.h"
+
+//! Max length of the codecs list of a record
+#define CDR_CODECS_LEN 128
+//! Writer thread wait when there are no queued records (us)
+#define CDR_WRITER_WAIT 10000
+
+//! Shorter declaration of cdr_record structure
+typedef struct cdr_record cdr_record_t;
+//! Shorter declaration of cdr_config structure
+typedef struct cdr_config cdr_config_t;
+
+//! Record output formats
+enum cdr_format {
+    CDR_FORMAT_JSON = 0,
+    CDR_FORMAT_CSV,
+};
+
+//! Text values stored in a record
+enum cdr_string {
+    CDR_STRING_CALLID = 0,
+    CDR_STRING_XCALLID,
+    CDR_STRING_SIPFROM,
+    CDR_STRING_SIPTO,
+    CDR_STRING_REASON,
+    CDR_STRING_CODECS,
+    CDR_STRING_COUNT
+};
+
+/**
+ * @brief Dialog data copied when its record is exported
+ *
+ * Values are stored unformatted. Text values are stored one after
+ * another at the end of the record.
+ */
+struct cdr_record {
+    //! Call index in the call list
+    int index;
+    //! Call state
+    int state;
+    //! Warning header code
+    int warning;
+    //! Number of messages
+    int msgs;
+    //! Method or response code of the first message
+    int reqresp;
+    //! Packet type of the first message
+    int transport;
+    //! Source and destination of the first message
+    address_t src, dst;
+    //! Times of first and last messages
+    struct timeval start, end;
+    //! Times of conversation start and end messages (0 if none)
+    struct timeval conv_start, conv_end;
+    //! RTP streams and their packets
+    int streams;
+    uint64_t rtp_packets;
+    //! Worst RTP streams quality values (only if quality is set)
+    double loss, jitter, mos;
+    //! Streams with received packets used for quality values
+    int quality;
+    //! Offset of each text value in strings
+    uint16_t offsets[CDR_STRING_COUNT];
+    //! Text values (NULL terminated)
+    char strings[];
+};
+
+/**
+ * @brief Dialogs records exporter configuration and status
+ */
+struct cdr_config {
+    //! Output file (NULL if exporter is disabled)
+    FILE *out;
+    //! Records output format
+    enum cdr_format format;
+    //! Records waiting to be written
+    ring_t *queue;
+    //! Thread writing queued records
+    pthread_t writer;
+    //! Writer thread must keep writing records
+    bool running;
+    //! Records not exported because the queue was full
+    uint64_t dropped;
+};
+
+/**
+ * @brief Open the dialogs records file and start the writer thread
+ *
+ * Exporter is only enabled if cdr.file setting has a value
+ *
+ * @return 0 if exporter is disabled or has been started, 1 otherwise
+ */
+int
+cdr_init();
+
+/**
+ * @brief Export remaining dialogs and close the records file
+ *
+ * All queued records are written before returning.
+ */
+void
+cdr_deinit();
+
+/**
+ * @brief Queue the summary record of a dialog
+ *
+ * Each dialog is only exported once. This must be called with
+ * the capture lock.
+ *
+ * @param call Finished or removed dialog
+ */
+void
+cdr_export_call(sip_call_t *call);
+
+#endif /* __SNGREP_CDR_H */
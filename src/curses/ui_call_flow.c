@@ -100,6 +100,13 @@ call_flow_create(ui_t *ui)
     info->columns = vector_create(2, 1);
     info->arrows = vector_create(20, 5);
     vector_set_sorter(info->arrows, call_flow_arrow_sorter);
+    vector_set_destroyer(info->arrows, vector_generic_destroyer);
+
+    // Create indexes for columns and arrows
+    info->columns_index = htable_create(16);
+    info->columns_keys = vector_create(10, 10);
+    vector_set_destroyer(info->columns_keys, vector_generic_destroyer);
+    info->arrows_index = htable_create(256);
 
     // Store it into panel userptr
     set_panel_userptr(ui->panel, (void*) info);
@@ -116,6 +123,11 @@ call_flow_destroy(ui_t *ui)
         vector_destroy_items(info->columns);
         // Delete panel arrows
         vector_destroy_items(info->arrows);
+        // Delete panel indexes
+        htable_destroy(info->columns_index);
+        vector_destroy(info->columns_keys);
+        htable_destroy(info->arrows_index);
+        free(info->msgs_added);
         // Delete panel windows
         delwin(info->flow_win);
         delwin(info->raw_win);
@@ -172,6 +184,9 @@ call_flow_draw(ui_t *ui)
     // Get window of main panel
     werase(ui->win);
 
+    // Create arrows for new messages and streams
+    call_flow_update(ui);
+
     // Set title
     if (info->group->callid) {
         sprintf(title, "Extended Call flow for %s", info->group->callid);
@@ -208,13 +223,13 @@ call_flow_draw(ui_t *ui)
     // Draw the scrollbar
     vector_iter_t it = vector_iterator(info->darrows);
     call_flow_arrow_t *arrow = NULL;
-    info->scroll.max = info->scroll.pos = 0;
+    info->scroll.max = info->arrows_height;
+    info->scroll.pos = 0;
     while ((arrow = vector_iterator_next(&it))) {
         // Store current position arrow
-        if (vector_iterator_current(&it) == info->first_arrow) {
-            info->scroll.pos = info->scroll.max;
-        }
-        info->scroll.max += call_flow_arrow_height(ui, arrow);
+        if (vector_iterator_current(&it) == info->first_arrow)
+            break;
+        info->scroll.pos += arrow->height;
     }
     ui_scrollbar_draw(info->scroll);
 
@@ -248,19 +263,62 @@ call_flow_draw_footer(ui_t *ui)
     ui_draw_bindings(ui, keybindings, 22);
 }
 
-int
-call_flow_draw_columns(ui_t *ui)
+/**
+ * @brief Create the arrow of a message or stream and its columns
+ *
+ * @param ui UI structure pointer
+ * @param item Message or stream of the arrow
+ * @param type Type of arrow as defined in enum @call_flow_arrow_type
+ */
+static void
+call_flow_arrow_add(ui_t *ui, void *item, int type)
 {
-    call_flow_info_t *info;
-    call_flow_column_t *column;
-    sip_call_t *call = NULL;
+    call_flow_info_t *info = call_flow_info(ui);
+    call_flow_arrow_t *arrow;
+    sip_msg_t *msg;
     rtp_stream_t *stream;
-    sip_msg_t *msg = NULL;
-    vector_iter_t streams;
-    vector_iter_t columns;
-    char coltext[MAX_SETTING_LEN];
     address_t addr;
 
+    if (!item || call_flow_arrow_find(ui, item))
+        return;
+
+    if (!(arrow = call_flow_arrow_create(ui, item, type)))
+        return;
+
+    // Store the arrow in the time sorted list
+    arrow->height = call_flow_arrow_height(ui, arrow);
+    info->arrows_height += arrow->height;
+    vector_append(info->arrows, arrow);
+
+    // Add required columns for this arrow
+    if (type == CF_ARROW_SIP) {
+        msg = item;
+        call_flow_column_add(ui, msg->call->callid, msg->packet->src);
+        call_flow_column_add(ui, msg->call->callid, msg->packet->dst);
+    } else if (!setting_disabled(SETTING_CF_MEDIA)) {
+        stream = item;
+        addr = stream->src;
+        addr.port = 0;
+        call_flow_column_add(ui, NULL, addr);
+        addr = stream->dst;
+        addr.port = 0;
+        call_flow_column_add(ui, NULL, addr);
+    }
+}
+
+void
+call_flow_update(ui_t *ui)
+{
+    call_flow_info_t *info;
+    call_flow_arrow_t *arrow;
+    sip_call_t *call;
+    sip_msg_t *msg = NULL;
+    rtp_stream_t *stream;
+    vector_iter_t it;
+    char mode[80];
+    int *added;
+    int i, j, count;
+
     // Get panel information
     info = call_flow_info(ui);
 
@@ -271,29 +329,79 @@ call_flow_draw_columns(ui_t *ui)
         info->maxcallids = 2;
     }
 
-    // Load columns
-    while((msg = call_group_get_next_msg(info->group, msg))) {
-        call_flow_column_add(ui, msg->call->callid, msg->packet->src);
-        call_flow_column_add(ui, msg->call->callid, msg->packet->dst);
+    // Display settings have changed, calculate arrows height again
+    snprintf(mode, sizeof(mode), "%.20s %.20s %.20s",
+             setting_get_value(SETTING_CF_SDP_INFO),
+             setting_get_value(SETTING_CF_MEDIA),
+             setting_get_value(SETTING_CF_ONLYMEDIA));
+    if (strcmp(mode, info->arrows_mode)) {
+        strcpy(info->arrows_mode, mode);
+        info->arrows_height = 0;
+        it = vector_iterator(info->arrows);
+        while ((arrow = vector_iterator_next(&it))) {
+            arrow->height = call_flow_arrow_height(ui, arrow);
+            info->arrows_height += arrow->height;
+        }
     }
 
-    // Add RTP columns FIXME Really
-    if (!setting_disabled(SETTING_CF_MEDIA)) {
-        while ((call = call_group_get_next(info->group, call)) ) {
-            streams = vector_iterator(call->streams);
-
-            while ((stream = vector_iterator_next(&streams))) {
-                if (stream->type == PACKET_RTP && stream_get_count(stream)) {
-                    addr = stream->src;
-                    addr.port = 0;
-                    call_flow_column_add(ui, NULL, addr);
-                    addr = stream->dst;
-                    addr.port = 0;
-                    call_flow_column_add(ui, NULL, addr);
-                }
+    if (!info->msgs_added) {
+        // Create arrows in chronological order for existing messages
+        while ((msg = call_group_get_next_msg(info->group, msg)))
+            call_flow_arrow_add(ui, msg, CF_ARROW_SIP);
+
+        // Store how many messages of each call have been added
+        info->msgs_calls = call_group_count(info->group);
+        if ((info->msgs_added = malloc(sizeof(int) * (info->msgs_calls + 1)))) {
+            for (i = 0; i < info->msgs_calls; i++)
+                info->msgs_added[i] = call_msg_count(vector_item(info->group->calls, i));
+        }
+    } else {
+        // Extended flows can have new calls
+        if (call_group_count(info->group) > info->msgs_calls) {
+            if (!(added = realloc(info->msgs_added, sizeof(int) * call_group_count(info->group))))
+                return;
+            info->msgs_added = added;
+            for (i = info->msgs_calls; i < call_group_count(info->group); i++)
+                info->msgs_added[i] = 0;
+            info->msgs_calls = call_group_count(info->group);
+        }
+
+        // Only create arrows for new messages
+        for (i = 0; i < info->msgs_calls; i++) {
+            call = vector_item(info->group->calls, i);
+            count = call_msg_count(call);
+            for (j = info->msgs_added[i]; j < count; j++) {
+                msg = sip_parse_msg(vector_item(call->msgs, j));
+                if (info->group->sdp_only && !msg_has_sdp(msg))
+                    continue;
+                call_flow_arrow_add(ui, msg, CF_ARROW_SIP);
             }
+            info->msgs_added[i] = count;
+        }
+    }
+
+    // Create arrows for streams with packets
+    for (i = 0; i < call_group_count(info->group); i++) {
+        call = vector_item(info->group->calls, i);
+        it = vector_iterator(call->streams);
+        while ((stream = vector_iterator_next(&it))) {
+            if (stream->type == PACKET_RTP && stream_get_count(stream))
+                call_flow_arrow_add(ui, stream, CF_ARROW_RTP);
         }
     }
+}
+
+int
+call_flow_draw_columns(ui_t *ui)
+{
+    call_flow_info_t *info;
+    call_flow_column_t *column;
+    vector_iter_t columns;
+    char coltext[MAX_SETTING_LEN];
+    char colip[ADDRESSLEN];
+
+    // Get panel information
+    info = call_flow_info(ui);
 
     // Draw columns
     columns = vector_iterator(info->columns);
@@ -308,10 +416,13 @@ call_flow_draw_columns(ui_t *ui)
                 wattron(ui->win, A_BOLD);
         }
 
+        // Get column address text representation
+        address_get_ip(column->addr, colip);
+
         if (setting_enabled(SETTING_CF_SPLITCALLID) || !column->addr.port) {
             snprintf(coltext, MAX_SETTING_LEN, "%s", column->alias);
         } else if (setting_enabled(SETTING_DISPLAY_ALIAS)) {
-            if (strlen(column->addr.ip) > 15) {
+            if (strlen(colip) > 15) {
                 snprintf(coltext, MAX_SETTING_LEN, "..%.*s:%u",
                          MAX_SETTING_LEN - 7, column->alias + strlen(column->alias) - 13, column->addr.port);
             } else {
@@ -319,12 +430,12 @@ call_flow_draw_columns(ui_t *ui)
                          MAX_SETTING_LEN - 7, column->alias, column->addr.port);
             }
         } else {
-            if (strlen(column->addr.ip) > 15) {
+            if (strlen(colip) > 15) {
                 snprintf(coltext, MAX_SETTING_LEN, "..%.*s:%u",
-                         MAX_SETTING_LEN - 7, column->addr.ip + strlen(column->addr.ip) - 13, column->addr.port);
+                         MAX_SETTING_LEN - 7, colip + strlen(colip) - 13, column->addr.port);
             } else {
                 snprintf(coltext, MAX_SETTING_LEN, "%.*s:%u",
-                         MAX_SETTING_LEN - 7, column->addr.ip, column->addr.port);
+                         MAX_SETTING_LEN - 7, colip, column->addr.port);
             }
         }
 
@@ -345,23 +456,6 @@ call_flow_draw_arrows(ui_t *ui)
     // Get panel information
     info = call_flow_info(ui);
 
-    // Create pending SIP arrows
-    sip_msg_t *msg = NULL;
-    while ((msg = call_group_get_next_msg(info->group, msg))) {
-        if (!call_flow_arrow_find(ui, msg)) {
-            arrow = call_flow_arrow_create(ui, msg, CF_ARROW_SIP);
-            vector_append(info->arrows, arrow);
-        }
-    }
-    // Create pending RTP arrows
-    rtp_stream_t *stream = NULL;
-    while ((stream = call_group_get_next_stream(info->group, stream))) {
-        if (!call_flow_arrow_find(ui, stream)) {
-            arrow = call_flow_arrow_create(ui, stream, CF_ARROW_RTP);
-            vector_append(info->arrows, arrow);
-        }
-    }
-
     // Copy displayed arrows
     // vector_destroy(info->darrows);
     //info->darrows = vector_copy_if(info->arrows, call_flow_arrow_filter);
@@ -430,6 +524,7 @@ call_flow_draw_message(ui_t *ui, call_flow_arrow_t *arrow, int cline)
     address_t src;
     address_t dst;
     char method[80];
+    char mediaip[ADDRESSLEN];
     char delta[15] = {};
     int flowh, floww;
     char mediastr[40];
@@ -449,9 +544,6 @@ call_flow_draw_message(ui_t *ui, call_flow_arrow_t *arrow, int cline)
     // Store arrow start line
     arrow->line = cline;
 
-    // Calculate how many lines this message requires
-    arrow->height = call_flow_arrow_height(ui, arrow);
-
     // Check this message fits on the panel
     if (cline > flowh + arrow->height)
         return 0;
@@ -486,12 +578,12 @@ call_flow_draw_message(ui_t *ui, call_flow_arrow_t *arrow, int cline)
     if (msg_has_sdp(msg) && setting_has_value(SETTING_CF_SDP_INFO, "first")) {
         sprintf(method, "%.3s (%s:%u)",
                 msg_method,
-                media->address.ip,
+                address_get_ip(media->address, mediaip),
                 media->address.port);
     }
 
     if (msg_has_sdp(msg) && setting_has_value(SETTING_CF_SDP_INFO, "full")) {
-        sprintf(method, "%.3s (%s)", msg_method, media->address.ip);
+        sprintf(method, "%.3s (%s)", msg_method, address_get_ip(media->address, mediaip));
     }
 
     // Draw message type or status and line
@@ -672,7 +764,7 @@ call_flow_draw_rtp_stream(ui_t *ui, call_flow_arrow_t *arrow, int cline)
 {
     call_flow_info_t *info;
     WINDOW *win;
-    char text[50], time[20];
+    char text[100], quality[50], time[20];
     int height, width;
     const char *callid;
     rtp_stream_t *stream = arrow->item;
@@ -690,9 +782,6 @@ call_flow_draw_rtp_stream(ui_t *ui, call_flow_arrow_t *arrow, int cline)
     // Store arrow start line
     arrow->line = cline;
 
-    // Calculate how many lines this message requires
-    arrow->height = call_flow_arrow_height(ui, arrow);
-
     // Check this media fits on the panel
     if (cline > height + arrow->height)
         return 0;
@@ -700,6 +789,11 @@ call_flow_draw_rtp_stream(ui_t *ui, call_flow_arrow_t *arrow, int cline)
     // Get arrow text
     sprintf(text, "RTP (%s) %d", stream_get_format(stream), stream_get_count(stream));
 
+    // Get stream quality text
+    quality[0] = '\0';
+    if (stream->type == PACKET_RTP && stream_get_count(stream))
+        sprintf(quality, " L:%.1f%% J:%.1fms", stream_get_loss(stream), stream_get_jitter(stream));
+
     // Get message data
     call = stream->media->msg->call;
     callid = call->callid;
@@ -814,6 +908,12 @@ call_flow_draw_rtp_stream(ui_t *ui, call_flow_arrow_t *arrow, int cline)
         }
     }
 
+    // Add stream quality if it fits between columns (or only its loss)
+    if (strlen(quality) && strlen(text) + strlen(quality) >= (size_t) distance)
+        *strstr(quality, " J:") = '\0';
+    if (strlen(text) + strlen(quality) < (size_t) distance)
+        strcat(text, quality);
+
     // Check if displayed stream is active
     int active = stream_is_active(stream);
 
@@ -890,10 +990,15 @@ call_flow_arrow_create(ui_t *ui, void *item, int type)
     info = call_flow_info(ui);
 
     // Create a new arrow of the given type
-    arrow = malloc(sizeof(call_flow_arrow_t));
+    if (!(arrow = malloc(sizeof(call_flow_arrow_t))))
+        return NULL;
     memset(arrow, 0, sizeof(call_flow_arrow_t));
     arrow->type = type;
     arrow->item = item;
+
+    // Index the arrow by its item
+    sprintf(arrow->key, "%p", item);
+    htable_insert(info->arrows_index, arrow->key, arrow);
     return arrow;
 }
 
@@ -928,8 +1033,7 @@ call_flow_arrow_t *
 call_flow_arrow_find(ui_t *ui, const void *data)
 {
     call_flow_info_t *info;
-    call_flow_arrow_t *arrow;
-    vector_iter_t arrows;
+    char key[24];
 
     if (!data)
         return NULL;
@@ -937,12 +1041,8 @@ call_flow_arrow_find(ui_t *ui, const void *data)
     if (!(info = call_flow_info(ui)))
         return NULL;
 
-    arrows = vector_iterator(info->arrows);
-    while ((arrow = vector_iterator_next(&arrows)))
-        if (arrow->item == data)
-            return arrow;
-
-    return arrow;
+    sprintf(key, "%p", data);
+    return htable_find(info->arrows_index, key);
 }
 
 sip_msg_t *
@@ -1350,6 +1450,12 @@ call_flow_set_group(sip_call_group_t *group)
 
     vector_clear(info->columns);
     vector_clear(info->arrows);
+    htable_clear(info->columns_index);
+    vector_clear(info->columns_keys);
+    htable_clear(info->arrows_index);
+    info->arrows_height = 0;
+    free(info->msgs_added);
+    info->msgs_added = NULL;
 
     info->group = group;
     info->cur_arrow = info->selected = -1;
@@ -1357,12 +1463,40 @@ call_flow_set_group(sip_call_group_t *group)
     return 0;
 }
 
+/**
+ * @brief Add a column to the columns index
+ *
+ * @param ui UI structure pointer
+ * @param callid Call-Id header of SIP payload
+ * @param addr Address:port of the column
+ * @param column Column to be indexed
+ */
+static void
+call_flow_column_index(ui_t *ui, const char *callid, address_t addr, call_flow_column_t *column)
+{
+    call_flow_info_t *info = call_flow_info(ui);
+    char ip[ADDRESSLEN];
+    char *key;
+
+    // Only columns with Call-Id and port are searched in the index
+    if (!callid || !addr.port)
+        return;
+
+    if (!(key = malloc(strlen(callid) + ADDRESSLEN + 8)))
+        return;
+
+    sprintf(key, "%s %s:%u", callid, address_get_ip(addr, ip), addr.port);
+    vector_append(info->columns_keys, key);
+    htable_insert(info->columns_index, key, column);
+}
+
 void
 call_flow_column_add(ui_t *ui, const char *callid, address_t addr)
 {
     call_flow_info_t *info;
     call_flow_column_t *column;
     vector_iter_t columns;
+    char ip[ADDRESSLEN];
 
     if (!(info = call_flow_info(ui)))
         return;
@@ -1376,6 +1510,7 @@ call_flow_column_add(ui_t *ui, const char *callid, address_t addr)
         if (addressport_equals(column->addr, addr)) {
             if (column->colpos != 0 && vector_count(column->callids) < info->maxcallids) {
                 vector_append(column->callids, (void*)callid);
+                call_flow_column_index(ui, callid, addr, column);
                 return;
             }
         }
@@ -1387,9 +1522,10 @@ call_flow_column_add(ui_t *ui, const char *callid, address_t addr)
     column->callids = vector_create(1, 1);
     vector_append(column->callids, (void*)callid);
     column->addr = addr;
-    strcpy(column->alias, get_alias_value(addr.ip));
+    strcpy(column->alias, get_alias_value(address_get_ip(addr, ip)));
     column->colpos = vector_count(info->columns);
     vector_append(info->columns, column);
+    call_flow_column_index(ui, callid, addr, column);
 }
 
 call_flow_column_t *
@@ -1398,39 +1534,38 @@ call_flow_column_get(ui_t *ui, const char *callid, address_t addr)
     call_flow_info_t *info;
     call_flow_column_t *column;
     vector_iter_t columns;
-    int match_port;
     const char *alias;
+    char ip[ADDRESSLEN];
+    char key[MAX_SETTING_LEN + ADDRESSLEN + 8];
 
     if (!(info = call_flow_info(ui)))
         return NULL;
 
-    // Look for address or address:port ?
-    match_port = addr.port != 0;
+    // In compressed mode, we search using alias instead of address
+    if (setting_enabled(SETTING_CF_SPLITCALLID)) {
+        alias = get_alias_value(address_get_ip(addr, ip));
+        columns = vector_iterator(info->columns);
+        while ((column = vector_iterator_next(&columns))) {
+            if (!strcmp(column->alias, alias)) {
+                return column;
+            }
+        }
+        return NULL;
+    }
 
-    // Get alias value for given address
-    alias = get_alias_value(addr.ip);
+    // Look for address:port and Call-Id in columns index
+    if (addr.port) {
+        if (!callid)
+            return NULL;
+        snprintf(key, sizeof(key), "%s %s:%u", callid, address_get_ip(addr, ip), addr.port);
+        return htable_find(info->columns_index, key);
+    }
 
+    // Dont check port
     columns = vector_iterator(info->columns);
     while ((column = vector_iterator_next(&columns))) {
-        // In compressed mode, we search using alias instead of address
-        if (setting_enabled(SETTING_CF_SPLITCALLID)) {
-            if (!strcmp(column->alias, alias)) {
-                return column;
-            }
-        } else {
-            // Check if this column matches requested address
-            if (match_port) {
-                if (addressport_equals(column->addr, addr)) {
-                    if (vector_index(column->callids, (void*)callid) >= 0) {
-                        return column;
-                    }
-                }
-            } else {
-                // Dont check port
-                if (address_equals(column->addr, addr)) {
-                    return column;
-                }
-            }
+        if (address_equals(column->addr, addr)) {
+            return column;
         }
     }
     return NULL;
@@ -1492,7 +1627,7 @@ call_flow_move(ui_t *ui, int arrowindex)
         vector_iterator_set_current(&it, info->first_arrow - 1);
         while ((arrow = vector_iterator_next(&it))) {
             // Increase current arrow height position
-            curh += call_flow_arrow_height(ui, arrow);
+            curh += arrow->height;
             // If we have reached current arrow
             if (vector_iterator_current(&it) == info->cur_arrow) {
                 if (curh > flowh) {
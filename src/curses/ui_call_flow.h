@@ -57,6 +57,7 @@
 
 #include <stdbool.h>
 #include "ui_manager.h"
+#include "hash.h"
 #include "group.h"
 #include "scrollbar.h"
 
@@ -93,6 +94,8 @@ struct call_flow_arrow {
     int type;
     //! Item owner of this arrow
     void *item;
+    //! Key of this arrow in the arrows index
+    char key[24];
     //! Stream packet count for this arrow
     int rtp_count;
     //! Stream arrow position
@@ -144,6 +147,16 @@ struct call_flow_info {
     sip_call_group_t *group;
     //! List of arrows (call_flow_arrow_t *)
     vector_t *arrows;
+    //! Arrows indexed by their item pointer
+    htable_t *arrows_index;
+    //! Sum of all arrows height
+    int arrows_height;
+    //! Display settings used to calculate arrows height
+    char arrows_mode[80];
+    //! Messages of each group call that already have an arrow
+    int *msgs_added;
+    //! Number of group calls in msgs_added
+    int msgs_calls;
     //! List of displayed arrows
     vector_t *darrows;
     //! First displayed arrow in the list
@@ -156,6 +169,10 @@ struct call_flow_info {
     scrollbar_t scroll;
     //! List of columns in the panel
     vector_t *columns;
+    //! Columns indexed by Call-Id and address
+    htable_t *columns_index;
+    //! Keys of the columns index
+    vector_t *columns_keys;
     //! Max callids per column
     int maxcallids;
     //! Print timestamp next to the arrow
@@ -228,6 +245,17 @@ call_flow_draw(ui_t *ui);
 void
 call_flow_draw_footer(ui_t *ui);
 
+/**
+ * @brief Create arrows and columns for new messages and streams
+ *
+ * Only messages added to the group calls since the last update are
+ * processed. Streams are added once they have packets.
+ *
+ * @param ui UI structure pointer
+ */
+void
+call_flow_update(ui_t *ui);
+
 /**
  * @brief Draw the visible columns in panel window
  *
@@ -300,10 +328,11 @@ call_flow_draw_rtp_stream(ui_t *ui, call_flow_arrow_t *arrow, int cline);
  * @brief Create a new arrow of given type
  *
  * Allocate memory for a new arrow of the given type and associate the
- * item pointer. If the arrow already exists in the ui arrows vector
+ * item pointer. If the arrow already exists in the ui arrows index
  * this function will return that arrow instead of creating a new one.
  *
- * This function WON'T add the arrow to any ui vector.
+ * New arrows are indexed, but this function WON'T add the arrow to
+ * any ui vector.
  *
  * @param ui UI structure pointer
  * @param item Item pointer to associate to the arrow
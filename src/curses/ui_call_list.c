@@ -27,6 +27,7 @@
  *
  */
 #include <stdlib.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
@@ -45,6 +46,7 @@
 #include "ui_filter.h"
 #include "ui_save.h"
 #include "sip.h"
+#include "history.h"
 
 /**
  * Ui Structure definition for Call List panel
@@ -140,7 +142,9 @@ call_list_destroy(ui_t *ui)
 
         // Deallocate group data
         call_group_destroy(info->group);
-        vector_destroy(info->dcalls);
+
+        // Deallocate rendered rows
+        free(info->rows);
 
         // Deallocate panel windows
         delwin(info->list_win);
@@ -159,7 +163,26 @@ call_list_info(ui_t *ui)
 bool
 call_list_redraw(ui_t *ui)
 {
-    return sip_calls_has_changed();
+    call_list_info_t *info;
+    sip_stats_t stats;
+    int listh;
+
+    // Nothing has been captured since last check
+    if (!sip_calls_has_changed())
+        return false;
+
+    // Get panel info
+    info = call_list_info(ui);
+    listh = getmaxy(info->list_win);
+
+    // Check if any of the rows in the screen has changed
+    sip_calls_view_refresh();
+    if (sip_calls_view_changed(info->scroll.pos, info->scroll.pos + listh - 1))
+        return true;
+
+    // Otherwise, only redraw if call counters have changed
+    stats = sip_calls_stats();
+    return stats.total != info->stats.total || stats.displayed != info->stats.displayed;
 }
 
 int
@@ -195,6 +218,9 @@ call_list_draw_header(ui_t *ui)
     char sortind;
     const char *countlb;
     const char *device, *filterexpr, *filterbpf;
+    uint64_t loaded, total, msecs, rate;
+    capture_stats_t capstats;
+    int saved, sample;
 
     // Get panel info
     call_list_info_t *info = call_list_info(ui);
@@ -224,13 +250,47 @@ call_list_draw_header(ui_t *ui)
 #ifdef USE_EEP
     const char *eep_port;
     if ((eep_port = capture_eep_send_port())) {
-        wprintw(ui->win, "[H:%s]", eep_port);
+        if (capture_eep_send_drops())
+            wprintw(ui->win, "[H:%s D:%" PRIu64 "]", eep_port, capture_eep_send_drops());
+        else
+            wprintw(ui->win, "[H:%s]", eep_port);
     }
     if ((eep_port = capture_eep_listen_port())) {
         wprintw(ui->win, "[L:%s]", eep_port);
     }
 #endif
 
+    // Packets dropped because parser was too slow
+    if (capture_queue_drops())
+        wprintw(ui->win, "[D:%u]", capture_queue_drops());
+
+    // Packets dropped by the kernel because capture was too slow
+    capture_stats(&capstats);
+    if (capstats.drops || capstats.ifdrops)
+        wprintw(ui->win, "[K:%" PRIu64 "]", capstats.drops + capstats.ifdrops);
+
+    // Only some dialogs are being stored
+    if ((sample = sip_calls_counters().sample) > 1)
+        wprintw(ui->win, "[S:1/%d]", sample);
+
+    // Rotated dialogs kept in history
+    if (history_count())
+        wprintw(ui->win, "[R:%u]", history_count());
+
+    // Packets written by a background save
+    if ((saved = save_progress()) >= 0)
+        wprintw(ui->win, "[Saving %d%%]", saved);
+
+    // Offline files loading progress and estimated remaining time
+    if (capture_load_progress(&loaded, &total, &msecs) && msecs && total) {
+        rate = loaded * 1000 / msecs;
+        wprintw(ui->win, "[%d%% %.1fMB/s", (int) (loaded * 100 / total), (double) rate / (1024 * 1024));
+        if (rate && total > loaded)
+            wprintw(ui->win, " ETA %d:%02d", (int) ((total - loaded) / rate / 60),
+                    (int) ((total - loaded) / rate % 60));
+        wprintw(ui->win, "]");
+    }
+
     wattroff(ui->win, COLOR_PAIR(CP_GREEN_ON_DEF));
     wattroff(ui->win, COLOR_PAIR(CP_RED_ON_DEF));
 
@@ -306,7 +366,7 @@ call_list_draw_header(ui_t *ui)
     }
 
     // Print calls count (also filtered)
-    sip_stats_t stats = sip_calls_stats();
+    sip_stats_t stats = info->stats = sip_calls_stats();
     mvwprintw(ui->win, 1, 45, "%*s", 30, "");
     if (stats.total != stats.displayed) {
         mvwprintw(ui->win, 1, 45, "%s: %d (%d displayed)", countlb, stats.total, stats.displayed);
@@ -337,17 +397,119 @@ call_list_draw_footer(ui_t *ui)
     ui_draw_bindings(ui, keybindings, 23);
 }
 
+/**
+ * @brief Get an attribute text of a stored call or a history record
+ *
+ * @param call Stored call (NULL for history records)
+ * @param hrow History record number (only if call is NULL)
+ */
+static const char *
+call_list_attr_text(sip_call_t *call, uint32_t hrow, enum sip_attr_id id)
+{
+    return (call) ? call_attr_text(call, id) : history_attr_text(hrow, id);
+}
+
+/**
+ * @brief Render the columns of a call or history record into a row
+ */
+static void
+call_list_row_render(ui_t *ui, call_list_row_t *row, sip_call_t *call, uint32_t hrow, int listw)
+{
+    call_list_info_t *info = call_list_info(ui);
+    const char *coltext;
+    int i, colid, collen, colpos;
+
+    row->colcnt = 0;
+    row->text[0] = '\0';
+
+    colpos = 6;
+    for (i = 0; i < info->columncnt; i++) {
+        // Get current column id
+        colid = info->columns[i].id;
+        // Get current column width
+        collen = info->columns[i].width;
+        // Check if next column fits on window width
+        if (colpos + collen >= listw || colpos + collen >= CALL_LIST_ROW_MAXLEN)
+            break;
+
+        // Get call attribute for current column
+        if (!(coltext = call_list_attr_text(call, hrow, colid)))
+            coltext = "";
+
+        // Add the column text to the existing columns
+        sprintf(row->text + colpos - 6, "%-*.*s ", collen, collen, coltext);
+        row->colors[i] = (*coltext) ? sip_attr_get_color(colid, coltext) : 0;
+        row->colcnt++;
+        colpos += collen + 1;
+    }
+}
+
+/**
+ * @brief Get the rendered columns of a call
+ *
+ * Return the cached row of the call if it has not changed since it was
+ * rendered with current columns layout, or render it again otherwise.
+ *
+ * @param ui UI structure pointer
+ * @param call Call to get its row
+ * @param listw Width of the list window
+ * @return rendered row of the call
+ */
+static call_list_row_t *
+call_list_row_get(ui_t *ui, sip_call_t *call, int listw)
+{
+    call_list_info_t *info = call_list_info(ui);
+    call_list_row_t *row;
+
+    row = &info->rows[call->index & (info->rowcnt - 1)];
+
+    // Cached row is still valid
+    if (row->call == call && row->index == call->index
+        && row->changes == call->changes && row->layout == info->layout)
+        return row;
+
+    row->call = call;
+    row->index = call->index;
+    row->changes = call->changes;
+    row->layout = info->layout;
+    call_list_row_render(ui, row, call, 0, listw);
+
+    return row;
+}
+
+/**
+ * @brief Draw the rendered columns of a row at the given line
+ */
+static void
+call_list_draw_row(ui_t *ui, call_list_row_t *row, int cline, bool current)
+{
+    call_list_info_t *info = call_list_info(ui);
+    int i, collen, colpos;
+
+    mvwprintw(info->list_win, cline, 6, "%s", row->text);
+
+    // Enable attribute colors (if not current one)
+    if (!current) {
+        colpos = 6;
+        for (i = 0; i < row->colcnt; i++) {
+            collen = info->columns[i].width;
+            if (row->colors[i] > 0) {
+                wattron(info->list_win, row->colors[i]);
+                mvwaddnstr(info->list_win, cline, colpos, row->text + colpos - 6, collen);
+                wattroff(info->list_win, row->colors[i]);
+            }
+            colpos += collen + 1;
+        }
+    }
+}
+
 void
 call_list_draw_list(ui_t *ui)
 {
     WINDOW *list_win;
-    int listh, listw, cline = 0;
+    int listh, listw, cline = 0, pos, count;
     struct sip_call *call = NULL;
-    int i, collen;
-    char coltext[SIP_ATTR_MAXLEN];
-    int colid;
-    int colpos;
-    int color;
+    call_list_row_t *row, hrow;
 
     // Get panel info
     call_list_info_t *info = call_list_info(ui);
@@ -356,16 +518,29 @@ call_list_draw_list(ui_t *ui)
     list_win = info->list_win;
     getmaxyx(list_win, listh, listw);
 
+    // Rendered rows depend on list width
+    if (info->layout_width != listw) {
+        info->layout_width = listw;
+        info->layout++;
+    }
+
+    // Keep enough cached rows to scroll a few pages without rendering them again
+    if (info->rowcnt < listh * 2) {
+        free(info->rows);
+        for (info->rowcnt = 64; info->rowcnt < listh * 2; info->rowcnt <<= 1);
+        info->rows = calloc(info->rowcnt, sizeof(call_list_row_t));
+    }
+
     // Store selected call
     if (info->cur_call >= 0)
-        call = vector_item(info->dcalls, info->cur_call);
+        call = sip_calls_view_item(info->cur_call);
 
-    // Get the list of calls that are goint to be displayed
-    vector_destroy(info->dcalls);
-    info->dcalls = vector_copy_if(sip_calls_vector(), filter_check_call);
+    // Update the list of calls that are going to be displayed
+    sip_calls_view_refresh();
+    history_view_refresh();
 
     // If no active call, use the fist one (if exists)
-    if (info->cur_call == -1 && vector_count(info->dcalls)) {
+    if (info->cur_call == -1 && sip_calls_view_count()) {
         info->cur_call = info->scroll.pos = 0;
     }
 
@@ -373,23 +548,20 @@ call_list_draw_list(ui_t *ui)
     if (info->autoscroll)  {
         sip_sort_t sort = sip_sort_options();
         if (sort.asc) {
-            call_list_move(ui, vector_count(info->dcalls) - 1);
+            call_list_move(ui, sip_calls_view_count() - 1);
         } else {
             call_list_move(ui, 0);
         }
     } else if (call) {
-        call_list_move(ui, vector_index(info->dcalls, call));
+        call_list_move(ui, sip_calls_view_index(call));
     }
 
     // Clear call list before redrawing
     werase(list_win);
 
-    // Set the iterator position to the first call
-    vector_iter_t it = vector_iterator(info->dcalls);
-    vector_iterator_set_current(&it, info->scroll.pos - 1);
-
-    // Fill the call list
-    while ((call = vector_iterator_next(&it))) {
+    // Fill the call list starting at the first displayed call
+    count = sip_calls_view_count();
+    for (pos = info->scroll.pos; (call = sip_calls_view_item(pos)); pos++) {
         // Stop if we have reached the bottom of the list
         if (cline == listh)
             break;
@@ -403,7 +575,7 @@ call_list_draw_list(ui_t *ui)
             wattron(list_win, A_BOLD | COLOR_PAIR(CP_DEFAULT));
 
         // Highlight active call
-        if (info->cur_call == vector_iterator_current(&it)) {
+        if (info->cur_call == pos) {
             wattron(list_win, COLOR_PAIR(CP_WHITE_ON_BLUE));
             // Reverse colors on monochrome terminals
             if (!has_colors())
@@ -414,42 +586,9 @@ call_list_draw_list(ui_t *ui)
         // Set current line selection box
         mvwprintw(list_win, cline, 2, call_group_exists(info->group, call) ? "[*]" : "[ ]");
 
-        // Print requested columns
-        colpos = 6;
-        for (i = 0; i < info->columncnt; i++) {
-            // Get current column id
-            colid = info->columns[i].id;
-            // Get current column width
-            collen = info->columns[i].width;
-            // Check if next column fits on window width
-            if (colpos + collen >= listw)
-                break;
-
-            // Initialize column text
-            memset(coltext, 0, sizeof(coltext));
-
-            // Get call attribute for current column
-            if (!call_get_attribute(call, colid, coltext)) {
-                colpos += collen + 1;
-                continue;
-            }
-
-            // Enable attribute color (if not current one)
-            color = 0;
-            if (info->cur_call != vector_iterator_current(&it)) {
-                if ((color = sip_attr_get_color(colid, coltext)) > 0) {
-                    wattron(list_win, color);
-                }
-            }
-
-            // Add the column text to the existing columns
-            mvwprintw(list_win, cline, colpos, "%.*s", collen, coltext);
-            colpos += collen + 1;
-
-            // Disable attribute color
-            if (color > 0)
-                wattroff(list_win, color);
-        }
+        // Get rendered columns of this call
+        row = call_list_row_get(ui, call, listw);
+        call_list_draw_row(ui, row, cline, info->cur_call == pos);
         cline++;
 
         wattroff(list_win, COLOR_PAIR(CP_DEFAULT));
@@ -457,8 +596,29 @@ call_list_draw_list(ui_t *ui)
         wattroff(list_win, A_BOLD | A_REVERSE);
     }
 
+    // Continue with rotated calls after the stored ones
+    for (pos = (pos > count) ? pos : count; cline < listh && pos < count + history_view_count(); pos++) {
+        // Highlight active call
+        if (info->cur_call == pos) {
+            wattron(list_win, COLOR_PAIR(CP_WHITE_ON_BLUE));
+            // Reverse colors on monochrome terminals
+            if (!has_colors())
+                wattron(list_win, A_REVERSE);
+        }
+        // Set current line background (history rows can not be selected)
+        mvwprintw(list_win, cline, 0, "%*s", listw, "");
+        mvwprintw(list_win, cline, 2, " - ");
+
+        call_list_row_render(ui, &hrow, NULL, history_view_item(pos - count), listw);
+        call_list_draw_row(ui, &hrow, cline, info->cur_call == pos);
+        cline++;
+
+        wattroff(list_win, COLOR_PAIR(CP_WHITE_ON_BLUE));
+        wattroff(list_win, A_REVERSE);
+    }
+
     // Draw scrollbar to the right
-    info->scroll.max = vector_count(info->dcalls);
+    info->scroll.max = count + history_view_count();
     ui_scrollbar_draw(info->scroll);
 
     // Refresh the list
@@ -512,11 +672,14 @@ call_list_form_activate(ui_t *ui, int active)
     form_driver(info->form, REQ_END_LINE);
 }
 
-const char *
-call_list_line_text(ui_t *ui, sip_call_t *call, char *text)
+/**
+ * @brief Get List line of a stored call or a history record
+ */
+static const char *
+call_list_line_attrs(ui_t *ui, sip_call_t *call, uint32_t hrow, char *text)
 {
     int i, collen;
-    char call_attr[SIP_ATTR_MAXLEN];
+    const char *call_attr;
     char coltext[SIP_ATTR_MAXLEN];
     int colid;
 
@@ -542,10 +705,9 @@ call_list_line_text(ui_t *ui, sip_call_t *call, char *text)
 
         // Initialize column text
         memset(coltext, 0, sizeof(coltext));
-        memset(call_attr, 0, sizeof(call_attr));
 
         // Get call attribute for current column
-        if (call_get_attribute(call, colid, call_attr)) {
+        if ((call_attr = call_list_attr_text(call, hrow, colid))) {
             sprintf(coltext, "%.*s", collen, call_attr);
         }
         // Add the column text to the existing columns
@@ -555,6 +717,45 @@ call_list_line_text(ui_t *ui, sip_call_t *call, char *text)
     return text;
 }
 
+const char *
+call_list_line_text(ui_t *ui, sip_call_t *call, char *text)
+{
+    return call_list_line_attrs(ui, call, 0, text);
+}
+
+const char *
+call_list_history_line_text(ui_t *ui, uint32_t row, char *text)
+{
+    return call_list_line_attrs(ui, NULL, row, text);
+}
+
+/**
+ * @brief Show where the packets of the selected rotated call are stored
+ *
+ * Rotated calls only keep their call list attributes.
+ */
+static void
+call_list_history_info(ui_t *ui)
+{
+    call_list_info_t *info = call_list_info(ui);
+    const char *callid;
+    int64_t row, offset;
+    uint32_t file;
+
+    if ((row = history_view_item(info->cur_call - sip_calls_view_count())) < 0)
+        return;
+
+    if (!(callid = history_attr_text(row, SIP_ATTR_CALLID)))
+        callid = "";
+
+    if (history_dump_position(row, &file, &offset) == 0) {
+        dialog_run("Call %s has been rotated. Its packets start at offset %" PRId64
+                   " of dump file %s (file %u).", callid, offset, capture_output_file(), file);
+    } else {
+        dialog_run("Call %s has been rotated. Its packets were not written to a dump file.", callid);
+    }
+}
+
 int
 call_list_handle_key(ui_t *ui, int key)
 {
@@ -610,7 +811,7 @@ call_list_handle_key(ui_t *ui, int key)
                 call_list_move(ui, 0);
                 break;
             case ACTION_END:
-                call_list_move(ui, vector_count(info->dcalls));
+                call_list_move(ui, sip_calls_view_count() + history_view_count());
                 break;
             case ACTION_DISP_FILTER:
                 // Activate Form
@@ -620,18 +821,19 @@ call_list_handle_key(ui_t *ui, int key)
             case ACTION_SHOW_FLOW_EX:
             case ACTION_SHOW_RAW:
                 // Check we have calls in the list
-                if (info->cur_call == -1)
+                if (!(call = sip_calls_view_item(info->cur_call))) {
+                    call_list_history_info(ui);
                     break;
+                }
                 // Create a new group of calls
                 group = call_group_clone(info->group);
 
                 // If not selected call, show current call flow
                 if (call_group_count(info->group) == 0)
-                    call_group_add(group, vector_item(info->dcalls, info->cur_call));
+                    call_group_add(group, call);
 
                 // Add xcall to the group
                 if (action == ACTION_SHOW_FLOW_EX) {
-                    call = vector_item(info->dcalls, info->cur_call);
                     call_group_add_calls(group, call->xcalls);
                     group->callid = call->callid;
                 }
@@ -655,6 +857,9 @@ call_list_handle_key(ui_t *ui, int key)
             case ACTION_SHOW_STATS:
                 ui_create_panel(PANEL_STATS);
                 break;
+            case ACTION_SHOW_KEEPALIVE:
+                ui_create_panel(PANEL_KEEPALIVE);
+                break;
             case ACTION_SAVE:
                 if (capture_sources_count() > 1) {
                     dialog_run("Saving is not possible when multiple input sources are specified.");
@@ -668,12 +873,22 @@ call_list_handle_key(ui_t *ui, int key)
                 vector_clear(info->group->calls);
                 break;
             case ACTION_CLEAR_CALLS:
+                // Saved calls must be kept until written
+                if (save_running()) {
+                    dialog_run("Unable to clear calls while saving.");
+                    break;
+                }
                 // Remove all stored calls
                 sip_calls_clear();
                 // Clear List
                 call_list_clear(ui);
                 break;
             case ACTION_CLEAR_CALLS_SOFT:
+                // Saved calls must be kept until written
+                if (save_running()) {
+                    dialog_run("Unable to clear calls while saving.");
+                    break;
+                }
                 // Remove stored calls, keeping the currently displayed calls
                 sip_calls_clear_soft();
                 // Clear List
@@ -686,7 +901,8 @@ call_list_handle_key(ui_t *ui, int key)
                 ui_create_panel(PANEL_SETTINGS);
                 break;
             case ACTION_SELECT:
-                call = vector_item(info->dcalls, info->cur_call);
+                if (!(call = sip_calls_view_item(info->cur_call)))
+                    break;
                 if (call_group_exists(info->group, call)) {
                     call_group_del(info->group, call);
                 } else {
@@ -986,6 +1202,7 @@ call_list_add_column(ui_t *ui, enum sip_attr_id id, const char* attr,
     info->columns[info->columncnt].title = title;
     info->columns[info->columncnt].width = width;
     info->columncnt++;
+    info->layout++;
     return 0;
 }
 
@@ -1002,6 +1219,9 @@ call_list_clear(ui_t *ui)
     info->scroll.pos = info->cur_call = -1;
     vector_clear(info->group->calls);
 
+    // Call indexes may be reused after clearing, invalidate rendered rows
+    info->layout++;
+
     // Clear Displayed lines
     werase(info->list_win);
 }
@@ -1010,6 +1230,7 @@ void
 call_list_move(ui_t *ui, int line)
 {
     call_list_info_t *info;
+    int count;
 
     // Get panel info
     if (!(info = call_list_info(ui)))
@@ -1019,41 +1240,19 @@ call_list_move(ui_t *ui, int line)
     if (info->cur_call == line)
         return;
 
-    // Moving down or up?
-    bool move_down = (info->cur_call < line);
-
-    vector_iter_t it = vector_iterator(info->dcalls);
-    vector_iterator_set_current(&it, info->cur_call);
-
-    if (move_down) {
-        while (info->cur_call < line) {
-            // Check if there is a call below us
-            if (!vector_iterator_next(&it))
-               break;
-
-            // Increase current call position
-            info->cur_call++;
-
-            // If we are out of the bottom of the displayed list
-            // refresh it starting in the next call
-            if (info->cur_call - info->scroll.pos == getmaxy(info->list_win)) {
-               info->scroll.pos++;
-            }
-        }
-    } else {
-        while (info->cur_call > line) {
-            // Check if there is a call above us
-            if (!vector_iterator_prev(&it))
-              break;
-            // If we are out of the top of the displayed list
-            // refresh it starting in the previous (in fact current) call
-            if (info->cur_call ==  info->scroll.pos) {
-              info->scroll.pos--;
-            }
-            // Move current call position
-            info->cur_call--;
-        }
-    }
+    // Only move to displayed calls (rotated calls are displayed after stored ones)
+    count = sip_calls_view_count() + history_view_count();
+    if (line >= count)
+        line = count - 1;
+    if (line < 0 && count)
+        line = 0;
+    info->cur_call = line;
+
+    // If we are out of the displayed list, refresh it starting in current call
+    if (info->cur_call - info->scroll.pos >= getmaxy(info->list_win))
+        info->scroll.pos = info->cur_call - getmaxy(info->list_win) + 1;
+    if (info->cur_call < info->scroll.pos)
+        info->scroll.pos = info->cur_call;
 }
 
 void
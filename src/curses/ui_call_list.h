@@ -48,9 +48,14 @@ enum call_list_field_list {
 
 //! Sorter declaration of call_list_column struct
 typedef struct call_list_column call_list_column_t;
+//! Sorter declaration of call_list_row struct
+typedef struct call_list_row call_list_row_t;
 //! Sorter declaration of call_list_info struct
 typedef struct call_list_info call_list_info_t;
 
+//! Max rendered length of a cached call list row
+#define CALL_LIST_ROW_MAXLEN 1024
+
 /**
  * @brief Call List column information
  *
@@ -65,6 +70,29 @@ struct call_list_column {
     int width;
 };
 
+/**
+ * @brief Rendered call list row
+ *
+ * Columns text and colors of a displayed call. Rows are reused while the
+ * call has no changes and the columns layout remains the same.
+ */
+struct call_list_row {
+    //! Call whose columns are rendered
+    sip_call_t *call;
+    //! Call index when rendered
+    int index;
+    //! Call changes counter when rendered
+    uint32_t changes;
+    //! Columns layout generation when rendered
+    int layout;
+    //! Number of columns that fit in the row
+    int colcnt;
+    //! Columns text, padded to their width and separated by spaces
+    char text[CALL_LIST_ROW_MAXLEN];
+    //! Attribute color of each column
+    int colors[SIP_ATTR_COUNT];
+};
+
 /**
  * @brief Call List panel status information
  *
@@ -72,8 +100,6 @@ struct call_list_column {
  * panel pointer.
  */
 struct call_list_info {
-    //! Displayed calls vector
-    vector_t *dcalls;
     //! Selected call in the list
     int cur_call;
     //! Selected calls with space
@@ -100,6 +126,16 @@ struct call_list_info {
     int autoscroll;
     //! List scrollbar
     scrollbar_t scroll;
+    //! Call counters displayed in the last draw
+    sip_stats_t stats;
+    //! Rendered rows cache, indexed by call index
+    call_list_row_t *rows;
+    //! Number of rows in the cache (always a power of two)
+    int rowcnt;
+    //! Columns layout generation, changes invalidate all cached rows
+    int layout;
+    //! List width used to render cached rows
+    int layout_width;
 };
 
 /**
@@ -231,6 +267,17 @@ call_list_form_activate(ui_t *ui, int active);
 const char*
 call_list_line_text(ui_t *ui, sip_call_t *call, char *text);
 
+/**
+ * @brief Get List line from the given history record
+ *
+ * @param ui UI structure pointer
+ * @param row History record number
+ * @param text Text pointer to store the generated line
+ * @return A pointer to text
+ */
+const char*
+call_list_history_line_text(ui_t *ui, uint32_t row, char *text);
+
 /**
  * @brief Handle Call list key strokes
  *
@@ -61,8 +61,6 @@ call_raw_create(ui_t *ui)
     // Store it into panel userptr
     set_panel_userptr(ui->panel, (void*) info);
 
-    // Create a initial pad of 1000 lines
-    info->pad = newpad(500, COLS);
     info->padline = 0;
     info->scroll = 0;
 }
@@ -73,8 +71,8 @@ call_raw_destroy(ui_t *ui)
     call_raw_info_t *info;
 
     if ((info = call_raw_info(ui))) {
-        // Delete panel windows
-        delwin(info->pad);
+        // Delete messages positions
+        free(info->lines);
         sng_free(info);
     }
     ui_panel_destroy(ui);
@@ -97,26 +95,101 @@ call_raw_redraw(ui_t *ui)
 
 }
 
+/**
+ * @brief Print a message in the panel window
+ *
+ * @param ui UI structure pointer
+ * @param line Message position in the panel
+ * @param cline Window line of the message header (may be negative)
+ */
+static void
+call_raw_draw_msg(ui_t *ui, call_raw_line_t *line, int cline)
+{
+    call_raw_info_t *info = call_raw_info(ui);
+    sip_msg_t *msg = line->msg;
+    // Message ngrep style Header
+    char header[256];
+    int color = 0;
+
+    // Color the message {
+    if (setting_has_value(SETTING_COLORMODE, "request")) {
+        // Determine arrow color
+        if (msg_is_request(msg)) {
+            color = CP_RED_ON_DEF;
+        } else {
+            color = CP_GREEN_ON_DEF;
+        }
+    } else if (info->group && setting_has_value(SETTING_COLORMODE, "callid")) {
+        // Color by call-id
+        color = call_group_color(info->group, msg->call);
+    } else if (setting_has_value(SETTING_COLORMODE, "cseq")) {
+        // Color by CSeq within the same call
+        color = msg->cseq % 7 + 1;
+    }
+
+    // Turn on the message color
+    wattron(ui->win, COLOR_PAIR(color));
+
+    // Print msg header
+    if (cline >= 0) {
+        wattron(ui->win, A_BOLD);
+        mvwprintw(ui->win, cline, 0, "%s", sip_get_msg_header(msg, header));
+        wattroff(ui->win, A_BOLD);
+    }
+
+    // Print msg payload
+    if (cline + 1 >= 0) {
+        draw_message_skip(ui->win, msg, cline + 1, 0);
+    } else {
+        draw_message_skip(ui->win, msg, 0, -(cline + 1));
+    }
+
+    // Turn off the message color
+    wattroff(ui->win, COLOR_PAIR(color));
+}
+
 int
 call_raw_draw(ui_t *ui)
 {
     call_raw_info_t *info;
     sip_msg_t *msg = NULL;
+    int first, last, middle;
 
     // Get panel information
     if(!(info = call_raw_info(ui)))
         return -1;
 
     if (info->group) {
-        // Print the call group messages into the pad
+        // Messages positions depend on panel width
+        if (info->width != ui->width)
+            call_raw_set_group(info->group);
+        // Add the call group messages into the panel
         while ((msg = call_group_get_next_msg(info->group, info->last)))
             call_raw_print_msg(ui, msg);
     } else {
         call_raw_set_msg(info->msg);
     }
 
-    // Copy the visible part of the pad into the panel window
-    copywin(info->pad, ui->win, info->scroll, 0, 0, 0, ui->height - 1, ui->width - 1, 0);
+    // Find the first message in the visible part of the panel
+    first = 0;
+    last = info->linecnt - 1;
+    while (first < last) {
+        middle = (first + last + 1) / 2;
+        if (info->lines[middle].line > info->scroll) {
+            last = middle - 1;
+        } else {
+            first = middle;
+        }
+    }
+
+    // Print only the visible messages
+    werase(ui->win);
+    for (; first < info->linecnt; first++) {
+        if (info->lines[first].line - info->scroll >= ui->height)
+            break;
+        call_raw_draw_msg(ui, &info->lines[first], info->lines[first].line - info->scroll);
+    }
+
     touchwin(ui->win);
     return 0;
 }
@@ -125,77 +198,26 @@ int
 call_raw_print_msg(ui_t *ui, sip_msg_t *msg)
 {
     call_raw_info_t *info;
-    int payload_lines, i, column, height, width;
-    // Message ngrep style Header
-    char header[256];
-    char payload[MAX_SIP_PAYLOAD];
-    int color = 0;
+    call_raw_line_t *line;
 
     // Get panel information
     if (!(info = call_raw_info(ui)))
         return -1;
 
-    // Get the pad window
-    WINDOW *pad = info->pad;
-
-    // Get current pad dimensions
-    getmaxyx(pad, height, width);
-
-    // Get message payload
-    strcpy(payload, msg_get_payload(msg));
-
-    // Check how many lines we well need to draw this message
-    payload_lines = 0;
-    column = 0;
-    for (i = 0; i < strlen(payload); i++) {
-        if (column == width || payload[i] == '\n') {
-            payload_lines++;
-            column = 0;
-            continue;
-        }
-        column++;
-    }
-
-    // Check if we have enough space in our huge pad to store this message
-    if (info->padline + payload_lines > height) {
-        // Create a new pad with more lines!
-        pad = newpad(height + 500, COLS);
-        // And copy all previous information
-        overwrite(info->pad, pad);
-        // Delete previous pad
-        delwin(info->pad);
-        // And store the new pad
-        info->pad = pad;
-    }
-
-    // Color the message {
-    if (setting_has_value(SETTING_COLORMODE, "request")) {
-        // Determine arrow color
-        if (msg_is_request(msg)) {
-            color = CP_RED_ON_DEF;
-        } else {
-            color = CP_GREEN_ON_DEF;
-        }
-    } else if (info->group && setting_has_value(SETTING_COLORMODE, "callid")) {
-        // Color by call-id
-        color = call_group_color(info->group, msg->call);
-    } else if (setting_has_value(SETTING_COLORMODE, "cseq")) {
-        // Color by CSeq within the same call
-        color = msg->cseq % 7 + 1;
+    // Check if we have enough space to store this message position
+    if (info->linecnt == info->linesize) {
+        info->linesize = info->linesize ? info->linesize * 2 : 64;
+        info->lines = realloc(info->lines, sizeof(call_raw_line_t) * info->linesize);
     }
 
-    // Turn on the message color
-    wattron(pad, COLOR_PAIR(color));
+    // Calculate message lines only once
+    line = &info->lines[info->linecnt++];
+    line->msg = msg;
+    line->line = info->padline;
+    line->height = draw_message_lines(msg, ui->width);
 
-    // Print msg header
-    wattron(pad, A_BOLD);
-    mvwprintw(pad, info->padline++, 0, "%s", sip_get_msg_header(msg, header));
-    wattroff(pad, A_BOLD);
-
-    // Print msg payload
-    info->padline += draw_message_pos(pad, msg, info->padline);
-    // Extra line between messages
-    info->padline++;
+    // Header, payload and an extra line between messages
+    info->padline += line->height + 2;
 
     // Set this as the last printed message
     info->last = msg;
@@ -254,16 +276,6 @@ call_raw_handle_key(ui_t *ui, int key)
             case ACTION_CYCLE_COLOR:
                 // Handle colors using default handler
                 ui_default_handle_key(ui, key);
-                // Create a new pad (forces messages draw)
-                delwin(info->pad);
-                info->pad = newpad(500, COLS);
-                info->last = NULL;
-                // Force refresh panel
-                if (info->group) {
-                    call_raw_set_group(info->group);
-                } else {
-                    call_raw_set_msg(info->msg);
-                }
                 break;
             case ACTION_CLEAR_CALLS:
             case ACTION_CLEAR_CALLS_SOFT:
@@ -308,9 +320,11 @@ call_raw_set_group(sip_call_group_t *group)
     info->group = group;
     info->msg = NULL;
 
-    // Initialize internal pad
+    // Initialize messages positions
     info->padline = 0;
-    wclear(info->pad);
+    info->linecnt = 0;
+    info->last = NULL;
+    info->width = ui->width;
 
     return 0;
 }
@@ -334,11 +348,13 @@ call_raw_set_msg(sip_msg_t *msg)
     info->group = NULL;
     info->msg = msg;
 
-    // Initialize internal pad
+    // Initialize messages positions
     info->padline = 0;
-    wclear(info->pad);
+    info->linecnt = 0;
+    info->last = NULL;
+    info->width = ui->width;
 
-    // Print the message in the pad
+    // Add the message to the panel
     call_raw_print_msg(ui, msg);
 
     return 0;
@@ -35,9 +35,26 @@
 #include "config.h"
 #include "ui_manager.h"
 
+//! Sorter declaration of struct call_raw_line
+typedef struct call_raw_line call_raw_line_t;
 //! Sorter declaration of struct call_raw_info
 typedef struct call_raw_info call_raw_info_t;
 
+/**
+ * @brief Position of a message in the panel
+ *
+ * Messages are not printed until they are in the visible part of the
+ * panel. This stores the lines each message requires once.
+ */
+struct call_raw_line {
+    //! Printed message
+    sip_msg_t *msg;
+    //! First line of the message in the panel
+    int line;
+    //! Number of payload lines of the message
+    int height;
+};
+
 /**
  * @brief Call raw status information
  *
@@ -51,11 +68,17 @@ struct call_raw_info {
     sip_msg_t *msg;
     //! Last printed message on panel (Call raw display)
     sip_msg_t *last;
-    //! Window pad to copy on displayed screen
-    WINDOW *pad;
-    //! Already used lines of the window pad
+    //! Position of printed messages
+    call_raw_line_t *lines;
+    //! Number of printed messages
+    int linecnt;
+    //! Allocated positions for printed messages
+    int linesize;
+    //! Already used lines of the panel
     int padline;
-    //! Scroll position of the window pad
+    //! Width used to calculate messages lines
+    int width;
+    //! Scroll position of the panel
     int scroll;
 };
 
@@ -116,9 +139,10 @@ int
 call_raw_draw(ui_t *ui);
 
 /**
- * @brief Draw a message in call Raw
+ * @brief Add a message in call Raw
  *
- * Draw a new message in the Raw pad.
+ * Calculate the lines required by a new message. Message is printed
+ * only when it is in the visible part of the panel.
  *
  * @param panel Ncurses panel pointer
  * @param msg New message to be printed
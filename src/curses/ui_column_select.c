@@ -35,6 +35,7 @@
 #include "ui_manager.h"
 #include "ui_call_list.h"
 #include "ui_column_select.h"
+#include "filter.h"
 
 /**
  * Ui Structure definition for Message Diff panel
@@ -365,6 +366,10 @@ column_select_update_columns(ui_t *ui)
         call_list_add_column(ui_list, attr_id, sip_attr_get_name(attr_id),
                              sip_attr_get_title(attr_id), sip_attr_get_width(attr_id));
     }
+
+    // Displayed line text has changed, evaluate call list filter again
+    if (filter_get(FILTER_CALL_LIST))
+        filter_reset_calls();
 }
 
 void
@@ -0,0 +1,269 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file ui_keepalive.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in ui_keepalive.h
+ *
+ * +--------------------------------------------------------------------------+
+ * |                          Keepalive Aggregates                            |
+ * |  Entries: 12     Folded messages: 34123                                  |
+ * |                                                                          |
+ * |  Method    Peer                 Peer                 Requests ... Latency|
+ * |  OPTIONS   10.0.0.1:5060        10.0.0.2:5060        1200         12.3ms |
+ * |  REGISTER  10.0.0.5:5060        10.0.0.2:5060        300          40.1ms |
+ * |  ...                                                                     |
+ * |  Last messages                                                           |
+ * |  12:00:01.123456 10.0.0.1:5060 -> 10.0.0.2:5060 OPTIONS sip:... SIP/2.0  |
+ * |  ...                                                                     |
+ * +--------------------------------------------------------------------------+
+ */
+#include "config.h"
+#include <string.h>
+#include <inttypes.h>
+#include "keepalive.h"
+#include "keybinding.h"
+#include "setting.h"
+#include "util.h"
+#include "ui_manager.h"
+#include "ui_keepalive.h"
+
+/**
+ * Ui Structure definition for Keepalive panel
+ */
+ui_t ui_keepalive = {
+    .type = PANEL_KEEPALIVE,
+    .panel = NULL,
+    .create = keepalive_create,
+    .destroy = keepalive_destroy,
+    .redraw = keepalive_redraw,
+    .draw = keepalive_draw,
+    .handle_key = keepalive_handle_key
+};
+
+void
+keepalive_create(ui_t *ui)
+{
+    keepalive_info_t *info;
+
+    // Create a new panel to fill all the screen
+    ui_panel_create(ui, LINES, COLS);
+
+    // Initialize panel specific data
+    info = sng_malloc(sizeof(keepalive_info_t));
+    set_panel_userptr(ui->panel, (void*) info);
+}
+
+void
+keepalive_destroy(ui_t *ui)
+{
+    sng_free(keepalive_info(ui));
+    ui_panel_destroy(ui);
+}
+
+keepalive_info_t *
+keepalive_info(ui_t *ui)
+{
+    return (keepalive_info_t*) panel_userptr(ui->panel);
+}
+
+bool
+keepalive_redraw(ui_t *ui)
+{
+    keepalive_info_t *info = keepalive_info(ui);
+    return info && info->folded != keepalive_folded();
+}
+
+/**
+ * @brief Get the number of rows available for entries
+ */
+static int
+keepalive_list_height(ui_t *ui)
+{
+    int height = ui->height - KEEPALIVE_LIST_ROW - 1;
+
+    // Leave room for selected entry stored messages
+    if (setting_get_intvalue(SETTING_SIP_KEEPALIVE_MSGS) > 0)
+        height -= KEEPALIVE_MSGS_ROWS + 1;
+
+    return (height > 1) ? height : 1;
+}
+
+/**
+ * @brief Format an address with its port
+ */
+static const char *
+keepalive_address(address_t addr, char *out)
+{
+    char ip[ADDRESSLEN];
+    sprintf(out, "%s:%u", address_get_ip(addr, ip), addr.port);
+    return out;
+}
+
+/**
+ * @brief Draw the stored messages of the selected entry
+ *
+ * @param ui UI structure pointer
+ * @param entry Selected aggregate entry
+ * @param row First row of the messages section
+ */
+static void
+keepalive_draw_msgs(ui_t *ui, keepalive_t *entry, int row)
+{
+    keepalive_msg_t *msg;
+    char time[80], src[ADDRESSLEN + 8], dst[ADDRESSLEN + 8];
+    int i, len;
+
+    wattron(ui->win, A_BOLD);
+    mvwprintw(ui->win, row++, 2, "Last messages");
+    wattroff(ui->win, A_BOLD);
+
+    for (i = 0; i < KEEPALIVE_MSGS_ROWS && row < ui->height - 1 && (msg = keepalive_msg(entry, i)); i++) {
+        // Only the first line of each message is displayed
+        len = strcspn(msg->payload, "\r\n");
+        mvwprintw(ui->win, row++, 2, "%-15s %s -> %s %.*s", timeval_to_time(msg->time, time),
+                  keepalive_address(msg->src, src), keepalive_address(msg->dst, dst), len, msg->payload);
+    }
+}
+
+int
+keepalive_draw(ui_t *ui)
+{
+    keepalive_info_t *info;
+    keepalive_t *entry;
+    char src[ADDRESSLEN + 8], dst[ADDRESSLEN + 8], latency[16], time[80];
+    int height, count, i, row;
+
+    if (!(info = keepalive_info(ui)))
+        return -1;
+
+    info->folded = keepalive_folded();
+    count = keepalive_count();
+    height = keepalive_list_height(ui);
+
+    // Keep selected entry visible
+    if (info->cur >= count)
+        info->cur = count - 1;
+    if (info->cur < 0)
+        info->cur = 0;
+    if (info->cur < info->first)
+        info->first = info->cur;
+    if (info->cur >= info->first + height)
+        info->first = info->cur - height + 1;
+
+    werase(ui->win);
+    ui_set_title(ui, "Keepalive Aggregates");
+
+    if (!keepalive_enabled()) {
+        mvwprintw(ui->win, 2, 2, "Keepalive aggregation is disabled. Set %s to enable it.",
+                  setting_name(SETTING_SIP_KEEPALIVE));
+        return 0;
+    }
+
+    mvwprintw(ui->win, 1, 2, "Entries: %d     Folded messages: %" PRIu64, count, keepalive_folded());
+
+    // Columns header
+    wattron(ui->win, A_BOLD | COLOR_PAIR(CP_DEF_ON_CYAN));
+    ui_clear_line(ui, KEEPALIVE_LIST_ROW - 1);
+    mvwprintw(ui->win, KEEPALIVE_LIST_ROW - 1, 2, "%-10s %-24s %-24s %9s %9s %4s %9s %s",
+              "Method", "Peer", "Peer", "Requests", "Responses", "Last", "Latency", "Last seen");
+    wattroff(ui->win, A_BOLD | COLOR_PAIR(CP_DEF_ON_CYAN));
+
+    for (i = info->first, row = KEEPALIVE_LIST_ROW; i < count && row < KEEPALIVE_LIST_ROW + height; i++, row++) {
+        entry = keepalive_item(i);
+        if (entry->last_latency >= 0)
+            sprintf(latency, "%.1fms", entry->last_latency / 1000.0);
+        else
+            sprintf(latency, "-");
+
+        // Highlight selected entry
+        if (i == info->cur) {
+            wattron(ui->win, COLOR_PAIR(CP_WHITE_ON_BLUE));
+            // Reverse colors on monochrome terminals
+            if (!has_colors())
+                wattron(ui->win, A_REVERSE);
+        }
+        ui_clear_line(ui, row);
+        mvwprintw(ui->win, row, 2, "%-10s %-24s %-24s %9" PRIu64 " %9" PRIu64 " %4d %9s %s",
+                  sip_method_str(entry->method), keepalive_address(entry->src, src),
+                  keepalive_address(entry->dst, dst), entry->requests, entry->responses,
+                  entry->last_code, latency, timeval_to_time(entry->last, time));
+        wattroff(ui->win, COLOR_PAIR(CP_WHITE_ON_BLUE) | A_REVERSE);
+    }
+
+    // Stored messages of selected entry
+    if ((entry = keepalive_item(info->cur)) && entry->msgs_count)
+        keepalive_draw_msgs(ui, entry, KEEPALIVE_LIST_ROW + height + 1);
+
+    return 0;
+}
+
+int
+keepalive_handle_key(ui_t *ui, int key)
+{
+    keepalive_info_t *info;
+    int action = -1;
+
+    if (!(info = keepalive_info(ui)))
+        return KEY_NOT_HANDLED;
+
+    // Check actions for this key
+    while ((action = key_find_action(key, action)) != ERR) {
+        // Check if we handle this action
+        switch (action) {
+            case ACTION_DOWN:
+                info->cur++;
+                break;
+            case ACTION_UP:
+                info->cur--;
+                break;
+            case ACTION_NPAGE:
+                info->cur += keepalive_list_height(ui);
+                break;
+            case ACTION_PPAGE:
+                info->cur -= keepalive_list_height(ui);
+                break;
+            case ACTION_BEGIN:
+                info->cur = 0;
+                break;
+            case ACTION_END:
+                info->cur = keepalive_count() - 1;
+                break;
+            case ACTION_CLEAR_CALLS:
+                // Propagate the key to the previous panel
+                return KEY_PROPAGATED;
+            default:
+                // Parse next action
+                continue;
+        }
+
+        // This panel has handled the key successfully
+        break;
+    }
+
+    // Force redraw with the new selected entry
+    info->folded = 0;
+
+    // Return if this panel has handled or not the key
+    return (action == ERR) ? KEY_NOT_HANDLED : KEY_HANDLED;
+}
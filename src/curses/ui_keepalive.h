@@ -0,0 +1,108 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file ui_keepalive.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to manage ui window for keepalive aggregate entries
+ */
+#ifndef __SNGREP_UI_KEEPALIVE_H
+#define __SNGREP_UI_KEEPALIVE_H
+
+#include "config.h"
+#include <stdint.h>
+#include "ui_manager.h"
+
+//! First row of the entries list
+#define KEEPALIVE_LIST_ROW 4
+//! Max rows used to display stored messages of the selected entry
+#define KEEPALIVE_MSGS_ROWS 10
+
+//! Sorter declaration of struct keepalive_info
+typedef struct keepalive_info keepalive_info_t;
+
+/**
+ * @brief Keepalive panel status information
+ */
+struct keepalive_info {
+    //! Selected entry position
+    int cur;
+    //! First displayed entry position
+    int first;
+    //! Folded messages count when the panel was last drawn
+    uint64_t folded;
+};
+
+/**
+ * @brief Creates a new keepalive panel
+ *
+ * @param ui UI structure pointer
+ */
+void
+keepalive_create(ui_t *ui);
+
+/**
+ * @brief Destroy keepalive panel
+ *
+ * @param ui UI structure pointer
+ */
+void
+keepalive_destroy(ui_t *ui);
+
+/**
+ * @brief Get custom information of given panel
+ *
+ * @param ui UI structure pointer
+ * @return a pointer to info structure of given panel
+ */
+keepalive_info_t *
+keepalive_info(ui_t *ui);
+
+/**
+ * @brief Check if the panel requires to be redrawn
+ *
+ * @param ui UI structure pointer
+ * @return true if any message has been folded since last draw
+ */
+bool
+keepalive_redraw(ui_t *ui);
+
+/**
+ * @brief Draw aggregate entries and selected entry messages
+ *
+ * @param ui UI structure pointer
+ * @return 0 if the panel has been drawn, -1 otherwise
+ */
+int
+keepalive_draw(ui_t *ui);
+
+/**
+ * @brief Handle keepalive panel keys
+ *
+ * @param ui UI structure pointer
+ * @param key key pressed by user
+ * @return enum @key_handler_ret
+ */
+int
+keepalive_handle_key(ui_t *ui, int key);
+
+#endif /* __SNGREP_UI_KEEPALIVE_H */
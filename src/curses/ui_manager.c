@@ -32,9 +32,14 @@
 #include <math.h>
 #include <stdlib.h>
 #include <locale.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
 #include "setting.h"
 #include "ui_manager.h"
 #include "capture.h"
+#include "filter.h"
+#include "health.h"
 #include "ui_call_list.h"
 #include "ui_call_flow.h"
 #include "ui_call_raw.h"
@@ -60,7 +65,8 @@ static ui_t *panel_pool[] = {
     &ui_msg_diff,
     &ui_column_select,
     &ui_settings,
-    &ui_stats
+    &ui_stats,
+    &ui_keepalive
 };
 
 int
@@ -145,6 +151,8 @@ ncurses_init()
 void
 ncurses_deinit()
 {
+    // Close file of a running background save
+    save_stop();
     // Clear screen before leaving
     refresh();
     // End ncurses mode
@@ -182,37 +190,74 @@ ui_find_by_type(enum panel_types type)
     return NULL;
 }
 
+/**
+ * @brief Get current monotonic time in milliseconds
+ */
+static int64_t
+ui_time_msecs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
 int
 ui_wait_for_input()
 {
     ui_t *ui;
     WINDOW *win;
     PANEL *panel;
+    struct pollfd fds[2];
+    char notify[64];
+    int64_t now, next_frame = 0;
+    int maxfps, timeout;
+
+    // Wait for pressed keys and captured calls changes
+    memset(fds, 0, sizeof(fds));
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = sip_calls_notify_fd();
+    fds[1].events = POLLIN;
 
     // While there are still panels
     while ((panel = panel_below(NULL))) {
 
+        // Report background saves that have finished
+        save_check_finished();
+
+        // Write internal containers report if requested
+        health_check_signal();
+
         // Get panel interface structure
         ui = ui_find_by_panel(panel);
 
-        // Set character input timeout 200 ms
-        halfdelay(REFRESHTHSECS);
-
-        // Avoid parsing any packet while UI is being drawn
-        capture_lock();
-        // Query the interface if it needs to be redrawn
-        if (ui_draw_redraw(ui)) {
-            // Redraw this panel
-            if (ui_draw_panel(ui) != 0) {
-                capture_unlock();
-                return -1;
+        // Limit redraws caused by capture changes
+        maxfps = setting_get_intvalue(SETTING_UI_MAXFPS);
+        now = ui_time_msecs();
+
+        if (ui->changed || now >= next_frame || filter_pass_pending()) {
+            // Avoid parsing any packet while UI is being drawn
+            capture_lock();
+            // Display calls evaluated by the running filter pass
+            if (filter_pass_pending()) {
+                filter_pass_step(FILTER_PASS_STEP);
+                ui->changed = true;
             }
-        }
-        capture_unlock();
+            // Query the interface if it needs to be redrawn
+            if (ui_draw_redraw(ui)) {
+                // Redraw this panel
+                if (ui_draw_panel(ui) != 0) {
+                    capture_unlock();
+                    return -1;
+                }
+                next_frame = (maxfps > 0) ? now + 1000 / maxfps : now;
+            }
+            capture_unlock();
 
-        // Update panel stack
-        update_panels();
-        doupdate();
+            // Update panel stack
+            update_panels();
+            doupdate();
+        }
 
         // Get topmost panel
         panel = panel_below(NULL);
@@ -220,13 +265,30 @@ ui_wait_for_input()
         // Enable key input on current panel
         win = panel_window(panel);
         keypad(win, TRUE);
+        cbreak();
+        nodelay(win, TRUE);
 
         // Get pressed key
         int c = wgetch(win);
 
-        // Timeout, no key pressed
-        if (c == ERR)
+        // No key pressed
+        if (c == ERR) {
+            // Wait until next frame if something has been drawn, otherwise
+            // check panels every 200 ms
+            if (filter_pass_pending()) {
+                timeout = 0;
+            } else if (next_frame > now) {
+                timeout = next_frame - now;
+            } else {
+                timeout = REFRESHTHSECS * 100;
+            }
+
+            if (poll(fds, 2, timeout) > 0 && (fds[1].revents & POLLIN)) {
+                // Consume capture notifications
+                while (read(fds[1].fd, notify, sizeof(notify)) > 0);
+            }
             continue;
+        }
 
         capture_lock();
         // Handle received key
@@ -346,7 +408,38 @@ draw_message(WINDOW *win, sip_msg_t *msg)
 int
 draw_message_pos(WINDOW *win, sip_msg_t *msg, int starting)
 {
-    int height, width, line, column, i;
+    return draw_message_skip(win, msg, starting, 0);
+}
+
+int
+draw_message_lines(sip_msg_t *msg, int width)
+{
+    int line = 0, column = 0;
+    const char *payload;
+
+    // Use the same wrapping rules than draw_message_skip
+    for (payload = msg_get_payload(msg); *payload; payload++) {
+        if (*payload == '\r')
+            continue;
+        if (*payload == '\n') {
+            line++;
+            column = 0;
+            continue;
+        }
+        if (column == width) {
+            line++;
+            column = 0;
+        }
+        column++;
+    }
+
+    return line;
+}
+
+int
+draw_message_skip(WINDOW *win, sip_msg_t *msg, int starting, int skip)
+{
+    int height, width, line, column, i, len;
     const char *cur_line, *payload, *method = NULL;
     int syntax = setting_enabled(SETTING_SYNTAX);
     const char *nonascii = setting_get_value(SETTING_CR_NON_ASCII);
@@ -366,15 +459,16 @@ draw_message_pos(WINDOW *win, sip_msg_t *msg, int starting)
 
     // Get packet payload
     cur_line = payload = (const char *) msg_get_payload(msg);
+    len = strlen(payload);
 
-    // Print msg payload
-    line = starting;
+    // Print msg payload (skipped lines are placed before starting line)
+    line = starting - skip;
     column = 0;
-    for (i = 0; i < strlen(payload); i++) {
+    for (i = 0; i < len; i++) {
         // If syntax highlighting is enabled
         if (syntax) {
             // First line highlight
-            if (line == starting) {
+            if (cur_line == payload) {
                 // Request syntax
                 if (i == 0 && strncmp(cur_line, "SIP/2.0", 7))
                     attrs = A_BOLD | COLOR_PAIR(CP_YELLOW_ON_DEF);
@@ -440,14 +534,28 @@ draw_message_pos(WINDOW *win, sip_msg_t *msg, int starting)
         if (payload[i] == '\r')
             continue;
 
-        // Store where the line begins
-        if (payload[i] == '\n')
-            cur_line =payload + i + 1;
+        // Move to the next line if we reach a line break
+        if (payload[i] == '\n') {
+            // Store where the line begins
+            cur_line = payload + i + 1;
+            line++;
+            column = 0;
+            continue;
+        }
 
-        // Move to the next line if line is filled or a we reach a line break
-        if (column > width || payload[i] == '\n') {
+        // Move to the next line if line is filled
+        if (column == width) {
             line++;
             column = 0;
+        }
+
+        // Stop if we've reached the bottom of the window
+        if (line >= height)
+            break;
+
+        // Skipped lines are not printed
+        if (line < starting) {
+            column++;
             continue;
         }
 
@@ -457,10 +565,6 @@ draw_message_pos(WINDOW *win, sip_msg_t *msg, int starting)
         } else {
             mvwaddch(win, line, column++, *nonascii);
         }
-
-        // Stop if we've reached the bottom of the window
-        if (line == height)
-            break;
     }
 
     // Disable syntax when leaving
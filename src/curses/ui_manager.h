@@ -43,7 +43,7 @@
 #include "keybinding.h"
 #include "setting.h"
 
-//! Refresh UI every 200 ms
+//! Check panels for changes every 200 ms
 #define REFRESHTHSECS   2
 //! Default dialog dimensions
 #define DIALOG_MAX_WIDTH 100
@@ -61,6 +61,7 @@ extern ui_t ui_msg_diff;
 extern ui_t ui_column_select;
 extern ui_t ui_settings;
 extern ui_t ui_stats;
+extern ui_t ui_keepalive;
 
 /**
  * @brief Initialize ncurses mode
@@ -175,6 +176,32 @@ draw_message(WINDOW *win, sip_msg_t *msg);
 int
 draw_message_pos(WINDOW *win, sip_msg_t *msg, int starting);
 
+/**
+ * @brief Draw a message payload in a window skipping its first lines
+ *
+ * Same as draw_message_pos, but first skip lines of the payload are
+ * not printed. This allows drawing only the visible part of messages
+ * that start above the window.
+ *
+ * @param win Ncurses window to draw payload
+ * @param msg Msg to be drawn
+ * @param starting Number of win line to start writting payload
+ * @param skip Number of payload lines not printed
+ * @return number of lines written
+ */
+int
+draw_message_skip(WINDOW *win, sip_msg_t *msg, int starting, int skip);
+
+/**
+ * @brief Get the number of lines a message payload requires
+ *
+ * @param msg Msg to be drawn
+ * @param width Width of the window where the payload will be drawn
+ * @return number of lines used by draw_message_skip with this width
+ */
+int
+draw_message_lines(sip_msg_t *msg, int width);
+
 /**
  * @brief Draw a centered dialog with a message
  *
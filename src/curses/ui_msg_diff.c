@@ -28,6 +28,7 @@
  */
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include "ui_msg_diff.h"
 #include "option.h"
 
@@ -100,7 +101,15 @@ msg_diff_create(ui_t *ui)
 void
 msg_diff_destroy(ui_t *ui)
 {
-    sng_free(msg_diff_info(ui));
+    msg_diff_info_t *info;
+
+    if ((info = msg_diff_info(ui))) {
+        // Deallocate differences data
+        sng_free(info->lines[0]);
+        sng_free(info->lines[1]);
+        sng_free(info->spans);
+        sng_free(info);
+    }
     ui_panel_destroy(ui);
 }
 
@@ -110,30 +119,205 @@ msg_diff_info(ui_t *ui)
     return (msg_diff_info_t*) panel_userptr(ui->panel);
 }
 
-int
-msg_diff_line_highlight(const char* payload1, const char* payload2, char *highlight)
+/**
+ * @brief Split a message payload into hashed lines
+ *
+ * @param payload Message payload
+ * @param count Pointer to store the number of lines
+ * @return allocated array of lines
+ */
+static msg_diff_line_t *
+msg_diff_split_lines(const char *payload, int *count)
+{
+    msg_diff_line_t *lines;
+    const char *end;
+    int i, linecnt = 1;
+
+    // Count payload lines to allocate them at once
+    for (i = 0; payload[i]; i++) {
+        if (payload[i] == '\n')
+            linecnt++;
+    }
+
+    if (!(lines = malloc(sizeof(msg_diff_line_t) * linecnt)))
+        return NULL;
+
+    // Store each line with its FNV-1a hash
+    for (*count = 0; *payload; (*count)++) {
+        if (!(end = strchr(payload, '\n')))
+            end = payload + strlen(payload) - 1;
+        lines[*count].text = payload;
+        lines[*count].len = end - payload + 1;
+        lines[*count].changed = false;
+        lines[*count].hash = 2166136261u;
+        for (; payload <= end; payload++)
+            lines[*count].hash = (lines[*count].hash ^ (uint8_t) *payload) * 16777619u;
+    }
+
+    return lines;
+}
+
+/**
+ * @brief Check if a line of first message is equal to a line of second one
+ */
+static bool
+msg_diff_line_equal(msg_diff_info_t *info, int x, int y)
 {
-    char search[MAX_SIP_PAYLOAD];
-    int len, i;
-
-    // Initialize search terms
-    memset(search, 0, sizeof(search));
-    len = 0;
-
-    for (i = 0; i < strlen(payload1); i++) {
-        // Store this char in the search term
-        search[len++] = payload1[i];
-        // If we have a full line in search array
-        if (payload1[i] == '\n') {
-            // Check if this line is in the other payload
-            if (strstr(payload2, search) == NULL) {
-                // Highlight this line as different from the other payload
-                memset(highlight + i - len + 1, '1', len);
+    msg_diff_line_t *one = &info->lines[0][x];
+    msg_diff_line_t *two = &info->lines[1][y];
+
+    return one->hash == two->hash && one->len == two->len
+        && !memcmp(one->text, two->text, one->len);
+}
+
+/**
+ * @brief Find the midpoint of the shortest edit script of given lines
+ *
+ * Myers' algorithm searching from both ends at the same time until forward
+ * and backward paths overlap. fd and bd are indexed by diagonal (x - y).
+ */
+static void
+msg_diff_midpoint(msg_diff_info_t *info, int xoff, int xlim, int yoff, int ylim,
+                  int *fd, int *bd, int *xmid, int *ymid)
+{
+    int dmin = xoff - ylim, dmax = xlim - yoff;
+    int fmid = xoff - yoff, bmid = xlim - ylim;
+    int fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+    int odd = (fmid - bmid) & 1;
+    int d, x, y;
+
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+
+    for (;;) {
+        // Extend the forward search by one edit
+        if (fmin > dmin) fd[--fmin - 1] = -1; else ++fmin;
+        if (fmax < dmax) fd[++fmax + 1] = -1; else --fmax;
+        for (d = fmax; d >= fmin; d -= 2) {
+            x = (fd[d - 1] >= fd[d + 1]) ? fd[d - 1] + 1 : fd[d + 1];
+            y = x - d;
+            while (x < xlim && y < ylim && msg_diff_line_equal(info, x, y)) {
+                x++;
+                y++;
+            }
+            fd[d] = x;
+            if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+                *xmid = x;
+                *ymid = y;
+                return;
             }
+        }
+
+        // Extend the backward search by one edit
+        if (bmin > dmin) bd[--bmin - 1] = INT_MAX; else ++bmin;
+        if (bmax < dmax) bd[++bmax + 1] = INT_MAX; else --bmax;
+        for (d = bmax; d >= bmin; d -= 2) {
+            x = (bd[d - 1] < bd[d + 1]) ? bd[d - 1] : bd[d + 1] - 1;
+            y = x - d;
+            while (x > xoff && y > yoff && msg_diff_line_equal(info, x - 1, y - 1)) {
+                x--;
+                y--;
+            }
+            bd[d] = x;
+            if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+                *xmid = x;
+                *ymid = y;
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Mark lines that are not common to both messages in given range
+ */
+static void
+msg_diff_compare(msg_diff_info_t *info, int xoff, int xlim, int yoff, int ylim,
+                 int *fd, int *bd)
+{
+    int xmid, ymid;
+
+    // Skip common lines at the start and end of the range
+    while (xoff < xlim && yoff < ylim && msg_diff_line_equal(info, xoff, yoff)) {
+        xoff++;
+        yoff++;
+    }
+    while (xoff < xlim && yoff < ylim && msg_diff_line_equal(info, xlim - 1, ylim - 1)) {
+        xlim--;
+        ylim--;
+    }
+
+    // Remaining lines belong only to one of the messages
+    if (xoff == xlim || yoff == ylim) {
+        for (; xoff < xlim; xoff++)
+            info->lines[0][xoff].changed = true;
+        for (; yoff < ylim; yoff++)
+            info->lines[1][yoff].changed = true;
+        return;
+    }
+
+    // Split the range and compare both halves
+    msg_diff_midpoint(info, xoff, xlim, yoff, ylim, fd, bd, &xmid, &ymid);
+    msg_diff_compare(info, xoff, xmid, yoff, ymid, fd, bd);
+    msg_diff_compare(info, xmid, xlim, ymid, ylim, fd, bd);
+}
+
+int
+msg_diff_calculate(msg_diff_info_t *info)
+{
+    int *diags, x = 0, y = 0, n, m;
+    msg_diff_span_t *span;
+
+    // Remove previous differences
+    sng_free(info->lines[0]);
+    sng_free(info->lines[1]);
+    sng_free(info->spans);
+    info->lines[0] = info->lines[1] = NULL;
+    info->spans = NULL;
+    info->spancnt = 0;
+
+    // Split both payloads into lines
+    info->lines[0] = msg_diff_split_lines(msg_get_payload(info->one), &info->linecnt[0]);
+    info->lines[1] = msg_diff_split_lines(msg_get_payload(info->two), &info->linecnt[1]);
+    n = info->linecnt[0];
+    m = info->linecnt[1];
+
+    // Forward and backward diagonals, indexed from -(m + 1) to (n + 1)
+    diags = malloc(sizeof(int) * 2 * (n + m + 3));
+    info->spans = malloc(sizeof(msg_diff_span_t) * (n + m + 1));
+    if (!info->lines[0] || !info->lines[1] || !diags || !info->spans) {
+        info->linecnt[0] = info->linecnt[1] = 0;
+        free(diags);
+        return 1;
+    }
+
+    msg_diff_compare(info, 0, n, 0, m, diags + m + 1, diags + (n + m + 3) + m + 1);
+    free(diags);
+
+    // Group consecutive changed lines into spans
+    while (x < n || y < m) {
+        if (x < n && y < m && !info->lines[0][x].changed && !info->lines[1][y].changed) {
+            x++;
+            y++;
+            continue;
+        }
 
-            // Reset search terms
-            memset(search, 0, sizeof(search));
-            len = 0;
+        span = &info->spans[info->spancnt++];
+        span->start[0] = x;
+        span->start[1] = y;
+        while (x < n && info->lines[0][x].changed)
+            x++;
+        while (y < m && info->lines[1][y].changed)
+            y++;
+        span->count[0] = x - span->start[0];
+        span->count[1] = y - span->start[1];
+
+        if (!span->count[1]) {
+            span->type = MSG_DIFF_DELETE;
+        } else if (!span->count[0]) {
+            span->type = MSG_DIFF_INSERT;
+        } else {
+            span->type = MSG_DIFF_CHANGE;
         }
     }
 
@@ -154,18 +338,10 @@ msg_diff_draw_footer(ui_t *ui)
 int
 msg_diff_draw(ui_t *ui)
 {
-    // Get panel information
-    msg_diff_info_t *info = msg_diff_info(ui);
-    char highlight[MAX_SIP_PAYLOAD];
-
     // Draw first message
-    memset(highlight, 0, sizeof(highlight));
-    msg_diff_line_highlight(msg_get_payload(info->one), msg_get_payload(info->two), highlight);
-    msg_diff_draw_message(info->one_win, info->one, highlight);
+    msg_diff_draw_message(ui, 0);
     // Draw second message
-    memset(highlight, 0, sizeof(highlight));
-    msg_diff_line_highlight(msg_get_payload(info->two), msg_get_payload(info->one), highlight);
-    msg_diff_draw_message(info->two_win, info->two, highlight);
+    msg_diff_draw_message(ui, 1);
 
     // Redraw footer
     msg_diff_draw_footer(ui);
@@ -174,11 +350,15 @@ msg_diff_draw(ui_t *ui)
 }
 
 int
-msg_diff_draw_message(WINDOW *win, sip_msg_t *msg, char *highlight)
+msg_diff_draw_message(ui_t *ui, int side)
 {
-    int height, width, line, column, i;
+    int height, width, line, column, i, j, span = 0;
     char header[MAX_SIP_PAYLOAD];
-    const char * payload = msg_get_payload(msg);
+    msg_diff_info_t *info = msg_diff_info(ui);
+    WINDOW *win = (side) ? info->two_win : info->one_win;
+    sip_msg_t *msg = (side) ? info->two : info->one;
+    msg_diff_line_t *dline;
+    msg_diff_span_t *dspan;
 
     // Clear the window
     werase(win);
@@ -192,29 +372,39 @@ msg_diff_draw_message(WINDOW *win, sip_msg_t *msg, char *highlight)
 
     // Print msg payload
     line = 2;
-    column = 0;
-    for (i = 0; i < strlen(payload); i++) {
-        if (payload[i] == '\r')
-            continue;
+    for (i = 0; i < info->linecnt[side] && line < height; i++) {
+        dline = &info->lines[side][i];
 
-        if (column == width || payload[i] == '\n') {
-            line++;
-            column = 0;
-            continue;
-        }
+        // Skip spans before this line
+        while (span < info->spancnt
+               && info->spans[span].start[side] + info->spans[span].count[side] <= i)
+            span++;
 
-        if (line == height)
-            break;
-
-        if (highlight[i] == '1') {
+        // Highlight lines that are part of a difference
+        dspan = (span < info->spancnt) ? &info->spans[span] : NULL;
+        if (dspan && dspan->start[side] <= i) {
             wattron(win, COLOR_PAIR(CP_YELLOW_ON_DEF));
         } else {
             wattroff(win, COLOR_PAIR(CP_YELLOW_ON_DEF));
         }
 
-        // Put next character in position
-        mvwaddch(win, line, column++, payload[i]);
+        for (j = 0, column = 0; j < dline->len && line < height; j++) {
+            if (dline->text[j] == '\r' || dline->text[j] == '\n')
+                continue;
+
+            if (column == width) {
+                line++;
+                column = 0;
+                if (line == height)
+                    break;
+            }
+
+            // Put next character in position
+            mvwaddch(win, line, column++, dline->text[j]);
+        }
+        line++;
     }
+    wattroff(win, COLOR_PAIR(CP_YELLOW_ON_DEF));
 
     // Redraw raw win
     wnoutrefresh(win);
@@ -232,6 +422,9 @@ msg_diff_set_msgs(ui_t *ui, sip_msg_t *one, sip_msg_t *two)
     info->one = one;
     info->two = two;
 
+    // Calculate messages differences
+    msg_diff_calculate(info);
+
     return 0;
 }
 
@@ -31,9 +31,51 @@
 #include "config.h"
 #include "ui_manager.h"
 
+//! Sorter declaration of struct msg_diff_line
+typedef struct msg_diff_line msg_diff_line_t;
+//! Sorter declaration of struct msg_diff_span
+typedef struct msg_diff_span msg_diff_span_t;
 //! Sorter declaration of struct msg_diff_info
 typedef struct msg_diff_info msg_diff_info_t;
 
+/**
+ * @brief Types of differences between compared messages
+ */
+enum msg_diff_span_type {
+    //! Lines of first message replaced by lines of second message
+    MSG_DIFF_CHANGE = 0,
+    //! Lines only in first message
+    MSG_DIFF_DELETE,
+    //! Lines only in second message
+    MSG_DIFF_INSERT,
+};
+
+/**
+ * @brief Payload line of a compared message
+ */
+struct msg_diff_line {
+    //! Line start in the message payload
+    const char *text;
+    //! Line length (including line break)
+    int len;
+    //! Hash value of line text
+    uint32_t hash;
+    //! This line is not part of the common lines of both messages
+    bool changed;
+};
+
+/**
+ * @brief Consecutive lines that differ between compared messages
+ */
+struct msg_diff_span {
+    //! Type of difference
+    enum msg_diff_span_type type;
+    //! First line of the span in each message
+    int start[2];
+    //! Number of lines of the span in each message
+    int count[2];
+};
+
 /**
  * @brief Call raw status information
  *
@@ -49,6 +91,14 @@ struct msg_diff_info {
     WINDOW *one_win;
     //! Right displayed subwindow
     WINDOW *two_win;
+    //! Payload lines of each message
+    msg_diff_line_t *lines[2];
+    //! Number of payload lines of each message
+    int linecnt[2];
+    //! Differences between messages
+    msg_diff_span_t *spans;
+    //! Number of differences between messages
+    int spancnt;
 };
 
 /**
@@ -117,17 +167,33 @@ msg_diff_draw_footer(ui_t *ui);
  * @brief Draw a message into a raw subwindow
  *
  * This function will be called for each message that wants to be draw
- * in the panel.
+ * in the panel. Lines that are part of a difference span are highlighted.
+ *
+ * @param ui UI structure pointer
+ * @param side 0 for first message, 1 for second message
+ * @return 0 in all cases
+ */
+int
+msg_diff_draw_message(ui_t *ui, int side);
+
+/**
+ * @brief Calculate differences spans between panel messages
+ *
+ * Payload lines of both messages are compared using Myers' algorithm and
+ * lines that are not common to both are grouped in spans.
  *
+ * @param info Message diff panel information
+ * @return 0 on success, 1 on allocation error
  */
 int
-msg_diff_draw_message(WINDOW *win, sip_msg_t *msg, char *highlight);
+msg_diff_calculate(msg_diff_info_t *info);
 
 /**
  * @brief Set the panel working messages
  *
  * This function will access the panel information and will set the
- * msg pointers to the processed messages.
+ * msg pointers to the processed messages. Differences between both
+ * messages payload are calculated here once.
  *
  * @param ui UI structure pointer
  * @param one Message pointer to be set in the internal info struct
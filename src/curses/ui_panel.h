@@ -74,6 +74,8 @@ enum panel_types {
     PANEL_SETTINGS,
     //! Stats panel
     PANEL_STATS,
+    //! Keepalive aggregates panel
+    PANEL_KEEPALIVE,
     //! Panel Counter
     PANEL_COUNT,
 };
@@ -38,6 +38,9 @@
 #include "capture.h"
 #include "filter.h"
 
+//! Background save of pcap files
+static save_task_t save_task;
+
 /**
  * Ui Structure definition for Save panel
  */
@@ -415,11 +418,7 @@ save_to_file(ui_t *ui)
     sip_msg_t *msg = NULL;
     pcap_dumper_t *pd = NULL;
     FILE *f = NULL;
-    int cur = 0, total = 0;
-    WINDOW *progress;
-    vector_iter_t calls, msgs, rtps, packets;
-    packet_t *packet;
-    vector_t *sorted;
+    vector_iter_t calls, msgs;
 
     // Get panel information
     save_info_t *info = save_info(ui);
@@ -457,6 +456,12 @@ save_to_file(ui_t *ui)
             return 1;
     }
 
+    // Only one file can be written in background
+    if (save_running()) {
+        dialog_run("Unable to save: Previous save is still running.");
+        return 1;
+    }
+
     // Don't allow to save no packets!
     if (info->savemode == SAVE_SELECTED && call_group_msg_count(info->group) == 0) {
         dialog_run("Unable to save: No selected dialogs.");
@@ -503,6 +508,7 @@ save_to_file(ui_t *ui)
             save_msg_txt(f, info->msg);
         } else {
             // Save selected message packet to pcap
+            call_uncompress(info->msg->call);
             dump_packet(pd, info->msg->packet);
         }
     } else if (info->saveformat == SAVE_TXT) {
@@ -515,49 +521,8 @@ save_to_file(ui_t *ui)
             }
         }
     } else {
-        // Store all messages in a time sorted vector
-        sorted = vector_create(100, 50);
-        vector_set_sorter(sorted, capture_packet_time_sorter);
-
-        // Count packages for progress bar
-        while ((call = vector_iterator_next(&calls))) {
-            total += vector_count(call->msgs);
-            if (info->saveformat == SAVE_PCAP_RTP)
-                total += vector_count(call->rtp_packets);
-        }
-        vector_iterator_reset(&calls);
-
-        progress = dialog_progress_run("Saving packets...");
-        dialog_progress_set_value(progress, 0);
-
-        // Save selected packets to file
-        while ((call = vector_iterator_next(&calls))) {
-            msgs = vector_iterator(call->msgs);
-            // Save SIP message content
-            while ((msg = vector_iterator_next(&msgs))) {
-                // Update progress bar dialog
-                dialog_progress_set_value(progress, (++cur * 100) / total);
-                vector_append(sorted, msg->packet);
-            }
-
-            // Save RTP packets
-            if (info->saveformat == SAVE_PCAP_RTP) {
-                rtps = vector_iterator(call->rtp_packets);
-                while ((packet = vector_iterator_next(&rtps))) {
-                    // Update progress bar dialog
-                    dialog_progress_set_value(progress, (++cur * 100) / total);
-                    vector_append(sorted, packet);
-                }
-            }
-        }
-
-        // Save sorted packets
-        packets = vector_iterator(sorted);
-        while ((packet = vector_iterator_next(&packets))) {
-            dump_packet(pd, packet);
-        }
-
-        dialog_progress_destroy(progress);
+        // Write packets in background, success is reported when finished
+        return save_pcap_start(pd, &calls, info->saveformat == SAVE_PCAP_RTP, savefile);
     }
 
     // Close saved file
@@ -589,3 +554,264 @@ save_msg_txt(FILE *f, sip_msg_t *msg)
             msg_get_attribute(msg, SIP_ATTR_DST, dst),
             msg_get_payload(msg));
 }
+
+/**
+ * @brief Load next packet of a save cursor list
+ *
+ * @return true if the list has more packets to save
+ */
+static bool
+save_cursor_load(save_cursor_t *cursor)
+{
+    sip_msg_t *msg;
+
+    if (cursor->spool) {
+        // Records are read from the spool file instead of packets
+        if (storage_rtp_read(cursor->spool, cursor->offset, &cursor->header, &cursor->data, &cursor->size) != 0)
+            return false;
+        cursor->time = cursor->header.ts;
+        return true;
+    } else if (cursor->msgs) {
+        msg = vector_item(cursor->call->msgs, cursor->index);
+        cursor->packet = (msg) ? msg->packet : NULL;
+    } else if (cursor->stream) {
+        cursor->packet = stream_stored_packet(cursor->stream, cursor->index);
+    } else {
+        cursor->packet = vector_item(cursor->call->rtp_packets, cursor->index);
+    }
+
+    if (cursor->packet)
+        cursor->time = packet_time(cursor->packet);
+
+    return cursor->packet != NULL;
+}
+
+/**
+ * @brief Check if first cursor packet must be saved before the second one
+ *
+ * Packets with the same time keep the order of the cursors.
+ */
+static bool
+save_cursor_before(int first, int second)
+{
+    save_cursor_t *a = &save_task.cursors[first];
+    save_cursor_t *b = &save_task.cursors[second];
+
+    if (timercmp(&a->time, &b->time, !=))
+        return timercmp(&a->time, &b->time, <);
+    return first < second;
+}
+
+/**
+ * @brief Move a heap item down until its children are newer
+ */
+static void
+save_heap_down(int pos)
+{
+    int *heap = save_task.heap;
+    int child, item = heap[pos];
+
+    while ((child = pos * 2 + 1) < save_task.heapsize) {
+        if (child + 1 < save_task.heapsize && save_cursor_before(heap[child + 1], heap[child]))
+            child++;
+        if (!save_cursor_before(heap[child], item))
+            break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = item;
+}
+
+/**
+ * @brief Release calls and memory of the background save
+ */
+static void
+save_task_free()
+{
+    int i;
+
+    // Calls can be removed again
+    capture_lock();
+    for (i = 0; i < save_task.dialogs; i++)
+        save_task.cursors[i].call->saving--;
+    // Release stream packets loaded by unsaved cursors
+    for (i = 0; i < save_task.heapsize; i++) {
+        if (save_task.cursors[save_task.heap[i]].stream)
+            stream_release_packet(save_task.cursors[save_task.heap[i]].stream, save_task.cursors[save_task.heap[i]].packet);
+    }
+    capture_unlock();
+
+    // Release spool records buffers
+    for (i = 0; i < save_task.ncursors; i++)
+        free(save_task.cursors[i].data);
+
+    free(save_task.cursors);
+    free(save_task.heap);
+    save_task.cursors = NULL;
+    save_task.heap = NULL;
+}
+
+/**
+ * @brief Write the oldest packet of all cursors until all have been saved
+ */
+static void *
+save_thread(void *arg)
+{
+    save_cursor_t *cursor;
+    int i;
+
+    while (save_task.heapsize && !__atomic_load_n(&save_task.aborted, __ATOMIC_RELAXED)) {
+        // Calls can get new packets between chunks
+        capture_lock();
+        for (i = 0; i < SAVE_CHUNK && save_task.heapsize; i++) {
+            cursor = &save_task.cursors[save_task.heap[0]];
+            if (cursor->spool) {
+                pcap_dump((u_char *) save_task.pd, &cursor->header, cursor->data);
+                cursor->offset += STORAGE_PCAP_RECORD + cursor->header.caplen;
+            } else {
+                dump_packet(save_task.pd, cursor->packet);
+            }
+            if (cursor->stream)
+                stream_release_packet(cursor->stream, cursor->packet);
+            cursor->index++;
+            // Remove this cursor from the heap if its list has been saved
+            if (!save_cursor_load(cursor))
+                save_task.heap[0] = save_task.heap[--save_task.heapsize];
+            if (save_task.heapsize)
+                save_heap_down(0);
+        }
+        capture_unlock();
+        __atomic_add_fetch(&save_task.saved, i, __ATOMIC_RELAXED);
+    }
+
+    dump_close(save_task.pd);
+    save_task_free();
+    __atomic_store_n(&save_task.finished, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+int
+save_pcap_start(pcap_dumper_t *pd, vector_iter_t *calls, bool rtp, const char *savefile)
+{
+    sip_call_t *call;
+    save_cursor_t *cursors, *cursor;
+    rtp_stream_t *stream;
+    vector_iter_t it;
+    int *heap = NULL;
+    int count, streams = 0, size, i;
+
+    // Count RTP packets lists stored in streams and spool files
+    count = vector_iterator_count(calls);
+    vector_iterator_reset(calls);
+    while (rtp && (call = vector_iterator_next(calls)))
+        streams += vector_count(call->streams) + (call->rtp_spool != NULL);
+
+    // Message cursors first, RTP cursors after them
+    size = count * 2 + streams + 1;
+    if (!(cursors = calloc(size, sizeof(save_cursor_t)))
+        || !(heap = calloc(size, sizeof(int)))) {
+        free(cursors);
+        dump_close(pd);
+        dialog_run("Unable to save: Not enough memory.");
+        return 1;
+    }
+
+    save_task.pd = pd;
+    save_task.cursors = cursors;
+    save_task.heap = heap;
+    save_task.ncursors = size;
+    save_task.heapsize = save_task.total = save_task.saved = 0;
+    save_task.finished = save_task.aborted = false;
+    strcpy(save_task.savefile, savefile);
+
+    vector_iterator_reset(calls);
+    for (i = 0, streams = count * 2; (call = vector_iterator_next(calls)); i++) {
+        // Keep call packets until they have been saved
+        call->saving++;
+        // Compressed packets contents are needed again
+        call_uncompress(call);
+        save_task.cursors[i].call = call;
+        save_task.cursors[i].msgs = true;
+        save_task.cursors[count + i].call = call;
+        save_task.cursors[count + i].msgs = false;
+        save_task.total += vector_count(call->msgs);
+        if (!rtp)
+            continue;
+        save_task.total += vector_count(call->rtp_packets);
+        // Streams can also store their own RTP packets
+        it = vector_iterator(call->streams);
+        while ((stream = vector_iterator_next(&it))) {
+            save_task.cursors[streams].call = call;
+            save_task.cursors[streams++].stream = stream;
+            save_task.total += stream_stored_count(stream);
+        }
+        // Spooled RTP records are merged with the call packets
+        if (call->rtp_spool) {
+            save_task.cursors[streams].call = call;
+            save_task.cursors[streams].spool = call->rtp_spool;
+            save_task.cursors[streams++].offset = STORAGE_PCAP_HEADER;
+            save_task.total += call->rtp_spool->frames;
+        }
+    }
+    save_task.dialogs = i;
+
+    // Add to the heap all lists with packets
+    for (i = 0; i < size; i++) {
+        cursor = &save_task.cursors[i];
+        if (cursor->call && (cursor->msgs || rtp) && save_cursor_load(cursor))
+            save_task.heap[save_task.heapsize++] = i;
+    }
+    for (i = save_task.heapsize / 2 - 1; i >= 0; i--)
+        save_heap_down(i);
+
+    save_task.active = true;
+    if (pthread_create(&save_task.thread, NULL, save_thread, NULL)) {
+        save_task.active = false;
+        dump_close(pd);
+        save_task_free();
+        dialog_run("Unable to save: %s", strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+bool
+save_running()
+{
+    return save_task.active && !__atomic_load_n(&save_task.finished, __ATOMIC_ACQUIRE);
+}
+
+int
+save_progress()
+{
+    if (!save_running())
+        return -1;
+    if (!save_task.total)
+        return 100;
+    return (int) ((int64_t) __atomic_load_n(&save_task.saved, __ATOMIC_RELAXED) * 100 / save_task.total);
+}
+
+void
+save_check_finished()
+{
+    if (!save_task.active || !__atomic_load_n(&save_task.finished, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_join(save_task.thread, NULL);
+    save_task.active = false;
+
+    dialog_run("Successfully saved %d dialogs to %s", save_task.dialogs, save_task.savefile);
+}
+
+void
+save_stop()
+{
+    if (!save_task.active)
+        return;
+
+    __atomic_store_n(&save_task.aborted, true, __ATOMIC_RELAXED);
+    pthread_join(save_task.thread, NULL);
+    save_task.active = false;
+}
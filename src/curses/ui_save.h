@@ -34,6 +34,7 @@
 #define __UI_SAVE_PCAP_H
 #include "config.h"
 #include <form.h>
+#include <pthread.h>
 #include "group.h"
 #include "ui_manager.h"
 
@@ -100,6 +101,78 @@ struct save_info {
     sip_msg_t *msg;
 };
 
+//! Packets written to a pcap file on each capture lock
+#define SAVE_CHUNK 1024
+
+//! Shorter declaration of save_cursor structure
+typedef struct save_cursor save_cursor_t;
+//! Shorter declaration of save_task structure
+typedef struct save_task save_task_t;
+
+/**
+ * @brief Next packet to be saved from a call packet list
+ */
+struct save_cursor {
+    //! Call owning the packet list
+    sip_call_t *call;
+    //! Packet list is call messages instead of RTP packets
+    bool msgs;
+    //! Stream storing the RTP packets list (NULL for call RTP packets)
+    rtp_stream_t *stream;
+    //! Spool file storing the RTP packets (NULL for call RTP packets)
+    storage_rtp_spool_t *spool;
+    //! Position of next packet in the list
+    int index;
+    //! Next packet of the list
+    packet_t *packet;
+    //! Position of next record in the spool file
+    uint64_t offset;
+    //! Next record of the spool file
+    struct pcap_pkthdr header;
+    //! Frame data of next spool record
+    u_char *data;
+    //! Size of frame data buffer
+    size_t size;
+    //! Next packet timestamp
+    struct timeval time;
+};
+
+/**
+ * @brief Background save of calls into a pcap file
+ *
+ * Packets of each call list are already sorted by time, so all lists are
+ * merged picking the oldest list head from a binary heap and written while
+ * the interface keeps running.
+ */
+struct save_task {
+    //! Writer thread
+    pthread_t thread;
+    //! Thread is running (or finished and not reported yet)
+    bool active;
+    //! Thread has written all packets
+    bool finished;
+    //! Stop writing packets
+    bool aborted;
+    //! Dump file
+    pcap_dumper_t *pd;
+    //! Saved filename (without path)
+    char savefile[MAX_SETTING_LEN];
+    //! Number of saved dialogs
+    int dialogs;
+    //! One cursor per saved packet list
+    save_cursor_t *cursors;
+    //! Number of allocated cursors
+    int ncursors;
+    //! Heap of cursor positions ordered by next packet time
+    int *heap;
+    //! Cursors in the heap
+    int heapsize;
+    //! Total packets to be saved
+    int total;
+    //! Already saved packets
+    int saved;
+};
+
 /**
  * @brief Creates a new save panel
  *
@@ -217,4 +290,54 @@ save_to_file(ui_t *ui);
 void
 save_msg_txt(FILE *f, sip_msg_t *msg);
 
+/**
+ * @brief Start saving given calls into a pcap file in background
+ *
+ * Calls are kept in storage until all their packets have been written.
+ * This must be called with capture lock held.
+ *
+ * @param pd Opened dump file, closed when all packets have been written
+ * @param calls Iterator of calls to be saved
+ * @param rtp Save also calls RTP packets
+ * @param savefile Filename displayed when save finishes
+ * @returns 1 in case of error, 0 otherwise.
+ */
+int
+save_pcap_start(pcap_dumper_t *pd, vector_iter_t *calls, bool rtp, const char *savefile);
+
+/**
+ * @brief Check if a background save is running
+ *
+ * Calls can not be removed from storage while they are being saved.
+ *
+ * @return true if packets are still being written
+ */
+bool
+save_running();
+
+/**
+ * @brief Get the percentage of packets already saved
+ *
+ * @return saved percentage or -1 if no background save is running
+ */
+int
+save_progress();
+
+/**
+ * @brief Report a finished background save
+ *
+ * Wait for save thread to finish and display a success dialog.
+ * This must be called from interface thread without capture lock.
+ */
+void
+save_check_finished();
+
+/**
+ * @brief Stop a running background save
+ *
+ * Dump file is closed with the packets written so far.
+ */
+void
+save_stop();
+
 #endif
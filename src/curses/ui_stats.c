@@ -32,10 +32,10 @@
  * |  Dialogs: 725                  COMPLETED:  7 (22.1%)    |
  * |  Calls: 10                     CANCELLED:  2 (12.2%)    |
  * |  Messages: 200                 IN CALL:    10 (60.5%)   |
- * |                                REJECTED:   0 (0.0%)     |
- * |                                BUSY:       0 (0.0%)     |
- * |                                DIVERTED:   0 (0.0%)     |
- * |                                CALL SETUP: 0 (0.0%)     |
+ * |  Messages/s: 20                REJECTED:   0 (0.0%)     |
+ * |  RTP Streams: 4                BUSY:       0 (0.0%)     |
+ * |  RTP Packets: 1200             DIVERTED:   0 (0.0%)     |
+ * |  RTP Packets/s: 100            CALL SETUP: 0 (0.0%)     |
  * +---------------------------------------------------------+
  * |  INVITE:    10 (0.5%)          1XX: 123 (1.5%)          |
  * |  REGISTER:  200 (5.1%)         2XX: 231 (3.1%)          |
@@ -46,16 +46,37 @@
  * |  PUBLISH:   0 (0.0%)           7XX: 0 (0.0%)            |
  * |  MESSAGE:   0 (0.0%)           8XX: 0 (0.0%)            |
  * |  INFO:      0 (0.0%)                                    |
- * |  BYE:       10 (0.5%)                                   |
- * |  CANCEL:    0 (0.0%)                                    |
+ * |  BYE:       10 (0.5%)          FRAG EXPIRED:    0        |
+ * |  CANCEL:    0 (0.0%)           FRAG INCOMPLETE: 0        |
+ * +---------------------------------------------------------+
+ * |  Dialogs:    12M               TOP MEMORY                |
+ * |  Payloads:   40M               #12     120M  a84b4c76e6  |
+ * |  Frames:     52M               #3      32M   1-2345@host |
+ * |  Compressed: 0B                ...                      |
+ * |  RTP:        150M                                       |
+ * |  Strings:    2.1M                                       |
+ * |  Keepalive:  310K                                       |
+ * |  Total:      256M                                       |
+ * +---------------------------------------------------------+
+ * |  STAGE          COUNT      AVG      P50      P99        |  (only with
+ * |  reasm_ip       1200      210ns    256ns    1us         |   profiling
+ * |  ...                                                    |   support)
  * +---------------------------------------------------------+
  * |               Press any key to continue                 |
  * +---------------------------------------------------------+
  *
  */
 #include "config.h"
+#include <inttypes.h>
+#include <time.h>
 #include "vector.h"
 #include "sip.h"
+#include "intern.h"
+#include "keepalive.h"
+#include "capture.h"
+#include "profile.h"
+#include "util.h"
+#include "keybinding.h"
 #include "ui_manager.h"
 #include "ui_stats.h"
 
@@ -66,135 +87,364 @@ ui_t ui_stats = {
     .type = PANEL_STATS,
     .panel = NULL,
     .create = stats_create,
-    .destroy = ui_panel_destroy,
-    .handle_key = NULL
+    .destroy = stats_destroy,
+    .draw = stats_draw,
+    .handle_key = stats_handle_key
 };
 
 void
 stats_create(ui_t *ui)
 {
-    vector_iter_t calls;
-    vector_iter_t msgs;
-    sip_call_t *call;
-    sip_msg_t *msg;
-
-    // Counters!
-    struct {
-        int dtotal, dcalls, completed, cancelled, incall, rejected, setup, busy, diverted;
-        int mtotal, invite, regist, subscribe, update, notify, options;
-        int publish, message, info, ack, bye, cancel;
-        int r100, r200, r300, r400, r500, r600, r700, r800;
-    } stats;
-    memset(&stats, 0, sizeof(stats));
+    stats_info_t *info;
 
     // Calculate window dimensions
-    ui_panel_create(ui, 25, 60);
+    ui_panel_create(ui, STATS_HEIGHT, 60);
+
+    // Initialize panel specific data
+    info = sng_malloc(sizeof(stats_info_t));
+    set_panel_userptr(ui->panel, (void*) info);
 
     // Set the window title and boxes
     mvwprintw(ui->win, 1, ui->width / 2 - 9, "Stats Information");
     wattron(ui->win, COLOR_PAIR(CP_BLUE_ON_DEF));
     title_foot_box(ui->panel);
-    mvwhline(ui->win, 10, 1, ACS_HLINE, ui->width - 1);
-    mvwaddch(ui->win, 10, 0, ACS_LTEE);
-    mvwaddch(ui->win, 10, ui->width - 1, ACS_RTEE);
-    mvwprintw(ui->win, ui->height - 2, ui->width / 2 - 9, "Press ESC to leave");
+    mvwprintw(ui->win, ui->height - 2, ui->width / 2 - 18, "Press %s for internals, ESC to leave",
+              key_action_key_str(ACTION_SHOW_STATS));
     wattroff(ui->win, COLOR_PAIR(CP_BLUE_ON_DEF));
+}
 
-    // Parse the data
-    calls = sip_calls_iterator();
-    stats.dtotal = vector_iterator_count(&calls);
+void
+stats_destroy(ui_t *ui)
+{
+    sng_free(stats_info(ui));
+    ui_panel_destroy(ui);
+}
 
-    // Ignore this screen when no dialog exists
-    if (!stats.dtotal) {
-        mvwprintw(ui->win, 3, 3, "No information to display");
+stats_info_t *
+stats_info(ui_t *ui)
+{
+    return (stats_info_t*) panel_userptr(ui->panel);
+}
+
+/**
+ * @brief Copy the stored calls using more memory
+ *
+ * @param info Stats panel information
+ */
+static void
+stats_update_memory_top(stats_info_t *info)
+{
+    sip_call_t *top[STATS_MEMORY_TOP];
+    int i;
+
+    info->top_count = sip_calls_memory_top(top, STATS_MEMORY_TOP);
+    for (i = 0; i < info->top_count; i++) {
+        info->top[i].index = top[i]->index;
+        info->top[i].memory = top[i]->memory;
+        snprintf(info->top[i].callid, sizeof(info->top[i].callid), "%s", top[i]->callid);
+    }
+}
+
+/**
+ * @brief Draw stored calls memory usage
+ *
+ * @param ui UI structure pointer
+ * @param info Stats panel information
+ */
+static void
+stats_draw_memory(ui_t *ui, stats_info_t *info)
+{
+    char size[16], name[16];
+    int i;
+
+    for (i = 0; i < CALL_MEMORY_COUNT; i++) {
+        snprintf(name, sizeof(name), "%s:", call_memory_type_name(i));
+        mvwprintw(ui->win, STATS_MEMORY_ROW + i, 3, "%-12s%s", name,
+                  bytes_to_human(sip_calls_memory_type(i), size));
+    }
+    mvwprintw(ui->win, STATS_MEMORY_ROW + i, 3, "%-12s%s", "Strings:", bytes_to_human(intern_memory(), size));
+    mvwprintw(ui->win, STATS_MEMORY_ROW + i + 1, 3, "%-12s%s", "Keepalive:", bytes_to_human(keepalive_memory(), size));
+    mvwprintw(ui->win, STATS_MEMORY_ROW + i + 2, 3, "%-12s%s", "Total:", bytes_to_human(sip_calls_memory(), size));
+
+    if (!info->top_count)
         return;
+
+    mvwprintw(ui->win, STATS_MEMORY_ROW, 33, "TOP MEMORY");
+    for (i = 0; i < info->top_count; i++) {
+        mvwprintw(ui->win, STATS_MEMORY_ROW + 1 + i, 33, "#%-6d %-5s %.*s", info->top[i].index,
+                  bytes_to_human(info->top[i].memory, size), ui->width - 48, info->top[i].callid);
     }
+}
 
-    while ((call = vector_iterator_next(&calls))) {
-        // If this dialog is a call
-        if (call->state) {
-            // Increase call counter
-            stats.dcalls++;
-            // Increase call status counter
-            switch (call->state) {
-                case SIP_CALLSTATE_CALLSETUP: stats.setup++; break;
-                case SIP_CALLSTATE_INCALL: stats.incall++; break;
-                case SIP_CALLSTATE_CANCELLED: stats.cancelled++; break;
-                case SIP_CALLSTATE_REJECTED: stats.rejected++; break;
-                case SIP_CALLSTATE_BUSY: stats.busy++; break;
-                case SIP_CALLSTATE_DIVERTED: stats.diverted++; break;
-                case SIP_CALLSTATE_COMPLETED: stats.completed++; break;
-            }
-        }
-        // For each message in call
-        msgs = vector_iterator(call->msgs);
-        while ((msg = vector_iterator_next(&msgs))) {
-            // Increase message counter
-            stats.mtotal++;
-            // Check message type
-            switch (msg->reqresp) {
-                case SIP_METHOD_REGISTER: stats.regist++; break;
-                case SIP_METHOD_INVITE: stats.invite++; break;
-                case SIP_METHOD_SUBSCRIBE: stats.subscribe++; break;
-                case SIP_METHOD_NOTIFY: stats.notify++; break;
-                case SIP_METHOD_OPTIONS: stats.options++; break;
-                case SIP_METHOD_PUBLISH: stats.publish++; break;
-                case SIP_METHOD_MESSAGE: stats.message++; break;
-                case SIP_METHOD_CANCEL: stats.cancel++; break;
-                case SIP_METHOD_BYE: stats.bye++; break;
-                case SIP_METHOD_ACK: stats.ack++; break;
-                // case SIP_METHOD_PRACK:
-                case SIP_METHOD_INFO: stats.info++; break;
-                // case SIP_METHOD_REFER:
-                case SIP_METHOD_UPDATE: stats.update++; break;
-                default:
-                    if (msg->reqresp >= 800) stats.r800++;
-                    else if (msg->reqresp >= 700) stats.r700++;
-                    else if (msg->reqresp >= 600) stats.r600++;
-                    else if (msg->reqresp >= 500) stats.r500++;
-                    else if (msg->reqresp >= 400) stats.r400++;
-                    else if (msg->reqresp >= 300) stats.r300++;
-                    else if (msg->reqresp >= 200) stats.r200++;
-                    else if (msg->reqresp >= 100) stats.r100++;
-            }
+/**
+ * @brief Draw or remove a horizontal line between sections
+ *
+ * @param ui UI structure pointer
+ * @param row Window row of the line
+ * @param visible Draw the line or blank the row keeping window borders
+ */
+static void
+stats_draw_separator(ui_t *ui, int row, bool visible)
+{
+    wattron(ui->win, COLOR_PAIR(CP_BLUE_ON_DEF));
+    if (visible) {
+        mvwhline(ui->win, row, 1, ACS_HLINE, ui->width - 1);
+        mvwaddch(ui->win, row, 0, ACS_LTEE);
+        mvwaddch(ui->win, row, ui->width - 1, ACS_RTEE);
+    } else {
+        mvwhline(ui->win, row, 1, ' ', ui->width - 2);
+        mvwaddch(ui->win, row, 0, ACS_VLINE);
+        mvwaddch(ui->win, row, ui->width - 1, ACS_VLINE);
+    }
+    wattroff(ui->win, COLOR_PAIR(CP_BLUE_ON_DEF));
+}
+
+/**
+ * @brief Draw internal containers usage
+ *
+ * Rows that do not fit in the panel are not displayed, the complete
+ * report is written on SIGUSR1.
+ *
+ * @param ui UI structure pointer
+ * @param info Stats panel information
+ */
+static void
+stats_draw_health(ui_t *ui, stats_info_t *info)
+{
+    health_info_t *health = &info->health;
+    char size[16], date[32];
+    struct tm tm;
+    int i, row;
+
+    mvwprintw(ui->win, 3, 3, "Call-ID table:   %zu/%zu (%.1f%% load)", health->callids_count,
+              health->callids_size,
+              (health->callids_size) ? (double) health->callids_count * 100 / health->callids_size : 0);
+    mvwprintw(ui->win, 4, 3, "Longest probe:   %zu", health->callids_probe);
+    if (health->limit) {
+        mvwprintw(ui->win, 5, 3, "Dialogs:         %d/%d (%.1f%% of limit)", health->dialogs, health->limit,
+                  (double) health->dialogs * 100 / health->limit);
+    } else {
+        mvwprintw(ui->win, 5, 3, "Dialogs:         %d (no limit)", health->dialogs);
+    }
+    mvwprintw(ui->win, 6, 3, "Active calls:    %d", health->active);
+    mvwprintw(ui->win, 7, 3, "RTP packets:     %" PRIu64 " (%s stored)", health->rtp_packets,
+              bytes_to_human(health->rtp_memory, size));
+    mvwprintw(ui->win, 8, 3, "Rotated:         %" PRIu64, health->rotated);
+    if (health->rotated_time) {
+        localtime_r(&health->rotated_time, &tm);
+        strftime(date, sizeof(date), "%Y/%m/%d %H:%M:%S", &tm);
+        mvwprintw(ui->win, 9, 3, "Last rotation:   %s", date);
+    } else {
+        mvwprintw(ui->win, 9, 3, "Last rotation:   never");
+    }
+    mvwprintw(ui->win, 10, 3, "TLS connections: %u (%u packets queued)", health->tls_connections,
+              health->tls_pending);
+
+    // Parser queues, three per row
+    row = 12;
+    if (health->nworkers) {
+        mvwprintw(ui->win, row++, 3, "PARSER QUEUES (%u packets each)", health->queue_size);
+        for (i = 0; i < health->nworkers && row < ui->height - 3; i++) {
+            mvwprintw(ui->win, row, 3 + (i % 3) * 18, "#%-3d %u", i, health->queue[i]);
+            if (i % 3 == 2 || i == health->nworkers - 1)
+                row++;
         }
+        row++;
+    }
 
+    // Reassembly containers of each capture source
+    if (row < ui->height - 3)
+        mvwprintw(ui->win, row++, 3, "%-24s %9s %9s %9s", "SOURCE", "IP FRAGS", "MEMORY", "TCP FLOWS");
+    for (i = 0; i < health->nsources && row < ui->height - 3; i++, row++) {
+        mvwprintw(ui->win, row, 3, "%-24.24s %9zu %9s %9zu", health->sources[i].name,
+                  health->sources[i].ip_frags, bytes_to_human(health->sources[i].ip_frags_memory, size),
+                  health->sources[i].tcp_flows);
+    }
+}
+
+#ifdef USE_PROFILE
+/**
+ * @brief Format a stage latency with its unit
+ */
+static const char *
+stats_format_nsecs(uint64_t nsecs, char *out, size_t len)
+{
+    if (nsecs < 10000) {
+        snprintf(out, len, "%" PRIu64 "ns", nsecs);
+    } else if (nsecs < 10000000) {
+        snprintf(out, len, "%" PRIu64 "us", nsecs / 1000);
+    } else {
+        snprintf(out, len, "%" PRIu64 "ms", nsecs / 1000000);
+    }
+    return out;
+}
+
+/**
+ * @brief Draw parsing stages timing counters
+ *
+ * @param ui UI structure pointer
+ */
+static void
+stats_draw_profile(ui_t *ui)
+{
+    profile_counters_t counters;
+    char avg[STATS_NSECS_LEN], p50[STATS_NSECS_LEN], p99[STATS_NSECS_LEN];
+    int i;
+
+    profile_snapshot(&counters);
+
+    mvwprintw(ui->win, STATS_PROFILE_ROW, 3, "%-12s %10s %9s %9s %9s", "STAGE", "COUNT", "AVG", "P50", "P99");
+    for (i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        mvwprintw(ui->win, STATS_PROFILE_ROW + 1 + i, 3, "%-12s %10" PRIu64 " %9s %9s %9s",
+                  profile_stage_name(i), counters.count[i],
+                  stats_format_nsecs(counters.count[i] ? counters.nsecs[i] / counters.count[i] : 0, avg, sizeof(avg)),
+                  stats_format_nsecs(profile_percentile(&counters, i, 50), p50, sizeof(p50)),
+                  stats_format_nsecs(profile_percentile(&counters, i, 99), p99, sizeof(p99)));
+    }
+}
+#endif
+
+int
+stats_draw(ui_t *ui)
+{
+    stats_info_t *info;
+    sip_counters_t stats;
+    int dtotal, dcalls, i;
+    time_t now;
+
+    if (!(info = stats_info(ui)))
+        return -1;
+
+    // Get stored dialogs counters
+    stats = sip_calls_counters();
+    dtotal = sip_calls_count();
+    for (dcalls = 0, i = 0; i < SIP_CALLSTATE_COUNT; i++)
+        dcalls += stats.states[i];
+
+    // Update rates once per second
+    now = time(NULL);
+    if (now != info->last_time) {
+        // Rotated or cleared dialogs are not part of the rates
+        info->msgs_rate = info->rtp_rate = 0;
+        if (info->last_time && stats.msgs >= info->last.msgs)
+            info->msgs_rate = (stats.msgs - info->last.msgs) / (now - info->last_time);
+        if (info->last_time && stats.rtp_packets >= info->last.rtp_packets)
+            info->rtp_rate = (stats.rtp_packets - info->last.rtp_packets) / (now - info->last_time);
+        info->last = stats;
+        info->last_time = now;
+        // Finding top consumers requires walking all stored calls
+        stats_update_memory_top(info);
+        // Containers longest probe requires walking the Call-ID table
+        if (info->show_health)
+            health_sample(&info->health);
+    }
+
+    // Clear previous counters
+    for (i = 3; i < ui->height - 3; i++) {
+        if (i != 10 && i != STATS_MEMORY_ROW - 1 && i != STATS_PROFILE_ROW - 1)
+            mvwprintw(ui->win, i, 1, "%*s", ui->width - 2, "");
+    }
+
+    // Sections lines are only displayed with counters
+    stats_draw_separator(ui, 10, !info->show_health);
+    stats_draw_separator(ui, STATS_MEMORY_ROW - 1, !info->show_health);
+#ifdef USE_PROFILE
+    stats_draw_separator(ui, STATS_PROFILE_ROW - 1, !info->show_health);
+#endif
+
+    // Print internal containers usage instead of counters
+    if (info->show_health) {
+        stats_draw_health(ui, info);
+        return 0;
+    }
+
+    // Print stored calls memory usage
+    stats_draw_memory(ui, info);
+
+#ifdef USE_PROFILE
+    // Print parsing stages timing
+    stats_draw_profile(ui);
+#endif
 
+    // Ignore this screen when no dialog exists
+    if (!dtotal) {
+        mvwprintw(ui->win, 3, 3, "No information to display");
+        return 0;
     }
 
     // Print parses data
-    mvwprintw(ui->win, 3,  3,  "Dialogs: %d", stats.dtotal);
-    mvwprintw(ui->win, 4,  3,  "Calls: %d (%.1f\%)", stats.dcalls, (float) stats.dcalls * 100 / stats.dtotal);
-    mvwprintw(ui->win, 5,  3,  "Messages: %d", stats.mtotal);
+    mvwprintw(ui->win, 3,  3,  "Dialogs: %d", dtotal);
+    mvwprintw(ui->win, 4,  3,  "Calls: %d (%.1f\%)", dcalls, (float) dcalls * 100 / dtotal);
+    mvwprintw(ui->win, 5,  3,  "Messages: %" PRIu64, stats.msgs);
+    mvwprintw(ui->win, 6,  3,  "Messages/s: %" PRIu64, info->msgs_rate);
+    mvwprintw(ui->win, 7,  3,  "RTP Streams: %" PRIu64, stats.streams);
+    mvwprintw(ui->win, 8,  3,  "RTP Packets: %" PRIu64, stats.rtp_packets);
+    mvwprintw(ui->win, 9,  3,  "RTP Packets/s: %" PRIu64, info->rtp_rate);
     // Print status of calls if any
-    if (stats.dcalls) {
-        mvwprintw(ui->win, 3,  33, "COMPLETED:  %d (%.1f\%)", stats.completed, (float) stats.completed * 100 / stats.dcalls);
-        mvwprintw(ui->win, 4,  33, "CANCELLED:  %d (%.1f\%)", stats.cancelled, (float) stats.cancelled * 100 / stats.dcalls);
-        mvwprintw(ui->win, 5,  33, "IN CALL:    %d (%.1f\%)", stats.incall,    (float) stats.incall * 100 / stats.dcalls);
-        mvwprintw(ui->win, 6,  33, "REJECTED:   %d (%.1f\%)", stats.rejected,  (float) stats.rejected * 100 / stats.dcalls);
-        mvwprintw(ui->win, 7,  33, "BUSY:       %d (%.1f\%)", stats.busy,      (float) stats.busy * 100 / stats.dcalls);
-        mvwprintw(ui->win, 8,  33, "DIVERTED:   %d (%.1f\%)", stats.diverted,  (float) stats.diverted * 100 / stats.dcalls);
-        mvwprintw(ui->win, 9,  33, "CALL SETUP: %d (%.1f\%)", stats.setup,     (float) stats.setup * 100 / stats.dcalls);
-    }
-
-    mvwprintw(ui->win, 11, 3, "INVITE:    %d (%.1f\%)", stats.invite,    (float) stats.invite * 100 / stats.mtotal);
-    mvwprintw(ui->win, 12, 3, "REGISTER:  %d (%.1f\%)", stats.regist,    (float) stats.regist * 100 / stats.mtotal);
-    mvwprintw(ui->win, 13, 3, "SUBSCRIBE: %d (%.1f\%)", stats.subscribe, (float) stats.subscribe * 100 / stats.mtotal);
-    mvwprintw(ui->win, 14, 3, "UPDATE:    %d (%.1f\%)", stats.update,    (float) stats.update * 100 / stats.mtotal);
-    mvwprintw(ui->win, 15, 3, "NOTIFY:    %d (%.1f\%)", stats.notify,    (float) stats.notify * 100 / stats.mtotal);
-    mvwprintw(ui->win, 16, 3, "OPTIONS:   %d (%.1f\%)", stats.options,   (float) stats.options * 100 / stats.mtotal);
-    mvwprintw(ui->win, 17, 3, "PUBLISH:   %d (%.1f\%)", stats.publish,   (float) stats.publish * 100 / stats.mtotal);
-    mvwprintw(ui->win, 18, 3, "MESSAGE:   %d (%.1f\%)", stats.message,   (float) stats.message * 100 / stats.mtotal);
-    mvwprintw(ui->win, 19, 3, "INFO:      %d (%.1f\%)", stats.info,      (float) stats.info * 100 / stats.mtotal);
-    mvwprintw(ui->win, 20, 3, "BYE:       %d (%.1f\%)", stats.bye,       (float) stats.bye * 100 / stats.mtotal);
-    mvwprintw(ui->win, 21, 3, "CANCEL:    %d (%.1f\%)", stats.cancel,    (float) stats.cancel * 100 / stats.mtotal);
-
-    mvwprintw(ui->win, 11, 33, "1XX: %d (%.1f\%)", stats.r100, (float) stats.r100 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 12, 33, "2XX: %d (%.1f\%)", stats.r200, (float) stats.r200 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 13, 33, "3XX: %d (%.1f\%)", stats.r300, (float) stats.r300 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 14, 33, "4XX: %d (%.1f\%)", stats.r400, (float) stats.r400 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 15, 33, "5XX: %d (%.1f\%)", stats.r500, (float) stats.r500 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 16, 33, "6XX: %d (%.1f\%)", stats.r600, (float) stats.r600 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 17, 33, "7XX: %d (%.1f\%)", stats.r700, (float) stats.r700 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 18, 33, "8XX: %d (%.1f\%)", stats.r800, (float) stats.r800 * 100 / stats.mtotal);
+    if (dcalls) {
+        mvwprintw(ui->win, 3,  33, "COMPLETED:  %d (%.1f\%)", stats.states[SIP_CALLSTATE_COMPLETED], (float) stats.states[SIP_CALLSTATE_COMPLETED] * 100 / dcalls);
+        mvwprintw(ui->win, 4,  33, "CANCELLED:  %d (%.1f\%)", stats.states[SIP_CALLSTATE_CANCELLED], (float) stats.states[SIP_CALLSTATE_CANCELLED] * 100 / dcalls);
+        mvwprintw(ui->win, 5,  33, "IN CALL:    %d (%.1f\%)", stats.states[SIP_CALLSTATE_INCALL],    (float) stats.states[SIP_CALLSTATE_INCALL] * 100 / dcalls);
+        mvwprintw(ui->win, 6,  33, "REJECTED:   %d (%.1f\%)", stats.states[SIP_CALLSTATE_REJECTED],  (float) stats.states[SIP_CALLSTATE_REJECTED] * 100 / dcalls);
+        mvwprintw(ui->win, 7,  33, "BUSY:       %d (%.1f\%)", stats.states[SIP_CALLSTATE_BUSY],      (float) stats.states[SIP_CALLSTATE_BUSY] * 100 / dcalls);
+        mvwprintw(ui->win, 8,  33, "DIVERTED:   %d (%.1f\%)", stats.states[SIP_CALLSTATE_DIVERTED],  (float) stats.states[SIP_CALLSTATE_DIVERTED] * 100 / dcalls);
+        mvwprintw(ui->win, 9,  33, "CALL SETUP: %d (%.1f\%)", stats.states[SIP_CALLSTATE_CALLSETUP], (float) stats.states[SIP_CALLSTATE_CALLSETUP] * 100 / dcalls);
+    }
+
+    if (!stats.msgs)
+        return 0;
+
+    mvwprintw(ui->win, 11, 3, "INVITE:    %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_INVITE],    (float) stats.methods[SIP_METHOD_INVITE] * 100 / stats.msgs);
+    mvwprintw(ui->win, 12, 3, "REGISTER:  %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_REGISTER],  (float) stats.methods[SIP_METHOD_REGISTER] * 100 / stats.msgs);
+    mvwprintw(ui->win, 13, 3, "SUBSCRIBE: %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_SUBSCRIBE], (float) stats.methods[SIP_METHOD_SUBSCRIBE] * 100 / stats.msgs);
+    mvwprintw(ui->win, 14, 3, "UPDATE:    %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_UPDATE],    (float) stats.methods[SIP_METHOD_UPDATE] * 100 / stats.msgs);
+    mvwprintw(ui->win, 15, 3, "NOTIFY:    %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_NOTIFY],    (float) stats.methods[SIP_METHOD_NOTIFY] * 100 / stats.msgs);
+    mvwprintw(ui->win, 16, 3, "OPTIONS:   %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_OPTIONS],   (float) stats.methods[SIP_METHOD_OPTIONS] * 100 / stats.msgs);
+    mvwprintw(ui->win, 17, 3, "PUBLISH:   %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_PUBLISH],   (float) stats.methods[SIP_METHOD_PUBLISH] * 100 / stats.msgs);
+    mvwprintw(ui->win, 18, 3, "MESSAGE:   %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_MESSAGE],   (float) stats.methods[SIP_METHOD_MESSAGE] * 100 / stats.msgs);
+    mvwprintw(ui->win, 19, 3, "INFO:      %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_INFO],      (float) stats.methods[SIP_METHOD_INFO] * 100 / stats.msgs);
+    mvwprintw(ui->win, 20, 3, "BYE:       %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_BYE],       (float) stats.methods[SIP_METHOD_BYE] * 100 / stats.msgs);
+    mvwprintw(ui->win, 21, 3, "CANCEL:    %" PRIu64 " (%.1f\%)", stats.methods[SIP_METHOD_CANCEL],    (float) stats.methods[SIP_METHOD_CANCEL] * 100 / stats.msgs);
+
+    for (i = 1; i < SIP_RESPONSE_CLASSES; i++) {
+        mvwprintw(ui->win, 10 + i, 33, "%dXX: %" PRIu64 " (%.1f\%)", i, stats.responses[i],
+                  (float) stats.responses[i] * 100 / stats.msgs);
+    }
+
+    mvwprintw(ui->win, 20, 33, "FRAG EXPIRED:    %u", capture_ip_frags_expired());
+    mvwprintw(ui->win, 21, 33, "FRAG INCOMPLETE: %u", capture_ip_frags_incomplete());
+
+    return 0;
+}
+
+int
+stats_handle_key(ui_t *ui, int key)
+{
+    stats_info_t *info;
+    int action = -1;
+
+    if (!(info = stats_info(ui)))
+        return KEY_NOT_HANDLED;
+
+    // Check actions for this key
+    while ((action = key_find_action(key, action)) != ERR) {
+        // Check if we handle this action
+        switch (action) {
+            case ACTION_SHOW_STATS:
+                // Toggle internal containers usage report
+                info->show_health = !info->show_health;
+                if (info->show_health)
+                    health_sample(&info->health);
+                break;
+            default:
+                // Parse next action
+                continue;
+        }
+
+        // This panel has handled the key successfully
+        break;
+    }
+
+    // Return if this panel has handled or not the key
+    return (action == ERR) ? KEY_NOT_HANDLED : KEY_HANDLED;
 }
@@ -28,6 +28,73 @@
 #ifndef __SNGREP_UI_STATS_H
 #define __SNGREP_UI_STATS_H
 
+#include "config.h"
+#include <time.h>
+#include "ui_manager.h"
+#include "profile.h"
+#include "health.h"
+
+//! First row of memory usage counters
+#define STATS_MEMORY_ROW 23
+//! Number of calls listed as top memory consumers
+#define STATS_MEMORY_TOP 5
+//! Max displayed length of top memory consumers Call-ID
+#define STATS_MEMORY_CALLID 24
+//! First row of parsing stages timing counters
+#define STATS_PROFILE_ROW (STATS_MEMORY_ROW + CALL_MEMORY_COUNT + 4)
+//! Longest formatted stage latency: 20 digits, unit and NUL
+#define STATS_NSECS_LEN 24
+#ifdef USE_PROFILE
+#define STATS_HEIGHT (STATS_PROFILE_ROW + PROFILE_STAGE_COUNT + 4)
+#else
+#define STATS_HEIGHT (STATS_PROFILE_ROW + 2)
+#endif
+
+//! Sorter declaration of struct stats_info
+typedef struct stats_info stats_info_t;
+//! Sorter declaration of struct stats_memory_call
+typedef struct stats_memory_call stats_memory_call_t;
+
+/**
+ * @brief Stored call using a lot of memory
+ *
+ * Calls attributes are copied, as the call may be removed before
+ * the panel is drawn again.
+ */
+struct stats_memory_call {
+    //! Call index
+    int index;
+    //! Memory used by the call
+    size_t memory;
+    //! Call-ID of the call
+    char callid[STATS_MEMORY_CALLID + 1];
+};
+
+/**
+ * @brief Stats panel status information
+ *
+ * Counters are read from storage each time the panel is drawn. Last
+ * read counters are kept to display per second rates.
+ */
+struct stats_info {
+    //! Counters when rates were last calculated
+    sip_counters_t last;
+    //! Time when rates were last calculated
+    time_t last_time;
+    //! Stored messages per second
+    uint64_t msgs_rate;
+    //! Stored RTP packets per second
+    uint64_t rtp_rate;
+    //! Calls using more memory when rates were last calculated
+    stats_memory_call_t top[STATS_MEMORY_TOP];
+    //! Number of calls in top memory consumers
+    int top_count;
+    //! Display internal containers usage instead of counters
+    bool show_health;
+    //! Internal containers usage when rates were last calculated
+    health_info_t health;
+};
+
 /**
  * @brief Creates a new stats panel
  *
@@ -41,4 +108,46 @@
 void
 stats_create(ui_t *ui);
 
+/**
+ * @brief Destroy stats panel
+ *
+ * @param ui UI structure pointer
+ */
+void
+stats_destroy(ui_t *ui);
+
+/**
+ * @brief Get custom information of given panel
+ *
+ * @param ui UI structure pointer
+ * @return a pointer to info structure of given panel
+ */
+stats_info_t *
+stats_info(ui_t *ui);
+
+/**
+ * @brief Draw stats panel counters
+ *
+ * Stored dialogs counters are maintained while packets are parsed, so
+ * drawing does not depend on the number of stored dialogs. Only the top
+ * memory consumers walk all stored dialogs, once per second.
+ *
+ * @param ui UI structure pointer
+ * @return 0 if the panel has been drawn, -1 otherwise
+ */
+int
+stats_draw(ui_t *ui);
+
+/**
+ * @brief Handle stats panel keys
+ *
+ * Stats key toggles the internal containers usage report.
+ *
+ * @param ui UI structure pointer
+ * @param key key pressed by user
+ * @return enum @key_handler_ret
+ */
+int
+stats_handle_key(ui_t *ui, int key);
+
 #endif /* __SNGREP_UI_STATS_H */
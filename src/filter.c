@@ -26,19 +26,215 @@
  * @brief Source code of functions defined in filter.h
  *
  */
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include "sip.h"
+#include "setting.h"
 #include "curses/ui_call_list.h"
 #include "filter.h"
+#include "parallel.h"
+#include "history.h"
+
+//! Cost of filter checks, from cheapest to most expensive
+enum filter_cost {
+    //! Lookup of the first message method in the matching methods
+    FILTER_COST_METHODS = 0,
+    //! Search of a literal text in a call attribute
+    FILTER_COST_LITERAL,
+    //! Regular expression match of a call attribute
+    FILTER_COST_REGEX,
+    //! Render of the call list line
+    FILTER_COST_LINE,
+    //! Match of call messages payloads
+    FILTER_COST_PAYLOAD,
+};
 
 //! Storage of filter information
 filter_t filters[FILTER_COUNT] = { };
+//! Enabled filter types sorted by evaluation cost
+static int filter_plan[FILTER_COUNT];
+//! Number of enabled filters in the evaluation plan
+static int filter_plan_count = 0;
+//! Filters generation, calls evaluated with a different one must be checked again
+static uint32_t filter_gen = 1;
+//! Next call position to be evaluated by the running pass (-1 if none)
+static int filter_pass = -1;
+//! Index messages payload trigrams
+static bool filter_index = false;
+//! Trigrams required by the payload filter
+static trigram_query_t filter_query;
+#if defined(WITH_PCRE2)
+//! Match results of filter checks made by each thread
+static __thread pcre2_match_data *filter_match_data;
+#endif
+
+/**
+ * @brief Check if data contains the filter literal text
+ *
+ * Search is case insensitive, as filter expressions are.
+ */
+static bool
+filter_literal_find(filter_t *filter, const char *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + filter->literal_len <= len; i++) {
+        if (tolower((unsigned char) data[i]) == filter->literal[0]
+            && !strncasecmp(data + i, filter->literal, filter->literal_len))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check if data matches the filter using its cheaper checks first
+ *
+ * @return 0 if the given data matches the filter
+ */
+static int
+filter_check_value(filter_t *filter, const char *data, size_t len)
+{
+    // Data without the required literal can not match the expression
+    if (filter->literal && !filter_literal_find(filter, data, len))
+        return 1;
+
+    // Expression is the literal itself
+    if (filter->exact)
+        return 0;
+
+    return filter_check_expr(*filter, data, len);
+}
+
+/**
+ * @brief Sort enabled filters by their evaluation cost
+ */
+static void
+filter_plan_update()
+{
+    int i, j;
+
+    filter_plan_count = 0;
+    for (i = 0; i < FILTER_COUNT; i++) {
+        if (!filters[i].expr)
+            continue;
+        // Filters with the same cost keep their type order
+        for (j = filter_plan_count++; j > 0 && filters[filter_plan[j - 1]].cost > filters[i].cost; j--)
+            filter_plan[j] = filter_plan[j - 1];
+        filter_plan[j] = i;
+    }
+}
+
+/**
+ * @brief Calculate the cheaper checks of a filter expression
+ *
+ * Expressions without alternatives, groups, classes or optional items
+ * can only match data containing their longest literal text, and they
+ * don't need the regular expression at all if they are literal text.
+ * Method filter is also evaluated against all request method names, so
+ * calls starting with a request only need to lookup their method.
+ *
+ * @param type Type of the filter
+ */
+static void
+filter_compile(int type)
+{
+    filter_t *filter = &filters[type];
+    const char *expr = filter->expr, *run, *best = NULL;
+    size_t len, best_len = 0, i;
+    const char *name;
+    int method;
+
+    // Remove previous checks
+    sng_free(filter->literal);
+    filter->literal = NULL;
+    filter->literal_len = 0;
+    filter->exact = false;
+    filter->methods = 0;
+
+    if (expr) {
+        if (!strpbrk(expr, "|?*{}()[]\\")) {
+            // Find the longest text between remaining special characters
+            for (run = expr; *run; run += len + (run[len] != '\0')) {
+                len = strcspn(run, ".^$+");
+                if (len > best_len) {
+                    best = run;
+                    best_len = len;
+                }
+            }
+            if (best_len && (filter->literal = sng_malloc(best_len + 1))) {
+                for (i = 0; i < best_len; i++)
+                    filter->literal[i] = tolower((unsigned char) best[i]);
+                filter->literal_len = best_len;
+                filter->exact = (best_len == strlen(expr));
+            }
+        }
+
+        // Calculate which request methods match the expression
+        if (type == FILTER_METHOD) {
+            for (method = 1; method < SIP_METHOD_COUNT; method++) {
+                if ((name = sip_method_str(method)) && filter_check_value(filter, name, strlen(name)) == 0)
+                    filter->methods |= 1 << method;
+            }
+        }
+    }
+
+    switch (type) {
+        case FILTER_METHOD:
+            filter->cost = FILTER_COST_METHODS;
+            break;
+        case FILTER_PAYLOAD:
+            filter->cost = FILTER_COST_PAYLOAD;
+            break;
+        case FILTER_CALL_LIST:
+            filter->cost = FILTER_COST_LINE;
+            break;
+        default:
+            filter->cost = (filter->exact) ? FILTER_COST_LITERAL : FILTER_COST_REGEX;
+            break;
+    }
+
+    filter_plan_update();
+}
 
 int
 filter_set(int type, const char *expr)
 {
-#ifdef WITH_PCRE
+    // Nothing to do if expression has not changed
+    if ((!expr && !filters[type].expr)
+        || (expr && filters[type].expr && !strcmp(expr, filters[type].expr)))
+        return 0;
+
+#if defined(WITH_PCRE2)
+    pcre2_code *regex = NULL;
+
+    // If we have an expression, check if compiles before changing the filter
+    if (expr) {
+        int re_err;
+        PCRE2_SIZE err_offset;
+
+        // Check if we have a valid expression
+        if (!(regex = pcre2_compile((PCRE2_SPTR) expr, PCRE2_ZERO_TERMINATED, PCRE2_UNGREEDY | PCRE2_CASELESS,
+                                    &re_err, &err_offset, NULL)))
+            return 1;
+
+        // JIT is optional, interpreted matching is used if not available
+        pcre2_jit_compile(regex, PCRE2_JIT_COMPLETE);
+    }
+
+    // Remove previous value
+    if (filters[type].expr) {
+        sng_free(filters[type].expr);
+        pcre2_code_free(filters[type].regex);
+    }
+
+    // Set new expresion values
+    filters[type].expr = (expr) ? strdup(expr) : NULL;
+    filters[type].regex = regex;
+
+#elif defined(WITH_PCRE)
     pcre *regex = NULL;
 
     // If we have an expression, check if compiles before changing the filter
@@ -82,6 +278,15 @@ filter_set(int type, const char *expr)
     memcpy(&filters[type].regex, &regex, sizeof(regex));
 #endif
 
+    // Calculate the cheaper checks of the new expression
+    filter_compile(type);
+
+    // Payload filter only checks calls with its trigrams
+    if (type == FILTER_PAYLOAD)
+        trigram_query_compile(&filter_query, expr);
+
+    // Evaluate all calls with the new filter
+    filter_reset_calls();
     return 0;
 }
 
@@ -91,99 +296,301 @@ filter_get(int type)
     return filters[type].expr;
 }
 
-int
-filter_check_call(void *item)
+/**
+ * @brief Calculate the filtered flag of a call
+ *
+ * If filters have not changed since the last evaluation, only the
+ * messages added to the call after that evaluation are checked.
+ *
+ * @param call Call to be checked
+ */
+static void
+filter_update_call(sip_call_t *call)
 {
-    int i;
+    int i, j, k, zcount;
     char data[MAX_SIP_PAYLOAD];
-    sip_call_t *call = (sip_call_t*) item;
+    const char *value;
+    u_char *zpayloads, *zpayload;
     sip_msg_t *msg;
     vector_iter_t it;
 
-    // Dont filter calls without messages
-    if (call_msg_count(call) == 0)
-        return 0;
+    // Filters have changed, evaluate all call messages
+    if (call->filter_gen != filter_gen) {
+        call->filter_gen = filter_gen;
+        call->filter_payload = 0;
+    }
 
-    // Filter for this call has already be processed
-    if (call->filtered != -1)
-        return (call->filtered == 0);
+    // Store the number of messages used for this evaluation
+    call->filter_msgs = call_msg_count(call);
 
     // By default, call matches all filters
     call->filtered = 0;
 
-    // Check all filter types
-    for (i=0; i < FILTER_COUNT; i++) {
-        // If filter is not enabled, go to the next
-        if (!filters[i].expr)
-            continue;
+    // Check enabled filters from the cheapest one
+    for (k = 0; k < filter_plan_count; k++) {
+        i = filter_plan[k];
 
         // Initialize
-        memset(data, 0, sizeof(data));
+        data[0] = '\0';
+        value = NULL;
 
         // Get filtered field
         switch(i) {
             case FILTER_SIPFROM:
-                call_get_attribute(call, SIP_ATTR_SIPFROM, data);
+                value = call_attr_text(call, SIP_ATTR_SIPFROM);
                 break;
             case FILTER_SIPTO:
-                call_get_attribute(call, SIP_ATTR_SIPTO, data);
+                value = call_attr_text(call, SIP_ATTR_SIPTO);
                 break;
             case FILTER_SOURCE:
-                call_get_attribute(call, SIP_ATTR_SRC, data);
+                value = call_attr_text(call, SIP_ATTR_SRC);
                 break;
             case FILTER_DESTINATION:
-                call_get_attribute(call, SIP_ATTR_DST, data);
+                value = call_attr_text(call, SIP_ATTR_DST);
                 break;
             case FILTER_METHOD:
-                call_get_attribute(call, SIP_ATTR_METHOD, data);
+                // Calls starting with a request only need their method
+                msg = vector_first(call->msgs);
+                if (msg->reqresp > 0 && msg->reqresp < SIP_METHOD_COUNT) {
+                    if (!(filters[i].methods & (1 << msg->reqresp))) {
+                        call->filtered = 1;
+                        return;
+                    }
+                    continue;
+                }
+                value = call_attr_text(call, SIP_ATTR_METHOD);
                 break;
             case FILTER_PAYLOAD:
                 break;
             case FILTER_CALL_LIST:
                 // FIXME Maybe call should know hot to calculate this line
-                call_list_line_text(ui_find_by_type(PANEL_CALL_LIST), call, data);
+                value = call_list_line_text(ui_find_by_type(PANEL_CALL_LIST), call, data);
                 break;
             default:
                 // Unknown filter id
-                return 0;
+                return;
         }
 
-        // For payload filtering, check all messages payload
+        // For payload filtering, check messages not checked yet
         if (i == FILTER_PAYLOAD) {
-            // Assume this call doesn't match the filter
-            call->filtered = 1;
-            // Create an iterator for the call messages
-            it = vector_iterator(call->msgs);
-            while ((msg = vector_iterator_next(&it))) {
-                // Copy message payload
-                strcpy(data, msg_get_payload(msg));
-                // Check if this payload matches the filter
-                if (filter_check_expr(filters[i], data) == 0) {
-                    call->filtered = 0;
-                    break;
+            // Payloads don't contain some of the filter trigrams
+            if (call->filter_payload >= 0 && call->payload_sig
+                && !trigram_sig_match(call->payload_sig, &filter_query)) {
+                call->filtered = 1;
+                break;
+            }
+            if (call->filter_payload >= 0) {
+                // Compressed payloads are checked without restoring the call
+                zpayload = zpayloads = call_compressed_payloads(call);
+                zcount = (zpayloads) ? call->zblock->count : 0;
+                for (j = 0; j < call->filter_payload && j < zcount; j++)
+                    zpayload += call->zblock->packets[j]->payload_len + 1;
+                // Create an iterator for the call messages
+                it = vector_iterator(call->msgs);
+                vector_iterator_set_current(&it, call->filter_payload - 1);
+                while ((msg = vector_iterator_next(&it))) {
+                    if (msg->index < zcount) {
+                        value = (const char *) zpayload;
+                        zpayload += packet_payloadlen(msg->packet) + 1;
+                    } else {
+                        value = msg_get_payload(msg);
+                    }
+                    // Check if this payload matches the filter
+                    if (filter_check_value(&filters[i], value, packet_payloadlen(msg->packet)) == 0) {
+                        call->filter_payload = -1;
+                        break;
+                    }
+                    call->filter_payload++;
                 }
+                free(zpayloads);
             }
-            if (call->filtered == 1)
+            // None of the messages matched the filter
+            if (call->filter_payload != -1) {
+                call->filtered = 1;
                 break;
+            }
         } else {
             // Check the filter against given data
-            if (filter_check_expr(filters[i], data) != 0) {
+            if (filter_check_value(&filters[i], value ? value : "", value ? strlen(value) : 0) != 0) {
                 // The data didn't matched the filter
                 call->filtered = 1;
                 break;
             }
         }
     }
+}
+
+void
+filter_index_init()
+{
+    filter_index = setting_enabled(SETTING_FILTER_PAYLOAD_INDEX);
+}
+
+void
+filter_index_msg(sip_call_t *call, sip_msg_t *msg)
+{
+    if (!filter_index)
+        return;
+
+    // Calls are only indexed from their first message
+    if (!call->payload_sig) {
+        if (call_msg_count(call))
+            return;
+        if (!(call->payload_sig = arena_alloc(call->arena, TRIGRAM_SIG_SIZE)))
+            return;
+    }
+
+    trigram_sig_add(call->payload_sig, msg_get_payload(msg), packet_payloadlen(msg->packet));
+}
+
+int
+filter_check_call(void *item)
+{
+    sip_call_t *call = (sip_call_t*) item;
+
+    // Dont filter calls without messages
+    if (call_msg_count(call) == 0)
+        return 0;
+
+    // Only evaluate calls with new filters or messages
+    if (call->filter_gen != filter_gen || call->filter_msgs != call_msg_count(call))
+        filter_update_call(call);
 
     // Return the final filter status
     return (call->filtered == 0);
 }
 
 int
-filter_check_expr(filter_t filter, const char *data)
+filter_check_history(uint32_t row)
 {
-#ifdef WITH_PCRE
-        return pcre_exec(filter.regex, 0, data, strlen(data), 0, 0, 0, 0);
+    char data[MAX_SIP_PAYLOAD];
+    const char *value;
+    int i, k;
+
+    // Check enabled filters from the cheapest one
+    for (k = 0; k < filter_plan_count; k++) {
+        i = filter_plan[k];
+
+        // Get filtered field
+        data[0] = '\0';
+        switch (i) {
+            case FILTER_SIPFROM:
+                value = history_attr_text(row, SIP_ATTR_SIPFROM);
+                break;
+            case FILTER_SIPTO:
+                value = history_attr_text(row, SIP_ATTR_SIPTO);
+                break;
+            case FILTER_SOURCE:
+                value = history_attr_text(row, SIP_ATTR_SRC);
+                break;
+            case FILTER_DESTINATION:
+                value = history_attr_text(row, SIP_ATTR_DST);
+                break;
+            case FILTER_METHOD:
+                value = history_attr_text(row, SIP_ATTR_METHOD);
+                break;
+            case FILTER_CALL_LIST:
+                value = call_list_history_line_text(ui_find_by_type(PANEL_CALL_LIST), row, data);
+                break;
+            default:
+                // Payloads of rotated calls are not stored
+                return 0;
+        }
+
+        // Check the filter against given data
+        if (filter_check_value(&filters[i], value ? value : "", value ? strlen(value) : 0) != 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+int
+filter_pass_check_call(void *item)
+{
+    sip_call_t *call = (sip_call_t*) item;
+
+    // Calls not reached by the running pass are not displayed yet
+    if (filter_pass >= 0 && call->filter_gen != filter_gen)
+        return 0;
+
+    return filter_check_call(item);
+}
+
+bool
+filter_pass_pending()
+{
+    return filter_pass >= 0;
+}
+
+/**
+ * @brief Evaluate a chunk of the calls of the running pass
+ *
+ * This runs in parallel threads, so it only modifies the checked calls.
+ */
+static void
+filter_pass_check_range(void *data, int start, int end)
+{
+    sip_call_t **calls = data;
+    int i;
+
+    for (i = start; i < end; i++)
+        filter_check_call(calls[i]);
+}
+
+bool
+filter_pass_step(int msecs)
+{
+    vector_t *list = sip_calls_vector();
+    struct timespec start, now;
+    sip_call_t **calls, *call;
+    int i, count;
+
+    if (filter_pass < 0)
+        return false;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (filter_pass < vector_count(list)) {
+        // Evaluate next calls using all threads
+        calls = (sip_call_t **) vector_list(list) + filter_pass;
+        count = vector_count(list) - filter_pass;
+        if (count > FILTER_PASS_CHECK * parallel_threads())
+            count = FILTER_PASS_CHECK * parallel_threads();
+        parallel_for(count, FILTER_PASS_CHUNK, filter_pass_check_range, calls);
+
+        // Display evaluated calls
+        for (i = 0; i < count; i++)
+            sip_calls_view_update(calls[i]);
+        filter_pass += count;
+
+        // Check elapsed time after each evaluated batch
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= msecs)
+            return true;
+    }
+
+    // Calls moved in the list while pass was running may have been skipped
+    for (filter_pass = 0; filter_pass < vector_count(list); filter_pass++) {
+        call = vector_item(list, filter_pass);
+        if (call->filter_gen != filter_gen && call_msg_count(call))
+            return true;
+    }
+
+    // All calls have been evaluated
+    filter_pass = -1;
+    return false;
+}
+
+int
+filter_check_expr(filter_t filter, const char *data, size_t len)
+{
+#if defined(WITH_PCRE2)
+        // Only match result is used, so one pair of offsets is enough
+        if (!filter_match_data && !(filter_match_data = pcre2_match_data_create(1, NULL)))
+            return 1;
+        return pcre2_match(filter.regex, (PCRE2_SPTR) data, len, 0, 0, filter_match_data, NULL) < 0;
+#elif defined(WITH_PCRE)
+        return pcre_exec(filter.regex, 0, data, len, 0, 0, 0, 0);
 #else
         // Call doesn't match this filter
         return regexec(&filter.regex, data, 0, NULL, 0);
@@ -193,10 +600,11 @@ filter_check_expr(filter_t filter, const char *data)
 void
 filter_reset_calls()
 {
-    sip_call_t *call;
-    vector_iter_t calls = sip_calls_iterator();
+    // Force filter evaluation of all calls in a new pass
+    filter_gen++;
+    filter_pass = 0;
 
-    // Force filter evaluation
-    while ((call = vector_iterator_next(&calls)))
-        call->filtered = -1;
+    // Calls will be displayed again once evaluated
+    sip_calls_view_reset();
+    history_view_reset();
 }
@@ -41,12 +41,26 @@
 #define __SNGREP_FILTER_H_
 
 #include "config.h"
-#ifdef WITH_PCRE
+#if defined(WITH_PCRE2)
+#ifndef PCRE2_CODE_UNIT_WIDTH
+#define PCRE2_CODE_UNIT_WIDTH 8
+#endif
+#include <pcre2.h>
+#elif defined(WITH_PCRE)
 #include <pcre.h>
 #else
 #include <regex.h>
 #endif
+#include <stdbool.h>
 #include "sip.h"
+#include "trigram.h"
+
+//! Max time evaluating calls in each pass step (ms)
+#define FILTER_PASS_STEP 50
+//! Number of calls evaluated by each thread between pass elapsed time checks
+#define FILTER_PASS_CHECK 256
+//! Number of calls evaluated by a thread at once
+#define FILTER_PASS_CHUNK 64
 
 //! Shorter declaration of sip_call_group structure
 typedef struct filter filter_t;
@@ -79,13 +93,26 @@ enum filter_type {
 struct filter {
     //! The filter text
     char *expr;
-#ifdef WITH_PCRE
+#if defined(WITH_PCRE2)
+    //! The filter compiled expression
+    pcre2_code *regex;
+#elif defined(WITH_PCRE)
     //! The filter compiled expression
     pcre *regex;
 #else
     //! The filter compiled expression
     regex_t regex;
 #endif
+    //! Lowercase text that any matching data must contain (NULL if none)
+    char *literal;
+    //! Length of the required literal text
+    size_t literal_len;
+    //! Data containing the literal text always matches the expression
+    bool exact;
+    //! Bitmask of request methods whose names match the expression
+    uint32_t methods;
+    //! Evaluation cost, cheapest filters are checked first
+    int cost;
 };
 
 /**
@@ -111,28 +138,99 @@ filter_set(int type, const char *expr);
 const char *
 filter_get(int type);
 
+/**
+ * @brief Enable payload index if configured
+ *
+ * Index must be enabled before any message is stored, calls created
+ * without index are always checked using the payload filter expression.
+ */
+void
+filter_index_init();
+
+/**
+ * @brief Add a message payload to its call trigrams index
+ *
+ * Calls only check the payload filter expression if their messages
+ * contain all the trigrams required by the expression.
+ *
+ * @param call Call owner of the message
+ * @param msg Message being added to the call
+ */
+void
+filter_index_msg(sip_call_t *call, sip_msg_t *msg);
+
 /**
  * @brief Check if a call if filtered
  *
+ * Filter status is cached in the call and only calculated again if
+ * filters have changed or call has new messages. In the later case,
+ * only new messages are checked against the payload filter.
+ *
+ * Enabled filters are checked from the cheapest to the most expensive
+ * one and the evaluation stops with the first filter not matching.
+ *
  * @param call Call to be checked
- * @return 1 if call is filtered
+ * @return 1 if call matches the filters
  */
 int
 filter_check_call(void *item);
 
+/**
+ * @brief Check if a call is filtered without waiting the running pass
+ *
+ * Same as filter_check_call, but calls not evaluated yet by the running
+ * pass are considered not matching, so they will be displayed once the
+ * pass reaches them.
+ *
+ * @param call Call to be checked
+ * @return 1 if call matches the filters
+ */
+int
+filter_pass_check_call(void *item);
+
+/**
+ * @brief Check if there is a pass evaluating all calls with new filters
+ */
+bool
+filter_pass_pending();
+
+/**
+ * @brief Continue evaluating calls with new filters
+ *
+ * @param msecs Max time evaluating calls in milliseconds
+ * @return true if pass has not finished yet
+ */
+bool
+filter_pass_step(int msecs);
+
+/**
+ * @brief Check if a history record matches all enabled filters
+ *
+ * Records never match payload filters, as their messages are not stored.
+ *
+ * @param row History record number
+ * @return 1 if record must be displayed, 0 otherwise
+ */
+int
+filter_check_history(uint32_t row);
+
 /**
  * @brief Check if data matches the filter regexp
  *
+ * @param filter Filter to check
+ * @param data Data to match (NULL terminated)
+ * @param len Length of the data
  * @return 0 if the given data matches the filter
  */
 int
-filter_check_expr(filter_t filter, const char *data);
+filter_check_expr(filter_t filter, const char *data, size_t len);
 
 /**
  * @brief Reset filtered flag in all calls
  *
  * This function can be used to force reevaluation
- * of filters in all calls.
+ * of filters in all calls. Calls will be evaluated in a
+ * pass that runs in small steps using filter_pass_step.
  */
 void
 filter_reset_calls();
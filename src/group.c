@@ -30,6 +30,128 @@
 #include <stdlib.h>
 #include "group.h"
 
+/**
+ * @brief Compare two messages by time
+ *
+ * Messages with the same time are sorted by call and message index, so
+ * every message has a single position in the group.
+ *
+ * @return 1 if first message is newer, -1 if older, 0 if equal
+ */
+static int
+call_group_msg_compare(sip_msg_t *one, sip_msg_t *two)
+{
+    struct timeval onets, twots;
+    int cmp;
+
+    onets = msg_get_time(one);
+    twots = msg_get_time(two);
+    if ((cmp = timeval_is_older(onets, twots) - timeval_is_older(twots, onets)))
+        return cmp;
+    if (one->call != two->call)
+        return (one->call->index > two->call->index) ? 1 : -1;
+    return (one->index > two->index) - (one->index < two->index);
+}
+
+/**
+ * @brief Compare two sorted list elements
+ */
+static int
+call_group_msg_list_compare(const void *a, const void *b)
+{
+    return call_group_msg_compare(*(sip_msg_t * const *) a, *(sip_msg_t * const *) b);
+}
+
+/**
+ * @brief Discard the sorted messages list
+ *
+ * List will be created again next time a group message is requested
+ *
+ * @param group Pointer to an existing group
+ */
+static void
+call_group_reset_msgs(sip_call_group_t *group)
+{
+    sng_free(group->merged);
+    group->merged = NULL;
+}
+
+/**
+ * @brief Add new messages of group calls to the sorted list
+ *
+ * The list is only fully sorted after the calls of the group change.
+ * Otherwise, only messages received after the last update are inserted.
+ *
+ * @param group Pointer to an existing group
+ */
+static void
+call_group_update_msgs(sip_call_group_t *group)
+{
+    sip_call_t *call;
+    int i, j, count;
+
+    // Calls of the group have changed
+    if (!group->merged) {
+        if (!(group->merged = sng_malloc(sizeof(int) * vector_count(group->calls))))
+            return;
+
+        // Sort all calls messages
+        for (i = 0, count = 0; i < vector_count(group->calls); i++)
+            count += call_msg_count(vector_item(group->calls, i));
+        vector_destroy(group->msgs);
+        group->msgs = vector_create(count, 100);
+        for (i = 0; i < vector_count(group->calls); i++) {
+            call = vector_item(group->calls, i);
+            vector_append_vector(group->msgs, call->msgs);
+            group->merged[i] = call_msg_count(call);
+        }
+        vector_sort(group->msgs, call_group_msg_list_compare);
+        vector_set_sorter(group->msgs, call_group_msg_sorter);
+        group->msgs_pos = 0;
+        return;
+    }
+
+    // Insert new messages, usually at the end of the list
+    for (i = 0; i < vector_count(group->calls); i++) {
+        call = vector_item(group->calls, i);
+        count = call_msg_count(call);
+        for (j = group->merged[i]; j < count; j++)
+            vector_append(group->msgs, vector_item(call->msgs, j));
+        group->merged[i] = count;
+    }
+}
+
+/**
+ * @brief Get the position of a message in the sorted list
+ *
+ * @param group Pointer to an existing group
+ * @param msg A sip message from a call in the group
+ * @return message position or -1 if not found
+ */
+static int
+call_group_msg_index(sip_call_group_t *group, sip_msg_t *msg)
+{
+    int low, high, mid, cmp;
+
+    // Most requests continue from the last returned message
+    if (vector_item(group->msgs, group->msgs_pos) == msg)
+        return group->msgs_pos;
+
+    low = 0;
+    high = vector_count(group->msgs) - 1;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if ((cmp = call_group_msg_compare(vector_item(group->msgs, mid), msg)) == 0)
+            return mid;
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+
+    return -1;
+}
+
 sip_call_group_t *
 call_group_create()
 {
@@ -50,6 +172,8 @@ call_group_destroy(sip_call_group_t *group)
         call_group_del(group, call);
     }
     vector_destroy(group->calls);
+    vector_destroy(group->msgs);
+    sng_free(group->merged);
     sng_free(group);
 }
 
@@ -102,6 +226,7 @@ call_group_add(sip_call_group_t *group, sip_call_t *call)
     if (!call_group_exists(group, call)) {
         call->locked = true;
         vector_append(group->calls, call);
+        call_group_reset_msgs(group);
     }
 }
 
@@ -116,6 +241,7 @@ call_group_add_calls(sip_call_group_t *group, vector_t *calls)
         call->locked = true;
         if (!call_group_exists(group, call)) {
             vector_append(group->calls, call);
+            call_group_reset_msgs(group);
         }
     }
 }
@@ -126,6 +252,7 @@ call_group_del(sip_call_group_t *group, sip_call_t *call)
     if (!call) return;
     call->locked = false;
     vector_remove(group->calls, call);
+    call_group_reset_msgs(group);
 }
 
 int
@@ -224,34 +351,32 @@ sip_msg_t *
 call_group_get_next_msg(sip_call_group_t *group, sip_msg_t *msg)
 {
     sip_msg_t *next;
+    sip_call_t *call;
+    int pos;
 
     if (call_group_count(group) == 1) {
-        sip_call_t *call = vector_first(group->calls);
-        vector_iter_t it = vector_iterator(call->msgs);
-        vector_iterator_set_current(&it, vector_index(call->msgs, msg));
-        next = vector_iterator_next(&it);
-    } else {
-        vector_t *messages = vector_create(1,10);
-        vector_set_sorter(messages, call_group_msg_sorter);
-        vector_iter_t callsit = vector_iterator(group->calls);
-        sip_call_t *call;
-        while ((call = vector_iterator_next(&callsit))) {
-            vector_append_vector(messages, call->msgs);
+        // Use call messages list directly
+        call = vector_first(group->calls);
+        pos = (msg && msg->call == call) ? (int) msg->index + 1 : 0;
+        while ((next = sip_parse_msg(vector_item(call->msgs, pos)))) {
+            if (!group->sdp_only || msg_has_sdp(next))
+                break;
+            pos++;
         }
-
-        if (msg == NULL) {
-            next = vector_first(messages);
-        } else {
-            next = vector_item(messages, vector_index(messages, msg) + 1);
-        }
-        vector_destroy(messages);
+        return next;
     }
 
-    next = sip_parse_msg(next);
-    if (next && group->sdp_only && !msg_has_sdp(next)) {
-        return call_group_get_next_msg(group, next);
+    // Get message position in the sorted list
+    call_group_update_msgs(group);
+    pos = (msg) ? call_group_msg_index(group, msg) + 1 : 0;
+
+    while ((next = sip_parse_msg(vector_item(group->msgs, pos)))) {
+        if (!group->sdp_only || msg_has_sdp(next))
+            break;
+        pos++;
     }
 
+    group->msgs_pos = pos;
     return next;
 }
 
@@ -259,36 +384,39 @@ sip_msg_t *
 call_group_get_prev_msg(sip_call_group_t *group, sip_msg_t *msg)
 {
     sip_msg_t *prev;
+    sip_call_t *call;
+    int pos;
 
     if (call_group_count(group) == 1) {
-        sip_call_t *call = vector_first(group->calls);
-        vector_iter_t it = vector_iterator(call->msgs);
-        vector_iterator_set_current(&it, vector_index(call->msgs, msg));
-        prev = vector_iterator_prev(&it);
-    } else {
-        vector_t *messages = vector_create(1, 10);
-        vector_set_sorter(messages, call_group_msg_sorter);
-
-
-        vector_iter_t callsit = vector_iterator(group->calls);
-        sip_call_t *call;
-        while ((call = vector_iterator_next(&callsit))) {
-            vector_append_vector(messages, call->msgs);
-        }
-
-        if (msg == NULL) {
-            prev = vector_last(messages);
-        } else {
-            prev = vector_item(messages, vector_index(messages, msg) - 1);
+        // Use call messages list directly
+        call = vector_first(group->calls);
+        if (!msg)
+            pos = call_msg_count(call) - 1;
+        else
+            pos = (msg->call == call) ? (int) msg->index - 1 : -1;
+        while ((prev = sip_parse_msg(vector_item(call->msgs, pos)))) {
+            if (!group->sdp_only || msg_has_sdp(prev))
+                break;
+            pos--;
         }
-        vector_destroy(messages);
+        return prev;
     }
 
-    prev = sip_parse_msg(prev);
-    if (prev && group->sdp_only && !msg_has_sdp(prev)) {
-        return call_group_get_prev_msg(group, prev);
+    // Get message position in the sorted list
+    call_group_update_msgs(group);
+    if (!msg)
+        pos = vector_count(group->msgs) - 1;
+    else if ((pos = call_group_msg_index(group, msg)) >= 0)
+        pos--;
+
+    while ((prev = sip_parse_msg(vector_item(group->msgs, pos)))) {
+        if (!group->sdp_only || msg_has_sdp(prev))
+            break;
+        pos--;
     }
 
+    if (prev)
+        group->msgs_pos = pos;
     return prev;
 }
 
@@ -323,18 +451,12 @@ call_group_get_next_stream(sip_call_group_t *group, rtp_stream_t *stream)
 void
 call_group_msg_sorter(vector_t *vector, void *item)
 {
-    struct timeval curts, prevts;
     int count = vector_count(vector);
     int i;
 
-    // Current and last packet times
-    curts = msg_get_time(item);
-
     for (i = count - 2 ; i >= 0; i--) {
-        // Get previous packet
-        prevts = msg_get_time(vector_item(vector, i));
         // Check if the item is already in a sorted position
-        if (timeval_is_older(curts, prevts)) {
+        if (call_group_msg_compare(item, vector_item(vector, i)) > 0) {
             vector_insert(vector, item, i + 1);
             return;
         }
@@ -56,6 +56,12 @@ struct sip_call_group {
     int color;
     //! Only consider SDP messages from Calls
     int sdp_only;
+    //! Messages of all group calls sorted by time
+    vector_t *msgs;
+    //! Messages of each group call already in the sorted list
+    int *merged;
+    //! Position of the last returned message in the sorted list
+    int msgs_pos;
 };
 
 /**
@@ -30,30 +30,141 @@
 #include <string.h>
 #include <stdlib.h>
 
+/**
+ * @brief Multiply and fold 64 bits values into a single value
+ */
+static inline uint64_t
+htable_mix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t) a * b;
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t) a, lb = (uint32_t) b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+/**
+ * @brief Get the table position of a hash value
+ */
+static inline size_t
+htable_pos(htable_t *table, uint64_t hash)
+{
+    return hash & (table->size - 1);
+}
+
+/**
+ * @brief Calculate the hash value of a key of the given table
+ */
+static inline uint64_t
+htable_key_hash(htable_t *table, const void *key)
+{
+    return table->keylen ? htable_hash_bytes(key, table->keylen) : htable_hash(key);
+}
+
+/**
+ * @brief Check if a key matches the key of a table entry
+ */
+static inline int
+htable_key_equals(htable_t *table, const void *entry, const void *key)
+{
+    return table->keylen ? !memcmp(entry, key, table->keylen) : !strcmp(entry, key);
+}
+
+/**
+ * @brief Allocate table entries with the given size
+ *
+ * Used entries from the current buckets are moved to the new ones.
+ */
+static int
+htable_resize(htable_t *table, size_t size)
+{
+    hentry_t *buckets = table->buckets;
+    size_t oldsize = table->size, i, pos;
+
+    if (!(table->buckets = calloc(size, sizeof(hentry_t)))) {
+        table->buckets = buckets;
+        return -1;
+    }
+    table->size = size;
+
+    // Move used entries using their cached hash
+    for (i = 0; i < oldsize; i++) {
+        if (!buckets[i].hash)
+            continue;
+        pos = htable_pos(table, buckets[i].hash);
+        while (table->buckets[pos].hash)
+            pos = htable_pos(table, pos + 1);
+        table->buckets[pos] = buckets[i];
+    }
+
+    free(buckets);
+    return 0;
+}
+
+/**
+ * @brief Get the position of the given key
+ *
+ * @return position of the key or the empty position where it should be
+ */
+static size_t
+htable_lookup(htable_t *table, const void *key, uint64_t hash)
+{
+    size_t pos = htable_pos(table, hash);
+
+    while (table->buckets[pos].hash) {
+        if (table->buckets[pos].hash == hash && htable_key_equals(table, table->buckets[pos].key, key))
+            break;
+        pos = htable_pos(table, pos + 1);
+    }
+    return pos;
+}
+
 htable_t *
 htable_create(size_t size)
 {
     htable_t *h;
+    size_t buckets = HTABLE_MIN_SIZE;
 
     // Allocate memory for this table data
     if (!(h = malloc(sizeof(htable_t))))
         return NULL;
 
-    h->size = size;
+    // Keep expected entries below 75% of table size
+    while (buckets - buckets / 4 < size)
+        buckets <<= 1;
+
+    h->size = buckets;
+    h->count = 0;
+    h->keylen = 0;
 
     // Allocate memory for this table buckets
-    if (!(h->buckets = malloc(sizeof(hentry_t) * size))) {
+    if (!(h->buckets = calloc(buckets, sizeof(hentry_t)))) {
         free(h);
         return NULL;
     }
 
-    // Initialize allocated memory
-    memset(h->buckets, 0, sizeof(hentry_t) * size);
-
     // Return allocated table
     return h;
 }
 
+htable_t *
+htable_create_fixed(size_t size, size_t keylen)
+{
+    htable_t *h;
+
+    if ((h = htable_create(size)))
+        h->keylen = keylen;
+
+    return h;
+}
+
 void
 htable_destroy(htable_t *table)
 {
@@ -62,81 +173,121 @@ htable_destroy(htable_t *table)
 }
 
 int
-htable_insert(htable_t *table, const char *key, void *data)
+htable_insert(htable_t *table, const void *key, void *data)
 {
-    // Get hash position for given entry
-    size_t pos = htable_hash(table, key);
+    uint64_t hash = htable_key_hash(table, key);
+    size_t pos;
 
-    // Create a new entry for given key
-    hentry_t *entry;
-    if (!(entry = malloc(sizeof(hentry_t))))
-        return -1;
-
-    entry->key = key;
-    entry->data = data;
-    entry->next = 0;
+    // Grow the table before it gets 75% full
+    if (table->count + 1 > table->size - table->size / 4) {
+        if (htable_resize(table, table->size * 2) != 0)
+            return -1;
+    }
 
-    // Check if the hash position is in use
-    hentry_t *exists = table->buckets[pos];
+    // Get hash position for given entry
+    pos = htable_lookup(table, key, hash);
+    if (!table->buckets[pos].hash)
+        table->count++;
 
-    if (!exists) {
-        table->buckets[pos] = entry;
-    } else {
-        while (exists->next) {
-            exists = exists->next;
-        }
-        exists->next = entry;
-    }
+    table->buckets[pos].key = key;
+    table->buckets[pos].data = data;
+    table->buckets[pos].hash = hash;
     return 0;
 }
 
 void
-htable_remove(htable_t *table, const char *key)
+htable_remove(htable_t *table, const void *key)
 {
+    size_t pos, next, ideal;
+
     // Get hash position for given entry
-    size_t pos = htable_hash(table, key);
-
-    // Check if the hash position is in use
-    hentry_t *entry, *prev = NULL;
-    for (entry = table->buckets[pos]; entry; prev = entry, entry = entry->next) {
-        if (!strcmp(entry->key, key)) {
-            if (prev) {
-                prev->next = entry->next;
-            } else {
-                table->buckets[pos] = entry->next;
-            }
-            // Remove item memory
-            free(entry);
-        }
+    pos = htable_lookup(table, key, htable_key_hash(table, key));
+    if (!table->buckets[pos].hash)
+        return;
+
+    // Move back following entries that can not be found after this hole
+    for (next = htable_pos(table, pos + 1); table->buckets[next].hash; next = htable_pos(table, next + 1)) {
+        ideal = htable_pos(table, table->buckets[next].hash);
+        // Entry is still reachable from its ideal position
+        if (htable_pos(table, next - ideal) < htable_pos(table, next - pos))
+            continue;
+        table->buckets[pos] = table->buckets[next];
+        pos = next;
     }
+
+    // Mark this position as empty
+    memset(&table->buckets[pos], 0, sizeof(hentry_t));
+    table->count--;
 }
 
 void *
-htable_find(htable_t *table, const char *key)
+htable_find(htable_t *table, const void *key)
 {
-    // Get hash position for given entry
-    size_t pos = htable_hash(table, key);
-
-    // Check if the hash position is in use
-    hentry_t *entry;
-    for (entry = table->buckets[pos]; entry; entry = entry->next) {
-        if (!strcmp(entry->key, key)) {
-            //! Found
-            return entry->data;
-        }
-    }
+    size_t pos = htable_lookup(table, key, htable_key_hash(table, key));
+    return table->buckets[pos].data;
+}
 
-    // Not found
-    return NULL;
+void
+htable_clear(htable_t *table)
+{
+    memset(table->buckets, 0, sizeof(hentry_t) * table->size);
+    table->count = 0;
 }
 
 size_t
-htable_hash(htable_t *table, const char *key)
+htable_count(htable_t *table)
 {
-    // dbj2 - http://www.cse.yorku.ca/~oz/hash.html
-    size_t hash = 5381;
-    while (*key++) {
-        hash = ((hash << 5) + hash) ^ *key;
+    return table->count;
+}
+
+/**
+ * @brief Get the max number of entries checked to find a stored key
+ *
+ * This walks all the table entries, so it must not be used for lookups.
+ */
+size_t
+htable_longest_probe(htable_t *table)
+{
+    size_t i, probe, longest = 0;
+
+    for (i = 0; i < table->size; i++) {
+        if (!table->buckets[i].hash)
+            continue;
+        // Distance from the ideal position of the entry (wrapping)
+        probe = htable_pos(table, i - htable_pos(table, table->buckets[i].hash)) + 1;
+        if (probe > longest)
+            longest = probe;
     }
-    return hash & (table->size - 1);
+    return longest;
+}
+
+uint64_t
+htable_hash(const char *key)
+{
+    return htable_hash_bytes(key, strlen(key));
+}
+
+uint64_t
+htable_hash_bytes(const void *key, size_t len)
+{
+    // Based on wyhash - https://github.com/wangyi-fudan/wyhash
+    const uint64_t p0 = 0xa0761d6478bd642full, p1 = 0xe7037ed1a0b428dbull;
+    const unsigned char *bytes = key;
+    uint64_t hash = p0 ^ len, word;
+    size_t i;
+
+    // Process 8 bytes words
+    for (i = 0; i + 8 <= len; i += 8) {
+        memcpy(&word, bytes + i, 8);
+        hash = htable_mix(hash ^ word, p1);
+    }
+
+    // Process remaining bytes
+    word = 0;
+    memcpy(&word, bytes + i, len - i);
+    hash = htable_mix(hash ^ word, p1 ^ len);
+    hash = htable_mix(hash, p0);
+
+    // Zero is reserved for empty entries
+    return hash ? hash : 1;
 }
@@ -24,6 +24,14 @@
  * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
  *
  * @brief Functions to manage hash tables
+ *
+ * Hash tables use open addressing with linear probing. Each entry caches
+ * the hash of its key, so growing the table and most failed comparisons
+ * never touch the key strings. Keys are not copied, they must live as long
+ * as their entry does.
+ *
+ * Tables created with @htable_create_fixed use binary keys of a fixed
+ * length instead of NULL terminated strings.
  */
 
 #ifndef __SNGREP_HASH_H_
@@ -31,6 +39,10 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <stdint.h>
+
+//! Minimum number of table entries
+#define HTABLE_MIN_SIZE 16
 
 //! Shorter declaration of hash structures
 typedef struct htable htable_t;
@@ -41,36 +53,91 @@ typedef struct hentry hentry_t;
  */
 struct hentry {
     //! Key of the hash entry
-    const char *key;
+    const void *key;
     //! Pointer to has entry data
     void *data;
-    //! Next entry sharing the same hash value
-    hentry_t *next;
+    //! Cached hash value of the key (0 for empty entries)
+    uint64_t hash;
 };
 
 struct htable {
-    //! Fixed hash table limit
+    //! Number of allocated entries (always a power of 2)
     size_t size;
+    //! Number of used entries
+    size_t count;
+    //! Length of binary keys (0 for NULL terminated strings)
+    size_t keylen;
     // Hash table entries
-    hentry_t **buckets;
+    hentry_t *buckets;
 };
 
+/**
+ * @brief Create a new hash table
+ *
+ * @param size Expected number of entries. Table will grow if required
+ * @return allocated table or NULL on error
+ */
 htable_t *
 htable_create(size_t size);
 
+/**
+ * @brief Create a new hash table with fixed length binary keys
+ *
+ * Keys are compared byte by byte, so any padding must be zeroed.
+ *
+ * @param size Expected number of entries. Table will grow if required
+ * @param keylen Length in bytes of all table keys
+ * @return allocated table or NULL on error
+ */
+htable_t *
+htable_create_fixed(size_t size, size_t keylen);
+
 void
 htable_destroy(htable_t *table);
 
+/**
+ * @brief Add or replace an entry in the table
+ *
+ * @return 0 on success, -1 on allocation error
+ */
 int
-htable_insert(htable_t *table, const char *key, void *data);
+htable_insert(htable_t *table, const void *key, void *data);
 
 void
-htable_remove(htable_t *table, const char *key);
+htable_remove(htable_t *table, const void *key);
 
 void *
-htable_find(htable_t *table, const char *key);
+htable_find(htable_t *table, const void *key);
+
+/**
+ * @brief Remove all entries keeping the allocated memory
+ */
+void
+htable_clear(htable_t *table);
+
+/**
+ * @brief Get the number of entries in the table
+ */
+size_t
+htable_count(htable_t *table);
 
 size_t
-htable_hash(htable_t *table, const char *key);
+htable_longest_probe(htable_t *table);
+
+/**
+ * @brief Calculate the hash value of a key
+ *
+ * @return hash value of the key (never 0)
+ */
+uint64_t
+htable_hash(const char *key);
+
+/**
+ * @brief Calculate the hash value of a binary key
+ *
+ * @return hash value of the key (never 0)
+ */
+uint64_t
+htable_hash_bytes(const void *key, size_t len);
 
 #endif /* __SNGREP_HASH_H_ */
@@ -0,0 +1,141 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file health.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in health.h
+ */
+#include "config.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <string.h>
+#include "health.h"
+#include "capture.h"
+#include "sip.h"
+#include "setting.h"
+#include "util.h"
+
+//! SIGUSR1 has been received and report has not been written yet
+static volatile sig_atomic_t health_requested = 0;
+
+/**
+ * @brief Flag the report request, it is written outside the handler
+ */
+static void
+health_signal_handler(int signum)
+{
+    health_requested = 1;
+}
+
+void
+health_init()
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = health_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    // Capture threads blocking reads are not interrupted
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+void
+health_sample(health_info_t *info)
+{
+    memset(info, 0, sizeof(health_info_t));
+    info->timestamp = time(NULL);
+    sip_calls_health(info);
+    capture_health(info);
+}
+
+void
+health_print(FILE *out, health_info_t *info)
+{
+    char date[32], size[16];
+    struct tm tm;
+    int i;
+
+    localtime_r(&info->timestamp, &tm);
+    strftime(date, sizeof(date), "%Y/%m/%d %H:%M:%S", &tm);
+    fprintf(out, "sngrep health report %s\n", date);
+
+    fprintf(out, "  Call-ID table:   %zu/%zu entries (%.1f%% load), longest probe %zu\n",
+            info->callids_count, info->callids_size,
+            (info->callids_size) ? (double) info->callids_count * 100 / info->callids_size : 0,
+            info->callids_probe);
+    if (info->limit) {
+        fprintf(out, "  Dialogs:         %d/%d (%.1f%% of limit), %d active\n", info->dialogs, info->limit,
+                (double) info->dialogs * 100 / info->limit, info->active);
+    } else {
+        fprintf(out, "  Dialogs:         %d (no limit), %d active\n", info->dialogs, info->active);
+    }
+    fprintf(out, "  RTP packets:     %" PRIu64 " (%s stored)\n", info->rtp_packets,
+            bytes_to_human(info->rtp_memory, size));
+
+    if (info->rotated_time) {
+        localtime_r(&info->rotated_time, &tm);
+        strftime(date, sizeof(date), "%Y/%m/%d %H:%M:%S", &tm);
+        fprintf(out, "  Rotated:         %" PRIu64 " dialogs, last at %s\n", info->rotated, date);
+    } else {
+        fprintf(out, "  Rotated:         none\n");
+    }
+    fprintf(out, "  TLS connections: %u (%u packets pending)\n", info->tls_connections, info->tls_pending);
+
+    for (i = 0; i < info->nworkers; i++)
+        fprintf(out, "  Parser queue %-3d %u/%u\n", i, info->queue[i], info->queue_size);
+
+    for (i = 0; i < info->nsources; i++) {
+        fprintf(out, "  Source %s: %zu IP datagrams (%s), %zu TCP flows\n", info->sources[i].name,
+                info->sources[i].ip_frags, bytes_to_human(info->sources[i].ip_frags_memory, size),
+                info->sources[i].tcp_flows);
+    }
+    fflush(out);
+}
+
+void
+health_check_signal()
+{
+    health_info_t info;
+    const char *file;
+    FILE *out = stderr;
+
+    if (!health_requested)
+        return;
+    health_requested = 0;
+
+    // Report is written to stderr unless a file is configured
+    if ((file = setting_get_value(SETTING_REPORT_HEALTH_FILE)) && !(out = fopen(file, "a"))) {
+        fprintf(stderr, "Unable to open health report file %s: %s\n", file, strerror(errno));
+        return;
+    }
+
+    capture_lock();
+    health_sample(&info);
+    capture_unlock();
+    health_print(out, &info);
+
+    if (out != stderr)
+        fclose(out);
+}
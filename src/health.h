@@ -0,0 +1,152 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file health.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to report usage of internal data structures
+ *
+ * Health report shows how full the internal containers are: Call-ID
+ * table load and longest probe sequence, stored dialogs against the
+ * capture limit, pending IP fragments and TCP flows of each capture
+ * source, TLS connections, parser queues depth and last rotation.
+ *
+ * Report is written when SIGUSR1 is received, displayed in the stats
+ * panel and included in JSON and Prometheus reports.
+ */
+#ifndef __SNGREP_HEALTH_H
+#define __SNGREP_HEALTH_H
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+//! Max number of capture sources in the report
+#define HEALTH_SOURCES_MAX 16
+//! Max number of parser queues in the report
+#define HEALTH_WORKERS_MAX 64
+//! Max length of a capture source name
+#define HEALTH_NAME_LEN 48
+
+//! Shorter declaration of health_info structure
+typedef struct health_info health_info_t;
+//! Shorter declaration of health_source structure
+typedef struct health_source health_source_t;
+
+/**
+ * @brief Reassembly containers of a capture source
+ */
+struct health_source
+{
+    //! Input file or capture device
+    char name[HEALTH_NAME_LEN];
+    //! Datagrams pending IP reassembly
+    size_t ip_frags;
+    //! Memory used by pending IP fragments
+    size_t ip_frags_memory;
+    //! TCP flows pending reassembly
+    size_t tcp_flows;
+};
+
+/**
+ * @brief Internal containers usage read at a given moment
+ */
+struct health_info
+{
+    //! Wall clock time of the report
+    time_t timestamp;
+    //! Allocated entries of the Call-ID table
+    size_t callids_size;
+    //! Used entries of the Call-ID table
+    size_t callids_count;
+    //! Longest probe sequence of the Call-ID table entries
+    size_t callids_probe;
+    //! Stored dialogs
+    int dialogs;
+    //! Stored active calls
+    int active;
+    //! Capture limit of stored dialogs
+    int limit;
+    //! RTP packets of stored dialogs streams
+    uint64_t rtp_packets;
+    //! Memory used by stored RTP packets
+    size_t rtp_memory;
+    //! Dialogs removed to make room for new ones
+    uint64_t rotated;
+    //! Wall clock time of the last rotation (0 if none)
+    time_t rotated_time;
+    //! TLS connections being decrypted
+    uint32_t tls_connections;
+    //! Packets queued to TLS threads and not yet sent to parser
+    uint32_t tls_pending;
+    //! Number of parser queues
+    int nworkers;
+    //! Packets pending in each parser queue
+    uint32_t queue[HEALTH_WORKERS_MAX];
+    //! Size of each parser queue
+    uint32_t queue_size;
+    //! Number of capture sources
+    int nsources;
+    //! Reassembly containers of each capture source
+    health_source_t sources[HEALTH_SOURCES_MAX];
+};
+
+/**
+ * @brief Write the health report when SIGUSR1 is received
+ *
+ * Report is appended to report.health.file or written to stderr if
+ * that setting is empty.
+ */
+void
+health_init();
+
+/**
+ * @brief Read current internal containers usage
+ *
+ * Capture lock must be held, as stored dialogs are read.
+ *
+ * @param info Pointer to store the report
+ */
+void
+health_sample(health_info_t *info);
+
+/**
+ * @brief Print a health report as text
+ *
+ * @param out Output file
+ * @param info Report to print
+ */
+void
+health_print(FILE *out, health_info_t *info);
+
+/**
+ * @brief Write the health report if SIGUSR1 has been received
+ *
+ * Signal handler only flags the request, so this must be called
+ * periodically from the interface or report loops.
+ */
+void
+health_check_signal();
+
+#endif /* __SNGREP_HEALTH_H */
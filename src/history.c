@@ -0,0 +1,354 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file history.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to keep a browsable history of rotated dialogs
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "history.h"
+#include "filter.h"
+#include "setting.h"
+#include "sip.h"
+#include "util.h"
+
+//! History files and displayed rows
+static history_config_t history = { .rfd = -1, .sfd = -1 };
+//! Sort options used for displayed rows
+static sip_sort_t history_sort;
+
+/**
+ * @brief Make sure a history file has room for the given size
+ *
+ * Files grow in HISTORY_GROW steps and are mapped again after growing.
+ *
+ * @return 0 if file is large enough, 1 otherwise
+ */
+static int
+history_file_reserve(int fd, void **map, size_t *size, size_t need)
+{
+    size_t grown;
+    void *data;
+
+    if (need <= *size)
+        return 0;
+
+    grown = (need + HISTORY_GROW - 1) / HISTORY_GROW * HISTORY_GROW;
+    if (ftruncate(fd, grown) != 0)
+        return 1;
+    if ((data = mmap(NULL, grown, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        return 1;
+
+    if (*map)
+        munmap(*map, *size);
+    *map = data;
+    *size = grown;
+    return 0;
+}
+
+/**
+ * @brief Create a history file, replacing any previous one
+ *
+ * @return file descriptor or -1 on error
+ */
+static int
+history_file_create(const char *path)
+{
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+    return fd;
+}
+
+int
+history_init()
+{
+    const char *file = setting_get_value(SETTING_HISTORY_FILE);
+    char path[PATH_MAX];
+    int i, numeric = 0;
+
+    if (!file || !strlen(file))
+        return 0;
+
+    snprintf(path, sizeof(path), "%s%s", file, HISTORY_STRINGS_SUFFIX);
+    if ((history.rfd = history_file_create(file)) < 0)
+        return 1;
+    if ((history.sfd = history_file_create(path)) < 0) {
+        history_deinit();
+        return 1;
+    }
+
+    if (!(history.dict = calloc(HISTORY_DICT_SLOTS, sizeof(uint32_t)))) {
+        fprintf(stderr, "Can't allocate memory for history dictionary!\n");
+        history_deinit();
+        return 1;
+    }
+
+    // Dictionary offset 0 is used for attributes without value
+    if (history_file_reserve(history.sfd, (void **) &history.strings, &history.strings_size, 1) != 0) {
+        fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+        history_deinit();
+        return 1;
+    }
+    history.strings_len = 1;
+
+    // Only numeric attributes store their values
+    for (i = 0; i < SIP_ATTR_COUNT; i++) {
+        history.numeric[i] = -1;
+        if (sip_attr_is_numeric(i) && numeric < HISTORY_NUMERIC_MAX)
+            history.numeric[i] = numeric++;
+    }
+
+    history_sort = sip_sort_options();
+    return 0;
+}
+
+void
+history_deinit()
+{
+    // Remove the unused space of last growth
+    if (history.rfd >= 0) {
+        if (ftruncate(history.rfd, (off_t) history.count * sizeof(history_record_t)) != 0)
+            fprintf(stderr, "Unable to truncate history file: %s\n", strerror(errno));
+        close(history.rfd);
+    }
+    if (history.sfd >= 0) {
+        if (ftruncate(history.sfd, history.strings_len) != 0)
+            fprintf(stderr, "Unable to truncate history strings file: %s\n", strerror(errno));
+        close(history.sfd);
+    }
+
+    if (history.records)
+        munmap(history.records, history.records_size);
+    if (history.strings)
+        munmap(history.strings, history.strings_size);
+    sng_free(history.dict);
+    sng_free(history.view);
+
+    memset(&history, 0, sizeof(history));
+    history.rfd = history.sfd = -1;
+}
+
+/**
+ * @brief Get the dictionary offset of a string, storing it if required
+ *
+ * Recently stored strings are reused. Other strings are appended to the
+ * dictionary even if they were stored before.
+ *
+ * @return dictionary offset or 0 if string could not be stored
+ */
+static uint32_t
+history_string(const char *value)
+{
+    uint32_t hash = 2166136261u, *slot, offset;
+    size_t len;
+    const char *c;
+
+    for (c = value; *c; c++)
+        hash = (hash ^ (uint8_t) *c) * 16777619u;
+    len = c - value + 1;
+
+    // Same string stored by a previous record
+    slot = &history.dict[hash & (HISTORY_DICT_SLOTS - 1)];
+    if (*slot && !strcmp(history.strings + *slot, value))
+        return *slot;
+
+    // Offsets must fit in record fields
+    if ((uint64_t) history.strings_len + len > UINT32_MAX)
+        return 0;
+    if (history_file_reserve(history.sfd, (void **) &history.strings, &history.strings_size,
+                             history.strings_len + len) != 0)
+        return 0;
+
+    offset = history.strings_len;
+    memcpy(history.strings + offset, value, len);
+    history.strings_len += len;
+    return *slot = offset;
+}
+
+void
+history_add_call(sip_call_t *call)
+{
+    history_record_t *record;
+    const char *value;
+    int i;
+
+    if (history.rfd < 0)
+        return;
+
+    if (history.count == UINT32_MAX
+        || history_file_reserve(history.rfd, (void **) &history.records, &history.records_size,
+                                (size_t) (history.count + 1) * sizeof(history_record_t)) != 0)
+        return;
+
+    record = &history.records[history.count];
+    memset(record, 0, sizeof(history_record_t));
+    for (i = 0; i < SIP_ATTR_COUNT; i++) {
+        if ((value = call_attr_text(call, i)) && *value)
+            record->text[i] = history_string(value);
+        if (history.numeric[i] >= 0)
+            record->num[history.numeric[i]] = call_attr_number(call, i);
+    }
+    record->dump_file = call->dump_file;
+    record->dump_offset = call->dump_offset;
+
+    history.count++;
+}
+
+uint32_t
+history_count()
+{
+    return history.count;
+}
+
+const char *
+history_attr_text(uint32_t row, enum sip_attr_id id)
+{
+    uint32_t offset;
+
+    if (row >= history.count || !(offset = history.records[row].text[id]))
+        return NULL;
+    return history.strings + offset;
+}
+
+int
+history_dump_position(uint32_t row, uint32_t *file, int64_t *offset)
+{
+    if (row >= history.count || history.records[row].dump_offset < 0)
+        return 1;
+
+    *file = history.records[row].dump_file;
+    *offset = history.records[row].dump_offset;
+    return 0;
+}
+
+/**
+ * @brief Compare two records using current sort options
+ *
+ * Records with the same value keep their storage order.
+ */
+static int
+history_view_compare(const void *one, const void *two)
+{
+    uint32_t onerow = *(const uint32_t *) one, tworow = *(const uint32_t *) two;
+    const char *onevalue, *twovalue;
+    int64_t onenum, twonum;
+    int pos, cmp;
+
+    if ((pos = history.numeric[history_sort.by]) >= 0) {
+        onenum = history.records[onerow].num[pos];
+        twonum = history.records[tworow].num[pos];
+        cmp = (onenum > twonum) - (onenum < twonum);
+    } else {
+        // Empty values are lesser than any other value
+        onevalue = history_attr_text(onerow, history_sort.by);
+        twovalue = history_attr_text(tworow, history_sort.by);
+        if (!onevalue || !twovalue) {
+            cmp = (onevalue != NULL) - (twovalue != NULL);
+        } else {
+            cmp = strcmp(onevalue, twovalue);
+        }
+    }
+
+    if (!history_sort.asc)
+        cmp = -cmp;
+    return (cmp) ? cmp : (onerow > tworow) - (onerow < tworow);
+}
+
+void
+history_view_reset()
+{
+    history.view_count = 0;
+    history.view_checked = 0;
+    history_sort = sip_sort_options();
+}
+
+void
+history_view_refresh()
+{
+    uint32_t first = history.view_count, *added, *rows, size, row, i, j, k;
+
+    if (history.rfd < 0 || history.view_checked == history.count)
+        return;
+
+    // Make room for all unchecked records
+    if (history.view_size < history.count) {
+        for (size = (history.view_size) ? history.view_size : 1024; size < history.count; size <<= 1);
+        if (!(rows = realloc(history.view, sizeof(uint32_t) * size)))
+            return;
+        history.view = rows;
+        history.view_size = size;
+    }
+
+    // Check new records against display filters
+    for (row = history.view_checked; row < history.count && row - history.view_checked < HISTORY_VIEW_STEP; row++) {
+        if (filter_check_history(row))
+            history.view[history.view_count++] = row;
+    }
+    history.view_checked = row;
+
+    if (history.view_count == first)
+        return;
+
+    // Sort the added rows and merge them with the displayed ones
+    qsort(history.view + first, history.view_count - first, sizeof(uint32_t), history_view_compare);
+    if (!first || history_view_compare(&history.view[first - 1], &history.view[first]) <= 0)
+        return;
+    if (!(added = malloc(sizeof(uint32_t) * (history.view_count - first))))
+        return;
+    memcpy(added, history.view + first, sizeof(uint32_t) * (history.view_count - first));
+
+    // Merge from the end so displayed rows are moved only once
+    i = first, j = history.view_count - first, k = history.view_count;
+    while (j > 0) {
+        if (i > 0 && history_view_compare(&history.view[i - 1], &added[j - 1]) > 0) {
+            history.view[--k] = history.view[--i];
+        } else {
+            history.view[--k] = added[--j];
+        }
+    }
+    free(added);
+}
+
+int
+history_view_count()
+{
+    return history.view_count;
+}
+
+int64_t
+history_view_item(int pos)
+{
+    if (pos < 0 || (uint32_t) pos >= history.view_count)
+        return -1;
+    return history.view[pos];
+}
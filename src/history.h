@@ -0,0 +1,192 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file history.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to keep a browsable history of rotated dialogs
+ *
+ * When rotation removes the oldest dialogs from storage, their call list
+ * attributes can be appended to a history file. Each dialog is stored as
+ * a fixed width record referencing its texts in a strings dictionary
+ * file, so history only needs a few bytes of memory per displayed row.
+ *
+ * The call list shows history rows after the stored dialogs, filtered
+ * and sorted with the same display options. Records also keep where the
+ * first dialog packet was written in the dump file.
+ */
+#ifndef __SNGREP_HISTORY_H
+#define __SNGREP_HISTORY_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include "sip_attr.h"
+#include "sip_call.h"
+
+//! Strings dictionary file name suffix
+#define HISTORY_STRINGS_SUFFIX ".str"
+//! History files grow in steps of this size (bytes)
+#define HISTORY_GROW (16 * 1024 * 1024)
+//! Slots of recently stored strings reused by new records (power of two)
+#define HISTORY_DICT_SLOTS 65536
+//! Max numeric attributes stored in each record
+#define HISTORY_NUMERIC_MAX 16
+//! Max history rows checked on each view refresh
+#define HISTORY_VIEW_STEP 65536
+
+//! Shorter declaration of history_record structure
+typedef struct history_record history_record_t;
+//! Shorter declaration of history_config structure
+typedef struct history_config history_config_t;
+
+/**
+ * @brief Rotated dialog record
+ */
+struct history_record {
+    //! Dictionary offset of each attribute text (0 if attribute has no value)
+    uint32_t text[SIP_ATTR_COUNT];
+    //! Value of numeric attributes (in attributes order)
+    int64_t num[HISTORY_NUMERIC_MAX];
+    //! Dump file number of the first dialog packet
+    uint32_t dump_file;
+    //! Dump file offset of the first dialog packet (-1 if not dumped)
+    int64_t dump_offset;
+};
+
+/**
+ * @brief History files and displayed rows
+ */
+struct history_config {
+    //! Records file descriptor (-1 if history is disabled)
+    int rfd;
+    //! Strings dictionary file descriptor
+    int sfd;
+    //! Mapped records file
+    history_record_t *records;
+    //! Number of stored records
+    uint32_t count;
+    //! Mapped records file size
+    size_t records_size;
+    //! Mapped strings dictionary file
+    char *strings;
+    //! Used bytes of strings dictionary
+    uint32_t strings_len;
+    //! Mapped strings dictionary file size
+    size_t strings_size;
+    //! Offsets of recently stored strings indexed by their hash
+    uint32_t *dict;
+    //! Position of each attribute in records numbers (-1 if not numeric)
+    int numeric[SIP_ATTR_COUNT];
+    //! Displayed rows, sorted by current sort options
+    uint32_t *view;
+    //! Number of displayed rows
+    uint32_t view_count;
+    //! Allocated displayed rows
+    uint32_t view_size;
+    //! Records already checked against display filters
+    uint32_t view_checked;
+};
+
+/**
+ * @brief Create the history files
+ *
+ * History is only enabled if history.file setting has a value. Previous
+ * files with the same name are replaced.
+ *
+ * @return 0 if history is disabled or files have been created, 1 otherwise
+ */
+int
+history_init();
+
+/**
+ * @brief Close the history files
+ */
+void
+history_deinit();
+
+/**
+ * @brief Store the record of a dialog removed by rotation
+ *
+ * This must be called with the capture lock.
+ *
+ * @param call Dialog being removed from storage
+ */
+void
+history_add_call(sip_call_t *call);
+
+/**
+ * @brief Get the number of stored records
+ */
+uint32_t
+history_count();
+
+/**
+ * @brief Get an attribute text of a stored record
+ *
+ * @return attribute value or NULL if attribute has no value
+ */
+const char *
+history_attr_text(uint32_t row, enum sip_attr_id id);
+
+/**
+ * @brief Get where a record dialog packets were written
+ *
+ * @param row Record number
+ * @param file Dump file number (rotated dump files)
+ * @param offset Offset of the first dialog packet in that file
+ * @return 0 if dialog packets were written to a dump file, 1 otherwise
+ */
+int
+history_dump_position(uint32_t row, uint32_t *file, int64_t *offset);
+
+/**
+ * @brief Check all records again in next view refresh
+ *
+ * Must be called when display filters or sort options change.
+ */
+void
+history_view_reset();
+
+/**
+ * @brief Add new records matching display filters to the view
+ *
+ * Only HISTORY_VIEW_STEP records are checked on each call.
+ */
+void
+history_view_refresh();
+
+/**
+ * @brief Get the number of displayed records
+ */
+int
+history_view_count();
+
+/**
+ * @brief Get the record displayed at the given position
+ *
+ * @return record number or -1 if position is not valid
+ */
+int64_t
+history_view_item(int pos);
+
+#endif /* __SNGREP_HISTORY_H */
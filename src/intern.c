@@ -0,0 +1,150 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file intern.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source code of functions defined in intern.h
+ *
+ */
+#include "config.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include "intern.h"
+#include "hash.h"
+#include "util.h"
+
+//! Initial number of interned strings table entries
+#define INTERN_TABLE_SIZE 1024
+
+//! Interned strings indexed by value
+static htable_t *intern_table = NULL;
+//! Memory used by interned strings
+static size_t intern_bytes = 0;
+//! Interned strings can be requested from several threads
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Get the interned string structure of a shared value
+ */
+static intern_str_t *
+intern_entry(const char *value)
+{
+    return (intern_str_t *) (value - offsetof(intern_str_t, value));
+}
+
+void
+intern_init()
+{
+    pthread_mutex_lock(&intern_lock);
+    if (!intern_table)
+        intern_table = htable_create(INTERN_TABLE_SIZE);
+    pthread_mutex_unlock(&intern_lock);
+}
+
+void
+intern_deinit()
+{
+    size_t i;
+
+    pthread_mutex_lock(&intern_lock);
+    if (intern_table) {
+        for (i = 0; i < intern_table->size; i++) {
+            if (intern_table->buckets[i].hash)
+                sng_free(intern_table->buckets[i].data);
+        }
+        htable_destroy(intern_table);
+        intern_table = NULL;
+        intern_bytes = 0;
+    }
+    pthread_mutex_unlock(&intern_lock);
+}
+
+const char *
+intern_string(const char *value)
+{
+    intern_str_t *str;
+    size_t len;
+
+    if (!value || !intern_table)
+        return NULL;
+
+    pthread_mutex_lock(&intern_lock);
+
+    // Value is already shared
+    if ((str = htable_find(intern_table, value))) {
+        str->refs++;
+        pthread_mutex_unlock(&intern_lock);
+        return str->value;
+    }
+
+    // Store a new shared copy
+    len = strlen(value);
+    if (!(str = sng_malloc(sizeof(intern_str_t) + len + 1))) {
+        pthread_mutex_unlock(&intern_lock);
+        return NULL;
+    }
+    str->refs = 1;
+    str->len = len;
+    memcpy(str->value, value, len + 1);
+
+    if (htable_insert(intern_table, str->value, str) != 0) {
+        sng_free(str);
+        pthread_mutex_unlock(&intern_lock);
+        return NULL;
+    }
+    intern_bytes += sizeof(intern_str_t) + len + 1;
+
+    pthread_mutex_unlock(&intern_lock);
+    return str->value;
+}
+
+void
+intern_release(const char *value)
+{
+    intern_str_t *str;
+
+    if (!value || !intern_table)
+        return;
+
+    pthread_mutex_lock(&intern_lock);
+    str = intern_entry(value);
+    if (--str->refs == 0) {
+        htable_remove(intern_table, str->value);
+        intern_bytes -= sizeof(intern_str_t) + str->len + 1;
+        sng_free(str);
+    }
+    pthread_mutex_unlock(&intern_lock);
+}
+
+size_t
+intern_memory()
+{
+    return intern_bytes;
+}
+
+size_t
+intern_count()
+{
+    return intern_table ? htable_count(intern_table) : 0;
+}
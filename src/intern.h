@@ -0,0 +1,98 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file intern.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to share repeated strings between calls
+ *
+ * Captures usually contain a few distinct From/To URIs or response texts
+ * repeated in lots of dialogs. Interned strings are stored once with a
+ * reference counter, so equal values also have the same address.
+ */
+
+#ifndef __SNGREP_INTERN_H_
+#define __SNGREP_INTERN_H_
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+
+//! Shorter declaration of intern string structure
+typedef struct intern_str intern_str_t;
+
+/**
+ * @brief Interned string
+ */
+struct intern_str {
+    //! Number of references to this string
+    uint32_t refs;
+    //! String length
+    uint32_t len;
+    //! String value
+    char value[];
+};
+
+/**
+ * @brief Initialize interned strings table
+ */
+void
+intern_init();
+
+/**
+ * @brief Release all interned strings
+ */
+void
+intern_deinit();
+
+/**
+ * @brief Get a reference to the shared copy of a string
+ *
+ * @param value String to intern
+ * @return shared copy of the string or NULL on allocation error
+ */
+const char *
+intern_string(const char *value);
+
+/**
+ * @brief Release a reference of an interned string
+ *
+ * String is removed when its last reference is released.
+ *
+ * @param value String returned by @intern_string (or NULL)
+ */
+void
+intern_release(const char *value);
+
+/**
+ * @brief Get the memory used by interned strings
+ */
+size_t
+intern_memory();
+
+/**
+ * @brief Get the number of distinct interned strings
+ */
+size_t
+intern_count();
+
+#endif /* __SNGREP_INTERN_H_ */
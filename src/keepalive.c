@@ -0,0 +1,304 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file keepalive.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to aggregate keepalive dialogs by peers
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "keepalive.h"
+#include "setting.h"
+#include "util.h"
+
+//! Aggregate entries storage
+static keepalive_config_t keepalive;
+
+void
+keepalive_init(int limit)
+{
+    char methods[MAX_SETTING_LEN], *name, *saveptr = NULL;
+    const char *value;
+    int method;
+
+    memset(&keepalive, 0, sizeof(keepalive));
+
+    if (!(value = setting_get_value(SETTING_SIP_KEEPALIVE)))
+        return;
+
+    // Parse comma separated list of aggregated methods
+    strncpy(methods, value, sizeof(methods) - 1);
+    methods[sizeof(methods) - 1] = '\0';
+    for (name = strtok_r(methods, ", ", &saveptr); name; name = strtok_r(NULL, ", ", &saveptr)) {
+        method = sip_method_from_str(name);
+        if (method <= 0 || method >= SIP_METHOD_COUNT || method == SIP_METHOD_INVITE) {
+            fprintf(stderr, "Ignoring unknown keepalive method %s\n", name);
+            continue;
+        }
+        keepalive.methods |= 1u << method;
+    }
+
+    if (!keepalive.methods)
+        return;
+
+    keepalive.msgs = setting_get_intvalue(SETTING_SIP_KEEPALIVE_MSGS);
+    if (keepalive.msgs < 0)
+        keepalive.msgs = 0;
+    if (keepalive.msgs > KEEPALIVE_MSGS_MAX)
+        keepalive.msgs = KEEPALIVE_MSGS_MAX;
+
+    keepalive.limit = limit;
+    keepalive.entries = htable_create(HTABLE_MIN_SIZE);
+    keepalive.list = vector_create(0, 32);
+}
+
+/**
+ * @brief Deallocate an aggregate entry and its stored messages
+ */
+static void
+keepalive_entry_destroy(keepalive_t *entry)
+{
+    int i;
+
+    for (i = 0; i < entry->msgs_count; i++)
+        free(entry->msgs[(entry->msgs_first + i) % keepalive.msgs].payload);
+    sng_free(entry->msgs);
+    sng_free(entry);
+}
+
+void
+keepalive_deinit()
+{
+    if (!keepalive.methods)
+        return;
+
+    keepalive_clear();
+    htable_destroy(keepalive.entries);
+    vector_destroy(keepalive.list);
+    keepalive.methods = 0;
+}
+
+void
+keepalive_clear()
+{
+    keepalive_t *entry;
+    vector_iter_t it;
+
+    if (!keepalive.methods)
+        return;
+
+    it = vector_iterator(keepalive.list);
+    while ((entry = vector_iterator_next(&it)))
+        keepalive_entry_destroy(entry);
+    vector_clear(keepalive.list);
+    htable_clear(keepalive.entries);
+    keepalive.memory = 0;
+}
+
+/**
+ * @brief Get the request method of a message
+ *
+ * Responses method is taken from their CSeq header.
+ *
+ * @return method id or 0 if it can not be found
+ */
+static int
+keepalive_method(sip_pending_t *pending)
+{
+    const char *payload = (const char *) packet_payload(pending->packet);
+    const char *start, *end;
+    char method[16];
+
+    if (msg_is_request(&pending->msg))
+        return pending->msg.reqresp;
+
+    // Method follows CSeq number
+    if (!pending->hdrs.cseq.len)
+        return 0;
+    start = end = payload + pending->hdrs.cseq.off + pending->hdrs.cseq.len;
+    while (*start == ' ' || *start == '\t')
+        start++;
+    for (end = start; isalpha((unsigned char) *end) && end - start < (int) sizeof(method) - 1; end++);
+    memcpy(method, start, end - start);
+    method[end - start] = '\0';
+
+    return sip_method_from_str(method);
+}
+
+/**
+ * @brief Create the key of an entry from its method and peers
+ *
+ * Both directions of the same peers share the same key.
+ */
+static void
+keepalive_key(int method, address_t src, address_t dst, char *key)
+{
+    char srcip[ADDRESSLEN], dstip[ADDRESSLEN];
+    char one[ADDRESSLEN + 8], two[ADDRESSLEN + 8];
+
+    snprintf(one, sizeof(one), "%s:%u", address_get_ip(src, srcip), src.port);
+    snprintf(two, sizeof(two), "%s:%u", address_get_ip(dst, dstip), dst.port);
+    if (strcmp(one, two) < 0)
+        snprintf(key, KEEPALIVE_KEY_LEN, "%d %s %s", method, one, two);
+    else
+        snprintf(key, KEEPALIVE_KEY_LEN, "%d %s %s", method, two, one);
+}
+
+/**
+ * @brief Store a copy of the message in the entry ring
+ */
+static void
+keepalive_store_msg(keepalive_t *entry, packet_t *packet, struct timeval time)
+{
+    keepalive_msg_t *msg;
+
+    if (!entry->msgs && !(entry->msgs = sng_malloc(sizeof(keepalive_msg_t) * keepalive.msgs)))
+        return;
+
+    // Replace the oldest message when the ring is full
+    if (entry->msgs_count == keepalive.msgs) {
+        msg = &entry->msgs[entry->msgs_first];
+        keepalive.memory -= msg->len + 1;
+        free(msg->payload);
+        entry->msgs_first = (entry->msgs_first + 1) % keepalive.msgs;
+        entry->msgs_count--;
+    }
+
+    msg = &entry->msgs[(entry->msgs_first + entry->msgs_count) % keepalive.msgs];
+    if (!(msg->payload = malloc(packet_payloadlen(packet) + 1)))
+        return;
+    memcpy(msg->payload, packet_payload(packet), packet_payloadlen(packet));
+    msg->payload[packet_payloadlen(packet)] = '\0';
+    msg->len = packet_payloadlen(packet);
+    msg->time = time;
+    msg->src = packet->src;
+    msg->dst = packet->dst;
+    entry->msgs_count++;
+    keepalive.memory += msg->len + 1;
+}
+
+bool
+keepalive_enabled()
+{
+    return keepalive.methods != 0;
+}
+
+bool
+keepalive_fold(sip_pending_t *pending)
+{
+    packet_t *packet = pending->packet;
+    struct timeval time = packet_time(packet);
+    keepalive_t *entry;
+    char key[KEEPALIVE_KEY_LEN];
+    int method, code;
+
+    if (!keepalive.methods)
+        return false;
+
+    method = keepalive_method(pending);
+    if (method <= 0 || method >= SIP_METHOD_COUNT || !(keepalive.methods & (1u << method)))
+        return false;
+
+    keepalive_key(method, packet->src, packet->dst, key);
+    if (!(entry = htable_find(keepalive.entries, key))) {
+        // Messages of new peers are discarded once limit is reached
+        keepalive.folded++;
+        if (keepalive.limit && vector_count(keepalive.list) >= keepalive.limit)
+            return true;
+        if (!(entry = sng_malloc(sizeof(keepalive_t))))
+            return true;
+        strcpy(entry->key, key);
+        entry->method = method;
+        entry->src = packet->src;
+        entry->dst = packet->dst;
+        entry->last_latency = -1;
+        entry->first = time;
+        htable_insert(keepalive.entries, entry->key, entry);
+        vector_append(keepalive.list, entry);
+        keepalive.memory += sizeof(keepalive_t) + sizeof(keepalive_msg_t) * keepalive.msgs;
+    } else {
+        keepalive.folded++;
+    }
+
+    entry->last = time;
+    if (msg_is_request(&pending->msg)) {
+        entry->requests++;
+        // Retransmissions keep the time of the first request
+        if (!entry->pending || entry->pending_cseq != pending->msg.cseq) {
+            entry->pending = true;
+            entry->pending_cseq = pending->msg.cseq;
+            entry->pending_time = time;
+        }
+    } else {
+        entry->responses++;
+        code = pending->msg.reqresp;
+        if (code >= 200) {
+            entry->last_code = code;
+            if (entry->pending && entry->pending_cseq == pending->msg.cseq) {
+                entry->last_latency = (int64_t) (time.tv_sec - entry->pending_time.tv_sec) * 1000000
+                                      + (time.tv_usec - entry->pending_time.tv_usec);
+                entry->pending = false;
+            }
+        }
+    }
+
+    if (keepalive.msgs)
+        keepalive_store_msg(entry, packet, time);
+
+    return true;
+}
+
+int
+keepalive_count()
+{
+    return (keepalive.list) ? vector_count(keepalive.list) : 0;
+}
+
+keepalive_t *
+keepalive_item(int pos)
+{
+    return (keepalive.list) ? vector_item(keepalive.list, pos) : NULL;
+}
+
+keepalive_msg_t *
+keepalive_msg(keepalive_t *entry, int pos)
+{
+    if (!entry || pos < 0 || pos >= entry->msgs_count)
+        return NULL;
+    return &entry->msgs[(entry->msgs_first + entry->msgs_count - 1 - pos) % keepalive.msgs];
+}
+
+uint64_t
+keepalive_folded()
+{
+    return keepalive.folded;
+}
+
+size_t
+keepalive_memory()
+{
+    return keepalive.memory;
+}
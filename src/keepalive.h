@@ -0,0 +1,205 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file keepalive.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to aggregate keepalive dialogs by peers
+ *
+ * OPTIONS pings and registration refreshes usually create most of the
+ * stored dialogs. Requests of configured methods (and their responses)
+ * that do not belong to a stored dialog can be folded into a single
+ * entry for each method and pair of peers, keeping only counters, the
+ * last final response and optionally the last messages payloads.
+ */
+#ifndef __SNGREP_KEEPALIVE_H
+#define __SNGREP_KEEPALIVE_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include "address.h"
+#include "hash.h"
+#include "vector.h"
+#include "sip.h"
+
+//! Max length of an aggregate entry key
+#define KEEPALIVE_KEY_LEN 128
+//! Max number of stored messages for each entry
+#define KEEPALIVE_MSGS_MAX 64
+
+//! Shorter declaration of keepalive structure
+typedef struct keepalive keepalive_t;
+//! Shorter declaration of keepalive_msg structure
+typedef struct keepalive_msg keepalive_msg_t;
+//! Shorter declaration of keepalive_config structure
+typedef struct keepalive_config keepalive_config_t;
+
+/**
+ * @brief Message stored in an aggregate entry
+ */
+struct keepalive_msg {
+    //! Capture time of the message
+    struct timeval time;
+    //! Message origin and destination
+    address_t src, dst;
+    //! Message payload (NULL terminated)
+    char *payload;
+    //! Payload length
+    uint32_t len;
+};
+
+/**
+ * @brief Aggregate entry of a method between two peers
+ */
+struct keepalive {
+    //! Hash table key: method and both peers addresses
+    char key[KEEPALIVE_KEY_LEN];
+    //! Aggregated request method
+    int method;
+    //! Peer sending the first request and its destination
+    address_t src, dst;
+    //! Number of requests
+    uint64_t requests;
+    //! Number of responses
+    uint64_t responses;
+    //! Last final response code (0 if none)
+    int last_code;
+    //! Time between last answered request and its final response (usecs, -1 if none)
+    int64_t last_latency;
+    //! Last request is waiting for a final response
+    bool pending;
+    //! CSeq of the last request waiting for a final response
+    uint32_t pending_cseq;
+    //! Capture time of the last request waiting for a final response
+    struct timeval pending_time;
+    //! Capture time of first and last messages
+    struct timeval first, last;
+    //! Stored messages ring (NULL if messages are not stored)
+    keepalive_msg_t *msgs;
+    //! First stored message position in the ring
+    int msgs_first;
+    //! Number of stored messages
+    int msgs_count;
+};
+
+/**
+ * @brief Aggregate entries storage
+ */
+struct keepalive_config {
+    //! Bitmask of aggregated methods (0 if disabled)
+    uint32_t methods;
+    //! Number of messages stored in each entry
+    int msgs;
+    //! Max number of entries
+    int limit;
+    //! Entries indexed by their key
+    htable_t *entries;
+    //! Entries in creation order
+    vector_t *list;
+    //! Number of messages folded into entries
+    uint64_t folded;
+    //! Memory used by entries
+    size_t memory;
+};
+
+/**
+ * @brief Initialize aggregate entries storage
+ *
+ * Aggregation is only enabled if sip.keepalive setting has a list of
+ * valid methods.
+ *
+ * @param limit Max number of entries
+ */
+void
+keepalive_init(int limit);
+
+/**
+ * @brief Remove all entries and deallocate their storage
+ */
+void
+keepalive_deinit();
+
+/**
+ * @brief Remove all entries
+ */
+void
+keepalive_clear();
+
+/**
+ * @brief Check if any method is being aggregated
+ */
+bool
+keepalive_enabled();
+
+/**
+ * @brief Fold a message without dialog into its aggregate entry
+ *
+ * Requests of aggregated methods and responses with an aggregated CSeq
+ * method are accounted in the entry of their method and peers. Messages
+ * are folded even if the entries limit has been reached, but only
+ * existing entries are updated.
+ *
+ * This must be called with the capture lock.
+ *
+ * @param pending Parsed message data
+ * @return true if message has been folded, false if it must be stored
+ */
+bool
+keepalive_fold(sip_pending_t *pending);
+
+/**
+ * @brief Get the number of aggregate entries
+ */
+int
+keepalive_count();
+
+/**
+ * @brief Get an aggregate entry by its creation position
+ */
+keepalive_t *
+keepalive_item(int pos);
+
+/**
+ * @brief Get a stored message of an entry
+ *
+ * @param entry Aggregate entry
+ * @param pos Message position, starting with the newest message
+ * @return stored message or NULL if there is no message at that position
+ */
+keepalive_msg_t *
+keepalive_msg(keepalive_t *entry, int pos);
+
+/**
+ * @brief Get the number of messages folded into entries
+ */
+uint64_t
+keepalive_folded();
+
+/**
+ * @brief Get the memory used by aggregate entries
+ */
+size_t
+keepalive_memory();
+
+#endif /* __SNGREP_KEEPALIVE_H */
@@ -35,7 +35,16 @@
 #include "option.h"
 #include "vector.h"
 #include "capture.h"
+#include "capture_merge.h"
+#include "capture_reader.h"
 #include "capture_eep.h"
+#include "report.h"
+#include "health.h"
+#include "cdr.h"
+#include "history.h"
+#include "snapshot.h"
+#include "filter.h"
+#include "parallel.h"
 #ifdef WITH_GNUTLS
 #include "capture_gnutls.h"
 #endif
@@ -44,6 +53,21 @@
 #endif
 #include "curses/ui_manager.h"
 
+//! Command line options without short version
+enum main_long_options {
+    OPTION_FROM = 256,
+    OPTION_TO,
+    OPTION_INDEX,
+    OPTION_SNAPSHOT,
+    OPTION_ROTATE_SIZE,
+    OPTION_ROTATE_TIME,
+    OPTION_MAX_FILES,
+    OPTION_EEP_RELAY,
+    OPTION_MATCH_FILE,
+    OPTION_PUBLISH,
+    OPTION_ATTACH,
+};
+
 /**
  * @brief Usage function
  *
@@ -52,7 +76,7 @@
 void
 usage()
 {
-    printf("Usage: %s [-hVcivNqrD] [-IO pcap_dump] [-d dev] [-l limit]"
+    printf("Usage: %s [-hVcivNqrD] [-IO pcap_dump] [-d dev] [-l limit] [-m pattern]"
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
            " [-k keyfile]"
 #endif
@@ -70,15 +94,27 @@ usage()
            "    -l --limit\t\t Set capture limit to N dialogs\n"
            "    -i --icase\t\t Make <match expression> case insensitive\n"
            "    -v --invert\t\t Invert <match expression>\n"
+           "    -m --match\t\t Only store dialogs containing this string (repeatable)\n"
+           "    --match-file\t Read -m strings from file, one per line\n"
            "    -N --no-interface\t Don't display sngrep interface, just capture\n"
            "    -q --quiet\t\t Don't print captured dialogs in no interface mode\n"
            "    -D --dump-config\t Print active configuration settings and exit\n"
            "    -f --config\t\t Read configuration from file\n"
            "    -F --no-config\t Do not read configuration from default config file\n"
            "    -R --rotate\t\t Rotate calls when capture limit have been reached\n"
+           "    --from\t\t Ignore input file packets before this date\n"
+           "    --to\t\t Ignore input file packets after this date\n"
+           "    --index\t\t Create input files indexes and exit\n"
+           "    --snapshot\t\t Save parsed calls to this file on exit\n"
+           "    --publish\t\t Publish stored calls packets in this shared memory\n"
+           "    --attach\t\t Display calls published by other sngrep in this shared memory\n"
+           "    --rotate-size\t Start a new output file after N MB\n"
+           "    --rotate-time\t Start a new output file after N minutes\n"
+           "    --max-files\t\t Only keep last N output files\n"
 #ifdef USE_EEP
            "    -H --eep-send\t Homer sipcapture url (udp:X.X.X.X:XXXX)\n"
            "    -L --eep-listen\t Listen for encapsulated packets (udp:X.X.X.X:XXXX)\n"
+           "    --eep-relay\t\t Forward -L packets to -H urls without parsing them\n"
 #endif
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
            "    -k --keyfile\t RSA private keyfile to decrypt captured packets\n"
@@ -107,6 +143,9 @@ version()
 #ifdef WITH_PCRE
            " * Compiled with Perl Compatible regular expressions support.\n"
 #endif
+#ifdef WITH_PCRE2
+           " * Compiled with Perl Compatible regular expressions support (PCRE2).\n"
+#endif
 #ifdef USE_IPV6
            " * Compiled with IPv6 support.\n"
 #endif
@@ -117,6 +156,34 @@ version()
            PACKAGE, VERSION);
 }
 
+/**
+ * @brief Read match patterns from a file
+ *
+ * Each non empty line of the file is a pattern.
+ *
+ * @return 0 if file has been read, 1 otherwise
+ */
+static int
+read_match_patterns(const char *file, vector_t *patterns)
+{
+    char line[1024];
+    FILE *fp;
+
+    if (!(fp = fopen(file, "r"))) {
+        fprintf(stderr, "Unable to open match file %s\n", file);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strlen(line))
+            vector_append(patterns, strdup(line));
+    }
+
+    fclose(fp);
+    return 0;
+}
+
 /**
  * @brief Main function logic
  *
@@ -133,9 +200,13 @@ main(int argc, char* argv[])
 #endif
     const char *match_expr;
     int match_insensitive = 0, match_invert = 0;
-    int no_interface = 0, quiet = 0, rtp_capture = 0, rotate = 0, no_config = 0;
+    int no_interface = 0, quiet = 0, rtp_capture = 0, rotate = 0, no_config = 0, status = 0;
+    int index = 0;
+    const char *snapshot = NULL, *publish = NULL, *attach = NULL;
+    struct timeval from = { 0 }, to = { 0 };
     vector_t *infiles = vector_create(0, 1);
     vector_t *indevices = vector_create(0, 1);
+    vector_t *match_patterns = vector_create(0, 8);
 
     // Program options
     static struct option long_options[] = {
@@ -152,6 +223,8 @@ main(int argc, char* argv[])
         { "limit", required_argument, 0, 'l' },
         { "icase", no_argument, 0, 'i' },
         { "invert", no_argument, 0, 'v' },
+        { "match", required_argument, 0, 'm' },
+        { "match-file", required_argument, 0, OPTION_MATCH_FILE },
         { "no-interface", no_argument, 0, 'N' },
         { "dump-config", no_argument, 0, 'D' },
         { "rotate", no_argument, 0, 'R' },
@@ -160,13 +233,24 @@ main(int argc, char* argv[])
 #ifdef USE_EEP
         { "eep-listen", required_argument, 0, 'L' },
         { "eep-send", required_argument, 0, 'H' },
+        { "eep-relay", no_argument, 0, OPTION_EEP_RELAY },
 #endif
         { "quiet", no_argument, 0, 'q' },
+        { "from", required_argument, 0, OPTION_FROM },
+        { "to", required_argument, 0, OPTION_TO },
+        { "index", no_argument, 0, OPTION_INDEX },
+        { "snapshot", required_argument, 0, OPTION_SNAPSHOT },
+        { "publish", required_argument, 0, OPTION_PUBLISH },
+        { "attach", required_argument, 0, OPTION_ATTACH },
+        { "rotate-size", required_argument, 0, OPTION_ROTATE_SIZE },
+        { "rotate-time", required_argument, 0, OPTION_ROTATE_TIME },
+        { "max-files", required_argument, 0, OPTION_MAX_FILES },
+        { 0, 0, 0, 0 }
     };
 
     // Parse command line arguments that have high priority
     opterr = 0;
-    char *options = "hVd:I:O:pqtW:k:crl:ivNqDL:H:Rf:F";
+    char *options = "hVd:I:O:pqtW:k:crl:ivm:NqDL:H:Rf:F";
     while ((opt = getopt_long(argc, argv, options, long_options, &idx)) != -1) {
         switch (opt) {
             case 'h':
@@ -244,6 +328,13 @@ main(int argc, char* argv[])
             case 'v':
                 match_invert++;
                 break;
+            case 'm':
+                vector_append(match_patterns, strdup(optarg));
+                break;
+            case OPTION_MATCH_FILE:
+                if (read_match_patterns(optarg, match_patterns) != 0)
+                    return 1;
+                break;
             case 'N':
                 no_interface = 1;
                 setting_set_value(SETTING_CAPTURE_STORAGE, "none");
@@ -264,6 +355,39 @@ main(int argc, char* argv[])
                 rotate = 1;
                 setting_set_value(SETTING_CAPTURE_ROTATE, SETTING_ON);
                 break;
+            case OPTION_FROM:
+                if (timeval_from_str(optarg, &from) != 0) {
+                    fprintf(stderr, "Invalid --from date: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPTION_TO:
+                if (timeval_from_str(optarg, &to) != 0) {
+                    fprintf(stderr, "Invalid --to date: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPTION_INDEX:
+                index = 1;
+                break;
+            case OPTION_SNAPSHOT:
+                snapshot = optarg;
+                break;
+            case OPTION_PUBLISH:
+                publish = optarg;
+                break;
+            case OPTION_ATTACH:
+                attach = optarg;
+                break;
+            case OPTION_ROTATE_SIZE:
+                setting_set_value(SETTING_CAPTURE_WRITER_ROTATE_SIZE, optarg);
+                break;
+            case OPTION_ROTATE_TIME:
+                setting_set_value(SETTING_CAPTURE_WRITER_ROTATE_TIME, optarg);
+                break;
+            case OPTION_MAX_FILES:
+                setting_set_value(SETTING_CAPTURE_WRITER_MAX_FILES, optarg);
+                break;
                 // Dark options for dummy ones
             case 'p':
             case 't':
@@ -284,6 +408,11 @@ main(int argc, char* argv[])
 #else
                 fprintf(stderr, "sngrep is not compiled with HEP/EEP support.");
                 exit(1);
+#endif
+#ifdef USE_EEP
+            case OPTION_EEP_RELAY:
+                setting_set_value(SETTING_EEP_RELAY, SETTING_ON);
+                break;
 #endif
             case '?':
                 if (strchr(options, optopt)) {
@@ -318,6 +447,7 @@ main(int argc, char* argv[])
 
     // Initialize SIP Messages Storage
     sip_init(limit, only_calls, no_incomplete);
+    filter_index_init();
 
     // Set capture options
     capture_init(limit, rtp_capture, rotate);
@@ -328,15 +458,37 @@ main(int argc, char* argv[])
 #endif
 
     // If no device or files has been specified in command line, use default
-    if (vector_count(indevices) == 0 && vector_count(infiles) == 0) {
+    if (vector_count(indevices) == 0 && vector_count(infiles) == 0 && !attach) {
         vector_append(indevices, (char *) device);
     }
 
-    // If we have an input file, load it
-    for (i = 0; i < vector_count(infiles); i++) {
-        // Try to load file
-        if (capture_offline(vector_item(infiles, i), outfile) != 0)
+    // Only create input files indexes
+    if (index) {
+        for (i = 0; i < vector_count(infiles); i++) {
+            if (capture_reader_index_file(vector_item(infiles, i)) != 0)
+                return 1;
+        }
+        return 0;
+    }
+
+    // Only parse input files packets inside requested time window
+    capture_set_time_window(from, to);
+
+    // Published segment header needs the link type of opened sources
+    if (publish)
+        setting_set_value(SETTING_CAPTURE_ASYNC, SETTING_OFF);
+
+    // If we have multiple input files, read them sorted by time
+    if (vector_count(infiles) > 1 && setting_enabled(SETTING_CAPTURE_MERGE)) {
+        if (capture_merge(infiles, outfile) != 0)
             return 1;
+    } else {
+        // If we have an input file, load it
+        for (i = 0; i < vector_count(infiles); i++) {
+            // Try to load file
+            if (capture_offline(vector_item(infiles, i), outfile) != 0)
+                return 1;
+        }
     }
 
     // If we have an input device, load it
@@ -346,6 +498,14 @@ main(int argc, char* argv[])
             return 1;
     }
 
+    // Parse packets published by other sngrep process
+    if (attach && snapshot_attach(attach, outfile) != 0)
+        return 1;
+
+    // Publish packets of stored calls for attached processes
+    if (publish && snapshot_publish(publish) != 0)
+        return 1;
+
     // Remove Input files vector
     vector_destroy(infiles);
 
@@ -385,6 +545,27 @@ main(int argc, char* argv[])
             }
     }
 
+    // Set the capture literal patterns
+    if (vector_count(match_patterns)) {
+        if (sip_set_match_patterns(match_patterns, match_insensitive)) {
+            fprintf(stderr, "Unable to set match patterns\n");
+            return 1;
+        }
+    }
+    vector_set_destroyer(match_patterns, vector_generic_destroyer);
+    vector_destroy(match_patterns);
+
+    // Export dialogs summary records without interface
+    if (no_interface && cdr_init() != 0)
+        return 1;
+
+    // Keep rotated dialogs browsable in the interface
+    if (!no_interface && history_init() != 0)
+        return 1;
+
+    // Write internal containers report on SIGUSR1
+    health_init();
+
     // Start a capture thread
     if (capture_launch_thread() != 0) {
         ncurses_deinit();
@@ -392,16 +573,29 @@ main(int argc, char* argv[])
         return 1;
     }
 
+    // Keep interface away from capture threads CPUs
+    capture_thread_setup(pthread_self(), setting_get_value(SETTING_UI_AFFINITY), 0, 0);
+
     if (!no_interface) {
+        // Threads for filtering and sorting stored calls
+        if (parallel_init(setting_get_intvalue(SETTING_UI_WORKERS)) != 0)
+            fprintf(stderr, "Failed to launch filter threads.\n");
+        // Find local addresses without blocking the interface
+        address_local_preload();
         // Initialize interface
         ncurses_init();
         // This is a blocking call.
         // Create the first panel and wait for user input
         ui_create_panel(PANEL_CALL_LIST);
         ui_wait_for_input();
+    } else if (report_enabled()) {
+        // Report counters until capture finishes
+        if (report_loop() != 0)
+            status = 1;
     } else {
         setbuf(stdout, NULL);
         while(capture_is_running()) {
+            health_check_signal();
             if (!quiet)
                 printf("\rDialog count: %d", sip_calls_count());
             usleep(500 * 1000);
@@ -410,12 +604,40 @@ main(int argc, char* argv[])
             printf("\rDialog count: %d\n", sip_calls_count());
     }
 
+    // Report sources that capture threads could not open
+    if (no_interface && capture_sources_errors() > 0)
+        status = 1;
+
+    // Save parsed calls before releasing them
+    if (snapshot && snapshot_save(snapshot) != 0)
+        status = 1;
+
+    // Export remaining dialogs records
+    cdr_deinit();
+
+    // Stop compressing finished calls before releasing capture lock
+    sip_calls_compress_stop();
+
+#ifdef USE_EEP
+    // Stop EEP listeners, send queued EEP packets and close sockets
+    capture_eep_deinit();
+#endif
+
     // Capture deinit
     capture_deinit();
 
+    // Close rotated dialogs history files
+    history_deinit();
+
+    // Attached processes will not receive more packets
+    snapshot_publish_close();
+
     // Deinitialize interface
     ncurses_deinit();
 
+    // Stop filtering and sorting threads
+    parallel_deinit();
+
     // Deinitialize configuration options
     deinit_options();
 
@@ -423,5 +645,5 @@ main(int argc, char* argv[])
     sip_deinit();
 
     // Leaving!
-    return 0;
+    return status;
 }
@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include "media.h"
 #include "rtp.h"
+#include "sip.h"
 #include "util.h"
 
 sdp_media_t *
@@ -39,13 +40,12 @@ media_create(struct sip_msg *msg)
     sdp_media_t *media;;
 
     // Allocate memory for this media structure
-    if (!(media = sng_malloc(sizeof(sdp_media_t))))
+    if (!(media = arena_alloc(msg->call->arena, sizeof(sdp_media_t))))
         return NULL;
 
     // Initialize all fields
     media->msg = msg;
     media->formats = vector_create(0, 1);
-    vector_set_destroyer(media->formats, vector_generic_destroyer);
     return media;
 }
 
@@ -55,8 +55,8 @@ media_destroyer(void *item)
     sdp_media_t *media = (sdp_media_t *) item;
     if (!item)
         return;
+    // Media and formats memory is released with the call arena
     vector_destroy(media->formats);
-    sng_free(media);
 }
 
 void
@@ -82,7 +82,7 @@ media_add_format(sdp_media_t *media, uint32_t code, const char *format)
 {
     sdp_media_fmt_t *fmt;
 
-    if (!(fmt = sng_malloc(sizeof(sdp_media_fmt_t))))
+    if (!(fmt = arena_alloc(media->msg->call->arena, sizeof(sdp_media_fmt_t))))
         return;
 
     fmt->id = code;
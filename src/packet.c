@@ -30,13 +30,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include "packet.h"
+#include "pool.h"
+
+//! Frame contents shorter than this are allocated from pools
+#define FRAME_SMALL_LEN 1536
+//! Size difference between frame content pools
+#define FRAME_SMALL_STEP 128
+//! Number of frame content pools
+#define FRAME_SMALL_POOLS (FRAME_SMALL_LEN / FRAME_SMALL_STEP)
+
+//! Pools of packet structures
+static pool_t packet_pool = POOL_INITIALIZER(sizeof(packet_t));
+static pool_t frame_pool = POOL_INITIALIZER(sizeof(frame_t));
+//! Pools of frame contents (one for each FRAME_SMALL_STEP bytes)
+static pool_t frame_data_pools[FRAME_SMALL_POOLS] = {
+    POOL_INITIALIZER(1 * FRAME_SMALL_STEP), POOL_INITIALIZER(2 * FRAME_SMALL_STEP),
+    POOL_INITIALIZER(3 * FRAME_SMALL_STEP), POOL_INITIALIZER(4 * FRAME_SMALL_STEP),
+    POOL_INITIALIZER(5 * FRAME_SMALL_STEP), POOL_INITIALIZER(6 * FRAME_SMALL_STEP),
+    POOL_INITIALIZER(7 * FRAME_SMALL_STEP), POOL_INITIALIZER(8 * FRAME_SMALL_STEP),
+    POOL_INITIALIZER(9 * FRAME_SMALL_STEP), POOL_INITIALIZER(10 * FRAME_SMALL_STEP),
+    POOL_INITIALIZER(11 * FRAME_SMALL_STEP), POOL_INITIALIZER(12 * FRAME_SMALL_STEP)
+};
+//! Thread caches of packet structures pools
+static __thread pool_cache_t packet_cache, frame_cache;
+static __thread pool_cache_t frame_data_caches[FRAME_SMALL_POOLS];
 
 packet_t *
 packet_create(uint8_t ip_ver, uint8_t proto, address_t src, address_t dst, uint32_t id)
 {
     // Create a new packet
     packet_t *packet;
-    packet = malloc(sizeof(packet_t));
+    packet = pool_alloc(&packet_pool, &packet_cache);
     memset(packet, 0, sizeof(packet_t));
     packet->ip_version = ip_ver;
     packet->proto = proto;
@@ -56,11 +80,14 @@ packet_clone(packet_t *packet)
     // Create a new packet with the original information
     clone =    packet_create(packet->ip_version, packet->proto, packet->src, packet->dst, packet->ip_id);
     clone->tcp_seq = packet->tcp_seq;
+    clone->eep = packet->eep;
 
     // Append this frames to the original packet
     vector_iter_t frames = vector_iterator(packet->frames);
-    while ((frame = vector_iterator_next(&frames)))
-        packet_add_frame(clone, frame->header, frame->data);
+    while ((frame = vector_iterator_next(&frames))) {
+        // Frames in disk storage share their content location
+        packet_add_frame(clone, &frame->header, frame->data)->offset = frame->offset;
+    }
 
     return clone;
 }
@@ -76,15 +103,15 @@ packet_destroy(packet_t *packet)
     // Destroy frames
     vector_iter_t it = vector_iterator(packet->frames);
     while ((frame = vector_iterator_next(&it))) {
-        free(frame->header);
-        free(frame->data);
+        frame_free_data(frame);
+        pool_free(&frame_pool, &frame_cache, frame);
     }
 
     // TODO Free remaining packet data
-    vector_set_destroyer(packet->frames, vector_generic_destroyer);
     vector_destroy(packet->frames);
-    free(packet->payload);
-    free(packet);
+    if (!packet->payload_ref)
+        free(packet->payload);
+    pool_free(&packet_pool, &packet_cache, packet);
 }
 
 void
@@ -99,9 +126,11 @@ packet_free_frames(packet_t *pkt)
     frame_t *frame;
     vector_iter_t it = vector_iterator(pkt->frames);
 
+    // Payload must survive frames content
+    packet_detach_payload(pkt);
+
     while ((frame = vector_iterator_next(&it))) {
-        free(frame->data);
-        frame->data = NULL;
+        frame_free_data(frame);
     }
 }
 
@@ -113,14 +142,61 @@ packet_set_transport_data(packet_t *pkt, uint16_t sport, uint16_t dport)
     return pkt;
 }
 
+/**
+ * @brief Get the allocated size of a frame content
+ */
+static size_t
+frame_data_size(uint32_t caplen)
+{
+    if (caplen < FRAME_SMALL_LEN)
+        return frame_data_pools[caplen / FRAME_SMALL_STEP].size;
+    return caplen + 1;
+}
+
+u_char *
+frame_alloc_data(frame_t *frame)
+{
+    uint32_t caplen = frame->header.caplen;
+
+    // Small contents are reused from the pool of their size
+    if (caplen < FRAME_SMALL_LEN) {
+        frame->data = pool_alloc(&frame_data_pools[caplen / FRAME_SMALL_STEP],
+                                 &frame_data_caches[caplen / FRAME_SMALL_STEP]);
+    } else {
+        frame->data = malloc(caplen + 1);
+    }
+    return frame->data;
+}
+
+void
+frame_free_data(frame_t *frame)
+{
+    uint32_t caplen = frame->header.caplen;
+
+    if (!frame->data)
+        return;
+
+    if (caplen < FRAME_SMALL_LEN) {
+        pool_free(&frame_data_pools[caplen / FRAME_SMALL_STEP],
+                  &frame_data_caches[caplen / FRAME_SMALL_STEP], frame->data);
+    } else {
+        free(frame->data);
+    }
+    frame->data = NULL;
+}
+
 frame_t *
 packet_add_frame(packet_t *pkt, const struct pcap_pkthdr *header, const u_char *packet)
 {
-    frame_t *frame = malloc(sizeof(frame_t));
-    frame->header = malloc(sizeof(struct pcap_pkthdr));
-    memcpy(frame->header, header, sizeof(struct pcap_pkthdr));
-    frame->data = malloc(header->caplen);
-    memcpy(frame->data, packet, header->caplen);
+    frame_t *frame = pool_alloc(&frame_pool, &frame_cache);
+    frame->header = *header;
+    frame->data = NULL;
+    frame->offset = -1;
+    if (packet && frame_alloc_data(frame)) {
+        // Keep frame data NULL terminated so payload can point into it
+        memcpy(frame->data, packet, header->caplen);
+        frame->data[header->caplen] = '\0';
+    }
     vector_append(pkt->frames, frame);
     return frame;
 }
@@ -135,9 +211,11 @@ void
 packet_set_payload(packet_t *packet, u_char *payload, uint32_t payload_len)
 {
     // Free previous payload
-    if (packet->payload)
+    if (packet->payload && !packet->payload_ref)
         free(packet->payload);
+    packet->payload = NULL;
     packet->payload_len = 0;
+    packet->payload_ref = false;
 
     // Set new payload
     if (payload) {
@@ -148,6 +226,49 @@ packet_set_payload(packet_t *packet, u_char *payload, uint32_t payload_len)
     }
 }
 
+void
+packet_set_frame_payload(packet_t *packet, u_char *payload, uint32_t payload_len)
+{
+    frame_t *frame = vector_first(packet->frames);
+
+    // Payload must end with the only frame content
+    if (!payload || vector_count(packet->frames) != 1 || !frame->data
+        || payload < frame->data || payload + payload_len != frame->data + frame->header.caplen) {
+        packet_set_payload(packet, payload, payload_len);
+        return;
+    }
+
+    // Remove previous payload
+    packet_set_payload(packet, NULL, 0);
+
+    // Frame data is NULL terminated
+    packet->payload = payload;
+    packet->payload_len = payload_len;
+    packet->payload_ref = true;
+}
+
+void
+packet_detach_payload(packet_t *packet)
+{
+    if (packet->payload_ref)
+        packet_set_payload(packet, packet->payload, packet->payload_len);
+}
+
+void
+packet_trim_payload(packet_t *packet, uint32_t payload_len)
+{
+    // Payload can only be shortened
+    if (!packet->payload || payload_len >= packet->payload_len)
+        return;
+
+    // Never modify frame data
+    packet_detach_payload(packet);
+
+    // Keep payload NULL terminated
+    packet->payload[payload_len] = '\0';
+    packet->payload_len = payload_len;
+}
+
 uint32_t
 packet_payloadlen(packet_t *packet)
 {
@@ -160,6 +281,43 @@ packet_payload(packet_t *packet)
     return packet->payload;
 }
 
+size_t
+packet_memory(packet_t *packet)
+{
+    size_t memory;
+
+    if (!packet)
+        return 0;
+
+    // Packet data and payload (unless it points into frame data)
+    memory = sizeof(packet_t);
+    if (packet->payload && !packet->payload_ref)
+        memory += packet->payload_len;
+
+    return memory + packet_frames_memory(packet);
+}
+
+size_t
+packet_frames_memory(packet_t *packet)
+{
+    frame_t *frame;
+    size_t memory = 0;
+    vector_iter_t it;
+
+    if (!packet)
+        return 0;
+
+    // Frames in memory
+    it = vector_iterator(packet->frames);
+    while ((frame = vector_iterator_next(&it))) {
+        memory += sizeof(frame_t);
+        if (frame->data)
+            memory += frame_data_size(frame->header.caplen);
+    }
+
+    return memory;
+}
+
 struct timeval
 packet_time(packet_t *packet)
 {
@@ -168,8 +326,8 @@ packet_time(packet_t *packet)
 
     // Return first frame timestamp
     if (packet && (first = vector_first(packet->frames))) {
-        ts.tv_sec = first->header->ts.tv_sec;
-        ts.tv_usec = first->header->ts.tv_usec;
+        ts.tv_sec = first->header.ts.tv_sec;
+        ts.tv_usec = first->header.ts.tv_usec;
     }
 
     // Return packe timestamp
@@ -36,12 +36,16 @@
 #ifndef __SNGREP_CAPTURE_PACKET_H
 #define __SNGREP_CAPTURE_PACKET_H
 
+#include <stdbool.h>
 #include <time.h>
 #include <sys/types.h>
 #include <pcap.h>
 #include "address.h"
 #include "vector.h"
 
+//! Frame content offset while it is stored in its call compressed block
+#define FRAME_OFFSET_COMPRESSED -2
+
 //! Stored packet types
 enum packet_type {
     PACKET_SIP_UDP = 0,
@@ -84,10 +88,18 @@ struct packet {
     uint32_t ip_exp_len;
     //! Last TCP sequence frame
     uint32_t tcp_seq;
+    //! TCP flags of a segment pending TLS decryption in TLS threads (0 if none)
+    uint8_t tcp_flags;
+    //! Packet is counted in capture packets pending to be parsed
+    bool unparsed;
     //! PCAP Packet payload when it can not be get from data
     u_char *payload;
     //! Payload length
     uint32_t payload_len;
+    //! Payload points into the first frame data instead of its own buffer
+    bool payload_ref;
+    //! Packet received through EEP (frames only contain the payload)
+    bool eep;
     //! Packet frame list (frame_t)
     vector_t *frames;
 };
@@ -100,13 +112,18 @@ struct packet {
  */
 struct frame {
     //! PCAP Frame Header data
-    struct pcap_pkthdr *header;
-    //! PCAP Frame content
+    struct pcap_pkthdr header;
+    //! PCAP Frame content (NULL if not stored in memory)
     u_char *data;
+    //! Frame content offset in disk storage (-1 if not stored in disk)
+    int64_t offset;
 };
 
 /**
  * @brief Allocate memory to store new packet data
+ *
+ * Packets and frames are reused from thread local pools, so they can be
+ * created and destroyed in the capture hot path without calling malloc.
  */
 packet_t *
 packet_create(uint8_t ip_ver, uint8_t proto, address_t src, address_t dst, uint32_t id);
@@ -125,6 +142,8 @@ packet_set_transport_data(packet_t *pkt, uint16_t sport, uint16_t dport);
 
 /**
  * @brief Add a new frame to the given packet
+ *
+ * If packet data is NULL, the frame is added without content
  */
 frame_t *
 packet_add_frame(packet_t *pkt, const struct pcap_pkthdr *header, const u_char *packet);
@@ -141,6 +160,23 @@ packet_destroy(packet_t *packet);
 void
 packet_destroyer(void *packet);
 
+/**
+ * @brief Allocate frame content buffer
+ *
+ * Buffer has room for header caplen bytes and a NULL terminator. Small
+ * contents are allocated from fixed size pools.
+ *
+ * @return frame content or NULL on allocation error
+ */
+u_char *
+frame_alloc_data(frame_t *frame);
+
+/**
+ * @brief Free frame content buffer
+ */
+void
+frame_free_data(frame_t *frame);
+
 /**
  * @brief Free packet frames data.
  *
@@ -161,6 +197,39 @@ packet_set_type(packet_t *packet, enum packet_type type);
 void
 packet_set_payload(packet_t *packet, u_char *payload, uint32_t payload_len);
 
+/**
+ * @brief Set packet payload pointing into its frame data
+ *
+ * Payload is not copied when it is the tail of the only packet frame.
+ * Otherwise (frame trailers, reassembled data) this works as
+ * packet_set_payload.
+ *
+ * @param packet Packet structure pointer
+ * @param payload Payload start
+ * @param payload_len Payload length
+ */
+void
+packet_set_frame_payload(packet_t *packet, u_char *payload, uint32_t payload_len);
+
+/**
+ * @brief Copy packet payload out of its frame data
+ *
+ * Required before releasing frames content that payload points to.
+ *
+ * @param packet Packet structure pointer
+ */
+void
+packet_detach_payload(packet_t *packet);
+
+/**
+ * @brief Shorten packet payload without reallocating it
+ *
+ * @param packet Packet structure pointer
+ * @param payload_len new payload length (must not be greater than current)
+ */
+void
+packet_trim_payload(packet_t *packet, uint32_t payload_len);
+
 /**
  * @brief Getter for capture payload size
  */
@@ -173,6 +242,22 @@ packet_payloadlen(packet_t *packet);
 u_char *
 packet_payload(packet_t *packet);
 
+/**
+ * @brief Get the memory used by a packet
+ *
+ * @return bytes allocated for the packet, its payload and its frames
+ */
+size_t
+packet_memory(packet_t *packet);
+
+/**
+ * @brief Get the memory used by packet frames
+ *
+ * @return bytes allocated for the packet frames and their contents
+ */
+size_t
+packet_frames_memory(packet_t *packet);
+
 /**
  * @brief Get The timestamp for a packet.
  */
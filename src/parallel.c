@@ -0,0 +1,256 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file parallel.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to split work across a pool of threads
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "parallel.h"
+
+/**
+ * @brief Array being sorted by parallel_sort
+ */
+typedef struct parallel_sort {
+    //! Merged runs source and destination arrays
+    void **src, **dst;
+    //! Start position of each sorted run (and end of the last one)
+    int bounds[PARALLEL_MAX + 1];
+    //! Number of sorted runs
+    int runs;
+    //! Items comparison function
+    int (*cmp)(const void *, const void *);
+} parallel_sort_t;
+
+//! Worker threads and current work
+static parallel_pool_t workers = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * @brief Process chunks of current work until there are none left
+ */
+static void
+parallel_run()
+{
+    int start, end;
+
+    while ((start = __atomic_fetch_add(&workers.next, workers.chunk, __ATOMIC_RELAXED)) < workers.items) {
+        end = start + workers.chunk;
+        workers.func(workers.data, start, (end < workers.items) ? end : workers.items);
+    }
+}
+
+/**
+ * @brief Worker thread waiting for works to process
+ */
+static void *
+parallel_worker(void *data)
+{
+    unsigned int gen = 0;
+
+    pthread_mutex_lock(&workers.lock);
+    while (true) {
+        while (workers.running && workers.gen == gen)
+            pthread_cond_wait(&workers.start, &workers.lock);
+        if (!workers.running)
+            break;
+        gen = workers.gen;
+        pthread_mutex_unlock(&workers.lock);
+
+        parallel_run();
+
+        // Last worker notifies the caller thread
+        pthread_mutex_lock(&workers.lock);
+        if (--workers.pending == 0)
+            pthread_cond_signal(&workers.done);
+    }
+    pthread_mutex_unlock(&workers.lock);
+
+    return NULL;
+}
+
+int
+parallel_init(int threads)
+{
+    if (threads <= 0)
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > PARALLEL_MAX)
+        threads = PARALLEL_MAX;
+
+    // Caller thread is also one of the working threads
+    workers.running = true;
+    for (workers.count = 0; workers.count < threads - 1; workers.count++) {
+        if (pthread_create(&workers.threads[workers.count], NULL, parallel_worker, NULL) != 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+void
+parallel_deinit()
+{
+    int i;
+
+    pthread_mutex_lock(&workers.lock);
+    workers.running = false;
+    pthread_cond_broadcast(&workers.start);
+    pthread_mutex_unlock(&workers.lock);
+
+    for (i = 0; i < workers.count; i++)
+        pthread_join(workers.threads[i], NULL);
+    workers.count = 0;
+}
+
+int
+parallel_threads()
+{
+    return workers.count + 1;
+}
+
+void
+parallel_for(int count, int chunk, parallel_func_t func, void *data)
+{
+    if (chunk < 1)
+        chunk = 1;
+
+    // Small works are not worth waking up the workers
+    if (!workers.count || count <= chunk) {
+        if (count > 0)
+            func(data, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&workers.lock);
+    workers.func = func;
+    workers.data = data;
+    workers.items = count;
+    workers.chunk = chunk;
+    workers.next = 0;
+    workers.pending = workers.count;
+    workers.gen++;
+    pthread_cond_broadcast(&workers.start);
+    pthread_mutex_unlock(&workers.lock);
+
+    parallel_run();
+
+    // Wait until workers have finished their last chunk
+    pthread_mutex_lock(&workers.lock);
+    while (workers.pending)
+        pthread_cond_wait(&workers.done, &workers.lock);
+    pthread_mutex_unlock(&workers.lock);
+}
+
+/**
+ * @brief Sort each run of the array
+ */
+static void
+parallel_sort_runs(void *data, int start, int end)
+{
+    parallel_sort_t *sort = data;
+    int i;
+
+    for (i = start; i < end; i++) {
+        qsort(sort->src + sort->bounds[i], sort->bounds[i + 1] - sort->bounds[i],
+              sizeof(void *), sort->cmp);
+    }
+}
+
+/**
+ * @brief Merge each pair of sorted runs into the destination array
+ *
+ * Last run is copied if it has no pair.
+ */
+static void
+parallel_sort_merge(void *data, int start, int end)
+{
+    parallel_sort_t *sort = data;
+    int i, a, aend, b, bend, out;
+
+    for (i = start; i < end; i++) {
+        a = out = sort->bounds[i * 2];
+        aend = b = sort->bounds[(i * 2 + 1 < sort->runs) ? i * 2 + 1 : sort->runs];
+        bend = sort->bounds[(i * 2 + 2 < sort->runs) ? i * 2 + 2 : sort->runs];
+
+        // Items of the first run go first when equal
+        while (a < aend && b < bend) {
+            if (sort->cmp(&sort->src[b], &sort->src[a]) < 0) {
+                sort->dst[out++] = sort->src[b++];
+            } else {
+                sort->dst[out++] = sort->src[a++];
+            }
+        }
+        while (a < aend)
+            sort->dst[out++] = sort->src[a++];
+        while (b < bend)
+            sort->dst[out++] = sort->src[b++];
+    }
+}
+
+void
+parallel_sort(void **items, int count, int (*cmp)(const void *, const void *))
+{
+    parallel_sort_t sort;
+    void **buffer, **swap;
+    int i;
+
+    // Small lists are sorted by caller thread
+    if (!workers.count || count < PARALLEL_SORT_MIN || !(buffer = malloc(sizeof(void *) * count))) {
+        if (count > 1)
+            qsort(items, count, sizeof(void *), cmp);
+        return;
+    }
+
+    // One run for each thread
+    sort.src = items;
+    sort.dst = buffer;
+    sort.cmp = cmp;
+    sort.runs = parallel_threads();
+    for (i = 0; i <= sort.runs; i++)
+        sort.bounds[i] = (int) ((int64_t) count * i / sort.runs);
+    parallel_for(sort.runs, 1, parallel_sort_runs, &sort);
+
+    // Merge pairs of runs until there is only one
+    while (sort.runs > 1) {
+        parallel_for((sort.runs + 1) / 2, 1, parallel_sort_merge, &sort);
+        for (i = 0; i * 2 < sort.runs; i++)
+            sort.bounds[i] = sort.bounds[i * 2];
+        sort.bounds[i] = count;
+        sort.runs = i;
+        swap = sort.src;
+        sort.src = sort.dst;
+        sort.dst = swap;
+    }
+
+    // Sorted items may be in the temporal buffer
+    if (sort.src != items)
+        memcpy(items, sort.src, sizeof(void *) * count);
+    free(buffer);
+}
@@ -0,0 +1,129 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file parallel.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to split work across a pool of threads
+ *
+ * Passes over all stored calls (filtering and sorting) are split in
+ * chunks run by a pool of worker threads and the calling thread. The
+ * calling thread waits until all chunks have been processed, so workers
+ * can access calls while it holds the capture lock.
+ */
+#ifndef __SNGREP_PARALLEL_H
+#define __SNGREP_PARALLEL_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <pthread.h>
+
+//! Max number of threads working in parallel (including caller thread)
+#define PARALLEL_MAX 32
+//! Lists smaller than this are sorted by caller thread
+#define PARALLEL_SORT_MIN 8192
+
+//! Shorter declaration of parallel_pool structure
+typedef struct parallel_pool parallel_pool_t;
+
+/**
+ * @brief Function processing items from start to end (not included)
+ */
+typedef void (*parallel_func_t)(void *data, int start, int end);
+
+/**
+ * @brief Worker threads and the work being processed
+ */
+struct parallel_pool {
+    //! Worker threads
+    pthread_t threads[PARALLEL_MAX];
+    //! Number of worker threads (caller thread also works)
+    int count;
+    //! Lock protecting work state
+    pthread_mutex_t lock;
+    //! Signal workers new work is available and caller that it is done
+    pthread_cond_t start, done;
+    //! Generation of the current work
+    unsigned int gen;
+    //! Workers still processing current work
+    int pending;
+    //! Workers must keep waiting for work
+    bool running;
+    //! Current work function and its data
+    parallel_func_t func;
+    void *data;
+    //! Current work items and chunk size
+    int items, chunk;
+    //! Next item to be processed
+    int next;
+};
+
+/**
+ * @brief Start the worker threads
+ *
+ * @param threads Number of threads working in parallel (0 for one per CPU)
+ * @return 0 if workers have been created, 1 otherwise
+ */
+int
+parallel_init(int threads);
+
+/**
+ * @brief Stop and join the worker threads
+ */
+void
+parallel_deinit();
+
+/**
+ * @brief Get the number of threads working in parallel
+ *
+ * @return worker threads plus caller thread
+ */
+int
+parallel_threads();
+
+/**
+ * @brief Process count items in chunks using all threads
+ *
+ * Chunks are taken in order by the first free thread. Returns once all
+ * items have been processed.
+ *
+ * @param count Number of items
+ * @param chunk Max number of items of each function call
+ * @param func Function processing a chunk
+ * @param data Data passed to the function
+ */
+void
+parallel_for(int count, int chunk, parallel_func_t func, void *data);
+
+/**
+ * @brief Sort an array of pointers using all threads
+ *
+ * Array parts are sorted by each thread and then merged.
+ *
+ * @param items Array of pointers
+ * @param count Number of pointers
+ * @param cmp qsort like comparison function of two pointers addresses
+ */
+void
+parallel_sort(void **items, int count, int (*cmp)(const void *, const void *));
+
+#endif /* __SNGREP_PARALLEL_H */
@@ -0,0 +1,165 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file pool.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source code of functions defined in pool.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include "pool.h"
+
+//! Key used to flush thread caches when threads exit
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+//! Caches with objects of the current thread
+static __thread pool_cache_t *pool_thread_caches;
+
+/**
+ * @brief Get the next free object stored in a free object
+ */
+static inline void **
+pool_next(void *obj)
+{
+    return (void **) obj;
+}
+
+/**
+ * @brief Move cached objects to the pool depot
+ *
+ * Objects are released if the depot is full.
+ *
+ * @param cache Thread cache
+ * @param count Number of objects to move from cache head
+ */
+static void
+pool_cache_flush(pool_cache_t *cache, uint32_t count)
+{
+    pool_t *pool = cache->pool;
+    void *batch = cache->first, *last = batch, *next;
+    uint32_t i;
+
+    if (!count)
+        return;
+
+    // Detach first objects from the cache
+    for (i = 1; i < count; i++)
+        last = *pool_next(last);
+    cache->first = *pool_next(last);
+    cache->count -= count;
+    *pool_next(last) = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->batches < POOL_DEPOT_MAX) {
+        pool->depot[pool->batches] = batch;
+        pool->depot_count[pool->batches++] = count;
+        batch = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    // Depot is full
+    for (; batch; batch = next) {
+        next = *pool_next(batch);
+        free(batch);
+    }
+}
+
+/**
+ * @brief Return all objects of exiting thread caches to their depots
+ */
+static void
+pool_thread_exit(void *caches)
+{
+    pool_cache_t *cache;
+
+    for (cache = caches; cache; cache = cache->next) {
+        pool_cache_flush(cache, cache->count);
+        cache->registered = false;
+    }
+}
+
+static void
+pool_key_create()
+{
+    pthread_key_create(&pool_key, pool_thread_exit);
+}
+
+/**
+ * @brief Add a cache to the current thread caches list
+ */
+static void
+pool_cache_register(pool_t *pool, pool_cache_t *cache)
+{
+    pthread_once(&pool_key_once, pool_key_create);
+    cache->pool = pool;
+    cache->next = pool_thread_caches;
+    cache->registered = true;
+    pool_thread_caches = cache;
+    pthread_setspecific(pool_key, pool_thread_caches);
+}
+
+void *
+pool_alloc(pool_t *pool, pool_cache_t *cache)
+{
+    void *obj;
+
+    // Get a batch of objects from the depot
+    if (!cache->count) {
+        if (!cache->registered)
+            pool_cache_register(pool, cache);
+
+        pthread_mutex_lock(&pool->lock);
+        if (pool->batches) {
+            cache->first = pool->depot[--pool->batches];
+            cache->count = pool->depot_count[pool->batches];
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (!cache->count)
+            return malloc(pool->size);
+    }
+
+    obj = cache->first;
+    cache->first = *pool_next(obj);
+    cache->count--;
+    return obj;
+}
+
+void
+pool_free(pool_t *pool, pool_cache_t *cache, void *obj)
+{
+    if (!obj)
+        return;
+
+    if (!cache->registered)
+        pool_cache_register(pool, cache);
+
+    // Keep a batch in the cache for next allocations
+    if (cache->count == 2 * POOL_BATCH)
+        pool_cache_flush(cache, POOL_BATCH);
+
+    *pool_next(obj) = cache->first;
+    cache->first = obj;
+    cache->count++;
+}
@@ -0,0 +1,117 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file pool.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to reuse fixed size objects
+ *
+ * Each thread keeps a small cache of free objects of every pool, so most
+ * allocations and releases are a single list operation without locking.
+ * Objects freed by one thread and allocated by another (capture and
+ * parser threads) move between caches in batches through a shared depot.
+ */
+
+#ifndef __SNGREP_POOL_H_
+#define __SNGREP_POOL_H_
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+//! Number of objects moved between thread caches and depot at once
+#define POOL_BATCH 64
+//! Max number of batches kept in the depot of each pool
+#define POOL_DEPOT_MAX 16
+
+//! Shorter declaration of pool structure
+typedef struct pool pool_t;
+//! Shorter declaration of pool_cache structure
+typedef struct pool_cache pool_cache_t;
+
+/**
+ * @brief Pool of fixed size objects shared by all threads
+ */
+struct pool {
+    //! Size of pool objects
+    size_t size;
+    //! Lock of the depot
+    pthread_mutex_t lock;
+    //! Batches of free objects returned by threads
+    void *depot[POOL_DEPOT_MAX];
+    //! Number of objects of each depot batch
+    uint32_t depot_count[POOL_DEPOT_MAX];
+    //! Number of batches in the depot
+    uint32_t batches;
+};
+
+/**
+ * @brief Free objects of a pool cached by a single thread
+ *
+ * Caches must be declared as thread local variables. Remaining cached
+ * objects are returned to the depot when the thread exits.
+ */
+struct pool_cache {
+    //! Pool of the cached objects
+    pool_t *pool;
+    //! First free object (next one is stored in the object)
+    void *first;
+    //! Number of free objects
+    uint32_t count;
+    //! Cache is in the thread list of caches
+    bool registered;
+    //! Next cache of the same thread
+    pool_cache_t *next;
+};
+
+//! Static initializer of a pool of objects of the given size
+#define POOL_INITIALIZER(objsize) \
+    { ((objsize) < sizeof(void *)) ? sizeof(void *) : (objsize), PTHREAD_MUTEX_INITIALIZER }
+
+/**
+ * @brief Get an object from the pool
+ *
+ * Objects are not initialized. If there are no free objects a new one
+ * is allocated.
+ *
+ * @param pool Object pool
+ * @param cache Thread cache of the pool
+ * @return object or NULL on allocation error
+ */
+void *
+pool_alloc(pool_t *pool, pool_cache_t *cache);
+
+/**
+ * @brief Return an object to the pool
+ *
+ * Object does not need to be allocated in the same thread.
+ *
+ * @param pool Object pool
+ * @param cache Thread cache of the pool
+ * @param obj Object allocated with @pool_alloc
+ */
+void
+pool_free(pool_t *pool, pool_cache_t *cache, void *obj);
+
+#endif /* __SNGREP_POOL_H_ */
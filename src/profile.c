@@ -0,0 +1,117 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file profile.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in profile.h
+ */
+#include "config.h"
+#include <pthread.h>
+#include <string.h>
+#include "profile.h"
+#include "util.h"
+
+//! Counters of the running thread
+__thread profile_counters_t *profile_local;
+
+//! Registered threads counters
+static profile_counters_t *profile_threads;
+
+//! Lock for registering threads
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//! Stage names, in the same order than enum profile_stage
+static const char *profile_stage_names[] = {
+    "reasm_ip",
+    "reasm_tcp",
+    "tls",
+    "ws",
+    "sip_parse",
+    "sip_store",
+    "rtp",
+    "dump",
+    "lock_wait",
+};
+
+profile_counters_t *
+profile_register()
+{
+    profile_counters_t *local;
+
+    // Thread counters are never released, threads may finish before they are read
+    if (!(local = sng_malloc(sizeof(profile_counters_t))))
+        return NULL;
+
+    pthread_mutex_lock(&profile_lock);
+    local->next = profile_threads;
+    __atomic_store_n(&profile_threads, local, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&profile_lock);
+
+    return profile_local = local;
+}
+
+void
+profile_snapshot(profile_counters_t *counters)
+{
+    profile_counters_t *local;
+    int i, j;
+
+    memset(counters, 0, sizeof(profile_counters_t));
+
+    for (local = __atomic_load_n(&profile_threads, __ATOMIC_ACQUIRE); local; local = local->next) {
+        for (i = 0; i < PROFILE_STAGE_COUNT; i++) {
+            counters->count[i] += __atomic_load_n(&local->count[i], __ATOMIC_RELAXED);
+            counters->nsecs[i] += __atomic_load_n(&local->nsecs[i], __ATOMIC_RELAXED);
+            for (j = 0; j < PROFILE_BUCKETS; j++)
+                counters->hist[i][j] += __atomic_load_n(&local->hist[i][j], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+uint64_t
+profile_percentile(profile_counters_t *counters, enum profile_stage stage, int pct)
+{
+    uint64_t total, seen = 0;
+    int i;
+
+    // Histogram may be updated while it is read, use its own total
+    for (total = 0, i = 0; i < PROFILE_BUCKETS; i++)
+        total += counters->hist[stage][i];
+
+    if (!total)
+        return 0;
+
+    for (i = 0; i < PROFILE_BUCKETS; i++) {
+        seen += counters->hist[stage][i];
+        if (seen * 100 >= total * pct)
+            break;
+    }
+
+    return (i < PROFILE_BUCKETS) ? (uint64_t) 1 << i : (uint64_t) 1 << (PROFILE_BUCKETS - 1);
+}
+
+const char *
+profile_stage_name(enum profile_stage stage)
+{
+    return profile_stage_names[stage];
+}
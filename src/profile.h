@@ -0,0 +1,178 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file profile.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to measure time spent in packet parsing stages
+ *
+ * When sngrep is configured with --enable-profile, each thread keeps its
+ * own counters of calls, elapsed time and a log2 latency histogram for
+ * every instrumented stage. Counters are only written by their owner
+ * thread so the fast path does not require any lock or atomic operation.
+ *
+ * Without profiling support all macros expand to nothing.
+ */
+#ifndef __SNGREP_PROFILE_H
+#define __SNGREP_PROFILE_H
+
+#include "config.h"
+#include <stdint.h>
+#include <time.h>
+
+//! Number of latency histogram buckets (bucket n holds times below 2^n ns)
+#define PROFILE_BUCKETS 32
+
+/**
+ * @brief Instrumented parsing stages
+ */
+enum profile_stage
+{
+    PROFILE_REASM_IP = 0,
+    PROFILE_REASM_TCP,
+    PROFILE_TLS,
+    PROFILE_WS,
+    PROFILE_SIP_PARSE,
+    PROFILE_SIP_STORE,
+    PROFILE_RTP,
+    PROFILE_DUMP,
+    PROFILE_LOCK_WAIT,
+    PROFILE_STAGE_COUNT
+};
+
+//! Shorter declaration of profile_counters structure
+typedef struct profile_counters profile_counters_t;
+
+/**
+ * @brief Timing counters of all stages
+ *
+ * Each thread has its own copy of this structure. Snapshots of all
+ * threads counters are returned with the same layout.
+ */
+struct profile_counters
+{
+    //! Times each stage has been measured
+    uint64_t count[PROFILE_STAGE_COUNT];
+    //! Total elapsed time of each stage (ns)
+    uint64_t nsecs[PROFILE_STAGE_COUNT];
+    //! Latency histogram of each stage
+    uint64_t hist[PROFILE_STAGE_COUNT][PROFILE_BUCKETS];
+    //! Next registered thread counters
+    profile_counters_t *next;
+};
+
+#ifdef USE_PROFILE
+//! Declare a variable to store a stage start time
+#define PROFILE_DECLARE(var) uint64_t var
+//! Store stage start time
+#define PROFILE_START(var) var = profile_now()
+//! Add elapsed time since PROFILE_START to the given stage
+#define PROFILE_STOP(stage, var) profile_add(stage, profile_now() - var)
+
+//! Counters of the running thread
+extern __thread profile_counters_t *profile_local;
+
+/**
+ * @brief Get monotonic time in nanoseconds
+ */
+static inline uint64_t
+profile_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Create and register counters for the running thread
+ *
+ * @return thread counters
+ */
+profile_counters_t *
+profile_register();
+
+/**
+ * @brief Add a stage measure to running thread counters
+ *
+ * Counters are updated with relaxed stores so readers from other
+ * threads never see torn values, but no atomic read-modify-write
+ * instruction is required.
+ *
+ * @param stage Measured stage
+ * @param nsecs Elapsed time of the stage
+ */
+static inline void
+profile_add(enum profile_stage stage, uint64_t nsecs)
+{
+    profile_counters_t *local = profile_local;
+    int bucket;
+
+    if (!local)
+        local = profile_register();
+
+    bucket = (nsecs) ? 64 - __builtin_clzll(nsecs) : 0;
+    if (bucket >= PROFILE_BUCKETS)
+        bucket = PROFILE_BUCKETS - 1;
+
+    __atomic_store_n(&local->count[stage], local->count[stage] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&local->nsecs[stage], local->nsecs[stage] + nsecs, __ATOMIC_RELAXED);
+    __atomic_store_n(&local->hist[stage][bucket], local->hist[stage][bucket] + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Sum the counters of all registered threads
+ *
+ * @param counters Pointer to store the counters
+ */
+void
+profile_snapshot(profile_counters_t *counters);
+
+/**
+ * @brief Estimate the given percentile of a stage latency
+ *
+ * Result is the upper bound of the histogram bucket where the
+ * percentile is reached.
+ *
+ * @param counters Counters snapshot
+ * @param stage Stage to check
+ * @param pct Percentile (0-100)
+ * @return latency in nanoseconds
+ */
+uint64_t
+profile_percentile(profile_counters_t *counters, enum profile_stage stage, int pct);
+
+/**
+ * @brief Get the name of a stage
+ *
+ * @param stage Stage to check
+ * @return stage name
+ */
+const char *
+profile_stage_name(enum profile_stage stage);
+
+#else
+#define PROFILE_DECLARE(var)
+#define PROFILE_START(var)
+#define PROFILE_STOP(stage, var)
+#endif
+
+#endif /* __SNGREP_PROFILE_H */
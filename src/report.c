@@ -0,0 +1,431 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file report.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in report.h
+ */
+#include "config.h"
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "report.h"
+#include "capture_overload.h"
+#include "sip_call.h"
+#include "setting.h"
+
+//! Append formatted text to a Prometheus buffer
+#define REPORT_APPEND(...) \
+    if (len < REPORT_BUFFER_SIZE) \
+        len += snprintf(buffer + len, REPORT_BUFFER_SIZE - len, __VA_ARGS__)
+
+/**
+ * @brief Get monotonic time in milliseconds
+ */
+static int64_t
+report_time_msecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Calculate the per second rate of a counter between samples
+ */
+static uint64_t
+report_rate(uint64_t value, uint64_t prev, int64_t msecs)
+{
+    if (msecs <= 0 || value < prev)
+        return 0;
+    return (value - prev) * 1000 / msecs;
+}
+
+bool
+report_enabled()
+{
+    return setting_enabled(SETTING_REPORT_JSON) || setting_enabled(SETTING_REPORT_LISTEN);
+}
+
+void
+report_sample(report_sample_t *sample)
+{
+    sample->time = report_time_msecs();
+    sample->timestamp = time(NULL);
+
+    // Avoid reading counters while packets are parsed
+    capture_lock();
+    capture_stats(&sample->capture);
+    sample->sip = sip_calls_counters();
+    sample->dialogs = sip_calls_count();
+    sample->active = vector_count(sip_active_calls_vector());
+    health_sample(&sample->health);
+    capture_unlock();
+
+#ifdef USE_PROFILE
+    profile_snapshot(&sample->profile);
+#endif
+}
+
+void
+report_print_json(FILE *out, report_sample_t *sample, report_sample_t *prev)
+{
+    health_info_t *health = &sample->health;
+    int64_t msecs = sample->time - prev->time;
+    int i, calls = 0;
+
+    for (i = 0; i < SIP_CALLSTATE_COUNT; i++)
+        calls += sample->sip.states[i];
+
+    fprintf(out, "{\"timestamp\":%ld,\"packets\":%" PRIu64 ",\"pps\":%" PRIu64,
+            (long) sample->timestamp, sample->capture.packets,
+            report_rate(sample->capture.packets, prev->capture.packets, msecs));
+    fprintf(out, ",\"drops\":%" PRIu64 ",\"ifdrops\":%" PRIu64 ",\"queue_drops\":%" PRIu64,
+            sample->capture.drops, sample->capture.ifdrops, sample->capture.queue_drops);
+    fprintf(out, ",\"duplicates\":%" PRIu64, sample->capture.duplicates);
+    fprintf(out, ",\"dump_queue\":%" PRIu64 ",\"dump_drops\":%" PRIu64,
+            sample->capture.dump_queue, sample->capture.dump_drops);
+    fprintf(out, ",\"eep_queue\":%" PRIu64 ",\"eep_drops\":%" PRIu64 ",\"eep_relayed\":%" PRIu64,
+            sample->capture.eep_queue, sample->capture.eep_drops, sample->capture.eep_relayed);
+    fprintf(out, ",\"dialogs\":%d,\"calls\":%d,\"active_calls\":%d,\"new_dialogs_ps\":%" PRIu64
+            ",\"expired_dialogs\":%" PRIu64,
+            sample->dialogs, calls, sample->active,
+            report_rate(sample->sip.created, prev->sip.created, msecs), sample->sip.expired);
+    fprintf(out, ",\"sample\":%d,\"sampled_messages\":%" PRIu64,
+            sample->sip.sample, sample->sip.sampled);
+
+    // Degradation level and data discarded by each level action
+    fprintf(out, ",\"overload_level\":%d,\"overload_shed\":{", capture_overload_level());
+    for (i = OVERLOAD_NONE + 1; i < OVERLOAD_ACTION_COUNT; i++) {
+        fprintf(out, "%s\"%s\":%" PRIu64, (i > OVERLOAD_NONE + 1) ? "," : "",
+                capture_overload_action_name(i), capture_overload_shed_count(i));
+    }
+    fprintf(out, "}");
+    fprintf(out, ",\"messages\":%" PRIu64 ",\"mps\":%" PRIu64,
+            sample->sip.msgs, report_rate(sample->sip.msgs, prev->sip.msgs, msecs));
+
+    // Stored requests by method
+    fprintf(out, ",\"methods\":{");
+    for (i = 1; i < SIP_METHOD_COUNT; i++) {
+        fprintf(out, "%s\"%s\":%" PRIu64, (i > 1) ? "," : "",
+                sip_method_str(i), sample->sip.methods[i]);
+    }
+
+    // Stored responses by class
+    fprintf(out, "},\"responses\":{");
+    for (i = 1; i < SIP_RESPONSE_CLASSES; i++) {
+        fprintf(out, "%s\"%dxx\":%" PRIu64, (i > 1) ? "," : "", i, sample->sip.responses[i]);
+    }
+
+    // Stored calls by state
+    fprintf(out, "},\"states\":{");
+    for (i = 1; i < SIP_CALLSTATE_COUNT; i++) {
+        fprintf(out, "%s\"%s\":%d", (i > 1) ? "," : "", call_state_to_str(i), sample->sip.states[i]);
+    }
+
+    fprintf(out, "},\"rtp_streams\":%" PRIu64 ",\"rtp_packets\":%" PRIu64 ",\"bytes\":%" PRIu64,
+            sample->sip.streams, sample->sip.rtp_packets, sample->sip.bytes);
+
+    // Internal containers usage
+    fprintf(out, ",\"health\":{\"callids_size\":%zu,\"callids_count\":%zu,\"callids_probe\":%zu",
+            health->callids_size, health->callids_count, health->callids_probe);
+    fprintf(out, ",\"limit\":%d,\"rtp_memory\":%zu,\"rotated\":%" PRIu64 ",\"rotated_time\":%ld",
+            health->limit, health->rtp_memory, health->rotated, (long) health->rotated_time);
+    fprintf(out, ",\"tls_connections\":%u,\"tls_pending\":%u,\"queue_size\":%u,\"queues\":[",
+            health->tls_connections, health->tls_pending, health->queue_size);
+    for (i = 0; i < health->nworkers; i++)
+        fprintf(out, "%s%u", (i) ? "," : "", health->queue[i]);
+    fprintf(out, "],\"sources\":[");
+    for (i = 0; i < health->nsources; i++) {
+        fprintf(out, "%s{\"name\":\"%s\",\"ip_frags\":%zu,\"ip_frags_memory\":%zu,\"tcp_flows\":%zu}",
+                (i) ? "," : "", health->sources[i].name, health->sources[i].ip_frags,
+                health->sources[i].ip_frags_memory, health->sources[i].tcp_flows);
+    }
+    fprintf(out, "]}");
+
+#ifdef USE_PROFILE
+    // Parsing stages timing
+    fprintf(out, ",\"profile\":{");
+    for (i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        fprintf(out, "%s\"%s\":{\"count\":%" PRIu64 ",\"nsecs\":%" PRIu64 ",\"p50\":%" PRIu64 ",\"p99\":%" PRIu64 "}",
+                (i) ? "," : "", profile_stage_name(i), sample->profile.count[i], sample->profile.nsecs[i],
+                profile_percentile(&sample->profile, i, 50), profile_percentile(&sample->profile, i, 99));
+    }
+    fprintf(out, "}");
+#endif
+
+    fprintf(out, "}\n");
+    fflush(out);
+}
+
+int
+report_format_prometheus(report_sample_t *sample, char *buffer)
+{
+    health_info_t *health = &sample->health;
+    int i, len = 0;
+
+    REPORT_APPEND("# TYPE sngrep_packets_total counter\n");
+    REPORT_APPEND("sngrep_packets_total %" PRIu64 "\n", sample->capture.packets);
+    REPORT_APPEND("# TYPE sngrep_drops_total counter\n");
+    REPORT_APPEND("sngrep_drops_total{reason=\"buffer\"} %" PRIu64 "\n", sample->capture.drops);
+    REPORT_APPEND("sngrep_drops_total{reason=\"interface\"} %" PRIu64 "\n", sample->capture.ifdrops);
+    REPORT_APPEND("sngrep_drops_total{reason=\"queue\"} %" PRIu64 "\n", sample->capture.queue_drops);
+    REPORT_APPEND("# TYPE sngrep_duplicates_total counter\n");
+    REPORT_APPEND("sngrep_duplicates_total %" PRIu64 "\n", sample->capture.duplicates);
+    REPORT_APPEND("# TYPE sngrep_dump_queue_blocks gauge\n");
+    REPORT_APPEND("sngrep_dump_queue_blocks %" PRIu64 "\n", sample->capture.dump_queue);
+    REPORT_APPEND("# TYPE sngrep_dump_drops_total counter\n");
+    REPORT_APPEND("sngrep_dump_drops_total %" PRIu64 "\n", sample->capture.dump_drops);
+    REPORT_APPEND("# TYPE sngrep_eep_queue_packets gauge\n");
+    REPORT_APPEND("sngrep_eep_queue_packets %" PRIu64 "\n", sample->capture.eep_queue);
+    REPORT_APPEND("# TYPE sngrep_eep_drops_total counter\n");
+    REPORT_APPEND("sngrep_eep_drops_total %" PRIu64 "\n", sample->capture.eep_drops);
+    REPORT_APPEND("# TYPE sngrep_eep_relayed_total counter\n");
+    REPORT_APPEND("sngrep_eep_relayed_total %" PRIu64 "\n", sample->capture.eep_relayed);
+    REPORT_APPEND("# TYPE sngrep_dialogs_created_total counter\n");
+    REPORT_APPEND("sngrep_dialogs_created_total %" PRIu64 "\n", sample->sip.created);
+    REPORT_APPEND("# TYPE sngrep_dialogs_expired_total counter\n");
+    REPORT_APPEND("sngrep_dialogs_expired_total %" PRIu64 "\n", sample->sip.expired);
+    REPORT_APPEND("# TYPE sngrep_sample_rate gauge\n");
+    REPORT_APPEND("sngrep_sample_rate %d\n", sample->sip.sample);
+    REPORT_APPEND("# TYPE sngrep_sampled_messages_total counter\n");
+    REPORT_APPEND("sngrep_sampled_messages_total %" PRIu64 "\n", sample->sip.sampled);
+    REPORT_APPEND("# TYPE sngrep_overload_level gauge\n");
+    REPORT_APPEND("sngrep_overload_level %d\n", capture_overload_level());
+    REPORT_APPEND("# TYPE sngrep_overload_shed_total counter\n");
+    for (i = OVERLOAD_NONE + 1; i < OVERLOAD_ACTION_COUNT; i++) {
+        REPORT_APPEND("sngrep_overload_shed_total{action=\"%s\"} %" PRIu64 "\n",
+                      capture_overload_action_name(i), capture_overload_shed_count(i));
+    }
+    REPORT_APPEND("# TYPE sngrep_dialogs gauge\n");
+    REPORT_APPEND("sngrep_dialogs %d\n", sample->dialogs);
+    REPORT_APPEND("# TYPE sngrep_active_calls gauge\n");
+    REPORT_APPEND("sngrep_active_calls %d\n", sample->active);
+
+    REPORT_APPEND("# TYPE sngrep_calls gauge\n");
+    for (i = 1; i < SIP_CALLSTATE_COUNT; i++) {
+        REPORT_APPEND("sngrep_calls{state=\"%s\"} %d\n", call_state_to_str(i), sample->sip.states[i]);
+    }
+
+    REPORT_APPEND("# TYPE sngrep_messages gauge\n");
+    for (i = 1; i < SIP_METHOD_COUNT; i++) {
+        REPORT_APPEND("sngrep_messages{method=\"%s\"} %" PRIu64 "\n",
+                      sip_method_str(i), sample->sip.methods[i]);
+    }
+    for (i = 1; i < SIP_RESPONSE_CLASSES; i++) {
+        REPORT_APPEND("sngrep_messages{response=\"%dxx\"} %" PRIu64 "\n", i, sample->sip.responses[i]);
+    }
+
+    REPORT_APPEND("# TYPE sngrep_rtp_streams gauge\n");
+    REPORT_APPEND("sngrep_rtp_streams %" PRIu64 "\n", sample->sip.streams);
+    REPORT_APPEND("# TYPE sngrep_rtp_packets gauge\n");
+    REPORT_APPEND("sngrep_rtp_packets %" PRIu64 "\n", sample->sip.rtp_packets);
+    REPORT_APPEND("# TYPE sngrep_bytes gauge\n");
+    REPORT_APPEND("sngrep_bytes %" PRIu64 "\n", sample->sip.bytes);
+
+    REPORT_APPEND("# TYPE sngrep_callids_buckets gauge\n");
+    REPORT_APPEND("sngrep_callids_buckets %zu\n", health->callids_size);
+    REPORT_APPEND("# TYPE sngrep_callids_entries gauge\n");
+    REPORT_APPEND("sngrep_callids_entries %zu\n", health->callids_count);
+    REPORT_APPEND("# TYPE sngrep_callids_longest_probe gauge\n");
+    REPORT_APPEND("sngrep_callids_longest_probe %zu\n", health->callids_probe);
+    REPORT_APPEND("# TYPE sngrep_dialogs_limit gauge\n");
+    REPORT_APPEND("sngrep_dialogs_limit %d\n", health->limit);
+    REPORT_APPEND("# TYPE sngrep_rtp_memory_bytes gauge\n");
+    REPORT_APPEND("sngrep_rtp_memory_bytes %zu\n", health->rtp_memory);
+    REPORT_APPEND("# TYPE sngrep_dialogs_rotated_total counter\n");
+    REPORT_APPEND("sngrep_dialogs_rotated_total %" PRIu64 "\n", health->rotated);
+    REPORT_APPEND("# TYPE sngrep_last_rotation_timestamp_seconds gauge\n");
+    REPORT_APPEND("sngrep_last_rotation_timestamp_seconds %ld\n", (long) health->rotated_time);
+    REPORT_APPEND("# TYPE sngrep_tls_connections gauge\n");
+    REPORT_APPEND("sngrep_tls_connections %u\n", health->tls_connections);
+    REPORT_APPEND("# TYPE sngrep_tls_queue_packets gauge\n");
+    REPORT_APPEND("sngrep_tls_queue_packets %u\n", health->tls_pending);
+    REPORT_APPEND("# TYPE sngrep_parser_queue_packets gauge\n");
+    for (i = 0; i < health->nworkers; i++) {
+        REPORT_APPEND("sngrep_parser_queue_packets{worker=\"%d\"} %u\n", i, health->queue[i]);
+    }
+    REPORT_APPEND("# TYPE sngrep_ip_frags_pending gauge\n");
+    for (i = 0; i < health->nsources; i++) {
+        REPORT_APPEND("sngrep_ip_frags_pending{source=\"%s\"} %zu\n",
+                      health->sources[i].name, health->sources[i].ip_frags);
+    }
+    REPORT_APPEND("# TYPE sngrep_tcp_flows_pending gauge\n");
+    for (i = 0; i < health->nsources; i++) {
+        REPORT_APPEND("sngrep_tcp_flows_pending{source=\"%s\"} %zu\n",
+                      health->sources[i].name, health->sources[i].tcp_flows);
+    }
+
+#ifdef USE_PROFILE
+    REPORT_APPEND("# TYPE sngrep_stage_duration_seconds summary\n");
+    for (i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        REPORT_APPEND("sngrep_stage_duration_seconds{stage=\"%s\",quantile=\"0.5\"} %.9f\n",
+                      profile_stage_name(i), profile_percentile(&sample->profile, i, 50) / 1e9);
+        REPORT_APPEND("sngrep_stage_duration_seconds{stage=\"%s\",quantile=\"0.99\"} %.9f\n",
+                      profile_stage_name(i), profile_percentile(&sample->profile, i, 99) / 1e9);
+        REPORT_APPEND("sngrep_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n",
+                      profile_stage_name(i), sample->profile.nsecs[i] / 1e9);
+        REPORT_APPEND("sngrep_stage_duration_seconds_count{stage=\"%s\"} %" PRIu64 "\n",
+                      profile_stage_name(i), sample->profile.count[i]);
+    }
+#endif
+
+    return (len < REPORT_BUFFER_SIZE) ? len : REPORT_BUFFER_SIZE - 1;
+}
+
+/**
+ * @brief Open the configured Prometheus listening socket
+ *
+ * @return socket descriptor or -1 on error
+ */
+static int
+report_listen()
+{
+    struct addrinfo hints, *res;
+    const char *addr = setting_get_value(SETTING_REPORT_LISTEN_ADDR);
+    const char *port = setting_get_value(SETTING_REPORT_LISTEN_PORT);
+    int fd, reuse = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if (getaddrinfo(addr, port, &hints, &res) != 0) {
+        fprintf(stderr, "Unable to resolve report address %s:%s\n", addr, port);
+        return -1;
+    }
+
+    if ((fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
+        fprintf(stderr, "Unable to create report socket: %s\n", strerror(errno));
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, 8) < 0) {
+        fprintf(stderr, "Unable to listen on report address %s:%s: %s\n", addr, port, strerror(errno));
+        freeaddrinfo(res);
+        close(fd);
+        return -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+/**
+ * @brief Answer a pending Prometheus request
+ *
+ * Any request is answered with current counters.
+ *
+ * @param lfd Listening socket descriptor
+ */
+static void
+report_serve(int lfd)
+{
+    report_sample_t sample;
+    char request[1024];
+    char buffer[REPORT_BUFFER_SIZE];
+    char header[128];
+    int fd, len;
+
+    if ((fd = accept(lfd, NULL, NULL)) < 0)
+        return;
+
+    // Requests are not parsed, just consume the received data
+    if (recv(fd, request, sizeof(request), MSG_DONTWAIT) < 0 && errno != EAGAIN) {
+        close(fd);
+        return;
+    }
+
+    report_sample(&sample);
+    len = report_format_prometheus(&sample, buffer);
+    sprintf(header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %d\r\n\r\n", len);
+
+    if (send(fd, header, strlen(header), MSG_NOSIGNAL) > 0)
+        send(fd, buffer, len, MSG_NOSIGNAL);
+    close(fd);
+}
+
+int
+report_loop()
+{
+    report_sample_t prev, sample;
+    struct pollfd pfd;
+    int64_t now, next;
+    int interval, json, wait;
+
+    interval = setting_get_intvalue(SETTING_REPORT_INTERVAL);
+    if (interval <= 0)
+        interval = 1;
+    json = setting_enabled(SETTING_REPORT_JSON);
+
+    // Open Prometheus endpoint
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = -1;
+    pfd.events = POLLIN;
+    if (setting_enabled(SETTING_REPORT_LISTEN) && (pfd.fd = report_listen()) < 0)
+        return 1;
+
+    report_sample(&prev);
+    next = prev.time + interval * 1000;
+
+    while (capture_is_running()) {
+        // Write internal containers report if requested
+        health_check_signal();
+
+        // Wait for requests until next report, checking if capture has finished
+        now = report_time_msecs();
+        if (now < next) {
+            wait = (next - now < REPORT_POLL_MSECS) ? next - now : REPORT_POLL_MSECS;
+            if (poll(&pfd, (pfd.fd >= 0) ? 1 : 0, wait) > 0 && (pfd.revents & POLLIN))
+                report_serve(pfd.fd);
+            continue;
+        }
+
+        // Print counters of this interval
+        report_sample(&sample);
+        if (json)
+            report_print_json(stdout, &sample, &prev);
+        prev = sample;
+        next += interval * 1000;
+    }
+
+    // Print final counters
+    if (json) {
+        report_sample(&sample);
+        report_print_json(stdout, &sample, &prev);
+    }
+
+    if (pfd.fd >= 0)
+        close(pfd.fd);
+
+    return 0;
+}
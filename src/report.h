@@ -0,0 +1,125 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file report.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to report capture counters without interface
+ *
+ * In no interface mode, counters of capture sources and stored dialogs
+ * can be printed periodically as JSON lines or served in Prometheus text
+ * format through a local HTTP socket.
+ */
+#ifndef __SNGREP_REPORT_H
+#define __SNGREP_REPORT_H
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include "capture.h"
+#include "sip.h"
+#include "profile.h"
+#include "health.h"
+
+//! Max size of a Prometheus text response
+#define REPORT_BUFFER_SIZE 16384
+//! Max time between capture status checks (ms)
+#define REPORT_POLL_MSECS 100
+
+//! Shorter declaration of report_sample structure
+typedef struct report_sample report_sample_t;
+
+/**
+ * @brief Counters read at a given moment
+ */
+struct report_sample
+{
+    //! Monotonic time of the sample (ms)
+    int64_t time;
+    //! Wall clock time of the sample
+    time_t timestamp;
+    //! Capture sources counters
+    capture_stats_t capture;
+    //! Stored dialogs counters
+    sip_counters_t sip;
+    //! Stored dialogs
+    int dialogs;
+    //! Stored active calls
+    int active;
+    //! Internal containers usage
+    health_info_t health;
+#ifdef USE_PROFILE
+    //! Parsing stages timing counters
+    profile_counters_t profile;
+#endif
+};
+
+/**
+ * @brief Check if any report has been configured
+ *
+ * @return true if JSON lines or Prometheus reports are enabled
+ */
+bool
+report_enabled();
+
+/**
+ * @brief Read current counters
+ *
+ * @param sample Pointer to store the counters
+ */
+void
+report_sample(report_sample_t *sample);
+
+/**
+ * @brief Print counters as a JSON line
+ *
+ * Rates are calculated from the previous sample.
+ *
+ * @param out Output file
+ * @param sample Current counters
+ * @param prev Previous counters
+ */
+void
+report_print_json(FILE *out, report_sample_t *sample, report_sample_t *prev);
+
+/**
+ * @brief Format counters in Prometheus text format
+ *
+ * @param sample Current counters
+ * @param buffer Output buffer of REPORT_BUFFER_SIZE bytes
+ * @return length of the formatted text
+ */
+int
+report_format_prometheus(report_sample_t *sample, char *buffer);
+
+/**
+ * @brief Report counters until capture is stopped
+ *
+ * This is a blocking call. JSON lines are printed to stdout every
+ * configured interval and Prometheus requests are served meanwhile.
+ *
+ * @return 0 when capture has finished, 1 if reports could not start
+ */
+int
+report_loop();
+
+#endif /* __SNGREP_REPORT_H */
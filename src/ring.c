@@ -0,0 +1,149 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file ring.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source code of functions defined in ring.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+ring_t *
+ring_create(size_t size)
+{
+    ring_t *ring;
+    size_t i, slots = 2;
+
+    // Round up to the next power of 2
+    while (slots < size)
+        slots <<= 1;
+
+    // Allocate memory for this ring data
+    if (!(ring = malloc(sizeof(ring_t))))
+        return NULL;
+    memset(ring, 0, sizeof(ring_t));
+
+    // Allocate memory for ring slots
+    if (!(ring->slots = malloc(sizeof(ring_slot_t) * slots))) {
+        free(ring);
+        return NULL;
+    }
+
+    // Each slot is ready to be written in its position
+    for (i = 0; i < slots; i++) {
+        ring->slots[i].seq = i;
+        ring->slots[i].item = NULL;
+    }
+    ring->mask = slots - 1;
+
+    return ring;
+}
+
+void
+ring_destroy(ring_t *ring)
+{
+    if (!ring)
+        return;
+    free(ring->slots);
+    free(ring);
+}
+
+int
+ring_push(ring_t *ring, void *item)
+{
+    ring_slot_t *slot;
+    size_t pos, seq;
+
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &ring->slots[pos & ring->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos) {
+            // Slot is free, try to claim it
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((intptr_t) (seq - pos) < 0) {
+            // Slot has not been read yet: ring is full
+            return 1;
+        } else {
+            // Other producer claimed this slot
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Store the item and mark the slot as readable
+    slot->item = item;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void *
+ring_pop(ring_t *ring)
+{
+    ring_slot_t *slot;
+    size_t pos, seq;
+    void *item;
+
+    pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &ring->slots[pos & ring->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos + 1) {
+            // Slot has an item, try to claim it
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((intptr_t) (seq - (pos + 1)) < 0) {
+            // Slot has not been written yet: ring is empty
+            return NULL;
+        } else {
+            // Other consumer claimed this slot
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    // Get the item and mark the slot as writable for the next lap
+    item = slot->item;
+    __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+size_t
+ring_count(ring_t *ring)
+{
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return (head > tail) ? head - tail : 0;
+}
+
+size_t
+ring_size(ring_t *ring)
+{
+    return ring->mask + 1;
+}
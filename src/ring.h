@@ -0,0 +1,116 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file ring.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to manage bounded lock-free queues of pointers
+ *
+ * Ring buffers can be written and read by multiple threads without
+ * locking. Each slot stores a sequence number that tells producers and
+ * consumers if it is ready to be written or read.
+ */
+
+#ifndef __SNGREP_RING_H_
+#define __SNGREP_RING_H_
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+
+//! Shorter declaration of ring structure
+typedef struct ring ring_t;
+//! Shorter declaration of ring slot structure
+typedef struct ring_slot ring_slot_t;
+
+/**
+ * @brief Ring buffer slot
+ */
+struct ring_slot {
+    //! Sequence number of this slot
+    size_t seq;
+    //! Stored item
+    void *item;
+};
+
+/**
+ * @brief Bounded queue of pointers
+ */
+struct ring {
+    //! Number of slots - 1 (size is always power of 2)
+    size_t mask;
+    //! Ring slots
+    ring_slot_t *slots;
+    //! Next position to write (avoid sharing cache line with readers)
+    size_t head __attribute__((aligned(64)));
+    //! Next position to read
+    size_t tail __attribute__((aligned(64)));
+};
+
+/**
+ * @brief Create a new ring buffer
+ *
+ * @param size Minimum number of slots (rounded up to power of 2)
+ * @return ring structure pointer or NULL on error
+ */
+ring_t *
+ring_create(size_t size);
+
+/**
+ * @brief Deallocate ring memory
+ *
+ * Items still stored in the ring are not deallocated
+ */
+void
+ring_destroy(ring_t *ring);
+
+/**
+ * @brief Add an item at the end of the ring
+ *
+ * @return 0 if item has been added, 1 if ring is full
+ */
+int
+ring_push(ring_t *ring, void *item);
+
+/**
+ * @brief Get and remove the first item of the ring
+ *
+ * @return first item or NULL if ring is empty
+ */
+void *
+ring_pop(ring_t *ring);
+
+/**
+ * @brief Get the number of items stored in the ring
+ *
+ * @note Result is only approximate while other threads use the ring
+ */
+size_t
+ring_count(ring_t *ring);
+
+/**
+ * @brief Get the max number of items the ring can store
+ */
+size_t
+ring_size(ring_t *ring);
+
+#endif /* __SNGREP_RING_H_ */
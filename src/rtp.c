@@ -31,9 +31,14 @@
 
 #include "config.h"
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <arpa/inet.h>
 #include "rtp.h"
 #include "sip.h"
+#include "setting.h"
 #include "vector.h"
 
 /**
@@ -67,13 +72,50 @@ rtp_encoding_t encodings[] = {
     { 0, NULL, NULL }
 };
 
+//! RTP flows indexed by destination address
+htable_t *rtp_flows = NULL;
+//! Number of RTP flows of each destination port
+static uint32_t rtp_flow_ports[RTP_PORTS];
+//! Number of times a flow has been added or removed
+static uint32_t rtp_flows_changes = 0;
+//! RTP packets storage policy
+static enum rtp_storage rtp_storage = RTP_STORAGE_FULL;
+//! Seconds of packets stored by each stream with ring storage
+static int rtp_ring_secs = 0;
+
+void
+rtp_init()
+{
+    // Create hash table for destination address search
+    rtp_flows = htable_create_fixed(RTP_FLOWS_SIZE, sizeof(address_key_t));
+
+    // Get RTP packets storage policy
+    if (setting_has_value(SETTING_CAPTURE_RTP_STORAGE, "ring")) {
+        rtp_storage = RTP_STORAGE_RING;
+    } else if (setting_has_value(SETTING_CAPTURE_RTP_STORAGE, "headers")) {
+        rtp_storage = RTP_STORAGE_HEADERS;
+    } else {
+        rtp_storage = RTP_STORAGE_FULL;
+    }
+    rtp_ring_secs = setting_get_intvalue(SETTING_CAPTURE_RTP_RING);
+}
+
+void
+rtp_deinit()
+{
+    // All streams must have been removed at this point
+    if (rtp_flows)
+        htable_destroy(rtp_flows);
+    rtp_flows = NULL;
+}
+
 rtp_stream_t *
 stream_create(sdp_media_t *media, address_t dst, int type)
 {
     rtp_stream_t *stream;
 
     // Allocate memory for this stream structure
-    if (!(stream = sng_malloc(sizeof(rtp_stream_t))))
+    if (!(stream = arena_alloc(media->msg->call->arena, sizeof(rtp_stream_t))))
         return NULL;
 
     // Initialize all fields
@@ -84,6 +126,22 @@ stream_create(sdp_media_t *media, address_t dst, int type)
     return stream;
 }
 
+void
+stream_destroy(rtp_stream_t *stream)
+{
+    // Remove stream from flows index
+    // Stream memory is released with its call arena
+    rtp_flow_remove(stream);
+    // Remove stored packets
+    stream_free_packets(stream);
+}
+
+void
+stream_destroyer(void *stream)
+{
+    stream_destroy((rtp_stream_t *) stream);
+}
+
 rtp_stream_t *
 stream_complete(rtp_stream_t *stream, address_t src)
 {
@@ -97,6 +155,115 @@ stream_set_format(rtp_stream_t *stream, uint32_t format)
     stream->rtpinfo.fmtcode = format;
 }
 
+/**
+ * @brief Get the RTP clock rate of the stream format
+ *
+ * Rate is taken from the encoding name (PCMU/8000) of standard formats
+ * or the SDP rtpmap attribute of dynamic ones.
+ */
+static uint32_t
+stream_clock_rate(rtp_stream_t *stream)
+{
+    const char *name = NULL, *rate;
+    int i;
+
+    for (i = 0; encodings[i].name; i++) {
+        if (encodings[i].id == stream->rtpinfo.fmtcode) {
+            name = encodings[i].name;
+            break;
+        }
+    }
+
+    if (!name && stream->media)
+        name = media_get_format(stream->media, stream->rtpinfo.fmtcode);
+
+    if (name && (rate = strchr(name, '/')) && atoi(rate + 1) > 0)
+        return atoi(rate + 1);
+
+    return RTP_CLOCK_RATE;
+}
+
+/**
+ * @brief Update stream quality statistics with a received RTP packet
+ */
+static void
+stream_update_stats(rtp_stream_t *stream, packet_t *packet)
+{
+    rtp_stats_t *stats = &stream->stats;
+    u_char *payload = packet_payload(packet);
+    struct timeval tv = packet_time(packet);
+    uint16_t seq, udelta;
+    uint32_t ts, arrival, lost, jitter;
+    int32_t transit, d;
+    sip_call_t *call;
+
+    if (packet_payloadlen(packet) < RTP_HDR_LENGTH)
+        return;
+
+    seq = (payload[2] << 8) | payload[3];
+    ts = ((uint32_t) payload[4] << 24) | (payload[5] << 16) | (payload[6] << 8) | payload[7];
+
+    if (!stats->clock)
+        stats->clock = stream_clock_rate(stream);
+
+    // Arrival time in timestamp units (only differences are meaningful)
+    arrival = (uint32_t) ((uint64_t) tv.tv_sec * stats->clock + (uint64_t) tv.tv_usec * stats->clock / 1000000);
+    transit = (int32_t) (arrival - ts);
+
+    // First stream packet
+    if (!stats->received) {
+        stats->base_seq = stats->max_seq = seq;
+        stats->received = 1;
+        stats->transit = transit;
+        return;
+    }
+
+    udelta = seq - stats->max_seq;
+    if (udelta == 0) {
+        // Duplicated packet, don't count it for loss or jitter
+        stats->dups++;
+        return;
+    } else if (udelta < RTP_MAX_DROPOUT) {
+        // In order, with permissible gap
+        if (seq < stats->max_seq)
+            stats->cycles++;
+        if (udelta - 1U > stats->max_gap)
+            stats->max_gap = udelta - 1;
+        stats->max_seq = seq;
+        stats->received++;
+    } else if (udelta <= RTP_SEQ_MOD - RTP_MAX_MISORDER) {
+        // Sequence restarted (source changed or restarted)
+        stats->base_seq = stats->max_seq = seq;
+        stats->cycles = 0;
+        stats->received = 1;
+        stats->transit = transit;
+        return;
+    } else {
+        // Late packet, received after a higher sequence number
+        stats->late++;
+        stats->received++;
+    }
+
+    // Interarrival jitter J(i) = J(i-1) + (|D(i-1,i)| - J(i-1)) / 16
+    d = transit - stats->transit;
+    stats->transit = transit;
+    if (d < 0)
+        d = -d;
+    stats->jitter += d - ((stats->jitter + 8) >> 4);
+    if (stats->jitter > stats->max_jitter)
+        stats->max_jitter = stats->jitter;
+
+    // Refresh call displayed attributes only when they change
+    lost = stream_get_lost(stream);
+    jitter = (uint32_t) stream_get_jitter(stream);
+    if (lost != stats->notified_lost || jitter != stats->notified_jitter) {
+        stats->notified_lost = lost;
+        stats->notified_jitter = jitter;
+        if (stream->media && stream->media->msg && (call = stream->media->msg->call))
+            call->changes++;
+    }
+}
+
 void
 stream_add_packet(rtp_stream_t *stream, packet_t *packet)
 {
@@ -105,6 +272,13 @@ stream_add_packet(rtp_stream_t *stream, packet_t *packet)
 
     stream->lasttm = (int) time(NULL);
     stream->pktcnt++;
+    stream->bytes += packet_payloadlen(packet);
+
+    if (stream->type == PACKET_RTP)
+        stream_update_stats(stream, packet);
+
+    // Update stored streams counters (only stored streams receive packets)
+    sip_calls_count_rtp(0, 1, packet_payloadlen(packet));
 }
 
 uint32_t
@@ -113,6 +287,276 @@ stream_get_count(rtp_stream_t *stream)
     return stream->pktcnt;
 }
 
+uint32_t
+stream_get_expected(rtp_stream_t *stream)
+{
+    rtp_stats_t *stats = &stream->stats;
+
+    if (!stats->received)
+        return 0;
+
+    return stats->cycles * RTP_SEQ_MOD + stats->max_seq - stats->base_seq + 1;
+}
+
+uint32_t
+stream_get_lost(rtp_stream_t *stream)
+{
+    uint32_t expected = stream_get_expected(stream);
+    return (expected > stream->stats.received) ? expected - stream->stats.received : 0;
+}
+
+double
+stream_get_loss(rtp_stream_t *stream)
+{
+    uint32_t expected = stream_get_expected(stream);
+    return expected ? (double) stream_get_lost(stream) * 100 / expected : 0;
+}
+
+double
+stream_get_jitter(rtp_stream_t *stream)
+{
+    if (!stream->stats.clock)
+        return 0;
+    return (double) stream->stats.jitter * 1000 / 16 / stream->stats.clock;
+}
+
+double
+stream_get_max_jitter(rtp_stream_t *stream)
+{
+    if (!stream->stats.clock)
+        return 0;
+    return (double) stream->stats.max_jitter * 1000 / 16 / stream->stats.clock;
+}
+
+double
+stream_get_mos(rtp_stream_t *stream)
+{
+    double delay, r, mos;
+
+    // Effective delay: jitter buffer of twice the jitter plus codec delay
+    delay = stream_get_jitter(stream) * 2 + 10;
+
+    // Transmission rating factor
+    r = 93.2 - ((delay < 160) ? delay / 40 : (delay - 120) / 10);
+    r -= stream_get_loss(stream) * 2.5;
+    if (r < 0)
+        r = 0;
+
+    mos = 1 + 0.035 * r + 0.000007 * r * (r - 60) * (100 - r);
+    if (mos < 1)
+        mos = 1;
+    if (mos > 4.5)
+        mos = 4.5;
+    return mos;
+}
+
+enum rtp_storage
+rtp_get_storage()
+{
+    return rtp_storage;
+}
+
+/**
+ * @brief Get a stored record of the stream
+ *
+ * @param index Position of the record, starting with the oldest one
+ */
+static rtp_record_t *
+stream_record(rtp_stream_t *stream, uint32_t index)
+{
+    return &stream->records[(stream->records_first + index) % stream->records_size];
+}
+
+/**
+ * @brief Double the size of stream records array
+ *
+ * @return 0 on success, 1 on allocation error
+ */
+static int
+stream_records_grow(rtp_stream_t *stream)
+{
+    rtp_record_t *records;
+    uint32_t size, i;
+
+    size = (stream->records_size) ? stream->records_size * 2 : RTP_RECORDS_SIZE;
+    if (!(records = malloc(sizeof(rtp_record_t) * size)))
+        return 1;
+
+    // Move stored records to the start of the new array
+    for (i = 0; i < stream->records_count; i++)
+        records[i] = *stream_record(stream, i);
+
+    call_add_memory(stream_get_call(stream), CALL_MEMORY_RTP, (int64_t) (size - stream->records_size) * sizeof(rtp_record_t));
+    free(stream->records);
+    stream->records = records;
+    stream->records_size = size;
+    stream->records_first = 0;
+    return 0;
+}
+
+/**
+ * @brief Set IP and UDP lengths of a rebuilt frame
+ *
+ * @param data Frame data
+ * @param offset Position of RTP data, after UDP header
+ * @param len Original RTP data length
+ */
+static void
+stream_frame_lengths(rtp_stream_t *stream, u_char *data, uint16_t offset, uint16_t len)
+{
+    uint16_t value;
+
+    if (offset < 8)
+        return;
+
+    // UDP datagram length
+    value = htons(len + 8);
+    memcpy(data + offset - 4, &value, sizeof(value));
+
+    // IPv4 header without options or IPv6 header without extensions
+    if (stream->dst.family == AF_INET && offset >= 28 && data[offset - 28] == 0x45) {
+        value = htons(len + 28);
+        memcpy(data + offset - 26, &value, sizeof(value));
+    } else if (stream->dst.family == AF_INET6 && offset >= 48 && (data[offset - 48] >> 4) == 6) {
+        value = htons(len + 8);
+        memcpy(data + offset - 44, &value, sizeof(value));
+    }
+}
+
+bool
+stream_store_packet(rtp_stream_t *stream, packet_t *packet)
+{
+    struct sip_call *call = stream_get_call(stream);
+    struct timeval ts = packet_time(packet);
+    rtp_record_t *record;
+    frame_t *frame;
+    uint32_t len;
+
+    if (rtp_storage == RTP_STORAGE_HEADERS) {
+        // Keep frame headers of first packet with RTP data in its frame
+        frame = vector_first(packet->frames);
+        if (!stream->frame && vector_count(packet->frames) == 1 && frame->data && packet->payload_ref
+            && packet->payload - frame->data <= UINT16_MAX) {
+            len = packet->payload - frame->data;
+            if ((stream->frame = malloc(len))) {
+                memcpy(stream->frame, frame->data, len);
+                stream->frame_len = len;
+                call_add_memory(call, CALL_MEMORY_RTP, len);
+            }
+        }
+    } else {
+        // Remove packets older than ring seconds, unless call is being saved
+        while (stream->records_count && !call->saving) {
+            record = stream_record(stream, 0);
+            if (ts.tv_sec - (time_t) record->sec < rtp_ring_secs)
+                break;
+            call_add_memory(call, CALL_MEMORY_RTP, -(int64_t) packet_memory(record->packet));
+            packet_destroy(record->packet);
+            stream->records_first = (stream->records_first + 1) % stream->records_size;
+            stream->records_count--;
+        }
+    }
+
+    // Make room for a new record
+    if (stream->records_count == stream->records_size && stream_records_grow(stream) != 0)
+        return false;
+
+    record = stream_record(stream, stream->records_count++);
+    record->sec = ts.tv_sec;
+    record->usec = ts.tv_usec;
+
+    if (rtp_storage == RTP_STORAGE_HEADERS) {
+        // Copy only RTP header, packet is not required anymore
+        len = packet_payloadlen(packet);
+        record->header.origlen = (len > UINT16_MAX) ? UINT16_MAX : len;
+        record->header.len = (len > RTP_HDR_LENGTH) ? RTP_HDR_LENGTH : len;
+        memcpy(record->header.data, packet_payload(packet), record->header.len);
+        return false;
+    }
+
+    record->packet = packet;
+    call_add_memory(call, CALL_MEMORY_RTP, packet_memory(packet));
+    return true;
+}
+
+uint32_t
+stream_stored_count(rtp_stream_t *stream)
+{
+    // Headers can not be rebuilt into frames without the first packet headers
+    if (rtp_storage == RTP_STORAGE_HEADERS && !stream->frame)
+        return 0;
+    return stream->records_count;
+}
+
+packet_t *
+stream_stored_packet(rtp_stream_t *stream, uint32_t index)
+{
+    struct pcap_pkthdr header;
+    rtp_record_t *record;
+    packet_t *packet;
+    frame_t *frame;
+
+    if (index >= stream_stored_count(stream))
+        return NULL;
+
+    record = stream_record(stream, index);
+    if (rtp_storage != RTP_STORAGE_HEADERS)
+        return record->packet;
+
+    // Rebuild a truncated frame using the first packet headers
+    header.ts.tv_sec = record->sec;
+    header.ts.tv_usec = record->usec;
+    header.caplen = stream->frame_len + record->header.len;
+    header.len = stream->frame_len + record->header.origlen;
+
+    packet = packet_create((stream->dst.family == AF_INET6) ? 6 : 4, IPPROTO_UDP, stream->src, stream->dst, 0);
+    frame = packet_add_frame(packet, &header, NULL);
+    if (!frame_alloc_data(frame)) {
+        packet_destroy(packet);
+        return NULL;
+    }
+    memcpy(frame->data, stream->frame, stream->frame_len);
+    memcpy(frame->data + stream->frame_len, record->header.data, record->header.len);
+    frame->data[header.caplen] = '\0';
+    stream_frame_lengths(stream, frame->data, stream->frame_len, record->header.origlen);
+
+    packet_set_type(packet, stream->type);
+    packet_set_frame_payload(packet, frame->data + stream->frame_len, record->header.len);
+    return packet;
+}
+
+void
+stream_release_packet(rtp_stream_t *stream, packet_t *packet)
+{
+    // Only rebuilt packets are not owned by the stream
+    if (rtp_storage == RTP_STORAGE_HEADERS)
+        packet_destroy(packet);
+}
+
+size_t
+stream_free_packets(rtp_stream_t *stream)
+{
+    size_t memory = stream->records_size * sizeof(rtp_record_t) + stream->frame_len;
+    packet_t *packet;
+    uint32_t i;
+
+    if (rtp_storage == RTP_STORAGE_RING) {
+        for (i = 0; i < stream->records_count; i++) {
+            packet = stream_record(stream, i)->packet;
+            memory += packet_memory(packet);
+            packet_destroy(packet);
+        }
+    }
+
+    free(stream->records);
+    free(stream->frame);
+    stream->records = NULL;
+    stream->frame = NULL;
+    stream->frame_len = 0;
+    stream->records_size = stream->records_first = stream->records_count = 0;
+    return memory;
+}
+
 struct sip_call *
 stream_get_call(rtp_stream_t *stream) {
     if (stream && stream->media && stream->media->msg)
@@ -328,81 +772,110 @@ rtp_check_packet(packet_t *packet)
     return stream;
 }
 
+/**
+ * @brief Get the index of the call owning a stream
+ *
+ * Streams of newer calls take precedence when several calls share the
+ * same destination address.
+ */
+static int
+rtp_stream_call_index(rtp_stream_t *stream)
+{
+    sip_call_t *call = stream_get_call(stream);
+    return call ? call->index : 0;
+}
+
 rtp_stream_t *
 rtp_find_stream_format(address_t src, address_t dst, uint32_t format)
 {
     // Structure for RTP packet streams
     rtp_stream_t *stream;
-    // Check if this is a RTP packet from active calls
-    sip_call_t *call;
-    // Iterator for active calls
-    vector_iter_t calls;
-    // Iterator for call streams
+    // Streams with the packet destination
+    rtp_flow_t *flow;
+    // Iterator for flow streams
     vector_iter_t streams;
-    // Candiate stream
-    rtp_stream_t *candidate = NULL;
-
-    // Get active calls (during conversation)
-    calls = sip_calls_iterator();
-    vector_iterator_set_current(&calls, vector_iterator_count(&calls));
-
-    while ((call = vector_iterator_prev(&calls))) {
-        streams = vector_iterator(call->streams);
-        vector_iterator_set_last(&streams);
-        while ((stream = vector_iterator_prev(&streams))) {
-            // Only look RTP packets
-            if (stream->type != PACKET_RTP)
-                continue;
+    // Found and candiate streams
+    rtp_stream_t *found = NULL, *candidate = NULL;
+    // Call index of found stream
+    int index = 0;
 
-            // Stream complete, check source, dst
-            if (stream_is_complete(stream)) {
-                if (addressport_equals(stream->src, src) &&
-                    addressport_equals(stream->dst, dst)) {
-                    // Exact searched stream format
-                    if (stream->rtpinfo.fmtcode == format) {
-                        return stream;
-                    } else {
-                        // Matching addresses but different format
-                        candidate = stream;
-                    }
-                }
-            } else {
-                // Incomplete stream, if dst match is enough
-                if (addressport_equals(stream->dst, dst)) {
-                       return stream;
-                }
+    // Get streams with this destination
+    if (!(flow = rtp_flow_find(dst)))
+        return NULL;
+
+    // Newest streams first, so the first match of each call is kept
+    streams = vector_iterator(flow->streams);
+    vector_iterator_set_last(&streams);
+    while ((stream = vector_iterator_prev(&streams))) {
+        // Only look RTP packets
+        if (stream->type != PACKET_RTP)
+            continue;
+
+        // Stream complete, check source
+        if (stream_is_complete(stream)) {
+            if (!addressport_equals(stream->src, src))
+                continue;
+            // Matching addresses but different format
+            if (stream->rtpinfo.fmtcode != format) {
+                if (!candidate || rtp_stream_call_index(stream) > rtp_stream_call_index(candidate))
+                    candidate = stream;
+                continue;
             }
         }
+
+        // Incomplete stream (dst match is enough) or exact searched stream format
+        if (!found || rtp_stream_call_index(stream) > index) {
+            found = stream;
+            index = rtp_stream_call_index(stream);
+        }
     }
 
-    return candidate;
+    return found ? found : candidate;
 }
 
 rtp_stream_t *
 rtp_find_stream(address_t src, address_t dst)
 {
     // Structure for RTP packet streams
-    rtp_stream_t *stream;
-    // Check if this is a RTP packet from active calls
-    sip_call_t *call;
-    // Iterator for active calls
-    vector_iter_t calls;
+    rtp_stream_t *stream, *found = NULL;
+    // Streams with the packet destination
+    rtp_flow_t *flow;
+    // Iterator for flow streams
+    vector_iter_t streams;
+    // Call index of found stream
+    int index = 0;
+    // Found stream has not received packets yet
+    bool incomplete, found_incomplete = false;
 
-    // Get active calls (during conversation)
-    calls = sip_calls_iterator();
-    vector_iterator_set_current(&calls, vector_iterator_count(&calls));
+    // Get streams with this destination
+    if (!(flow = rtp_flow_find(dst)))
+        return NULL;
 
-    while ((call = vector_iterator_prev(&calls))) {
-        // Check if this call has an RTP stream for current packet data
-        if ((stream = rtp_find_call_stream(call, src, dst))) {
-            return stream;
+    // Newest streams first, so the first match of each call is kept
+    streams = vector_iterator(flow->streams);
+    vector_iterator_set_last(&streams);
+    while ((stream = vector_iterator_prev(&streams))) {
+        // Complete streams must also match the source
+        incomplete = !src.port || !stream->pktcnt;
+        if (!incomplete && !addressport_equals(src, stream->src))
+            continue;
+
+        // Newest call first, then incomplete streams before complete ones
+        if (found) {
+            if (rtp_stream_call_index(stream) < index)
+                continue;
+            if (rtp_stream_call_index(stream) == index && (found_incomplete || !incomplete))
+                continue;
         }
+
+        found = stream;
+        index = rtp_stream_call_index(stream);
+        found_incomplete = incomplete;
     }
 
-    return NULL;
+    return found;
 }
 
-
 rtp_stream_t *
 rtp_find_call_stream(struct sip_call *call, address_t src, address_t dst)
 {
@@ -456,6 +929,96 @@ rtp_find_call_exact_stream(struct sip_call *call, address_t src, address_t dst)
     return NULL;
 }
 
+void
+rtp_flow_add(rtp_stream_t *stream)
+{
+    rtp_flow_t *flow;
+
+    if (!rtp_flows)
+        return;
+
+    // Create a new flow for this destination if required
+    if (!(flow = rtp_flow_find(stream->dst))) {
+        if (!(flow = sng_malloc(sizeof(rtp_flow_t))))
+            return;
+        address_get_key(stream->dst, &flow->key);
+        flow->dst = stream->dst;
+        flow->streams = vector_create(2, 2);
+        htable_insert(rtp_flows, &flow->key, flow);
+        __atomic_fetch_add(&rtp_flow_ports[stream->dst.port], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&rtp_flows_changes, 1, __ATOMIC_RELAXED);
+    }
+
+    // Add stream to this flow
+    vector_append(flow->streams, stream);
+}
+
+void
+rtp_flow_remove(rtp_stream_t *stream)
+{
+    rtp_flow_t *flow;
+
+    // Get the flow for this stream destination
+    if (!(flow = rtp_flow_find(stream->dst)))
+        return;
+
+    // Remove the stream from the flow
+    vector_remove(flow->streams, stream);
+
+    // Remove the flow once it has no streams
+    if (vector_count(flow->streams) == 0) {
+        htable_remove(rtp_flows, &flow->key);
+        vector_destroy(flow->streams);
+        sng_free(flow);
+        __atomic_fetch_sub(&rtp_flow_ports[stream->dst.port], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&rtp_flows_changes, 1, __ATOMIC_RELAXED);
+    }
+}
+
+bool
+rtp_flow_port(uint16_t port)
+{
+    return __atomic_load_n(&rtp_flow_ports[port], __ATOMIC_RELAXED) != 0;
+}
+
+uint32_t
+rtp_flow_changes()
+{
+    return __atomic_load_n(&rtp_flows_changes, __ATOMIC_RELAXED);
+}
+
+int
+rtp_flow_dsts(address_t *dsts, int max)
+{
+    rtp_flow_t *flow;
+    size_t i;
+    int count = 0;
+
+    if (!rtp_flows)
+        return 0;
+
+    for (i = 0; i < rtp_flows->size; i++) {
+        if (!(flow = rtp_flows->buckets[i].data))
+            continue;
+        if (count < max)
+            dsts[count] = flow->dst;
+        count++;
+    }
+
+    return count;
+}
+
+rtp_flow_t *
+rtp_flow_find(address_t dst)
+{
+    address_key_t key;
+
+    if (!rtp_flows)
+        return NULL;
+
+    return htable_find(rtp_flows, address_get_key(dst, &key));
+}
+
 int
 stream_is_older(rtp_stream_t *one, rtp_stream_t *two)
 {
@@ -35,6 +35,8 @@
 #include "config.h"
 #include "capture.h"
 #include "media.h"
+#include "vector.h"
+#include "hash.h"
 
 // Version is the first 2 bits of the first octet
 #define RTP_VERSION(octet) ((octet) >> 6)
@@ -53,6 +55,32 @@
 // If stream does not receive a packet in this seconds, we consider it inactive
 #define STREAM_INACTIVE_SECS 3
 
+// Number of buckets of RTP flows hash table (must be power of 2)
+#define RTP_FLOWS_SIZE 4096
+//! Number of UDP ports
+#define RTP_PORTS 65536
+//! Initial number of stored packets of a stream (ring and headers storage)
+#define RTP_RECORDS_SIZE 64
+//! Default RTP clock rate when the stream format rate is unknown
+#define RTP_CLOCK_RATE 8000
+//! Number of RTP sequence numbers
+#define RTP_SEQ_MOD (1 << 16)
+//! Max sequence jump considered packet loss instead of a sequence restart
+#define RTP_MAX_DROPOUT 3000
+//! Max sequence distance considered a late packet instead of a sequence restart
+#define RTP_MAX_MISORDER 100
+
+//! RTP packets storage policies
+enum rtp_storage
+{
+    //! Store every packet into its call
+    RTP_STORAGE_FULL = 0,
+    //! Store the packets of the last seconds of each stream
+    RTP_STORAGE_RING,
+    //! Store only the RTP header of each stream packet
+    RTP_STORAGE_HEADERS,
+};
+
 // RTCP header types
 //! http://www.iana.org/assignments/rtp-parameters/rtp-parameters.xhtml
 enum rtcp_header_types
@@ -91,6 +119,12 @@ enum rtcp_xr_block_types
 typedef struct rtp_encoding rtp_encoding_t;
 //! Shorter declaration of rtp_stream structure
 typedef struct rtp_stream rtp_stream_t;
+//! Shorter declaration of rtp_flow structure
+typedef struct rtp_flow rtp_flow_t;
+//! Shorter declaration of rtp_record structure
+typedef struct rtp_record rtp_record_t;
+//! Shorter declaration of rtp_stats structure
+typedef struct rtp_stats rtp_stats_t;
 
 struct rtp_encoding {
     uint32_t id;
@@ -98,6 +132,58 @@ struct rtp_encoding {
     const char *format;
 };
 
+/**
+ * @brief Packet stored in its stream
+ */
+struct rtp_record {
+    //! Packet capture time
+    uint32_t sec, usec;
+    union {
+        //! Stored packet (ring storage)
+        packet_t *packet;
+        struct {
+            //! Captured length of RTP data
+            uint16_t len;
+            //! Original length of RTP data
+            uint16_t origlen;
+            //! First bytes of RTP data
+            uint8_t data[RTP_HDR_LENGTH];
+        } header;
+    };
+};
+
+/**
+ * @brief RTP stream quality statistics
+ *
+ * Updated with each received packet following RFC 3550 appendix A.1
+ * (sequence numbers) and A.8 (interarrival jitter), so they don't
+ * depend on stored packets.
+ */
+struct rtp_stats {
+    //! First and highest received sequence numbers
+    uint16_t base_seq, max_seq;
+    //! Sequence numbers wraps
+    uint32_t cycles;
+    //! Packets counted since base sequence (excluding duplicates)
+    uint32_t received;
+    //! Packets with an already received sequence number
+    uint32_t dups;
+    //! Packets received after a higher sequence number
+    uint32_t late;
+    //! Max number of consecutive lost packets
+    uint32_t max_gap;
+    //! RTP clock rate of the stream payload
+    uint32_t clock;
+    //! Relative transit time of last packet (timestamp units)
+    int32_t transit;
+    //! Interarrival jitter (timestamp units scaled by 16)
+    uint32_t jitter;
+    //! Max interarrival jitter (timestamp units scaled by 16)
+    uint32_t max_jitter;
+    //! Lost packets and jitter (ms) last notified to the stream call
+    uint32_t notified_lost, notified_jitter;
+};
+
 struct rtp_stream {
     //! Determine stream type
     uint32_t type;
@@ -109,6 +195,8 @@ struct rtp_stream {
     sdp_media_t *media;
     //! Packet count for this stream
     uint32_t pktcnt;
+    //! Payload bytes of stream packets
+    uint64_t bytes;
     //! Time of first received packet of stream
     struct timeval time;
     //! Unix timestamp of last received packet
@@ -133,6 +221,34 @@ struct rtp_stream {
             uint8_t mosc;
         } rtcpinfo;
     };
+
+    //! Quality statistics (RTP streams)
+    rtp_stats_t stats;
+
+    //! Stored packets circular array (ring and headers storage)
+    rtp_record_t *records;
+    //! Allocated records, position of the oldest one and stored records
+    uint32_t records_size, records_first, records_count;
+    //! Frame data before RTP data of the first stored packet (headers storage)
+    u_char *frame;
+    //! Length of frame data before RTP data
+    uint16_t frame_len;
+};
+
+/**
+ * @brief Streams sharing the same destination address
+ *
+ * All streams added to calls are indexed by its destination address
+ * and port, so RTP and RTCP packets can be matched to its stream
+ * without walking all calls streams.
+ */
+struct rtp_flow {
+    //! Hash table key (destination ip:port)
+    address_key_t key;
+    //! Destination address of the streams
+    address_t dst;
+    //! Streams with this destination (oldest first)
+    vector_t *streams;
 };
 
 struct rtcp_hdr_generic
@@ -273,9 +389,37 @@ struct rtcp_blk_xr_voip
     uint16_t jbadelay;
 };
 
+/**
+ * @brief Initialize RTP flows index
+ */
+void
+rtp_init();
+
+/**
+ * @brief Deallocate RTP flows index
+ */
+void
+rtp_deinit();
+
 rtp_stream_t *
 stream_create(sdp_media_t *media, address_t dst, int type);
 
+/**
+ * @brief Deallocate stream memory
+ *
+ * Stream will also be removed from RTP flows index
+ *
+ * @param stream stream structure pointer
+ */
+void
+stream_destroy(rtp_stream_t *stream);
+
+/**
+ * @brief Wrapper around stream destroyer to use in vectors
+ */
+void
+stream_destroyer(void *stream);
+
 rtp_stream_t *
 stream_complete(rtp_stream_t *stream, address_t src);
 
@@ -288,6 +432,100 @@ stream_add_packet(rtp_stream_t *stream, packet_t *packet);
 uint32_t
 stream_get_count(rtp_stream_t *stream);
 
+/**
+ * @brief Get the number of packets expected from stream sequence numbers
+ */
+uint32_t
+stream_get_expected(rtp_stream_t *stream);
+
+/**
+ * @brief Get the number of lost packets of the stream
+ *
+ * Late and duplicated packets can make received packets exceed the
+ * expected ones, in that case no packet is considered lost.
+ */
+uint32_t
+stream_get_lost(rtp_stream_t *stream);
+
+/**
+ * @brief Get the percentage of lost packets of the stream
+ */
+double
+stream_get_loss(rtp_stream_t *stream);
+
+/**
+ * @brief Get the current interarrival jitter of the stream in milliseconds
+ */
+double
+stream_get_jitter(rtp_stream_t *stream);
+
+/**
+ * @brief Get the max interarrival jitter of the stream in milliseconds
+ */
+double
+stream_get_max_jitter(rtp_stream_t *stream);
+
+/**
+ * @brief Estimate the stream MOS from its loss and jitter
+ *
+ * Uses a simplified ITU-T G.107 E-model without codec impairment and
+ * a delay of twice the stream jitter (jitter buffer) plus 10ms (codec).
+ *
+ * @return MOS value between 1.0 and 4.5
+ */
+double
+stream_get_mos(rtp_stream_t *stream);
+
+/**
+ * @brief Get the configured RTP packets storage policy
+ */
+enum rtp_storage
+rtp_get_storage();
+
+/**
+ * @brief Store a RTP packet into its stream
+ *
+ * Ring storage keeps the packet and removes the stream packets older
+ * than the configured seconds. Headers storage only copies the packet
+ * RTP header, so the packet can be destroyed after calling this.
+ *
+ * @return true if the packet is now owned by the stream
+ */
+bool
+stream_store_packet(rtp_stream_t *stream, packet_t *packet);
+
+/**
+ * @brief Get the number of packets stored in the stream
+ */
+uint32_t
+stream_stored_count(rtp_stream_t *stream);
+
+/**
+ * @brief Get a stored packet of the stream
+ *
+ * Packets using headers storage are rebuilt with truncated frames from
+ * their header. Returned packets must be released using
+ * @stream_release_packet.
+ *
+ * @return packet or NULL if index is not stored
+ */
+packet_t *
+stream_stored_packet(rtp_stream_t *stream, uint32_t index);
+
+/**
+ * @brief Release a packet returned by @stream_stored_packet
+ */
+void
+stream_release_packet(rtp_stream_t *stream, packet_t *packet);
+
+/**
+ * @brief Remove all stored packets of the stream
+ *
+ * @return memory released in bytes
+ */
+size_t
+stream_free_packets(rtp_stream_t *stream);
+
 struct sip_call *
 stream_get_call(rtp_stream_t *stream);
 
@@ -309,6 +547,68 @@ rtp_find_stream(address_t src, address_t dst);
 rtp_stream_t *
 rtp_find_call_stream(struct sip_call *call, address_t src, address_t dst);
 
+/**
+ * @brief Add a stream to the RTP flows index
+ *
+ * This must be invoked once the stream destination is definitive,
+ * usually when the stream is added to its call.
+ *
+ * @param stream stream structure pointer
+ */
+void
+rtp_flow_add(rtp_stream_t *stream);
+
+/**
+ * @brief Remove a stream from the RTP flows index
+ *
+ * @param stream stream structure pointer
+ */
+void
+rtp_flow_remove(rtp_stream_t *stream);
+
+/**
+ * @brief Find the flow with given destination address
+ *
+ * @param dst Destination address and port
+ * @return flow structure pointer or NULL if not found
+ */
+rtp_flow_t *
+rtp_flow_find(address_t dst);
+
+/**
+ * @brief Check if there is any flow with given destination port
+ *
+ * This can be called from capture threads without the capture lock, as
+ * flows are only counted per port. Flows added or removed while checking
+ * may not be seen yet.
+ *
+ * @param port Destination port
+ * @return true if at least one flow has this port
+ */
+bool
+rtp_flow_port(uint16_t port);
+
+/**
+ * @brief Get the number of times a flow has been added or removed
+ *
+ * This can be called without the capture lock to check if the set of
+ * active destinations has changed.
+ */
+uint32_t
+rtp_flow_changes();
+
+/**
+ * @brief Get the destination address of all active flows
+ *
+ * This must be invoked with the capture lock held.
+ *
+ * @param dsts Array to store up to max destinations
+ * @param max Size of destinations array
+ * @return number of active flows (may be greater than max)
+ */
+int
+rtp_flow_dsts(address_t *dsts, int max);
+
 rtp_stream_t *
 rtp_find_call_exact_stream(struct sip_call *call, address_t src, address_t dst);
 
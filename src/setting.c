@@ -43,19 +43,87 @@ setting_t settings[SETTING_COUNT] = {
     { SETTING_SYNTAX_BRANCH,      "syntax.branch",      SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
     { SETTING_ALTKEY_HINT,        "hintkeyalt",         SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
     { SETTING_EXITPROMPT,         "exitprompt",         SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
+    { SETTING_UI_MAXFPS,          "ui.maxfps",          SETTING_FMT_NUMBER,  "10",        NULL },
+    { SETTING_UI_AFFINITY,        "ui.affinity",        SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_UI_WORKERS,         "ui.workers",         SETTING_FMT_NUMBER,  "0",         NULL },
     { SETTING_CAPTURE_LIMIT,      "capture.limit",      SETTING_FMT_NUMBER,  "20000",     NULL },
     { SETTING_CAPTURE_DEVICE,     "capture.device",     SETTING_FMT_STRING,  "any",       NULL },
     { SETTING_CAPTURE_OUTFILE,    "capture.outfile",    SETTING_FMT_STRING,  "",          NULL },
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
     { SETTING_CAPTURE_KEYFILE,    "capture.keyfile",    SETTING_FMT_STRING,  "",          NULL },
     { SETTING_CAPTURE_TLSSERVER,  "capture.tlsserver",  SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_CAPTURE_TLS_MAXCONN, "capture.tls.maxconn", SETTING_FMT_NUMBER, "4096",   NULL },
+    { SETTING_CAPTURE_TLS_WORKERS, "capture.tls.workers", SETTING_FMT_NUMBER, "0",      NULL },
 #endif
     { SETTING_CAPTURE_RTP,        "capture.rtp",        SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_RTP_FILTER, "capture.rtp.filter", SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_RTP_FILTER_SIP, "capture.rtp.filter.sip", SETTING_FMT_STRING, "not udp or udp port 5060", NULL },
+    { SETTING_CAPTURE_RTP_STORAGE, "capture.rtp.storage", SETTING_FMT_ENUM, "full",     SETTING_ENUM_RTPSTORAGE },
+    { SETTING_CAPTURE_RTP_RING,   "capture.rtp.ring",   SETTING_FMT_NUMBER,  "10",        NULL },
+    { SETTING_CAPTURE_RTP_SPOOL,  "capture.rtp.spool",  SETTING_FMT_ENUM,    "off",       SETTING_ENUM_RTPSPOOL },
     { SETTING_CAPTURE_STORAGE,    "capture.storage",    SETTING_FMT_ENUM,    "memory",    SETTING_ENUM_STORAGE },
+    { SETTING_CAPTURE_STORAGE_DIR, "capture.storagedir", SETTING_FMT_STRING, "/tmp",      NULL },
+    { SETTING_CAPTURE_MEMLIMIT,   "capture.memlimit",   SETTING_FMT_NUMBER,  "0",         NULL },
     { SETTING_CAPTURE_ROTATE,     "capture.rotate",     SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_QUEUE,      "capture.queue",      SETTING_FMT_NUMBER,  "8192",      NULL },
+    { SETTING_CAPTURE_WORKERS,    "capture.workers",    SETTING_FMT_NUMBER,  "1",         NULL },
+    { SETTING_CAPTURE_BATCH_SIZE, "capture.batchsize",  SETTING_FMT_NUMBER,  "32",        NULL },
+    { SETTING_CAPTURE_BATCH_LATENCY, "capture.batchlatency", SETTING_FMT_NUMBER, "100",   NULL },
+    { SETTING_CAPTURE_BUFFER,     "capture.buffer",     SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_CAPTURE_SNAPLEN,    "capture.snaplen",    SETTING_FMT_NUMBER,  "262144",    NULL },
+    { SETTING_CAPTURE_IMMEDIATE,  "capture.immediate",  SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_ASYNC,      "capture.async",      SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_AFFINITY,   "capture.affinity",   SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_CAPTURE_PRIORITY,   "capture.priority",   SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_CAPTURE_WORKERS_AFFINITY, "capture.workers.affinity", SETTING_FMT_STRING, "", NULL },
+    { SETTING_CAPTURE_OVERLOAD,   "capture.overload",   SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_OVERLOAD_LEVELS, "capture.overload.levels", SETTING_FMT_STRING, "rtp,sdp,dialogs,sample", NULL },
+    { SETTING_CAPTURE_OVERLOAD_SAMPLE, "capture.overload.sample", SETTING_FMT_NUMBER, "10", NULL },
+    { SETTING_CAPTURE_OVERLOAD_HOLD, "capture.overload.hold", SETTING_FMT_NUMBER,  "5",         NULL },
+    { SETTING_CAPTURE_TPACKET,    "capture.tpacket",    SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_TPACKET_BLOCKSIZE, "capture.tpacket.blocksize", SETTING_FMT_NUMBER, "1048576", NULL },
+    { SETTING_CAPTURE_TPACKET_BLOCKS, "capture.tpacket.blocks", SETTING_FMT_NUMBER, "64", NULL },
+    { SETTING_CAPTURE_TPACKET_FANOUT, "capture.tpacket.fanout", SETTING_FMT_NUMBER, "1", NULL },
+    { SETTING_CAPTURE_READER,     "capture.reader",     SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_READER_BLOCKSIZE, "capture.reader.blocksize", SETTING_FMT_NUMBER, "1048576", NULL },
+    { SETTING_CAPTURE_READER_BLOCKS, "capture.reader.blocks", SETTING_FMT_NUMBER, "8", NULL },
+    { SETTING_CAPTURE_INDEX,      "capture.index",      SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_INDEX_INTERVAL, "capture.index.interval", SETTING_FMT_NUMBER, "1000", NULL },
+    { SETTING_CAPTURE_MERGE,      "capture.merge",      SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_DEDUP,      "capture.dedup",      SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_CAPTURE_DEDUP_SOURCES, "capture.dedup.sources", SETTING_FMT_STRING, "",     NULL },
+    { SETTING_CAPTURE_WRITER,     "capture.writer",     SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_WRITER_BLOCKSIZE, "capture.writer.blocksize", SETTING_FMT_NUMBER, "1048576", NULL },
+    { SETTING_CAPTURE_WRITER_BLOCKS, "capture.writer.blocks", SETTING_FMT_NUMBER, "16", NULL },
+    { SETTING_CAPTURE_WRITER_DIRECT, "capture.writer.direct", SETTING_FMT_ENUM, SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_WRITER_FSYNC, "capture.writer.fsync", SETTING_FMT_ENUM,  "off",       SETTING_ENUM_FSYNC },
+    { SETTING_CAPTURE_WRITER_ROTATE_SIZE, "capture.writer.rotatesize", SETTING_FMT_NUMBER, "0", NULL },
+    { SETTING_CAPTURE_WRITER_ROTATE_TIME, "capture.writer.rotatetime", SETTING_FMT_NUMBER, "0", NULL },
+    { SETTING_CAPTURE_WRITER_MAX_FILES, "capture.writer.maxfiles", SETTING_FMT_NUMBER, "0", NULL },
+    { SETTING_CAPTURE_SHARED_SIZE, "capture.sharedsize", SETTING_FMT_NUMBER, "256", NULL },
     { SETTING_SIP_NOINCOMPLETE,   "sip.noincomplete",   SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
     { SETTING_SIP_HEADER_X_CID,   "sip.xcid",           SETTING_FMT_STRING,  "X-Call-ID|X-CID", NULL },
+    { SETTING_SIP_HEADER_CUSTOM,  "sip.header",         SETTING_FMT_STRING,  "",          NULL },
     { SETTING_SIP_CALLS,          "sip.calls",          SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_SIP_PARSER,         "sip.parser",         SETTING_FMT_ENUM,    "scan",      SETTING_ENUM_SIPPARSER },
+    { SETTING_SIP_EXPIRE_FINISHED, "sip.expire.finished", SETTING_FMT_NUMBER, "0",        NULL },
+    { SETTING_SIP_EXPIRE_DIALOGS, "sip.expire.dialogs", SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_SIP_EXPIRE_ACTIVE,  "sip.expire.active",  SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_SIP_SAMPLE,         "sip.sample",         SETTING_FMT_NUMBER,  "1",         NULL },
+    { SETTING_SIP_SAMPLE_ADAPTIVE, "sip.sample.adaptive", SETTING_FMT_ENUM,  SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_SIP_COMPRESS,       "sip.compress",       SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_SIP_KEEPALIVE,      "sip.keepalive",      SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_SIP_KEEPALIVE_MSGS, "sip.keepalive.msgs", SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_REPORT_JSON,        "report.json",        SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_REPORT_INTERVAL,    "report.interval",    SETTING_FMT_NUMBER,  "1",         NULL },
+    { SETTING_REPORT_LISTEN,      "report.listen",      SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_REPORT_LISTEN_ADDR, "report.listen.address", SETTING_FMT_STRING, "127.0.0.1", NULL },
+    { SETTING_REPORT_LISTEN_PORT, "report.listen.port", SETTING_FMT_NUMBER,  "9100",      NULL },
+    { SETTING_REPORT_HEALTH_FILE, "report.health.file", SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_CDR_FILE,           "cdr.file",           SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_CDR_FORMAT,         "cdr.format",         SETTING_FMT_ENUM,    "json",      SETTING_ENUM_CDRFORMAT },
+    { SETTING_CDR_QUEUE,          "cdr.queue",          SETTING_FMT_NUMBER,  "4096",      NULL },
+    { SETTING_HISTORY_FILE,       "history.file",       SETTING_FMT_STRING,  "",          NULL },
     { SETTING_SAVEPATH,           "savepath",           SETTING_FMT_STRING,  "",          NULL },
     { SETTING_DISPLAY_ALIAS,      "displayalias",       SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
     { SETTING_CL_SCROLLSTEP,      "cl.scrollstep",      SETTING_FMT_NUMBER,  "4",         NULL },
@@ -78,6 +146,7 @@ setting_t settings[SETTING_COUNT] = {
     { SETTING_CR_NON_ASCII,       "cr.nonascii",        SETTING_FMT_STRING,  ".",        NULL },
     { SETTING_FILTER_PAYLOAD,     "filter.payload",     SETTING_FMT_STRING,  "",          NULL },
     { SETTING_FILTER_METHODS,     "filter.methods",     SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_FILTER_PAYLOAD_INDEX, "filter.payload.index", SETTING_FMT_ENUM, SETTING_OFF, SETTING_ENUM_ONOFF },
 #ifdef USE_EEP
     { SETTING_EEP_SEND,           "eep.send",           SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
     { SETTING_EEP_SEND_VER,       "eep.send.version",   SETTING_FMT_ENUM,    "3",         SETTING_ENUM_HEPVERSION },
@@ -85,12 +154,18 @@ setting_t settings[SETTING_COUNT] = {
     { SETTING_EEP_SEND_PORT,      "eep.send.port",      SETTING_FMT_NUMBER,  "9060",      NULL },
     { SETTING_EEP_SEND_PASS,      "eep.send.pass",      SETTING_FMT_STRING,  "",          NULL },
     { SETTING_EEP_SEND_ID,        "eep.send.id",        SETTING_FMT_NUMBER,  "2002",      NULL },
+    { SETTING_EEP_SEND_QUEUE,     "eep.send.queue",     SETTING_FMT_NUMBER,  "4096",      NULL },
+    { SETTING_EEP_SEND_FANOUT,    "eep.send.fanout",    SETTING_FMT_STRING,  "",          NULL },
     { SETTING_EEP_LISTEN,         "eep.listen",         SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
     { SETTING_EEP_LISTEN_VER,     "eep.listen.version", SETTING_FMT_ENUM,    "3",         SETTING_ENUM_HEPVERSION },
     { SETTING_EEP_LISTEN_ADDR,    "eep.listen.address", SETTING_FMT_STRING,  "0.0.0.0",   NULL },
     { SETTING_EEP_LISTEN_PORT,    "eep.listen.port",    SETTING_FMT_NUMBER,  "9060",      NULL },
     { SETTING_EEP_LISTEN_PASS,    "eep.listen.pass",    SETTING_FMT_STRING,  "",          NULL },
     { SETTING_EEP_LISTEN_UUID,    "eep.listen.uuid",    SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_EEP_LISTEN_THREADS, "eep.listen.threads", SETTING_FMT_NUMBER,  "1",         NULL },
+    { SETTING_EEP_RELAY,          "eep.relay",          SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_EEP_RELAY_ID,       "eep.relay.id",       SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_EEP_RELAY_SAMPLE,   "eep.relay.sample",   SETTING_FMT_NUMBER,  "100",       NULL },
 #endif
 };
 
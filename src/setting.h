@@ -58,9 +58,14 @@ typedef struct setting_option setting_t;
 #define SETTING_ENUM_COLORMODE   (const char *[]){ "request", "cseq", "callid", NULL }
 #define SETTING_ENUM_HIGHLIGHT   (const char *[]){ "bold", "reverse", "reversebold", NULL }
 #define SETTING_ENUM_SDP_INFO    (const char *[]){ "off", "first", "full", "compressed", NULL}
-#define SETTING_ENUM_STORAGE     (const char *[]){ "none", "memory", NULL }
+#define SETTING_ENUM_STORAGE     (const char *[]){ "none", "memory", "disk", NULL }
+#define SETTING_ENUM_RTPSPOOL    (const char *[]){ "off", "locked", "filtered", NULL }
+#define SETTING_ENUM_FSYNC       (const char *[]){ "off", "block", "close", NULL }
 #define SETTING_ENUM_HEPVERSION  (const char *[]){ "2", "3", NULL }
 #define SETTING_ENUM_MEDIA       (const char *[]){ "off", "on", "active", NULL }
+#define SETTING_ENUM_SIPPARSER   (const char *[]){ "scan", "regex", NULL }
+#define SETTING_ENUM_RTPSTORAGE  (const char *[]){ "full", "ring", "headers", NULL }
+#define SETTING_ENUM_CDRFORMAT   (const char *[]){ "json", "csv", NULL }
 
 //! Other useful defines
 #define SETTING_ON  "on"
@@ -79,19 +84,87 @@ enum setting_id {
     SETTING_SYNTAX_BRANCH,
     SETTING_ALTKEY_HINT,
     SETTING_EXITPROMPT,
+    SETTING_UI_MAXFPS,
+    SETTING_UI_AFFINITY,
+    SETTING_UI_WORKERS,
     SETTING_CAPTURE_LIMIT,
     SETTING_CAPTURE_DEVICE,
     SETTING_CAPTURE_OUTFILE,
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
     SETTING_CAPTURE_KEYFILE,
     SETTING_CAPTURE_TLSSERVER,
+    SETTING_CAPTURE_TLS_MAXCONN,
+    SETTING_CAPTURE_TLS_WORKERS,
 #endif
     SETTING_CAPTURE_RTP,
+    SETTING_CAPTURE_RTP_FILTER,
+    SETTING_CAPTURE_RTP_FILTER_SIP,
+    SETTING_CAPTURE_RTP_STORAGE,
+    SETTING_CAPTURE_RTP_RING,
+    SETTING_CAPTURE_RTP_SPOOL,
     SETTING_CAPTURE_STORAGE,
+    SETTING_CAPTURE_STORAGE_DIR,
+    SETTING_CAPTURE_MEMLIMIT,
     SETTING_CAPTURE_ROTATE,
+    SETTING_CAPTURE_QUEUE,
+    SETTING_CAPTURE_WORKERS,
+    SETTING_CAPTURE_BATCH_SIZE,
+    SETTING_CAPTURE_BATCH_LATENCY,
+    SETTING_CAPTURE_BUFFER,
+    SETTING_CAPTURE_SNAPLEN,
+    SETTING_CAPTURE_IMMEDIATE,
+    SETTING_CAPTURE_ASYNC,
+    SETTING_CAPTURE_AFFINITY,
+    SETTING_CAPTURE_PRIORITY,
+    SETTING_CAPTURE_WORKERS_AFFINITY,
+    SETTING_CAPTURE_OVERLOAD,
+    SETTING_CAPTURE_OVERLOAD_LEVELS,
+    SETTING_CAPTURE_OVERLOAD_SAMPLE,
+    SETTING_CAPTURE_OVERLOAD_HOLD,
+    SETTING_CAPTURE_TPACKET,
+    SETTING_CAPTURE_TPACKET_BLOCKSIZE,
+    SETTING_CAPTURE_TPACKET_BLOCKS,
+    SETTING_CAPTURE_TPACKET_FANOUT,
+    SETTING_CAPTURE_READER,
+    SETTING_CAPTURE_READER_BLOCKSIZE,
+    SETTING_CAPTURE_READER_BLOCKS,
+    SETTING_CAPTURE_INDEX,
+    SETTING_CAPTURE_INDEX_INTERVAL,
+    SETTING_CAPTURE_MERGE,
+    SETTING_CAPTURE_DEDUP,
+    SETTING_CAPTURE_DEDUP_SOURCES,
+    SETTING_CAPTURE_WRITER,
+    SETTING_CAPTURE_WRITER_BLOCKSIZE,
+    SETTING_CAPTURE_WRITER_BLOCKS,
+    SETTING_CAPTURE_WRITER_DIRECT,
+    SETTING_CAPTURE_WRITER_FSYNC,
+    SETTING_CAPTURE_WRITER_ROTATE_SIZE,
+    SETTING_CAPTURE_WRITER_ROTATE_TIME,
+    SETTING_CAPTURE_WRITER_MAX_FILES,
+    SETTING_CAPTURE_SHARED_SIZE,
     SETTING_SIP_NOINCOMPLETE,
     SETTING_SIP_HEADER_X_CID,
+    SETTING_SIP_HEADER_CUSTOM,
     SETTING_SIP_CALLS,
+    SETTING_SIP_PARSER,
+    SETTING_SIP_EXPIRE_FINISHED,
+    SETTING_SIP_EXPIRE_DIALOGS,
+    SETTING_SIP_EXPIRE_ACTIVE,
+    SETTING_SIP_SAMPLE,
+    SETTING_SIP_SAMPLE_ADAPTIVE,
+    SETTING_SIP_COMPRESS,
+    SETTING_SIP_KEEPALIVE,
+    SETTING_SIP_KEEPALIVE_MSGS,
+    SETTING_REPORT_JSON,
+    SETTING_REPORT_INTERVAL,
+    SETTING_REPORT_LISTEN,
+    SETTING_REPORT_LISTEN_ADDR,
+    SETTING_REPORT_LISTEN_PORT,
+    SETTING_REPORT_HEALTH_FILE,
+    SETTING_CDR_FILE,
+    SETTING_CDR_FORMAT,
+    SETTING_CDR_QUEUE,
+    SETTING_HISTORY_FILE,
     SETTING_SAVEPATH,
     SETTING_DISPLAY_ALIAS,
     SETTING_CL_SCROLLSTEP,
@@ -114,6 +187,7 @@ enum setting_id {
     SETTING_CR_NON_ASCII,
     SETTING_FILTER_PAYLOAD,
     SETTING_FILTER_METHODS,
+    SETTING_FILTER_PAYLOAD_INDEX,
 #ifdef USE_EEP
     SETTING_EEP_SEND,
     SETTING_EEP_SEND_VER,
@@ -121,12 +195,18 @@ enum setting_id {
     SETTING_EEP_SEND_PORT,
     SETTING_EEP_SEND_PASS,
     SETTING_EEP_SEND_ID,
+    SETTING_EEP_SEND_QUEUE,
+    SETTING_EEP_SEND_FANOUT,
     SETTING_EEP_LISTEN,
     SETTING_EEP_LISTEN_VER,
     SETTING_EEP_LISTEN_ADDR,
     SETTING_EEP_LISTEN_PORT,
     SETTING_EEP_LISTEN_PASS,
     SETTING_EEP_LISTEN_UUID,
+    SETTING_EEP_LISTEN_THREADS,
+    SETTING_EEP_RELAY,
+    SETTING_EEP_RELAY_ID,
+    SETTING_EEP_RELAY_SAMPLE,
 #endif
     SETTING_COUNT
 };
@@ -32,10 +32,21 @@
 #include <time.h>
 #include <pthread.h>
 #include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "sip.h"
 #include "option.h"
 #include "setting.h"
 #include "filter.h"
+#include "intern.h"
+#include "capture_overload.h"
+#include "cdr.h"
+#include "history.h"
+#include "keepalive.h"
+#include "parallel.h"
 
 /**
  * @brief Linked list of parsed calls
@@ -148,6 +159,7 @@ sip_init(int limit, int only_calls, int no_incomplete)
     calls.only_calls = only_calls;
     calls.ignore_incomplete = no_incomplete;
     calls.last_index = 0;
+    calls.memlimit = (size_t) setting_get_intvalue(SETTING_CAPTURE_MEMLIMIT) * 1024 * 1024;
 
     // Create a vector to store calls
     calls.list = vector_create(200, 50);
@@ -155,9 +167,32 @@ sip_init(int limit, int only_calls, int no_incomplete)
     vector_set_sorter(calls.list, sip_list_sorter);
     calls.active = vector_create(10, 10);
 
+    // Create displayed calls view
+    calls.view = treap_create();
+    calls.view_changed = vector_create(0, 50);
+    calls.view_first = 0;
+    calls.view_last = INT_MAX;
+
+    // Create interface notification pipe
+    if (pipe(calls.notify) == 0) {
+        fcntl(calls.notify[0], F_SETFL, O_NONBLOCK);
+        fcntl(calls.notify[1], F_SETFL, O_NONBLOCK);
+    } else {
+        calls.notify[0] = calls.notify[1] = -1;
+    }
+
     // Create hash table for callid search
     calls.callids = htable_create(calls.limit);
 
+    // Create RTP flows index
+    rtp_init();
+
+    // Create shared strings table
+    intern_init();
+
+    // Create keepalive aggregate entries storage
+    keepalive_init(limit);
+
     // Set default sorting field
     if (sip_attr_from_name(setting_get_value(SETTING_CL_SORTFIELD)) >= 0) {
         calls.sort.by = sip_attr_from_name(setting_get_value(SETTING_CL_SORTFIELD));
@@ -168,6 +203,31 @@ sip_init(int limit, int only_calls, int no_incomplete)
         calls.sort.asc = true;
     }
 
+    // Use regular expressions for header parsing if requested
+    calls.regex_parser = setting_has_value(SETTING_SIP_PARSER, "regex");
+
+    // Idle dialogs expiry timeouts
+    calls.expire_finished = setting_get_intvalue(SETTING_SIP_EXPIRE_FINISHED);
+    calls.expire_dialogs = setting_get_intvalue(SETTING_SIP_EXPIRE_DIALOGS);
+    calls.expire_active = setting_get_intvalue(SETTING_SIP_EXPIRE_ACTIVE);
+
+    // Dialogs sampling
+    calls.sample_min = setting_get_intvalue(SETTING_SIP_SAMPLE);
+    if (calls.sample_min < 1)
+        calls.sample_min = 1;
+    if (calls.sample_min > SIP_SAMPLE_MAX)
+        calls.sample_min = SIP_SAMPLE_MAX;
+    calls.sample = calls.sample_min;
+    calls.sample_adaptive = setting_enabled(SETTING_SIP_SAMPLE_ADAPTIVE);
+
+    // Finished calls compression
+    calls.compress = setting_get_intvalue(SETTING_SIP_COMPRESS);
+    if (calls.compress > 0 && !call_compress_supported()) {
+        fprintf(stderr, "%s requires zstd or zlib support, disabling it.\n",
+            setting_name(SETTING_SIP_COMPRESS));
+        calls.compress = 0;
+    }
+
     // Initialize payload parsing regexp
     match_flags = REG_EXTENDED | REG_ICASE | REG_NEWLINE;
     regcomp(&calls.reg_method, "^([a-zA-Z]+) [a-zA-Z]+:.+ SIP/2.0[ ]*\r", match_flags & ~REG_NEWLINE);
@@ -181,6 +241,7 @@ sip_init(int limit, int only_calls, int no_incomplete)
             setting_name(SETTING_SIP_HEADER_X_CID));
     }
     snprintf(reg_rule, reg_rule_len, "^(%s):[ ]*([^ ]+)[ ]*\r$", setting);
+    calls.xcid = setting;
     reg_rule_err = regcomp(&calls.reg_xcallid, reg_rule, match_flags);
     if(reg_rule_err != 0) {
         regerror(reg_rule_err, &calls.reg_xcallid, reg_rule, SIP_ATTR_MAXLEN);
@@ -190,6 +251,7 @@ sip_init(int limit, int only_calls, int no_incomplete)
             setting_name(SETTING_SIP_HEADER_X_CID), reg_rule);
         regcomp(&calls.reg_xcallid,
             "^(X-Call-ID|X-CID):[ ]*([^ ]+)[ ]*\r$", match_flags);
+        calls.xcid = "X-Call-ID|X-CID";
     }
     regcomp(&calls.reg_response, "^SIP/2.0[ ]*(([0-9]{3}) [^\r]*)[ ]*\r", match_flags & ~REG_NEWLINE);
     regcomp(&calls.reg_cseq, "^CSeq:[ ]*([0-9]{1,10}) .+\r$", match_flags);
@@ -210,9 +272,26 @@ sip_deinit()
     sip_calls_clear();
     // Remove Call-id hash table
     htable_destroy(calls.callids);
+    // Remove RTP flows index
+    rtp_deinit();
+    // Remove shared strings table
+    intern_deinit();
+    // Remove keepalive aggregate entries
+    keepalive_deinit();
+    // Remove match expression literal matchers
+    strmatch_destroy(calls.match_literal);
+    strmatch_destroy(calls.match_patterns);
     // Remove calls vector
     vector_destroy(calls.list);
     vector_destroy(calls.active);
+    // Remove displayed calls view
+    treap_destroy(calls.view);
+    vector_destroy(calls.view_changed);
+    // Close interface notification pipe
+    if (calls.notify[0] >= 0) {
+        close(calls.notify[0]);
+        close(calls.notify[1]);
+    }
     // Deallocate regular expressions
     regfree(&calls.reg_method);
     regfree(&calls.reg_callid);
@@ -229,28 +308,84 @@ sip_deinit()
 }
 
 
-char *
-sip_get_callid(const char* payload, char *callid)
+int
+sip_parse_headers(const char *payload, uint32_t len, sip_headers_t *hdrs)
 {
-    regmatch_t pmatch[3];
+    regmatch_t pmatch[4];
+
+    // Scan all required headers in a single pass
+    if (!calls.regex_parser)
+        return sip_parser_scan(payload, len, calls.xcid, hdrs);
+
+    // Initialize scanned headers
+    memset(hdrs, 0, sizeof(sip_headers_t));
+    hdrs->body = -1;
+
+#define SET_HDR(hdr, match) \
+    hdr.off = match.rm_so; \
+    hdr.len = match.rm_eo - match.rm_so;
 
-    // Try to get Call-ID from payload
+    // Check if the first line follows SIP request or response format
+    if (regexec(&calls.reg_valid, payload, 2, pmatch, 0) != 0)
+        return 1;
+    hdrs->valid = true;
+
+    if (regexec(&calls.reg_method, payload, 2, pmatch, 0) == 0) {
+        SET_HDR(hdrs->method, pmatch[1]);
+    }
+    if (regexec(&calls.reg_response, payload, 3, pmatch, 0) == 0) {
+        SET_HDR(hdrs->response, pmatch[1]);
+        SET_HDR(hdrs->code, pmatch[2]);
+    }
     if (regexec(&calls.reg_callid, payload, 3, pmatch, 0) == 0) {
-        // Copy the matching part of payload
-        strncpy(callid, payload + pmatch[2].rm_so, (int) pmatch[2].rm_eo - pmatch[2].rm_so);
+        SET_HDR(hdrs->callid, pmatch[2]);
     }
+    if (regexec(&calls.reg_xcallid, payload, 3, pmatch, 0) == 0) {
+        SET_HDR(hdrs->xcallid, pmatch[2]);
+    }
+    if (regexec(&calls.reg_cseq, payload, 2, pmatch, 0) == 0) {
+        SET_HDR(hdrs->cseq, pmatch[1]);
+    }
+    if (regexec(&calls.reg_from, payload, 4, pmatch, 0) == 0) {
+        SET_HDR(hdrs->from, pmatch[2]);
+    }
+    if (regexec(&calls.reg_to, payload, 4, pmatch, 0) == 0) {
+        SET_HDR(hdrs->to, pmatch[2]);
+    }
+    if (regexec(&calls.reg_cl, payload, 4, pmatch, 0) == 0) {
+        SET_HDR(hdrs->cl, pmatch[2]);
+    }
+    if (regexec(&calls.reg_reason, payload, 2, pmatch, 0) == 0) {
+        SET_HDR(hdrs->reason, pmatch[1]);
+    }
+    if (regexec(&calls.reg_warning, payload, 2, pmatch, 0) == 0) {
+        SET_HDR(hdrs->warning, pmatch[1]);
+    }
+    if (regexec(&calls.reg_body, payload, 2, pmatch, 0) == 0) {
+        hdrs->body = pmatch[1].rm_so;
+    }
+#undef SET_HDR
 
-    return callid;
+    return 0;
 }
 
 char *
-sip_get_xcallid(const char *payload, char *xcallid)
+sip_get_callid(const char* payload, const sip_headers_t *hdrs, char *callid)
 {
-    regmatch_t pmatch[3];
+    // Copy Call-ID value from payload
+    if (hdrs->callid.len) {
+        sip_parser_value(payload, hdrs->callid, callid, 1024);
+    }
 
-    // Try to get X-Call-ID from payload
-    if (regexec(&calls.reg_xcallid, (const char *)payload, 3, pmatch, 0) == 0) {
-        strncpy(xcallid, (const char *)payload +  pmatch[2].rm_so, (int)pmatch[2].rm_eo - pmatch[2].rm_so);
+    return callid;
+}
+
+char *
+sip_get_xcallid(const char *payload, const sip_headers_t *hdrs, char *xcallid)
+{
+    // Copy X-Call-ID value from payload
+    if (hdrs->xcallid.len) {
+        sip_parser_value(payload, hdrs->xcallid, xcallid, 1024);
     }
 
     return xcallid;
@@ -259,47 +394,62 @@ sip_get_xcallid(const char *payload, char *xcallid)
 int
 sip_validate_packet(packet_t *packet)
 {
-    uint32_t plen = packet_payloadlen(packet);
-    u_char payload[MAX_SIP_PAYLOAD];
-    regmatch_t pmatch[3];
-    char cl_header[10];
+    uint32_t msglen;
+    int valid;
+
+    // Packet payload is always NULL terminated
+    valid = sip_validate_payload(packet_payload(packet), packet_payloadlen(packet), &msglen);
+
+    if (valid == VALIDATE_MULTIPLE_SIP) {
+        // We got more than one SIP message in the same packet
+        packet_trim_payload(packet, msglen);
+    }
+
+    return valid;
+}
+
+int
+sip_validate_payload(const u_char *payload, uint32_t plen, uint32_t *msglen)
+{
+    sip_headers_t hdrs;
+    char cl_header[11];
     int content_len;
     int bodylen;
 
+    // Message length is unknown until headers are complete
+    *msglen = 0;
+
     // Max SIP payload allowed
     if (plen == 0 || plen > MAX_SIP_PAYLOAD)
         return VALIDATE_NOT_SIP;
 
-    // Get payload from packet(s)
-    memset(payload, 0, MAX_SIP_PAYLOAD);
-    memcpy(payload, packet_payload(packet), plen);
-
-    // Initialize variables
-    memset(cl_header, 0, sizeof(cl_header));
-
     // Check if the first line follows SIP request or response format
-    if (regexec(&calls.reg_valid, (const char *) payload, 2, pmatch, 0) != 0) {
+    if (sip_parse_headers((const char *) payload, plen, &hdrs) != 0) {
         // Not a SIP message AT ALL
         return VALIDATE_NOT_SIP;
     }
 
     // Check if we have Content Length header
-    if (regexec(&calls.reg_cl, (const char *) payload, 4, pmatch, 0) != 0) {
+    if (!hdrs.cl.len) {
         // Not a SIP message or not complete
         return VALIDATE_PARTIAL_SIP;
     }
 
-    strncpy(cl_header, (const char *)payload +  pmatch[2].rm_so, (int)pmatch[2].rm_eo - pmatch[2].rm_so);
-    content_len = atoi(cl_header);
+    content_len = atoi(sip_parser_value((const char *) payload, hdrs.cl, cl_header, sizeof(cl_header)));
+    if (content_len < 0)
+        content_len = 0;
 
     // Check if we have Body separator field
-    if (regexec(&calls.reg_body, (const char *) payload, 2, pmatch, 0) != 0) {
+    if (hdrs.body < 0) {
         // Not a SIP message or not complete
         return VALIDATE_PARTIAL_SIP;
     }
 
     // Get the SIP message body length
-    bodylen = (int) pmatch[1].rm_eo - pmatch[1].rm_so;
+    bodylen = plen - hdrs.body;
+
+    // Length of the first SIP message
+    *msglen = hdrs.body + content_len;
 
     // The SDP body of the SIP message ends in another packet
     if (content_len > bodylen) {
@@ -308,7 +458,6 @@ sip_validate_packet(packet_t *packet)
 
     if (content_len < bodylen) {
         // We got more than one SIP message in the same packet
-        packet_set_payload(packet, payload, pmatch[1].rm_so + content_len);
         return VALIDATE_MULTIPLE_SIP;
     }
 
@@ -319,64 +468,483 @@ sip_validate_packet(packet_t *packet)
 sip_msg_t *
 sip_check_packet(packet_t *packet)
 {
-    sip_msg_t *msg;
-    sip_call_t *call;
-    char callid[1024], xcallid[1024];
-    address_t src, dst;
-    u_char payload[MAX_SIP_PAYLOAD];
-    bool newcall = false;
+    sip_pending_t pending;
 
-    // Max SIP payload allowed
-    if (packet->payload_len > MAX_SIP_PAYLOAD)
+    // Parse packet data
+    if (sip_prepare_packet(packet, &pending) != 0)
         return NULL;
 
-    // Get Addresses from packet
-    src = packet->src;
-    dst = packet->dst;
+    // Add message to its call
+    return sip_store_packet(&pending);
+}
+
+int
+sip_prepare_packet(packet_t *packet, sip_pending_t *pending)
+{
+    const u_char *payload;
 
-    // Initialize local variables
-    memset(callid, 0, sizeof(callid));
-    memset(xcallid, 0, sizeof(xcallid));
+    // Max SIP payload allowed
+    if (packet->payload_len == 0 || packet->payload_len > MAX_SIP_PAYLOAD)
+        return 1;
 
-    // Get payload from packet(s)
-    memset(payload, 0, MAX_SIP_PAYLOAD);
-    memcpy(payload, packet_payload(packet), packet_payloadlen(packet));
+    // Initialize pending data
+    pending->packet = packet;
+    memset(&pending->msg, 0, sizeof(sip_msg_t));
+    pending->callid[0] = '\0';
 
-    // Get the Call-ID of this message
-    if (!sip_get_callid((const char*) payload, callid))
-        return NULL;
+    // Packet payload is always NULL terminated
+    payload = packet_payload(packet);
 
-    // Create a new message from this data
-    if (!(msg = msg_create((const char*) payload)))
-        return NULL;
+    // Scan message headers
+    if (sip_parse_headers((const char*) payload, packet_payloadlen(packet), &pending->hdrs) != 0)
+        return 1;
+
+    // Get the Call-ID of this message
+    if (!sip_get_callid((const char*) payload, &pending->hdrs, pending->callid))
+        return 1;
 
     // Get Method and request for the following checks
     // There is no need to parse all payload at this point
     // If no response or request code is found, this is not a SIP message
-    if (!sip_get_msg_reqresp(msg, payload)) {
+    if (!sip_get_msg_reqresp(&pending->msg, payload, &pending->hdrs)) {
         // Deallocate message memory
-        msg_destroy(msg);
-        return NULL;
+        intern_release(pending->msg.resp_str);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check display filters of a call in the next view refresh
+ */
+static void
+sip_calls_view_touch(sip_call_t *call)
+{
+    if (call->view_changed || !call->view_node)
+        return;
+
+    call->view_changed = true;
+    vector_append(calls.view_changed, call);
+}
+
+/**
+ * @brief Flag a range of displayed positions as changed
+ */
+static void
+sip_calls_view_dirty(int first, int last)
+{
+    if (first < calls.view_first)
+        calls.view_first = first;
+    if (last > calls.view_last)
+        calls.view_last = last;
+}
+
+/**
+ * @brief Add a call to the displayed calls view
+ *
+ * @param pos Position of the call in the call list
+ */
+static void
+sip_calls_view_insert(sip_call_t *call, int pos)
+{
+    call->view_node = treap_insert(calls.view, pos, call);
+    sip_calls_view_touch(call);
+}
+
+/**
+ * @brief Remove a call from the displayed calls view
+ */
+static void
+sip_calls_view_remove(sip_call_t *call)
+{
+    if (call->view_changed) {
+        vector_remove(calls.view_changed, call);
+        call->view_changed = false;
     }
 
+    if (call->view_node) {
+        // Following displayed calls will move up
+        if (call->view_node->mark)
+            sip_calls_view_dirty(treap_marked_position(call->view_node), INT_MAX);
+        treap_remove(calls.view, call->view_node);
+        call->view_node = NULL;
+    }
+}
+
+/**
+ * @brief Create the displayed calls view from the call list
+ */
+static void
+sip_calls_view_rebuild()
+{
+    sip_call_t *call;
+    vector_iter_t it;
+
+    // Forget pending changes
+    it = vector_iterator(calls.view_changed);
+    while ((call = vector_iterator_next(&it)))
+        call->view_changed = false;
+    vector_clear(calls.view_changed);
+    treap_clear(calls.view);
+    sip_calls_view_dirty(0, INT_MAX);
+
+    // Add all calls in list order
+    it = vector_iterator(calls.list);
+    while ((call = vector_iterator_next(&it)))
+        sip_calls_view_insert(call, vector_iterator_current(&it));
+}
+
+/**
+ * @brief Wake up the interface after a list change
+ *
+ * Only one notification is sent until the interface checks the list
+ * changes again.
+ */
+static void
+sip_calls_notify()
+{
+    char c = 0;
+
+    if (calls.notify[1] < 0)
+        return;
+
+    // Pipe being full means the interface has pending notifications
+    if (write(calls.notify[1], &c, 1) < 0)
+        return;
+}
+
+/**
+ * @brief Remove a call from the expiry timer wheel
+ */
+static void
+sip_calls_expire_remove(sip_call_t *call)
+{
+    if (!call->expire)
+        return;
+
+    if (call->expire_prev) {
+        call->expire_prev->expire_next = call->expire_next;
+    } else {
+        calls.expire_wheel[call->expire & (SIP_EXPIRE_SLOTS - 1)] = call->expire_next;
+    }
+
+    if (call->expire_next)
+        call->expire_next->expire_prev = call->expire_prev;
+
+    call->expire_prev = call->expire_next = NULL;
+    call->expire = 0;
+}
+
+/**
+ * @brief Schedule the expiry of a call at the given capture time
+ */
+static void
+sip_calls_expire_insert(sip_call_t *call, time_t expire)
+{
+    sip_call_t **slot = &calls.expire_wheel[expire & (SIP_EXPIRE_SLOTS - 1)];
+
+    sip_calls_expire_remove(call);
+
+    call->expire = expire;
+    call->expire_prev = NULL;
+    call->expire_next = *slot;
+    if (*slot)
+        (*slot)->expire_prev = call;
+    *slot = call;
+}
+
+/**
+ * @brief Schedule the expiry of a call after receiving a message
+ *
+ * Timeout depends on the call being a finished call, an active call
+ * or a dialog that is not a call.
+ *
+ * @param call Call that has received a message
+ * @param now Capture time of the message
+ */
+static void
+sip_calls_expire_schedule(sip_call_t *call, time_t now)
+{
+    int timeout;
+
+    if (!call_is_invite(call)) {
+        timeout = calls.expire_dialogs;
+    } else if (call_is_active(call)) {
+        timeout = calls.expire_active;
+    } else {
+        timeout = calls.expire_finished;
+    }
+
+    if (timeout > 0) {
+        sip_calls_expire_insert(call, now + timeout);
+    } else {
+        sip_calls_expire_remove(call);
+    }
+}
+
+/**
+ * @brief Check if an active call has received RTP during its idle timeout
+ *
+ * Stream packets times are not stored, so this uses the system time
+ * of the last received packet of each stream.
+ */
+static bool
+sip_calls_expire_rtp(sip_call_t *call)
+{
+    rtp_stream_t *stream;
+    vector_iter_t it;
+    int since = (int) time(NULL) - calls.expire_active;
+
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it))) {
+        if (stream_get_count(stream) && stream->lasttm > since)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Remove a call from the compression queue
+ */
+static void
+sip_calls_compress_remove(sip_call_t *call)
+{
+    if (!call->compress_time)
+        return;
+
+    if (call->compress_prev) {
+        call->compress_prev->compress_next = call->compress_next;
+    } else if (calls.compress_first == call) {
+        calls.compress_first = call->compress_next;
+    }
+
+    if (call->compress_next) {
+        call->compress_next->compress_prev = call->compress_prev;
+    } else if (calls.compress_last == call) {
+        calls.compress_last = call->compress_prev;
+    }
+
+    call->compress_prev = call->compress_next = NULL;
+    call->compress_time = 0;
+}
+
+/**
+ * @brief Compress finished calls once their delay has passed
+ *
+ * Calls are compressed in small batches while holding the capture lock,
+ * so no other thread is accessing their messages.
+ */
+static void *
+sip_calls_compress_thread(void *data)
+{
+    sip_call_t *call;
+    time_t now;
+    int count;
+
+    while (__atomic_load_n(&calls.compress_running, __ATOMIC_ACQUIRE)) {
+        now = time(NULL);
+        capture_lock();
+        for (count = 0; count < SIP_COMPRESS_BATCH; count++) {
+            if (!(call = calls.compress_first) || call->compress_time > now)
+                break;
+            sip_calls_compress_remove(call);
+            // Calls being saved are compressed later
+            if (call->saving) {
+                sip_calls_compress_queue(call);
+            } else {
+                call_compress(call);
+            }
+        }
+        capture_unlock();
+
+        // Wait for more finished calls unless some are still pending
+        if (count < SIP_COMPRESS_BATCH)
+            usleep(SIP_COMPRESS_INTERVAL);
+    }
+
+    return NULL;
+}
+
+void
+sip_calls_compress_queue(sip_call_t *call)
+{
+    if (calls.compress <= 0 || call->compress_time || call->zblock || call->uncompressed)
+        return;
+
+    // Start compression thread with the first finished call
+    if (!calls.compress_running) {
+        calls.compress_running = true;
+        if (pthread_create(&calls.compress_thread, NULL, sip_calls_compress_thread, NULL) != 0) {
+            fprintf(stderr, "Error creating compression thread: %s\n", strerror(errno));
+            calls.compress_running = false;
+            calls.compress = 0;
+            return;
+        }
+    }
+
+    call->compress_time = time(NULL) + calls.compress;
+    call->compress_next = NULL;
+    call->compress_prev = calls.compress_last;
+    if (calls.compress_last) {
+        calls.compress_last->compress_next = call;
+    } else {
+        calls.compress_first = call;
+    }
+    calls.compress_last = call;
+}
+
+void
+sip_calls_compress_stop()
+{
+    if (calls.compress_running) {
+        __atomic_store_n(&calls.compress_running, false, __ATOMIC_RELEASE);
+        pthread_join(calls.compress_thread, NULL);
+    }
+}
+
+/**
+ * @brief Remove a call from storage
+ *
+ * Call is destroyed after removing it from all indexes.
+ */
+static void
+sip_calls_remove(sip_call_t *call)
+{
+    sip_call_t *parent;
+
+    // Export call summary before losing its data
+    cdr_export_call(call);
+    // Remove from callids hash
+    htable_remove(calls.callids, call->callid);
+    // Remove from capture order list
+    sip_calls_lru_remove(call);
+    // Remove from expiry timer wheel
+    sip_calls_expire_remove(call);
+    // Remove from compression queue
+    sip_calls_compress_remove(call);
+    // Remove from its X-Call-ID parent call
+    if (strlen(call->xcallid) && (parent = sip_find_by_callid(call->xcallid)))
+        vector_remove(parent->xcalls, call);
+    // Release call memory
+    sip_calls_release_memory(call);
+    // Remove from displayed calls view
+    sip_calls_view_remove(call);
+    // Remove call from active and call lists
+    vector_remove(calls.active, call);
+    vector_remove(calls.list, call);
+}
+
+/**
+ * @brief Remove the calls whose idle timeout has been reached
+ *
+ * Each processed second of capture time only walks the calls of its
+ * wheel slot. Calls being displayed or saved are checked again on the
+ * next second, active calls with RTP after another idle timeout.
+ *
+ * @param now Capture time of last received message
+ */
+static void
+sip_calls_expire(time_t now)
+{
+    sip_call_t *call, *next;
+    time_t sec, last;
+    bool expired = false;
+
+    // Capture time going backwards (merged or restarted captures)
+    if (now < calls.expire_time) {
+        calls.expire_time = now;
+        return;
+    }
+
+    // A whole wheel turn already walks all scheduled calls
+    last = (now - calls.expire_time > SIP_EXPIRE_SLOTS) ? calls.expire_time + SIP_EXPIRE_SLOTS : now;
+
+    for (sec = calls.expire_time + 1; sec <= last; sec++) {
+        for (call = calls.expire_wheel[sec & (SIP_EXPIRE_SLOTS - 1)]; call; call = next) {
+            next = call->expire_next;
+            // Calls scheduled for a later wheel turn
+            if (call->expire > now)
+                continue;
+            if (call->locked || call->saving) {
+                sip_calls_expire_insert(call, now + 1);
+                continue;
+            }
+            // Active calls are not stale while their streams receive packets
+            if (call_is_active(call) && sip_calls_expire_rtp(call)) {
+                sip_calls_expire_insert(call, now + calls.expire_active);
+                continue;
+            }
+            sip_calls_remove(call);
+            calls.counters.expired++;
+            expired = true;
+        }
+    }
+    calls.expire_time = now;
+
+    // Notify the interface about removed calls
+    if (expired) {
+        if (!calls.changed)
+            sip_calls_notify();
+        calls.changed = true;
+    }
+}
+
+sip_msg_t *
+sip_store_packet(sip_pending_t *pending)
+{
+    sip_msg_t *msg = &pending->msg;
+    sip_call_t *call;
+    char *callid = pending->callid;
+    const sip_headers_t *hdrs = &pending->hdrs;
+    const u_char *payload = packet_payload(pending->packet);
+    char xcallid[1024];
+    bool newcall = false;
+    size_t memory = 0;
+    time_t now = packet_time(pending->packet).tv_sec;
+
+    // Initialize local variables
+    xcallid[0] = '\0';
+
+    // Remove idle calls before looking for this message call
+    sip_calls_expire(now);
+
     // Find the call for this msg
     if (!(call = sip_find_by_callid(callid))) {
 
+        // Only store some dialogs, always the same ones for each Call-ID
+        if (!sip_check_sample(callid)) {
+            calls.counters.sampled++;
+            if (capture_overload_active(OVERLOAD_SAMPLE))
+                capture_overload_shed(OVERLOAD_SAMPLE);
+            goto skip_message;
+        }
+
         // Check if payload matches expression
-        if (!sip_check_match_expression((const char*) payload))
+        if (!sip_check_match_expression((const char*) payload, packet_payloadlen(pending->packet)))
+            goto skip_message;
+
+        // Keepalive dialogs are only accounted in their peers aggregate entry
+        if (keepalive_fold(pending))
             goto skip_message;
 
         // User requested only INVITE starting dialogs
         if (calls.only_calls && msg->reqresp != SIP_METHOD_INVITE)
             goto skip_message;
 
+        // Only INVITE starting dialogs are stored while capture is overloaded
+        if (msg->reqresp != SIP_METHOD_INVITE && capture_overload_active(OVERLOAD_DIALOGS)) {
+            capture_overload_shed(OVERLOAD_DIALOGS);
+            goto skip_message;
+        }
+
         // Only create a new call if the first msg
         // is a request message in the following gorup
         if (calls.ignore_incomplete && msg->reqresp > SIP_METHOD_MESSAGE)
             goto skip_message;
 
         // Get the Call-ID of this message
-        sip_get_xcallid((const char*) payload, xcallid);
+        sip_get_xcallid((const char*) payload, hdrs, xcallid);
 
         // Rotate call list if limit has been reached
         if (calls.limit == sip_calls_count())
@@ -392,17 +960,40 @@ sip_check_packet(packet_t *packet)
         // Set call index
         call->index = ++calls.last_index;
 
+        // Account call memory
+        call_add_memory(call, CALL_MEMORY_DIALOG, sizeof(sip_call_t));
+
         // Mark this as a new call
         newcall = true;
+        calls.counters.created++;
+    } else {
+        // Current size of call arena
+        memory = arena_size(call->arena);
     }
 
     // At this point we know we're handling an interesting SIP Packet
-    msg->packet = packet;
+    // Move parsed message data into the call arena
+    if (!(msg = msg_create(call))) {
+        msg = &pending->msg;
+        if (newcall) {
+            htable_remove(calls.callids, call->callid);
+            call_destroy(call);
+        }
+        goto skip_message;
+    }
+    msg->reqresp = pending->msg.reqresp;
+    msg->cseq = pending->msg.cseq;
+    msg->resp_str = pending->msg.resp_str;
+    pending->msg.resp_str = NULL;
+    msg->packet = pending->packet;
+    msg->fingerprint = msg_fingerprint(msg);
+    // Keep scanned headers location for later header lookups
+    msg_set_headers(msg, hdrs);
 
     // Always parse first call message
     if (call_msg_count(call) == 0) {
         // Parse SIP payload
-        sip_parse_msg_payload(msg, payload);
+        sip_parse_msg_payload(msg, payload, hdrs);
         // If this call has X-Call-Id, append it to the parent call
         if (strlen(call->xcallid)) {
             call_add_xcall(sip_find_by_callid(call->xcallid), call);
@@ -417,11 +1008,11 @@ sip_check_packet(packet_t *packet)
 
     if (call_is_invite(call)) {
         // Parse media data
-        sip_parse_msg_media(msg, payload);
+        sip_parse_msg_media(msg, payload, hdrs);
         // Update Call State
         call_update_state(call, msg);
         // Parse extra fields
-        sip_parse_extra_headers(msg, payload);
+        sip_parse_extra_headers(msg, payload, hdrs);
         // Check if this call should be in active call list
         if (call_is_active(call)) {
             if (sip_call_is_active(call)) {
@@ -437,9 +1028,22 @@ sip_check_packet(packet_t *packet)
     if (newcall) {
         // Append this call to the call list
         vector_append(calls.list, call);
+        // This is the newest call in capture order
+        sip_calls_lru_append(call);
     }
 
+    // Account call arena growth
+    call_add_memory(call, CALL_MEMORY_DIALOG, arena_size(call->arena) - memory);
+
+    // Restart call idle timeout
+    sip_calls_expire_schedule(call, now);
+
+    // Check display filters of this call again
+    sip_calls_view_touch(call);
+
     // Mark the list as changed
+    if (!calls.changed)
+        sip_calls_notify();
     calls.changed = true;
 
     // Return the loaded message
@@ -447,67 +1051,254 @@ sip_check_packet(packet_t *packet)
 
 skip_message:
     // Deallocate message memory
-    msg_destroy(msg);
+    intern_release(msg->resp_str);
     return NULL;
 
 }
 
+int
+sip_calls_notify_fd()
+{
+    return calls.notify[0];
+}
+
+bool
+sip_calls_has_changed()
+{
+    bool changed = calls.changed;
+    calls.changed = false;
+    return changed;
+}
+
+int
+sip_calls_count()
+{
+    return vector_count(calls.list);
+}
+
+vector_iter_t
+sip_calls_iterator()
+{
+    return vector_iterator(calls.list);
+}
+
+vector_iter_t
+sip_active_calls_iterator()
+{
+    return vector_iterator(calls.active);
+}
+
+bool
+sip_call_is_active(sip_call_t *call)
+{
+    return vector_index(calls.active, call) != -1;
+}
+
+vector_t *
+sip_calls_vector()
+{
+    return calls.list;
+}
+
+vector_t *
+sip_active_calls_vector()
+{
+    return calls.active;
+}
+
+void
+sip_calls_view_refresh()
+{
+    sip_call_t *call;
+    vector_iter_t it;
+
+    it = vector_iterator(calls.view_changed);
+    while ((call = vector_iterator_next(&it))) {
+        call->view_changed = false;
+        sip_calls_view_update(call);
+    }
+    vector_clear(calls.view_changed);
+}
+
+void
+sip_calls_view_update(sip_call_t *call)
+{
+    treap_node_t *node = call->view_node;
+    bool mark, marked;
+    int pos;
+
+    if (!node)
+        return;
+
+    mark = filter_pass_check_call(call);
+    marked = node->mark;
+
+    // Displayed call row has changed. If hidden now, following rows move up
+    if (marked) {
+        pos = treap_marked_position(node);
+        sip_calls_view_dirty(pos, mark ? pos : INT_MAX);
+    }
+
+    treap_set_mark(node, mark);
+
+    // New displayed call moves following rows down
+    if (mark && !marked)
+        sip_calls_view_dirty(treap_marked_position(node), INT_MAX);
+}
+
+void
+sip_calls_view_reset()
+{
+    if (calls.view)
+        treap_clear_marks(calls.view);
+    sip_calls_view_dirty(0, INT_MAX);
+}
+
+int
+sip_calls_view_count()
+{
+    return treap_marked_count(calls.view);
+}
+
+sip_call_t *
+sip_calls_view_item(int pos)
+{
+    return treap_marked_item(calls.view, pos);
+}
+
+int
+sip_calls_view_index(sip_call_t *call)
+{
+    return (call->view_node) ? treap_marked_position(call->view_node) : -1;
+}
+
 bool
-sip_calls_has_changed()
+sip_calls_view_changed(int first, int last)
 {
-    bool changed = calls.changed;
-    calls.changed = false;
+    bool changed = (calls.view_first <= last && calls.view_last >= first);
+
+    // Start tracking changes again
+    calls.view_first = INT_MAX;
+    calls.view_last = -1;
     return changed;
 }
 
-int
-sip_calls_count()
+sip_stats_t
+sip_calls_stats()
 {
-    return vector_count(calls.list);
+    sip_stats_t stats;
+
+    // Total number of calls without filtering
+    stats.total = vector_count(calls.list);
+    // Total number of calls after filtering
+    stats.displayed = sip_calls_view_count();
+    return stats;
 }
 
-vector_iter_t
-sip_calls_iterator()
+void
+sip_calls_sample_adapt(int usage)
 {
-    return vector_iterator(calls.list);
+    int sample, rate;
+    time_t last, now;
+
+    if (!calls.sample_adaptive)
+        return;
+
+    sample = __atomic_load_n(&calls.sample, __ATOMIC_RELAXED);
+    last = __atomic_load_n(&calls.sample_time, __ATOMIC_RELAXED);
+    if ((now = time(NULL)) == last)
+        return;
+
+    if (usage >= SIP_SAMPLE_HIGH && sample < SIP_SAMPLE_MAX) {
+        rate = sample * 2;
+    } else if (usage <= SIP_SAMPLE_LOW && sample > calls.sample_min) {
+        rate = sample / 2;
+        if (rate < calls.sample_min)
+            rate = calls.sample_min;
+    } else {
+        return;
+    }
+
+    // Only one parser thread changes the rate each second
+    if (__atomic_compare_exchange_n(&calls.sample_time, &last, now, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        __atomic_store_n(&calls.sample, rate, __ATOMIC_RELAXED);
 }
 
-vector_iter_t
-sip_active_calls_iterator()
+sip_counters_t
+sip_calls_counters()
 {
-    return vector_iterator(calls.active);
+    sip_counters_t counters = calls.counters;
+    counters.sample = __atomic_load_n(&calls.sample, __ATOMIC_RELAXED);
+    return counters;
 }
 
-bool
-sip_call_is_active(sip_call_t *call)
+void
+sip_calls_health(health_info_t *info)
 {
-    return vector_index(calls.active, call) != -1;
+    info->callids_size = calls.callids->size;
+    info->callids_count = htable_count(calls.callids);
+    info->callids_probe = htable_longest_probe(calls.callids);
+    info->dialogs = vector_count(calls.list);
+    info->active = vector_count(calls.active);
+    info->limit = calls.limit;
+    info->rtp_packets = calls.counters.rtp_packets;
+    info->rtp_memory = sip_calls_memory_type(CALL_MEMORY_RTP);
+    info->rotated = calls.counters.rotated;
+    info->rotated_time = calls.counters.rotated_time;
 }
 
-vector_t *
-sip_calls_vector()
+void
+sip_calls_count_msg(sip_msg_t *msg, int count)
 {
-    return calls.list;
+    calls.counters.msgs += count;
+    calls.counters.bytes += count * (int64_t) packet_payloadlen(msg->packet);
+
+    if (msg->reqresp < SIP_METHOD_COUNT) {
+        calls.counters.methods[msg->reqresp] += count;
+    } else if (msg->reqresp / 100 < SIP_RESPONSE_CLASSES) {
+        calls.counters.responses[msg->reqresp / 100] += count;
+    } else {
+        calls.counters.responses[SIP_RESPONSE_CLASSES - 1] += count;
+    }
 }
 
-vector_t *
-sip_active_calls_vector()
+void
+sip_calls_count_state(int prev, int state)
 {
-    return calls.active;
+    if (prev)
+        calls.counters.states[prev]--;
+    if (state)
+        calls.counters.states[state]++;
 }
 
-sip_stats_t
-sip_calls_stats()
+void
+sip_calls_count_rtp(int64_t streams, int64_t packets, int64_t bytes)
 {
-    sip_stats_t stats;
-    vector_iter_t it = vector_iterator(calls.list);
+    calls.counters.streams += streams;
+    calls.counters.rtp_packets += packets;
+    calls.counters.bytes += bytes;
+}
 
-    // Total number of calls without filtering
-    stats.total = vector_iterator_count(&it);
-    // Total number of calls after filtering
-    vector_iterator_set_filter(&it, filter_check_call);
-    stats.displayed = vector_iterator_count(&it);
-    return stats;
+void
+sip_calls_uncount_call(sip_call_t *call)
+{
+    vector_iter_t it;
+    sip_msg_t *msg;
+    rtp_stream_t *stream;
+
+    // Remove call messages
+    it = vector_iterator(call->msgs);
+    while ((msg = vector_iterator_next(&it)))
+        sip_calls_count_msg(msg, -1);
+
+    // Remove call streams and their packets
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it)))
+        sip_calls_count_rtp(-1, -(int64_t) stream->pktcnt, -(int64_t) stream->bytes);
+
+    // Remove call from its state counter
+    sip_calls_count_state(call->state, 0);
 }
 
 sip_call_t *
@@ -523,49 +1314,45 @@ sip_find_by_callid(const char *callid)
 }
 
 int
-sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload)
+sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs)
 {
-    regmatch_t pmatch[3];
     char resp_str[SIP_ATTR_MAXLEN];
     char reqresp[SIP_ATTR_MAXLEN];
     char cseq[11];
     const char *resp_def;
 
     // Initialize variables
-    memset(pmatch, 0, sizeof(pmatch));
     memset(resp_str, 0, sizeof(resp_str));
     memset(reqresp, 0, sizeof(reqresp));
 
     // If not already parsed
     if (!msg->reqresp) {
 
-        // Method & CSeq
-        if (regexec(&calls.reg_method, (const char *)payload, 2, pmatch, 0) == 0) {
-            if ((int)(pmatch[1].rm_eo - pmatch[1].rm_so) >= SIP_ATTR_MAXLEN) {
+        // Method
+        if (hdrs->method.len) {
+            if (hdrs->method.len >= SIP_ATTR_MAXLEN) {
                 strncpy(reqresp, "<malformed>", 11);
             } else {
-                sprintf(reqresp, "%.*s", (int) (pmatch[1].rm_eo - pmatch[1].rm_so), payload + pmatch[1].rm_so);
+                sip_parser_value((const char *) payload, hdrs->method, reqresp, sizeof(reqresp));
             }
         }
 
         // CSeq
-        if (regexec(&calls.reg_cseq, (char*)payload, 2, pmatch, 0) == 0) {
-            sprintf(cseq, "%.*s", (int)(pmatch[1].rm_eo - pmatch[1].rm_so), payload + pmatch[1].rm_so);
-            msg->cseq = atoi(cseq);
+        if (hdrs->cseq.len) {
+            msg->cseq = atoi(sip_parser_value((const char *) payload, hdrs->cseq, cseq, sizeof(cseq)));
         }
 
-
         // Response code
-        if (regexec(&calls.reg_response, (const char *)payload, 3, pmatch, 0) == 0) {
-            if ((int)(pmatch[1].rm_eo - pmatch[1].rm_so) >= SIP_ATTR_MAXLEN) {
+        if (hdrs->response.len) {
+            if (hdrs->response.len >= SIP_ATTR_MAXLEN) {
                 strncpy(resp_str, "<malformed>", 11);
             } else {
-                sprintf(resp_str, "%.*s", (int) (pmatch[1].rm_eo - pmatch[1].rm_so), payload + pmatch[1].rm_so);
+                sip_parser_value((const char *) payload, hdrs->response, resp_str, sizeof(resp_str));
             }
-            if ((int)(pmatch[2].rm_eo - pmatch[2].rm_so) >= SIP_ATTR_MAXLEN) {
+            if (hdrs->code.len >= SIP_ATTR_MAXLEN) {
                 strncpy(resp_str, "<malformed>", 11);
             } else {
-                sprintf(reqresp, "%.*s", (int) (pmatch[2].rm_eo - pmatch[2].rm_so), payload + pmatch[2].rm_so);
+                sip_parser_value((const char *) payload, hdrs->code, reqresp, sizeof(reqresp));
             }
         }
 
@@ -576,7 +1363,7 @@ sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload)
         if (!msg_is_request(msg)) {
             resp_def = sip_method_str(msg->reqresp);
             if (!resp_def || strcmp(resp_def, resp_str)) {
-                msg->resp_str = strdup(resp_str);
+                msg->resp_str = intern_string(resp_str);
             }
         }
     }
@@ -598,62 +1385,116 @@ sip_get_msg_reqresp_str(sip_msg_t *msg)
 sip_msg_t *
 sip_parse_msg(sip_msg_t *msg)
 {
+    sip_headers_t hdrs;
+    const char *payload;
+
     if (msg && !msg->cseq) {
-        sip_parse_msg_payload(msg, (u_char*) msg_get_payload(msg));
+        payload = msg_get_payload(msg);
+        sip_parse_headers(payload, packet_payloadlen(msg->packet), &hdrs);
+        sip_parse_msg_payload(msg, (const u_char *) payload, &hdrs);
     }
     return msg;
 }
 
 int
-sip_parse_msg_payload(sip_msg_t *msg, const u_char *payload)
+sip_parse_msg_payload(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs)
 {
-    regmatch_t pmatch[4];
+    char value[1024];
 
-    // From
-    if (regexec(&calls.reg_from, (const char *)payload, 4, pmatch, 0) == 0) {
-        msg->sip_from = sng_malloc((int)pmatch[2].rm_eo - pmatch[2].rm_so + 1);
-        strncpy(msg->sip_from, (const char *)payload +  pmatch[2].rm_so, (int)pmatch[2].rm_eo - pmatch[2].rm_so);
+    // From (repeated From values share the same interned string)
+    if (hdrs->from.len) {
+        msg->sip_from = intern_string(sip_parser_value((const char *) payload, hdrs->from, value, sizeof(value)));
     } else {
         // Malformed From Header
-        msg->sip_from = sng_malloc(12);
-        strncpy(msg->sip_from, "<malformed>", 11);
+        msg->sip_from = intern_string("<malformed>");
     }
 
     // To
-    if (regexec(&calls.reg_to, (const char *)payload, 4, pmatch, 0) == 0) {
-        msg->sip_to = sng_malloc((int)pmatch[2].rm_eo - pmatch[2].rm_so + 1);
-        strncpy(msg->sip_to, (const char *)payload +  pmatch[2].rm_so, (int)pmatch[2].rm_eo - pmatch[2].rm_so);
+    if (hdrs->to.len) {
+        msg->sip_to = intern_string(sip_parser_value((const char *) payload, hdrs->to, value, sizeof(value)));
     } else {
         // Malformed To Header
-        msg->sip_to = sng_malloc(12);
-        strncpy(msg->sip_to, "<malformed>", 11);
+        msg->sip_to = intern_string("<malformed>");
     }
 
     return 0;
 }
 
+/**
+ * @brief Copy next space separated token of a SDP line
+ *
+ * @param line Current position in the line
+ * @param end End of the line
+ * @param token Buffer to store the token (truncated to its size)
+ * @param size Size of the token buffer
+ * @return position after the token, NULL if there is no token
+ */
+static const char *
+sip_sdp_token(const char *line, const char *end, char *token, size_t size)
+{
+    size_t len = 0;
+
+    while (line < end && *line == ' ')
+        line++;
+    if (line == end)
+        return NULL;
+
+    while (line < end && *line != ' ') {
+        if (len + 1 < size)
+            token[len++] = *line;
+        line++;
+    }
+    token[len] = '\0';
+    return line;
+}
+
+/**
+ * @brief Parse next number of a SDP line
+ *
+ * @param line Current position in the line
+ * @param end End of the line
+ * @param value Parsed number
+ * @return position after the number, NULL if there is no number
+ */
+static const char *
+sip_sdp_number(const char *line, const char *end, uint32_t *value)
+{
+    const char *start;
+
+    while (line < end && *line == ' ')
+        line++;
+
+    for (start = line, *value = 0; line < end && isdigit((unsigned char) *line); line++)
+        *value = *value * 10 + (*line - '0');
+
+    return (line == start) ? NULL : line;
+}
+
 void
-sip_parse_msg_media(sip_msg_t *msg, const u_char *payload)
+sip_parse_msg_media(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs)
 {
 
+// Discarded streams memory is released with the call arena
 #define ADD_STREAM(stream) \
     if (stream) { \
         if (!rtp_find_call_stream(call, src, stream->dst)) { \
           call_add_stream(call, stream); \
       } else { \
-          sng_free(stream); \
           stream = NULL; \
       } \
     }
 
-    address_t dst, src = { };
+    address_t dst = { }, src = { }, session = { };
+    char dst_ip[ADDRESSLEN];
     rtp_stream_t *rtp_stream = NULL, *rtcp_stream = NULL, *msg_rtp_stream = NULL;
     char media_type[MEDIATYPELEN] = { };
     char media_format[30] = { };
+    char proto[16];
+    uint32_t media_port;
     uint32_t media_fmt_pref;
     uint32_t media_fmt_code;
     sdp_media_t *media = NULL;
-    char *payload2, *tofree, *line;
+    const char *line, *eol, *next, *end;
     sip_call_t *call = msg_get_call(msg);
 
     // If message is retrans, there's no need to parse the payload again
@@ -663,19 +1504,48 @@ sip_parse_msg_media(sip_msg_t *msg, const u_char *payload)
         return;
     }
 
-    // Parse each line of payload looking for sdp information
-    tofree = payload2 = strdup((char*)payload);
-    while ((line = strsep(&payload2, "\r\n")) != NULL) {
-        // Check if we have a media string
-        if (!strncmp(line, "m=", 2)) {
-            if (sscanf(line, "m=%s %hu RTP/%*s %u", media_type, &dst.port, &media_fmt_pref) == 3
-            ||  sscanf(line, "m=%s %hu UDP/%*s %u", media_type, &dst.port, &media_fmt_pref) == 3) {
+    // SDP information is only in message body
+    if (hdrs->body < 0)
+        return;
+
+    // Skip media parsing while capture is overloaded
+    if (capture_overload_active(OVERLOAD_SDP)) {
+        capture_overload_shed(OVERLOAD_SDP);
+        return;
+    }
+
+    // Parse each line of the body in place looking for sdp information
+    end = (const char *) payload + packet_payloadlen(msg->packet);
+    for (line = (const char *) payload + hdrs->body; line < end; line = next) {
+        // Get line boundaries, allowing any line terminator
+        for (eol = line; eol < end && *eol != '\r' && *eol != '\n'; eol++);
+        for (next = eol; next < end && (*next == '\r' || *next == '\n'); next++);
+
+        if (eol - line < 2 || line[1] != '=')
+            continue;
+
+        switch (line[0]) {
+            case 'm':
+                // m=<media> <port>[/<count>] <proto> <fmt> ...
+                if (!(line = sip_sdp_token(line + 2, eol, media_type, sizeof(media_type)))
+                    || !(line = sip_sdp_number(line, eol, &media_port)) || media_port > UINT16_MAX)
+                    break;
+                if (*line == '/' && !(line = sip_sdp_number(line + 1, eol, &media_fmt_code)))
+                    break;
+                if (!(line = sip_sdp_token(line, eol, proto, sizeof(proto)))
+                    || (strncmp(proto, "RTP/", 4) && strncmp(proto, "UDP/", 4))
+                    || !sip_sdp_number(line, eol, &media_fmt_pref))
+                    break;
 
                 // Add streams from previous 'm=' line to the call
                 ADD_STREAM(msg_rtp_stream);
                 ADD_STREAM(rtp_stream);
                 ADD_STREAM(rtcp_stream);
 
+                // Media address is the session one unless its own is set
+                dst = session;
+                dst.port = media_port;
+
                 // Create a new media structure for this message
                 if ((media = media_create(msg))) {
                     media_set_type(media, media_type);
@@ -702,31 +1572,45 @@ sip_parse_msg_media(sip_msg_t *msg, const u_char *payload)
                     rtcp_stream = stream_create(media, dst, PACKET_RTCP);
                     rtcp_stream->dst.port++;
                 }
-            }
-        }
-
-        // Check if we have a connection string
-        if (!strncmp(line, "c=", 2)) {
-            if (sscanf(line, "c=IN IP4 %s", dst.ip) && media) {
-                media_set_address(media, dst);
-                strcpy(rtp_stream->dst.ip, dst.ip);
-                strcpy(rtcp_stream->dst.ip, dst.ip);
-            }
-        }
-
-        // Check if we have attribute format string
-        if (!strncmp(line, "a=rtpmap:", 9)) {
-            if (media && sscanf(line, "a=rtpmap:%u %[^ ]", &media_fmt_code, media_format)) {
-                media_add_format(media, media_fmt_code, media_format);
-            }
-        }
+                break;
+            case 'c':
+                // c=IN IP4 <address>[/<ttl>]
+                if (eol - line < 9 || strncmp(line + 2, "IN IP", 5) || (line[7] != '4' && line[7] != '6'))
+                    break;
+                if (!sip_sdp_token(line + 8, eol, dst_ip, sizeof(dst_ip)))
+                    break;
+                dst_ip[strcspn(dst_ip, "/")] = '\0';
+                if (address_set_ip_str(&dst, dst_ip) != 0)
+                    break;
+
+                if (media) {
+                    // Media level connection
+                    media_set_address(media, dst);
+                    if (rtp_stream)
+                        address_set_ip(&rtp_stream->dst, dst.family, dst.ip.bytes);
+                    if (rtcp_stream)
+                        address_set_ip(&rtcp_stream->dst, dst.family, dst.ip.bytes);
+                } else {
+                    // Session level connection, used by all medias
+                    session = dst;
+                }
+                break;
+            case 'a':
+                // a=rtpmap:<code> <encoding>/<rate>[/<params>]
+                if (eol - line > 9 && !strncmp(line, "a=rtpmap:", 9)) {
+                    if (media && (line = sip_sdp_number(line + 9, eol, &media_fmt_code))
+                        && sip_sdp_token(line, eol, media_format, sizeof(media_format))) {
+                        media_add_format(media, media_fmt_code, media_format);
+                    }
+                }
 
-        // Check if we have attribute format RTCP port
-        if (!strncmp(line, "a=rtcp:", 7) && rtcp_stream) {
-            sscanf(line, "a=rtcp:%hu", &rtcp_stream->dst.port);
+                // a=rtcp:<port> [<address>]
+                if (eol - line > 7 && !strncmp(line, "a=rtcp:", 7) && rtcp_stream) {
+                    if (sip_sdp_number(line + 7, eol, &media_port) && media_port <= UINT16_MAX)
+                        rtcp_stream->dst.port = media_port;
+                }
+                break;
         }
-
-
     }
 
     // Add streams from last 'm=' line to the call
@@ -734,52 +1618,74 @@ sip_parse_msg_media(sip_msg_t *msg, const u_char *payload)
     ADD_STREAM(rtp_stream);
     ADD_STREAM(rtcp_stream);
 
-    sng_free(tofree);
-
 #undef ADD_STREAM
 }
 
 void
-sip_parse_extra_headers(sip_msg_t *msg, const u_char *payload)
+sip_parse_extra_headers(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs)
 {
-    regmatch_t pmatch[4];
     char warning[10];
 
-     // Reason text
-     if (regexec(&calls.reg_reason, (const char *)payload, 2, pmatch, 0) == 0) {
-         msg->call->reasontxt = sng_malloc((int)pmatch[1].rm_eo - pmatch[1].rm_so + 1);
-         strncpy(msg->call->reasontxt, (const char *)payload +  pmatch[1].rm_so, (int)pmatch[1].rm_eo - pmatch[1].rm_so);
-     }
+    // Reason text
+    if (hdrs->reason.len && (msg->call->reasontxt = arena_alloc(msg->call->arena, hdrs->reason.len + 1))) {
+        sip_parser_value((const char *) payload, hdrs->reason, msg->call->reasontxt, hdrs->reason.len + 1);
+    }
 
-     // Warning code
-     if (regexec(&calls.reg_warning, (const char *)payload, 2, pmatch, 0) == 0) {
-         strncpy(warning, (const char *)payload +  pmatch[1].rm_so, (int)pmatch[1].rm_eo - pmatch[1].rm_so);
-         msg->call->warning = atoi(warning);
-     }
+    // Warning code
+    if (hdrs->warning.len) {
+        msg->call->warning = atoi(sip_parser_value((const char *) payload, hdrs->warning, warning, sizeof(warning)));
+    }
 }
 
 void
 sip_calls_clear()
 {
-    // Create again the callid hash table
-    htable_destroy(calls.callids);
-    calls.callids = htable_create(calls.limit);
+    // Empty the callid hash table
+    htable_clear(calls.callids);
+
+    // Empty capture order list
+    calls.lru_first = calls.lru_last = NULL;
+    calls.memory = 0;
+    memset(calls.memory_types, 0, sizeof(calls.memory_types));
+
+    // Empty expiry timer wheel
+    memset(calls.expire_wheel, 0, sizeof(calls.expire_wheel));
+    calls.expire_time = 0;
+
+    // Empty compression queue
+    calls.compress_first = calls.compress_last = NULL;
+
+    // Empty displayed calls view
+    treap_clear(calls.view);
+    vector_clear(calls.view_changed);
+    sip_calls_view_dirty(0, INT_MAX);
 
     // Remove all items from vector
     vector_clear(calls.list);
     vector_clear(calls.active);
+
+    // Remove keepalive aggregate entries
+    keepalive_clear();
 }
 
 void
 sip_calls_clear_soft()
 {
-        // Create again the callid hash table
-        htable_destroy(calls.callids);
-        calls.callids = htable_create(calls.limit);
+        vector_t *list;
+
+        // Empty the callid hash table
+        htable_clear(calls.callids);
 
         // Repopulate list applying current filter
-        calls.list = vector_copy_if(sip_calls_vector(), filter_check_call);
-        calls.active = vector_copy_if(sip_active_calls_vector(), filter_check_call);
+        list = vector_copy_if(sip_calls_vector(), filter_check_call);
+        vector_set_destroyer(list, call_destroyer);
+        vector_set_sorter(list, sip_list_sorter);
+        vector_set_destroyer(calls.list, NULL);
+        vector_destroy(calls.list);
+        calls.list = list;
+        list = vector_copy_if(sip_active_calls_vector(), filter_check_call);
+        vector_destroy(calls.active);
+        calls.active = list;
 
         // Repopulate callids based on filtered list
         sip_call_t *call;
@@ -789,34 +1695,200 @@ sip_calls_clear_soft()
         {
                 htable_insert(calls.callids, call->callid, call);
         }
+
+        // Remove filtered calls from capture order list
+        sip_call_t *next;
+        for (call = calls.lru_first; call; call = next) {
+                next = call->lru_next;
+                if (htable_find(calls.callids, call->callid) != call) {
+                        sip_calls_lru_remove(call);
+                        sip_calls_expire_remove(call);
+                        sip_calls_compress_remove(call);
+                        sip_calls_release_memory(call);
+                        sip_calls_uncount_call(call);
+                }
+        }
+
+        // Create the view of the new list
+        sip_calls_view_rebuild();
 }
 
-void
+int
 sip_calls_rotate()
 {
     sip_call_t *call;
-    vector_iter_t it = vector_iterator(calls.list);
-    while ((call = vector_iterator_next(&it))) {
-        if (!call->locked) {
-            // Remove from callids hash
-            htable_remove(calls.callids, call->callid);
-            // Remove first call from active and call lists
-            vector_remove(calls.active, call);
-            vector_remove(calls.list, call);
-            return;
+
+    // Oldest calls are at the start of the capture order list
+    for (call = calls.lru_first; call; call = call->lru_next) {
+        if (!call->locked && !call->saving) {
+            // Keep call list attributes of the rotated call
+            history_add_call(call);
+            sip_calls_remove(call);
+            calls.counters.rotated++;
+            calls.counters.rotated_time = time(NULL);
+            return 0;
         }
     }
+    return 1;
+}
+
+void
+sip_calls_add_memory(enum call_memory_type type, int64_t bytes)
+{
+    // Filter threads may restore compressed calls
+    __atomic_add_fetch(&calls.memory, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&calls.memory_types[type], bytes, __ATOMIC_RELAXED);
+}
+
+void
+sip_calls_release_memory(sip_call_t *call)
+{
+    int i;
+
+    calls.memory -= call->memory;
+    for (i = 0; i < CALL_MEMORY_COUNT; i++)
+        calls.memory_types[i] -= call->memory_types[i];
+}
+
+size_t
+sip_calls_memory()
+{
+    // Shared strings and keepalive entries are not accounted in any call memory
+    return calls.memory + intern_memory() + keepalive_memory();
+}
+
+size_t
+sip_calls_memory_type(enum call_memory_type type)
+{
+    return calls.memory_types[type];
+}
+
+int
+sip_calls_memory_top(sip_call_t **top, int count)
+{
+    sip_call_t *call;
+    int found = 0, i;
+
+    // Keep the biggest calls sorted while walking stored calls
+    for (call = calls.lru_first; call && count > 0; call = call->lru_next) {
+        if (found == count && call->memory <= top[found - 1]->memory)
+            continue;
+        i = (found < count) ? found++ : found - 1;
+        for (; i > 0 && top[i - 1]->memory < call->memory; i--)
+            top[i] = top[i - 1];
+        top[i] = call;
+    }
+
+    return found;
+}
+
+bool
+sip_calls_memory_exceeded()
+{
+    return calls.memlimit && sip_calls_memory() > calls.memlimit;
+}
+
+void
+sip_calls_check_memory(bool rotate)
+{
+    sip_call_t *call;
+
+    if (!sip_calls_memory_exceeded())
+        return;
+
+    // Remove RTP packets starting with the oldest calls
+    for (call = calls.lru_first; call && sip_calls_memory_exceeded(); call = call->lru_next) {
+        if (!call->saving)
+            call_free_rtp_packets(call);
+    }
+
+    // Remove oldest calls, keeping at least the newest one
+    while (rotate && sip_calls_memory_exceeded() && sip_calls_count() > 1) {
+        if (sip_calls_rotate() != 0)
+            break;
+    }
+}
+
+void
+sip_calls_lru_append(sip_call_t *call)
+{
+    call->lru_next = NULL;
+    call->lru_prev = calls.lru_last;
+    if (calls.lru_last) {
+        calls.lru_last->lru_next = call;
+    } else {
+        calls.lru_first = call;
+    }
+    calls.lru_last = call;
+}
+
+void
+sip_calls_lru_remove(sip_call_t *call)
+{
+    if (call->lru_prev) {
+        call->lru_prev->lru_next = call->lru_next;
+    } else if (calls.lru_first == call) {
+        calls.lru_first = call->lru_next;
+    }
+
+    if (call->lru_next) {
+        call->lru_next->lru_prev = call->lru_prev;
+    } else if (calls.lru_last == call) {
+        calls.lru_last = call->lru_prev;
+    }
+
+    call->lru_prev = call->lru_next = NULL;
 }
 
 int
 sip_set_match_expression(const char *expr, int insensitive, int invert)
 {
+    char literal[256];
+
     // Store expression text
     calls.match_expr = expr;
     // Set invert flag
     calls.match_invert = invert;
 
-#ifdef WITH_PCRE
+    // Discard payloads without the expression required literal before using regexp
+    // Inline options like (?i) may change how literals are compared
+    if (!strstr(expr, "(?")) {
+        calls.match_literal_only = strmatch_regex_literal(expr, literal, sizeof(literal));
+        if (strlen(literal) && (calls.match_literal = strmatch_create(insensitive))) {
+            if (strmatch_add(calls.match_literal, literal) || strmatch_compile(calls.match_literal)) {
+                strmatch_destroy(calls.match_literal);
+                calls.match_literal = NULL;
+                calls.match_literal_only = false;
+            }
+        } else {
+            calls.match_literal_only = false;
+        }
+    }
+
+#if defined(WITH_PCRE2)
+    int re_err;
+    PCRE2_SIZE err_offset;
+    uint32_t pflags = PCRE2_UNGREEDY;
+
+    if (insensitive)
+        pflags |= PCRE2_CASELESS;
+
+    // Check if we have a valid expression
+    if (!(calls.match_regex = pcre2_compile((PCRE2_SPTR) expr, PCRE2_ZERO_TERMINATED, pflags,
+                                            &re_err, &err_offset, NULL)))
+        return 1;
+
+    // JIT is optional, interpreted matching is used if not available
+    pcre2_jit_compile(calls.match_regex, PCRE2_JIT_COMPLETE);
+
+    // Allocate match results once for all checked payloads
+    if (!(calls.match_data = pcre2_match_data_create_from_pattern(calls.match_regex, NULL))) {
+        pcre2_code_free(calls.match_regex);
+        calls.match_regex = NULL;
+        return 1;
+    }
+    return 0;
+#elif defined(WITH_PCRE)
     const char *re_err = NULL;
     int32_t err_offset;
     int32_t pflags = PCRE_UNGREEDY;
@@ -846,25 +1918,73 @@ sip_get_match_expression()
 }
 
 int
-sip_check_match_expression(const char *payload)
+sip_set_match_patterns(vector_t *patterns, int insensitive)
 {
-    // Everything matches when there is no match
-    if (!calls.match_expr)
+    vector_iter_t it = vector_iterator(patterns);
+    const char *pattern;
+
+    if (!(calls.match_patterns = strmatch_create(insensitive)))
         return 1;
 
-#ifdef WITH_PCRE
-    switch (pcre_exec(calls.match_regex, 0, payload, strlen(payload), 0, 0, 0, 0)) {
-        case PCRE_ERROR_NOMATCH:
-            return 1 == calls.match_invert;
+    while ((pattern = vector_iterator_next(&it))) {
+        if (strmatch_add(calls.match_patterns, pattern))
+            return 1;
     }
 
-    return 0 == calls.match_invert;
+    return strmatch_compile(calls.match_patterns);
+}
+
+/**
+ * @brief Check if payload matches the compiled match expression
+ */
+static int
+sip_check_match_regex(const char *payload, size_t len)
+{
+#if defined(WITH_PCRE2)
+    return pcre2_match(calls.match_regex, (PCRE2_SPTR) payload, len, 0, 0, calls.match_data, NULL) >= 0;
+#elif defined(WITH_PCRE)
+    return pcre_exec(calls.match_regex, 0, payload, len, 0, 0, 0, 0) != PCRE_ERROR_NOMATCH;
 #else
-    // Check if payload matches the given expresion
-    return (regexec(&calls.match_regex, payload, 0, NULL, 0) == calls.match_invert);
+    return regexec(&calls.match_regex, payload, 0, NULL, 0) == 0;
 #endif
 }
 
+int
+sip_check_match_expression(const char *payload, size_t len)
+{
+    int matched = 1;
+
+    // Everything matches when there is no match
+    if (!calls.match_expr && !calls.match_patterns)
+        return 1;
+
+    // Payload must contain any of the literal patterns
+    if (calls.match_patterns)
+        matched = strmatch_find(calls.match_patterns, payload, len);
+
+    if (matched && calls.match_expr) {
+        // Payload can not match without containing expression literal
+        if (calls.match_literal)
+            matched = strmatch_find(calls.match_literal, payload, len);
+        if (matched && !calls.match_literal_only)
+            matched = sip_check_match_regex(payload, len);
+    }
+
+    return matched != (calls.match_invert != 0);
+}
+
+int
+sip_check_sample(const char *callid)
+{
+    int sample = __atomic_load_n(&calls.sample, __ATOMIC_RELAXED);
+
+    // Overload sample level can only store fewer dialogs
+    if (capture_overload_sample() > sample)
+        sample = capture_overload_sample();
+
+    return sample <= 1 || htable_hash(callid) % sample == 0;
+}
+
 const char *
 sip_method_str(int method)
 {
@@ -931,6 +2051,7 @@ sip_set_sort_options(sip_sort_t sort)
 {
     calls.sort = sort;
     sip_sort_list();
+    history_view_reset();
 }
 
 sip_sort_t
@@ -939,44 +2060,100 @@ sip_sort_options()
     return calls.sort;
 }
 
+/**
+ * @brief Calculate the sort key of a call for current sort attribute
+ */
+static void
+sip_sort_key_update(sip_call_t *call)
+{
+    const char *value;
+
+    sng_free(call->sort_str);
+    call->sort_str = NULL;
+
+    if (sip_attr_is_numeric(calls.sort.by)) {
+        call->sort_num = call_attr_number(call, calls.sort.by);
+    } else if ((value = call_attr_text(call, calls.sort.by))) {
+        call->sort_str = strdup(value);
+    }
+}
+
+/**
+ * @brief Compare two calls using their sort keys
+ *
+ * Calls with the same sort value keep their creation order.
+ */
+static int
+sip_sort_compare(const void *a, const void *b)
+{
+    const sip_call_t *one = a, *two = b;
+    int cmp;
+
+    if (sip_attr_is_numeric(calls.sort.by)) {
+        cmp = (one->sort_num > two->sort_num) - (one->sort_num < two->sort_num);
+    } else if (!one->sort_str || !two->sort_str) {
+        // Empty values are sorted first
+        cmp = (one->sort_str != NULL) - (two->sort_str != NULL);
+    } else {
+        cmp = strcmp(one->sort_str, two->sort_str);
+    }
+
+    if (!calls.sort.asc)
+        cmp = -cmp;
+
+    if (cmp == 0)
+        cmp = (one->index > two->index) - (one->index < two->index);
+
+    return cmp;
+}
+
+/**
+ * @brief Compare two call list elements
+ */
+static int
+sip_sort_list_compare(const void *a, const void *b)
+{
+    return sip_sort_compare(*(sip_call_t * const *) a, *(sip_call_t * const *) b);
+}
+
+/**
+ * @brief Calculate sort keys of a chunk of the call list
+ */
+static void
+sip_sort_key_update_range(void *data, int start, int end)
+{
+    sip_call_t **list = data;
+    int i;
+
+    for (i = start; i < end; i++)
+        sip_sort_key_update(list[i]);
+}
+
 void
 sip_sort_list()
 {
-    // Cloning the vector automatically sorts it
-    vector_t *clone = vector_clone(calls.list);
+    void **list = vector_list(calls.list);
+    int count = vector_count(calls.list);
 
-    // FIXME FIXME FIXME
-    // There should be a way to destroy the vector without calling the
-    // vector destroyer for each item...
-    vector_set_destroyer(calls.list, NULL);
-    vector_destroy(calls.list);
+    // Calculate sort keys for current sort options
+    parallel_for(count, SIP_SORT_CHUNK, sip_sort_key_update_range, list);
 
-    // The new sorted list
-    calls.list = clone;
+    // Sort the list and create its view again
+    parallel_sort(list, count, sip_sort_list_compare);
+    sip_calls_view_rebuild();
 }
 
 void
 sip_list_sorter(vector_t *vector, void *item)
 {
-    sip_call_t *prev, *cur = (sip_call_t *)item;
-    int count = vector_count(vector);
-    int i;
-
-    // First item is alway sorted
-    if (vector_count(vector) == 1)
-        return;
+    sip_call_t *call = (sip_call_t *) item;
+    int pos;
 
-    for (i = count - 2 ; i >= 0; i--) {
-        // Get previous item
-        prev = vector_item(vector, i);
-        // Check if the item is already in a sorted position
-        int cmp = call_attr_compare(cur, prev, calls.sort.by);
-        if ((calls.sort.asc && cmp > 0) || (!calls.sort.asc && cmp < 0)) {
-            vector_insert(vector, item, i + 1);
-            return;
-        }
-    }
+    // Find the call position using the view, that has the list order
+    sip_sort_key_update(call);
+    pos = treap_bound(calls.view, call, sip_sort_compare);
 
-    // Put this item at the begining of the vector
-    vector_insert(vector, item, 0);
+    // Move the appended call to its sorted position
+    vector_insert(vector, item, pos);
+    sip_calls_view_insert(call, pos);
 }
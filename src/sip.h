@@ -35,12 +35,21 @@
 #include "config.h"
 #include <stdbool.h>
 #include <regex.h>
-#ifdef WITH_PCRE
+#include <pthread.h>
+#if defined(WITH_PCRE2)
+#ifndef PCRE2_CODE_UNIT_WIDTH
+#define PCRE2_CODE_UNIT_WIDTH 8
+#endif
+#include <pcre2.h>
+#elif defined(WITH_PCRE)
 #include <pcre.h>
 #endif
 #include "sip_call.h"
+#include "sip_parser.h"
 #include "vector.h"
 #include "hash.h"
+#include "health.h"
+#include "strmatch.h"
 
 #define MAX_SIP_PAYLOAD 10240
 
@@ -50,8 +59,12 @@ typedef struct sip_call_list sip_call_list_t;
 typedef struct sip_code sip_code_t;
 //! Shorter declaration of sip stats
 typedef struct sip_stats sip_stats_t;
+//! Shorter declaration of sip counters
+typedef struct sip_counters sip_counters_t;
 //! Shorter declaration of sip sort
 typedef struct sip_sort sip_sort_t;
+//! Shorter declaration of sip pending message
+typedef struct sip_pending sip_pending_t;
 
 //! SIP Methods
 enum sip_methods {
@@ -69,8 +82,29 @@ enum sip_methods {
     SIP_METHOD_BYE,
     SIP_METHOD_ACK,
     SIP_METHOD_PRACK,
+    //! Number of request methods (including unknown method 0)
+    SIP_METHOD_COUNT
 };
 
+//! Number of response classes counted (1XX to 8XX, more are stored in last)
+#define SIP_RESPONSE_CLASSES 9
+//! Max number of dialogs per stored dialog when sampling
+#define SIP_SAMPLE_MAX 1024
+//! Parser queue usage (%) that raises or lowers adaptive sampling rate
+#define SIP_SAMPLE_HIGH 75
+#define SIP_SAMPLE_LOW 10
+
+//! Size of call state counters (SIP_CALLSTATE_COMPLETED + 1)
+#define SIP_CALLSTATE_COUNT 8
+//! Number of slots of the idle calls expiry timer wheel (must be power of 2)
+#define SIP_EXPIRE_SLOTS 1024
+//! Max finished calls compressed each time the capture lock is taken
+#define SIP_COMPRESS_BATCH 64
+//! Wait between checks of the finished calls compression queue (us)
+#define SIP_COMPRESS_INTERVAL 100000
+//! Number of calls whose sort key is calculated by a thread at once
+#define SIP_SORT_CHUNK 1024
+
 //! Return values for sip_validate_packet
 enum validate_result {
     VALIDATE_NOT_SIP        = -1,
@@ -99,6 +133,43 @@ struct sip_stats
     int displayed;
 };
 
+/**
+ * @brief Counters of stored dialogs data
+ *
+ * These counters are updated while messages and packets are added to the
+ * calls and when calls are removed, so they always match the stored data
+ * without walking the call list.
+ */
+struct sip_counters
+{
+    //! Stored calls in each state (dialogs that are not calls are not counted)
+    int states[SIP_CALLSTATE_COUNT];
+    //! Stored messages
+    uint64_t msgs;
+    //! Stored requests of each method
+    uint64_t methods[SIP_METHOD_COUNT];
+    //! Stored responses of each class (index is code / 100)
+    uint64_t responses[SIP_RESPONSE_CLASSES];
+    //! Streams of stored dialogs
+    uint64_t streams;
+    //! RTP packets of stored dialogs streams
+    uint64_t rtp_packets;
+    //! Payload bytes of stored messages and RTP packets
+    uint64_t bytes;
+    //! Dialogs created since capture started (never decreased)
+    uint64_t created;
+    //! Dialogs removed after their idle timeout (never decreased)
+    uint64_t expired;
+    //! Messages of dialogs not stored because of sampling (never decreased)
+    uint64_t sampled;
+    //! Dialogs removed to make room for new ones (never decreased)
+    uint64_t rotated;
+    //! Wall clock time of the last rotation (0 if none)
+    time_t rotated_time;
+    //! Current sampling rate (1 of each N dialogs is stored)
+    int sample;
+};
+
 /**
  * @brief Sorting information for the sip list
  */
@@ -110,6 +181,24 @@ struct sip_sort
     bool asc;
 };
 
+/**
+ * @brief SIP message parsed but not stored yet
+ *
+ * This contains all the packet information that can be parsed
+ * without accessing the call list.
+ */
+struct sip_pending
+{
+    //! Packet containing the message
+    packet_t *packet;
+    //! Message data parsed before knowing its call
+    sip_msg_t msg;
+    //! Scanned header locations
+    sip_headers_t hdrs;
+    //! Call-ID of the message
+    char callid[1024];
+};
+
 /**
  * @brief call structures head list
  *
@@ -128,6 +217,44 @@ struct sip_call_list {
     int last_index;
     //! Call-Ids hash table
     htable_t *callids;
+    //! Oldest and newest stored calls (capture order)
+    sip_call_t *lru_first, *lru_last;
+    //! Idle calls expiry timer wheel (one slot per second)
+    sip_call_t *expire_wheel[SIP_EXPIRE_SLOTS];
+    //! Last second processed by the expiry timer wheel
+    time_t expire_time;
+    //! Idle timeout of finished calls, other dialogs and active calls (0 disabled)
+    int expire_finished, expire_dialogs, expire_active;
+    //! Store 1 of each N dialogs (by Call-ID hash) and configured minimum N
+    int sample, sample_min;
+    //! Raise sample rate while parser queues are backing up
+    bool sample_adaptive;
+    //! Last time sample rate was changed
+    time_t sample_time;
+    //! Compress finished calls after this number of seconds (0 disabled)
+    int compress;
+    //! Finished calls waiting to be compressed (oldest first)
+    sip_call_t *compress_first, *compress_last;
+    //! Thread compressing finished calls
+    pthread_t compress_thread;
+    //! Compression thread is running
+    bool compress_running;
+    //! Memory used by stored calls
+    size_t memory;
+    //! Memory used by stored calls in each accounting category
+    size_t memory_types[CALL_MEMORY_COUNT];
+    //! Max memory for stored calls. 0 for disabling
+    size_t memlimit;
+    //! Calls in list order, marking the ones matching display filters
+    treap_t *view;
+    //! Calls changed since the last view refresh
+    vector_t *view_changed;
+    //! First and last displayed positions changed since last check
+    int view_first, view_last;
+    //! Pipe used to notify the interface about list changes
+    int notify[2];
+    //! Counters of stored dialogs data
+    sip_counters_t counters;
 
     // Max call limit
     int limit;
@@ -137,7 +264,12 @@ struct sip_call_list {
     int ignore_incomplete;
     //! match expression text
     const char *match_expr;
-#ifdef WITH_PCRE
+#if defined(WITH_PCRE2)
+    //! Compiled match expression
+    pcre2_code *match_regex;
+    //! Match results reused by each match expression check
+    pcre2_match_data *match_data;
+#elif defined(WITH_PCRE)
     //! Compiled match expression
     pcre *match_regex;
 #else
@@ -146,6 +278,16 @@ struct sip_call_list {
 #endif
     //! Invert match expression result
     int match_invert;
+    //! Literal that any payload matching the expression contains
+    strmatch_t *match_literal;
+    //! Match expression is a literal string, no regexp check is required
+    bool match_literal_only;
+    //! Literal patterns, new dialogs payload must contain one of them
+    strmatch_t *match_patterns;
+    //! Use regular expressions instead of header scanner
+    bool regex_parser;
+    //! X-Call-ID header names ('|' separated)
+    const char *xcid;
 
     //! Regexp for payload matching
     regex_t reg_method;
@@ -178,17 +320,32 @@ sip_init(int limit, int only_calls, int no_incomplete);
 void
 sip_deinit();
 
+/**
+ * @brief Get the location of the SIP headers in the payload
+ *
+ * Depending on sip.parser setting, this will use the single pass header
+ * scanner or the payload regular expressions.
+ *
+ * @param payload SIP message payload (NULL terminated)
+ * @param len SIP message payload length
+ * @param hdrs Structure to store headers locations
+ * @return 0 if payload first line is a SIP request or response, 1 otherwise
+ */
+int
+sip_parse_headers(const char *payload, uint32_t len, sip_headers_t *hdrs);
+
 /**
  * @brief Parses Call-ID header of a SIP message payload
  *
  * Mainly used to check if a payload contains a callid.
  *
  * @param payload SIP message payload
+ * @param hdrs Scanned headers of the payload
  * @param callid Character array to store callid
  * @return callid parsed from Call-ID header
  */
 char *
-sip_get_callid(const char* payload, char *callid);
+sip_get_callid(const char* payload, const sip_headers_t *hdrs, char *callid);
 
 /**
  * @brief Parses X-Call-ID header of a SIP message payload
@@ -196,11 +353,12 @@ sip_get_callid(const char* payload, char *callid);
  * Mainly used to check if a payload contains a xcallid.
  *
  * @param payload SIP message payload
- * @paramx callid Character array to store callid
+ * @param hdrs Scanned headers of the payload
+ * @param xcallid Character array to store callid
  * @return xcallid parsed from Call-ID header
  */
 char *
-sip_get_xcallid(const char* payload, char *xcallid);
+sip_get_xcallid(const char* payload, const sip_headers_t *hdrs, char *xcallid);
 
 /**
  * @brief Validate the packet payload is a SIP message
@@ -221,6 +379,21 @@ sip_get_xcallid(const char* payload, char *xcallid);
 int
 sip_validate_packet(packet_t *packet);
 
+/**
+ * @brief Validate a TCP payload is a SIP message
+ *
+ * Same as sip_validate_packet but without modifying any packet. Once
+ * the first message headers are complete, its expected length (headers
+ * and Content-Length) is stored in msglen, even if its body is not.
+ *
+ * @param payload NULL terminated payload
+ * @param plen payload length
+ * @param msglen length of the first SIP message in payload
+ * @return same as sip_validate_packet
+ */
+int
+sip_validate_payload(const u_char *payload, uint32_t plen, uint32_t *msglen);
+
 /**
  * @brief Loads a new message from raw header/payload
  *
@@ -233,6 +406,32 @@ sip_validate_packet(packet_t *packet);
 sip_msg_t *
 sip_check_packet(packet_t *packet);
 
+/**
+ * @brief Parse packet data that does not depend on stored calls
+ *
+ * This function does not access the call list, so it can be invoked
+ * without holding the capture lock. Prepared messages must be stored
+ * using @sip_store_packet
+ *
+ * @param packet Packet structure pointer
+ * @param pending Structure to store parsed data
+ * @return 0 if packet contains a SIP message, 1 otherwise
+ */
+int
+sip_prepare_packet(packet_t *packet, sip_pending_t *pending);
+
+/**
+ * @brief Store a prepared message into its call
+ *
+ * Find or create the call of a message prepared with @sip_prepare_packet.
+ * Message is destroyed if it is not stored.
+ *
+ * @param pending Parsed data of the packet
+ * @return a SIP msg structure pointer or NULL if message was not stored
+ */
+sip_msg_t *
+sip_store_packet(sip_pending_t *pending);
+
 /**
  * @brief Return if the call list has changed
  *
@@ -245,6 +444,18 @@ sip_check_packet(packet_t *packet);
 bool
 sip_calls_has_changed();
 
+/**
+ * @brief Get the file descriptor for list change notifications
+ *
+ * The descriptor becomes readable when the call list changes after the
+ * last time sip_calls_has_changed was invoked. Readers must consume all
+ * pending data after waking up.
+ *
+ * @return readable end of the notification pipe or -1 if not available
+ */
+int
+sip_calls_notify_fd();
+
 /**
  * @brief Getter for calls linked list size
  *
@@ -290,6 +501,63 @@ sip_calls_vector();
 vector_t *
 sip_active_calls_vector();
 
+/**
+ * @brief Update displayed calls view with changed calls
+ *
+ * Check display filters of calls added or changed since last refresh.
+ */
+void
+sip_calls_view_refresh();
+
+/**
+ * @brief Update the displayed flag of a call in the view
+ *
+ * @param call Call already checked against display filters
+ */
+void
+sip_calls_view_update(sip_call_t *call);
+
+/**
+ * @brief Hide all calls from the view until they are checked again
+ */
+void
+sip_calls_view_reset();
+
+/**
+ * @brief Get the number of displayed calls
+ */
+int
+sip_calls_view_count();
+
+/**
+ * @brief Get the displayed call in the given position
+ *
+ * @return call or NULL if position is out of bounds
+ */
+sip_call_t *
+sip_calls_view_item(int pos);
+
+/**
+ * @brief Get the position of a call between displayed calls
+ *
+ * @return position or -1 if call is not displayed
+ */
+int
+sip_calls_view_index(sip_call_t *call);
+
+/**
+ * @brief Check if displayed positions have changed
+ *
+ * Check if any call between given displayed positions has changed,
+ * has been added or has been removed since the last check.
+ *
+ * @param first First displayed position to check
+ * @param last Last displayed position to check
+ * @return true if any position in the range has changed
+ */
+bool
+sip_calls_view_changed(int first, int last);
+
 /**
  * @brief Return stats from call list
  *
@@ -299,6 +567,71 @@ sip_active_calls_vector();
 sip_stats_t
 sip_calls_stats();
 
+/**
+ * @brief Adapt dialog sampling rate to parser load
+ *
+ * Sampling rate is doubled while parser queue usage is over SIP_SAMPLE_HIGH
+ * and halved back to the configured rate when it's under SIP_SAMPLE_LOW.
+ * Rate is changed at most once per second. This can be called from any
+ * parser thread.
+ *
+ * @param usage Parser queue usage percentage
+ */
+void
+sip_calls_sample_adapt(int usage);
+
+/**
+ * @brief Return counters of stored dialogs
+ *
+ * @return a copy of current counters
+ */
+sip_counters_t
+sip_calls_counters();
+
+/**
+ * @brief Read stored dialogs containers usage
+ *
+ * @param info Health report to fill
+ */
+void
+sip_calls_health(health_info_t *info);
+
+/**
+ * @brief Update message counters
+ *
+ * @param msg Message added to (or removed from) a call
+ * @param count 1 for added messages, -1 for removed ones
+ */
+void
+sip_calls_count_msg(sip_msg_t *msg, int count);
+
+/**
+ * @brief Update call state counters
+ *
+ * @param prev Previous state of the call
+ * @param state Current state of the call
+ */
+void
+sip_calls_count_state(int prev, int state);
+
+/**
+ * @brief Update RTP counters
+ *
+ * @param streams Number of added (or removed if negative) streams
+ * @param packets Number of added (or removed if negative) packets
+ * @param bytes Payload bytes of added (or removed if negative) packets
+ */
+void
+sip_calls_count_rtp(int64_t streams, int64_t packets, int64_t bytes);
+
+/**
+ * @brief Remove all data of a call from the counters
+ *
+ * @param call Call being removed from storage
+ */
+void
+sip_calls_uncount_call(sip_call_t *call);
+
 
 /**
  * @brief Find a call structure in calls linked list given a call index
@@ -328,7 +661,7 @@ sip_find_by_callid(const char *callid);
  * @param payload SIP message payload
  */
 void
-sip_parse_extra_headers(sip_msg_t *msg, const u_char *payload);
+sip_parse_extra_headers(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs);
 
 /**
  * @brief Remove al calls
@@ -349,14 +682,108 @@ void
 sip_calls_clear_soft();
 
 /**
- * @brief Remove first call in the call list
+ * @brief Remove oldest call in the call list
  *
- * This function removes the first call in the calls vector avoiding
+ * This function removes the oldest unlocked call not being saved avoiding
  * reaching the capture limit.
+ *
+ * @return 0 if a call has been removed, 1 if all calls are locked
  */
-void
+int
 sip_calls_rotate();
 
+/**
+ * @brief Update memory used by stored calls
+ *
+ * @param type accounting category of the memory
+ * @param bytes memory bytes allocated (or deallocated if negative)
+ */
+void
+sip_calls_add_memory(enum call_memory_type type, int64_t bytes);
+
+/**
+ * @brief Remove the memory of a call from stored calls memory
+ *
+ * @param call call being removed from stored calls
+ */
+void
+sip_calls_release_memory(sip_call_t *call);
+
+/**
+ * @brief Get memory used by stored calls
+ */
+size_t
+sip_calls_memory();
+
+/**
+ * @brief Get memory used by stored calls in an accounting category
+ */
+size_t
+sip_calls_memory_type(enum call_memory_type type);
+
+/**
+ * @brief Get the stored calls using more memory
+ *
+ * @param top array where calls are stored, from bigger to smaller
+ * @param count max number of calls to store
+ * @return number of stored calls
+ */
+int
+sip_calls_memory_top(sip_call_t **top, int count);
+
+/**
+ * @brief Check if stored calls use more memory than allowed
+ */
+bool
+sip_calls_memory_exceeded();
+
+/**
+ * @brief Release memory until stored calls are below memory limit
+ *
+ * Stored RTP packets are removed first, starting with the oldest calls.
+ * If memory usage is still over the limit and rotation is enabled, oldest
+ * calls will be removed.
+ *
+ * @param rotate Allow removing calls
+ */
+void
+sip_calls_check_memory(bool rotate);
+
+/**
+ * @brief Add a call at the end of capture order list
+ *
+ * @param call New stored call
+ */
+void
+sip_calls_lru_append(sip_call_t *call);
+
+/**
+ * @brief Remove a call from capture order list
+ *
+ * @param call Call being removed
+ */
+void
+sip_calls_lru_remove(sip_call_t *call);
+
+/**
+ * @brief Queue a finished call to be compressed
+ *
+ * Call payloads and frames will be compressed by a separate thread
+ * after sip.compress seconds.
+ *
+ * @param call Call that has reached a final state
+ */
+void
+sip_calls_compress_queue(sip_call_t *call);
+
+/**
+ * @brief Stop the finished calls compression thread
+ *
+ * This must be called before capture lock is destroyed.
+ */
+void
+sip_calls_compress_stop();
+
 /**
  * @brief Get message Request/Response code
  *
@@ -366,7 +793,7 @@ sip_calls_rotate();
  * @return numeric representation of Request/ResponseCode
  */
 int
-sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload);
+sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs);
 
 /**
  * @brief Get full Response code (including text)
@@ -396,21 +823,24 @@ sip_parse_msg(sip_msg_t *msg);
  *
  * @param msg SIP message structure
  * @param payload SIP message payload
+ * @param hdrs Scanned headers of the payload
  * @return 0 in all cases
  */
 int
-sip_parse_msg_payload(sip_msg_t *msg, const u_char *payload);
+sip_parse_msg_payload(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs);
 
 /**
  * @brief Parse SIP Message payload for SDP media streams
  *
- * Parse the payload content to get SDP information
+ * Parse the body lines in place to get SDP connection, media and
+ * format information. Both IPv4 and IPv6 connections are supported.
  *
  * @param msg SIP message structure
- * @return 0 in all cases
+ * @param payload SIP message payload
+ * @param hdrs Scanned headers of the payload
  */
 void
-sip_parse_msg_media(sip_msg_t *msg, const u_char *payload);
+sip_parse_msg_media(sip_msg_t *msg, const u_char *payload, const sip_headers_t *hdrs);
 
 /**
  * @brief Set Capture Matching expression
@@ -431,14 +861,41 @@ sip_set_match_expression(const char *expr, int insensitive, int invert);
 const char *
 sip_get_match_expression();
 
+/**
+ * @brief Set Capture Matching literal patterns
+ *
+ * New dialogs are only stored if their first message payload contains
+ * any of the given strings. All patterns are searched in a single pass.
+ *
+ * @param patterns Vector of pattern strings
+ * @param insensitive 1 for case insensitive matching
+ * @return 0 if patterns are valid, 1 otherwise
+ */
+int
+sip_set_match_patterns(vector_t *patterns, int insensitive);
+
 /**
  * @brief Checks if a given payload matches expression
  *
- * @param payload Packet payload
+ * @param payload Packet payload (NULL terminated)
+ * @param len Length of the payload
  * @return 1 if matches, 0 otherwise
  */
 int
-sip_check_match_expression(const char *payload);
+sip_check_match_expression(const char *payload, size_t len);
+
+/**
+ * @brief Checks if a new dialog is stored with current sampling rate
+ *
+ * The same Call-IDs are always sampled, so different sngrep instances
+ * store the same dialogs. Dialogs stored with a rate are also stored with
+ * any of its divisors, so changing adaptive rate doesn't break dialogs.
+ *
+ * @param callid Call-ID of the dialog
+ * @return 1 if dialog must be stored, 0 otherwise
+ */
+int
+sip_check_sample(const char *callid);
 
 /**
  * @brief Get String value for a Method
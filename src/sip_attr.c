@@ -31,12 +31,13 @@
 #include <string.h>
 #include <stdarg.h>
 #include "option.h"
+#include "setting.h"
 #include "sip_attr.h"
 #include "util.h"
 #include "curses/ui_manager.h"
 
 static sip_attr_hdr_t attrs[SIP_ATTR_COUNT] = {
-    { SIP_ATTR_CALLINDEX,   "index",       "Idx",  "Call Index",    4 },
+    { SIP_ATTR_CALLINDEX,   "index",       "Idx",  "Call Index",    4, NULL, true },
     { SIP_ATTR_SIPFROM,     "sipfrom",     NULL,   "SIP From",      25 },
     { SIP_ATTR_SIPFROMUSER, "sipfromuser", NULL,   "SIP From User", 20 },
     { SIP_ATTR_SIPTO,       "sipto",       NULL,   "SIP To",        25 },
@@ -45,16 +46,22 @@ static sip_attr_hdr_t attrs[SIP_ATTR_COUNT] = {
     { SIP_ATTR_DST,         "dst",         NULL,   "Destination",   22 },
     { SIP_ATTR_CALLID,      "callid",      NULL,   "Call-ID",       50 },
     { SIP_ATTR_XCALLID,     "xcallid",     NULL,   "X-Call-ID",     50 },
-    { SIP_ATTR_DATE,        "date",        NULL,   "Date",          10 },
-    { SIP_ATTR_TIME,        "time",        NULL,   "Time",          8 },
+    { SIP_ATTR_DATE,        "date",        NULL,   "Date",          10, NULL, true },
+    { SIP_ATTR_TIME,        "time",        NULL,   "Time",          8, NULL, true },
     { SIP_ATTR_METHOD,      "method",      NULL,   "Method",        10, sip_attr_color_method },
     { SIP_ATTR_TRANSPORT,   "transport",   "Trans", "Transport",    3 },
-    { SIP_ATTR_MSGCNT,      "msgcnt",      "Msgs", "Message Count", 5 },
+    { SIP_ATTR_MSGCNT,      "msgcnt",      "Msgs", "Message Count", 5, NULL, true },
     { SIP_ATTR_CALLSTATE,   "state",       NULL,   "Call State",    10, sip_attr_color_state },
-    { SIP_ATTR_CONVDUR,     "convdur",     "ConvDur", "Conversation Duration", 7 },
-    { SIP_ATTR_TOTALDUR,    "totaldur",    "TotalDur", "Total Duration", 8 },
+    { SIP_ATTR_CONVDUR,     "convdur",     "ConvDur", "Conversation Duration", 7, NULL, true },
+    { SIP_ATTR_TOTALDUR,    "totaldur",    "TotalDur", "Total Duration", 8, NULL, true },
     { SIP_ATTR_REASON_TXT,  "reason",      "Reason Text",   "Reason Text", 25 },
-    { SIP_ATTR_WARNING,     "warning",     "Warning", "Warning code", 4 }
+    { SIP_ATTR_WARNING,     "warning",     "Warning", "Warning code", 4, NULL, true },
+    { SIP_ATTR_RTPLOSS,     "rtploss",     "Loss", "RTP Packet Loss", 6, NULL, true },
+    { SIP_ATTR_RTPJITTER,   "rtpjitter",   "Jitter", "RTP Jitter (ms)", 6, NULL, true },
+    { SIP_ATTR_RTPMOS,      "rtpmos",      "MOS", "RTP Estimated MOS", 4, NULL, true },
+    { SIP_ATTR_MEMORY,      "memory",      "Memory", "Memory Usage", 7, NULL, true },
+    { SIP_ATTR_USERAGENT,   "useragent",   "User-Agent", "User-Agent", 25 },
+    { SIP_ATTR_HEADER,      "header",      NULL,   "Custom Header", 25 }
 };
 
 sip_attr_hdr_t *
@@ -77,6 +84,12 @@ const char *
 sip_attr_get_title(enum sip_attr_id id)
 {
     sip_attr_hdr_t *header;
+    const char *name = setting_get_value(SETTING_SIP_HEADER_CUSTOM);
+
+    // Custom header column is titled with the header name
+    if (id == SIP_ATTR_HEADER && name)
+        return name;
+
     if ((header = sip_attr_get_header(id))) {
         if (header->title)
             return header->title;
@@ -117,6 +130,12 @@ sip_attr_from_name(const char *name)
     return -1;
 }
 
+bool
+sip_attr_is_numeric(enum sip_attr_id id)
+{
+    return attrs[id].numeric;
+}
+
 int
 sip_attr_get_color(int id, const char *value)
 {
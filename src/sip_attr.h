@@ -30,6 +30,7 @@
 #define __SNGREP_SIP_ATTR_H
 
 #include "config.h"
+#include <stdbool.h>
 #include "vector.h"
 
 //! Max attribute length
@@ -85,6 +86,18 @@ enum sip_attr_id {
     SIP_ATTR_REASON_TXT,
     //! Warning Header
     SIP_ATTR_WARNING,
+    //! Worst RTP stream packet loss
+    SIP_ATTR_RTPLOSS,
+    //! Worst RTP stream jitter
+    SIP_ATTR_RTPJITTER,
+    //! Worst RTP stream estimated MOS
+    SIP_ATTR_RTPMOS,
+    //! Memory used by the call
+    SIP_ATTR_MEMORY,
+    //! SIP Message User-Agent header
+    SIP_ATTR_USERAGENT,
+    //! SIP Message header configured in sip.header setting
+    SIP_ATTR_HEADER,
     //! SIP Attribute count
     SIP_ATTR_COUNT
 };
@@ -111,6 +124,8 @@ struct sip_attr_hdr {
     int dwidth;
     //! This function determines the color of this attribute in CallList
     int (*color)(const char *value);
+    //! Attribute values are compared as numbers instead of text
+    bool numeric;
 };
 
 /**
@@ -190,6 +205,15 @@ sip_attr_get_width(enum sip_attr_id id);
 int
 sip_attr_from_name(const char *name);
 
+/**
+ * @brief Check if attribute values are compared as numbers
+ *
+ * @param id Attribute id
+ * @return true for counters, durations and dates, false otherwise
+ */
+bool
+sip_attr_is_numeric(enum sip_attr_id id);
+
 /**
  * @brief Determine the color of the attribute in Call List
  *
@@ -29,9 +29,22 @@
  *
  */
 
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(WITH_ZSTD)
+#include <zstd.h>
+#elif defined(WITH_ZLIB)
+#include <zlib.h>
+#endif
 #include "sip_call.h"
 #include "sip.h"
 #include "setting.h"
+#include "intern.h"
+#include "capture_overload.h"
+#include "filter.h"
+#include "cdr.h"
+#include "snapshot.h"
 
 sip_call_t *
 call_create(char *callid, char *xcallid)
@@ -42,6 +55,12 @@ call_create(char *callid, char *xcallid)
     if (!(call = sng_malloc(sizeof(sip_call_t))))
         return NULL;
 
+    // Create the memory arena for call data
+    if (!(call->arena = arena_create())) {
+        sng_free(call);
+        return NULL;
+    }
+
     // Create a vector to store call messages
     call->msgs = vector_create(2, 2);
     vector_set_destroyer(call->msgs, msg_destroyer);
@@ -54,7 +73,7 @@ call_create(char *callid, char *xcallid)
 
     // Create an empty vector to strore stream data
     call->streams = vector_create(0, 2);
-    vector_set_destroyer(call->streams, vector_generic_destroyer);
+    vector_set_destroyer(call->streams, stream_destroyer);
 
     // Create an empty vector to store x-calls
     call->xcalls = vector_create(0, 1);
@@ -62,9 +81,15 @@ call_create(char *callid, char *xcallid)
     // Initialize call filter status
     call->filtered = -1;
 
+    // No attribute value has been cached yet
+    call->changes = 1;
+
+    // No packet has been written to dump file yet
+    call->dump_offset = -1;
+
     // Set message callid
-    call->callid = strdup(callid);
-    call->xcallid = strdup(xcallid);
+    call->callid = arena_strdup(call->arena, callid);
+    call->xcallid = intern_string(xcallid);
 
     return call;
 }
@@ -72,18 +97,37 @@ call_create(char *callid, char *xcallid)
 void
 call_destroy(sip_call_t *call)
 {
+    int i;
+
+    // Remove call data from stored dialogs counters
+    sip_calls_uncount_call(call);
     // Remove all call messages
     vector_destroy(call->msgs);
     // Remove all call streams
     vector_destroy(call->streams);
     // Remove all call rtp packets
     vector_destroy(call->rtp_packets);
+    storage_rtp_close(call->rtp_spool);
     // Remove all xcalls
     vector_destroy(call->xcalls);
+    // Release shared X-Call-ID
+    intern_release(call->xcallid);
+    // Remove sort key
+    sng_free(call->sort_str);
+    // Remove cached attribute values
+    if (call->attrs) {
+        for (i = 0; i < SIP_ATTR_COUNT; i++)
+            sng_free(call->attrs[i].value);
+        sng_free(call->attrs);
+    }
+    // Remove compressed payloads
+    if (call->zblock) {
+        free(call->zblock->data);
+        sng_free(call->zblock->packets);
+        sng_free(call->zblock);
+    }
     // Deallocate call memory
-    sng_free(call->callid);
-    sng_free(call->xcallid);
-    sng_free(call->reasontxt);
+    arena_destroy(call->arena);
     sng_free(call);
 }
 
@@ -104,10 +148,17 @@ call_add_message(sip_call_t *call, sip_msg_t *msg)
 {
     // Set the message owner
     msg->call = call;
+    // Index message payload before it can be checked by filters
+    filter_index_msg(call, msg);
     // Put this msg at the end of the msg list
     msg->index = vector_append(call->msgs, msg);
+    // Account message packet memory (message data lives in call arena)
+    call_add_packet_memory(call, msg->packet, 1);
+    // Update stored messages counters
+    sip_calls_count_msg(msg, 1);
     // Flag this call as changed
     call->changed = true;
+    call->changes++;
 }
 
 void
@@ -115,19 +166,398 @@ call_add_stream(sip_call_t *call, rtp_stream_t *stream)
 {
     // Store stream
     vector_append(call->streams, stream);
+    // Index stream by its destination
+    rtp_flow_add(stream);
+    // Update stored streams counters
+    sip_calls_count_rtp(1, stream->pktcnt, stream->bytes);
     // Flag this call as changed
     call->changed = true;
 }
 
-void
-call_add_rtp_packet(sip_call_t *call, packet_t *packet)
+/**
+ * @brief Check if call RTP packets must be written to a spool file
+ */
+static bool
+call_rtp_spool_wanted(sip_call_t *call)
 {
+    switch (storage_get_rtp_mode()) {
+        case STORAGE_RTP_LOCKED:
+            return call->locked;
+        case STORAGE_RTP_FILTERED:
+            return filter_check_call(call);
+        default:
+            return false;
+    }
+}
+
+bool
+call_add_rtp_packet(sip_call_t *call, rtp_stream_t *stream, packet_t *packet)
+{
+    // Flag this call as changed
+    call->changed = true;
+
+    // Stream statistics are updated, but packets are not stored while overloaded
+    if (capture_overload_active(OVERLOAD_RTP)) {
+        capture_overload_shed(OVERLOAD_RTP);
+        return false;
+    }
+
+    // Write packet to the call spool file instead of memory
+    if (call->rtp_spool || call_rtp_spool_wanted(call)) {
+        if (!call->rtp_spool && (call->rtp_spool = storage_rtp_open(
+                setting_get_value(SETTING_CAPTURE_STORAGE_DIR), capture_datalink())))
+            call_add_memory(call, CALL_MEMORY_RTP, sizeof(storage_rtp_spool_t));
+        if (call->rtp_spool && storage_rtp_write(call->rtp_spool, packet) == 0)
+            return false;
+    }
+
+    // Store packet or its header in the stream
+    if (rtp_get_storage() != RTP_STORAGE_FULL) {
+        if (stream_store_packet(stream, packet))
+            return true;
+        if (rtp_get_storage() == RTP_STORAGE_HEADERS)
+            return false;
+    }
+
     // Store packet
     vector_append(call->rtp_packets, packet);
-    // Flag this call as changed
+    // Account packet memory
+    call_add_memory(call, CALL_MEMORY_RTP, packet_memory(packet));
+    return true;
+}
+
+void
+call_add_memory(sip_call_t *call, enum call_memory_type type, int64_t bytes)
+{
+    call->memory += bytes;
+    call->memory_types[type] += bytes;
+    sip_calls_add_memory(type, bytes);
+}
+
+void
+call_add_packet_memory(sip_call_t *call, packet_t *packet, int sign)
+{
+    int64_t frames;
+
+    if (!packet)
+        return;
+
+    if (packet->type == PACKET_RTP || packet->type == PACKET_RTCP) {
+        call_add_memory(call, CALL_MEMORY_RTP, sign * (int64_t) packet_memory(packet));
+        return;
+    }
+
+    frames = packet_frames_memory(packet);
+    call_add_memory(call, CALL_MEMORY_PAYLOADS, sign * ((int64_t) packet_memory(packet) - frames));
+    call_add_memory(call, CALL_MEMORY_FRAMES, sign * frames);
+}
+
+const char *
+call_memory_type_name(enum call_memory_type type)
+{
+    switch (type) {
+        case CALL_MEMORY_DIALOG:
+            return "Dialogs";
+        case CALL_MEMORY_PAYLOADS:
+            return "Payloads";
+        case CALL_MEMORY_FRAMES:
+            return "Frames";
+        case CALL_MEMORY_COMPRESSED:
+            return "Compressed";
+        case CALL_MEMORY_RTP:
+            return "RTP";
+        default:
+            return "";
+    }
+}
+
+void
+call_free_rtp_packets(sip_call_t *call)
+{
+    rtp_stream_t *stream;
+    packet_t *packet;
+    int64_t memory = 0;
+    vector_iter_t it;
+
+    // Get memory used by stored packets
+    it = vector_iterator(call->rtp_packets);
+    while ((packet = vector_iterator_next(&it)))
+        memory += packet_memory(packet);
+
+    // Remove packets stored in call streams
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it)))
+        memory += stream_free_packets(stream);
+
+    if (!memory)
+        return;
+
+    // Remove all packets
+    vector_clear(call->rtp_packets);
+    call_add_memory(call, CALL_MEMORY_RTP, -memory);
     call->changed = true;
 }
 
+/**
+ * @brief Compress a call block with the available library
+ *
+ * @return compressed block or NULL on error
+ */
+static u_char *
+call_zblock_pack(const u_char *raw, size_t rawlen, size_t *len)
+{
+    u_char *data = NULL;
+#if defined(WITH_ZSTD)
+    size_t bound = ZSTD_compressBound(rawlen);
+
+    if (!(data = malloc(bound)))
+        return NULL;
+    *len = ZSTD_compress(data, bound, raw, rawlen, CALL_COMPRESS_LEVEL);
+    if (ZSTD_isError(*len)) {
+        free(data);
+        return NULL;
+    }
+#elif defined(WITH_ZLIB)
+    uLongf bound = compressBound(rawlen);
+
+    if (!(data = malloc(bound)))
+        return NULL;
+    if (compress2(data, &bound, raw, rawlen, CALL_COMPRESS_LEVEL) != Z_OK) {
+        free(data);
+        return NULL;
+    }
+    *len = bound;
+#endif
+    return data;
+}
+
+/**
+ * @brief Uncompress a call block into a buffer of its uncompressed size
+ *
+ * @return 0 if block has been uncompressed, 1 otherwise
+ */
+static int
+call_zblock_unpack(const sip_call_zblock_t *zblock, u_char *raw)
+{
+#if defined(WITH_ZSTD)
+    return ZSTD_decompress(raw, zblock->rawlen, zblock->data, zblock->len) != zblock->rawlen;
+#elif defined(WITH_ZLIB)
+    uLongf rawlen = zblock->rawlen;
+
+    return uncompress(raw, &rawlen, zblock->data, zblock->len) != Z_OK || rawlen != zblock->rawlen;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief Get the bytes of a frame content stored in a call block
+ *
+ * Payloads pointing into their frame are already stored with the other
+ * payloads, so only the frame bytes before them are stored.
+ */
+static uint32_t
+call_zblock_frame_len(const packet_t *packet, const frame_t *frame)
+{
+    if (packet->payload_ref)
+        return frame->header.caplen - packet->payload_len;
+    return frame->header.caplen;
+}
+
+bool
+call_compress_supported()
+{
+#if defined(WITH_ZSTD) || defined(WITH_ZLIB)
+    return true;
+#else
+    return false;
+#endif
+}
+
+int
+call_compress(sip_call_t *call)
+{
+    sip_call_zblock_t *zblock;
+    sip_msg_t *msg;
+    packet_t *packet;
+    frame_t *frame;
+    vector_iter_t it;
+    u_char *raw, *pos;
+    size_t rawlen = 0;
+    int i, count;
+
+    if (!call_compress_supported() || call->zblock || call->saving || !(count = call_msg_count(call)))
+        return 1;
+
+    if (!(zblock = sng_malloc(sizeof(sip_call_zblock_t))))
+        return 1;
+
+    if (!(zblock->packets = sng_malloc(sizeof(packet_t *) * count))) {
+        sng_free(zblock);
+        return 1;
+    }
+
+    // Get uncompressed block size
+    for (i = 0; i < count; i++) {
+        msg = vector_item(call->msgs, i);
+        if (!(packet = zblock->packets[i] = msg->packet))
+            continue;
+        rawlen += packet->payload_len + 1;
+        it = vector_iterator(packet->frames);
+        while ((frame = vector_iterator_next(&it))) {
+            if (frame->data)
+                rawlen += call_zblock_frame_len(packet, frame);
+        }
+    }
+
+    if (!(raw = malloc(rawlen))) {
+        sng_free(zblock->packets);
+        sng_free(zblock);
+        return 1;
+    }
+
+    // Store all payloads first, then all frames contents
+    for (i = 0, pos = raw; i < count; i++) {
+        if (!(packet = zblock->packets[i]))
+            continue;
+        if (packet->payload)
+            memcpy(pos, packet->payload, packet->payload_len);
+        pos[packet->payload_len] = '\0';
+        pos += packet->payload_len + 1;
+    }
+    for (i = 0; i < count; i++) {
+        if (!(packet = zblock->packets[i]))
+            continue;
+        it = vector_iterator(packet->frames);
+        while ((frame = vector_iterator_next(&it))) {
+            if (!frame->data)
+                continue;
+            memcpy(pos, frame->data, call_zblock_frame_len(packet, frame));
+            pos += call_zblock_frame_len(packet, frame);
+        }
+    }
+
+    zblock->data = call_zblock_pack(raw, rawlen, &zblock->len);
+    free(raw);
+    if (!zblock->data) {
+        sng_free(zblock->packets);
+        sng_free(zblock);
+        return 1;
+    }
+    zblock->rawlen = rawlen;
+    zblock->count = count;
+
+    // Release compressed contents
+    for (i = 0; i < count; i++) {
+        if (!(packet = zblock->packets[i]))
+            continue;
+        call_add_packet_memory(call, packet, -1);
+        it = vector_iterator(packet->frames);
+        while ((frame = vector_iterator_next(&it))) {
+            if (!frame->data)
+                continue;
+            frame_free_data(frame);
+            frame->offset = FRAME_OFFSET_COMPRESSED;
+        }
+        if (!packet->payload_ref)
+            free(packet->payload);
+        packet->payload = NULL;
+        call_add_packet_memory(call, packet, 1);
+    }
+
+    call->zblock = zblock;
+    call_add_memory(call, CALL_MEMORY_COMPRESSED, sizeof(sip_call_zblock_t) + sizeof(packet_t *) * count + zblock->len);
+    return 0;
+}
+
+int
+call_uncompress(sip_call_t *call)
+{
+    sip_call_zblock_t *zblock = call->zblock;
+    packet_t *packet;
+    frame_t *frame;
+    vector_iter_t it;
+    u_char *raw, *payload, *pos;
+    uint32_t len;
+    int i;
+
+    if (!zblock)
+        return 0;
+
+    if (!(raw = malloc(zblock->rawlen)))
+        return 1;
+
+    if (call_zblock_unpack(zblock, raw) != 0) {
+        free(raw);
+        return 1;
+    }
+
+    // Frames contents are stored after all payloads
+    for (i = 0, pos = raw; i < zblock->count; i++) {
+        if (zblock->packets[i])
+            pos += zblock->packets[i]->payload_len + 1;
+    }
+
+    for (i = 0, payload = raw; i < zblock->count; i++) {
+        if (!(packet = zblock->packets[i]))
+            continue;
+        call_add_packet_memory(call, packet, -1);
+
+        // Restore frames contents
+        it = vector_iterator(packet->frames);
+        while ((frame = vector_iterator_next(&it))) {
+            if (frame->offset != FRAME_OFFSET_COMPRESSED)
+                continue;
+            len = call_zblock_frame_len(packet, frame);
+            if (frame_alloc_data(frame)) {
+                memcpy(frame->data, pos, len);
+                if (packet->payload_ref)
+                    memcpy(frame->data + len, payload, packet->payload_len);
+                frame->data[frame->header.caplen] = '\0';
+            }
+            frame->offset = -1;
+            pos += len;
+        }
+
+        // Restore payload, pointing into its frame when it did
+        frame = vector_first(packet->frames);
+        if (packet->payload_ref && frame && frame->data) {
+            packet->payload = frame->data + frame->header.caplen - packet->payload_len;
+        } else if ((packet->payload = malloc(packet->payload_len + 1))) {
+            memcpy(packet->payload, payload, packet->payload_len + 1);
+            packet->payload_ref = false;
+        }
+        payload += packet->payload_len + 1;
+        call_add_packet_memory(call, packet, 1);
+    }
+    free(raw);
+
+    // Restored calls are never compressed again
+    call->zblock = NULL;
+    call->uncompressed = true;
+    call_add_memory(call, CALL_MEMORY_COMPRESSED, -(int64_t) (sizeof(sip_call_zblock_t) + sizeof(packet_t *) * zblock->count + zblock->len));
+    free(zblock->data);
+    sng_free(zblock->packets);
+    sng_free(zblock);
+    return 0;
+}
+
+u_char *
+call_compressed_payloads(sip_call_t *call)
+{
+    u_char *raw;
+
+    if (!call->zblock || !(raw = malloc(call->zblock->rawlen)))
+        return NULL;
+
+    if (call_zblock_unpack(call->zblock, raw) != 0) {
+        free(raw);
+        return NULL;
+    }
+
+    return raw;
+}
+
 int
 call_msg_count(sip_call_t *call)
 {
@@ -153,22 +583,35 @@ call_is_invite(sip_call_t *call)
 void
 call_msg_retrans_check(sip_msg_t *msg)
 {
-    sip_msg_t *prev = NULL;
-    vector_iter_t it;
+    sip_call_t *call = msg->call;
+    sip_call_path_t *path;
+    sip_msg_t *prev;
 
     // Get previous message in call with same origin and destination
-    it = vector_iterator(msg->call->msgs);
-    vector_iterator_set_current(&it, vector_index(msg->call->msgs, msg));
-    while ((prev = vector_iterator_prev(&it))) {
-        if (addressport_equals(prev->packet->src, msg->packet->src) &&
-                addressport_equals(prev->packet->dst, msg->packet->dst))
+    for (path = call->paths; path; path = path->next) {
+        if (addressport_equals(path->src, msg->packet->src) &&
+                addressport_equals(path->dst, msg->packet->dst))
             break;
     }
 
-    // Store the flag that determines if message is retrans
-    if (prev && !strcasecmp(msg_get_payload(msg), msg_get_payload(prev))) {
-        msg->retrans = prev;
+    if (!path) {
+        // First message between these addresses
+        if (!(path = arena_alloc(call->arena, sizeof(sip_call_path_t))))
+            return;
+        path->src = msg->packet->src;
+        path->dst = msg->packet->dst;
+        path->next = call->paths;
+        call->paths = path;
+    } else {
+        // Store the flag that determines if message is retrans
+        prev = path->last;
+        if (prev->fingerprint == msg->fingerprint
+            && packet_payloadlen(prev->packet) == packet_payloadlen(msg->packet)) {
+            msg->retrans = prev;
+        }
     }
+
+    path->last = msg;
 }
 
 sip_msg_t *
@@ -196,12 +639,18 @@ call_msg_with_media(sip_call_t *call, address_t dst)
 void
 call_update_state(sip_call_t *call, sip_msg_t *msg)
 {
-    int reqresp;
+    int reqresp, state;
     sip_msg_t *first;
 
     if (!call_is_invite(call))
         return;
 
+    // Store current state for counters update
+    state = call->state;
+
+    // Call state and durations may change
+    call->changes++;
+
     // Get the first message in the call
     first = vector_first(call->msgs);
 
@@ -246,12 +695,50 @@ call_update_state(sip_call_t *call, sip_msg_t *msg)
             call->state = SIP_CALLSTATE_CALLSETUP;
         }
     }
+
+    // Update call state counters
+    if (call->state != state) {
+        sip_calls_count_state(state, call->state);
+        // Finished calls payloads are not expected to be read again
+        if (!call_is_active(call)) {
+            cdr_export_call(call);
+            snapshot_publish_streams(call);
+            sip_calls_compress_queue(call);
+        }
+    }
+}
+
+int
+call_rtp_quality(sip_call_t *call, double *loss, double *jitter, double *mos)
+{
+    rtp_stream_t *stream;
+    vector_iter_t it;
+    int count = 0;
+
+    *loss = *jitter = 0;
+    *mos = 5;
+
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it))) {
+        if (stream->type != PACKET_RTP || !stream_get_count(stream))
+            continue;
+        if (stream_get_loss(stream) > *loss)
+            *loss = stream_get_loss(stream);
+        if (stream_get_jitter(stream) > *jitter)
+            *jitter = stream_get_jitter(stream);
+        if (stream_get_mos(stream) < *mos)
+            *mos = stream_get_mos(stream);
+        count++;
+    }
+
+    return count;
 }
 
 const char *
 call_get_attribute(sip_call_t *call, enum sip_attr_id id, char *value)
 {
     sip_msg_t *first, *last;
+    double loss, jitter, mos;
 
     if (!call)
         return NULL;
@@ -292,6 +779,21 @@ call_get_attribute(sip_call_t *call, enum sip_attr_id id, char *value)
             if (call->warning)
                 sprintf(value, "%d", call->warning);
             break;
+        case SIP_ATTR_RTPLOSS:
+            if (call_rtp_quality(call, &loss, &jitter, &mos))
+                sprintf(value, "%.1f%%", loss);
+            break;
+        case SIP_ATTR_RTPJITTER:
+            if (call_rtp_quality(call, &loss, &jitter, &mos))
+                sprintf(value, "%.1f", jitter);
+            break;
+        case SIP_ATTR_RTPMOS:
+            if (call_rtp_quality(call, &loss, &jitter, &mos))
+                sprintf(value, "%.1f", mos);
+            break;
+        case SIP_ATTR_MEMORY:
+            bytes_to_human(call->memory, value);
+            break;
         default:
             return msg_get_attribute(vector_first(call->msgs), id, value);
             break;
@@ -322,51 +824,144 @@ call_state_to_str(int state)
     return "";
 }
 
-int
-call_attr_compare(sip_call_t *one, sip_call_t *two, enum sip_attr_id id)
+/**
+ * @brief Get the cached value of a call attribute
+ *
+ * Calculate the attribute value if the call has changed since the
+ * last time it was requested.
+ *
+ * @param call SIP call structure
+ * @param id Attribute id
+ * @return cached attribute value or NULL on allocation failure
+ */
+static sip_call_attr_t *
+call_attr_get(sip_call_t *call, enum sip_attr_id id)
 {
-    char onevalue[256], twovalue[256];
-    int oneintvalue, twointvalue;
-    int comparetype; /* TODO 0 = string compare, 1 = int comprare */
+    sip_call_attr_t *attr;
+    sip_msg_t *first, *last;
+    struct timeval start, end;
+    double loss, jitter, mos;
+    char value[SIP_ATTR_MAXLEN + 1];
+
+    // Allocate attribute cache on first request
+    if (!call->attrs && !(call->attrs = sng_malloc(sizeof(sip_call_attr_t) * SIP_ATTR_COUNT)))
+        return NULL;
+
+    // Cached value is still valid (RTP changes call memory, but not its messages)
+    attr = &call->attrs[id];
+    if (attr->changes == call->changes && (id != SIP_ATTR_MEMORY || attr->num == (int64_t) call->memory))
+        return attr;
 
+    // Format attribute value
+    value[0] = '\0';
+    sng_free(attr->value);
+    attr->value = call_get_attribute(call, id, value) ? strdup(value) : NULL;
+
+    // Calculate numeric value
     switch (id) {
         case SIP_ATTR_CALLINDEX:
-            oneintvalue = one->index;
-            twointvalue = two->index;
-            comparetype = 1;
+            attr->num = call->index;
             break;
         case SIP_ATTR_MSGCNT:
-            oneintvalue = call_msg_count(one);
-            twointvalue = call_msg_count(two);
-            comparetype = 1;
+            attr->num = call_msg_count(call);
+            break;
+        case SIP_ATTR_WARNING:
+            attr->num = call->warning;
+            break;
+        case SIP_ATTR_DATE:
+        case SIP_ATTR_TIME:
+            start = msg_get_time(vector_first(call->msgs));
+            attr->num = (int64_t) start.tv_sec * 1000000 + start.tv_usec;
+            break;
+        case SIP_ATTR_CONVDUR:
+        case SIP_ATTR_TOTALDUR:
+            if (id == SIP_ATTR_CONVDUR) {
+                first = call->cstart_msg;
+                last = call->cend_msg;
+            } else {
+                first = vector_first(call->msgs);
+                last = vector_last(call->msgs);
+            }
+            start = msg_get_time(first);
+            end = msg_get_time(last);
+            attr->num = (start.tv_sec && end.tv_sec) ? end.tv_sec - start.tv_sec : -1;
+            break;
+        case SIP_ATTR_RTPLOSS:
+        case SIP_ATTR_RTPJITTER:
+        case SIP_ATTR_RTPMOS:
+            // Calls without RTP are sorted before any other
+            if (!call_rtp_quality(call, &loss, &jitter, &mos))
+                attr->num = -1;
+            else if (id == SIP_ATTR_RTPLOSS)
+                attr->num = loss * 1000;
+            else if (id == SIP_ATTR_RTPJITTER)
+                attr->num = jitter * 1000;
+            else
+                attr->num = mos * 1000;
+            break;
+        case SIP_ATTR_MEMORY:
+            attr->num = call->memory;
             break;
         default:
-            // Get attribute values
-            memset(onevalue, 0, sizeof(onevalue));
-            memset(twovalue, 0, sizeof(twovalue));
-            call_get_attribute(one, id, onevalue);
-            call_get_attribute(two, id, twovalue);
-            comparetype = 0;
+            attr->num = 0;
             break;
     }
 
-    switch (comparetype) {
-        case 0:
-            if (strlen(twovalue) == 0 && strlen(onevalue) == 0)
-                return 0;
-            if (strlen(twovalue) == 0)
-                return 1;
-            if (strlen(onevalue) == 0)
-                return -1;
-            return strcmp(onevalue, twovalue);
-        case 1:
-            if (oneintvalue == twointvalue) return 0;
-            if (oneintvalue > twointvalue) return 1;
-            if (oneintvalue < twointvalue) return -1;
-            /* no break */
-        default:
+    attr->changes = call->changes;
+    return attr;
+}
+
+const char *
+call_attr_text(sip_call_t *call, enum sip_attr_id id)
+{
+    sip_call_attr_t *attr;
+
+    if (!call || !(attr = call_attr_get(call, id)))
+        return NULL;
+
+    return attr->value;
+}
+
+int64_t
+call_attr_number(sip_call_t *call, enum sip_attr_id id)
+{
+    sip_call_attr_t *attr;
+
+    if (!call || !(attr = call_attr_get(call, id)))
+        return 0;
+
+    return attr->num;
+}
+
+int
+call_attr_compare(sip_call_t *one, sip_call_t *two, enum sip_attr_id id)
+{
+    const char *onevalue, *twovalue;
+    sip_msg_t *onemsg, *twomsg;
+    int64_t onenum, twonum;
+
+    // Interned headers with the same value share its address
+    if (id == SIP_ATTR_SIPFROM || id == SIP_ATTR_SIPTO) {
+        onemsg = vector_first(one->msgs);
+        twomsg = vector_first(two->msgs);
+        if (onemsg && twomsg && ((id == SIP_ATTR_SIPFROM) ? onemsg->sip_from == twomsg->sip_from
+                                                          : onemsg->sip_to == twomsg->sip_to))
             return 0;
     }
+
+    // Compare numeric attributes by its value
+    if (sip_attr_is_numeric(id)) {
+        onenum = call_attr_number(one, id);
+        twonum = call_attr_number(two, id);
+        return (onenum > twonum) - (onenum < twonum);
+    }
+
+    // Empty values are lesser than any other value
+    onevalue = call_attr_text(one, id);
+    twovalue = call_attr_text(two, id);
+    if (!onevalue || !twovalue)
+        return (onevalue != NULL) - (twovalue != NULL);
+    return strcmp(onevalue, twovalue);
 }
 
 void
@@ -33,12 +33,24 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include "vector.h"
+#include "arena.h"
+#include "treap.h"
 #include "rtp.h"
 #include "sip_msg.h"
 #include "sip_attr.h"
+#include "storage.h"
+
+//! Compression level of finished calls payloads (fastest)
+#define CALL_COMPRESS_LEVEL 1
 
 //! Shorter declaration of sip_call structure
 typedef struct sip_call sip_call_t;
+//! Shorter declaration of sip_call_path structure
+typedef struct sip_call_path sip_call_path_t;
+//! Shorter declaration of sip_call_attr structure
+typedef struct sip_call_attr sip_call_attr_t;
+//! Shorter declaration of sip_call_zblock structure
+typedef struct sip_call_zblock sip_call_zblock_t;
 
 //! SIP Call State
 enum call_state
@@ -52,6 +64,72 @@ enum call_state
     SIP_CALLSTATE_COMPLETED
 };
 
+//! Memory accounting categories of a call
+enum call_memory_type
+{
+    //! Call structure and arena: messages, headers, SDP media and streams
+    CALL_MEMORY_DIALOG = 0,
+    //! SIP packets structures and payloads
+    CALL_MEMORY_PAYLOADS,
+    //! SIP packets frames in memory
+    CALL_MEMORY_FRAMES,
+    //! Compressed blocks of SIP payloads and frames
+    CALL_MEMORY_COMPRESSED,
+    //! RTP packets, stream records and spool files
+    CALL_MEMORY_RTP,
+    //! Memory categories count
+    CALL_MEMORY_COUNT
+};
+
+/**
+ * @brief Last message sent between two addresses of a call
+ *
+ * Used to find the previous message with the same origin and destination
+ * without walking all the call messages.
+ */
+struct sip_call_path {
+    //! Message origin and destination
+    address_t src, dst;
+    //! Last message sent from origin to destination
+    sip_msg_t *last;
+    //! Next path of the call
+    sip_call_path_t *next;
+};
+
+/**
+ * @brief Cached value of a call attribute
+ *
+ * Attribute values are formatted once and reused until the call changes.
+ * Numeric attributes also store their value to be compared as numbers.
+ */
+struct sip_call_attr {
+    //! Call changes counter when this value was calculated
+    uint32_t changes;
+    //! Numeric value of the attribute
+    int64_t num;
+    //! Formatted value of the attribute (NULL if empty)
+    char *value;
+};
+
+/**
+ * @brief Compressed payloads and frames of a finished call
+ *
+ * Compressed packets keep their headers and frames list, but their payload
+ * and in-memory frames contents are moved into a single compressed block.
+ * Payloads are stored first, one after another and NULL terminated, followed
+ * by the frames contents (without the payload bytes they already contain).
+ */
+struct sip_call_zblock {
+    //! Compressed block
+    u_char *data;
+    //! Compressed and uncompressed sizes of the block
+    size_t len, rawlen;
+    //! Compressed packets (call messages packets in order)
+    packet_t **packets;
+    //! Number of compressed packets
+    int count;
+};
+
 /**
  * @brief Contains all information of a call and its messages
  *
@@ -64,16 +142,30 @@ struct sip_call {
     int index;
     // Call identifier
     char *callid;
-    //! Related Call identifier
-    char *xcallid;
+    //! Related Call identifier (interned)
+    const char *xcallid;
     //! Flag this call as filtered so won't be displayed
     signed char filtered;
+    //! Filters generation used to calculate filtered flag
+    uint32_t filter_gen;
+    //! Number of messages when filtered flag was calculated
+    uint32_t filter_msgs;
+    //! Messages checked against payload filter (-1 if any matched)
+    int filter_payload;
+    //! Trigrams signature of messages payloads (NULL if not indexed)
+    uint8_t *payload_sig;
     //! Call State. For dialogs starting with an INVITE method
     int state;
     //! Changed flag. For interface optimal updates
     bool changed;
+    //! Changes counter. Invalidates cached attribute values
+    uint32_t changes;
+    //! Cached attribute values (SIP_ATTR_COUNT items)
+    sip_call_attr_t *attrs;
     //! Locked flag. Calls locked are never deleted
     bool locked;
+    //! Running saves of this call. Saved calls keep all their packets
+    int saving;
     //! Last reason text value for this call
     char *reasontxt;
     //! Last warning text value for this call
@@ -90,6 +182,44 @@ struct sip_call {
     vector_t *streams;
     //! RTP packets for this call (capture_packet_t *)
     vector_t *rtp_packets;
+    //! Spool file with RTP packets not stored in memory (NULL if none)
+    storage_rtp_spool_t *rtp_spool;
+    //! Previous and next calls in capture order
+    sip_call_t *lru_prev, *lru_next;
+    //! Previous and next calls in the same expiry timer wheel slot
+    sip_call_t *expire_prev, *expire_next;
+    //! Capture time when this call expires (0 if not scheduled)
+    time_t expire;
+    //! Sort key for numeric sort attributes
+    int64_t sort_num;
+    //! Sort key for text sort attributes (NULL for empty values)
+    char *sort_str;
+    //! Node of this call in the displayed calls view
+    treap_node_t *view_node;
+    //! Call is pending to be checked by the displayed calls view
+    bool view_changed;
+    //! Memory used by this call messages and packets
+    size_t memory;
+    //! Memory used by this call in each accounting category
+    size_t memory_types[CALL_MEMORY_COUNT];
+    //! Memory for messages, strings, SDP media and streams of this call
+    arena_t *arena;
+    //! Last message of each origin and destination (in call arena)
+    sip_call_path_t *paths;
+    //! Compressed messages payloads and frames (NULL if not compressed)
+    sip_call_zblock_t *zblock;
+    //! Previous and next calls waiting to be compressed
+    sip_call_t *compress_prev, *compress_next;
+    //! Time when this call will be compressed (0 if not queued)
+    time_t compress_time;
+    //! Call has been uncompressed. It won't be compressed again
+    bool uncompressed;
+    //! Summary record of this call has been exported
+    bool cdr_exported;
+    //! Dump file number of the first written packet
+    uint32_t dump_file;
+    //! Dump file offset of the first written packet (-1 if not written)
+    int64_t dump_offset;
 };
 
 /**
@@ -98,6 +228,9 @@ struct sip_call {
  * Allocated required memory for a new SIP Call. The call acts as
  * header structure to all the messages with the same callid.
  *
+ * Each call owns a memory arena used by all its messages, SDP media
+ * and RTP streams, that is released when the call is destroyed.
+ *
  * @param callid Call-ID Header value
  * @param xcallid X-Call-ID Header value
  * @return pointer to the sip_call created
@@ -162,11 +295,95 @@ call_add_stream(sip_call_t *call, rtp_stream_t *stream);
 /**
  * @brief Append a new RTP packet to the call
  *
+ * Depending on RTP storage policy, the packet is stored in the call or in
+ * its stream, or only its RTP header is stored.
+ *
  * @param call pointer to the call owner of the stream
+ * @param stream stream of the packet
  * @param packet new RTP packet from call rtp streams
+ * @return true if the packet has been stored, false if it can be destroyed
+ */
+bool
+call_add_rtp_packet(sip_call_t *call, rtp_stream_t *stream, packet_t *packet);
+
+/**
+ * @brief Update memory used by the call
+ *
+ * Call memory is also added to the call list memory usage
+ *
+ * @param call pointer to the call
+ * @param type accounting category of the memory
+ * @param bytes memory bytes allocated (or deallocated if negative)
+ */
+void
+call_add_memory(sip_call_t *call, enum call_memory_type type, int64_t bytes);
+
+/**
+ * @brief Update memory used by a call packet
+ *
+ * RTP packets are accounted as RTP memory. SIP packets memory is split
+ * between their payloads and their frames.
+ *
+ * @param call pointer to the call
+ * @param packet packet owned by the call
+ * @param sign 1 when the packet memory is added, -1 when it is removed
+ */
+void
+call_add_packet_memory(sip_call_t *call, packet_t *packet, int sign);
+
+/**
+ * @brief Get the name of a call memory category
+ */
+const char *
+call_memory_type_name(enum call_memory_type type);
+
+/**
+ * @brief Check if calls payloads can be compressed
+ *
+ * @return true if sngrep has been built with a compression library
+ */
+bool
+call_compress_supported();
+
+/**
+ * @brief Compress call messages payloads and frames
+ *
+ * Calls being saved are not compressed.
+ *
+ * @param call pointer to the call
+ * @return 0 if call has been compressed, 1 otherwise
+ */
+int
+call_compress(sip_call_t *call);
+
+/**
+ * @brief Restore call messages payloads and frames
+ *
+ * @param call pointer to the call
+ * @return 0 if call is not compressed anymore, 1 otherwise
+ */
+int
+call_uncompress(sip_call_t *call);
+
+/**
+ * @brief Get a copy of compressed messages payloads
+ *
+ * The call is not uncompressed. Payloads of the compressed packets are
+ * stored one after another, each one NULL terminated.
+ *
+ * @param call pointer to the call
+ * @return allocated payloads or NULL if they are not available
+ */
+u_char *
+call_compressed_payloads(sip_call_t *call);
+
+/**
+ * @brief Remove all RTP packets stored in the call
+ *
+ * @param call pointer to the call
  */
 void
-call_add_rtp_packet(sip_call_t *call, packet_t *packet);
+call_free_rtp_packets(sip_call_t *call);
 
 /**
  * @brief Getter for call messages linked list size
@@ -201,8 +418,9 @@ call_is_invite(sip_call_t *call);
 /**
  * @brief Check if a message is a retransmission
  *
- * This function will compare its payload with the previous message
- * in the dialog, to check if it has the same content.
+ * This function will compare its payload fingerprint with the previous
+ * message in the dialog with the same origin and destination, to check
+ * if it has the same content.
  *
  * @param msg SIP message that will be checked
  */
@@ -228,6 +446,18 @@ call_msg_with_media(sip_call_t *call, address_t dst);
 void
 call_update_state(sip_call_t *call, sip_msg_t *msg);
 
+/**
+ * @brief Get the worst quality values of call RTP streams
+ *
+ * @param call SIP call structure
+ * @param loss Worst packet loss percentage
+ * @param jitter Worst jitter (ms)
+ * @param mos Worst estimated MOS
+ * @return number of RTP streams with received packets
+ */
+int
+call_rtp_quality(sip_call_t *call, double *loss, double *jitter, double *mos);
+
 /**
  * @brief Return a call attribute value
  *
@@ -241,6 +471,32 @@ call_update_state(sip_call_t *call, sip_msg_t *msg);
 const char *
 call_get_attribute(struct sip_call *call, enum sip_attr_id id, char *value);
 
+/**
+ * @brief Return the cached value of a call attribute
+ *
+ * Value is formatted the first time is requested and stored until
+ * the call changes.
+ *
+ * @param call SIP call structure
+ * @param id Attribute id
+ * @return Attribute value or NULL if empty
+ */
+const char *
+call_attr_text(sip_call_t *call, enum sip_attr_id id);
+
+/**
+ * @brief Return the cached numeric value of a call attribute
+ *
+ * Only attributes flagged as numeric have a numeric value. Dates are
+ * returned in microseconds and durations in seconds (-1 if empty).
+ *
+ * @param call SIP call structure
+ * @param id Attribute id
+ * @return Attribute numeric value or 0 for non numeric attributes
+ */
+int64_t
+call_attr_number(sip_call_t *call, enum sip_attr_id id);
+
 /**
  * @brief Return the string represtation of a call state
  *
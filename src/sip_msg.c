@@ -28,16 +28,20 @@
  * This file contains the functions and structure to manage SIP message data
  *
  */
+#include <ctype.h>
 #include "sip_msg.h"
 #include "media.h"
 #include "sip.h"
+#include "intern.h"
+#include "setting.h"
 
 sip_msg_t *
-msg_create()
+msg_create(struct sip_call *call)
 {
     sip_msg_t *msg;
-    if (!(msg = sng_malloc(sizeof(sip_msg_t))))
+    if (!(msg = arena_alloc(call->arena, sizeof(sip_msg_t))))
         return NULL;
+    msg->call = call;
     return msg;
 }
 
@@ -50,11 +54,11 @@ msg_destroy(sip_msg_t *msg)
 
     // Free message packets
     packet_destroy(msg->packet);
-    // Free all memory
-    sng_free(msg->resp_str);
-    sng_free(msg->sip_from);
-    sng_free(msg->sip_to);
-    sng_free(msg);
+
+    // Release message shared strings
+    intern_release(msg->resp_str);
+    intern_release(msg->sip_from);
+    intern_release(msg->sip_to);
 }
 
 void
@@ -97,33 +101,112 @@ msg_add_media(sip_msg_t *msg, sdp_media_t *media)
     vector_append(msg->medias, media);
 }
 
+uint64_t
+msg_fingerprint(sip_msg_t *msg)
+{
+    // FNV-1a hash of lowercase payload
+    const u_char *payload = packet_payload(msg->packet);
+    uint32_t len = packet_payloadlen(msg->packet);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (uint64_t) tolower(payload[i]);
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
 const char *
 msg_get_payload(sip_msg_t *msg)
 {
+    // Compressed calls are restored when their payloads are needed
+    if (msg->call && msg->call->zblock && call_uncompress(msg->call) != 0)
+        return "";
     return (const char *) packet_payload(msg->packet);
 }
 
+void
+msg_set_headers(sip_msg_t *msg, const sip_headers_t *hdrs)
+{
+    if (!hdrs->count)
+        return;
+
+    if ((msg->headers = arena_alloc(msg->call->arena, sizeof(sip_hdr_entry_t) * hdrs->count))) {
+        memcpy(msg->headers, hdrs->index, sizeof(sip_hdr_entry_t) * hdrs->count);
+        msg->nheaders = hdrs->count;
+    }
+}
+
+int
+msg_get_header(sip_msg_t *msg, const char *name, sip_hdr_t *hdr)
+{
+    sip_headers_t hdrs;
+    const char *payload = msg_get_payload(msg);
+
+    // Index headers of messages not scanned while captured
+    if (!msg->headers) {
+        sip_parser_scan(payload, packet_payloadlen(msg->packet), NULL, &hdrs);
+        msg_set_headers(msg, &hdrs);
+    }
+
+    return sip_parser_header(payload, msg->headers, msg->nheaders, name, hdr);
+}
+
 struct timeval
 msg_get_time(sip_msg_t *msg) {
     struct timeval t = { };
     frame_t *frame;
 
     if (msg && (frame = vector_first(msg->packet->frames)))
-        return frame->header->ts;
+        return frame->header.ts;
     return t;
 }
 
+/**
+ * @brief Copy a message header value into an attribute buffer
+ *
+ * @param uri Only copy the URI of From/To like header values
+ */
+static void
+msg_get_header_attribute(sip_msg_t *msg, const char *name, bool uri, char *value)
+{
+    sip_hdr_t hdr;
+
+    if (!name || !strlen(name) || msg_get_header(msg, name, &hdr) != 0)
+        return;
+    if (uri && sip_parser_header_uri(msg_get_payload(msg), hdr, &hdr) != 0)
+        return;
+    sip_parser_value(msg_get_payload(msg), hdr, value, SIP_ATTR_MAXLEN + 1);
+}
+
 const char *
 msg_get_attribute(sip_msg_t *msg, int id, char *value)
 {
     char *ar;
+    char ip[ADDRESSLEN];
+
+    // Messages not parsed when stored only have the headers index
+    if (!msg->sip_from && (id == SIP_ATTR_SIPFROM || id == SIP_ATTR_SIPFROMUSER)) {
+        msg_get_header_attribute(msg, "From", true, value);
+        if (id == SIP_ATTR_SIPFROMUSER && (ar = strchr(value, '@')))
+            *ar = '\0';
+        return strlen(value) ? value : NULL;
+    }
+    if (!msg->sip_to && (id == SIP_ATTR_SIPTO || id == SIP_ATTR_SIPTOUSER)) {
+        msg_get_header_attribute(msg, "To", true, value);
+        if (id == SIP_ATTR_SIPTOUSER && (ar = strchr(value, '@')))
+            *ar = '\0';
+        return strlen(value) ? value : NULL;
+    }
 
     switch (id) {
         case SIP_ATTR_SRC:
-            sprintf(value, "%s:%u", msg->packet->src.ip, msg->packet->src.port);
+            sprintf(value, "%s:%u", address_get_ip(msg->packet->src, ip), msg->packet->src.port);
             break;
         case SIP_ATTR_DST:
-            sprintf(value, "%s:%u", msg->packet->dst.ip, msg->packet->dst.port);
+            sprintf(value, "%s:%u", address_get_ip(msg->packet->dst, ip), msg->packet->dst.port);
             break;
         case SIP_ATTR_METHOD:
             sprintf(value, "%.*s", SIP_ATTR_MAXLEN, sip_get_msg_reqresp_str(msg));
@@ -136,12 +219,12 @@ msg_get_attribute(sip_msg_t *msg, int id, char *value)
             break;
         case SIP_ATTR_SIPFROMUSER:
             if ((ar = strchr(msg->sip_from, '@'))) {
-                strncpy(value, msg->sip_from, ar - msg->sip_from);
+                sprintf(value, "%.*s", (int) (ar - msg->sip_from), msg->sip_from);
             }
             break;
         case SIP_ATTR_SIPTOUSER:
             if ((ar = strchr(msg->sip_to, '@'))) {
-                strncpy(value, msg->sip_to, ar - msg->sip_to);
+                sprintf(value, "%.*s", (int) (ar - msg->sip_to), msg->sip_to);
             }
             break;
         case SIP_ATTR_DATE:
@@ -150,6 +233,12 @@ msg_get_attribute(sip_msg_t *msg, int id, char *value)
         case SIP_ATTR_TIME:
             timeval_to_time(msg_get_time(msg), value);
             break;
+        case SIP_ATTR_USERAGENT:
+            msg_get_header_attribute(msg, "User-Agent", false, value);
+            break;
+        case SIP_ATTR_HEADER:
+            msg_get_header_attribute(msg, setting_get_value(SETTING_SIP_HEADER_CUSTOM), false, value);
+            break;
         default:
             fprintf(stderr, "Unhandled attribute %s (%d)\n", sip_attr_get_name(id), id); abort();
         break;
@@ -34,6 +34,7 @@
 #include "vector.h"
 #include "media.h"
 #include "sip_attr.h"
+#include "sip_parser.h"
 #include "util.h"
 
 //! Shorter declaration of sip_msg structure
@@ -52,14 +53,14 @@ struct sip_call;
 struct sip_msg {
     //! Request Method or Response Code @see sip_methods
     int reqresp;
-    //!  Response text if it doesn't matches an standard
-    char *resp_str;
+    //!  Response text if it doesn't matches an standard (interned)
+    const char *resp_str;
     //! Message Cseq
     uint32_t cseq;
-    //! SIP From Header
-    char *sip_from;
-    //! SIP To Header
-    char *sip_to;
+    //! SIP From Header (interned)
+    const char *sip_from;
+    //! SIP To Header (interned)
+    const char *sip_to;
     //! SDP payload information (sdp_media_t *)
     vector_t *medias;
     //! Captured packet for this message
@@ -70,28 +71,34 @@ struct sip_msg {
     struct sip_call *call;
     //! Message is a retransmission from other message
     sip_msg_t *retrans;
+    //! Payload fingerprint used to detect retransmissions
+    uint64_t fingerprint;
+    //! Location of payload headers (allocated in call arena)
+    sip_hdr_entry_t *headers;
+    //! Number of indexed headers
+    uint16_t nheaders;
 };
 
 
 /**
- * @brief Create a new message from the readed header and payload
+ * @brief Create a new message for the given call
  *
- * Allocate required memory for a new SIP message. This function
- * will only store the given information, but wont parse it until
- * needed.
+ * Allocate required memory for a new SIP message from the call
+ * memory arena. This function will only create the message, but
+ * wont add it to the call messages list.
  *
- * @param payload Raw payload content
+ * @param call Call owner of the message
  * @return a new allocated message
  */
 sip_msg_t *
-msg_create();
+msg_create(struct sip_call *call);
 
 /**
  * @brief Destroy a SIP message and free its memory
  *
- * Deallocate memory of an existing SIP Message.
- * This function will remove the message from the call and the
- * passed pointer will be NULL.
+ * Deallocate the packet and media list of an existing SIP Message.
+ * Message data itself lives in its call arena and will be released
+ * with the call.
  *
  * @param nsg SIP message to be deleted
  */
@@ -158,12 +165,49 @@ msg_is_request(sip_msg_t *msg);
 void
 msg_add_media(sip_msg_t *msg, sdp_media_t *media);
 
+/**
+ * @brief Calculate the fingerprint of the message payload
+ *
+ * Fingerprint is a case insensitive 64 bits hash of the payload, so
+ * two messages with the same payload will have the same fingerprint.
+ *
+ * @param msg SIP message with packet payload
+ * @return payload fingerprint
+ */
+uint64_t
+msg_fingerprint(sip_msg_t *msg);
+
 /**
  * @brief Get SIP Message payload
  */
 const char *
 msg_get_payload(sip_msg_t *msg);
 
+/**
+ * @brief Store the headers index of a scanned message
+ *
+ * Header locations are copied into the call arena so any header value
+ * can be later retrieved without scanning the payload again.
+ *
+ * @param msg SIP message
+ * @param hdrs Scanned headers of the message payload
+ */
+void
+msg_set_headers(sip_msg_t *msg, const sip_headers_t *hdrs);
+
+/**
+ * @brief Get a header value of the message
+ *
+ * Messages without headers index are scanned on first request.
+ *
+ * @param msg SIP message
+ * @param name Header full or compact name
+ * @param hdr Structure to store the value location
+ * @return 0 if header has been found, 1 otherwise
+ */
+int
+msg_get_header(sip_msg_t *msg, const char *name, sip_hdr_t *hdr);
+
 /**
  * @brief Get Time of message from packet header
  *
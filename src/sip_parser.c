@@ -0,0 +1,532 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_parser.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in sip_parser.h
+ */
+
+#include "config.h"
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "sip_parser.h"
+
+/**
+ * @brief Get the next line feed of the payload
+ *
+ * Same as memchr(p, '\n', end - p), but checking 16 bytes per iteration
+ * inline where SSE2 or NEON instructions are available. Most SIP lines
+ * are shorter than the setup cost of a library call.
+ *
+ * @return line feed position or NULL if not found
+ */
+static inline const char *
+sip_parser_eol(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i lf = _mm_set1_epi8('\n');
+    int mask;
+
+    for (; end - p >= 16; p += 16) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p), lf));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    uint64_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        // Narrow each compared byte to 4 bits to get a 64 bits mask
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(
+                   vceqq_u8(vld1q_u8((const uint8_t *) p), lf)), 4)), 0);
+        if (mask)
+            return p + (__builtin_ctzll(mask) >> 2);
+    }
+#endif
+    return (p < end) ? memchr(p, '\n', end - p) : NULL;
+}
+
+/**
+ * @brief Check if a header name is the given full or compact name
+ */
+static bool
+sip_parser_name_is(const char *name, uint32_t namelen, const char *full, char compact)
+{
+    if (namelen == strlen(full) && !strncasecmp(name, full, namelen))
+        return true;
+    if (compact && namelen == 1 && tolower(*name) == compact)
+        return true;
+    return false;
+}
+
+/**
+ * @brief Check if a header name is in a '|' separated list of names
+ */
+static bool
+sip_parser_name_in(const char *name, uint32_t namelen, const char *names)
+{
+    const char *next;
+
+    while (names && *names) {
+        if (!(next = strchr(names, '|')))
+            next = names + strlen(names);
+        if (next - names == namelen && !strncasecmp(name, names, namelen))
+            return true;
+        names = (*next) ? next + 1 : next;
+    }
+    return false;
+}
+
+/**
+ * @brief Store value location if it has not been found yet
+ */
+static void
+sip_parser_set(sip_hdr_t *hdr, const char *payload, const char *start, const char *end)
+{
+    if (hdr->len == 0 && end > start) {
+        hdr->off = start - payload;
+        hdr->len = end - start;
+    }
+}
+
+/**
+ * @brief Get the end of a non blank token
+ */
+static const char *
+sip_parser_token(const char *p, const char *end)
+{
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+    return p;
+}
+
+/**
+ * @brief Get the end of a digits sequence
+ */
+static const char *
+sip_parser_digits(const char *p, const char *end)
+{
+    while (p < end && isdigit(*p))
+        p++;
+    return p;
+}
+
+/**
+ * @brief Get From/To URI from the header value
+ *
+ * This skips the display name and URI scheme and stores the URI value
+ * until its parameters or closing bracket.
+ */
+static void
+sip_parser_uri(sip_hdr_t *hdr, const char *payload, const char *p, const char *end)
+{
+    const char *start, *at;
+
+    // Skip everything until the scheme separator
+    if (!(p = memchr(p, ':', end - p)))
+        return;
+    start = at = ++p;
+
+    // User part can contain parameters separators
+    while (at < end && *at != '@' && *at != '>')
+        at++;
+
+    if (at < end && *at == '@') {
+        p = at + 1;
+    } else {
+        p = start;
+    }
+
+    // Host part ends with parameters or closing bracket
+    while (p < end && *p != '>' && *p != ';')
+        p++;
+
+    sip_parser_set(hdr, payload, start, p);
+}
+
+/**
+ * @brief Get Reason header text parameter
+ */
+static void
+sip_parser_reason(sip_hdr_t *hdr, const char *payload, const char *p, const char *end)
+{
+    const char *start, *last;
+
+    // Look for text parameter
+    for (; p + 7 <= end; p++) {
+        if (!strncasecmp(p, ";text=\"", 7))
+            break;
+    }
+    if (p + 7 > end)
+        return;
+
+    // Quoted text ends in the last quote of the line
+    start = p + 7;
+    for (last = end - 1; last > start && *last != '"'; last--);
+
+    if (last > start && *last == '"')
+        sip_parser_set(hdr, payload, start, last);
+}
+
+/**
+ * @brief Parse the first line of the message
+ */
+static void
+sip_parser_start_line(sip_headers_t *hdrs, const char *payload, const char *end, bool cr)
+{
+    const char *p = payload, *method_end, *line_end;
+
+    if (end - p >= 11 && !strncasecmp(p, "SIP/2.0", 7)) {
+        // Response line
+        p += 7;
+        hdrs->valid = (*p == ' ' && sip_parser_digits(p + 1, end) - (p + 1) >= 3);
+        while (p < end && *p == ' ')
+            p++;
+        if (cr && end - p >= 4 && sip_parser_digits(p, end) == p + 3 && p[3] == ' ') {
+            sip_parser_set(&hdrs->code, payload, p, p + 3);
+            sip_parser_set(&hdrs->response, payload, p, end);
+        }
+        return;
+    }
+
+    // Request line: METHOD scheme:uri SIP/2.0
+    while (p < end && isalpha(*p))
+        p++;
+    if (p == payload || p >= end || *p != ' ')
+        return;
+    method_end = p++;
+
+    while (p < end && isalpha(*p))
+        p++;
+    if (p == method_end + 1 || p >= end || *p != ':')
+        return;
+    hdrs->valid = true;
+
+    // Check request line ends with SIP version
+    for (line_end = end; line_end > p && line_end[-1] == ' '; line_end--);
+    if (cr && line_end - p > 9 && !strncasecmp(line_end - 8, " SIP/2.0", 8))
+        sip_parser_set(&hdrs->method, payload, payload, method_end);
+}
+
+/**
+ * @brief Add a header location to the headers index
+ */
+static void
+sip_parser_index(sip_headers_t *hdrs, const char *payload, const char *name, const char *name_end,
+                 const char *value, const char *end, int id)
+{
+    sip_hdr_entry_t *entry;
+
+    if (hdrs->count == SIP_PARSER_MAX_HEADERS || name_end - name > UINT8_MAX)
+        return;
+
+    // Ignore value trailing spaces
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+
+    entry = &hdrs->index[hdrs->count++];
+    entry->name = name - payload;
+    entry->namelen = name_end - name;
+    entry->off = value - payload;
+    entry->len = (end - value > UINT16_MAX) ? UINT16_MAX : end - value;
+    entry->id = id;
+}
+
+int
+sip_parser_header_id(const char *name, uint32_t namelen)
+{
+    if (!namelen)
+        return SIP_HDR_OTHER;
+
+    switch (tolower(*name)) {
+        case 'c':
+        case 'i':
+        case 'l':
+        case 'm':
+            if (sip_parser_name_is(name, namelen, "Call-ID", 'i'))
+                return SIP_HDR_CALLID;
+            if (sip_parser_name_is(name, namelen, "CSeq", 0))
+                return SIP_HDR_CSEQ;
+            if (sip_parser_name_is(name, namelen, "Contact", 'm'))
+                return SIP_HDR_CONTACT;
+            if (sip_parser_name_is(name, namelen, "Content-Type", 'c'))
+                return SIP_HDR_CONTENT_TYPE;
+            if (sip_parser_name_is(name, namelen, "Content-Length", 'l'))
+                return SIP_HDR_CONTENT_LENGTH;
+            break;
+        case 'f':
+            if (sip_parser_name_is(name, namelen, "From", 'f'))
+                return SIP_HDR_FROM;
+            break;
+        case 't':
+            if (sip_parser_name_is(name, namelen, "To", 't'))
+                return SIP_HDR_TO;
+            break;
+        case 'v':
+            if (sip_parser_name_is(name, namelen, "Via", 'v'))
+                return SIP_HDR_VIA;
+            break;
+        case 'u':
+            if (sip_parser_name_is(name, namelen, "User-Agent", 0))
+                return SIP_HDR_USER_AGENT;
+            break;
+        case 'r':
+            if (sip_parser_name_is(name, namelen, "Reason", 0))
+                return SIP_HDR_REASON;
+            break;
+        case 'w':
+            if (sip_parser_name_is(name, namelen, "Warning", 0))
+                return SIP_HDR_WARNING;
+            break;
+        default:
+            break;
+    }
+
+    return SIP_HDR_OTHER;
+}
+
+int
+sip_parser_scan(const char *payload, uint32_t len, const char *xcid, sip_headers_t *hdrs)
+{
+    const char *line, *end, *next, *name, *name_end, *value, *digits;
+    const char *limit = payload + len;
+    bool cr;
+    int id;
+
+    // Initialize scanned headers (index entries are only set when added)
+    memset(hdrs, 0, offsetof(sip_headers_t, index));
+    hdrs->body = -1;
+
+    for (line = payload; line < limit; line = next) {
+        // Get the end of this line
+        if ((end = sip_parser_eol(line, limit))) {
+            next = end + 1;
+        } else {
+            end = next = limit;
+        }
+
+        // Ignore line end carriage returns
+        if ((cr = (end > line && end[-1] == '\r')))
+            end--;
+
+        // First line is the request or response line
+        if (line == payload) {
+            sip_parser_start_line(hdrs, payload, end, cr);
+            // Not a SIP message, nothing else to scan
+            if (!hdrs->valid)
+                return 1;
+            continue;
+        }
+
+        // Empty line separates headers from body
+        if (end == line) {
+            if (next != limit || limit[-1] == '\n')
+                hdrs->body = next - payload;
+            break;
+        }
+
+        // Skip folded header lines
+        if (*line == ' ' || *line == '\t')
+            continue;
+
+        // Get header name
+        name = line;
+        if (!(name_end = memchr(name, ':', end - name)))
+            continue;
+        value = name_end + 1;
+        while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t'))
+            name_end--;
+
+        // Skip value leading spaces
+        while (value < end && (*value == ' ' || *value == '\t'))
+            value++;
+
+        id = sip_parser_header_id(name, name_end - name);
+        switch (id) {
+            case SIP_HDR_CALLID:
+                sip_parser_set(&hdrs->callid, payload, value, sip_parser_token(value, end));
+                break;
+            case SIP_HDR_CSEQ:
+                digits = sip_parser_digits(value, end);
+                if (digits - value <= 10 && digits < end && *digits == ' ')
+                    sip_parser_set(&hdrs->cseq, payload, value, digits);
+                break;
+            case SIP_HDR_CONTENT_LENGTH:
+                sip_parser_set(&hdrs->cl, payload, value, sip_parser_digits(value, end));
+                break;
+            case SIP_HDR_FROM:
+                sip_parser_uri(&hdrs->from, payload, value, end);
+                break;
+            case SIP_HDR_TO:
+                sip_parser_uri(&hdrs->to, payload, value, end);
+                break;
+            case SIP_HDR_REASON:
+                sip_parser_reason(&hdrs->reason, payload, value, end);
+                break;
+            case SIP_HDR_WARNING:
+                sip_parser_set(&hdrs->warning, payload, value, sip_parser_digits(value, end));
+                break;
+            default:
+                break;
+        }
+
+        // Store header location for later lookups
+        sip_parser_index(hdrs, payload, name, name_end, value, end, id);
+
+        // Configurable X-Call-ID headers
+        if (!hdrs->xcallid.len && sip_parser_name_in(name, name_end - name, xcid))
+            sip_parser_set(&hdrs->xcallid, payload, value, sip_parser_token(value, end));
+    }
+
+    return 0;
+}
+
+int
+sip_parser_header(const char *payload, const sip_hdr_entry_t *index, uint16_t count,
+                  const char *name, sip_hdr_t *value)
+{
+    uint32_t namelen = strlen(name);
+    int id = sip_parser_header_id(name, namelen);
+    uint16_t i;
+
+    for (i = 0; i < count; i++) {
+        if ((id != SIP_HDR_OTHER) ? index[i].id == id
+                                  : (index[i].id == SIP_HDR_OTHER && index[i].namelen == namelen
+                                     && !strncasecmp(payload + index[i].name, name, namelen))) {
+            value->off = index[i].off;
+            value->len = index[i].len;
+            return 0;
+        }
+    }
+
+    memset(value, 0, sizeof(sip_hdr_t));
+    return 1;
+}
+
+int
+sip_parser_header_uri(const char *payload, sip_hdr_t value, sip_hdr_t *uri)
+{
+    memset(uri, 0, sizeof(sip_hdr_t));
+    sip_parser_uri(uri, payload, payload + value.off, payload + value.off + value.len);
+    return (uri->len) ? 0 : 1;
+}
+
+int
+sip_parser_callid(const char *payload, uint32_t len, sip_hdr_t *callid)
+{
+    const char *line, *end, *next, *name_end, *value;
+    const char *limit = payload + len;
+
+    memset(callid, 0, sizeof(sip_hdr_t));
+
+    // Skip the first line
+    if (!(line = sip_parser_eol(payload, limit)))
+        return 1;
+
+    for (line++; line < limit; line = next) {
+        // Get the end of this line
+        if ((end = sip_parser_eol(line, limit))) {
+            next = end + 1;
+        } else {
+            end = next = limit;
+        }
+        if (end > line && end[-1] == '\r')
+            end--;
+
+        // No Call-ID in the header block
+        if (end == line)
+            break;
+
+        // Only Call-ID header is interesting
+        if (tolower(*line) != 'c' && tolower(*line) != 'i')
+            continue;
+        if (!(name_end = memchr(line, ':', end - line)))
+            continue;
+        value = name_end + 1;
+        while (name_end > line && (name_end[-1] == ' ' || name_end[-1] == '\t'))
+            name_end--;
+        if (!sip_parser_name_is(line, name_end - line, "Call-ID", 'i'))
+            continue;
+
+        while (value < end && (*value == ' ' || *value == '\t'))
+            value++;
+        sip_parser_set(callid, payload, value, sip_parser_token(value, end));
+        return (callid->len) ? 0 : 1;
+    }
+
+    return 1;
+}
+
+bool
+sip_parser_start(const char *payload, uint32_t len)
+{
+    const char *p = payload, *end = payload + len;
+
+    // Response line: SIP/2.0 code
+    if (len >= 11 && !strncasecmp(p, "SIP/2.0 ", 8))
+        return sip_parser_digits(p + 8, end) - (p + 8) >= 3;
+
+    // Request line: METHOD scheme:
+    while (p < end && isalpha(*p))
+        p++;
+    if (p == payload || p >= end || *p != ' ')
+        return false;
+    payload = ++p;
+    while (p < end && isalpha(*p))
+        p++;
+    return p != payload && p < end && *p == ':';
+}
+
+int32_t
+sip_parser_body(const char *payload, uint32_t len, uint32_t from)
+{
+    const char *p = payload + from, *limit = payload + len;
+
+    // Empty line is a line feed followed by another one or CRLF
+    for (; (p = sip_parser_eol(p, limit)); p++) {
+        if (p + 1 < limit && p[1] == '\n')
+            return p + 2 - payload;
+        if (p + 2 < limit && p[1] == '\r' && p[2] == '\n')
+            return p + 3 - payload;
+    }
+
+    return -1;
+}
+
+char *
+sip_parser_value(const char *payload, sip_hdr_t hdr, char *out, uint32_t outlen)
+{
+    uint32_t len = (hdr.len < outlen) ? hdr.len : outlen - 1;
+
+    memcpy(out, payload + hdr.off, len);
+    out[len] = '\0';
+    return out;
+}
@@ -0,0 +1,245 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_parser.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to scan SIP message headers
+ *
+ * This file contains a single pass scanner for SIP headers. Instead of
+ * running one regular expression for each required header, the header
+ * block is walked once storing the offsets of the interesting values.
+ */
+
+#ifndef __SNGREP_SIP_PARSER_H
+#define __SNGREP_SIP_PARSER_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+//! Max number of headers stored in the headers index
+#define SIP_PARSER_MAX_HEADERS 48
+
+//! Shorter declaration of sip_hdr structure
+typedef struct sip_hdr sip_hdr_t;
+//! Shorter declaration of sip_hdr_entry structure
+typedef struct sip_hdr_entry sip_hdr_entry_t;
+//! Shorter declaration of sip_headers structure
+typedef struct sip_headers sip_headers_t;
+
+/**
+ * @brief Location of a header value in the payload
+ *
+ * A value with zero length is considered not found
+ */
+struct sip_hdr {
+    //! Offset from the payload start
+    uint32_t off;
+    //! Length of the value
+    uint32_t len;
+};
+
+/**
+ * @brief Well known header names
+ *
+ * Headers with any other name are indexed as SIP_HDR_OTHER and looked
+ * up comparing their names.
+ */
+enum sip_hdr_name {
+    SIP_HDR_OTHER = 0,
+    SIP_HDR_CALLID,
+    SIP_HDR_CSEQ,
+    SIP_HDR_FROM,
+    SIP_HDR_TO,
+    SIP_HDR_VIA,
+    SIP_HDR_CONTACT,
+    SIP_HDR_CONTENT_TYPE,
+    SIP_HDR_CONTENT_LENGTH,
+    SIP_HDR_USER_AGENT,
+    SIP_HDR_REASON,
+    SIP_HDR_WARNING,
+};
+
+/**
+ * @brief Location of a header in the payload
+ */
+struct sip_hdr_entry {
+    //! Header name offset from the payload start
+    uint32_t name;
+    //! Header value offset from the payload start
+    uint32_t off;
+    //! Length of the value first line
+    uint16_t len;
+    //! Header name id @see sip_hdr_name
+    uint8_t id;
+    //! Length of the header name
+    uint8_t namelen;
+};
+
+/**
+ * @brief Scanned SIP message headers
+ */
+struct sip_headers {
+    //! First line is a SIP request or response
+    bool valid;
+    //! Request method (only for requests)
+    sip_hdr_t method;
+    //! Response code and text (only for responses)
+    sip_hdr_t response;
+    //! Response code (only for responses)
+    sip_hdr_t code;
+    //! Call-ID header value
+    sip_hdr_t callid;
+    //! X-Call-ID header value
+    sip_hdr_t xcallid;
+    //! CSeq header number
+    sip_hdr_t cseq;
+    //! From header URI
+    sip_hdr_t from;
+    //! To header URI
+    sip_hdr_t to;
+    //! Content-Length header value
+    sip_hdr_t cl;
+    //! Reason header text
+    sip_hdr_t reason;
+    //! Warning header code
+    sip_hdr_t warning;
+    //! Body offset (-1 if header block is not complete)
+    int32_t body;
+    //! Number of headers in the index
+    uint16_t count;
+    //! Location of each header in payload order (not initialized after count)
+    sip_hdr_entry_t index[SIP_PARSER_MAX_HEADERS];
+};
+
+/**
+ * @brief Scan SIP payload headers
+ *
+ * Walk the header block of the payload once, storing the offsets of the
+ * start line values and the headers required by sngrep. The location of
+ * every header is also added to the headers index, up to
+ * SIP_PARSER_MAX_HEADERS headers.
+ *
+ * @param payload SIP message payload
+ * @param len payload length
+ * @param xcid '|' separated list of X-Call-ID header names
+ * @param hdrs Structure to store the scanned offsets
+ * @return 0 if the first line is a SIP request or response, 1 otherwise
+ */
+int
+sip_parser_scan(const char *payload, uint32_t len, const char *xcid, sip_headers_t *hdrs);
+
+/**
+ * @brief Get well known header id from its name
+ *
+ * @param name Header full or compact name
+ * @param namelen Length of the name
+ * @return header id or SIP_HDR_OTHER if name is not well known
+ */
+int
+sip_parser_header_id(const char *name, uint32_t namelen);
+
+/**
+ * @brief Find a header in the headers index
+ *
+ * Well known headers are compared by id, so compact names will be also
+ * found. Other headers are compared by name ignoring case.
+ *
+ * @param payload SIP message payload
+ * @param index Headers index
+ * @param count Number of headers in the index
+ * @param name Header name
+ * @param value Structure to store the first found header value location
+ * @return 0 if header has been found, 1 otherwise
+ */
+int
+sip_parser_header(const char *payload, const sip_hdr_entry_t *index, uint16_t count,
+                  const char *name, sip_hdr_t *value);
+
+/**
+ * @brief Get URI location from a From/To like header value
+ *
+ * @param payload SIP message payload
+ * @param value Header value location
+ * @param uri Structure to store the URI location
+ * @return 0 if an URI has been found, 1 otherwise
+ */
+int
+sip_parser_header_uri(const char *payload, sip_hdr_t value, sip_hdr_t *uri);
+
+/**
+ * @brief Find Call-ID header value
+ *
+ * Walk the header block until Call-ID is found, without checking
+ * the message start line or any other header.
+ *
+ * @param payload SIP message payload
+ * @param len payload length
+ * @param callid Structure to store the value location
+ * @return 0 if Call-ID header has been found, 1 otherwise
+ */
+int
+sip_parser_callid(const char *payload, uint32_t len, sip_hdr_t *callid);
+
+/**
+ * @brief Check if payload could start with a SIP request or response line
+ *
+ * Only the first bytes of the payload are checked, accepting at least
+ * all start lines considered valid by @sip_parser_scan, so non SIP
+ * payloads can be discarded before any further processing.
+ *
+ * @param payload Packet payload
+ * @param len payload length
+ * @return true if payload could be a SIP message
+ */
+bool
+sip_parser_start(const char *payload, uint32_t len);
+
+/**
+ * @brief Find the end of the header block
+ *
+ * Search the empty line that separates headers from body without parsing
+ * any header. Scan can start at any offset so data received in several
+ * segments is only checked once.
+ *
+ * @param payload SIP message payload
+ * @param len payload length
+ * @param from Offset to start searching (2 bytes before previous data end)
+ * @return body offset or -1 if header block is not complete
+ */
+int32_t
+sip_parser_body(const char *payload, uint32_t len, uint32_t from);
+
+/**
+ * @brief Copy a scanned value into a buffer
+ *
+ * @param payload SIP message payload
+ * @param hdr Header value location
+ * @param out Buffer to store the value
+ * @param outlen Buffer size
+ * @return pointer to out
+ */
+char *
+sip_parser_value(const char *payload, sip_hdr_t hdr, char *out, uint32_t outlen);
+
+#endif /* __SNGREP_SIP_PARSER_H */
@@ -0,0 +1,1006 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file snapshot.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in snapshot.h
+ */
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "sip.h"
+#include "rtp.h"
+#include "media.h"
+#include "storage.h"
+#include "setting.h"
+#include "util.h"
+
+//! Shared memory segment where stored calls packets are published
+static snapshot_shared_t *published;
+//! Name of the segment to be removed when publishing finishes
+static char published_path[PATH_MAX];
+
+/**
+ * @brief Stored packet pending to be saved
+ */
+typedef struct
+{
+    //! Stored packet
+    packet_t *packet;
+    //! Position in save order (used to keep equal times order)
+    uint32_t seq;
+    //! Stream storing the packet (NULL for call packets)
+    rtp_stream_t *stream;
+} snapshot_item_t;
+
+/**
+ * @brief Get current monotonic time in milliseconds
+ */
+static uint64_t
+snapshot_msecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Sort stored packets by capture time
+ */
+static int
+snapshot_item_cmp(const void *a, const void *b)
+{
+    const snapshot_item_t *one = a, *two = b;
+    struct timeval t1 = packet_time(one->packet), t2 = packet_time(two->packet);
+
+    if (timercmp(&t1, &t2, <))
+        return -1;
+    if (timercmp(&t1, &t2, >))
+        return 1;
+    return (one->seq < two->seq) ? -1 : (one->seq > two->seq);
+}
+
+/**
+ * @brief Write data followed by padding up to next record alignment
+ */
+static void
+snapshot_write(FILE *fp, const void *data, size_t len)
+{
+    static const uint8_t padding[8] = { 0 };
+
+    fwrite(data, 1, len, fp);
+    fwrite(padding, 1, SNAPSHOT_ALIGN(len) - len, fp);
+}
+
+/**
+ * @brief Get the frames content of a stored packet
+ *
+ * Frames moved to disk storage are read again, and must be released with
+ * snapshot_packet_data_free.
+ *
+ * @return frames content array or NULL if packet can not be stored
+ */
+static u_char **
+snapshot_packet_data(packet_t *packet)
+{
+    frame_t *frame;
+    u_char **data;
+    int i, count;
+
+    // Frames are counted in 16 bits
+    if ((count = vector_count(packet->frames)) > UINT16_MAX)
+        return NULL;
+
+    if (!(data = malloc(sizeof(u_char *) * (count + 1))))
+        return NULL;
+
+    // Get frames content from memory or disk storage
+    for (i = 0; i < count; i++) {
+        frame = vector_item(packet->frames, i);
+        data[i] = (frame->data) ? frame->data : storage_read_frame(frame);
+    }
+
+    return data;
+}
+
+/**
+ * @brief Release the frames content read by snapshot_packet_data
+ */
+static void
+snapshot_packet_data_free(packet_t *packet, u_char **data)
+{
+    frame_t *frame;
+    int i;
+
+    // Release frames read from disk storage
+    for (i = 0; i < vector_count(packet->frames); i++) {
+        frame = vector_item(packet->frames, i);
+        if (data[i] && data[i] != frame->data)
+            sng_free(data[i]);
+    }
+    free(data);
+}
+
+/**
+ * @brief Get the size of a stored packet record
+ */
+static uint32_t
+snapshot_packet_size(packet_t *packet, u_char **data)
+{
+    frame_t *frame, *first;
+    uint32_t size = sizeof(snapshot_record_t);
+    int i;
+
+    for (i = 0; i < vector_count(packet->frames); i++) {
+        frame = vector_item(packet->frames, i);
+        size += sizeof(snapshot_frame_t) + ((data[i]) ? SNAPSHOT_ALIGN(frame->header.caplen) : 0);
+    }
+
+    // Payload pointing into first frame is not stored twice
+    first = vector_first(packet->frames);
+    if (!packet->payload_ref || !first || !first->data)
+        size += SNAPSHOT_ALIGN(packet_payloadlen(packet));
+
+    return size;
+}
+
+/**
+ * @brief Copy data followed by padding up to next record alignment
+ *
+ * @return position after the copied data
+ */
+static uint8_t *
+snapshot_pack(uint8_t *out, const void *data, size_t len)
+{
+    memcpy(out, data, len);
+    memset(out + len, 0, SNAPSHOT_ALIGN(len) - len);
+    return out + SNAPSHOT_ALIGN(len);
+}
+
+/**
+ * @brief Create a stored packet record
+ *
+ * @param out Buffer of snapshot_packet_size bytes
+ */
+static void
+snapshot_packet_pack(packet_t *packet, u_char **data, uint8_t *out)
+{
+    snapshot_record_t rec;
+    snapshot_frame_t sframe;
+    frame_t *frame, *first;
+    int i;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = SNAPSHOT_RECORD_PACKET;
+    rec.frames = vector_count(packet->frames);
+    rec.size = snapshot_packet_size(packet, data);
+    rec.ip_version = packet->ip_version;
+    rec.proto = packet->proto;
+    rec.packet_type = packet->type;
+    rec.payload_len = packet_payloadlen(packet);
+    rec.payload_offset = -1;
+    rec.src = packet->src;
+    rec.dst = packet->dst;
+
+    // Payload pointing into first frame is not stored twice
+    first = vector_first(packet->frames);
+    if (packet->payload_ref && first && first->data)
+        rec.payload_offset = packet->payload - first->data;
+
+    out = snapshot_pack(out, &rec, sizeof(rec));
+    for (i = 0; i < rec.frames; i++) {
+        frame = vector_item(packet->frames, i);
+        memset(&sframe, 0, sizeof(sframe));
+        sframe.sec = frame->header.ts.tv_sec;
+        sframe.usec = frame->header.ts.tv_usec;
+        sframe.caplen = frame->header.caplen;
+        sframe.len = frame->header.len;
+        sframe.stored = (data[i] != NULL);
+        out = snapshot_pack(out, &sframe, sizeof(sframe));
+        if (data[i])
+            out = snapshot_pack(out, data[i], frame->header.caplen);
+    }
+    if (rec.payload_offset < 0)
+        snapshot_pack(out, packet_payload(packet), rec.payload_len);
+}
+
+/**
+ * @brief Write a stored packet record
+ */
+static void
+snapshot_save_packet(FILE *fp, packet_t *packet)
+{
+    u_char **data;
+    uint8_t *rec;
+    uint32_t size;
+
+    if (!(data = snapshot_packet_data(packet)))
+        return;
+
+    size = snapshot_packet_size(packet, data);
+    if ((rec = malloc(size))) {
+        snapshot_packet_pack(packet, data, rec);
+        fwrite(rec, 1, size, fp);
+        free(rec);
+    }
+
+    snapshot_packet_data_free(packet, data);
+}
+
+/**
+ * @brief Fill a call stream statistics record
+ *
+ * Record is followed by the call Call-ID, that is not copied.
+ *
+ * @return true if the stream can be restored from the record
+ */
+static bool
+snapshot_stream_record(sip_call_t *call, rtp_stream_t *stream, snapshot_stream_t *rec)
+{
+    size_t len = strlen(call->callid);
+
+    // Only streams created from stored SDP can be restored
+    if (!stream->media || !stream->media->msg || len > UINT16_MAX)
+        return false;
+
+    memset(rec, 0, sizeof(snapshot_stream_t));
+    rec->type = SNAPSHOT_RECORD_STREAM;
+    rec->callid_len = len;
+    rec->size = sizeof(snapshot_stream_t) + SNAPSHOT_ALIGN(len + 1);
+    rec->msg_index = stream->media->msg->index;
+    rec->media_index = vector_index(stream->media->msg->medias, stream->media);
+    rec->stream_type = stream->type;
+    rec->src = stream->src;
+    rec->dst = stream->dst;
+    rec->pktcnt = stream->pktcnt;
+    rec->bytes = stream->bytes;
+    rec->sec = stream->time.tv_sec;
+    rec->usec = stream->time.tv_usec;
+    rec->lasttm = stream->lasttm;
+    if (stream->type == PACKET_RTCP) {
+        rec->spc = stream->rtcpinfo.spc;
+        rec->flost = stream->rtcpinfo.flost;
+        rec->fdiscard = stream->rtcpinfo.fdiscard;
+        rec->mosl = stream->rtcpinfo.mosl;
+        rec->mosc = stream->rtcpinfo.mosc;
+    } else {
+        rec->fmtcode = stream->rtpinfo.fmtcode;
+        rec->stats = stream->stats;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Write a call stream statistics record
+ */
+static void
+snapshot_save_stream(FILE *fp, sip_call_t *call, rtp_stream_t *stream)
+{
+    snapshot_stream_t rec;
+
+    if (!snapshot_stream_record(call, stream, &rec))
+        return;
+
+    fwrite(&rec, sizeof(rec), 1, fp);
+    snapshot_write(fp, call->callid, rec.callid_len + 1);
+}
+
+int
+snapshot_save(const char *outfile)
+{
+    snapshot_header_t header;
+    snapshot_item_t *items = NULL;
+    sip_call_t *call;
+    sip_msg_t *msg;
+    packet_t *packet;
+    rtp_stream_t *stream;
+    vector_iter_t calls, it;
+    uint32_t count = 0, i, j;
+    FILE *fp;
+    int ret;
+
+    if (!(fp = fopen(outfile, "w"))) {
+        fprintf(stderr, "Couldn't open snapshot file %s for writing\n", outfile);
+        return 1;
+    }
+
+    // Frames have the link type of first capture source
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    if ((header.link = capture_datalink()) == -1)
+        header.link = DLT_EN10MB;
+    fwrite(&header, sizeof(header), 1, fp);
+
+    // Calls can not change while they are saved
+    capture_lock();
+
+    // Count stored packets of all calls
+    calls = sip_calls_iterator();
+    while ((call = vector_iterator_next(&calls))) {
+        count += vector_count(call->msgs) + vector_count(call->rtp_packets);
+        it = vector_iterator(call->streams);
+        while ((stream = vector_iterator_next(&it)))
+            count += stream_stored_count(stream);
+    }
+
+    if (count && !(items = malloc(sizeof(snapshot_item_t) * count))) {
+        capture_unlock();
+        fclose(fp);
+        fprintf(stderr, "Can't allocate memory for snapshot data!\n");
+        return 1;
+    }
+
+    // Packets are restored in capture order, so SDP is parsed before its RTP
+    count = 0;
+    calls = sip_calls_iterator();
+    while ((call = vector_iterator_next(&calls))) {
+        // Compressed packets contents are needed again
+        call_uncompress(call);
+        it = vector_iterator(call->msgs);
+        while ((msg = vector_iterator_next(&it))) {
+            if (msg->packet) {
+                items[count].packet = msg->packet;
+                items[count].seq = count;
+                items[count].stream = NULL;
+                count++;
+            }
+        }
+        it = vector_iterator(call->rtp_packets);
+        while ((packet = vector_iterator_next(&it))) {
+            items[count].packet = packet;
+            items[count].seq = count;
+            items[count].stream = NULL;
+            count++;
+        }
+        it = vector_iterator(call->streams);
+        while ((stream = vector_iterator_next(&it))) {
+            for (j = 0; j < stream_stored_count(stream); j++) {
+                if (!(packet = stream_stored_packet(stream, j)))
+                    continue;
+                items[count].packet = packet;
+                items[count].seq = count;
+                items[count].stream = stream;
+                count++;
+            }
+        }
+    }
+    if (count)
+        qsort(items, count, sizeof(snapshot_item_t), snapshot_item_cmp);
+
+    for (i = 0; i < count; i++) {
+        snapshot_save_packet(fp, items[i].packet);
+        if (items[i].stream)
+            stream_release_packet(items[i].stream, items[i].packet);
+    }
+
+    // Streams statistics are restored after all packets
+    calls = sip_calls_iterator();
+    while ((call = vector_iterator_next(&calls))) {
+        it = vector_iterator(call->streams);
+        while ((stream = vector_iterator_next(&it)))
+            snapshot_save_stream(fp, call, stream);
+    }
+
+    capture_unlock();
+    free(items);
+
+    ret = ferror(fp);
+    if (fclose(fp) != 0 || ret) {
+        fprintf(stderr, "Error writing snapshot file %s\n", outfile);
+        return 1;
+    }
+
+    return 0;
+}
+
+bool
+snapshot_is_file(const char *infile)
+{
+    snapshot_header_t header;
+    FILE *fp;
+    bool ret = false;
+
+    // Standard input can not be mapped
+    if (!strcmp(infile, "-") || !(fp = fopen(infile, "r")))
+        return false;
+
+    if (fread(&header, sizeof(header), 1, fp) == 1)
+        ret = !memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+
+    fclose(fp);
+    return ret;
+}
+
+int
+snapshot_open(const char *infile, const char *outfile)
+{
+    capture_info_t *capinfo;
+    snapshot_t *snap;
+    snapshot_header_t *header;
+    struct stat st;
+    int fd;
+
+    // Create a new structure to handle this capture source
+    if (!(capinfo = sng_malloc(sizeof(capture_info_t)))
+        || !(snap = sng_malloc(sizeof(snapshot_t)))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+    capinfo->snapshot = snap;
+    capinfo->infile = infile;
+    snap->name = infile;
+
+    // Map the whole snapshot file
+    if ((fd = open(infile, O_RDONLY)) < 0 || fstat(fd, &st) != 0
+        || st.st_size < (off_t) sizeof(snapshot_header_t)) {
+        fprintf(stderr, "Couldn't open snapshot file %s\n", infile);
+        return 1;
+    }
+    snap->size = st.st_size;
+    snap->map = mmap(NULL, snap->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snap->map == MAP_FAILED) {
+        snap->map = NULL;
+        fprintf(stderr, "Couldn't map snapshot file %s\n", infile);
+        return 1;
+    }
+    madvise(snap->map, snap->size, MADV_SEQUENTIAL);
+
+    // Check this sngrep version can read the file
+    header = (snapshot_header_t *) snap->map;
+    if (header->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported snapshot file %s version %u\n", infile, header->version);
+        return 1;
+    }
+    snap->offset = sizeof(snapshot_header_t);
+
+    // Check linktypes sngrep knowns before start parsing packets
+    if (capture_set_link(capinfo, header->link) != 0) {
+        fprintf(stderr, "Unable to handle linktype %d\n", capinfo->link);
+        return 3;
+    }
+
+    // Dummy pcap handler for filter compiling and dump files
+    if (!(capinfo->handle = pcap_open_dead(capinfo->link, MAXIMUM_SNAPLEN))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+
+    // Add this capture information as packet source
+    return capture_add_source(capinfo, outfile);
+}
+
+/**
+ * @brief Get the shared memory object path of a segment name
+ */
+static void
+snapshot_shared_path(const char *name, char *path, size_t len)
+{
+    snprintf(path, len, "%s%s", (name[0] == '/') ? "" : "/", name);
+}
+
+int
+snapshot_attach(const char *name, const char *outfile)
+{
+    capture_info_t *capinfo;
+    snapshot_t *snap;
+    snapshot_shared_t header;
+    char path[PATH_MAX];
+    int fd;
+
+    // Create a new structure to handle this capture source
+    if (!(capinfo = sng_malloc(sizeof(capture_info_t)))
+        || !(snap = sng_malloc(sizeof(snapshot_t)))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+    capinfo->snapshot = snap;
+    capinfo->device = name;
+    snap->name = name;
+
+    // Segment size is only known after reading its header
+    snapshot_shared_path(name, path, sizeof(path));
+    if ((fd = shm_open(path, O_RDONLY, 0)) < 0 || read(fd, &header, sizeof(header)) != sizeof(header)
+        || memcmp(header.header.magic, SNAPSHOT_SHARED_MAGIC, sizeof(header.header.magic))) {
+        fprintf(stderr, "Couldn't attach to shared memory %s\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    if (header.header.version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "Unsupported shared memory %s version %u\n", name, header.header.version);
+        close(fd);
+        return 1;
+    }
+
+    snap->size = header.size;
+    snap->map = mmap(NULL, snap->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (snap->map == MAP_FAILED) {
+        snap->map = NULL;
+        fprintf(stderr, "Couldn't map shared memory %s\n", name);
+        return 1;
+    }
+    snap->shared = (snapshot_shared_t *) snap->map;
+    snap->epoch = header.epoch;
+    snap->offset = SNAPSHOT_SHARED_START;
+
+    // Check linktypes sngrep knowns before start parsing packets
+    if (capture_set_link(capinfo, header.header.link) != 0) {
+        fprintf(stderr, "Unable to handle linktype %d\n", capinfo->link);
+        return 3;
+    }
+
+    // Dummy pcap handler for filter compiling and dump files
+    if (!(capinfo->handle = pcap_open_dead(capinfo->link, MAXIMUM_SNAPLEN))) {
+        fprintf(stderr, "Can't allocate memory for capture data!\n");
+        return 1;
+    }
+
+    // Add this capture information as packet source
+    return capture_add_source(capinfo, outfile);
+}
+
+/**
+ * @brief Create a packet from a stored packet record
+ *
+ * @return restored packet or NULL if it must be ignored
+ */
+static packet_t *
+snapshot_restore_packet(capture_info_t *capinfo, snapshot_record_t *rec)
+{
+    snapshot_t *snap = capinfo->snapshot;
+    snapshot_frame_t *sframe;
+    struct pcap_pkthdr header;
+    packet_t *packet;
+    frame_t *first;
+    uint8_t *data = (uint8_t *) (rec + 1), *end = (uint8_t *) rec + rec->size;
+    int i;
+
+    packet = packet_create(rec->ip_version, rec->proto, rec->src, rec->dst, 0);
+    packet_set_type(packet, rec->packet_type);
+
+    for (i = 0; i < rec->frames; i++) {
+        sframe = (snapshot_frame_t *) data;
+        data += sizeof(snapshot_frame_t);
+        if (data > end || (sframe->stored && data + sframe->caplen > end))
+            goto corrupted;
+
+        memset(&header, 0, sizeof(header));
+        header.ts.tv_sec = sframe->sec;
+        header.ts.tv_usec = sframe->usec;
+        header.caplen = sframe->caplen;
+        header.len = sframe->len;
+
+        // Ignore packets outside requested time window or not matching filter
+        if (i == 0 && (capture_time_window_check(header.ts) != 0
+                       || (snap->filter && sframe->stored
+                           && !pcap_offline_filter(snap->filter, &header, data)))) {
+            packet_destroy(packet);
+            return NULL;
+        }
+
+        packet_add_frame(packet, &header, (sframe->stored) ? data : NULL);
+        if (sframe->stored)
+            data += SNAPSHOT_ALIGN(sframe->caplen);
+    }
+
+    first = vector_first(packet->frames);
+    if (rec->payload_offset < 0) {
+        if (data + rec->payload_len > end)
+            goto corrupted;
+        packet_set_payload(packet, data, rec->payload_len);
+    } else {
+        if (!first || !first->data || rec->payload_offset + rec->payload_len > first->header.caplen)
+            goto corrupted;
+        packet_set_frame_payload(packet, first->data + rec->payload_offset, rec->payload_len);
+    }
+
+    return packet;
+
+corrupted:
+    packet_destroy(packet);
+    fprintf(stderr, "Invalid packet record in snapshot %s\n", snap->name);
+    return NULL;
+}
+
+/**
+ * @brief Set the statistics of a call stream from a stored stream record
+ */
+static void
+snapshot_restore_stream(snapshot_stream_t *rec)
+{
+    const char *callid = (const char *) (rec + 1);
+    sip_call_t *call;
+    sip_msg_t *msg;
+    sdp_media_t *media;
+    rtp_stream_t *stream;
+    vector_iter_t it;
+
+    // Stream call and media may have not been restored (filters, limits)
+    if (callid[rec->callid_len] != '\0'
+        || !(call = sip_find_by_callid(callid))
+        || !(msg = vector_item(call->msgs, rec->msg_index))
+        || !(media = vector_item(msg->medias, rec->media_index)))
+        return;
+
+    // Find the stream created while parsing restored packets
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it))) {
+        if (stream->media == media && stream->type == rec->stream_type
+            && addressport_equals(stream->src, rec->src) && addressport_equals(stream->dst, rec->dst)
+            && (stream->type == PACKET_RTCP || stream->rtpinfo.fmtcode == rec->fmtcode))
+            break;
+    }
+
+    // Or the SDP stream completed by non stored RTP packets
+    if (!stream) {
+        it = vector_iterator(call->streams);
+        while ((stream = vector_iterator_next(&it))) {
+            if (stream->media == media && stream->type == rec->stream_type
+                && !stream_is_complete(stream) && addressport_equals(stream->dst, rec->dst))
+                break;
+        }
+    }
+
+    // Streams created by non stored RTP packets
+    if (!stream) {
+        if (!(stream = stream_create(media, rec->dst, rec->stream_type)))
+            return;
+        call_add_stream(call, stream);
+    }
+    stream_complete(stream, rec->src);
+
+    // Update stored streams counters with restored values
+    sip_calls_count_rtp(0, (int64_t) rec->pktcnt - stream->pktcnt, (int64_t) rec->bytes - stream->bytes);
+    stream->pktcnt = rec->pktcnt;
+    stream->bytes = rec->bytes;
+    stream->time.tv_sec = rec->sec;
+    stream->time.tv_usec = rec->usec;
+    stream->lasttm = rec->lasttm;
+    if (stream->type == PACKET_RTCP) {
+        stream->rtcpinfo.spc = rec->spc;
+        stream->rtcpinfo.flost = rec->flost;
+        stream->rtcpinfo.fdiscard = rec->fdiscard;
+        stream->rtcpinfo.mosl = rec->mosl;
+        stream->rtcpinfo.mosc = rec->mosc;
+    } else {
+        stream_set_format(stream, rec->fmtcode);
+        stream->stats = rec->stats;
+    }
+    call->changes++;
+    call->changed = true;
+}
+
+/**
+ * @brief Copy the next published record of the attached segment
+ *
+ * Publisher may be overwriting the record while it is being copied, so
+ * the copy is only valid if records epoch has not changed after it.
+ *
+ * @return record copy or NULL if there are no valid records available
+ */
+static snapshot_record_t *
+snapshot_shared_next(snapshot_t *snap)
+{
+    snapshot_shared_t *shared = snap->shared;
+    uint64_t end = __atomic_load_n(&shared->end, __ATOMIC_ACQUIRE);
+    uint32_t size;
+    uint8_t *record;
+
+    // Publisher started writing records again from the start
+    if (__atomic_load_n(&shared->epoch, __ATOMIC_ACQUIRE) != snap->epoch) {
+        snap->epoch = __atomic_load_n(&shared->epoch, __ATOMIC_ACQUIRE);
+        snap->offset = SNAPSHOT_SHARED_START;
+        return NULL;
+    }
+
+    if (snap->offset + sizeof(snapshot_record_t) > end)
+        return NULL;
+
+    size = ((snapshot_record_t *) (snap->map + snap->offset))->size;
+    if (size < sizeof(snapshot_record_t) || size % 8 || snap->offset + size > end)
+        return NULL;
+
+    if (size > snap->record_size) {
+        if (!(record = realloc(snap->record, size)))
+            return NULL;
+        snap->record = record;
+        snap->record_size = size;
+    }
+    memcpy(snap->record, snap->map + snap->offset, size);
+
+    // Discard the copy if the record may have been replaced
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shared->epoch, __ATOMIC_RELAXED) != snap->epoch)
+        return NULL;
+
+    snap->offset += size;
+    return (snapshot_record_t *) snap->record;
+}
+
+/**
+ * @brief Parse records published in the attached segment
+ *
+ * Segment is followed until the publisher finishes or capture is stopped.
+ */
+static void
+snapshot_shared_loop(capture_info_t *capinfo)
+{
+    snapshot_t *snap = capinfo->snapshot;
+    snapshot_record_t *rec;
+    packet_t *packet;
+    bool closed;
+
+    while (capinfo->running) {
+        closed = __atomic_load_n(&snap->shared->closed, __ATOMIC_ACQUIRE);
+        if (!(rec = snapshot_shared_next(snap))) {
+            // Parse pending packets while waiting for new records
+            capture_batch_flush(capinfo);
+            if (closed && snap->epoch == __atomic_load_n(&snap->shared->epoch, __ATOMIC_ACQUIRE))
+                break;
+            usleep(SNAPSHOT_SHARED_POLL);
+            continue;
+        }
+
+        if (rec->type == SNAPSHOT_RECORD_PACKET) {
+            __atomic_fetch_add(&capinfo->packets, 1, __ATOMIC_RELAXED);
+            if (!capture_paused() && (packet = snapshot_restore_packet(capinfo, rec))) {
+                capinfo->batch[capinfo->batch_count++] = packet;
+                if (capinfo->batch_count >= CAPTURE_BATCH_MAX)
+                    capture_batch_flush(capinfo);
+            }
+        } else if (rec->type == SNAPSHOT_RECORD_STREAM && rec->size >= sizeof(snapshot_stream_t)
+                   && ((snapshot_stream_t *) rec)->callid_len < rec->size - sizeof(snapshot_stream_t)) {
+            // Streams messages must be parsed before updating their statistics
+            capture_batch_flush(capinfo);
+            capture_lock();
+            snapshot_restore_stream((snapshot_stream_t *) rec);
+            capture_unlock();
+        }
+    }
+
+    // Parse remaining published packets
+    capture_batch_flush(capinfo);
+}
+
+void
+snapshot_loop(capture_info_t *capinfo)
+{
+    snapshot_t *snap = capinfo->snapshot;
+    snapshot_record_t *rec;
+    packet_t *packet;
+
+    // Follow published records of attached segment
+    if (snap->shared) {
+        snapshot_shared_loop(capinfo);
+        return;
+    }
+
+    snap->start = snapshot_msecs();
+
+    while (capinfo->running && snap->offset + sizeof(snapshot_record_t) <= snap->size) {
+        rec = (snapshot_record_t *) (snap->map + snap->offset);
+        if (rec->size < sizeof(snapshot_record_t) || rec->size % 8
+            || snap->offset + rec->size > snap->size) {
+            fprintf(stderr, "Invalid record in snapshot %s\n", snap->name);
+            break;
+        }
+
+        if (rec->type == SNAPSHOT_RECORD_PACKET) {
+            __atomic_fetch_add(&capinfo->packets, 1, __ATOMIC_RELAXED);
+            // Stored packets are parsed in this thread, so streams exist before their records
+            if (!capture_paused() && (packet = snapshot_restore_packet(capinfo, rec))) {
+                capinfo->batch[capinfo->batch_count++] = packet;
+                if (capinfo->batch_count >= CAPTURE_BATCH_MAX)
+                    capture_batch_flush(capinfo);
+            }
+        } else if (rec->type == SNAPSHOT_RECORD_STREAM && rec->size >= sizeof(snapshot_stream_t)
+                   && ((snapshot_stream_t *) rec)->callid_len < rec->size - sizeof(snapshot_stream_t)) {
+            capture_batch_flush(capinfo);
+            capture_lock();
+            snapshot_restore_stream((snapshot_stream_t *) rec);
+            capture_unlock();
+        }
+
+        __atomic_store_n(&snap->offset, snap->offset + rec->size, __ATOMIC_RELAXED);
+    }
+
+    // Parse remaining restored packets
+    capture_batch_flush(capinfo);
+}
+
+int
+snapshot_set_filter(capture_info_t *capinfo, struct bpf_program *fp)
+{
+    capinfo->snapshot->filter = fp;
+    return 0;
+}
+
+void
+snapshot_progress(capture_info_t *capinfo, uint64_t *decoded, uint64_t *size, uint64_t *msecs)
+{
+    snapshot_t *snap = capinfo->snapshot;
+
+    *decoded = __atomic_load_n(&snap->offset, __ATOMIC_RELAXED);
+    *size = snap->size;
+    *msecs = (snap->start) ? snapshot_msecs() - snap->start : 0;
+}
+
+void
+snapshot_close(capture_info_t *capinfo)
+{
+    snapshot_t *snap = capinfo->snapshot;
+
+    if (!snap)
+        return;
+
+    if (snap->map)
+        munmap(snap->map, snap->size);
+    if (capinfo->handle)
+        pcap_close(capinfo->handle);
+
+    capinfo->handle = NULL;
+    capinfo->snapshot = NULL;
+    free(snap->record);
+    sng_free(snap);
+}
+
+int
+snapshot_publish(const char *name)
+{
+    uint64_t size = (uint64_t) setting_get_intvalue(SETTING_CAPTURE_SHARED_SIZE) * 1024 * 1024;
+    snapshot_shared_t *shared;
+    int fd;
+
+    if (size <= SNAPSHOT_SHARED_START) {
+        fprintf(stderr, "Invalid shared memory size\n");
+        return 1;
+    }
+
+    // Processes attached to a previous segment keep using it
+    snapshot_shared_path(name, published_path, sizeof(published_path));
+    shm_unlink(published_path);
+    if ((fd = shm_open(published_path, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        fprintf(stderr, "Couldn't create shared memory %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    if (ftruncate(fd, size) != 0
+        || (shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Couldn't allocate shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(published_path);
+        return 1;
+    }
+    close(fd);
+
+    // Frames have the link type of first capture source
+    memcpy(shared->header.magic, SNAPSHOT_SHARED_MAGIC, sizeof(shared->header.magic));
+    shared->header.version = SNAPSHOT_VERSION;
+    if ((shared->header.link = capture_datalink()) == -1)
+        shared->header.link = DLT_EN10MB;
+    shared->size = size;
+    shared->end = SNAPSHOT_SHARED_START;
+    published = shared;
+
+    return 0;
+}
+
+/**
+ * @brief Get the position of the next published record
+ *
+ * If the record doesn't fit after the last one, records are written
+ * again from the segment start.
+ *
+ * @return record position or NULL if it doesn't fit in the segment
+ */
+static uint8_t *
+snapshot_publish_reserve(uint32_t size)
+{
+    snapshot_shared_t *shared = published;
+
+    // Records that don't fit in an empty segment are not published
+    if (SNAPSHOT_SHARED_START + size > shared->size)
+        return NULL;
+
+    if (shared->end + size > shared->size) {
+        // Attached processes discard records copied after the epoch change
+        __atomic_store_n(&shared->end, SNAPSHOT_SHARED_START, __ATOMIC_RELAXED);
+        __atomic_store_n(&shared->epoch, shared->epoch + 1, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    return (uint8_t *) shared + shared->end;
+}
+
+/**
+ * @brief Make the reserved record available to attached processes
+ */
+static void
+snapshot_publish_commit(uint32_t size)
+{
+    __atomic_store_n(&published->end, published->end + size, __ATOMIC_RELEASE);
+}
+
+void
+snapshot_publish_packet(packet_t *packet)
+{
+    u_char **data;
+    uint8_t *out;
+    uint32_t size;
+
+    if (!published || !(data = snapshot_packet_data(packet)))
+        return;
+
+    size = snapshot_packet_size(packet, data);
+    if ((out = snapshot_publish_reserve(size))) {
+        snapshot_packet_pack(packet, data, out);
+        snapshot_publish_commit(size);
+    }
+
+    snapshot_packet_data_free(packet, data);
+}
+
+void
+snapshot_publish_streams(sip_call_t *call)
+{
+    snapshot_stream_t rec;
+    rtp_stream_t *stream;
+    vector_iter_t it;
+    uint8_t *out;
+
+    if (!published)
+        return;
+
+    // Attached processes update the streams counters with these records
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it))) {
+        if (!snapshot_stream_record(call, stream, &rec) || !(out = snapshot_publish_reserve(rec.size)))
+            continue;
+        out = snapshot_pack(out, &rec, sizeof(rec));
+        snapshot_pack(out, call->callid, rec.callid_len + 1);
+        snapshot_publish_commit(rec.size);
+    }
+}
+
+void
+snapshot_publish_close()
+{
+    if (!published)
+        return;
+
+    __atomic_store_n(&published->closed, 1, __ATOMIC_RELEASE);
+    munmap(published, published->size);
+    shm_unlink(published_path);
+    published = NULL;
+}
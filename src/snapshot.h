@@ -0,0 +1,350 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file snapshot.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to save and restore parsed calls
+ *
+ * Snapshot files contain the stored packets of each call (SIP messages
+ * and RTP packets with their frames) followed by the call RTP streams
+ * statistics. Restoring a snapshot sends the stored packets directly to
+ * the SIP and RTP parsers, skipping link layer decoding, reassembly,
+ * decryption and all the packets that were not stored, and then sets the
+ * streams statistics that were calculated from non stored RTP packets.
+ *
+ * All records are 8 bytes aligned, so the file is read using mmap.
+ *
+ * Capture processes can also publish the packets of their calls as
+ * snapshot records appended to a shared memory segment, so other sngrep
+ * processes attached to the segment display the same calls without
+ * capturing, reassembling or decrypting the packets again.
+ */
+#ifndef __SNGREP_SNAPSHOT_H
+#define __SNGREP_SNAPSHOT_H
+
+#include "config.h"
+#include <stdint.h>
+#include "capture.h"
+#include "rtp.h"
+#include "sip_call.h"
+
+//! Snapshot file format identifier
+#define SNAPSHOT_MAGIC "SNGSNAP"
+//! Snapshot file format version
+#define SNAPSHOT_VERSION 2
+//! Records alignment in snapshot files
+#define SNAPSHOT_ALIGN(len) (((len) + 7) & ~((size_t) 7))
+//! Shared memory segment format identifier
+#define SNAPSHOT_SHARED_MAGIC "SNGSHAR"
+//! Offset of the first record in shared memory segments
+#define SNAPSHOT_SHARED_START SNAPSHOT_ALIGN(sizeof(snapshot_shared_t))
+//! Wait between checks of new published records (us)
+#define SNAPSHOT_SHARED_POLL 20000
+
+//! Shorter declaration of snapshot_header structure
+typedef struct snapshot_header snapshot_header_t;
+//! Shorter declaration of snapshot_record structure
+typedef struct snapshot_record snapshot_record_t;
+//! Shorter declaration of snapshot_frame structure
+typedef struct snapshot_frame snapshot_frame_t;
+//! Shorter declaration of snapshot_stream structure
+typedef struct snapshot_stream snapshot_stream_t;
+//! Shorter declaration of snapshot_shared structure
+typedef struct snapshot_shared snapshot_shared_t;
+
+//! Snapshot record types
+enum snapshot_record_type {
+    SNAPSHOT_RECORD_PACKET = 1,
+    SNAPSHOT_RECORD_STREAM,
+};
+
+/**
+ * @brief Snapshot file header
+ */
+struct snapshot_header
+{
+    //! File format identifier
+    char magic[8];
+    //! File format version
+    uint32_t version;
+    //! Link type of stored frames
+    int32_t link;
+};
+
+/**
+ * @brief Snapshot stored packet
+ *
+ * Record is followed by its frames and its payload (if it is not part
+ * of the first frame content).
+ */
+struct snapshot_record
+{
+    //! Record type (see snapshot_record_type)
+    uint16_t type;
+    //! Number of frames following the record
+    uint16_t frames;
+    //! Record size (including frames and payload)
+    uint32_t size;
+    //! IP protocol
+    uint8_t ip_version;
+    //! Transport protocol
+    uint8_t proto;
+    //! Packet type as defined in packet_type
+    uint16_t packet_type;
+    //! Payload length
+    uint32_t payload_len;
+    //! Payload offset in first frame content (-1 if stored after frames)
+    int64_t payload_offset;
+    //! Packet source
+    address_t src;
+    //! Packet destination
+    address_t dst;
+};
+
+/**
+ * @brief Snapshot stored frame
+ *
+ * Frame is followed by its content (if available)
+ */
+struct snapshot_frame
+{
+    //! Frame capture time
+    int64_t sec, usec;
+    //! Captured frame length
+    uint32_t caplen;
+    //! Original frame length
+    uint32_t len;
+    //! Frame content stored after this header
+    uint32_t stored;
+    //! Unused (alignment)
+    uint32_t unused;
+};
+
+/**
+ * @brief Snapshot RTP stream statistics
+ *
+ * Record is followed by the stream call Call-ID
+ */
+struct snapshot_stream
+{
+    //! Record type (always SNAPSHOT_RECORD_STREAM)
+    uint16_t type;
+    //! Call-ID length
+    uint16_t callid_len;
+    //! Record size (including Call-ID)
+    uint32_t size;
+    //! Index of the message with the stream SDP media
+    uint32_t msg_index;
+    //! Index of the stream media in its message
+    uint32_t media_index;
+    //! Stream type
+    uint32_t stream_type;
+    //! Stream format code
+    uint32_t fmtcode;
+    //! Stream source
+    address_t src;
+    //! Stream destination
+    address_t dst;
+    //! Stream packets and payload bytes
+    uint64_t pktcnt, bytes;
+    //! Time of first stream packet
+    int64_t sec, usec;
+    //! Unix timestamp of last stream packet
+    int64_t lasttm;
+    //! RTCP stream information
+    uint32_t spc;
+    uint8_t flost, fdiscard, mosl, mosc;
+    //! RTP stream quality statistics
+    rtp_stats_t stats;
+};
+
+/**
+ * @brief Shared memory segment header
+ *
+ * Published packets are appended after this header. When the segment is
+ * full, the epoch is increased and records are written again from the
+ * start, so attached processes know previous records are being replaced.
+ */
+struct snapshot_shared
+{
+    //! Records format (using SNAPSHOT_SHARED_MAGIC identifier)
+    snapshot_header_t header;
+    //! Segment size
+    uint64_t size;
+    //! Offset after the last published record
+    uint64_t end;
+    //! Times records have been written again from the start
+    uint32_t epoch;
+    //! Publisher has finished, no more records will be added
+    uint32_t closed;
+};
+
+/**
+ * @brief Snapshot file being restored
+ */
+struct snapshot
+{
+    //! Snapshot file or shared memory segment name
+    const char *name;
+    //! Mapped snapshot file
+    uint8_t *map;
+    //! Snapshot file size
+    uint64_t size;
+    //! Offset of next record to restore
+    uint64_t offset;
+    //! Attached shared memory segment (NULL for snapshot files)
+    snapshot_shared_t *shared;
+    //! Epoch of the records being read from shared memory
+    uint32_t epoch;
+    //! Copy of the shared record being restored
+    uint8_t *record;
+    //! Allocated size of record copy
+    uint32_t record_size;
+    //! Compiled filter program (NULL if none)
+    struct bpf_program *filter;
+    //! Restore start time (ms)
+    uint64_t start;
+};
+
+/**
+ * @brief Check if the given file is a snapshot file
+ *
+ * @param infile File path
+ * @return true if file starts with a snapshot header
+ */
+bool
+snapshot_is_file(const char *infile);
+
+/**
+ * @brief Create an offline capture source restoring a snapshot file
+ *
+ * @param infile Snapshot file
+ * @param outfile Dumpfile for captured packets
+ * @return 0 on success, error code otherwise (same as capture_offline)
+ */
+int
+snapshot_open(const char *infile, const char *outfile);
+
+/**
+ * @brief Create an online capture source following a shared memory segment
+ *
+ * Packets published by other sngrep process are parsed as they are added
+ * to the segment, starting from the oldest one still available.
+ *
+ * @param name Shared memory segment name
+ * @param outfile Dumpfile for captured packets
+ * @return 0 on success, 1 otherwise
+ */
+int
+snapshot_attach(const char *name, const char *outfile);
+
+/**
+ * @brief Restore snapshot records until file end or capture is stopped
+ *
+ * @param capinfo Capture source information
+ */
+void
+snapshot_loop(capture_info_t *capinfo);
+
+/**
+ * @brief Set the BPF filter of a snapshot capture source
+ *
+ * Filter is checked against the first frame of each stored packet.
+ *
+ * @param capinfo Capture source information
+ * @param fp Compiled filter program
+ * @return 0 if filter has been set, 1 otherwise
+ */
+int
+snapshot_set_filter(capture_info_t *capinfo, struct bpf_program *fp);
+
+/**
+ * @brief Get the restoring progress of a snapshot capture source
+ *
+ * @param capinfo Capture source information
+ * @param decoded Bytes of the file already restored
+ * @param size Snapshot file size
+ * @param msecs Time elapsed since the file started to be restored
+ */
+void
+snapshot_progress(capture_info_t *capinfo, uint64_t *decoded, uint64_t *size, uint64_t *msecs);
+
+/**
+ * @brief Unmap the snapshot file
+ *
+ * @param capinfo Capture source information
+ */
+void
+snapshot_close(capture_info_t *capinfo);
+
+/**
+ * @brief Save all stored calls into a snapshot file
+ *
+ * @param outfile Snapshot file path
+ * @return 0 if snapshot has been saved, 1 otherwise
+ */
+int
+snapshot_save(const char *outfile);
+
+/**
+ * @brief Create a shared memory segment to publish calls packets
+ *
+ * Segment size is configured with capture.sharedsize setting.
+ *
+ * @param name Shared memory segment name
+ * @return 0 if segment has been created, 1 otherwise
+ */
+int
+snapshot_publish(const char *name);
+
+/**
+ * @brief Append a packet of a stored call to the published segment
+ *
+ * This must be called with the capture lock held.
+ *
+ * @param packet Packet to be published
+ */
+void
+snapshot_publish_packet(packet_t *packet);
+
+/**
+ * @brief Append the streams statistics of a call to the published segment
+ *
+ * Attached processes don't receive the RTP packets that are not stored,
+ * so finished calls publish their streams counters and quality.
+ * This must be called with the capture lock held.
+ *
+ * @param call Call whose streams are published
+ */
+void
+snapshot_publish_streams(sip_call_t *call);
+
+/**
+ * @brief Notify attached processes no more packets will be published
+ *
+ * Segment is removed, but remains available for attached processes.
+ */
+void
+snapshot_publish_close();
+
+#endif /* __SNGREP_SNAPSHOT_H */
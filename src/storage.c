@@ -0,0 +1,399 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file storage.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in storage.h
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "storage.h"
+#include "capture.h"
+#include "util.h"
+
+/**
+ * @brief Disk storage spool
+ */
+static storage_spool_t frames_spool = { .fd = -1 };
+
+//! Calls with RTP written to spool files
+static enum storage_rtp_mode rtp_mode = STORAGE_RTP_OFF;
+
+/**
+ * @brief Write full blocks to the spool file until storage is closed
+ */
+static void *
+storage_spool_thread(void *data)
+{
+    storage_spool_block_t *block;
+    size_t done;
+    ssize_t bytes;
+
+    while (true) {
+        // Write all full blocks before stopping
+        if ((block = ring_pop(frames_spool.full))) {
+            // Frames of blocks that can not be written are lost
+            for (done = 0; done < block->len; done += bytes) {
+                if ((bytes = pwrite(frames_spool.fd, block->data + done, block->len - done,
+                                    block->start + done)) <= 0)
+                    break;
+            }
+
+            // Block frames are now read from the spool file
+            pthread_mutex_lock(&frames_spool.lock);
+            block->len = 0;
+            pthread_mutex_unlock(&frames_spool.lock);
+            ring_push(frames_spool.free, block);
+            continue;
+        }
+
+        if (!__atomic_load_n(&frames_spool.running, __ATOMIC_ACQUIRE))
+            break;
+
+        usleep(1000);
+    }
+
+    return NULL;
+}
+
+int
+storage_init(const char *dir)
+{
+    char path[256];
+    int i;
+
+    // Create a unique spool file
+    snprintf(path, sizeof(path), "%s/sngrep-spool-XXXXXX", dir);
+    if ((frames_spool.fd = mkstemp(path)) == -1)
+        return 1;
+
+    // Nobody else needs this file
+    unlink(path);
+    frames_spool.offset = 0;
+    pthread_mutex_init(&frames_spool.lock, NULL);
+
+    // Allocate write blocks, all of them are initially free
+    frames_spool.free = ring_create(STORAGE_SPOOL_BLOCKS);
+    frames_spool.full = ring_create(STORAGE_SPOOL_BLOCKS);
+    if (!frames_spool.free || !frames_spool.full) {
+        storage_deinit();
+        return 1;
+    }
+    for (i = 0; i < STORAGE_SPOOL_BLOCKS; i++) {
+        if (!(frames_spool.blocks[i].data = malloc(STORAGE_SPOOL_BLOCK))) {
+            storage_deinit();
+            return 1;
+        }
+        ring_push(frames_spool.free, &frames_spool.blocks[i]);
+    }
+
+    // Start spool writer thread
+    frames_spool.running = true;
+    if (pthread_create(&frames_spool.thread, NULL, storage_spool_thread, NULL) != 0) {
+        frames_spool.running = false;
+        storage_deinit();
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+storage_deinit()
+{
+    int i;
+
+    // Stop writer thread
+    if (frames_spool.running) {
+        __atomic_store_n(&frames_spool.running, false, __ATOMIC_RELEASE);
+        pthread_join(frames_spool.thread, NULL);
+    }
+
+    if (frames_spool.fd != -1) {
+        close(frames_spool.fd);
+        pthread_mutex_destroy(&frames_spool.lock);
+    }
+    frames_spool.fd = -1;
+
+    for (i = 0; i < STORAGE_SPOOL_BLOCKS; i++) {
+        free(frames_spool.blocks[i].data);
+        frames_spool.blocks[i].data = NULL;
+        frames_spool.blocks[i].len = 0;
+    }
+    frames_spool.current = NULL;
+    if (frames_spool.free)
+        ring_destroy(frames_spool.free);
+    if (frames_spool.full)
+        ring_destroy(frames_spool.full);
+    frames_spool.free = frames_spool.full = NULL;
+}
+
+int
+storage_spool_frames(packet_t *packet)
+{
+    storage_spool_block_t *block;
+    frame_t *frame;
+    vector_iter_t it;
+
+    if (!frames_spool.running)
+        return 1;
+
+    // Payload must survive frames content
+    packet_detach_payload(packet);
+
+    pthread_mutex_lock(&frames_spool.lock);
+    it = vector_iterator(packet->frames);
+    while ((frame = vector_iterator_next(&it))) {
+        // Frame already in disk or without content (or too big for blocks)
+        if (!frame->data || frame->header.caplen > STORAGE_SPOOL_BLOCK)
+            continue;
+
+        // Send current block to writer thread if frame does not fit
+        block = frames_spool.current;
+        if (block && block->len + frame->header.caplen > STORAGE_SPOOL_BLOCK) {
+            ring_push(frames_spool.full, block);
+            block = frames_spool.current = NULL;
+        }
+
+        // Keep frame in memory if all blocks are waiting to be written
+        if (!block) {
+            if (!(block = frames_spool.current = ring_pop(frames_spool.free))) {
+                pthread_mutex_unlock(&frames_spool.lock);
+                return 1;
+            }
+            block->start = frames_spool.offset;
+        }
+
+        // Only keep the frame location in memory
+        memcpy(block->data + block->len, frame->data, frame->header.caplen);
+        block->len += frame->header.caplen;
+        frame_free_data(frame);
+        frame->offset = frames_spool.offset;
+        frames_spool.offset += frame->header.caplen;
+    }
+    pthread_mutex_unlock(&frames_spool.lock);
+
+    return 0;
+}
+
+u_char *
+storage_read_frame(const frame_t *frame)
+{
+    storage_spool_block_t *block;
+    u_char *data;
+    int i;
+
+    if (!(data = sng_malloc(frame->header.caplen)))
+        return NULL;
+
+    if (frame->data) {
+        // Frame content is still in memory
+        memcpy(data, frame->data, frame->header.caplen);
+        return data;
+    }
+
+    if (!frames_spool.running || frame->offset < 0) {
+        // Frame content is not available
+        sng_free(data);
+        return NULL;
+    }
+
+    // Frame content may be waiting to be written
+    pthread_mutex_lock(&frames_spool.lock);
+    for (i = 0; i < STORAGE_SPOOL_BLOCKS; i++) {
+        block = &frames_spool.blocks[i];
+        if ((uint64_t) frame->offset >= block->start && (uint64_t) frame->offset < block->start + block->len) {
+            memcpy(data, block->data + frame->offset - block->start, frame->header.caplen);
+            pthread_mutex_unlock(&frames_spool.lock);
+            return data;
+        }
+    }
+    pthread_mutex_unlock(&frames_spool.lock);
+
+    if (pread(frames_spool.fd, data, frame->header.caplen, frame->offset) != frame->header.caplen) {
+        // Frame content is not available
+        sng_free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+void
+storage_set_rtp_mode(enum storage_rtp_mode mode)
+{
+    rtp_mode = mode;
+}
+
+enum storage_rtp_mode
+storage_get_rtp_mode()
+{
+    return rtp_mode;
+}
+
+/**
+ * @brief Write buffered records to the spool file
+ *
+ * @return 0 if all records have been written, 1 otherwise
+ */
+static int
+storage_rtp_flush(storage_rtp_spool_t *spool)
+{
+    if (!spool->buflen)
+        return 0;
+
+    if (pwrite(spool->fd, spool->buffer, spool->buflen, spool->written) != (ssize_t) spool->buflen)
+        return 1;
+
+    spool->written += spool->buflen;
+    spool->buflen = 0;
+    return 0;
+}
+
+storage_rtp_spool_t *
+storage_rtp_open(const char *dir, int link)
+{
+    storage_rtp_spool_t *spool;
+    char path[256];
+    uint32_t header[6];
+
+    if (!(spool = sng_malloc(sizeof(storage_rtp_spool_t))))
+        return NULL;
+
+    // Create a unique spool file
+    snprintf(path, sizeof(path), "%s/sngrep-rtp-XXXXXX", dir);
+    if ((spool->fd = mkstemp(path)) == -1) {
+        sng_free(spool);
+        return NULL;
+    }
+
+    // Nobody else needs this file
+    unlink(path);
+
+    // Same file header written by libpcap
+    header[0] = 0xa1b2c3d4;
+    header[1] = 2 | (4 << 16);
+    header[2] = 0;
+    header[3] = 0;
+    header[4] = MAXIMUM_SNAPLEN;
+    header[5] = link;
+    memcpy(spool->buffer, header, STORAGE_PCAP_HEADER);
+    spool->buflen = STORAGE_PCAP_HEADER;
+
+    return spool;
+}
+
+int
+storage_rtp_write(storage_rtp_spool_t *spool, const packet_t *packet)
+{
+    frame_t *frame;
+    vector_iter_t it;
+    uint32_t record[4];
+
+    it = vector_iterator(packet->frames);
+    while ((frame = vector_iterator_next(&it))) {
+        // Frame without content
+        if (!frame->data)
+            return 1;
+
+        // Same record header written by pcap_dump
+        record[0] = frame->header.ts.tv_sec;
+        record[1] = frame->header.ts.tv_usec;
+        record[2] = frame->header.caplen;
+        record[3] = frame->header.len;
+
+        // Make room for this record
+        if (spool->buflen + sizeof(record) + frame->header.caplen > STORAGE_RTP_BUFFER
+            && storage_rtp_flush(spool) != 0)
+            return 1;
+
+        if (sizeof(record) + frame->header.caplen > STORAGE_RTP_BUFFER) {
+            // Big records are written directly
+            if (pwrite(spool->fd, record, sizeof(record), spool->written) != sizeof(record)
+                || pwrite(spool->fd, frame->data, frame->header.caplen, spool->written + sizeof(record))
+                   != frame->header.caplen)
+                return 1;
+            spool->written += sizeof(record) + frame->header.caplen;
+        } else {
+            memcpy(spool->buffer + spool->buflen, record, sizeof(record));
+            memcpy(spool->buffer + spool->buflen + sizeof(record), frame->data, frame->header.caplen);
+            spool->buflen += sizeof(record) + frame->header.caplen;
+        }
+        spool->frames++;
+    }
+
+    return 0;
+}
+
+int
+storage_rtp_read(storage_rtp_spool_t *spool, uint64_t offset, struct pcap_pkthdr *header,
+                 u_char **data, size_t *size)
+{
+    uint32_t record[4];
+    u_char *buffer;
+
+    if (offset < STORAGE_PCAP_HEADER || offset + sizeof(record) > spool->written + spool->buflen)
+        return 1;
+
+    // Records are either in the file or in the buffer
+    if (offset >= spool->written) {
+        memcpy(record, spool->buffer + offset - spool->written, sizeof(record));
+    } else if (pread(spool->fd, record, sizeof(record), offset) != sizeof(record)) {
+        return 1;
+    }
+
+    header->ts.tv_sec = record[0];
+    header->ts.tv_usec = record[1];
+    header->caplen = record[2];
+    header->len = record[3];
+
+    // Grow the buffer as required
+    if (*size < header->caplen) {
+        if (!(buffer = realloc(*data, header->caplen)))
+            return 1;
+        *data = buffer;
+        *size = header->caplen;
+    }
+
+    offset += sizeof(record);
+    if (offset >= spool->written) {
+        memcpy(*data, spool->buffer + offset - spool->written, header->caplen);
+    } else if (pread(spool->fd, *data, header->caplen, offset) != header->caplen) {
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+storage_rtp_close(storage_rtp_spool_t *spool)
+{
+    if (!spool)
+        return;
+    close(spool->fd);
+    sng_free(spool);
+}
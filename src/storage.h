@@ -0,0 +1,223 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file storage.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to store captured frames on disk
+ *
+ * When disk storage is enabled, frames content of stored packets is moved
+ * to a spool file and only its offset is kept in memory. Frame data is read
+ * back from the spool file when packets need to be saved or dumped.
+ *
+ * Frames are copied into memory blocks and a writer thread writes full
+ * blocks to the spool file, so capture threads never wait for the disk.
+ * Frames are kept in memory when all blocks are waiting to be written.
+ *
+ * RTP packets of some calls can also be written to a per-call spool file
+ * in pcap format instead of being stored in memory. Records are appended
+ * to a small buffer that is written to the file when full, so recording
+ * long calls costs disk bandwidth instead of memory.
+ */
+#ifndef __SNGREP_STORAGE_H
+#define __SNGREP_STORAGE_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "packet.h"
+#include "ring.h"
+
+//! Size of pcap file global header
+#define STORAGE_PCAP_HEADER 24
+//! Size of pcap record header
+#define STORAGE_PCAP_RECORD 16
+//! Size of RTP spool file write buffer
+#define STORAGE_RTP_BUFFER 16384
+//! Size of spool file write blocks (must fit the biggest frame)
+#define STORAGE_SPOOL_BLOCK (1024 * 1024)
+//! Number of spool file write blocks
+#define STORAGE_SPOOL_BLOCKS 8
+
+//! Shorter declaration of storage_spool structures
+typedef struct storage_spool storage_spool_t;
+typedef struct storage_spool_block storage_spool_block_t;
+//! Shorter declaration of storage_rtp_spool structure
+typedef struct storage_rtp_spool storage_rtp_spool_t;
+
+//! Calls with RTP written to spool files
+enum storage_rtp_mode {
+    STORAGE_RTP_OFF = 0,
+    STORAGE_RTP_LOCKED,
+    STORAGE_RTP_FILTERED,
+};
+
+/**
+ * @brief Frames pending to be written to the spool file
+ */
+struct storage_spool_block {
+    //! Block data
+    u_char *data;
+    //! Spool file position of the first byte
+    uint64_t start;
+    //! Bytes used in this block (0 if free)
+    size_t len;
+};
+
+/**
+ * @brief Disk storage spool file
+ */
+struct storage_spool {
+    //! Spool file descriptor (-1 if not opened)
+    int fd;
+    //! Next write position in spool file
+    uint64_t offset;
+    //! Allocated blocks
+    storage_spool_block_t blocks[STORAGE_SPOOL_BLOCKS];
+    //! Block being filled with frames
+    storage_spool_block_t *current;
+    //! Blocks ready to be filled with frames
+    ring_t *free;
+    //! Blocks ready to be written by the writer thread
+    ring_t *full;
+    //! Protects current block and blocks being freed
+    pthread_mutex_t lock;
+    //! Writer thread
+    pthread_t thread;
+    //! Writer thread is running
+    bool running;
+};
+
+/**
+ * @brief Per-call RTP spool file
+ */
+struct storage_rtp_spool {
+    //! Spool file descriptor
+    int fd;
+    //! Bytes already written to the spool file
+    uint64_t written;
+    //! Records pending to be written
+    u_char buffer[STORAGE_RTP_BUFFER];
+    //! Bytes used in the buffer
+    size_t buflen;
+    //! Number of stored frames
+    uint32_t frames;
+};
+
+/**
+ * @brief Create the spool file in the given directory
+ *
+ * Spool file is removed from the directory once opened, so it will be
+ * deleted when sngrep exists.
+ *
+ * @param dir Directory for the spool file
+ * @return 0 if spool file has been created, 1 otherwise
+ */
+int
+storage_init(const char *dir);
+
+/**
+ * @brief Close the spool file
+ */
+void
+storage_deinit();
+
+/**
+ * @brief Move packet frames content to the spool file
+ *
+ * Frames are copied to spool memory blocks, they are written to disk
+ * later by the spool writer thread.
+ *
+ * @param packet Stored packet
+ * @return 0 if all frames have been moved, 1 otherwise
+ */
+int
+storage_spool_frames(packet_t *packet);
+
+/**
+ * @brief Get frame content from memory or spool file
+ *
+ * @param frame Packet frame
+ * @return allocated frame content that must be freed by the caller or
+ * NULL if frame content is not available
+ */
+u_char *
+storage_read_frame(const frame_t *frame);
+
+/**
+ * @brief Set which calls write their RTP packets to spool files
+ */
+void
+storage_set_rtp_mode(enum storage_rtp_mode mode);
+
+/**
+ * @brief Get which calls write their RTP packets to spool files
+ */
+enum storage_rtp_mode
+storage_get_rtp_mode();
+
+/**
+ * @brief Create a RTP spool file in the given directory
+ *
+ * Spool file is removed from the directory once opened, so it will be
+ * deleted when the spool is closed.
+ *
+ * @param dir Directory for the spool file
+ * @param link Link type of stored frames
+ * @return spool or NULL if file can not be created
+ */
+storage_rtp_spool_t *
+storage_rtp_open(const char *dir, int link);
+
+/**
+ * @brief Append packet frames to the spool as pcap records
+ *
+ * @return 0 if all frames have been stored, 1 otherwise
+ */
+int
+storage_rtp_write(storage_rtp_spool_t *spool, const packet_t *packet);
+
+/**
+ * @brief Read a pcap record from the spool
+ *
+ * Records start after the pcap file header (STORAGE_PCAP_HEADER) and each
+ * one is followed by the next one.
+ *
+ * @param spool RTP spool
+ * @param offset Record position in the spool file
+ * @param header Record header
+ * @param data Buffer for the record frame, reallocated as required
+ * @param size Size of the data buffer
+ * @return 0 if record has been read, 1 if there are no more records
+ */
+int
+storage_rtp_read(storage_rtp_spool_t *spool, uint64_t offset, struct pcap_pkthdr *header,
+                 u_char **data, size_t *size);
+
+/**
+ * @brief Close the spool file and release spool memory
+ */
+void
+storage_rtp_close(storage_rtp_spool_t *spool);
+
+#endif /* __SNGREP_STORAGE_H */
@@ -0,0 +1,286 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file strmatch.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source code of functions defined in strmatch.h
+ *
+ */
+#include "config.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strmatch.h"
+
+strmatch_t *
+strmatch_create(bool icase)
+{
+    strmatch_t *sm;
+
+    if (!(sm = calloc(1, sizeof(strmatch_t))))
+        return NULL;
+
+    sm->icase = icase;
+    return sm;
+}
+
+void
+strmatch_destroy(strmatch_t *sm)
+{
+    uint32_t i;
+
+    if (!sm)
+        return;
+
+    for (i = 0; i < sm->count; i++)
+        free(sm->patterns[i]);
+    free(sm->patterns);
+    free(sm->next);
+    free(sm->final);
+    free(sm);
+}
+
+int
+strmatch_add(strmatch_t *sm, const char *pattern)
+{
+    char **patterns;
+
+    // Empty patterns would match everything
+    if (!pattern || !strlen(pattern) || sm->next)
+        return 1;
+
+    if (!(patterns = realloc(sm->patterns, sizeof(char *) * (sm->count + 1))))
+        return 1;
+    sm->patterns = patterns;
+
+    if (!(sm->patterns[sm->count] = strdup(pattern)))
+        return 1;
+    sm->count++;
+    return 0;
+}
+
+/**
+ * @brief Get the byte that represents a pattern character
+ */
+static inline uint8_t
+strmatch_byte(strmatch_t *sm, char c)
+{
+    return sm->icase ? tolower((uint8_t) c) : (uint8_t) c;
+}
+
+int
+strmatch_compile(strmatch_t *sm)
+{
+    uint32_t *fail = NULL, *queue = NULL;
+    uint32_t i, c, s, t, max = 1, head = 0, tail = 0;
+    uint8_t byte;
+    const char *p;
+
+    if (!sm->count || sm->next)
+        return 1;
+
+    // Assign a class to each byte used in patterns
+    sm->nclasses = 1;
+    for (i = 0; i < sm->count; i++) {
+        for (p = sm->patterns[i]; *p; p++, max++) {
+            byte = strmatch_byte(sm, *p);
+            if (!sm->classes[byte]) {
+                sm->classes[byte] = sm->nclasses;
+                if (sm->icase)
+                    sm->classes[toupper(byte)] = sm->nclasses;
+                sm->nclasses++;
+            }
+        }
+    }
+
+    if (!(sm->next = calloc((size_t) max * sm->nclasses, sizeof(uint32_t)))
+        || !(sm->final = calloc(max, sizeof(uint8_t)))
+        || !(fail = calloc(max, sizeof(uint32_t)))
+        || !(queue = calloc(max, sizeof(uint32_t)))) {
+        free(sm->next);
+        free(sm->final);
+        free(fail);
+        sm->next = NULL;
+        sm->final = NULL;
+        return 1;
+    }
+
+    // Build patterns trie (transitions to initial state are missing edges)
+    sm->states = 1;
+    for (i = 0; i < sm->count; i++) {
+        s = 0;
+        for (p = sm->patterns[i]; *p; p++) {
+            c = sm->classes[strmatch_byte(sm, *p)];
+            if (!sm->next[s * sm->nclasses + c])
+                sm->next[s * sm->nclasses + c] = sm->states++;
+            s = sm->next[s * sm->nclasses + c];
+        }
+        sm->final[s] = 1;
+    }
+
+    // States following the initial one fail to it
+    for (c = 0; c < sm->nclasses; c++) {
+        if ((t = sm->next[c]))
+            queue[tail++] = t;
+    }
+
+    // Fill missing transitions with the ones of the failure state
+    while (head < tail) {
+        s = queue[head++];
+        sm->final[s] |= sm->final[fail[s]];
+        for (c = 0; c < sm->nclasses; c++) {
+            t = sm->next[s * sm->nclasses + c];
+            if (t) {
+                fail[t] = sm->next[fail[s] * sm->nclasses + c];
+                queue[tail++] = t;
+            } else {
+                sm->next[s * sm->nclasses + c] = sm->next[fail[s] * sm->nclasses + c];
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+bool
+strmatch_find(strmatch_t *sm, const char *data, size_t len)
+{
+    const uint8_t *byte = (const uint8_t *) data, *end = byte + len;
+    uint32_t s = 0;
+
+    if (!sm->next)
+        return false;
+
+    // A single case sensitive pattern is faster with libc search
+    if (sm->count == 1 && !sm->icase)
+        return memmem(data, len, sm->patterns[0], strlen(sm->patterns[0])) != NULL;
+
+    for (; byte < end; byte++) {
+        s = sm->next[s * sm->nclasses + sm->classes[*byte]];
+        if (sm->final[s])
+            return true;
+    }
+    return false;
+}
+
+bool
+strmatch_regex_literal(const char *expr, char *literal, size_t size)
+{
+    char run[size];
+    size_t len = 0;
+    int depth;
+    bool pure = true;
+    const char *p;
+
+    literal[0] = '\0';
+
+    // No literal is required by all alternatives
+    if (strchr(expr, '|'))
+        return false;
+
+    for (p = expr; *p; p++) {
+        switch (*p) {
+            case '\\':
+                // Escaped classes and assertions (\d, \w, \b, ...)
+                if (!p[1] || isalnum((uint8_t) p[1])) {
+                    pure = false;
+                    goto end_run;
+                }
+                p++;
+                break;
+            case '[':
+                // Skip bracket expression (']' is literal as first item)
+                p++;
+                if (*p == '^')
+                    p++;
+                if (*p == ']')
+                    p++;
+                while (*p && *p != ']')
+                    p++;
+                if (!*p)
+                    p--;
+                pure = false;
+                goto end_run;
+            case '(':
+                // Skip groups, their content may be optional
+                for (depth = 1, p++; *p && depth; p++) {
+                    if (*p == '\\' && p[1])
+                        p++;
+                    else if (*p == '(')
+                        depth++;
+                    else if (*p == ')')
+                        depth--;
+                }
+                p--;
+                pure = false;
+                goto end_run;
+            case '*':
+            case '?':
+            case '{':
+                // Previous character is optional
+                if (len)
+                    len--;
+                if (*p == '{') {
+                    while (p[1] && *p != '}')
+                        p++;
+                }
+                pure = false;
+                goto end_run;
+            case '+':
+            case '.':
+            case '^':
+            case '$':
+            case ')':
+            case ']':
+            case '}':
+                pure = false;
+                goto end_run;
+            default:
+                break;
+        }
+
+        // Literal character
+        if (len < size - 1) {
+            run[len++] = *p;
+        } else {
+            pure = false;
+        }
+        continue;
+
+end_run:
+        if (len > strlen(literal)) {
+            memcpy(literal, run, len);
+            literal[len] = '\0';
+        }
+        len = 0;
+    }
+
+    if (len > strlen(literal)) {
+        memcpy(literal, run, len);
+        literal[len] = '\0';
+    }
+
+    return pure && strlen(literal);
+}
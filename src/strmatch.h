@@ -0,0 +1,120 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file strmatch.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to search several literal strings in one pass
+ *
+ * Patterns are compiled into an Aho-Corasick automaton, so payloads
+ * are scanned once no matter how many patterns are searched. Automaton
+ * only has transitions for the bytes used in patterns, any other byte
+ * goes back to the initial state.
+ */
+
+#ifndef __SNGREP_STRMATCH_H_
+#define __SNGREP_STRMATCH_H_
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Shorter declaration of strmatch structure
+typedef struct strmatch strmatch_t;
+
+/**
+ * @brief Literal strings matcher
+ */
+struct strmatch {
+    //! Compare patterns ignoring ASCII case
+    bool icase;
+    //! Added patterns
+    char **patterns;
+    //! Number of added patterns
+    uint32_t count;
+    //! Class of each byte (0 for bytes not used in any pattern)
+    uint8_t classes[256];
+    //! Number of byte classes
+    uint32_t nclasses;
+    //! Automaton transitions (states * classes)
+    uint32_t *next;
+    //! States that end a pattern
+    uint8_t *final;
+    //! Number of automaton states
+    uint32_t states;
+};
+
+/**
+ * @brief Create an empty literal strings matcher
+ *
+ * @param icase Compare patterns ignoring ASCII case
+ * @return new matcher or NULL on allocation error
+ */
+strmatch_t *
+strmatch_create(bool icase);
+
+/**
+ * @brief Destroy a matcher and its patterns
+ */
+void
+strmatch_destroy(strmatch_t *sm);
+
+/**
+ * @brief Add a pattern to the matcher
+ *
+ * Patterns can not be added after compiling the matcher.
+ *
+ * @return 0 on success, 1 on error
+ */
+int
+strmatch_add(strmatch_t *sm, const char *pattern);
+
+/**
+ * @brief Build the automaton of added patterns
+ *
+ * @return 0 on success, 1 on error
+ */
+int
+strmatch_compile(strmatch_t *sm);
+
+/**
+ * @brief Check if data contains any of the matcher patterns
+ */
+bool
+strmatch_find(strmatch_t *sm, const char *data, size_t len);
+
+/**
+ * @brief Get the longest literal that any match of a regexp contains
+ *
+ * Only literal characters outside groups and brackets are extracted.
+ * Expressions with alternatives don't have any required literal.
+ *
+ * @param expr Extended regular expression
+ * @param literal Buffer to store the literal
+ * @param size Size of the literal buffer
+ * @return true if the whole expression is a literal string
+ */
+bool
+strmatch_regex_literal(const char *expr, char *literal, size_t size);
+
+#endif /* __SNGREP_STRMATCH_H_ */
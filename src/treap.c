@@ -0,0 +1,339 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file treap.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in treap.h
+ */
+#include "config.h"
+#include <stdlib.h>
+#include "treap.h"
+#include "util.h"
+
+//! Size of a (maybe empty) subtree
+#define TREAP_SIZE(node)   ((node) ? (node)->size : 0)
+//! Marked nodes of a (maybe empty) subtree
+#define TREAP_MARKED(node) ((node) ? (node)->marked : 0)
+
+treap_t *
+treap_create()
+{
+    treap_t *treap;
+
+    if (!(treap = sng_malloc(sizeof(treap_t))))
+        return NULL;
+
+    treap->seed = 0x9e3779b9;
+    return treap;
+}
+
+/**
+ * @brief Release a subtree nodes
+ */
+static void
+treap_destroy_nodes(treap_node_t *node)
+{
+    if (!node)
+        return;
+
+    treap_destroy_nodes(node->left);
+    treap_destroy_nodes(node->right);
+    sng_free(node);
+}
+
+void
+treap_destroy(treap_t *treap)
+{
+    if (!treap)
+        return;
+
+    treap_destroy_nodes(treap->root);
+    sng_free(treap);
+}
+
+void
+treap_clear(treap_t *treap)
+{
+    treap_destroy_nodes(treap->root);
+    treap->root = NULL;
+}
+
+/**
+ * @brief Calculate node counters from its children
+ */
+static void
+treap_update(treap_node_t *node)
+{
+    node->size = 1 + TREAP_SIZE(node->left) + TREAP_SIZE(node->right);
+    node->marked = node->mark + TREAP_MARKED(node->left) + TREAP_MARKED(node->right);
+}
+
+/**
+ * @brief Replace the parent link of a node
+ */
+static void
+treap_replace(treap_t *treap, treap_node_t *node, treap_node_t *child)
+{
+    if (!node->parent)
+        treap->root = child;
+    else if (node->parent->left == node)
+        node->parent->left = child;
+    else
+        node->parent->right = child;
+
+    if (child)
+        child->parent = node->parent;
+}
+
+/**
+ * @brief Rotate a node over its parent
+ */
+static void
+treap_rotate(treap_t *treap, treap_node_t *node)
+{
+    treap_node_t *parent = node->parent;
+
+    treap_replace(treap, parent, node);
+
+    if (parent->left == node) {
+        parent->left = node->right;
+        if (node->right)
+            node->right->parent = parent;
+        node->right = parent;
+    } else {
+        parent->right = node->left;
+        if (node->left)
+            node->left->parent = parent;
+        node->left = parent;
+    }
+    parent->parent = node;
+
+    treap_update(parent);
+    treap_update(node);
+}
+
+treap_node_t *
+treap_insert(treap_t *treap, int pos, void *data)
+{
+    treap_node_t *node, *parent = NULL, *cur;
+    bool left = false;
+
+    if (!(node = sng_malloc(sizeof(treap_node_t))))
+        return NULL;
+
+    // Xorshift random priority
+    treap->seed ^= treap->seed << 13;
+    treap->seed ^= treap->seed >> 17;
+    treap->seed ^= treap->seed << 5;
+    node->prio = treap->seed;
+    node->data = data;
+    node->size = 1;
+
+    // Look for the new leaf position
+    for (cur = treap->root; cur; ) {
+        parent = cur;
+        cur->size++;
+        if (pos <= (int) TREAP_SIZE(cur->left)) {
+            cur = cur->left;
+            left = true;
+        } else {
+            pos -= TREAP_SIZE(cur->left) + 1;
+            cur = cur->right;
+            left = false;
+        }
+    }
+
+    // Link the new leaf
+    node->parent = parent;
+    if (!parent)
+        treap->root = node;
+    else if (left)
+        parent->left = node;
+    else
+        parent->right = node;
+
+    // Restore heap order
+    while (node->parent && node->parent->prio < node->prio)
+        treap_rotate(treap, node);
+
+    return node;
+}
+
+int
+treap_bound(treap_t *treap, const void *item, int (*cmp)(const void *a, const void *b))
+{
+    treap_node_t *cur = treap->root;
+    int pos = 0;
+
+    while (cur) {
+        if (cmp(item, cur->data) < 0) {
+            cur = cur->left;
+        } else {
+            pos += TREAP_SIZE(cur->left) + 1;
+            cur = cur->right;
+        }
+    }
+
+    return pos;
+}
+
+void
+treap_remove(treap_t *treap, treap_node_t *node)
+{
+    treap_node_t *child, *cur;
+
+    // Move the node down until it has one child at most
+    while (node->left && node->right) {
+        child = (node->left->prio > node->right->prio) ? node->left : node->right;
+        treap_rotate(treap, child);
+    }
+
+    // Replace the node with its child
+    child = (node->left) ? node->left : node->right;
+    treap_replace(treap, node, child);
+
+    // Update ancestors counters
+    for (cur = node->parent; cur; cur = cur->parent) {
+        cur->size--;
+        cur->marked -= node->mark;
+    }
+
+    sng_free(node);
+}
+
+int
+treap_count(treap_t *treap)
+{
+    return TREAP_SIZE(treap->root);
+}
+
+int
+treap_marked_count(treap_t *treap)
+{
+    return TREAP_MARKED(treap->root);
+}
+
+int
+treap_position(treap_node_t *node)
+{
+    int pos = TREAP_SIZE(node->left);
+
+    for (; node->parent; node = node->parent) {
+        if (node->parent->right == node)
+            pos += TREAP_SIZE(node->parent->left) + 1;
+    }
+
+    return pos;
+}
+
+int
+treap_marked_position(treap_node_t *node)
+{
+    int pos;
+
+    if (!node->mark)
+        return -1;
+
+    for (pos = TREAP_MARKED(node->left); node->parent; node = node->parent) {
+        if (node->parent->right == node)
+            pos += TREAP_MARKED(node->parent->left) + node->parent->mark;
+    }
+
+    return pos;
+}
+
+void *
+treap_item(treap_t *treap, int pos)
+{
+    treap_node_t *cur = treap->root;
+
+    if (pos < 0 || pos >= treap_count(treap))
+        return NULL;
+
+    while (cur) {
+        if (pos < (int) TREAP_SIZE(cur->left)) {
+            cur = cur->left;
+        } else if (pos == (int) TREAP_SIZE(cur->left)) {
+            return cur->data;
+        } else {
+            pos -= TREAP_SIZE(cur->left) + 1;
+            cur = cur->right;
+        }
+    }
+
+    return NULL;
+}
+
+void *
+treap_marked_item(treap_t *treap, int pos)
+{
+    treap_node_t *cur = treap->root;
+
+    if (pos < 0 || pos >= treap_marked_count(treap))
+        return NULL;
+
+    while (cur) {
+        if (pos < (int) TREAP_MARKED(cur->left)) {
+            cur = cur->left;
+        } else if (cur->mark && pos == (int) TREAP_MARKED(cur->left)) {
+            return cur->data;
+        } else {
+            pos -= TREAP_MARKED(cur->left) + cur->mark;
+            cur = cur->right;
+        }
+    }
+
+    return NULL;
+}
+
+void
+treap_set_mark(treap_node_t *node, bool mark)
+{
+    if (node->mark == mark)
+        return;
+
+    node->mark = mark;
+    for (; node; node = node->parent)
+        node->marked += (mark) ? 1 : -1;
+}
+
+/**
+ * @brief Unmark all nodes of a subtree
+ */
+static void
+treap_clear_marks_nodes(treap_node_t *node)
+{
+    if (!node || !node->marked)
+        return;
+
+    node->mark = false;
+    node->marked = 0;
+    treap_clear_marks_nodes(node->left);
+    treap_clear_marks_nodes(node->right);
+}
+
+void
+treap_clear_marks(treap_t *treap)
+{
+    treap_clear_marks_nodes(treap->root);
+}
@@ -0,0 +1,182 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file treap.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to manage positional treaps
+ *
+ * A treap keeps a sequence of items in a randomized balanced binary tree,
+ * so items can be inserted or removed at any position and found by their
+ * position in logarithmic time.
+ *
+ * Each item can also be marked. Marked items can be counted and found by
+ * their position between marked items, which allows keeping a filtered
+ * view of the sequence without copying it.
+ */
+
+#ifndef __SNGREP_TREAP_H_
+#define __SNGREP_TREAP_H_
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+//! Shorter declaration of treap structures
+typedef struct treap treap_t;
+typedef struct treap_node treap_node_t;
+
+/**
+ * @brief Treap node holding one item of the sequence
+ */
+struct treap_node {
+    //! Item of the sequence
+    void *data;
+    //! Tree links
+    treap_node_t *parent, *left, *right;
+    //! Random heap priority
+    uint32_t prio;
+    //! Number of nodes in this subtree
+    uint32_t size;
+    //! Number of marked nodes in this subtree
+    uint32_t marked;
+    //! This item is marked
+    bool mark;
+};
+
+/**
+ * @brief Treap structure
+ */
+struct treap {
+    //! Tree root node
+    treap_node_t *root;
+    //! Random generator state for priorities
+    uint32_t seed;
+};
+
+/**
+ * @brief Create a new empty treap
+ *
+ * @return allocated treap or NULL on error
+ */
+treap_t *
+treap_create();
+
+/**
+ * @brief Destroy a treap and all its nodes
+ *
+ * Items stored in the nodes are not released.
+ */
+void
+treap_destroy(treap_t *treap);
+
+/**
+ * @brief Remove all nodes of the treap
+ */
+void
+treap_clear(treap_t *treap);
+
+/**
+ * @brief Insert an item in the given position
+ *
+ * Items in that position and after it are moved one position.
+ * Inserted item is not marked.
+ *
+ * @param pos Position of the new item (clamped to the sequence size)
+ * @return created node or NULL on allocation error
+ */
+treap_node_t *
+treap_insert(treap_t *treap, int pos, void *data);
+
+/**
+ * @brief Find the sorted position of an item
+ *
+ * Treap items must be sorted using the given compare function.
+ *
+ * @param item Item to look for (not required to be in the treap)
+ * @param cmp Compare function returning negative, 0 or positive like strcmp
+ * @return position after all the items not greater than given item
+ */
+int
+treap_bound(treap_t *treap, const void *item, int (*cmp)(const void *a, const void *b));
+
+/**
+ * @brief Remove a node from the treap
+ */
+void
+treap_remove(treap_t *treap, treap_node_t *node);
+
+/**
+ * @brief Get the number of items in the treap
+ */
+int
+treap_count(treap_t *treap);
+
+/**
+ * @brief Get the number of marked items in the treap
+ */
+int
+treap_marked_count(treap_t *treap);
+
+/**
+ * @brief Get the position of a node in the sequence
+ */
+int
+treap_position(treap_node_t *node);
+
+/**
+ * @brief Get the position of a node between marked nodes
+ *
+ * @return position of the node or -1 if node is not marked
+ */
+int
+treap_marked_position(treap_node_t *node);
+
+/**
+ * @brief Get the item in the given position
+ *
+ * @return item or NULL if position is out of bounds
+ */
+void *
+treap_item(treap_t *treap, int pos);
+
+/**
+ * @brief Get the marked item in the given position between marked items
+ *
+ * @return item or NULL if position is out of bounds
+ */
+void *
+treap_marked_item(treap_t *treap, int pos);
+
+/**
+ * @brief Mark or unmark a node
+ */
+void
+treap_set_mark(treap_node_t *node, bool mark);
+
+/**
+ * @brief Unmark all nodes of the treap
+ */
+void
+treap_clear_marks(treap_t *treap);
+
+#endif /* __SNGREP_TREAP_H_ */
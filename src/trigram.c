@@ -0,0 +1,121 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file trigram.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source code of functions defined in trigram.h
+ *
+ */
+#include "config.h"
+#include <string.h>
+#include "strmatch.h"
+#include "trigram.h"
+
+//! Max length of an expression required literal
+#define TRIGRAM_LITERAL_LEN 256
+
+/**
+ * @brief Lowercase an ASCII byte
+ */
+static inline uint32_t
+trigram_lower(uint8_t c)
+{
+    return (c - 'A' < 26u) ? c | 0x20 : c;
+}
+
+/**
+ * @brief Get the signature bit of a trigram
+ */
+static inline uint32_t
+trigram_bit(uint32_t trigram)
+{
+    return (trigram * 0x9E3779B1u) >> (32 - 12);
+}
+
+void
+trigram_sig_add(uint8_t *sig, const char *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    uint32_t trigram, bit;
+    size_t i;
+
+    if (!sig || !data || len < 3)
+        return;
+
+    trigram = trigram_lower(p[0]) << 8 | trigram_lower(p[1]);
+    for (i = 2; i < len; i++) {
+        trigram = ((trigram << 8) | trigram_lower(p[i])) & 0xFFFFFF;
+        bit = trigram_bit(trigram);
+        sig[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+bool
+trigram_sig_match(const uint8_t *sig, const trigram_query_t *query)
+{
+    uint32_t i;
+
+    for (i = 0; i < query->count; i++) {
+        if (!(sig[query->bits[i] >> 3] & (1 << (query->bits[i] & 7))))
+            return false;
+    }
+
+    return true;
+}
+
+bool
+trigram_query_compile(trigram_query_t *query, const char *expr)
+{
+    char literal[TRIGRAM_LITERAL_LEN];
+    const uint8_t *p;
+    uint32_t trigram, bit, i;
+    size_t len, pos, ascii;
+
+    query->count = 0;
+
+    if (!expr)
+        return false;
+
+    // Only the required literal can be searched in the signatures
+    strmatch_regex_literal(expr, literal, sizeof(literal));
+    if ((len = strlen(literal)) < 3)
+        return false;
+
+    p = (const uint8_t *) literal;
+    for (pos = 0, ascii = 0, trigram = 0; pos < len && query->count < TRIGRAM_QUERY_MAX; pos++) {
+        trigram = ((trigram << 8) | trigram_lower(p[pos])) & 0xFFFFFF;
+
+        // Case of non ASCII bytes depends on the expression locale
+        ascii = (p[pos] < 0x80) ? ascii + 1 : 0;
+        if (ascii < 3)
+            continue;
+        bit = trigram_bit(trigram);
+
+        // Skip repeated bits
+        for (i = 0; i < query->count && query->bits[i] != bit; i++);
+        if (i == query->count)
+            query->bits[query->count++] = bit;
+    }
+
+    return query->count > 0;
+}
@@ -0,0 +1,93 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file trigram.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to index payloads by their trigrams
+ *
+ * Each indexed item keeps a fixed size signature with one bit set for
+ * every trigram (three consecutive bytes, ignoring ASCII case) found in
+ * its data. Searches only need to check the bits of the trigrams of
+ * the required literal of their expression: items missing any of them
+ * can't match, while the rest must still be verified with the expression
+ * because different trigrams may share the same bit.
+ */
+
+#ifndef __SNGREP_TRIGRAM_H_
+#define __SNGREP_TRIGRAM_H_
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Bits of each trigram signature
+#define TRIGRAM_SIG_BITS 4096
+//! Bytes of each trigram signature
+#define TRIGRAM_SIG_SIZE (TRIGRAM_SIG_BITS / 8)
+//! Max trigrams checked for each search
+#define TRIGRAM_QUERY_MAX 64
+
+//! Shorter declaration of trigram_query structure
+typedef struct trigram_query trigram_query_t;
+
+/**
+ * @brief Signature bits required to match an expression
+ */
+struct trigram_query {
+    //! Number of required bits (0 if any signature may match)
+    uint32_t count;
+    //! Signature bit of each required trigram
+    uint16_t bits[TRIGRAM_QUERY_MAX];
+};
+
+/**
+ * @brief Add the trigrams of given data to a signature
+ *
+ * @param sig Signature of TRIGRAM_SIG_SIZE bytes
+ * @param data Data to index
+ * @param len Length of the data
+ */
+void
+trigram_sig_add(uint8_t *sig, const char *data, size_t len);
+
+/**
+ * @brief Check if a signature has all the bits required by a search
+ */
+bool
+trigram_sig_match(const uint8_t *sig, const trigram_query_t *query);
+
+/**
+ * @brief Get the signature bits required to match a regexp
+ *
+ * Bits are taken from the trigrams of the longest literal that any
+ * match of the expression contains.
+ *
+ * @param query Query to fill
+ * @param expr Extended regular expression
+ * @return true if the expression requires any bit
+ */
+bool
+trigram_query_compile(trigram_query_t *query, const char *expr);
+
+#endif /* __SNGREP_TRIGRAM_H_ */
@@ -89,8 +89,9 @@ const char *
 timeval_to_date(struct timeval time, char *out)
 {
     time_t t = (time_t) time.tv_sec;
-    struct tm *timestamp = localtime(&t);
-    strftime(out, 11, "%Y/%m/%d", timestamp);
+    struct tm timestamp;
+    localtime_r(&t, &timestamp);
+    strftime(out, 11, "%Y/%m/%d", &timestamp);
     return out;
 }
 
@@ -99,8 +100,9 @@ const char *
 timeval_to_time(struct timeval time, char *out)
 {
     time_t t = (time_t) time.tv_sec;
-    struct tm *timestamp = localtime(&t);
-    strftime(out, 19, "%H:%M:%S", timestamp);
+    struct tm timestamp;
+    localtime_r(&t, &timestamp);
+    strftime(out, 19, "%H:%M:%S", &timestamp);
     sprintf(out + 8, ".%06d", (int) time.tv_usec);
     return out;
 }
@@ -143,6 +145,60 @@ timeval_to_delta(struct timeval start, struct timeval end, char *out)
     sprintf(out, "%c%d.%06d", sign, abs(nsec), nusec);
     return out;
 }
+
+const char *
+bytes_to_human(size_t bytes, char *out)
+{
+    const char *units = "KMGT";
+    double size = bytes;
+    int unit = -1;
+
+    if (!out)
+        return NULL;
+
+    if (bytes < 1024) {
+        sprintf(out, "%zuB", bytes);
+        return out;
+    }
+
+    while (size >= 1024 && unit < 3) {
+        size /= 1024;
+        unit++;
+    }
+
+    sprintf(out, (size < 10) ? "%.1f%c" : "%.0f%c", size, units[unit]);
+    return out;
+}
+int
+timeval_from_str(const char *str, struct timeval *time)
+{
+    struct tm timestamp;
+    const char *end;
+    char *usec;
+    double secs;
+
+    // Seconds since epoch
+    secs = strtod(str, &usec);
+    if (usec != str && *usec == '\0') {
+        time->tv_sec = (time_t) secs;
+        time->tv_usec = (suseconds_t) ((secs - time->tv_sec) * 1000000);
+        return 0;
+    }
+
+    // Local time date
+    memset(&timestamp, 0, sizeof(timestamp));
+    if (!(end = strptime(str, "%Y/%m/%d %H:%M:%S", &timestamp))
+        && !(end = strptime(str, "%Y-%m-%d %H:%M:%S", &timestamp)))
+        return 1;
+    if (*end != '\0')
+        return 1;
+
+    timestamp.tm_isdst = -1;
+    time->tv_sec = mktime(&timestamp);
+    time->tv_usec = 0;
+    return 0;
+}
+
 char *
 strtrim(char *str)
 {
@@ -90,6 +90,23 @@ timeval_to_duration(struct timeval start, struct timeval end, char *out);
 const char *
 timeval_to_delta(struct timeval start, struct timeval end, char *out);
 
+/**
+ * @brief Convert a bytes count to a short human readable size (1.5M)
+ */
+const char *
+bytes_to_human(size_t bytes, char *out);
+
+/**
+ * @brief Convert a date string to timeval
+ *
+ * Accepted formats are seconds since epoch (with optional fraction) and
+ * local time dates in yyyy/mm/dd HH:MM:SS or yyyy-mm-dd HH:MM:SS format.
+ *
+ * @return 0 if string has been converted, 1 otherwise
+ */
+int
+timeval_from_str(const char *str, struct timeval *time);
+
 /**
  * @brief Return a given string without trailing spaces
  */
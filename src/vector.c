@@ -32,6 +32,77 @@
 #include <stdio.h>
 #include "util.h"
 
+/**
+ * @brief Get the number of used list positions (elements and holes)
+ */
+static inline uint32_t
+vector_used(vector_t *vector)
+{
+    return vector->count + vector->holes;
+}
+
+/**
+ * @brief Move list elements to fill holes of removed elements
+ *
+ * @param vector Vector to compact
+ * @param pos Iterator position to update (NULL if none)
+ */
+static void
+vector_compact(vector_t *vector, int *pos)
+{
+    uint32_t i, j, end, holes = vector->holes, used = vector_used(vector);
+    int newpos = (pos && *pos >= (int) used) ? (int) vector->count : -1;
+
+    // Positions before the first hole don't change
+    for (i = vector->hole; i < used && vector->list[i]; i++);
+    if (pos && *pos < (int) i)
+        newpos = *pos;
+
+    for (j = i; i < used; i = end) {
+        // Position of a removed element continues with the next one
+        for (; i < used && !vector->list[i]; i++, holes--) {
+            if (pos && *pos == (int) i)
+                newpos = (int) j - 1;
+        }
+        // Move next run of elements
+        if (holes) {
+            for (end = i; end < used && vector->list[end]; end++);
+        } else {
+            end = used;
+        }
+        if (pos && *pos >= (int) i && *pos < (int) end)
+            newpos = j + *pos - i;
+        memmove(vector->list + j, vector->list + i, sizeof(void *) * (end - i));
+        j += end - i;
+    }
+
+    memset(vector->list + j, 0, sizeof(void *) * vector->holes);
+    vector->holes = 0;
+    if (pos && *pos >= 0)
+        *pos = newpos;
+}
+
+/**
+ * @brief Get the list position of an item
+ *
+ * @return position or -1 if not found
+ */
+static int
+vector_slot(vector_t *vector, void *item)
+{
+    uint32_t i, used = vector_used(vector);
+
+    // Last item is usually the one requested
+    if (used && vector->list[used - 1] == item)
+        return used - 1;
+
+    for (i = 0; i < used; i++) {
+        if (vector->list[i] == item)
+            return i;
+    }
+    return -1;
+}
+
 vector_t *
 vector_create(int limit, int step)
 {
@@ -41,9 +112,13 @@ vector_create(int limit, int step)
         return NULL;
 
     v->count = 0;
+    v->holes = 0;
+    v->hole = 0;
+    v->shift = 0;
     v->limit = limit;
     v->step = step;
     v->list = NULL;
+    v->base = NULL;
     v->sorter = NULL;
     v->destroyer = NULL;
 
@@ -58,7 +133,7 @@ vector_destroy(vector_t *vector)
     // Remove all items if a destroyer is set
     vector_clear(vector);
     // Deallocate vector list
-    sng_free(vector->list);
+    sng_free(vector->base);
     // Deallocate vector itself
     sng_free(vector);
 }
@@ -73,11 +148,11 @@ vector_destroy_items(vector_t *vector)
 
     // If vector contains items
     if (vector->count) {
-        for (i = 0; i < vector->count; i++) {
+        for (i = 0; i < (int) vector_used(vector); i++) {
             free(vector->list[i]);
         }
-        free(vector->list);
     }
+    free(vector->base);
     free(vector);
 }
 
@@ -106,6 +181,23 @@ vector_clone(vector_t *original)
     return clone;
 }
 
+void
+vector_sort(vector_t *vector, int (*cmp)(const void *a, const void *b))
+{
+    if (vector->holes)
+        vector_compact(vector, NULL);
+    if (vector->count > 1)
+        qsort(vector->list, vector->count, sizeof(void *), cmp);
+}
+
+void **
+vector_list(vector_t *vector)
+{
+    if (vector->holes)
+        vector_compact(vector, NULL);
+    return vector->list;
+}
+
 vector_t *
 vector_copy_if(vector_t *original, int (*filter)(void *item))
 {
@@ -140,28 +232,48 @@ vector_clear(vector_t *vector)
 int
 vector_append(vector_t *vector, void *item)
 {
+    size_t offset, grow;
+
     // Sanity check
     if (!item)
         return vector->count;
 
     // Check if the vector has been initializated
-    if (!vector->list) {
-        vector->list = malloc(sizeof(void *) * vector->limit);
+    if (!vector->base) {
+        vector->base = vector->list = malloc(sizeof(void *) * vector->limit);
         memset(vector->list, 0, sizeof(void *) * vector->limit);
     }
 
     // Check if we need to increase vector size
-    if (vector->count == vector->limit) {
-        // Increase vector size
-        vector->limit += vector->step;
-        // Add more memory to the list
-        vector->list = realloc(vector->list, sizeof(void *) * vector->limit);
-        // Initialize new allocated memory
-        memset(vector->list + vector->limit - vector->step, 0, vector->step);
+    offset = vector->list - vector->base;
+    if (vector_used(vector) + offset == vector->limit) {
+        if (offset && offset >= vector_used(vector)) {
+            // Reuse the space of removed first items
+            memmove(vector->base, vector->list, sizeof(void *) * vector_used(vector));
+            memset(vector->base + vector_used(vector), 0, sizeof(void *) * offset);
+            vector->list = vector->base;
+        } else if (vector->holes && vector->holes >= vector_used(vector) / 4) {
+            // Reuse the space of removed items
+            vector_compact(vector, NULL);
+        } else {
+            // Increase vector size by half its size (at least step positions)
+            grow = vector->limit / 2;
+            if (grow < vector->step)
+                grow = vector->step;
+            if (grow == 0)
+                grow = 1;
+            vector->limit += grow;
+            // Add more memory to the list
+            vector->base = realloc(vector->base, sizeof(void *) * vector->limit);
+            vector->list = vector->base + offset;
+            // Initialize new allocated memory
+            memset(vector->base + vector->limit - grow, 0, sizeof(void *) * grow);
+        }
     }
 
     // Add item to the end of the list
-    vector->list[vector->count++] = item;
+    vector->list[vector_used(vector)] = item;
+    vector->count++;
 
     // Check if vector has a sorter
     if (vector->sorter) {
@@ -192,9 +304,12 @@ vector_insert(vector_t *vector, void *item, int pos)
     if (!item)
         return vector->count;
 
-    if (pos < 0 || pos > vector->count - 2)
+    if (pos < 0 || pos > (int) vector->count - 2)
         return vector->count;
 
+    if (vector->holes)
+        vector_compact(vector, NULL);
+
     // If position is already filled with that item, we're done
     if (vector->list[pos] == item)
         return vector->count;
@@ -215,17 +330,35 @@ void
 vector_remove(vector_t *vector, void *item)
 {
     // Get item position
-    int idx = vector_index(vector, item);
+    int idx = vector_slot(vector, item);
     // Not found in the vector
     if (idx == -1)
         return;
 
     // Decrease item counter
     vector->count--;
-    // Move the rest of the elements one position up
-    memmove(vector->list + idx, vector->list + idx + 1, sizeof(void *) * (vector->count - idx));
-    // Reset vector last position
-    vector->list[vector->count] = NULL;
+    vector->list[idx] = NULL;
+    if (!vector->count) {
+        // Empty list starts again in the first position
+        vector->shift += vector_used(vector) + 1;
+        vector->list = vector->base;
+        vector->holes = 0;
+    } else if (idx == 0) {
+        // Removing first item only moves the list start
+        for (idx = 1, vector->list++; !vector->list[0]; idx++, vector->list++)
+            vector->holes--;
+        vector->shift += idx;
+        vector->hole = (vector->hole > idx) ? vector->hole - idx : 0;
+    } else if (idx == vector_used(vector)) {
+        // Removing last item only reduces used positions
+        while (!vector->list[vector_used(vector) - 1])
+            vector->holes--;
+    } else {
+        // Leave a hole instead of moving the rest of the elements
+        if (!vector->holes || idx < vector->hole)
+            vector->hole = idx;
+        vector->holes++;
+    }
 
     // Destroy the item if vector has a destroyer
     if (vector->destroyer) {
@@ -254,41 +387,47 @@ vector_generic_destroyer(void *item)
 void *
 vector_item(vector_t *vector, int index)
 {
-    if (!vector || index >= vector->count || index < 0)
+    if (!vector || index >= (int) vector->count || index < 0)
         return NULL;
+    if (vector->holes)
+        vector_compact(vector, NULL);
     return vector->list[index];
 }
 
 void
 vector_set_item(vector_t *vector, int index, void *item)
 {
-    if (!vector || index >= vector->count || index < 0)
+    if (!vector || index >= (int) vector->count || index < 0)
         return;
+    if (vector->holes)
+        vector_compact(vector, NULL);
     vector->list[index] = item;
 }
 
 void *
 vector_first(vector_t *vector)
 {
-    return vector_item(vector, 0);
+    // First and last positions are never holes
+    if (!vector || !vector->count)
+        return NULL;
+    return vector->list[0];
 }
 
 void *
 vector_last(vector_t *vector)
 {
-    return vector_item(vector, vector_count(vector) - 1);
+    if (!vector || !vector->count)
+        return NULL;
+    return vector->list[vector_used(vector) - 1];
 }
 
 int
 vector_index(vector_t *vector, void *item)
 {
     // FIXME Bad perfomance
-    int i;
-    for (i = 0; i < vector->count; i++) {
-        if (vector->list[i] == item)
-            return i;
-    }
-    return -1;
+    if (vector->holes)
+        vector_compact(vector, NULL);
+    return vector_slot(vector, item);
 }
 
 int
@@ -304,9 +443,25 @@ vector_iterator(vector_t *vector)
     memset(&it, 0, sizeof(vector_iter_t));
     it.current = -1;
     it.vector = vector;
+    it.shift = (vector) ? vector->shift : 0;
     return it;
 }
 
+/**
+ * @brief Update iterator position after removing first vector items
+ */
+static void
+vector_iterator_sync(vector_iter_t *it)
+{
+    if (!it->vector || it->shift == it->vector->shift)
+        return;
+
+    it->current -= (int) (it->vector->shift - it->shift);
+    if (it->current < -1)
+        it->current = -1;
+    it->shift = it->vector->shift;
+}
+
 vector_t *
 vector_iterator_vector(vector_iter_t *it)
 {
@@ -317,7 +472,10 @@ int
 vector_iterator_count(vector_iter_t *it)
 {
     int count = 0;
-    int pos = it->current;
+    int pos;
+
+    vector_iterator_sync(it);
+    pos = it->current;
 
     vector_iterator_reset(it);
 
@@ -329,7 +487,8 @@ vector_iterator_count(vector_iter_t *it)
         }
     }
 
-    vector_iterator_set_current(it, pos);
+    // Restore position without compacting the list
+    it->current = pos;
 
     return count;
 }
@@ -338,18 +497,22 @@ void *
 vector_iterator_next(vector_iter_t *it)
 {
     void *item;
+    int used;
 
-    if (!it || it->current >= vector_count(it->vector))
+    if (!it || !it->vector)
         return NULL;
 
-    while ((item = vector_item(it->vector, ++it->current))) {
-        if (it->filter) {
-            if (it->filter(item)) {
-                return item;
-            }
-        } else {
+    vector_iterator_sync(it);
+    used = vector_used(it->vector);
+    if (it->current >= used)
+        return NULL;
+
+    // Skip holes of removed items
+    while (++it->current < used) {
+        if (!(item = it->vector->list[it->current]))
+            continue;
+        if (!it->filter || it->filter(item))
             return item;
-        }
     }
     return NULL;
 }
@@ -359,17 +522,19 @@ vector_iterator_prev(vector_iter_t *it)
 {
     void *item;
 
-    if (it->current == -1)
+    vector_iterator_sync(it);
+    if (it->current == -1 || !it->vector)
         return NULL;
 
-    while ((item = vector_item(it->vector, --it->current))) {
-        if (it->filter) {
-            if (it->filter(item)) {
-                return item;
-            }
-        } else {
+    if (it->current > (int) vector_used(it->vector))
+        it->current = vector_used(it->vector);
+
+    // Skip holes of removed items
+    while (--it->current >= 0) {
+        if (!(item = it->vector->list[it->current]))
+            continue;
+        if (!it->filter || it->filter(item))
             return item;
-        }
     }
     return NULL;
 }
@@ -384,24 +549,34 @@ vector_iterator_set_filter(vector_iter_t *it, int
 void
 vector_iterator_set_current(vector_iter_t *it, int current)
 {
+    // Positions are requested without holes
+    if (it->vector && it->vector->holes)
+        vector_compact(it->vector, NULL);
     it->current = current;
+    it->shift = (it->vector) ? it->vector->shift : 0;
 }
 
 void
 vector_iterator_set_last(vector_iter_t *it)
 {
-    it->current = vector_count(it->vector);
+    it->current = (it->vector) ? vector_used(it->vector) : 0;
+    it->shift = (it->vector) ? it->vector->shift : 0;
 }
 
 int
 vector_iterator_current(vector_iter_t *it)
 {
+    // Positions are returned without holes
+    vector_iterator_sync(it);
+    if (it->vector && it->vector->holes)
+        vector_compact(it->vector, &it->current);
     return it->current;
 }
 
 void
 vector_iterator_reset(vector_iter_t *it)
 {
-    vector_iterator_set_current(it, -1);
+    it->current = -1;
+    it->shift = (it->vector) ? it->vector->shift : 0;
 }
 
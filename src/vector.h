@@ -33,6 +33,7 @@
 
 #include "config.h"
 #include <stdint.h>
+#include <stddef.h>
 
 //! Shorter declaration of vector structure
 typedef struct vector vector_t;
@@ -41,27 +42,48 @@ typedef struct vector_iter vector_iter_t;
 
 /**
  * @brief Structure to hold a list of pointers
+ *
+ * List grows geometrically, so appending is amortized O(1). Removing
+ * items from the middle of the list leaves a hole instead of moving the
+ * following items. Holes are skipped by iterators and removed the next
+ * time items are accessed by position.
  */
 struct vector {
     //! Number of elements in list
     uint32_t count;
-    //! Total space in list (available + elements)
-    uint32_t limit;
-    //! Number of new spaces to be reallocated
-    uint8_t step;
+    //! Number of removed elements positions in list
+    uint32_t holes;
+    //! Lower bound of first removed element position in list
+    uint32_t hole;
+    //! Number of first positions removed from list (for iterators)
+    uint32_t shift;
+    //! Total space in list (available + elements + holes)
+    size_t limit;
+    //! Min number of new spaces to be reallocated
+    uint32_t step;
     //! Elements of the vector
     void **list;
+    //! Allocated memory for elements (list can start after removing first items)
+    void **base;
     //! Function to destroy one item
     void (*destroyer) (void *item);
     //! Function to sort each appended/inserted item
     void (*sorter) (vector_t *vector, void *item);
 };
 
+/**
+ * @brief Vector iterator
+ *
+ * Iterators walk list positions, so removing items (even the last
+ * returned one) while iterating does not skip any other item.
+ */
 struct vector_iter {
     //! Last requested position
     int current;
     //! Last vector position
     int current_vector;
+    //! Vector removed first positions when current was set
+    uint32_t shift;
     //! Vector that's being iterated
     vector_t *vector;
     //! Filter iterator results using this func
@@ -102,6 +124,24 @@ vector_destroy_items(vector_t *vector);
 vector_t *
 vector_clone(vector_t *original);
 
+/**
+ * @brief Sort all vector elements
+ *
+ * Sorter function of the vector is not used. Given compare function
+ * receives pointers to the vector elements as qsort does.
+ */
+void
+vector_sort(vector_t *vector, int (*cmp)(const void *a, const void *b));
+
+/**
+ * @brief Get the array of vector elements
+ *
+ * Array contains vector_count elements without holes. It is valid until
+ * the vector is modified.
+ */
+void **
+vector_list(vector_t *vector);
+
 /**
  * @brief Copy filtered elements to a new vector
  *
@@ -0,0 +1,87 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file bench.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Common functions for sngrep micro-benchmarks
+ *
+ * Benchmarks use deterministic input data so results of different
+ * builds can be compared. Each measure is printed in a single line
+ * with the number of operations, ns/op and ops/s.
+ */
+#ifndef __SNGREP_BENCH_H
+#define __SNGREP_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+//! Seed for benchmarks pseudo random numbers
+#define BENCH_SEED 0x5e9e9u
+
+/**
+ * @brief Get monotonic time in nanoseconds
+ */
+static inline uint64_t
+bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Get next deterministic pseudo random number
+ *
+ * @param state Generator state
+ */
+static inline uint32_t
+bench_rand(uint32_t *state)
+{
+    // xorshift32
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/**
+ * @brief Print the result of a benchmark
+ *
+ * @param name Benchmark name
+ * @param ops Number of measured operations
+ * @param nsecs Time spent in those operations
+ */
+static inline void
+bench_report(const char *name, uint64_t ops, uint64_t nsecs)
+{
+    if (!ops || !nsecs)
+        nsecs = ops = 1;
+
+    printf("%-40s %10" PRIu64 " ops %10.1f ns/op %12.0f ops/s\n",
+           name, ops, (double) nsecs / ops, (double) ops * 1000000000 / nsecs);
+    fflush(stdout);
+}
+
+#endif /* __SNGREP_BENCH_H */
@@ -0,0 +1,176 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file bench_capture.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * End-to-end throughput benchmark of offline captures
+ *
+ * Runs sngrep without interface reading each given pcap file and prints
+ * parsed packets, dialogs and calls per second and the peak resident
+ * memory of the process. Counters are taken from the last JSON report
+ * line printed by sngrep.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+//! Max length of a sngrep report line
+#define BENCH_LINE_LEN 8192
+
+/**
+ * @brief Get the numeric value of a report field
+ */
+static uint64_t
+bench_field(const char *line, const char *field)
+{
+    char key[64];
+    const char *value;
+
+    snprintf(key, sizeof(key), "\"%s\":", field);
+    if (!(value = strstr(line, key)))
+        return 0;
+    return strtoull(value + strlen(key), NULL, 10);
+}
+
+/**
+ * @brief Run sngrep reading the given file
+ *
+ * @return 0 if sngrep finished successfully, 1 otherwise
+ */
+static int
+bench_capture(const char *sngrep, const char *rcfile, const char *limit, const char *pcap, int rtp)
+{
+    char line[BENCH_LINE_LEN], last[BENCH_LINE_LEN] = "";
+    struct rusage usage;
+    uint64_t start, elapsed, packets, dialogs, calls;
+    double secs;
+    FILE *out;
+    pid_t pid;
+    int fds[2], status;
+
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    start = bench_now();
+    if ((pid = fork()) == 0) {
+        // Report lines are written to the pipe
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(sngrep, sngrep, "-F", "-f", rcfile, "-N", "-q", "-l", limit, "-I", pcap,
+              rtp ? "-r" : NULL, NULL);
+        perror(sngrep);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    if (pid < 0 || !(out = fdopen(fds[0], "r"))) {
+        perror("fork");
+        return 1;
+    }
+
+    // Only last report contains final counters
+    while (fgets(line, sizeof(line), out)) {
+        if (line[0] == '{')
+            strcpy(last, line);
+    }
+    fclose(out);
+
+    if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed reading %s\n", sngrep, pcap);
+        return 1;
+    }
+    elapsed = bench_now() - start;
+
+    packets = bench_field(last, "packets");
+    dialogs = bench_field(last, "dialogs");
+    calls = bench_field(last, "calls");
+    secs = (double) elapsed / 1000000000;
+
+    printf("%s\n", pcap);
+    printf("  elapsed   %10.2f s\n", secs);
+    printf("  packets   %10" PRIu64 " %12.0f packets/s\n", packets, packets / secs);
+    printf("  dialogs   %10" PRIu64 " %12.0f dialogs/s\n", dialogs, dialogs / secs);
+    printf("  calls     %10" PRIu64 " %12.0f calls/s\n", calls, calls / secs);
+    printf("  peak RSS  %10.1f MB\n", usage.ru_maxrss / 1024.0);
+    fflush(stdout);
+
+    return 0;
+}
+
+static void
+usage()
+{
+    printf("Usage: bench-capture [-s sngrep] [-l limit] [-r] file.pcap [file.pcap ...]\n\n"
+           "    -s FILE\t sngrep binary (default ../src/sngrep)\n"
+           "    -l NUM\t Capture limit of dialogs (default 2000000)\n"
+           "    -r\t\t Store RTP packets\n\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *sngrep = "../src/sngrep", *limit = "2000000";
+    char rcfile[] = "/tmp/sngrep-bench-XXXXXX";
+    FILE *rc;
+    int opt, fd, rtp = 0, ret = 0;
+
+    while ((opt = getopt(argc, argv, "s:l:rh")) != -1) {
+        switch (opt) {
+            case 's': sngrep = optarg; break;
+            case 'l': limit = optarg; break;
+            case 'r': rtp = 1; break;
+            default:
+                usage();
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        return 1;
+    }
+
+    // Configuration for sngrep JSON reports
+    if ((fd = mkstemp(rcfile)) < 0 || !(rc = fdopen(fd, "w"))) {
+        perror(rcfile);
+        return 1;
+    }
+    fprintf(rc, "set report.json on\nset report.interval 1\n");
+    fclose(rc);
+
+    for (; optind < argc && !ret; optind++)
+        ret = bench_capture(sngrep, rcfile, limit, argv[optind], rtp);
+
+    unlink(rcfile);
+
+    return ret;
+}
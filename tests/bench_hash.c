@@ -0,0 +1,94 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file bench_hash.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Benchmark of hash table insert and find operations
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include "hash.h"
+#include "bench.h"
+
+//! Number of keys stored in the table
+#define BENCH_HASH_KEYS 1000000
+//! Max length of each key
+#define BENCH_HASH_KEYLEN 48
+
+int main ()
+{
+    htable_t *table;
+    char *keys;
+    uint32_t seed = BENCH_SEED;
+    uint64_t start;
+    int i, found;
+
+    // Keys look like Call-IDs of common user agents
+    keys = malloc((size_t) BENCH_HASH_KEYS * BENCH_HASH_KEYLEN);
+    assert(keys);
+    for (i = 0; i < BENCH_HASH_KEYS; i++) {
+        snprintf(keys + (size_t) i * BENCH_HASH_KEYLEN, BENCH_HASH_KEYLEN,
+                 "%08x-%04x@10.%d.%d.%d", bench_rand(&seed), i & 0xffff,
+                 (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+    }
+#define KEY(n) (keys + (size_t) (n) * BENCH_HASH_KEYLEN)
+
+    table = htable_create(1024);
+    assert(table);
+
+    // Insert all keys, growing the table from its initial size
+    start = bench_now();
+    for (i = 0; i < BENCH_HASH_KEYS; i++)
+        htable_insert(table, KEY(i), KEY(i));
+    bench_report("htable_insert (1M keys)", BENCH_HASH_KEYS, bench_now() - start);
+    assert(htable_count(table) == BENCH_HASH_KEYS);
+
+    // Find existing keys in random order
+    seed = BENCH_SEED;
+    start = bench_now();
+    for (found = 0, i = 0; i < BENCH_HASH_KEYS; i++)
+        found += (htable_find(table, KEY(bench_rand(&seed) % BENCH_HASH_KEYS)) != NULL);
+    bench_report("htable_find hit (1M keys)", BENCH_HASH_KEYS, bench_now() - start);
+    assert(found == BENCH_HASH_KEYS);
+
+    // Find keys not stored in the table
+    start = bench_now();
+    for (found = 0, i = 0; i < BENCH_HASH_KEYS; i++)
+        found += (htable_find(table, "not-stored-call-id@10.0.0.1") != NULL);
+    bench_report("htable_find miss (1M keys)", BENCH_HASH_KEYS, bench_now() - start);
+    assert(found == 0);
+
+    // Remove all keys
+    start = bench_now();
+    for (i = 0; i < BENCH_HASH_KEYS; i++)
+        htable_remove(table, KEY(i));
+    bench_report("htable_remove (1M keys)", BENCH_HASH_KEYS, bench_now() - start);
+    assert(htable_count(table) == 0);
+
+    htable_destroy(table);
+    free(keys);
+
+    return 0;
+}
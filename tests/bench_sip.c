@@ -0,0 +1,446 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file bench_sip.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Benchmark of SIP parsing, RTP stream lookup and call filtering
+ *
+ * Messages are generated from a corpus of common user agents dialogs,
+ * replacing call specific tokens so each dialog is unique:
+ *  - {C} Call number
+ *  - {A} Caller IP address
+ *  - {B} Callee IP address
+ *  - {P} Media port
+ *  - {L} Length of the message body
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include "option.h"
+#include "setting.h"
+#include "capture.h"
+#include "filter.h"
+#include "sip.h"
+#include "rtp.h"
+#include "bench.h"
+
+//! Dialogs parsed in each round of sip_check_packet benchmark
+#define BENCH_SIP_CALLS 2000
+//! Rounds of sip_check_packet benchmark
+#define BENCH_SIP_ROUNDS 10
+//! Packets checked in sip_validate_packet benchmark
+#define BENCH_SIP_BUFFERS 50000
+//! Lookups for each rtp_find_stream benchmark
+#define BENCH_RTP_LOOKUPS 1000000
+//! Max size of a generated message
+#define BENCH_SIP_MSGLEN 2048
+
+/**
+ * @brief Message template of the corpus
+ */
+struct bench_msg
+{
+    //! Message headers, ending in empty line
+    const char *headers;
+    //! Message body or NULL
+    const char *body;
+};
+
+//! SDP offer sent by the caller
+#define BENCH_SDP_OFFER \
+    "v=0\r\no=root 1821 1821 IN IP4 {A}\r\ns=Asterisk PBX 16.2.1\r\nc=IN IP4 {A}\r\nt=0 0\r\n" \
+    "m=audio {P} RTP/AVP 8 0 101\r\na=rtpmap:8 PCMA/8000\r\na=rtpmap:0 PCMU/8000\r\n" \
+    "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\na=ptime:20\r\na=sendrecv\r\n"
+
+//! SDP answer sent by the callee
+#define BENCH_SDP_ANSWER \
+    "v=0\r\no=- 3723318952 3723318953 IN IP4 {B}\r\ns=pjmedia\r\nc=IN IP4 {B}\r\nt=0 0\r\n" \
+    "m=audio {P} RTP/AVP 8 101\r\na=rtcp:{P} IN IP4 {B}\r\na=rtpmap:8 PCMA/8000\r\n" \
+    "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\na=sendrecv\r\n"
+
+//! Common dialog headers
+#define BENCH_DIALOG(method, cseq) \
+    "Via: SIP/2.0/UDP {A}:5060;branch=z9hG4bK-{C}-" #cseq ";rport\r\n" \
+    "From: \"Alice\" <sip:alice@example.com>;tag=as{C}\r\n" \
+    "To: <sip:bob@example.com>;tag=bob{C}\r\n" \
+    "Call-ID: {C}-3c26700f@{A}\r\n" \
+    "CSeq: " #cseq " " method "\r\n"
+
+//! Corpus of dialog messages, in capture order
+static const struct bench_msg bench_corpus[] = {
+    {
+        "INVITE sip:bob@example.com SIP/2.0\r\n" BENCH_DIALOG("INVITE", 102)
+        "Max-Forwards: 70\r\nContact: <sip:alice@{A}:5060>\r\nUser-Agent: Asterisk PBX 16.2.1\r\n"
+        "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+        "Supported: replaces, timer\r\nContent-Type: application/sdp\r\nContent-Length: {L}\r\n\r\n",
+        BENCH_SDP_OFFER
+    },
+    {
+        "SIP/2.0 100 Trying\r\n" BENCH_DIALOG("INVITE", 102)
+        "Server: Kamailio (5.2.4 (x86_64/linux))\r\nContent-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "SIP/2.0 180 Ringing\r\n" BENCH_DIALOG("INVITE", 102)
+        "Contact: <sip:bob@{B}:5060;ob>\r\nAllow: PRACK, INVITE, ACK, BYE, CANCEL, UPDATE, INFO\r\n"
+        "Content-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "SIP/2.0 200 OK\r\n" BENCH_DIALOG("INVITE", 102)
+        "Contact: <sip:bob@{B}:5060;ob>\r\nAllow: PRACK, INVITE, ACK, BYE, CANCEL, UPDATE, INFO\r\n"
+        "Supported: replaces, 100rel, timer, norefersub\r\nSession-Expires: 1800;refresher=uac\r\n"
+        "Content-Type: application/sdp\r\nContent-Length: {L}\r\n\r\n",
+        BENCH_SDP_ANSWER
+    },
+    {
+        "ACK sip:bob@{B}:5060;ob SIP/2.0\r\n" BENCH_DIALOG("ACK", 102)
+        "Max-Forwards: 70\r\nContent-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "INFO sip:bob@{B}:5060;ob SIP/2.0\r\n" BENCH_DIALOG("INFO", 103)
+        "Max-Forwards: 70\r\nContent-Type: application/dtmf-relay\r\nContent-Length: {L}\r\n\r\n",
+        "Signal=1\r\nDuration=160\r\n"
+    },
+    {
+        "SIP/2.0 200 OK\r\n" BENCH_DIALOG("INFO", 103)
+        "Content-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "BYE sip:bob@{B}:5060;ob SIP/2.0\r\n" BENCH_DIALOG("BYE", 104)
+        "Max-Forwards: 70\r\nX-Asterisk-HangupCause: Normal Clearing\r\nContent-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "SIP/2.0 200 OK\r\n" BENCH_DIALOG("BYE", 104)
+        "Content-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "REGISTER sip:example.com SIP/2.0\r\n"
+        "Via: SIP/2.0/UDP {A}:5060;rport;branch=z9hG4bKPj{C}\r\nMax-Forwards: 70\r\n"
+        "From: <sip:1000@example.com>;tag={C}\r\nTo: <sip:1000@example.com>\r\n"
+        "Call-ID: reg-{C}@{A}\r\nCSeq: 27883 REGISTER\r\nUser-Agent: Linphone/3.12.0 (belle-sip/1.6.3)\r\n"
+        "Contact: <sip:1000@{A}:5060;ob>\r\nExpires: 300\r\nContent-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "SIP/2.0 401 Unauthorized\r\n"
+        "Via: SIP/2.0/UDP {A}:5060;rport=5060;branch=z9hG4bKPj{C}\r\n"
+        "From: <sip:1000@example.com>;tag={C}\r\nTo: <sip:1000@example.com>;tag=as7b2c1f0a\r\n"
+        "Call-ID: reg-{C}@{A}\r\nCSeq: 27883 REGISTER\r\n"
+        "WWW-Authenticate: Digest algorithm=MD5, realm=\"example.com\", nonce=\"5c3f8a21\"\r\n"
+        "Content-Length: 0\r\n\r\n",
+        NULL
+    },
+    {
+        "NOTIFY sip:1000@{A}:5060;ob SIP/2.0\r\n"
+        "Via: SIP/2.0/UDP {B}:5060;branch=z9hG4bK-n{C}\r\nMax-Forwards: 70\r\n"
+        "From: <sip:1000@example.com>;tag=n{C}\r\nTo: <sip:1000@example.com>;tag={C}\r\n"
+        "Call-ID: mwi-{C}@{B}\r\nCSeq: 2 NOTIFY\r\nEvent: message-summary\r\n"
+        "Subscription-State: active;expires=3600\r\nContent-Type: application/simple-message-summary\r\n"
+        "Content-Length: {L}\r\n\r\n",
+        "Messages-Waiting: yes\r\nMessage-Account: sip:1000@example.com\r\nVoice-Message: 2/8 (0/2)\r\n"
+    },
+};
+
+//! Number of messages in the corpus
+#define BENCH_CORPUS_SIZE (sizeof(bench_corpus) / sizeof(bench_corpus[0]))
+
+/**
+ * @brief Replace template tokens with values of the given call
+ *
+ * @return length of generated text
+ */
+static int
+bench_render(char *out, const char *tmpl, int call, int bodylen)
+{
+    char *start = out;
+
+    for (; *tmpl; tmpl++) {
+        if (*tmpl != '{' || !tmpl[1] || tmpl[2] != '}') {
+            *out++ = *tmpl;
+            continue;
+        }
+        switch (tmpl[1]) {
+            case 'C': out += sprintf(out, "%08x", call); break;
+            case 'A': out += sprintf(out, "10.1.%d.%d", (call >> 8) & 0xff, call & 0xff); break;
+            case 'B': out += sprintf(out, "10.2.%d.%d", (call >> 8) & 0xff, call & 0xff); break;
+            case 'P': out += sprintf(out, "%d", 10000 + (call % 25000) * 2); break;
+            case 'L': out += sprintf(out, "%d", bodylen); break;
+        }
+        tmpl += 2;
+    }
+    *out = '\0';
+
+    return out - start;
+}
+
+/**
+ * @brief Generate a corpus message of the given call
+ *
+ * @return length of the generated message
+ */
+static int
+bench_message(char *out, int msg, int call)
+{
+    char body[BENCH_SIP_MSGLEN];
+    int bodylen = 0, len;
+
+    if (bench_corpus[msg].body)
+        bodylen = bench_render(body, bench_corpus[msg].body, call, 0);
+
+    len = bench_render(out, bench_corpus[msg].headers, call, bodylen);
+    memcpy(out + len, body, bodylen);
+
+    return len + bodylen;
+}
+
+/**
+ * @brief Create a UDP packet with the given payload
+ */
+static packet_t *
+bench_packet(const char *payload, int len, int call)
+{
+    struct pcap_pkthdr header;
+    packet_t *packet;
+    frame_t *frame;
+    char src[ADDRESSLEN + 8], dst[ADDRESSLEN + 8];
+
+    sprintf(src, "10.1.%d.%d:5060", (call >> 8) & 0xff, call & 0xff);
+    sprintf(dst, "10.2.%d.%d:5060", (call >> 8) & 0xff, call & 0xff);
+
+    memset(&header, 0, sizeof(header));
+    header.ts.tv_sec = 1500000000 + call;
+    header.caplen = header.len = len;
+
+    packet = packet_create(4, IPPROTO_UDP, address_from_str(src), address_from_str(dst), 0);
+    frame = packet_add_frame(packet, &header, (const u_char *) payload);
+    packet_set_type(packet, PACKET_SIP_UDP);
+    packet_set_frame_payload(packet, frame->data, len);
+
+    return packet;
+}
+
+/**
+ * @brief Parse the whole corpus for the given number of calls
+ *
+ * @return time spent in sip_check_packet
+ */
+static uint64_t
+bench_store_calls(int first, int count, int messages)
+{
+    char payload[BENCH_SIP_MSGLEN];
+    packet_t **packets;
+    uint64_t start, elapsed;
+    int i, total = count * messages;
+
+    // Create all packets before measuring
+    packets = malloc(sizeof(packet_t *) * total);
+    assert(packets);
+    for (i = 0; i < total; i++) {
+        packets[i] = bench_packet(payload, bench_message(payload, i % messages, first + i / messages),
+                                  first + i / messages);
+    }
+
+    start = bench_now();
+    for (i = 0; i < total; i++) {
+        // Stored packets are released with their calls
+        if (sip_check_packet(packets[i]))
+            packets[i] = NULL;
+    }
+    elapsed = bench_now() - start;
+
+    // Release packets not stored in any call
+    for (i = 0; i < total; i++) {
+        if (packets[i])
+            packet_destroy(packets[i]);
+    }
+    free(packets);
+
+    return elapsed;
+}
+
+/**
+ * @brief Measure sip_check_packet with all corpus messages
+ */
+static void
+bench_check_packet()
+{
+    uint64_t elapsed = 0;
+    int i;
+
+    for (i = 0; i < BENCH_SIP_ROUNDS; i++) {
+        elapsed += bench_store_calls(i * BENCH_SIP_CALLS, BENCH_SIP_CALLS, BENCH_CORPUS_SIZE);
+        sip_calls_clear();
+    }
+
+    bench_report("sip_check_packet (corpus)",
+                 (uint64_t) BENCH_SIP_ROUNDS * BENCH_SIP_CALLS * BENCH_CORPUS_SIZE, elapsed);
+}
+
+/**
+ * @brief Measure sip_validate_packet with TCP segments
+ *
+ * Each segment contains one to four corpus messages, the last one
+ * may be truncated as it would continue in the next segment.
+ */
+static void
+bench_validate_packet()
+{
+    char payload[BENCH_SIP_MSGLEN * 4];
+    packet_t **packets;
+    uint32_t seed = BENCH_SEED;
+    uint64_t start, elapsed;
+    int i, j, len, count;
+
+    // Create all segments before measuring
+    packets = malloc(sizeof(packet_t *) * BENCH_SIP_BUFFERS);
+    assert(packets);
+    for (i = 0; i < BENCH_SIP_BUFFERS; i++) {
+        count = 1 + bench_rand(&seed) % 4;
+        for (len = 0, j = 0; j < count; j++)
+            len += bench_message(payload + len, (i + j) % BENCH_CORPUS_SIZE, i);
+        if (bench_rand(&seed) % 4 == 0)
+            len -= bench_rand(&seed) % 64;
+        packets[i] = bench_packet(payload, len, i);
+        packet_set_type(packets[i], PACKET_SIP_TCP);
+    }
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SIP_BUFFERS; i++)
+        sip_validate_packet(packets[i]);
+    elapsed = bench_now() - start;
+
+    for (i = 0; i < BENCH_SIP_BUFFERS; i++)
+        packet_destroy(packets[i]);
+    free(packets);
+
+    bench_report("sip_validate_packet (tcp segments)", BENCH_SIP_BUFFERS, elapsed);
+}
+
+/**
+ * @brief Measure RTP stream lookups with the given number of calls
+ *
+ * Calls only contain INVITE and 200 OK messages so each one has
+ * a stream for each direction.
+ */
+static void
+bench_find_stream(int calls)
+{
+    char name[64], src[ADDRESSLEN + 8], dst[ADDRESSLEN + 8];
+    address_t *srcs, *dsts;
+    uint32_t seed = BENCH_SEED;
+    uint64_t start;
+    int i, call, found;
+
+    // Precalculate addresses of each call streams
+    srcs = malloc(sizeof(address_t) * calls);
+    dsts = malloc(sizeof(address_t) * calls);
+    assert(srcs && dsts);
+    for (i = 0; i < calls; i++) {
+        sprintf(src, "10.2.%d.%d:%d", (i >> 8) & 0xff, i & 0xff, 10000 + (i % 25000) * 2);
+        sprintf(dst, "10.1.%d.%d:%d", (i >> 8) & 0xff, i & 0xff, 10000 + (i % 25000) * 2);
+        srcs[i] = address_from_str(src);
+        dsts[i] = address_from_str(dst);
+    }
+
+    start = bench_now();
+    for (found = 0, i = 0; i < BENCH_RTP_LOOKUPS; i++) {
+        call = bench_rand(&seed) % calls;
+        found += (rtp_find_stream(srcs[call], dsts[call]) != NULL);
+    }
+    sprintf(name, "rtp_find_stream (%d calls)", calls);
+    bench_report(name, BENCH_RTP_LOOKUPS, bench_now() - start);
+    assert(found == BENCH_RTP_LOOKUPS);
+
+    free(srcs);
+    free(dsts);
+}
+
+/**
+ * @brief Measure filters evaluation of all stored calls
+ *
+ * Filters are reset before each pass so every call is evaluated again.
+ */
+static void
+bench_filter_calls(int calls, int type, const char *expr, const char *desc)
+{
+    char name[64];
+    vector_iter_t it;
+    sip_call_t *call;
+    uint64_t start, elapsed = 0, ops = 0;
+    int i, passes = 1000000 / calls + 1;
+
+    filter_set(type, expr);
+
+    for (i = 0; i < passes; i++) {
+        filter_reset_calls();
+        it = sip_calls_iterator();
+        start = bench_now();
+        while ((call = vector_iterator_next(&it))) {
+            filter_check_call(call);
+            ops++;
+        }
+        elapsed += bench_now() - start;
+    }
+
+    filter_set(type, NULL);
+
+    sprintf(name, "filter_check_call (%s, %d calls)", desc, calls);
+    bench_report(name, ops, elapsed);
+}
+
+int main ()
+{
+    const int calls[] = { 1000, 10000 };
+    int i;
+
+    // Use default settings and store everything in memory
+    init_options(1);
+    capture_init(0, false, false);
+    sip_init(100000, 0, 0);
+
+    bench_check_packet();
+    bench_validate_packet();
+
+    for (i = 0; i < 2; i++) {
+        // Only INVITE and 200 OK with SDP
+        bench_store_calls(0, calls[i], 4);
+        assert(sip_calls_count() == calls[i]);
+        bench_find_stream(calls[i]);
+        bench_filter_calls(calls[i], FILTER_SIPFROM, "alice", "from");
+        bench_filter_calls(calls[i], FILTER_PAYLOAD, "Kamailio", "payload");
+        sip_calls_clear();
+    }
+
+    sip_deinit();
+    capture_deinit();
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file bench_vector.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Benchmark of vector append, insert and remove operations
+ */
+
+#include "config.h"
+#include <assert.h>
+#include "vector.h"
+#include "bench.h"
+
+//! Number of items appended to the vector
+#define BENCH_VECTOR_ITEMS 1000000
+//! Number of items inserted or removed in the middle of the vector
+#define BENCH_VECTOR_MOVES 5000
+
+int main ()
+{
+    vector_t *vector;
+    vector_iter_t it;
+    void *item;
+    int removed = 0;
+    uint32_t seed = BENCH_SEED;
+    uint64_t start;
+    uintptr_t i;
+
+    vector = vector_create(10, 10);
+    assert(vector);
+
+    // Append items (pointer values only, never dereferenced)
+    start = bench_now();
+    for (i = 1; i <= BENCH_VECTOR_ITEMS; i++)
+        vector_append(vector, (void *) i);
+    bench_report("vector_append (1M items)", BENCH_VECTOR_ITEMS, bench_now() - start);
+    assert(vector_count(vector) == BENCH_VECTOR_ITEMS);
+
+    // Insert items in random positions, like sorters do after appending
+    start = bench_now();
+    for (i = 0; i < BENCH_VECTOR_MOVES; i++) {
+        vector_append(vector, (void *) (BENCH_VECTOR_ITEMS + 1 + i));
+        vector_insert(vector, (void *) (BENCH_VECTOR_ITEMS + 1 + i), bench_rand(&seed) % (vector_count(vector) - 1));
+    }
+    bench_report("vector_insert (random position)", BENCH_VECTOR_MOVES, bench_now() - start);
+    assert(vector_count(vector) == BENCH_VECTOR_ITEMS + BENCH_VECTOR_MOVES);
+
+    // Remove the oldest items, like calls rotation does
+    start = bench_now();
+    for (i = 0; i < BENCH_VECTOR_MOVES; i++)
+        vector_remove(vector, vector_first(vector));
+    bench_report("vector_remove (first item)", BENCH_VECTOR_MOVES, bench_now() - start);
+
+    // Remove items from random positions
+    start = bench_now();
+    for (i = 0; i < BENCH_VECTOR_MOVES; i++)
+        vector_remove(vector, vector_item(vector, bench_rand(&seed) % vector_count(vector)));
+    bench_report("vector_remove (random item)", BENCH_VECTOR_MOVES, bench_now() - start);
+    assert(vector_count(vector) == BENCH_VECTOR_ITEMS - BENCH_VECTOR_MOVES);
+
+    // Remove items while iterating, like expired calls cleanup does
+    start = bench_now();
+    it = vector_iterator(vector);
+    while ((item = vector_iterator_next(&it)) && removed < BENCH_VECTOR_MOVES) {
+        if ((uintptr_t) item % 100 == 0) {
+            vector_remove(vector, item);
+            removed++;
+        }
+    }
+    bench_report("vector_remove (while iterating)", removed, bench_now() - start);
+    assert(vector_count(vector) == BENCH_VECTOR_ITEMS - BENCH_VECTOR_MOVES - removed);
+
+    vector_destroy(vector);
+
+    return 0;
+}
@@ -0,0 +1,782 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file gen_pcap.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Synthetic SIP/RTP capture generator for scale testing
+ *
+ * Writes a pcap file with the given number of dialogs. All random
+ * decisions are taken from a generator initialized with a seed, so the
+ * same options always produce the same capture.
+ *
+ * Dialogs start at the configured rate and run concurrently. Calls are
+ * INVITE dialogs with optional RTP streams in both directions, the rest
+ * are REGISTER and OPTIONS dialogs. Each dialog uses one transport (UDP,
+ * TCP or WebSocket), some messages are sent in several IP fragments or
+ * TCP segments and some requests are retransmitted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+//! Time between retransmissions of a request (us)
+#define GEN_RETRANS_TIME 500000
+//! Max length of a generated SIP message
+#define GEN_MSGLEN 4096
+//! RTP payload size (G711 20ms)
+#define GEN_RTP_PAYLOAD 160
+
+/**
+ * @brief Dialog message flow steps
+ */
+enum gen_step
+{
+    STEP_SPAWN = 0,
+    STEP_INVITE,
+    STEP_TRYING,
+    STEP_RINGING,
+    STEP_ANSWER,
+    STEP_ACK,
+    STEP_RTP,
+    STEP_BYE,
+    STEP_BYE_OK,
+    STEP_REGISTER,
+    STEP_UNAUTHORIZED,
+    STEP_REGISTER_AUTH,
+    STEP_REGISTER_OK,
+    STEP_OPTIONS,
+    STEP_OPTIONS_OK,
+    STEP_DONE
+};
+
+/**
+ * @brief Dialog transports
+ */
+enum gen_transport
+{
+    GEN_UDP = 0,
+    GEN_TCP,
+    GEN_WS,
+    GEN_TRANSPORTS
+};
+
+/**
+ * @brief Pending event of a dialog
+ *
+ * Events are sorted by time in a binary heap. After an event is written
+ * it is updated with the next step of its dialog and pushed again.
+ */
+struct gen_event
+{
+    //! Event time (us since capture start)
+    uint64_t time;
+    //! Dialog number
+    uint32_t dialog;
+    //! Dialog step
+    uint8_t step;
+    //! Event is a retransmission, dialog continues with the original
+    uint8_t retrans;
+    //! Dialog transport
+    uint8_t transport;
+    //! Dialog has RTP streams
+    uint8_t rtp;
+    //! RTP sequence numbers sent
+    uint32_t rtp_seq;
+    //! TCP sequence of caller and callee sides
+    uint32_t tcp_seq[2];
+    //! Time when RTP must stop and the call is hung up
+    uint64_t hangup;
+};
+
+/**
+ * @brief Generator configuration and state
+ */
+struct gen
+{
+    //! Output file
+    FILE *out;
+    //! Random generator state
+    uint64_t rand;
+    //! Number of dialogs to generate
+    uint32_t dialogs;
+    //! Dialogs started per second
+    uint32_t rate;
+    //! Call duration (us)
+    uint64_t duration;
+    //! Percent of INVITE dialogs
+    uint32_t calls;
+    //! Percent of calls with RTP
+    uint32_t rtp;
+    //! RTP packet interval (us)
+    uint64_t ptime;
+    //! Percent of dialogs per transport
+    uint32_t transports[GEN_TRANSPORTS];
+    //! Percent of messages sent in fragments or segments
+    uint32_t frags;
+    //! Percent of retransmitted requests
+    uint32_t retrans;
+    //! Pending events heap
+    struct gen_event *heap;
+    //! Pending events count
+    size_t count;
+    //! Pending events heap size
+    size_t size;
+    //! IP identification counter
+    uint16_t ip_id;
+    //! Written packets
+    uint64_t packets;
+    //! Written bytes
+    uint64_t bytes;
+};
+
+/**
+ * @brief Get next pseudo random number (xorshift64*)
+ */
+static uint64_t
+gen_rand(struct gen *gen)
+{
+    gen->rand ^= gen->rand >> 12;
+    gen->rand ^= gen->rand << 25;
+    gen->rand ^= gen->rand >> 27;
+    return gen->rand * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Check a random event with the given probability
+ */
+static int
+gen_chance(struct gen *gen, uint32_t percent)
+{
+    return (gen_rand(gen) % 100) < percent;
+}
+
+/**
+ * @brief Add an event to the pending events heap
+ */
+static void
+gen_push(struct gen *gen, struct gen_event *event)
+{
+    size_t pos, parent;
+
+    if (gen->count == gen->size) {
+        gen->size = (gen->size) ? gen->size * 2 : 1024;
+        if (!(gen->heap = realloc(gen->heap, sizeof(struct gen_event) * gen->size))) {
+            fprintf(stderr, "Can't allocate memory for pending events!\n");
+            exit(1);
+        }
+    }
+
+    // Move the event up until its parent is not later
+    for (pos = gen->count++; pos > 0; pos = parent) {
+        parent = (pos - 1) / 2;
+        if (gen->heap[parent].time <= event->time)
+            break;
+        gen->heap[pos] = gen->heap[parent];
+    }
+    gen->heap[pos] = *event;
+}
+
+/**
+ * @brief Remove the earliest event from the pending events heap
+ */
+static void
+gen_pop(struct gen *gen, struct gen_event *event)
+{
+    struct gen_event last;
+    size_t pos, child;
+
+    *event = gen->heap[0];
+    last = gen->heap[--gen->count];
+
+    // Move the last event down from the root
+    for (pos = 0; (child = pos * 2 + 1) < gen->count; pos = child) {
+        if (child + 1 < gen->count && gen->heap[child + 1].time < gen->heap[child].time)
+            child++;
+        if (last.time <= gen->heap[child].time)
+            break;
+        gen->heap[pos] = gen->heap[child];
+    }
+    gen->heap[pos] = last;
+}
+
+/**
+ * @brief Get the IP address of a dialog side
+ *
+ * Callers have their own address, callees are shared servers.
+ */
+static uint32_t
+gen_address(uint32_t dialog, int callee)
+{
+    if (callee)
+        return (10u << 24) | (255u << 16) | (dialog % 4 + 1);
+    return (10u << 24) | (dialog & 0xfffff);
+}
+
+/**
+ * @brief Get the media port of a dialog side
+ */
+static uint16_t
+gen_media_port(uint32_t dialog, int callee)
+{
+    return (callee ? 30000 : 10000) + (dialog % 10000) * 2;
+}
+
+/**
+ * @brief Compute IPv4 header checksum
+ */
+static uint16_t
+gen_ip_checksum(const uint8_t *hdr)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < 20; i += 2)
+        sum += (hdr[i] << 8) | hdr[i + 1];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return htons(~sum & 0xffff);
+}
+
+/**
+ * @brief Write an ethernet frame with an IPv4 packet
+ *
+ * @param frag IP flags and fragment offset field (host byte order)
+ */
+static void
+gen_write_ip(struct gen *gen, uint64_t time, uint32_t src, uint32_t dst, uint8_t proto,
+             uint16_t id, uint16_t frag, const uint8_t *data, uint32_t len)
+{
+    uint8_t frame[14 + 20 + GEN_MSGLEN + 64];
+    uint32_t rec[4];
+
+    // Ethernet header
+    memset(frame, 0, 14);
+    frame[1] = frame[7] = 0x02;
+    frame[5] = 0x01;
+    frame[11] = 0x02;
+    frame[12] = 0x08;
+
+    // IPv4 header
+    memset(frame + 14, 0, 20);
+    frame[14] = 0x45;
+    *(uint16_t *) (frame + 16) = htons(20 + len);
+    *(uint16_t *) (frame + 18) = htons(id);
+    *(uint16_t *) (frame + 20) = htons(frag);
+    frame[22] = 64;
+    frame[23] = proto;
+    *(uint32_t *) (frame + 26) = htonl(src);
+    *(uint32_t *) (frame + 30) = htonl(dst);
+    *(uint16_t *) (frame + 24) = gen_ip_checksum(frame + 14);
+    memcpy(frame + 34, data, len);
+
+    // Record header (native byte order, as the file header)
+    rec[0] = time / 1000000;
+    rec[1] = time % 1000000;
+    rec[2] = rec[3] = 34 + len;
+    fwrite(rec, sizeof(rec), 1, gen->out);
+    fwrite(frame, 34 + len, 1, gen->out);
+
+    gen->packets++;
+    gen->bytes += sizeof(rec) + 34 + len;
+}
+
+/**
+ * @brief Write a UDP datagram, optionally split in two IP fragments
+ */
+static void
+gen_write_udp(struct gen *gen, uint64_t time, uint32_t src, uint16_t sport, uint32_t dst,
+              uint16_t dport, const uint8_t *payload, uint32_t len, int fragment)
+{
+    uint8_t dgram[8 + GEN_MSGLEN];
+    uint16_t id = gen->ip_id++;
+    uint32_t half;
+
+    *(uint16_t *) (dgram) = htons(sport);
+    *(uint16_t *) (dgram + 2) = htons(dport);
+    *(uint16_t *) (dgram + 4) = htons(8 + len);
+    *(uint16_t *) (dgram + 6) = 0;
+    memcpy(dgram + 8, payload, len);
+    len += 8;
+
+    if (!fragment || len < 16) {
+        gen_write_ip(gen, time, src, dst, IPPROTO_UDP, id, 0, dgram, len);
+        return;
+    }
+
+    // Fragments must be multiple of 8 bytes, except the last one
+    half = (len / 2) & ~7u;
+    gen_write_ip(gen, time, src, dst, IPPROTO_UDP, id, 0x2000, dgram, half);
+    gen_write_ip(gen, time, src, dst, IPPROTO_UDP, id, half / 8, dgram + half, len - half);
+}
+
+/**
+ * @brief Write a TCP segment
+ */
+static void
+gen_write_tcp_segment(struct gen *gen, uint64_t time, uint32_t src, uint16_t sport, uint32_t dst,
+                      uint16_t dport, uint32_t seq, int push, const uint8_t *payload, uint32_t len)
+{
+    uint8_t seg[20 + GEN_MSGLEN + 16];
+
+    memset(seg, 0, 20);
+    *(uint16_t *) (seg) = htons(sport);
+    *(uint16_t *) (seg + 2) = htons(dport);
+    *(uint32_t *) (seg + 4) = htonl(seq);
+    *(uint32_t *) (seg + 8) = htonl(1);
+    seg[12] = 5 << 4;
+    seg[13] = push ? 0x18 : 0x10;
+    *(uint16_t *) (seg + 14) = htons(65535);
+    memcpy(seg + 20, payload, len);
+
+    gen_write_ip(gen, time, src, dst, IPPROTO_TCP, gen->ip_id++, 0x4000, seg, 20 + len);
+}
+
+/**
+ * @brief Write a SIP message of a dialog event using its transport
+ *
+ * @param callee Side of the dialog sending the message
+ */
+static void
+gen_write_sip(struct gen *gen, struct gen_event *ev, int callee, const char *msg, uint32_t len)
+{
+    uint8_t frame[GEN_MSGLEN + 16];
+    uint32_t src = gen_address(ev->dialog, callee), dst = gen_address(ev->dialog, !callee);
+    uint16_t sport = 5060, dport = 5060;
+    uint32_t i, half, *seq;
+    int fragment = gen_chance(gen, gen->frags);
+
+    if (ev->transport == GEN_UDP) {
+        gen_write_udp(gen, ev->time, src, sport, dst, dport, (const uint8_t *) msg, len, fragment);
+        return;
+    }
+
+    // Connection oriented transports use an ephemeral port in caller side
+    if (callee) {
+        sport = (ev->transport == GEN_WS) ? 8080 : 5060;
+        dport = 20000 + ev->dialog % 40000;
+    } else {
+        sport = 20000 + ev->dialog % 40000;
+        dport = (ev->transport == GEN_WS) ? 8080 : 5060;
+    }
+
+    if (ev->transport == GEN_WS) {
+        // Text frame with 16 bits length, caller messages are masked
+        frame[0] = 0x81;
+        frame[1] = 126 | (callee ? 0 : 0x80);
+        *(uint16_t *) (frame + 2) = htons(len);
+        if (callee) {
+            memcpy(frame + 4, msg, len);
+            len += 4;
+        } else {
+            *(uint32_t *) (frame + 4) = htonl(ev->dialog);
+            for (i = 0; i < len; i++)
+                frame[8 + i] = msg[i] ^ frame[4 + i % 4];
+            len += 8;
+        }
+    } else {
+        memcpy(frame, msg, len);
+    }
+
+    // Send the message in one or two segments
+    seq = &ev->tcp_seq[callee];
+    if (fragment && len > 1) {
+        half = len / 2;
+        gen_write_tcp_segment(gen, ev->time, src, sport, dst, dport, *seq, 0, frame, half);
+        gen_write_tcp_segment(gen, ev->time, src, sport, dst, dport, *seq + half, 1, frame + half, len - half);
+    } else {
+        gen_write_tcp_segment(gen, ev->time, src, sport, dst, dport, *seq, 1, frame, len);
+    }
+    *seq += len;
+}
+
+/**
+ * @brief Write RTP packets of both call directions
+ */
+static void
+gen_write_rtp(struct gen *gen, struct gen_event *ev)
+{
+    uint8_t rtp[12 + GEN_RTP_PAYLOAD];
+    int callee;
+
+    for (callee = 0; callee < 2; callee++) {
+        rtp[0] = 0x80;
+        rtp[1] = 8;
+        *(uint16_t *) (rtp + 2) = htons(ev->rtp_seq);
+        *(uint32_t *) (rtp + 4) = htonl(ev->rtp_seq * GEN_RTP_PAYLOAD);
+        *(uint32_t *) (rtp + 8) = htonl(ev->dialog * 2 + callee);
+        memset(rtp + 12, 0xd5, GEN_RTP_PAYLOAD);
+        gen_write_udp(gen, ev->time, gen_address(ev->dialog, callee), gen_media_port(ev->dialog, callee),
+                      gen_address(ev->dialog, !callee), gen_media_port(ev->dialog, !callee),
+                      rtp, sizeof(rtp), 0);
+    }
+    ev->rtp_seq++;
+}
+
+/**
+ * @brief Format the SIP message of a dialog step
+ *
+ * @return length of the message
+ */
+static int
+gen_format_sip(struct gen_event *ev, char *msg, int *callee)
+{
+    static const char *transports[] = { "UDP", "TCP", "WS" };
+    const char *tr = transports[ev->transport];
+    char body[1024] = "", ctype[64] = "";
+    char from[64], to[64], caller[16], server[16], start[128];
+    const char *method;
+    struct in_addr addr;
+    uint32_t id = ev->dialog;
+    int cseq = 1, totag;
+
+    addr.s_addr = htonl(gen_address(id, 0));
+    strcpy(caller, inet_ntoa(addr));
+    addr.s_addr = htonl(gen_address(id, 1));
+    strcpy(server, inet_ntoa(addr));
+    sprintf(from, "<sip:%u@example.com>;tag=%08x", 100000 + id, id);
+    sprintf(to, "<sip:%u@example.com>", 200000 + id % 1000);
+
+    *callee = 0;
+    switch (ev->step) {
+        case STEP_INVITE:
+            sprintf(start, "INVITE sip:%u@example.com SIP/2.0", 200000 + id % 1000);
+            method = "INVITE";
+            break;
+        case STEP_TRYING:
+            strcpy(start, "SIP/2.0 100 Trying");
+            method = "INVITE";
+            *callee = 1;
+            break;
+        case STEP_RINGING:
+            strcpy(start, "SIP/2.0 180 Ringing");
+            method = "INVITE";
+            *callee = 1;
+            break;
+        case STEP_ANSWER:
+            strcpy(start, "SIP/2.0 200 OK");
+            method = "INVITE";
+            *callee = 1;
+            break;
+        case STEP_ACK:
+            sprintf(start, "ACK sip:%u@%s:5060 SIP/2.0", 200000 + id % 1000, server);
+            method = "ACK";
+            break;
+        case STEP_BYE:
+            sprintf(start, "BYE sip:%u@%s:5060 SIP/2.0", 200000 + id % 1000, server);
+            method = "BYE";
+            cseq = 2;
+            break;
+        case STEP_BYE_OK:
+            strcpy(start, "SIP/2.0 200 OK");
+            method = "BYE";
+            cseq = 2;
+            *callee = 1;
+            break;
+        case STEP_REGISTER:
+        case STEP_REGISTER_AUTH:
+            strcpy(start, "REGISTER sip:example.com SIP/2.0");
+            method = "REGISTER";
+            cseq = (ev->step == STEP_REGISTER) ? 1 : 2;
+            sprintf(to, "<sip:%u@example.com>", 100000 + id);
+            break;
+        case STEP_UNAUTHORIZED:
+        case STEP_REGISTER_OK:
+            strcpy(start, (ev->step == STEP_UNAUTHORIZED) ? "SIP/2.0 401 Unauthorized" : "SIP/2.0 200 OK");
+            method = "REGISTER";
+            cseq = (ev->step == STEP_UNAUTHORIZED) ? 1 : 2;
+            sprintf(to, "<sip:%u@example.com>", 100000 + id);
+            *callee = 1;
+            break;
+        case STEP_OPTIONS:
+            sprintf(start, "OPTIONS sip:%s SIP/2.0", server);
+            method = "OPTIONS";
+            break;
+        default:
+            strcpy(start, "SIP/2.0 200 OK");
+            method = "OPTIONS";
+            *callee = 1;
+            break;
+    }
+
+    // Media descriptions of the call
+    if (ev->step == STEP_INVITE || ev->step == STEP_ANSWER) {
+        addr.s_addr = htonl(gen_address(id, *callee));
+        sprintf(body, "v=0\r\no=- %u %u IN IP4 %s\r\ns=-\r\nc=IN IP4 %s\r\nt=0 0\r\n"
+                "m=audio %u RTP/AVP 8 0 101\r\na=rtpmap:8 PCMA/8000\r\na=rtpmap:0 PCMU/8000\r\n"
+                "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\na=ptime:20\r\na=sendrecv\r\n",
+                id, ev->step, inet_ntoa(addr), inet_ntoa(addr), gen_media_port(id, *callee));
+        strcpy(ctype, "Content-Type: application/sdp\r\n");
+    }
+
+    // Dialog responses and in-dialog requests have the server tag
+    totag = (ev->step >= STEP_RINGING && ev->step <= STEP_BYE_OK) || ev->step == STEP_UNAUTHORIZED
+            || ev->step == STEP_REGISTER_OK || ev->step == STEP_OPTIONS_OK;
+
+    return sprintf(msg, "%s\r\nVia: SIP/2.0/%s %s:5060;branch=z9hG4bK%08x%02x;rport\r\n"
+                   "Max-Forwards: 70\r\nFrom: %s\r\nTo: %s%s\r\nCall-ID: %08x-%u@%s\r\n"
+                   "CSeq: %d %s\r\nContact: <sip:%u@%s:5060;transport=%s>\r\n"
+                   "User-Agent: sngrep-gen\r\n%s%sContent-Length: %zu\r\n\r\n%s",
+                   start, tr, caller, id, cseq, from, to, totag ? ";tag=srv" : "",
+                   id * 2654435761u, id, caller, cseq, method, *callee ? 200000 + id % 1000 : 100000 + id,
+                   *callee ? server : caller, tr,
+                   (ev->step == STEP_UNAUTHORIZED)
+                   ? "WWW-Authenticate: Digest realm=\"example.com\", nonce=\"5c3f8a21\", algorithm=MD5\r\n" : "",
+                   ctype, strlen(body), body);
+}
+
+/**
+ * @brief Get the next step of a dialog and its delay (us)
+ */
+static uint8_t
+gen_next_step(struct gen *gen, struct gen_event *ev, uint64_t *delay)
+{
+    switch (ev->step) {
+        case STEP_INVITE:
+            *delay = 20000;
+            return STEP_TRYING;
+        case STEP_TRYING:
+            *delay = 200000;
+            return STEP_RINGING;
+        case STEP_RINGING:
+            *delay = 1000000 + gen_rand(gen) % 4000000;
+            return STEP_ANSWER;
+        case STEP_ANSWER:
+            *delay = 20000;
+            ev->hangup = ev->time + *delay + gen->duration;
+            return STEP_ACK;
+        case STEP_ACK:
+        case STEP_RTP:
+            if (ev->rtp && ev->time + gen->ptime < ev->hangup) {
+                *delay = gen->ptime;
+                return STEP_RTP;
+            }
+            *delay = (ev->hangup > ev->time) ? ev->hangup - ev->time : 0;
+            return STEP_BYE;
+        case STEP_BYE:
+        case STEP_REGISTER:
+        case STEP_REGISTER_AUTH:
+        case STEP_OPTIONS:
+            *delay = 30000;
+            return ev->step + 1;
+        case STEP_UNAUTHORIZED:
+            *delay = 50000;
+            return STEP_REGISTER_AUTH;
+        default:
+            *delay = 0;
+            return STEP_DONE;
+    }
+}
+
+/**
+ * @brief Create the first event of a new dialog
+ */
+static void
+gen_spawn(struct gen *gen, uint32_t dialog, uint64_t time)
+{
+    struct gen_event ev;
+    uint32_t roll;
+    int i;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.time = time;
+    ev.dialog = dialog;
+    ev.tcp_seq[0] = (uint32_t) gen_rand(gen);
+    ev.tcp_seq[1] = (uint32_t) gen_rand(gen);
+
+    // Choose dialog type
+    if (gen_chance(gen, gen->calls)) {
+        ev.step = STEP_INVITE;
+        ev.rtp = gen_chance(gen, gen->rtp);
+    } else {
+        ev.step = gen_chance(gen, 50) ? STEP_REGISTER : STEP_OPTIONS;
+    }
+
+    // Choose dialog transport
+    roll = gen_rand(gen) % 100;
+    for (i = 0; i < GEN_TRANSPORTS - 1 && roll >= gen->transports[i]; i++)
+        roll -= gen->transports[i];
+    ev.transport = i;
+
+    gen_push(gen, &ev);
+}
+
+/**
+ * @brief Write events until all dialogs have finished
+ */
+static void
+gen_run(struct gen *gen)
+{
+    struct gen_event ev, copy;
+    char msg[GEN_MSGLEN];
+    uint32_t seq;
+    uint64_t delay, interval = 1000000 / gen->rate;
+    int callee, len;
+
+    // First event creates the dialogs
+    memset(&ev, 0, sizeof(ev));
+    ev.step = STEP_SPAWN;
+    gen_push(gen, &ev);
+
+    while (gen->count) {
+        gen_pop(gen, &ev);
+
+        if (ev.step == STEP_SPAWN) {
+            gen_spawn(gen, ev.dialog, ev.time);
+            if (++ev.dialog < gen->dialogs) {
+                // Next dialog with some jitter around configured rate
+                ev.time += interval / 2 + gen_rand(gen) % (interval + 1);
+                gen_push(gen, &ev);
+            }
+            continue;
+        }
+
+        if (ev.step == STEP_RTP) {
+            gen_write_rtp(gen, &ev);
+        } else {
+            len = gen_format_sip(&ev, msg, &callee);
+            seq = ev.tcp_seq[callee];
+            gen_write_sip(gen, &ev, callee, msg, len);
+
+            // Retransmissions are sent again with the same TCP sequence
+            if (!ev.retrans && !callee && ev.step != STEP_ACK && gen_chance(gen, gen->retrans)) {
+                copy = ev;
+                copy.retrans = 1;
+                copy.time += GEN_RETRANS_TIME;
+                copy.tcp_seq[callee] = seq;
+                gen_push(gen, &copy);
+            }
+        }
+
+        // Retransmissions don't continue the dialog
+        if (ev.retrans)
+            continue;
+
+        ev.step = gen_next_step(gen, &ev, &delay);
+        ev.time += delay;
+        if (ev.step != STEP_DONE)
+            gen_push(gen, &ev);
+    }
+}
+
+static void
+usage()
+{
+    printf("Usage: gen-pcap -o file.pcap [options]\n\n"
+           "    -o FILE\t Output pcap file\n"
+           "    -s SEED\t Random generator seed (default 1)\n"
+           "    -n NUM\t Number of dialogs (default 10000)\n"
+           "    -c RATE\t New dialogs per second (default 100)\n"
+           "    -d SECS\t Call duration after answer (default 30)\n"
+           "    -i PCT\t Percent of INVITE dialogs (default 70)\n"
+           "    -r PCT\t Percent of calls with RTP (default 10)\n"
+           "    -p MSECS\t RTP packet interval (default 20)\n"
+           "    -t U,T,W\t Percent of UDP, TCP and WebSocket dialogs (default 80,15,5)\n"
+           "    -f PCT\t Percent of fragmented messages (default 5)\n"
+           "    -R PCT\t Percent of retransmitted requests (default 2)\n\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gen gen;
+    const char *outfile = NULL;
+    uint32_t hdr[5];
+    uint16_t version[2] = { 2, 4 };
+    uint64_t seed = 1;
+    int opt;
+
+    memset(&gen, 0, sizeof(gen));
+    gen.dialogs = 10000;
+    gen.rate = 100;
+    gen.duration = 30 * 1000000ULL;
+    gen.calls = 70;
+    gen.rtp = 10;
+    gen.ptime = 20000;
+    gen.transports[GEN_UDP] = 80;
+    gen.transports[GEN_TCP] = 15;
+    gen.transports[GEN_WS] = 5;
+    gen.frags = 5;
+    gen.retrans = 2;
+
+    while ((opt = getopt(argc, argv, "o:s:n:c:d:i:r:p:t:f:R:h")) != -1) {
+        switch (opt) {
+            case 'o': outfile = optarg; break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'n': gen.dialogs = atoi(optarg); break;
+            case 'c': gen.rate = atoi(optarg); break;
+            case 'd': gen.duration = atoi(optarg) * 1000000ULL; break;
+            case 'i': gen.calls = atoi(optarg); break;
+            case 'r': gen.rtp = atoi(optarg); break;
+            case 'p': gen.ptime = atoi(optarg) * 1000ULL; break;
+            case 't':
+                if (sscanf(optarg, "%u,%u,%u", &gen.transports[GEN_UDP], &gen.transports[GEN_TCP],
+                           &gen.transports[GEN_WS]) != 3) {
+                    usage();
+                    return 1;
+                }
+                break;
+            case 'f': gen.frags = atoi(optarg); break;
+            case 'R': gen.retrans = atoi(optarg); break;
+            default:
+                usage();
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    if (!outfile || !gen.dialogs || !gen.rate || gen.rate > 1000000 || !gen.ptime) {
+        usage();
+        return 1;
+    }
+
+    if (!(gen.out = fopen(outfile, "wb"))) {
+        fprintf(stderr, "Unable to open %s for writing\n", outfile);
+        return 1;
+    }
+
+    // Seed must never be zero for xorshift generators
+    gen.rand = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    // Pcap file header: version 2.4, ethernet frames
+    hdr[0] = 0xa1b2c3d4;
+    hdr[1] = hdr[2] = 0;
+    hdr[3] = 65535;
+    hdr[4] = 1;
+    fwrite(hdr, sizeof(uint32_t), 1, gen.out);
+    fwrite(version, sizeof(version), 1, gen.out);
+    fwrite(hdr + 1, sizeof(uint32_t), 4, gen.out);
+
+    gen_run(&gen);
+
+    fclose(gen.out);
+    free(gen.heap);
+
+    fprintf(stderr, "%u dialogs, %llu packets, %llu bytes written to %s\n", gen.dialogs,
+            (unsigned long long) gen.packets, (unsigned long long) gen.bytes, outfile);
+
+    return 0;
+}
@@ -28,10 +28,21 @@
 
 #include "config.h"
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include "vector.h"
 #include "util.h"
 
+/**
+ * @brief Compare vector items by their pointer value
+ */
+static int
+vector_test_cmp(const void *a, const void *b)
+{
+    intptr_t one = *(intptr_t *) a, two = *(intptr_t *) b;
+    return (one > two) - (one < two);
+}
+
 int main ()
 {
     vector_t *vector;
@@ -76,5 +87,94 @@ int main ()
     vector_remove(vector, vector_item(vector, 12));
     assert(vector_count(vector) == 15);
 
+    // Rotation test: remove first item and append a new one
+    int i;
+    void *second;
+    for (i = 0; i < 100; i++) {
+        second = vector_item(vector, 1);
+        vector_remove(vector, vector_first(vector));
+        assert(vector_first(vector) == second);
+        vector_append(vector, sng_malloc(32));
+        assert(vector_count(vector) == 15);
+    }
+    assert(vector_item(vector, vector_count(vector)) == 0);
+
+    // Clear all items
+    vector_clear(vector);
+    assert(vector_count(vector) == 0);
+    assert(vector_first(vector) == 0);
+    vector_destroy(vector);
+
+    // Holes test: remove items while iterating
+    intptr_t value, prev;
+    vector_iter_t it;
+    int visited = 0;
+    vector = vector_create(0, 4);
+    for (i = 1; i <= 50; i++)
+        vector_append(vector, (void *) (intptr_t) i);
+    it = vector_iterator(vector);
+    while ((value = (intptr_t) vector_iterator_next(&it))) {
+        visited++;
+        // Remove current item
+        if (value % 3 == 0)
+            vector_remove(vector, (void *) value);
+        // Remove a middle item not visited yet
+        if (value == 10)
+            vector_remove(vector, (void *) 31);
+    }
+    // All items but the removed middle one are visited once
+    assert(visited == 49);
+    assert(vector_count(vector) == 50 - 16 - 1);
+    assert(vector_first(vector) == (void *) 1);
+    assert(vector_last(vector) == (void *) 50);
+
+    // Remaining items keep their order
+    it = vector_iterator(vector);
+    prev = 0;
+    while ((value = (intptr_t) vector_iterator_next(&it))) {
+        assert(value > prev && value % 3 && value != 31);
+        prev = value;
+    }
+
+    // Iterator positions do not count holes
+    it = vector_iterator(vector);
+    while ((value = (intptr_t) vector_iterator_next(&it)) != 20);
+    assert(vector_iterator_current(&it) == 13);
+    assert(vector_index(vector, (void *) 20) == 13);
+    assert(vector_item(vector, vector_iterator_current(&it)) == (void *) 20);
+    assert(vector_iterator_next(&it) == (void *) 22);
+
+    // Insert an item after removing middle items
+    vector_remove(vector, (void *) 40);
+    vector_remove(vector, (void *) 25);
+    vector_append(vector, (void *) 100);
+    vector_insert(vector, (void *) 100, 0);
+    assert(vector_count(vector) == 50 - 16 - 3 + 1);
+    assert(vector_first(vector) == (void *) 100);
+    assert(vector_item(vector, 1) == (void *) 1);
+    assert(vector_last(vector) == (void *) 50);
+    assert(vector_index(vector, (void *) 40) == -1);
+
+    // Sort items after removing middle items
+    vector_remove(vector, (void *) 26);
+    vector_sort(vector, vector_test_cmp);
+    assert(vector_count(vector) == 50 - 16 - 4 + 1);
+    assert(vector_first(vector) == (void *) 1);
+    assert(vector_last(vector) == (void *) 100);
+    for (i = 1; i < vector_count(vector); i++)
+        assert(vector_item(vector, i - 1) < vector_item(vector, i));
+    assert(vector_item(vector, vector_count(vector)) == 0);
+    vector_destroy(vector);
+
+    // Growth test: steps bigger than 255 positions
+    vector = vector_create(1, 1000);
+    for (i = 1; i <= 3000; i++)
+        vector_append(vector, (void *) (intptr_t) i);
+    assert(vector_count(vector) == 3000);
+    assert(vector->limit >= 3000);
+    for (i = 0; i < 3000; i++)
+        assert(vector_item(vector, i) == (void *) (intptr_t) (i + 1));
+    vector_destroy(vector);
+
     return 0;
 }
@@ -97,8 +97,60 @@ int main ()
     // Search a not found entry
     assert(htable_find(table, "key7") == NULL);
 
+    // Remove the first entry
+    htable_remove(table, "key");
+    assert(htable_count(table) == 0);
+
+    // Fill the table beyond its initial size
+    char keys[5000][16];
+    int i;
+    for (i = 0; i < 5000; i++) {
+        sprintf(keys[i], "callid%d", i);
+        htable_insert(table, keys[i], keys[i]);
+    }
+    assert(htable_count(table) == 5000);
+
+    // All entries are found after growing
+    for (i = 0; i < 5000; i++)
+        assert(htable_find(table, keys[i]) == keys[i]);
+
+    // Remove half the entries
+    for (i = 0; i < 5000; i += 2)
+        htable_remove(table, keys[i]);
+    assert(htable_count(table) == 2500);
+
+    // Remaining entries are still found
+    for (i = 0; i < 5000; i++)
+        assert(htable_find(table, keys[i]) == ((i % 2) ? keys[i] : NULL));
+
+    // Empty the table
+    htable_clear(table);
+    assert(htable_count(table) == 0);
+    assert(htable_find(table, keys[1]) == NULL);
+
     // Destroy the table
     htable_destroy(table);
 
+    // Binary keys can contain zeros and are compared by their length
+    unsigned char bins[1000][8];
+    table = htable_create_fixed(10, sizeof(bins[0]));
+    assert(table);
+    memset(bins, 0, sizeof(bins));
+    for (i = 0; i < 1000; i++) {
+        bins[i][6] = i >> 8;
+        bins[i][7] = i & 0xff;
+        htable_insert(table, bins[i], bins[i]);
+    }
+    assert(htable_count(table) == 1000);
+
+    // Keys with the same content are found
+    unsigned char bin[8] = { 0, 0, 0, 0, 0, 0, 2, 1 };
+    assert(htable_find(table, bin) == bins[513]);
+    htable_remove(table, bin);
+    assert(htable_find(table, bins[513]) == NULL);
+    assert(htable_find(table, bins[512]) == bins[512]);
+    assert(htable_count(table) == 999);
+    htable_destroy(table);
+
     return 0;
 }
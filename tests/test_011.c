@@ -0,0 +1,165 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_011.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of SIP headers scanner
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <string.h>
+#include "sip_parser.h"
+
+/**
+ * @brief Check a scanned value is the given text
+ */
+static int
+value_is(const char *payload, sip_hdr_t hdr, const char *text)
+{
+    return hdr.len == strlen(text) && !strncmp(payload + hdr.off, text, hdr.len);
+}
+
+int main ()
+{
+    sip_headers_t hdrs;
+    sip_hdr_t value;
+    const char *payload;
+    char partial[512];
+    size_t len;
+
+    // Request with full header names
+    payload = "INVITE sip:bob@example.com SIP/2.0\r\n"
+              "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK1\r\n"
+              "From: \"Alice\" <sip:alice@example.com>;tag=1\r\n"
+              "To: <sip:bob@example.com>\r\n"
+              "Call-ID: abc123@10.0.0.1\r\n"
+              "CSeq: 1 INVITE\r\n"
+              "Content-Length: 4\r\n"
+              "\r\n"
+              "body";
+    assert(sip_parser_scan(payload, strlen(payload), "", &hdrs) == 0);
+    assert(hdrs.valid);
+    assert(value_is(payload, hdrs.method, "INVITE"));
+    assert(hdrs.response.len == 0 && hdrs.code.len == 0);
+    assert(value_is(payload, hdrs.callid, "abc123@10.0.0.1"));
+    assert(value_is(payload, hdrs.cseq, "1"));
+    assert(value_is(payload, hdrs.from, "alice@example.com"));
+    assert(value_is(payload, hdrs.to, "bob@example.com"));
+    assert(value_is(payload, hdrs.cl, "4"));
+    assert(hdrs.body == (int32_t) (strlen(payload) - 4));
+    assert(hdrs.count == 6);
+
+    // Response with compact header names
+    payload = "SIP/2.0 180 Ringing\r\n"
+              "v: SIP/2.0/TCP 10.0.0.1:5060;branch=z9hG4bK2\r\n"
+              "f: <sip:alice@example.com>;tag=1\r\n"
+              "t: <sip:bob@example.org>;tag=2\r\n"
+              "i: def456\r\n"
+              "CSeq: 2 INVITE\r\n"
+              "l: 0\r\n"
+              "\r\n";
+    assert(sip_parser_scan(payload, strlen(payload), "", &hdrs) == 0);
+    assert(hdrs.valid);
+    assert(hdrs.method.len == 0);
+    assert(value_is(payload, hdrs.code, "180"));
+    assert(value_is(payload, hdrs.response, "180 Ringing"));
+    assert(value_is(payload, hdrs.callid, "def456"));
+    assert(value_is(payload, hdrs.to, "bob@example.org"));
+    assert(value_is(payload, hdrs.cl, "0"));
+    assert(hdrs.body == (int32_t) strlen(payload));
+
+    // Compact names are found in the index by their full names
+    assert(sip_parser_header(payload, hdrs.index, hdrs.count, "Call-ID", &value) == 0);
+    assert(value_is(payload, value, "def456"));
+    assert(sip_parser_header(payload, hdrs.index, hdrs.count, "content-length", &value) == 0);
+    assert(value_is(payload, value, "0"));
+    assert(sip_parser_header(payload, hdrs.index, hdrs.count, "Contact", &value) == 1);
+
+    // Folded lines belong to the previous header
+    payload = "OPTIONS sip:bob@example.com SIP/2.0\r\n"
+              "Subject: first line\r\n"
+              " To: <sip:fake@example.net>\r\n"
+              "\tCall-ID: fake\r\n"
+              "Call-ID: ghi789\r\n"
+              "X-Custom: value\r\n"
+              "\r\n";
+    assert(sip_parser_scan(payload, strlen(payload), "X-Custom", &hdrs) == 0);
+    assert(hdrs.to.len == 0);
+    assert(value_is(payload, hdrs.callid, "ghi789"));
+    assert(value_is(payload, hdrs.xcallid, "value"));
+    assert(hdrs.count == 3);
+    assert(sip_parser_header(payload, hdrs.index, hdrs.count, "subject", &value) == 0);
+    assert(value_is(payload, value, "first line"));
+
+    // Not SIP start lines
+    payload = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    assert(sip_parser_scan(payload, strlen(payload), "", &hdrs) == 1);
+    assert(!hdrs.valid);
+    assert(!sip_parser_start(payload, strlen(payload)));
+    payload = "SIP/2.0 OK\r\n\r\n";
+    assert(sip_parser_scan(payload, strlen(payload), "", &hdrs) == 1);
+
+    // Header block without the empty line is not complete
+    payload = "BYE sip:bob@example.com SIP/2.0\r\n"
+              "Call-ID: jkl012\r\n"
+              "Content-Length: 0\r\n";
+    assert(sip_parser_scan(payload, strlen(payload), "", &hdrs) == 0);
+    assert(value_is(payload, hdrs.callid, "jkl012"));
+    assert(hdrs.body == -1);
+    assert(sip_parser_body(payload, strlen(payload), 0) == -1);
+
+    // Line feeds without carriage returns also end the header block
+    payload = "BYE sip:bob@example.com SIP/2.0\n"
+              "Call-ID: jkl012\n"
+              "\n";
+    assert(sip_parser_scan(payload, strlen(payload), "", &hdrs) == 0);
+    assert(hdrs.body == (int32_t) strlen(payload));
+    assert(sip_parser_body(payload, strlen(payload), 0) == (int32_t) strlen(payload));
+
+    // Content-Length value split between two TCP segments
+    payload = "MESSAGE sip:bob@example.com SIP/2.0\r\n"
+              "Call-ID: mno345\r\n"
+              "Content-Length: 12\r\n"
+              "\r\n"
+              "Hello world!";
+    len = strstr(payload, "12\r\n") - payload + 1;
+    memcpy(partial, payload, len);
+    assert(sip_parser_scan(partial, len, "", &hdrs) == 0);
+    assert(value_is(partial, hdrs.cl, "1"));
+    assert(hdrs.body == -1);
+    assert(sip_parser_body(partial, len, 0) == -1);
+
+    // Next segment completes the value and the header block
+    memcpy(partial + len, payload + len, strlen(payload) - len);
+    assert(sip_parser_body(partial, strlen(payload), len - 2) == (int32_t) (strlen(payload) - 12));
+    assert(sip_parser_scan(partial, strlen(payload), "", &hdrs) == 0);
+    assert(value_is(partial, hdrs.cl, "12"));
+    assert(hdrs.body == (int32_t) (strlen(payload) - 12));
+
+    // Call-ID can be found without scanning other headers
+    assert(sip_parser_callid(payload, strlen(payload), &value) == 0);
+    assert(value_is(payload, value, "mno345"));
+
+    return 0;
+}
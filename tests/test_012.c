@@ -0,0 +1,127 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_012.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of message diff spans
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include "sip_msg.h"
+#include "curses/ui_msg_diff.h"
+
+/**
+ * @brief Create a message without call with the given payload
+ */
+static sip_msg_t *
+msg_with_payload(const char *payload)
+{
+    address_t addr = { };
+    sip_msg_t *msg = calloc(1, sizeof(sip_msg_t));
+    assert(msg);
+    msg->packet = packet_create(4, IPPROTO_UDP, addr, addr, 0);
+    assert(msg->packet);
+    packet_set_payload(msg->packet, (u_char *) payload, strlen(payload));
+    return msg;
+}
+
+/**
+ * @brief Check a span has the given type, starts and counts
+ */
+static int
+span_is(msg_diff_span_t *span, int type, int start1, int count1, int start2, int count2)
+{
+    return span->type == type
+           && span->start[0] == start1 && span->count[0] == count1
+           && span->start[1] == start2 && span->count[1] == count2;
+}
+
+/**
+ * @brief Calculate differences between two payloads
+ */
+static void
+diff_payloads(msg_diff_info_t *info, const char *one, const char *two)
+{
+    packet_destroy(info->one->packet);
+    packet_destroy(info->two->packet);
+    free(info->one);
+    free(info->two);
+    info->one = msg_with_payload(one);
+    info->two = msg_with_payload(two);
+    assert(msg_diff_calculate(info) == 0);
+}
+
+int main ()
+{
+    msg_diff_info_t info = { };
+    info.one = msg_with_payload("");
+    info.two = msg_with_payload("");
+
+    // Equal messages have no spans
+    diff_payloads(&info, "A\nB\nC\nD\n", "A\nB\nC\nD\n");
+    assert(info.linecnt[0] == 4 && info.linecnt[1] == 4);
+    assert(info.spancnt == 0);
+
+    // Line inserted in second message
+    diff_payloads(&info, "A\nB\nC\nD\n", "A\nB\nX\nC\nD\n");
+    assert(info.spancnt == 1);
+    assert(span_is(&info.spans[0], MSG_DIFF_INSERT, 2, 0, 2, 1));
+
+    // Line deleted from first message
+    diff_payloads(&info, "A\nB\nC\nD\n", "A\nC\nD\n");
+    assert(info.spancnt == 1);
+    assert(span_is(&info.spans[0], MSG_DIFF_DELETE, 1, 1, 1, 0));
+
+    // Line changed between messages
+    diff_payloads(&info, "A\nB\nC\nD\n", "A\nY\nC\nD\n");
+    assert(info.spancnt == 1);
+    assert(span_is(&info.spans[0], MSG_DIFF_CHANGE, 1, 1, 1, 1));
+
+    // Line break is part of the compared line
+    diff_payloads(&info, "A\nB\nC\nD", "A\nB\nC\nD\n");
+    assert(info.spancnt == 1);
+    assert(span_is(&info.spans[0], MSG_DIFF_CHANGE, 3, 1, 3, 1));
+
+    // Change, delete and insert in the same messages
+    diff_payloads(&info, "A\nB\nC\nD\nE\n", "A\nX\nC\nE\nF\n");
+    assert(info.spancnt == 3);
+    assert(span_is(&info.spans[0], MSG_DIFF_CHANGE, 1, 1, 1, 1));
+    assert(span_is(&info.spans[1], MSG_DIFF_DELETE, 3, 1, 3, 0));
+    assert(span_is(&info.spans[2], MSG_DIFF_INSERT, 5, 0, 4, 1));
+
+    // Changed lines are flagged in both messages
+    assert(!info.lines[0][0].changed && info.lines[0][1].changed);
+    assert(info.lines[0][3].changed && !info.lines[0][4].changed);
+    assert(info.lines[1][1].changed && info.lines[1][4].changed);
+
+    // Whole message replaced
+    diff_payloads(&info, "A\nB\n", "X\nY\nZ\n");
+    assert(info.spancnt == 1);
+    assert(span_is(&info.spans[0], MSG_DIFF_CHANGE, 0, 2, 0, 3));
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_013.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of literal strings matcher
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <string.h>
+#include "strmatch.h"
+
+/**
+ * @brief Check if matcher finds a pattern in the given text
+ */
+static bool
+find(strmatch_t *sm, const char *text)
+{
+    return strmatch_find(sm, text, strlen(text));
+}
+
+int main ()
+{
+    strmatch_t *sm;
+    char literal[64];
+
+    // Overlapping patterns
+    sm = strmatch_create(false);
+    assert(sm);
+    assert(strmatch_add(sm, "he") == 0);
+    assert(strmatch_add(sm, "she") == 0);
+    assert(strmatch_add(sm, "his") == 0);
+    assert(strmatch_add(sm, "hers") == 0);
+    // Nothing matches before compiling
+    assert(!find(sm, "she"));
+    assert(strmatch_compile(sm) == 0);
+    // Patterns can not be added once compiled
+    assert(strmatch_add(sm, "other") != 0);
+    assert(find(sm, "ushers"));
+    assert(find(sm, "sh he"));
+    assert(find(sm, "xxxhis"));
+    // Pattern found through a failure transition
+    assert(find(sm, "shis"));
+    // Pattern prefixes are not matches
+    assert(!find(sm, "sh"));
+    assert(!find(sm, "h-i-s"));
+    assert(!find(sm, ""));
+    // Matches are case sensitive
+    assert(!find(sm, "SHE HIS"));
+    // Only the given length is scanned
+    assert(!strmatch_find(sm, "ushers", 3));
+    assert(strmatch_find(sm, "ushers", 4));
+    strmatch_destroy(sm);
+
+    // Pattern contained in a longer one ends a match
+    sm = strmatch_create(false);
+    assert(strmatch_add(sm, "abcd") == 0);
+    assert(strmatch_add(sm, "bc") == 0);
+    assert(strmatch_compile(sm) == 0);
+    assert(find(sm, "abce"));
+    assert(!find(sm, "abdc"));
+    strmatch_destroy(sm);
+
+    // Case insensitive patterns
+    sm = strmatch_create(true);
+    assert(strmatch_add(sm, "INVITE") == 0);
+    assert(strmatch_add(sm, "call-id:") == 0);
+    assert(strmatch_compile(sm) == 0);
+    assert(find(sm, "invite sip:bob@example.com"));
+    assert(find(sm, "Invite"));
+    assert(find(sm, "\r\nCALL-ID: abc"));
+    assert(!find(sm, "INVIT"));
+    assert(!find(sm, "call_id:"));
+    strmatch_destroy(sm);
+
+    // Single pattern, case sensitive and not
+    sm = strmatch_create(false);
+    assert(strmatch_add(sm, "BYE") == 0);
+    assert(strmatch_compile(sm) == 0);
+    assert(find(sm, "SIP BYE"));
+    assert(!find(sm, "SIP bye"));
+    strmatch_destroy(sm);
+    sm = strmatch_create(true);
+    assert(strmatch_add(sm, "BYE") == 0);
+    assert(strmatch_compile(sm) == 0);
+    assert(find(sm, "SIP bye"));
+    strmatch_destroy(sm);
+
+    // Empty patterns and matchers are rejected
+    sm = strmatch_create(false);
+    assert(strmatch_add(sm, "") != 0);
+    assert(strmatch_compile(sm) != 0);
+    strmatch_destroy(sm);
+
+    // Required literals of regular expressions
+    assert(strmatch_regex_literal("INVITE", literal, sizeof(literal)));
+    assert(!strcmp(literal, "INVITE"));
+    assert(!strmatch_regex_literal("^INVITE sip:[0-9]+", literal, sizeof(literal)));
+    assert(!strcmp(literal, "INVITE sip:"));
+    assert(!strmatch_regex_literal("INVITE|BYE", literal, sizeof(literal)));
+    assert(!strcmp(literal, ""));
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2018 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2018 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_014.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of SIP attributes titles
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <string.h>
+#include "setting.h"
+#include "sip_attr.h"
+
+int main ()
+{
+    // Attributes without title use their description
+    assert(!strcmp(sip_attr_get_title(SIP_ATTR_CALLID), "Call-ID"));
+
+    // Custom header column without header name (default settings)
+    assert(setting_get_value(SETTING_SIP_HEADER_CUSTOM) == NULL);
+    assert(!strcmp(sip_attr_get_title(SIP_ATTR_HEADER), "Custom Header"));
+
+    // Custom header column is titled with the header name
+    setting_set_value(SETTING_SIP_HEADER_CUSTOM, "X-Call-ID");
+    assert(!strcmp(sip_attr_get_title(SIP_ATTR_HEADER), "X-Call-ID"));
+
+    return 0;
+}